@@ -1,12 +1,21 @@
 /**
  * Claude Session Sync
  * Detects Claude processes in screen sessions and manages claudeSessionId in JSON
+ *
+ * A pass never blocks the extension host: everything runs as child
+ * processes and file reads that are awaited. The logs and Claude's history
+ * are read incrementally, only the bytes appended since the last pass, so
+ * a pass that finds nothing new costs a `screen -ls` and a query per session.
  */
 
 import * as fs from 'fs';
 import * as path from 'path';
 import * as os from 'os';
-import { execSync } from 'child_process';
+import * as readline from 'readline';
+import * as zlib from 'zlib';
+import { execFile } from 'child_process';
+import { StringDecoder } from 'string_decoder';
+import { promisify } from 'util';
 import {
     getTerminalNameFromJson,
     getAllWindowIds,
@@ -15,6 +24,9 @@ import {
     removeClaudeSessionId
 } from './json-utils';
 
+const execFileAsync = promisify(execFile);
+const gunzipAsync = promisify(zlib.gunzip);
+
 let projectName: string;
 let workspacePath: string;
 let screenBinary: string = 'immorterm';
@@ -37,15 +49,12 @@ export interface ScreenSession {
 /**
  * Get all screen sessions for this project and detect Claude processes
  */
-export function getScreenSessionsWithClaudeStatus(): ScreenSession[] {
+export async function getScreenSessionsWithClaudeStatus(): Promise<ScreenSession[]> {
     const sessions: ScreenSession[] = [];
 
     try {
         logFn(`[claude-sync] Using screen binary: ${screenBinary}, project: ${projectName}`);
-        const screenList = execSync(`${screenBinary} -ls 2>/dev/null || true`, {
-            encoding: 'utf8',
-            timeout: 5000
-        });
+        const screenList = await runQuiet(screenBinary, ['-ls']);
 
         // Parse ImmorTerm sessions - check both Attached and Detached
         const sessionRegex = new RegExp(`(\\d+)\\.${projectName}-(\\S+)\\s+\\((Attached|Detached)\\)`, 'g');
@@ -53,23 +62,32 @@ export function getScreenSessionsWithClaudeStatus(): ScreenSession[] {
         let match;
 
         const seenWindowIds = new Set<string>();
-        let debugOnce = true;
+        const found: { screenPid: string; windowId: string; status: string }[] = [];
 
         while ((match = sessionRegex.exec(screenList)) !== null) {
-            const screenPid = match[1];
             const windowId = match[2];
-            const status = match[3];
-
             if (seenWindowIds.has(windowId)) continue;
             seenWindowIds.add(windowId);
+            found.push({ screenPid: match[1], windowId, status: match[3] });
+        }
 
-            // Check ALL sessions for Claude processes, not just Attached ones
-            // Claude can be running in a Detached session (e.g., after laptop restart)
-            const hasClaudeProcess = checkForClaudeProcess(screenPid, debugOnce);
-            if (debugOnce) {
+        // Check ALL sessions for Claude processes, not just Attached ones
+        // Claude can be running in a Detached session (e.g., after laptop restart)
+        const answers = await Promise.all(found.map(({ screenPid, windowId }) =>
+            queryClaudeProcess(`${screenPid}.${projectName}-${windowId}`)));
+
+        // Sessions that could not be asked fall back to one process table
+        let processes: ProcessEntry[] | null = null;
+        for (let i = 0; i < found.length; i++) {
+            const { screenPid, windowId, status } = found[i];
+            let hasClaudeProcess = answers[i];
+            if (hasClaudeProcess === null) {
+                processes ??= await listProcesses();
+                hasClaudeProcess = checkForClaudeProcess(processes, screenPid);
+            }
+            if (i === 0) {
                 logFn(`[claude-sync] Session ${windowId} (${status}): claude=${hasClaudeProcess}`);
             }
-            debugOnce = false;
             const name = getTerminalNameFromJson(windowId);
 
             sessions.push({ windowId, screenPid, hasClaudeProcess, name: name || undefined });
@@ -82,303 +100,515 @@ export function getScreenSessionsWithClaudeStatus(): ScreenSession[] {
 }
 
 /**
- * Check if a screen session has a Claude process running
- * Process tree: screen → zsh/bash → claude
+ * Run a command and return its output, also when it exits non-zero
+ * (`screen -ls` does with no sessions); '' if it could not run
+ */
+async function runQuiet(file: string, args: string[], timeout = 5000): Promise<string> {
+    try {
+        const { stdout } = await execFileAsync(file, args, { encoding: 'utf8', timeout });
+        return stdout;
+    } catch (error) {
+        if (error && typeof error === 'object' && 'stdout' in error) {
+            return String((error as { stdout: unknown }).stdout ?? '');
+        }
+        return '';
+    }
+}
+
+/**
+ * Parse the output of `screen -Q sessionstate`: a line per record, the
+ * record type then tab separated key=value fields
+ */
+function parseSessionState(output: string): { type: string; fields: Map<string, string> }[] {
+    return output.split('\n').filter(line => line).map(line => {
+        const [type, ...pairs] = line.split('\t');
+        const fields = new Map<string, string>();
+        for (const pair of pairs) {
+            const eq = pair.indexOf('=');
+            if (eq > 0) fields.set(pair.slice(0, eq), pair.slice(eq + 1));
+        }
+        return { type, fields };
+    });
+}
+
+/**
+ * Check if Claude is in the foreground of a window of the session, with
+ * one query instead of scraping the process tree
+ * @returns null if the session could not be asked (e.g. an older screen)
  */
-function checkForClaudeProcess(screenPid: string, debug: boolean = false): boolean {
+async function queryClaudeProcess(session: string): Promise<boolean | null> {
     try {
-        const psOutput = execSync('ps -eo pid,ppid,comm', {
+        const { stdout } = await execFileAsync(screenBinary, ['-S', session, '-Q', 'sessionstate'], {
             encoding: 'utf8',
             timeout: 5000
         });
+        const records = parseSessionState(stdout);
+        if (!records.some(record => record.type === 'session')) return null;
+        return records.some(record => record.type === 'window' && record.fields.get('fg') === 'claude');
+    } catch (error) {
+        return null;
+    }
+}
 
-        const lines = psOutput.trim().split('\n').slice(1);
-        const processes: { pid: string; ppid: string; comm: string }[] = [];
-
-        for (const line of lines) {
-            const parts = line.trim().split(/\s+/);
-            if (parts.length >= 3) {
-                processes.push({
-                    pid: parts[0],
-                    ppid: parts[1],
-                    comm: parts.slice(2).join(' ')  // Handle comm with spaces
-                });
-            }
+interface ProcessEntry {
+    pid: string;
+    ppid: string;
+    comm: string;
+}
+
+/**
+ * The process table, read once for all sessions of a pass that need it
+ */
+async function listProcesses(): Promise<ProcessEntry[]> {
+    const psOutput = await runQuiet('ps', ['-eo', 'pid,ppid,comm']);
+    const processes: ProcessEntry[] = [];
+
+    for (const line of psOutput.trim().split('\n').slice(1)) {
+        const parts = line.trim().split(/\s+/);
+        if (parts.length >= 3) {
+            processes.push({
+                pid: parts[0],
+                ppid: parts[1],
+                comm: parts.slice(2).join(' ')  // Handle comm with spaces
+            });
         }
+    }
+    return processes;
+}
+
+/**
+ * Check if a screen session has a Claude process running
+ * Process tree: screen → zsh/bash → claude
+ */
+function checkForClaudeProcess(processes: ProcessEntry[], screenPid: string): boolean {
+    const screenChildren = processes.filter(p => p.ppid === screenPid);
+    // Always log for debugging
+    logFn(`[debug] Screen ${screenPid} children: ${screenChildren.length > 0 ? screenChildren.map(c => `${c.comm}(${c.pid})`).join(', ') : 'NONE'}`);
 
-        const screenChildren = processes.filter(p => p.ppid === screenPid);
-        // Always log for debugging
-        logFn(`[debug] Screen ${screenPid} children: ${screenChildren.length > 0 ? screenChildren.map(c => `${c.comm}(${c.pid})`).join(', ') : 'NONE'}`);
+    // Find ALL shell processes under screen (not just the first one)
+    const shellProcesses = screenChildren.filter(p => p.comm.includes('zsh') || p.comm.includes('bash'));
 
-        // Find ALL shell processes under screen (not just the first one)
-        const shellProcesses = processes.filter(p =>
-            p.ppid === screenPid &&
-            (p.comm.includes('zsh') || p.comm.includes('bash'))
+    if (shellProcesses.length === 0) {
+        logFn(`[debug] No shell found for screen ${screenPid}`);
+        return false;
+    }
+
+    // Check each shell for Claude process
+    for (const shellProcess of shellProcesses) {
+        const claudeProcess = processes.find(p =>
+            p.ppid === shellProcess.pid &&
+            p.comm === 'claude'
         );
 
-        if (shellProcesses.length === 0) {
-            logFn(`[debug] No shell found for screen ${screenPid}`);
-            return false;
+        if (claudeProcess) {
+            logFn(`[debug] Found Claude (${claudeProcess.pid}) under shell ${shellProcess.comm}(${shellProcess.pid})`);
+            return true;
+        }
+    }
+
+    logFn(`[debug] Claude process found: NO (checked ${shellProcesses.length} shells)`);
+    return false;
+}
+
+/**
+ * The log of a window: <name>.log.gz while screen compresses its logs
+ * (logfile compress), else <name>.log; null if there is neither
+ */
+function windowLogFile(logsDir: string, windowId: string): string | null {
+    const logFile = path.join(logsDir, `${projectName}-${windowId}.log`);
+    if (fs.existsSync(`${logFile}.gz`)) return `${logFile}.gz`;
+    return fs.existsSync(logFile) ? logFile : null;
+}
+
+/**
+ * Read the bytes of a file from offset to its current end
+ */
+async function readFrom(file: string, offset: number, size: number): Promise<Buffer> {
+    const handle = await fs.promises.open(file, 'r');
+    try {
+        const data = Buffer.alloc(size - offset);
+        let done = 0;
+        while (done < data.length) {
+            const { bytesRead } = await handle.read(data, done, data.length - done, offset + done);
+            if (bytesRead === 0) break;
+            done += bytesRead;
         }
+        return data.subarray(0, done);
+    } finally {
+        await handle.close();
+    }
+}
 
-        // Check each shell for Claude process
-        for (const shellProcess of shellProcesses) {
-            const claudeProcess = processes.find(p =>
-                p.ppid === shellProcess.pid &&
-                p.comm === 'claude'
-            );
+/** Most text of a log kept for matching: its end, where Claude is */
+const LOG_TEXT_KEPT = 4 * 1024 * 1024;
+
+/**
+ * What was read of a window's log: how far, and the text without color
+ * codes. `held` is the end of the text read that may be the start of an
+ * escape sequence, kept until the rest of it is read.
+ */
+interface LogState {
+    file: string;
+    ino: number;
+    offset: number;
+    decoder: StringDecoder;
+    text: string;
+    held: string;
+}
+
+const logStates = new Map<string, LogState>();
+
+/**
+ * Bring the text of a window's log up to date, reading only what was
+ * appended since the last pass. A gzipped log is read again whole when it
+ * grew, since appended bytes may continue a member screen is still writing.
+ */
+async function readWindowLog(windowId: string, logFile: string): Promise<LogState> {
+    const stat = await fs.promises.stat(logFile);
+    let state = logStates.get(windowId);
+    if (!state || state.file !== logFile || state.ino !== stat.ino || stat.size < state.offset) {
+        state = { file: logFile, ino: stat.ino, offset: 0, decoder: new StringDecoder('utf8'), text: '', held: '' };
+        logStates.set(windowId, state);
+    }
+    if (stat.size === state.offset) return state;
+
+    let chunk: string;
+    if (logFile.endsWith('.gz')) {
+        // A gzipped one may end in a member screen is still writing, which
+        // is decoded as far as it goes
+        const data = await fs.promises.readFile(logFile);
+        chunk = (await gunzipAsync(data, { finishFlush: zlib.constants.Z_SYNC_FLUSH })).toString('utf8');
+        state.text = '';
+        state.held = '';
+    } else {
+        chunk = state.decoder.write(await readFrom(logFile, state.offset, stat.size));
+    }
+    state.offset = stat.size;
+
+    chunk = state.held + chunk;
+    const esc = chunk.lastIndexOf('\x1b');
+    // eslint-disable-next-line no-control-regex
+    const complete = esc < 0 || !/^\x1b(\[[0-9;]*)?$/.test(chunk.slice(esc));
+    state.held = complete ? '' : chunk.slice(esc);
+    // eslint-disable-next-line no-control-regex
+    state.text += (complete ? chunk : chunk.slice(0, esc)).replace(/\x1b\[[0-9;]*m/g, '');
+    if (state.text.length > LOG_TEXT_KEPT) {
+        state.text = state.text.slice(-LOG_TEXT_KEPT);
+    }
+    return state;
+}
+
+/** A line of Claude's history.jsonl which parsed */
+interface HistoryEntry {
+    sessionId?: string;
+    display?: string;
+    project?: string;
+}
+
+/** Lines of the history kept: the last mentioning the workspace, and the last of all */
+const HISTORY_WORKSPACE_LINES = 1000;
+const HISTORY_RECENT_LINES = 500;
+
+/** Most of the history read the first time, from its end */
+const HISTORY_FIRST_READ = 4 * 1024 * 1024;
+
+/**
+ * What was read of the history: how far, the unfinished last line, and
+ * the lines the matching looks at
+ */
+const history = {
+    ino: 0,
+    offset: 0,
+    decoder: new StringDecoder('utf8'),
+    partial: '',
+    workspace: [] as (HistoryEntry | null)[],
+    recent: [] as (HistoryEntry | null)[],
+};
+
+function parseHistoryLine(line: string): HistoryEntry | null {
+    try {
+        const entry = JSON.parse(line);
+        return entry && typeof entry === 'object' ? entry : null;
+    } catch {
+        return null;  // Skip invalid JSON
+    }
+}
+
+/**
+ * Bring the history up to date, reading only what was appended since the
+ * last pass
+ */
+async function readHistory(historyPath: string): Promise<void> {
+    const stat = await fs.promises.stat(historyPath);
+    let skipFirst = false;
+    if (stat.ino !== history.ino || stat.size < history.offset) {
+        history.ino = stat.ino;
+        history.offset = Math.max(0, stat.size - HISTORY_FIRST_READ);
+        history.decoder = new StringDecoder('utf8');
+        history.partial = '';
+        history.workspace = [];
+        history.recent = [];
+        skipFirst = history.offset > 0;  // most likely only the end of a line
+    }
+    if (stat.size === history.offset) return;
+
+    const lines = (history.partial + history.decoder.write(await readFrom(historyPath, history.offset, stat.size))).split('\n');
+    history.offset = stat.size;
+    history.partial = lines.pop() ?? '';
+    if (skipFirst) lines.shift();
+
+    for (const line of lines) {
+        if (!line.trim()) continue;
+        const entry = parseHistoryLine(line);
+        history.recent.push(entry);
+        if (line.includes(workspacePath)) {
+            history.workspace.push(entry);
+        }
+    }
+    history.recent.splice(0, history.recent.length - HISTORY_RECENT_LINES);
+    history.workspace.splice(0, history.workspace.length - HISTORY_WORKSPACE_LINES);
+}
 
-            if (claudeProcess) {
-                logFn(`[debug] Found Claude (${claudeProcess.pid}) under shell ${shellProcess.comm}(${shellProcess.pid})`);
-                return true;
+/**
+ * The first responses of Claude in a session, by session ID. They do not
+ * change once the session has five of them, or is past the lines looked at.
+ */
+const responseCache = new Map<string, string[]>();
+
+/** Lines at the start of a session file looked at for responses */
+const SESSION_HEAD_LINES = 50;
+
+/**
+ * Get Claude's responses from a session file
+ */
+async function getClaudeResponses(sessionId: string, projectPath: string): Promise<string[]> {
+    const cached = responseCache.get(sessionId);
+    if (cached) return cached;
+
+    const responses: string[] = [];
+    // Convert project path to folder name: /Users/foo → -Users-foo
+    const projectFolder = projectPath.replace(/\//g, '-');
+    const sessionFile = path.join(os.homedir(), '.claude', 'projects', projectFolder, `${sessionId}.jsonl`);
+    if (!fs.existsSync(sessionFile)) return responses;
+
+    // Read the first lines to get early responses (most distinctive)
+    const stream = fs.createReadStream(sessionFile, { encoding: 'utf8' });
+    const lines = readline.createInterface({ input: stream, crlfDelay: Infinity });
+    let count = 0;
+    try {
+        for await (const line of lines) {
+            if (++count > SESSION_HEAD_LINES || responses.length >= 5) break;
+            if (!line.trim()) continue;
+            const entry = parseHistoryLine(line) as { type?: string; message?: { content?: { type?: string; text?: string }[] } } | null;
+            // Session files have: entry.message.content[] array with {type, text}
+            if (entry?.type === 'assistant' && Array.isArray(entry.message?.content)) {
+                for (const block of entry.message!.content!) {
+                    if (block.type === 'text' && block.text && block.text.length > 5) {
+                        responses.push(block.text.substring(0, 200));
+                        if (responses.length >= 5) break;
+                    }
+                }
             }
         }
+    } catch {
+        // Session file not found or error reading
+    } finally {
+        lines.close();
+        stream.destroy();
+    }
 
-        logFn(`[debug] Claude process found: NO (checked ${shellProcesses.length} shells)`);
-        return false;
-    } catch (error) {
-        logFn(`[debug] Error in checkForClaudeProcess: ${error}`);
-        return false;
+    if (responses.length >= 5 || count > SESSION_HEAD_LINES) {
+        responseCache.set(sessionId, responses);
     }
+    return responses;
 }
 
+/**
+ * How far the log and history were read when a window last found no
+ * match: it is not tried again until either grew
+ */
+const unmatched = new Map<string, string>();
+
 /**
  * Find Claude session ID using CONTENT-BASED matching
  * Searches log file content for user messages from history.jsonl
  */
-export function findClaudeSessionIdForWindow(windowId: string): string | null {
+export async function findClaudeSessionIdForWindow(windowId: string): Promise<string | null> {
     const logsDir = path.join(workspacePath, '.vscode', 'terminals', 'logs');
-    const logFile = path.join(logsDir, `${projectName}-${windowId}.log`);
+    const logFile = windowLogFile(logsDir, windowId);
     const historyPath = path.join(os.homedir(), '.claude', 'history.jsonl');
 
-    if (!fs.existsSync(logFile) || !fs.existsSync(historyPath)) {
+    if (!logFile || !fs.existsSync(historyPath)) {
         logFn(`[claude-sync] Log or history not found for ${windowId}`);
         return null;
     }
 
     try {
-        // Read log and strip ANSI escape codes for accurate matching
-        const rawLogContent = fs.readFileSync(logFile, 'utf8');
-        // eslint-disable-next-line no-control-regex
-        const logContent = rawLogContent.replace(/\x1b\[[0-9;]*m/g, '');
-
-        // Helper to get Claude's responses from session file
-        const getClaudeResponses = (sessionId: string, projectPath: string): string[] => {
-            const responses: string[] = [];
-            try {
-                // Convert project path to folder name: /Users/foo → -Users-foo
-                const projectFolder = projectPath.replace(/\//g, '-');
-                const sessionFile = path.join(os.homedir(), '.claude', 'projects', projectFolder, `${sessionId}.jsonl`);
-
-                if (!fs.existsSync(sessionFile)) return responses;
-
-                // Read first 50 lines to get early responses (most distinctive)
-                const content = execSync(`head -50 "${sessionFile}"`, { encoding: 'utf8', timeout: 5000 });
-
-                for (const line of content.split('\n')) {
-                    if (!line.trim()) continue;
-                    try {
-                        const entry = JSON.parse(line);
-                        // Session files have: entry.message.content[] array with {type, text}
-                        if (entry.type === 'assistant' && entry.message?.content) {
-                            for (const block of entry.message.content) {
-                                if (block.type === 'text' && block.text && block.text.length > 5) {
-                                    responses.push(block.text.substring(0, 200));
-                                    if (responses.length >= 5) return responses;
-                                }
-                            }
-                        }
-                    } catch {
-                        // Skip invalid JSON
-                    }
-                }
-            } catch {
-                // Session file not found or error reading
-            }
-            return responses;
-        };
+        const log = await readWindowLog(windowId, logFile);
+        await readHistory(historyPath);
+        const position = `${logFile}:${log.offset}:${history.offset}`;
+        if (unmatched.get(windowId) === position) {
+            logFn(`[claude-sync] No new output or history for ${windowId} since the last attempt`);
+            return null;
+        }
 
-        // Helper to parse history content into session messages map
-        // Also tracks project path for each session to lookup Claude responses
-        const sessionProjects = new Map<string, string>(); // sessionId → project path
-
-        const parseHistory = (content: string): Map<string, string[]> => {
-            const sessions = new Map<string, string[]>();
-            for (const line of content.split('\n')) {
-                if (!line.trim()) continue;
-                try {
-                    const entry = JSON.parse(line);
-                    if (entry.sessionId && entry.display &&
-                        entry.display.length > 10 &&
-                        !entry.display.includes('/resume') &&
-                        !entry.display.includes('/status') &&
-                        entry.display !== 'go on') {
-
-                        if (!sessions.has(entry.sessionId)) {
-                            sessions.set(entry.sessionId, []);
-                        }
-                        sessions.get(entry.sessionId)!.push(entry.display);
-
-                        // Track project path for this session
-                        if (entry.project && !sessionProjects.has(entry.sessionId)) {
-                            sessionProjects.set(entry.sessionId, entry.project);
-                        }
-                    }
-                } catch {
-                    // Skip invalid JSON
-                }
-            }
-            return sessions;
-        };
+        const sessionId = await matchByContent(windowId, log.text);
+        if (sessionId) {
+            unmatched.delete(windowId);
+        } else {
+            unmatched.set(windowId, position);
+        }
+        return sessionId;
+    } catch (error) {
+        logFn(`[claude-sync] Error in content matching: ${error}`);
+        return null;
+    }
+}
 
-        // Helper to score sessions against log content
-        // Additive scoring: exact matches + phrase matches, no cap
-        const scoreSession = (messages: string[]): { score: number; info: string } => {
-            let exactMatches = 0;
-            let phraseMatches = 0;
+/**
+ * Score the sessions of the history against a window's log text and
+ * return the one that matches, falling back to timestamps
+ */
+async function matchByContent(windowId: string, logContent: string): Promise<string | null> {
+    // Helper to parse history entries into session messages map
+    // Also tracks project path for each session to lookup Claude responses
+    const sessionProjects = new Map<string, string>(); // sessionId → project path
+
+    const parseHistory = (entries: (HistoryEntry | null)[]): Map<string, string[]> => {
+        const sessions = new Map<string, string[]>();
+        for (const entry of entries) {
+            if (entry?.sessionId && typeof entry.display === 'string' &&
+                entry.display.length > 10 &&
+                !entry.display.includes('/resume') &&
+                !entry.display.includes('/status') &&
+                entry.display !== 'go on') {
+
+                if (!sessions.has(entry.sessionId)) {
+                    sessions.set(entry.sessionId, []);
+                }
+                sessions.get(entry.sessionId)!.push(entry.display);
 
-            // Check exact matches - full message found in log (lowered threshold to 5 chars)
-            for (const msg of messages.slice(-20)) {
-                if (msg.length >= 5 && logContent.includes(msg)) {
-                    exactMatches++;
+                // Track project path for this session
+                if (entry.project && !sessionProjects.has(entry.sessionId)) {
+                    sessionProjects.set(entry.sessionId, entry.project);
                 }
             }
+        }
+        return sessions;
+    };
+
+    // Helper to score sessions against log content
+    // Additive scoring: exact matches + phrase matches, no cap
+    const scoreSession = (messages: string[]): { score: number; info: string } => {
+        let exactMatches = 0;
+        let phraseMatches = 0;
+
+        // Check exact matches - full message found in log (lowered threshold to 5 chars)
+        for (const msg of messages.slice(-20)) {
+            if (msg.length >= 5 && logContent.includes(msg)) {
+                exactMatches++;
+            }
+        }
 
-            // Check phrase matches - 3-word phrases (lowered threshold to 10 chars)
-            const searchTerms = messages
-                .slice(-20)
-                .filter(m => m.length >= 10)
-                .flatMap(m => {
-                    const words = m.split(/\s+/).filter(w => w.length > 2);
-                    const phrases: string[] = [];
-                    for (let i = 0; i < words.length - 2; i++) {
-                        phrases.push(words.slice(i, i + 3).join(' '));
-                    }
-                    return phrases.slice(0, 5);
-                })
-                .slice(0, 30);
-
-            for (const term of searchTerms) {
-                if (logContent.includes(term)) {
-                    phraseMatches++;
+        // Check phrase matches - 3-word phrases (lowered threshold to 10 chars)
+        const searchTerms = messages
+            .slice(-20)
+            .filter(m => m.length >= 10)
+            .flatMap(m => {
+                const words = m.split(/\s+/).filter(w => w.length > 2);
+                const phrases: string[] = [];
+                for (let i = 0; i < words.length - 2; i++) {
+                    phrases.push(words.slice(i, i + 3).join(' '));
                 }
+                return phrases.slice(0, 5);
+            })
+            .slice(0, 30);
+
+        for (const term of searchTerms) {
+            if (logContent.includes(term)) {
+                phraseMatches++;
             }
+        }
 
-            // Additive scoring - no cap, higher = better match
-            const score = (exactMatches * 0.15) + (phraseMatches * 0.03);
+        // Additive scoring - no cap, higher = better match
+        const score = (exactMatches * 0.15) + (phraseMatches * 0.03);
 
-            return {
-                score,
-                info: `exact=${exactMatches}, phrases=${phraseMatches}`
-            };
+        return {
+            score,
+            info: `exact=${exactMatches}, phrases=${phraseMatches}`
         };
-
-        // Try workspace-filtered search first
-        let historyContent = '';
-        try {
-            historyContent = execSync(`grep "${workspacePath}" "${historyPath}" | tail -1000`, {
-                encoding: 'utf8',
-                timeout: 10000
-            });
-        } catch {
-            // grep returns error if no matches
+    };
+
+    // Try the history lines mentioning the workspace first
+    const sessionMessages = parseHistory(history.workspace);
+    let bestSession = '';
+    let bestScore = 0;
+    let bestMatchInfo = '';
+
+    // Score workspace-filtered sessions (user messages + Claude responses)
+    for (const [sessionId, userMessages] of sessionMessages) {
+        const projectPath = sessionProjects.get(sessionId);
+        const claudeResponses = projectPath ? await getClaudeResponses(sessionId, projectPath) : [];
+        const { score, info } = scoreSession([...userMessages, ...claudeResponses]);
+        if (score > bestScore) {
+            bestScore = score;
+            bestSession = sessionId;
+            bestMatchInfo = info;
         }
+    }
 
-        let sessionMessages = parseHistory(historyContent);
-        let bestSession = '';
-        let bestScore = 0;
-        let bestMatchInfo = '';
+    // If no confident match from workspace filter, also try recent history
+    // Claude may record a different project path if started from different cwd
+    if (bestScore < 0.1) {
+        logFn(`[claude-sync] Workspace filter score too low (${bestScore.toFixed(2)}), trying recent history`);
+        const recentSessions = parseHistory(history.recent);
 
-        // Score workspace-filtered sessions (user messages + Claude responses)
-        for (const [sessionId, userMessages] of sessionMessages) {
+        for (const [sessionId, userMessages] of recentSessions) {
             const projectPath = sessionProjects.get(sessionId);
-            const claudeResponses = projectPath ? getClaudeResponses(sessionId, projectPath) : [];
-            const allMessages = [...userMessages, ...claudeResponses];
-            const { score, info } = scoreSession(allMessages);
+            const claudeResponses = projectPath ? await getClaudeResponses(sessionId, projectPath) : [];
+            const { score, info } = scoreSession([...userMessages, ...claudeResponses]);
             if (score > bestScore) {
                 bestScore = score;
                 bestSession = sessionId;
                 bestMatchInfo = info;
+                logFn(`[claude-sync] Found better match in recent history: ${sessionId.slice(0, 8)}... (score=${score.toFixed(2)})`);
             }
         }
+    }
 
-        // If no confident match from workspace filter, also try recent history
-        // Claude may record a different project path if started from different cwd
-        if (bestScore < 0.1) {
-            logFn(`[claude-sync] Workspace filter score too low (${bestScore.toFixed(2)}), trying recent history`);
-            try {
-                const recentHistory = execSync(`tail -500 "${historyPath}"`, {
-                    encoding: 'utf8',
-                    timeout: 10000
-                });
-                const recentSessions = parseHistory(recentHistory);
-
-                for (const [sessionId, userMessages] of recentSessions) {
-                    const projectPath = sessionProjects.get(sessionId);
-                    const claudeResponses = projectPath ? getClaudeResponses(sessionId, projectPath) : [];
-                    const allMessages = [...userMessages, ...claudeResponses];
-                    const { score, info } = scoreSession(allMessages);
-                    if (score > bestScore) {
-                        bestScore = score;
-                        bestSession = sessionId;
-                        bestMatchInfo = info;
-                        logFn(`[claude-sync] Found better match in recent history: ${sessionId.slice(0, 8)}... (score=${score.toFixed(2)})`);
-                    }
-                }
-            } catch {
-                // Ignore
-            }
-        }
-
-        if (sessionMessages.size === 0 && bestScore === 0) {
-            logFn(`[claude-sync] No session messages found in history`);
-            return null;
-        }
-
-        // Accept if score >= 0.1 (at least 1 exact match or 4+ phrase matches)
-        // With additive scoring: exact=0.15, phrase=0.03
-        const hasConfidentMatch = bestScore >= 0.1 && bestSession;
+    if (sessionMessages.size === 0 && bestScore === 0) {
+        logFn(`[claude-sync] No session messages found in history`);
+        return null;
+    }
 
-        if (hasConfidentMatch) {
-            logFn(`[claude-sync] Content match: ${windowId} → ${bestSession.slice(0, 8)}... (${bestMatchInfo}, score=${bestScore.toFixed(2)})`);
-            return bestSession;
-        }
+    // Accept if score >= 0.1 (at least 1 exact match or 4+ phrase matches)
+    // With additive scoring: exact=0.15, phrase=0.03
+    const hasConfidentMatch = bestScore >= 0.1 && bestSession;
 
-        logFn(`[claude-sync] No confident match for ${windowId} (best score: ${bestScore.toFixed(2)})`);
-        return findSessionByTimestamp(windowId);
-    } catch (error) {
-        logFn(`[claude-sync] Error in content matching: ${error}`);
-        return null;
+    if (hasConfidentMatch) {
+        logFn(`[claude-sync] Content match: ${windowId} → ${bestSession.slice(0, 8)}... (${bestMatchInfo}, score=${bestScore.toFixed(2)})`);
+        return bestSession;
     }
+
+    logFn(`[claude-sync] No confident match for ${windowId} (best score: ${bestScore.toFixed(2)})`);
+    return findSessionByTimestamp(windowId);
 }
 
 /**
  * Fallback: Find session by timestamp correlation
  */
-function findSessionByTimestamp(windowId: string): string | null {
+async function findSessionByTimestamp(windowId: string): Promise<string | null> {
     const logsDir = path.join(workspacePath, '.vscode', 'terminals', 'logs');
-    const logFile = path.join(logsDir, `${projectName}-${windowId}.log`);
-    const historyPath = path.join(os.homedir(), '.claude', 'history.jsonl');
+    const logFile = windowLogFile(logsDir, windowId);
     const claudeProjectDir = path.join(os.homedir(), '.claude', 'projects', workspacePath.replace(/\//g, '-'));
 
-    if (!fs.existsSync(logFile) || !fs.existsSync(historyPath)) return null;
+    if (!logFile) return null;
 
     try {
-        const historyContent = execSync(`tail -100 "${historyPath}"`, {
-            encoding: 'utf8',
-            timeout: 5000
-        });
-
         const sessionIds = new Set<string>();
-        for (const line of historyContent.split('\n')) {
-            if (!line.trim()) continue;
-            try {
-                const entry = JSON.parse(line);
-                if (entry.project === workspacePath && entry.sessionId) {
-                    sessionIds.add(entry.sessionId);
-                }
-            } catch {
-                // Skip
+        for (const entry of history.recent.slice(-100)) {
+            if (entry?.project === workspacePath && entry.sessionId) {
+                sessionIds.add(entry.sessionId);
             }
         }
 
@@ -389,7 +619,7 @@ function findSessionByTimestamp(windowId: string): string | null {
         }
 
         if (fs.existsSync(claudeProjectDir)) {
-            const logStat = fs.statSync(logFile);
+            const logStat = await fs.promises.stat(logFile);
             const logMtime = logStat.mtimeMs;
 
             let bestSession = '';
@@ -397,9 +627,9 @@ function findSessionByTimestamp(windowId: string): string | null {
 
             for (const sessionId of sessionIds) {
                 const sessionFile = path.join(claudeProjectDir, `${sessionId}.jsonl`);
-                if (!fs.existsSync(sessionFile)) continue;
+                const sessionStat = await fs.promises.stat(sessionFile).catch(() => null);
+                if (!sessionStat) continue;
 
-                const sessionStat = fs.statSync(sessionFile);
                 const diff = Math.abs(logMtime - sessionStat.mtimeMs);
 
                 if (diff < bestDiff && diff < 120000) {
@@ -423,14 +653,17 @@ function findSessionByTimestamp(windowId: string): string | null {
 /**
  * Clean up orphaned screen sessions and log files
  */
-export function cleanupOrphanedLogs() {
+export async function cleanupOrphanedLogs(): Promise<void> {
     const logsDir = path.join(workspacePath, '.vscode', 'terminals', 'logs');
     if (!fs.existsSync(logsDir)) return;
 
     try {
         const validWindowIds = getAllWindowIds();
-        const logFiles = fs.readdirSync(logsDir).filter(f => f.endsWith('.log'));
-        const logPattern = new RegExp(`^${projectName}-(.+)\\.log$`);
+        // <name>.log and the <name>.log.txt text log, gzipped or not, the
+        // <name>.log.ckpt checkpoint and its .jnl journal, and the
+        // <name>.log.hist history store with its rotated .1
+        const logPattern = new RegExp(`^${projectName}-(.+?)\\.log((\\.txt)?(\\.gz)?|\\.ckpt(\\.jnl)?|\\.hist(\\.1)?)$`);
+        const logFiles = (await fs.promises.readdir(logsDir)).filter(f => logPattern.test(f));
 
         for (const logFile of logFiles) {
             const match = logFile.match(logPattern);
@@ -439,19 +672,14 @@ export function cleanupOrphanedLogs() {
                 if (!validWindowIds.has(windowId)) {
                     // Kill the orphaned screen session first
                     const sessionName = `${projectName}-${windowId}`;
-                    try {
-                        execSync(`${screenBinary} -S "${sessionName}" -X quit 2>/dev/null || true`, {
-                            timeout: 5000,
-                            stdio: 'pipe'
-                        });
-                        logFn(`[cleanup] Killed orphaned screen: ${sessionName}`);
-                    } catch {
-                        // Ignore
-                    }
+                    await runQuiet(screenBinary, ['-S', sessionName, '-X', 'quit']);
+                    logFn(`[cleanup] Killed orphaned screen: ${sessionName}`);
 
                     // Remove the log file
                     const logPath = path.join(logsDir, logFile);
-                    fs.unlinkSync(logPath);
+                    await fs.promises.unlink(logPath);
+                    logStates.delete(windowId);
+                    unmatched.delete(windowId);
                     logFn(`[cleanup] Removed orphaned log: ${logFile}`);
                 }
             }
@@ -461,35 +689,50 @@ export function cleanupOrphanedLogs() {
     }
 }
 
+// A pass still running when the next one is due makes it skip
+let syncRunning = false;
+
 /**
  * Main sync function: detect Claude processes and update JSON
  */
-export function syncClaudeSessions() {
-    logFn(`[claude-sync] Scanning for Claude sessions...`);
-
-    cleanupOrphanedLogs();
-
-    const sessions = getScreenSessionsWithClaudeStatus();
-    logFn(`[claude-sync] Found ${sessions.length} ImmorTerm sessions`);
-
-    for (const session of sessions) {
-        const currentSessionId = getCurrentClaudeSessionId(session.windowId);
-        const displayName = session.name || session.windowId;
-        logFn(`[claude-sync] "${displayName}": claude=${session.hasClaudeProcess}, currentId=${currentSessionId ? currentSessionId.slice(0, 8) + '...' : 'none'}`);
-
-        if (session.hasClaudeProcess) {
-            if (!currentSessionId) {
-                const sessionId = findClaudeSessionIdForWindow(session.windowId);
-                if (sessionId) {
-                    updateClaudeSessionId(session.windowId, sessionId);
-                } else {
-                    logFn(`[claude-sync] No session ID found in history for ${displayName}`);
+export async function syncClaudeSessions(): Promise<void> {
+    if (syncRunning) {
+        logFn(`[claude-sync] Previous scan still running, skipping`);
+        return;
+    }
+    syncRunning = true;
+    try {
+        logFn(`[claude-sync] Scanning for Claude sessions...`);
+
+        await cleanupOrphanedLogs();
+
+        const sessions = await getScreenSessionsWithClaudeStatus();
+        logFn(`[claude-sync] Found ${sessions.length} ImmorTerm sessions`);
+
+        for (const session of sessions) {
+            const currentSessionId = getCurrentClaudeSessionId(session.windowId);
+            const displayName = session.name || session.windowId;
+            logFn(`[claude-sync] "${displayName}": claude=${session.hasClaudeProcess}, currentId=${currentSessionId ? currentSessionId.slice(0, 8) + '...' : 'none'}`);
+
+            if (session.hasClaudeProcess) {
+                if (!currentSessionId) {
+                    const sessionId = await findClaudeSessionIdForWindow(session.windowId);
+                    if (sessionId) {
+                        updateClaudeSessionId(session.windowId, sessionId);
+                    } else {
+                        logFn(`[claude-sync] No session ID found in history for ${displayName}`);
+                    }
                 }
-            }
-        } else {
-            if (currentSessionId) {
-                removeClaudeSessionId(session.windowId);
+            } else {
+                if (currentSessionId) {
+                    removeClaudeSessionId(session.windowId);
+                }
+                unmatched.delete(session.windowId);
             }
         }
+    } catch (error) {
+        logFn(`[claude-sync] Error syncing sessions: ${error}`);
+    } finally {
+        syncRunning = false;
     }
 }
@@ -0,0 +1,77 @@
+/**
+ * Export Terminal Command
+ *
+ * Writes the scrollback and screen of the active terminal to a file, as
+ * plain text, text with ANSI colors or an HTML page, rendered by screen
+ * from what it holds in memory (screen's export command).
+ */
+
+import * as path from 'path';
+import * as vscode from 'vscode';
+import { TerminalManager } from '../terminal/manager';
+import { logger } from '../utils/logger';
+import { screenCommands, ExportFormat } from '../utils/screen-commands';
+
+export interface ExportTerminalResult {
+  /** Whether an export was asked of screen (false if cancelled) */
+  exported: boolean;
+  /** The file written */
+  file?: string;
+}
+
+interface FormatItem extends vscode.QuickPickItem {
+  format: ExportFormat;
+  extension: string;
+}
+
+const FORMATS: FormatItem[] = [
+  { label: 'HTML', description: 'A page with the colors of the terminal', format: 'html', extension: 'html' },
+  { label: 'ANSI', description: 'Text with color escape sequences, for cat or less -R', format: 'ansi', extension: 'ans' },
+  { label: 'Plain text', description: 'Text only', format: 'plain', extension: 'txt' },
+];
+
+/**
+ * Asks for a format and a file and exports the active terminal to it.
+ *
+ * @param terminalManager The terminal manager instance
+ * @returns Whether it was exported, and where to
+ */
+export async function exportTerminal(terminalManager: TerminalManager): Promise<ExportTerminalResult> {
+  const terminal = vscode.window.activeTerminal;
+  const windowId = terminal && terminalManager.getWindowIdForTerminal(terminal);
+  const state = windowId ? terminalManager.getTerminalByWindowId(windowId) : undefined;
+  if (!state) {
+    vscode.window.showWarningMessage('ImmorTerm: The active terminal is not an ImmorTerm terminal');
+    return { exported: false };
+  }
+
+  const picked = await vscode.window.showQuickPick(FORMATS, { placeHolder: `Export "${state.name}" as` });
+  if (!picked) {
+    return { exported: false };
+  }
+
+  const folder = vscode.workspace.workspaceFolders?.[0]?.uri.fsPath ?? process.cwd();
+  const base = state.name.replace(/[^\w.-]+/g, '-');
+  const uri = await vscode.window.showSaveDialog({
+    defaultUri: vscode.Uri.file(path.join(folder, `${base}.${picked.extension}`)),
+    filters: { [picked.label]: [picked.extension] },
+  });
+  if (!uri) {
+    return { exported: false };
+  }
+
+  if (!(await screenCommands.exportHistory(state.screenSession, picked.format, uri.fsPath))) {
+    vscode.window.showErrorMessage(`ImmorTerm: Could not export "${state.name}"`);
+    return { exported: false };
+  }
+  logger.debug(`Exported ${state.screenSession} as ${picked.format} to ${uri.fsPath}`);
+
+  const open = await vscode.window.showInformationMessage(
+    `ImmorTerm: Exported "${state.name}" to ${path.basename(uri.fsPath)}`,
+    'Open'
+  );
+  if (open) {
+    await vscode.commands.executeCommand('vscode.open', uri);
+  }
+  return { exported: true, file: uri.fsPath };
+}
@@ -87,15 +87,19 @@ export async function forgetTerminal(
     logger.debug(`Removed from restore-terminals.json: ${windowId}`);
   }
 
-  // Delete the log file
+  // Delete the log file, the plain text log next to it (logfile text), the
+  // gzipped forms of both (logfile compress), the window's checkpoint and
+  // its history store (logfile history)
   const logPath = path.join(logsDir, `${screenSession}.log`);
-  try {
-    await fs.unlink(logPath);
-    result.logDeleted = true;
-    logger.debug(`Deleted log file: ${logPath}`);
-  } catch (err) {
-    // Log file might not exist, that's okay
-    logger.debug(`Log file not found or couldn't delete: ${logPath}`);
+  for (const suffix of ['', '.gz', '.txt', '.txt.gz', '.ckpt', '.ckpt.jnl', '.hist', '.hist.1']) {
+    try {
+      await fs.unlink(logPath + suffix);
+      result.logDeleted = true;
+      logger.debug(`Deleted log file: ${logPath + suffix}`);
+    } catch (err) {
+      // Log file might not exist, that's okay
+      logger.debug(`Log file not found or couldn't delete: ${logPath + suffix}`);
+    }
   }
 
   // Close VS Code terminal tab if requested
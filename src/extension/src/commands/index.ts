@@ -21,3 +21,9 @@ export { killAllScreenSessions, type KillAllResult } from './kill-all';
 
 // Rename Terminal - rename via VS Code input box (Ctrl+Shift+R)
 export { renameTerminal, type RenameTerminalResult } from './rename-terminal';
+
+// Search All Terminals - grep the history of every terminal at once
+export { searchAllTerminals, type SearchTerminalsResult } from './search-terminals';
+
+// Export Terminal - write the scrollback of a terminal as text or HTML
+export { exportTerminal, type ExportTerminalResult } from './export-terminal';
@@ -42,7 +42,12 @@ async function getLogFiles(logsDir: string): Promise<LogFileInfo[]> {
     const entries = await fs.readdir(logsDir);
 
     for (const entry of entries) {
-      if (!entry.endsWith('.log')) {
+      // foo.log plus the foo.log.1, foo.log.2, ... screen rotates it into,
+      // the .txt text log with its own rotations, the same as .gz
+      // (foo.log.gz, foo.log.1.gz), the .idx line index screen keeps
+      // next to each of them, the foo.log.ckpt window checkpoint and its journal,
+      // and the foo.log.hist history store with its rotated foo.log.hist.1
+      if (!/\.log((\.txt)?(\.\d+)?(\.gz)?(\.idx)?|\.ckpt(\.jnl)?|\.hist(\.1)?)$/.test(entry)) {
         continue;
       }
 
@@ -8,21 +8,10 @@
  */
 
 import * as vscode from 'vscode';
-import { exec } from 'child_process';
-import { promisify } from 'util';
 import { WorkspaceStorage } from '../storage/workspace-state';
 import { updateJsonNameAndCommand } from '../json-utils';
 import { logger } from '../utils/logger';
-
-const execAsync = promisify(exec);
-
-/**
- * Gets the configured screen binary path from settings
- */
-function getScreenBinary(): string {
-  const config = vscode.workspace.getConfiguration('immorterm');
-  return config.get<string>('screenBinary', 'immorterm');
-}
+import { screenCommands } from '../utils/screen-commands';
 
 export interface RenameTerminalResult {
   success: boolean;
@@ -85,14 +74,19 @@ export async function renameTerminal(
   }
 
   try {
-    // 1. Update screen title (clean name only - no timestamp prefix)
-    await execAsync(`${getScreenBinary()} -S "${sessionName}" -X title "${trimmedName}"`);
-    logger.debug(`Set screen title to "${trimmedName}"`);
-
+    // 1. Update screen title (clean name only - no timestamp prefix), and
     // 2. Set pending rename via screen environment variable (cleaner than file-based IPC)
     // The shell's precmd hook will query this via `screen -Q echo` and update IMMORTERM_BASE_NAME
-    await execAsync(`${getScreenBinary()} -S "${sessionName}" -X setenv IMMORTERM_PENDING_RENAME "${trimmedName}"`);
-    logger.debug(`Set IMMORTERM_PENDING_RENAME="${trimmedName}" on session ${sessionName}`);
+    // Both go to the session in one batch
+    const quoted = `"${trimmedName.replace(/[\\"$]/g, '\\$&')}"`;
+    const results = await screenCommands.runBatch(sessionName, [
+      `title ${quoted}`,
+      `setenv IMMORTERM_PENDING_RENAME ${quoted}`,
+    ]);
+    if (!results || results.length < 2) {
+      throw new Error(`could not update screen session ${sessionName}`);
+    }
+    logger.debug(`Set screen title and IMMORTERM_PENDING_RENAME to "${trimmedName}" on session ${sessionName}`);
 
     // 3. Update storage
     await storage.updateTerminal(windowId, { name: trimmedName });
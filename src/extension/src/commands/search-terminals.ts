@@ -0,0 +1,94 @@
+/**
+ * Search All Terminals Command
+ *
+ * Searches what every terminal of the project still holds in memory
+ * (screen's grep command) instead of reading the logs from disk, and
+ * shows the terminal picked from the results.
+ */
+
+import * as vscode from 'vscode';
+import { TerminalManager } from '../terminal/manager';
+import { logger } from '../utils/logger';
+import { screenCommands, GrepMatch } from '../utils/screen-commands';
+
+export interface SearchTerminalsResult {
+  /** Whether a search ran (false if cancelled) */
+  searched: boolean;
+  /** Number of matching lines over all terminals */
+  matches: number;
+  /** Terminal shown, if one was picked */
+  windowId?: string;
+}
+
+interface MatchItem extends vscode.QuickPickItem {
+  windowId: string;
+}
+
+/** Most matching lines asked from each terminal */
+const MAX_MATCHES_PER_TERMINAL = 200;
+
+/**
+ * Asks for a pattern and searches all terminals for it. A pattern
+ * written as /.../ is an extended regular expression; case is ignored
+ * unless the pattern has capitals.
+ *
+ * @param terminalManager The terminal manager instance
+ * @returns What was searched and picked
+ */
+export async function searchAllTerminals(terminalManager: TerminalManager): Promise<SearchTerminalsResult> {
+  const input = await vscode.window.showInputBox({
+    prompt: 'Search all terminals (/.../ for a regular expression)',
+    placeHolder: 'Text to find',
+  });
+  if (!input) {
+    return { searched: false, matches: 0 };
+  }
+
+  const regexMatch = /^\/(.+)\/$/.exec(input);
+  const pattern = regexMatch ? regexMatch[1] : input;
+  const ignoreCase = pattern === pattern.toLowerCase();
+  const terminals = terminalManager.getAllTerminals();
+
+  const results = await Promise.all(
+    terminals.map(async (state) => ({
+      state,
+      matches: await screenCommands.grep(state.screenSession, pattern, {
+        ignoreCase,
+        regex: regexMatch !== null,
+        max: MAX_MATCHES_PER_TERMINAL,
+      }),
+    }))
+  );
+
+  const items: MatchItem[] = [];
+  for (const { state, matches } of results) {
+    // newest first: what was printed last is most likely what is wanted
+    for (const match of [...matches].reverse()) {
+      items.push(toItem(state.windowId, state.name, match));
+    }
+  }
+  logger.debug(`Search for "${input}": ${items.length} matches in ${terminals.length} terminals`);
+
+  if (items.length === 0) {
+    vscode.window.showInformationMessage(`ImmorTerm: "${input}" not found in any terminal`);
+    return { searched: true, matches: 0 };
+  }
+
+  const picked = await vscode.window.showQuickPick(items, {
+    placeHolder: `${items.length} matching lines`,
+    matchOnDescription: true,
+  });
+  if (!picked) {
+    return { searched: true, matches: items.length };
+  }
+  terminalManager.getTerminalForWindowId(picked.windowId)?.show();
+  return { searched: true, matches: items.length, windowId: picked.windowId };
+}
+
+function toItem(windowId: string, name: string, match: GrepMatch): MatchItem {
+  return {
+    label: match.text.trim(),
+    description: `${name} · line ${match.line}`,
+    windowId,
+  };
+}
@@ -20,6 +20,8 @@
  * - immorterm.syncNow: Sync terminal names now
  * - immorterm.enableForProject: Enable ImmorTerm for this project
  * - immorterm.disableForProject: Disable ImmorTerm for this project
+ * - immorterm.searchAllTerminals: Search the history of all terminals
+ * - immorterm.exportTerminal: Export the history of the active terminal
  */
 
 import * as vscode from 'vscode';
@@ -35,6 +37,7 @@ import {
   checkAndSyncNameChange,
   generateNextName,
   isModifiableName,
+  fillSessionPool,
 } from './terminal';
 import { WorkspaceStorage } from './storage/workspace-state';
 import {
@@ -45,13 +48,25 @@ import {
   cleanupLogs,
   reconcileTerminal,
   renameTerminal,
+  searchAllTerminals,
+  exportTerminal,
 } from './commands';
-import { shouldAutoCleanupStale, getClaudeSyncInterval, shouldClaudeAutoResume } from './utils/settings';
+import {
+  shouldAutoCleanupStale,
+  getClaudeSyncInterval,
+  shouldClaudeAutoResume,
+  getSessionPoolSize,
+  isHostSessionsEnabled,
+  isStartupTraceEnabled,
+  onSettingsChange,
+  isSettingChanged,
+  SETTINGS,
+} from './utils/settings';
 import { screenCommands } from './utils/screen-commands';
 import { initJsonUtils, updateJsonNameAndCommand, updateJsonTheme, getAllTerminalsFromJson } from './json-utils';
 import { initClaudeSync, syncClaudeSessions } from './claude-sync';
 import * as fs from 'fs/promises';
-import * as fsSync from 'fs';
+import { ChildProcess } from 'child_process';
 import * as path from 'path';
 
 // Track command-initiated renames to prevent onDidChangeTerminalState from reverting
@@ -186,15 +201,17 @@ async function syncTerminalTitle(
   }
 }
 
-// Track active title file watchers to clean up on deactivation
-const titleFileWatchers = new Map<string, fsSync.FSWatcher>();
+// Track the event connections to the sessions to close them on deactivation
+const sessionEventWatchers = new Map<string, ChildProcess>();
+
+// How often to try to connect to a session that is not up yet, a second apart
+const EVENT_WATCH_RETRIES = 30;
 
 /**
- * Set up file watchers for title change notifications from ImmorTerm C code.
- * C code writes to /tmp/immorterm-title-{sessionname} when title changes.
- * Uses OS-native kqueue/inotify for event-driven notifications (no polling).
+ * Follow the events of all tracked terminals' sessions, for their title
+ * changes (the C code reports them on a `screen -Q events` connection).
  */
-function setupTitleFileWatchers(terminalManager: TerminalManager): void {
+function setupSessionEventWatchers(terminalManager: TerminalManager): void {
   const projectName = terminalManager.getProjectName();
 
   // Watch for all tracked terminals
@@ -203,104 +220,97 @@ function setupTitleFileWatchers(terminalManager: TerminalManager): void {
     if (!windowId) continue;
 
     const sessionName = `${projectName}-${windowId}`;
-    watchTitleFile(sessionName, windowId, terminalManager);
+    watchSessionEvents(sessionName, windowId, terminalManager);
   }
 
-  logger.debug('Title file watchers initialized');
+  logger.debug('Session event watchers initialized');
 }
 
 /**
- * Watch a single title file for changes.
+ * Follow the events of a single session. One connection replaces watching
+ * its title file: if it goes away while the terminal is still tracked
+ * (the session was not up yet, or dropped us for falling behind), connect
+ * again, giving up after EVENT_WATCH_RETRIES attempts without an event.
  */
-function watchTitleFile(sessionName: string, windowId: string, terminalManager: TerminalManager): void {
-  const titlePath = `/tmp/immorterm-title-${sessionName}`;
-
+function watchSessionEvents(
+  sessionName: string,
+  windowId: string,
+  terminalManager: TerminalManager,
+  retries = EVENT_WATCH_RETRIES
+): void {
   // Don't create duplicate watchers
-  if (titleFileWatchers.has(sessionName)) {
+  if (sessionEventWatchers.has(sessionName)) {
     return;
   }
 
-  // Create watcher (will be created when file appears)
-  const startWatcher = () => {
-    try {
-      const watcher = fsSync.watch(titlePath, async (eventType) => {
-        if (eventType === 'change') {
-          try {
-            const content = await fs.readFile(titlePath, 'utf-8');
-            const newTitle = content.trim();
-
-            if (newTitle) {
-              const storedTerminal = terminalManager.getTerminalByWindowId(windowId);
-
-              // Only sync if name is modifiable (not user's custom name)
-              if (storedTerminal && isModifiableName(storedTerminal.name, storedTerminal.claudeSessionId)) {
-                logger.debug(`Title file notification: "${newTitle}" for window ${windowId}`);
-                await syncTerminalTitle(windowId, newTitle, terminalManager);
-              } else {
-                logger.debug(`Ignoring title file notification - name not modifiable: "${storedTerminal?.name}"`);
-              }
-            }
-          } catch (readErr) {
-            // File may have been deleted, ignore
-          }
-        }
-      });
+  let connected = false;
+  const child = screenCommands.watchEvents(
+    sessionName,
+    (event) => {
+      connected = true;
+      if (event.type !== 'title' || !event.text.trim()) {
+        return;
+      }
+      const newTitle = event.text.trim();
+      const storedTerminal = terminalManager.getTerminalByWindowId(windowId);
 
-      titleFileWatchers.set(sessionName, watcher);
-      logger.debug(`Watching title file: ${titlePath}`);
-    } catch (err) {
-      // File doesn't exist yet, retry later when terminal writes to it
-      setTimeout(startWatcher, 1000);
-    }
-  };
+      // A title the terminal already has is synced: screen reports it
+      // again on every reconnection
+      if (storedTerminal?.name === newTitle) {
+        return;
+      }
 
-  // Check if file exists before watching
-  fsSync.access(titlePath, fsSync.constants.F_OK, (err) => {
-    if (!err) {
-      startWatcher();
-    } else {
-      // File doesn't exist, wait for it to be created
-      // We'll retry periodically until the file appears
-      const retryInterval = setInterval(() => {
-        fsSync.access(titlePath, fsSync.constants.F_OK, (accessErr) => {
-          if (!accessErr) {
-            clearInterval(retryInterval);
-            startWatcher();
-          }
+      // Only sync if name is modifiable (not user's custom name)
+      if (storedTerminal && isModifiableName(storedTerminal.name, storedTerminal.claudeSessionId)) {
+        logger.debug(`Title event: "${newTitle}" for window ${windowId}`);
+        syncTerminalTitle(windowId, newTitle, terminalManager).catch((err) => {
+          logger.debug(`Could not sync title of ${windowId}:`, err);
         });
-      }, 1000);
-
-      // Stop retrying after 30 seconds (terminal may not have been started yet)
-      setTimeout(() => clearInterval(retryInterval), 30000);
+      } else {
+        logger.debug(`Ignoring title event - name not modifiable: "${storedTerminal?.name}"`);
+      }
+    },
+    () => {
+      if (sessionEventWatchers.get(sessionName) !== child) {
+        return; // removed in the meantime
+      }
+      sessionEventWatchers.delete(sessionName);
+      const left = connected ? EVENT_WATCH_RETRIES : retries - 1;
+      if (left > 0 && terminalManager.getTerminalByWindowId(windowId)) {
+        setTimeout(() => watchSessionEvents(sessionName, windowId, terminalManager, left), 1000);
+      }
     }
-  });
+  );
+
+  sessionEventWatchers.set(sessionName, child);
+  logger.debug(`Following events of ${sessionName}`);
 }
 
 /**
- * Add a title file watcher for a newly created terminal.
+ * Add a session event watcher for a newly created terminal.
  * Called when a new terminal is created.
  */
-export function addTitleFileWatcher(windowId: string, terminalManager: TerminalManager): void {
+export function addSessionEventWatcher(windowId: string, terminalManager: TerminalManager): void {
   const projectName = terminalManager.getProjectName();
   const sessionName = `${projectName}-${windowId}`;
-  watchTitleFile(sessionName, windowId, terminalManager);
+  watchSessionEvents(sessionName, windowId, terminalManager);
 }
 
 /**
- * Remove a title file watcher when terminal is closed.
+ * Remove a session event watcher when terminal is closed.
  */
-export function removeTitleFileWatcher(windowId: string, terminalManager: TerminalManager): void {
+export function removeSessionEventWatcher(windowId: string, terminalManager: TerminalManager): void {
   const projectName = terminalManager.getProjectName();
   const sessionName = `${projectName}-${windowId}`;
 
-  const watcher = titleFileWatchers.get(sessionName);
-  if (watcher) {
-    watcher.close();
-    titleFileWatchers.delete(sessionName);
-    logger.debug(`Closed title file watcher for ${sessionName}`);
+  const child = sessionEventWatchers.get(sessionName);
+  if (child) {
+    sessionEventWatchers.delete(sessionName);
+    child.kill();
+    logger.debug(`Stopped following events of ${sessionName}`);
   }
 
-  // Clean up the temp file
+  // Clean up the title file the C code still writes for other readers
   const titlePath = `/tmp/immorterm-title-${sessionName}`;
   fs.unlink(titlePath).catch(() => { /* ignore if doesn't exist */ });
 }
@@ -373,6 +383,9 @@ class ImmorTermProfileProvider implements vscode.TerminalProfileProvider {
         IMMORTERM_WINDOW_ID: windowId,
         IMMORTERM_DISPLAY_NAME: displayName,
         IMMORTERM_SCREEN_BINARY: screenBinary,
+        IMMORTERM_POOL_SIZE: String(getSessionPoolSize()),
+        IMMORTERM_HOST_SESSIONS: isHostSessionsEnabled() ? '1' : '0',
+        ...(isStartupTraceEnabled() ? { IMMORTERM_STARTUP_TRACE: '1' } : {}),
       },
     });
   }
@@ -489,12 +502,12 @@ function cancelScheduledCleanup(): void {
     logger.debug('Cancelled Claude sync timer');
   }
 
-  // Close all title file watchers
-  for (const [sessionName, watcher] of titleFileWatchers) {
-    watcher.close();
-    logger.debug(`Closed title file watcher for ${sessionName}`);
+  // Close all session event connections
+  for (const [sessionName, child] of sessionEventWatchers) {
+    child.kill();
+    logger.debug(`Stopped following events of ${sessionName}`);
   }
-  titleFileWatchers.clear();
+  sessionEventWatchers.clear();
 }
 
 /**
@@ -1189,6 +1202,26 @@ function registerCommands(
   );
   context.subscriptions.push(setTerminalThemeCmd);
 
+  // Command: Search All Terminals
+  // Greps what every terminal still holds in memory, see screen's grep command
+  const searchAllTerminalsCmd = vscode.commands.registerCommand(
+    'immorterm.searchAllTerminals',
+    async () => {
+      await searchAllTerminals(terminalManager);
+    }
+  );
+  context.subscriptions.push(searchAllTerminalsCmd);
+
+  // Command: Export Terminal
+  // Writes the history of the active terminal, see screen's export command
+  const exportTerminalCmd = vscode.commands.registerCommand(
+    'immorterm.exportTerminal',
+    async () => {
+      await exportTerminal(terminalManager);
+    }
+  );
+  context.subscriptions.push(exportTerminalCmd);
+
   // TEST Command: Try to set terminal title via sendText with OSC
   const testTitleCmd = vscode.commands.registerCommand(
     'immorterm.testTitle',
@@ -1243,7 +1276,7 @@ function subscribeToTerminalEvents(
     const envWindowId = opts?.env?.IMMORTERM_WINDOW_ID;
     if (envWindowId) {
       terminalManager.trackTerminal(terminal, envWindowId);
-      addTitleFileWatcher(envWindowId, terminalManager);
+      addSessionEventWatcher(envWindowId, terminalManager);
       logger.info('Tracked terminal by env var:', envWindowId);
       return;
     }
@@ -1257,7 +1290,7 @@ function subscribeToTerminalEvents(
     if (terminalState) {
       // Found matching terminal in storage - track it!
       terminalManager.trackTerminal(terminal, terminalState.windowId);
-      addTitleFileWatcher(terminalState.windowId, terminalManager);
+      addSessionEventWatcher(terminalState.windowId, terminalManager);
       logger.info('Tracked new terminal by name:', terminal.name, '->', terminalState.windowId);
     } else {
       // Terminal not in storage yet - might be reconciled later via pending file
@@ -1267,7 +1300,7 @@ function subscribeToTerminalEvents(
           const retryState = storage.getTerminalByName(terminal.name);
           if (retryState) {
             terminalManager.trackTerminal(terminal, retryState.windowId);
-            addTitleFileWatcher(retryState.windowId, terminalManager);
+            addSessionEventWatcher(retryState.windowId, terminalManager);
             logger.info('Tracked terminal after delay:', terminal.name, '->', retryState.windowId);
           }
         }
@@ -1292,8 +1325,8 @@ function subscribeToTerminalEvents(
       // Clear restored terminal tracking (if within grace period)
       restoredTerminals.delete(windowId);
 
-      // Remove title file watcher
-      removeTitleFileWatcher(windowId, terminalManager);
+      // Stop following its session's events
+      removeSessionEventWatcher(windowId, terminalManager);
 
       // Schedule cleanup with grace period (prevents accidental cleanup during VS Code reload)
       // The logsDir is captured from the outer scope (initResult)
@@ -1313,9 +1346,8 @@ function subscribeToTerminalEvents(
   context.subscriptions.push(onDidCloseTerminal);
   disposables.push(onDidCloseTerminal);
 
-  // Set up file watchers for title change notifications from ImmorTerm C code
-  // C code writes to /tmp/immorterm-title-{sessionname} when title changes
-  setupTitleFileWatchers(terminalManager);
+  // Follow the sessions' events for title changes from ImmorTerm C code
+  setupSessionEventWatchers(terminalManager);
 
   // Track terminal state changes (may include name changes)
   const onDidChangeTerminalState = vscode.window.onDidChangeTerminalState(
@@ -1358,6 +1390,9 @@ function subscribeToTerminalEvents(
         // Check if this terminal's name changed (user manual rename via VS Code UI)
         const windowId = terminalManager.getWindowIdForTerminal(terminal);
         if (windowId) {
+          // Remembered so that the next restore brings this terminal up first
+          await terminalManager.getStorage().updateTerminal(windowId, { lastFocused: Date.now() });
+
           const storedTerminal = terminalManager.getTerminalByWindowId(windowId);
           if (storedTerminal && storedTerminal.name !== terminal.name) {
             // Check if we should skip this sync (command-initiated rename)
@@ -1689,6 +1724,18 @@ export async function activate(
   } else {
     logger.info('Terminal restoration disabled by settings');
   }
+
+  // Keep sessions ready for new terminals (immorterm.sessionPool)
+  if (screenAvailable) {
+    fillSessionPool(terminalsDir);
+    context.subscriptions.push(
+      onSettingsChange((e) => {
+        if (isSettingChanged(e, SETTINGS.SESSION_POOL) || isSettingChanged(e, SETTINGS.HOST_SESSIONS)) {
+          fillSessionPool(terminalsDir);
+        }
+      })
+    );
+  }
 }
 
 /**
@@ -16,6 +16,8 @@ export interface TerminalState {
   createdAt: number;
   /** Unix timestamp when terminal was last attached */
   lastAttached: number;
+  /** Unix timestamp when terminal was last the active one (restored first) */
+  lastFocused?: number;
   /** Claude session ID if this terminal is running Claude Code */
   claudeSessionId?: string;
   /** Terminal position in the tab bar */
@@ -14,6 +14,7 @@ export {
   createTerminalWithScreen,
   createNewImmorTerminal,
   createStandardTerminal,
+  fillSessionPool,
   isImmorTermTerminal,
   setScreenAvailable,
   isScreenAvailable,
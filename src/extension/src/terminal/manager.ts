@@ -364,8 +364,15 @@ export class TerminalManager {
         const fs = await import('fs/promises');
         const path = await import('path');
         const logPath = path.join(logsDir, `${terminalState.screenSession}.log`);
-        await fs.unlink(logPath);
-        logger.debug('Deleted log file:', logPath);
+        // the log, the plain text log next to it (logfile text), gzipped or
+        // not (logfile compress), the window's checkpoint with its journal,
+        // and its history store with the one rotated before (logfile history)
+        for (const suffix of ['', '.gz', '.txt', '.txt.gz', '.ckpt', '.ckpt.jnl', '.hist', '.hist.1']) {
+          await fs.unlink(logPath + suffix).then(
+            () => logger.debug('Deleted log file:', logPath + suffix),
+            () => {} // Log file might not exist, that's okay
+          );
+        }
       } catch {
         // Log file might not exist, that's okay
       }
@@ -1,10 +1,14 @@
 import * as vscode from 'vscode';
+import * as fs from 'fs';
+import * as os from 'os';
+import * as path from 'path';
 import { exec } from 'child_process';
 import { promisify } from 'util';
 import { TerminalManager } from './manager';
 import { TerminalState } from '../storage/workspace-state';
 import { createTerminalWithScreen, isScreenAvailable, isModifiableName } from './screen-integration';
 import { logger } from '../utils/logger';
+import { screenCommands } from '../utils/screen-commands';
 import { shouldCloseExistingOnRestore } from '../utils/settings';
 import { getAllTerminalsFromJson } from '../json-utils';
 import { getTheme, generateHardstatus } from '../themes';
@@ -12,6 +16,15 @@ import { markAsRestored } from '../extension';
 
 const execAsync = promisify(exec);
 
+/** Terminals whose screen-auto may run at once during a restore */
+const RESTORE_CONCURRENCY = 3;
+
+/** Longest a terminal holds its slot waiting for its session to come up */
+const RESTORE_SLOT_TIMEOUT = 5000;
+
+/** How often the sessions of the terminals holding a slot are checked */
+const RESTORE_POLL_INTERVAL = 150;
+
 /**
  * Configuration options for terminal restoration
  */
@@ -139,6 +152,7 @@ export async function restoreTerminals(
     screenSession: `${projectName}-${t.windowId}`,
     createdAt: Date.now(),
     lastAttached: Date.now(),
+    lastFocused: manager.getTerminalByWindowId(t.windowId)?.lastFocused,
     claudeSessionId: t.claudeSessionId,
   }));
 
@@ -148,7 +162,25 @@ export async function restoreTerminals(
   // Uses a small stagger (50ms) between terminal creations to avoid VS Code race conditions
   const STAGGER_DELAY = 50; // ms between starting each terminal creation
 
-  logger.info(`Restoring ${terminals.length} terminals in parallel...`);
+  // The tabs are all created at once, in their order, but only the
+  // RESTORE_CONCURRENCY most recently focused terminals start right away
+  // (dumping their log and starting screen); the others wait behind a gate
+  // file that is removed as terminals ahead of them come up
+  const order = terminals
+    .map((_, i) => i)
+    .sort((a, b) => (terminals[b].lastFocused ?? 0) - (terminals[a].lastFocused ?? 0));
+  const gates = new Map<number, string>();
+  for (const i of order.slice(RESTORE_CONCURRENCY)) {
+    const gate = path.join(os.tmpdir(), `immorterm-restore-${terminals[i].screenSession}`);
+    try {
+      fs.writeFileSync(gate, '');
+      gates.set(i, gate);
+    } catch (error) {
+      logger.debug(`Could not create restore gate ${gate}:`, error);
+    }
+  }
+
+  logger.info(`Restoring ${terminals.length} terminals, ${RESTORE_CONCURRENCY} at a time...`);
 
   // Create restoration promises with staggered starts
   const restorationPromises = terminals.map(async (terminalState, i) => {
@@ -162,11 +194,13 @@ export async function restoreTerminals(
         manager,
         terminalState,
         options.scriptsPath,
-        projectName
+        projectName,
+        gates.get(i)
       );
       return detail;
     } catch (error) {
       logger.error(`Failed to restore terminal ${terminalState.windowId}:`, error);
+      openGate(gates.get(i));
       return {
         windowId: terminalState.windowId,
         name: terminalState.name,
@@ -179,6 +213,12 @@ export async function restoreTerminals(
   // Wait for all restorations to complete
   const details = await Promise.all(restorationPromises);
 
+  // The gated terminals come up in the background
+  if (gates.size > 0) {
+    releaseGates(order.map((i) => ({ session: terminals[i].screenSession, gate: gates.get(i) })))
+      .catch((error) => logger.warn('Could not restore the remaining terminals:', error));
+  }
+
   // Aggregate results
   for (const detail of details) {
     result.details.push(detail);
@@ -205,10 +245,10 @@ export async function restoreTerminals(
     // Delay to ensure VS Code has registered the terminals
     await delay(200);
 
-    // Show the first terminal to open the panel
-    const allTerminals = vscode.window.terminals;
-    if (allTerminals.length > 0) {
-      allTerminals[0].show(false); // false = take focus
+    // Show the terminal focused last (else the first one) to open the panel
+    const shown = manager.getTerminalForWindowId(terminals[order[0]].windowId) ?? vscode.window.terminals[0];
+    if (shown) {
+      shown.show(false); // false = take focus
       logger.info('Revealed terminal panel after restoration');
     }
   }
@@ -223,13 +263,15 @@ export async function restoreTerminals(
  * @param terminalState The stored terminal state
  * @param scriptsPath Path to the scripts directory
  * @param projectName The project name for session naming
+ * @param restoreGate File its screen-auto waits on before it starts, if any
  * @returns RestorationDetail for this terminal
  */
 async function restoreSingleTerminal(
   manager: TerminalManager,
   terminalState: TerminalState,
   scriptsPath: string,
-  projectName: string
+  projectName: string,
+  restoreGate?: string
 ): Promise<RestorationDetail> {
   const { windowId, name, screenSession, claudeSessionId } = terminalState;
 
@@ -256,6 +298,7 @@ async function restoreSingleTerminal(
     cwd: vscode.workspace.workspaceFolders?.[0]?.uri.fsPath,
     isRestoration: true,
     claudeSessionId,
+    restoreGate,
   });
 
   // Cancel any pending cleanup (in case terminal is being restored during grace period)
@@ -308,6 +351,52 @@ async function restoreSingleTerminal(
   };
 }
 
+/**
+ * Lets a gated terminal's screen-auto start
+ * @param gate Its gate file, if it has one
+ */
+function openGate(gate: string | undefined): void {
+  if (gate) {
+    fs.unlink(gate, () => { /* ignore if screen-auto removed it */ });
+  }
+}
+
+/**
+ * Opens the restore gates in turn, keeping RESTORE_CONCURRENCY terminals
+ * starting at once: a terminal gives up its slot when its session shows
+ * up in one shared `screen -ls` (its log is dumped by then), or after
+ * RESTORE_SLOT_TIMEOUT.
+ *
+ * @param queue All terminals, first to be restored first; the ones
+ *              without a gate started right away
+ */
+async function releaseGates(queue: Array<{ session: string; gate?: string }>): Promise<void> {
+  const starting = new Map<string, number>();
+  const waiting = queue.filter((entry) => {
+    if (!entry.gate) {
+      starting.set(entry.session, Date.now());
+    }
+    return entry.gate !== undefined;
+  });
+
+  while (waiting.length > 0) {
+    await delay(RESTORE_POLL_INTERVAL);
+    const sessions = await screenCommands.listSessions();
+    const now = Date.now();
+    for (const [session, since] of starting) {
+      if (sessions.has(session) || now - since > RESTORE_SLOT_TIMEOUT) {
+        starting.delete(session);
+      }
+    }
+    while (starting.size < RESTORE_CONCURRENCY && waiting.length > 0) {
+      const next = waiting.shift()!;
+      openGate(next.gate);
+      starting.set(next.session, now);
+      logger.debug(`Restore gate opened for ${next.session}`);
+    }
+  }
+}
+
 /**
  * Applies a per-terminal theme to a running screen session
  *
@@ -1,6 +1,8 @@
 import * as vscode from 'vscode';
 import * as path from 'path';
+import { spawn } from 'child_process';
 import { logger } from '../utils/logger';
+import { getSessionPoolSize, isHostSessionsEnabled, isStartupTraceEnabled } from '../utils/settings';
 
 /** Module-level flag for Screen availability (set by activation) */
 let screenAvailableFlag = true;
@@ -37,6 +39,8 @@ export interface CreateTerminalOptions {
   isRestoration?: boolean;
   /** Claude session ID if this terminal has an active Claude session */
   claudeSessionId?: string;
+  /** A file screen-auto waits to disappear before it starts (see restoreTerminals) */
+  restoreGate?: string;
 }
 
 /**
@@ -97,7 +101,7 @@ export function isModifiableName(name: string, claudeSessionId?: string): boolea
  * @returns The created VS Code Terminal instance
  */
 export function createTerminalWithScreen(options: CreateTerminalOptions): vscode.Terminal {
-  const { name, windowId, scriptsPath, cwd, isRestoration = false, claudeSessionId } = options;
+  const { name, windowId, scriptsPath, cwd, isRestoration = false, claudeSessionId, restoreGate } = options;
 
   // Graceful degradation: if Screen is not available, create standard terminal
   if (!screenAvailableFlag) {
@@ -154,6 +158,10 @@ export function createTerminalWithScreen(options: CreateTerminalOptions): vscode
       IMMORTERM_WINDOW_ID: windowId,
       IMMORTERM_DISPLAY_NAME: name,
       IMMORTERM_SCREEN_BINARY: screenBinary,
+      IMMORTERM_POOL_SIZE: String(getSessionPoolSize()),
+      IMMORTERM_HOST_SESSIONS: isHostSessionsEnabled() ? '1' : '0',
+      ...(isStartupTraceEnabled() ? { IMMORTERM_STARTUP_TRACE: '1' } : {}),
+      ...(restoreGate ? { IMMORTERM_RESTORE_GATE: restoreGate } : {}),
     },
   };
 
@@ -168,6 +176,34 @@ export function createTerminalWithScreen(options: CreateTerminalOptions): vscode
   return terminal;
 }
 
+/**
+ * Brings the pool of ready sessions to the configured size (immorterm.sessionPool)
+ *
+ * screen-pool starts detached sessions past their screenrc and socket setup;
+ * screen-auto takes one for a new terminal and refills the pool behind it.
+ * A size of 0 quits the ready sessions, as does host mode
+ * (immorterm.hostSessions), which starts sessions in the host instead.
+ *
+ * @param scriptsPath Path to the .vscode/terminals directory containing scripts
+ */
+export function fillSessionPool(scriptsPath: string): void {
+  const size = isHostSessionsEnabled() ? 0 : getSessionPoolSize();
+  const screenBinary = vscode.workspace.getConfiguration('immorterm').get<string>('screenBinary', 'immorterm');
+
+  try {
+    const child = spawn(path.join(scriptsPath, 'screen-pool'), ['fill', String(size)], {
+      detached: true,
+      stdio: 'ignore',
+      env: { ...process.env, IMMORTERM_SCREEN_BINARY: screenBinary },
+    });
+    child.on('error', (err) => logger.warn('Failed to fill the session pool:', err));
+    child.unref();
+    logger.debug(`Filling the session pool to ${size}`);
+  } catch (err) {
+    logger.warn('Failed to fill the session pool:', err);
+  }
+}
+
 /**
  * Creates a standard VS Code terminal without Screen integration
  * Used for graceful degradation when Screen is not available
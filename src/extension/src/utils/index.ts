@@ -40,6 +40,7 @@ export {
   getMaxLogSizeMb,
   getLogRetainLines,
   isDebugLogEnabled,
+  isStartupTraceEnabled,
   getCloseGracePeriod,
   shouldAutoCleanupStale,
   isStatusBarEnabled,
@@ -22,6 +22,7 @@ const BUNDLED_SCRIPTS = [
   'screen-forget',
   'screen-forget-all',
   'screen-reconcile',
+  'screen-pool',
   'kill-screens',
   'log-cleanup',
   // Claude session tracking (for resume after restart)
@@ -60,6 +61,7 @@ export interface ExtractionResult {
  * ├── screen-forget            (executable - remove single session)
  * ├── screen-forget-all        (executable - kill all sessions)
  * ├── screen-reconcile         (executable - reconcile pending terminals)
+ * ├── screen-pool              (executable - sessions kept ready for new terminals)
  * ├── kill-screens             (executable - kill all project screens)
  * ├── claude-session-capture   (executable - capture Claude session IDs)
  * ├── claude-session-map       (executable - interactive session mapper)
@@ -1,4 +1,5 @@
-import { exec } from 'child_process';
+import { ChildProcess, exec, execFile, spawn } from 'child_process';
+import * as readline from 'readline';
 import { promisify } from 'util';
 import * as vscode from 'vscode';
 import { logger } from './logger';
@@ -62,6 +63,82 @@ function parseScreenLsOutput(output: string): Map<string, ScreenSession> {
   return sessions;
 }
 
+/**
+ * Result of one command of a batch (see screenCommands.runBatch)
+ */
+export interface BatchResult {
+  /** Whether the command worked (always true for non-query commands) */
+  ok: boolean;
+  /** What a query printed */
+  output: string;
+}
+
+/**
+ * Parses the output of `screen -Q -` / `screen -X -`: for each command
+ * '0' or '1' for success or failure, a space, its output and a NUL
+ */
+function parseBatchOutput(output: string): BatchResult[] {
+  const records = output.split('\0');
+  records.pop(); // the last NUL ends the last record
+  return records.map((record) => ({ ok: record[0] === '0', output: record.slice(2) }));
+}
+
+/**
+ * One event a session reports (see screenCommands.watchEvents): new, dead,
+ * title, name, bell, activity, attach or detach
+ */
+export interface ScreenEvent {
+  type: string;
+  /** The window it concerns, -1 if none */
+  window: number;
+  /** The title, name or tty that comes with it, '' if none */
+  text: string;
+}
+
+/**
+ * Parses one line of `screen -Q events`: the event, the window number and
+ * an optional text, separated by single spaces
+ */
+function parseEventLine(line: string): ScreenEvent | null {
+  const match = /^(\S+) (-?\d+)(?: (.*))?$/.exec(line);
+  if (!match) {
+    return null;
+  }
+  return { type: match[1], window: parseInt(match[2], 10), text: match[3] ?? '' };
+}
+
+/**
+ * One line of a window's history that matched (see screenCommands.grep)
+ */
+export interface GrepMatch {
+  /** The window it is in */
+  window: number;
+  /** Its line number, 1 being the oldest line kept */
+  line: number;
+  /** The text of the line */
+  text: string;
+}
+
+/**
+ * What screen's export command can write (see screenCommands.exportHistory)
+ */
+export type ExportFormat = 'plain' | 'ansi' | 'html';
+
+/**
+ * Parses the output of `screen -Q grep`: window number, line number and
+ * text of each matching line, separated by tabs
+ */
+function parseGrepOutput(output: string): GrepMatch[] {
+  const matches: GrepMatch[] = [];
+  for (const line of output.split('\n')) {
+    const match = /^(\d+)\t(\d+)\t(.*)$/.exec(line);
+    if (match) {
+      matches.push({ window: parseInt(match[1], 10), line: parseInt(match[2], 10), text: match[3] });
+    }
+  }
+  return matches;
+}
+
 /**
  * Screen CLI wrapper for ImmorTerm extension
  * Provides methods for interacting with GNU Screen sessions
@@ -180,13 +257,19 @@ export const screenCommands = {
   /**
    * Lists all sessions matching a project pattern
    * @param projectName The project name prefix to match
+   * @param includePool Whether to include the sessions kept ready for new
+   *   terminals (screen-pool), which belong to no terminal yet, and the one
+   *   hosting the others (immorterm.hostSessions)
    * @returns Array of matching session info
    */
-  async listProjectSessions(projectName: string): Promise<ScreenSession[]> {
+  async listProjectSessions(projectName: string, includePool = false): Promise<ScreenSession[]> {
     const sessions = await this.listSessions();
     const matching: ScreenSession[] = [];
 
     for (const [name, session] of sessions) {
+      if (!includePool && (name.startsWith(`${projectName}-pool-`) || name === `${projectName}-host`)) {
+        continue;
+      }
       if (name.startsWith(`${projectName}-`)) {
         matching.push(session);
       }
@@ -201,7 +284,7 @@ export const screenCommands = {
    * @returns Number of sessions killed
    */
   async killProjectSessions(projectName: string): Promise<number> {
-    const sessions = await this.listProjectSessions(projectName);
+    const sessions = await this.listProjectSessions(projectName, true);
     let killed = 0;
 
     for (const session of sessions) {
@@ -274,6 +357,114 @@ export const screenCommands = {
     }
   },
 
+  /**
+   * Runs several commands in one session over a single connection
+   * (`screen -X -` or `-Q -`), instead of spawning screen once for each
+   * @param sessionName The session to run them in
+   * @param commands Command lines in screenrc syntax, one per command
+   * @param query Run them as queries (-Q) and collect their output
+   * @returns One result per command that ran; fewer if the session went
+   *          away in between (e.g. after quit), null if none could be sent
+   */
+  async runBatch(sessionName: string, commands: string[], query = false): Promise<BatchResult[] | null> {
+    const screen = getScreenBinary();
+    return new Promise((resolve) => {
+      const child = execFile(
+        screen,
+        ['-S', sessionName, query ? '-Q' : '-X', '-'],
+        (error, stdout) => {
+          // a failed command makes screen exit with 1; its result says which
+          const results = parseBatchOutput(stdout ?? '');
+          if (error && results.length === 0) {
+            logger.warn(`Failed to run commands in ${sessionName}:`, error);
+            resolve(null);
+            return;
+          }
+          resolve(results);
+        }
+      );
+      child.stdin?.end(commands.map((command) => command.replace(/[\r\n]/g, ' ')).join('\n') + '\n');
+    });
+  },
+
+  /**
+   * Follows the events of a session over one long-lived connection
+   * (`screen -Q events`). It starts with a new event for each window, its
+   * title and an attach for each display, then reports changes as they
+   * happen.
+   * @param sessionName The session to follow
+   * @param onEvent Called for each event
+   * @param onExit Called once the connection is gone: the session ended,
+   *               was not there yet, or dropped a reader that fell behind
+   * @returns The screen process; kill it to stop following
+   */
+  watchEvents(
+    sessionName: string,
+    onEvent: (event: ScreenEvent) => void,
+    onExit: () => void
+  ): ChildProcess {
+    const child = spawn(getScreenBinary(), ['-S', sessionName, '-Q', 'events'], {
+      stdio: ['ignore', 'pipe', 'ignore'],
+    });
+    const lines = readline.createInterface({ input: child.stdout! });
+    lines.on('line', (line) => {
+      const event = parseEventLine(line);
+      if (event) {
+        onEvent(event);
+      }
+    });
+    child.on('error', (error) => logger.debug(`Could not follow events of ${sessionName}:`, error));
+    child.on('close', onExit);
+    return child;
+  },
+
+  /**
+   * Searches the history and screen of every window of a session
+   * (`screen -Q grep`), without touching the log files
+   * @param sessionName The session to search
+   * @param pattern A literal string, or an extended regular expression
+   * @param options ignoreCase, regex, and max (most matches, 0 for all)
+   * @returns The matching lines, oldest first within a window; [] if none
+   *          matched or the session is gone
+   */
+  async grep(
+    sessionName: string,
+    pattern: string,
+    options: { ignoreCase?: boolean; regex?: boolean; max?: number } = {}
+  ): Promise<GrepMatch[]> {
+    const args = ['-S', sessionName, '-Q', 'grep', '-m', String(options.max ?? 1000)];
+    if (options.ignoreCase) {
+      args.push('-i');
+    }
+    if (options.regex) {
+      args.push('-E');
+    }
+    // screen expands \, ^ and $ in command arguments
+    args.push('--', pattern.replace(/[\\^$]/g, '\\$&'));
+    return new Promise((resolve) => {
+      execFile(getScreenBinary(), args, { maxBuffer: 16 * 1024 * 1024 }, (_error, stdout) => {
+        // screen exits with 1 if nothing matched; the output tells
+        resolve(parseGrepOutput(stdout ?? ''));
+      });
+    });
+  },
+
+  /**
+   * Writes the history and screen of a session's window to a file
+   * (`screen -X export -h`), rendered from its cells by screen
+   * @param sessionName The session to export
+   * @param format plain text, text with ANSI colors, or an HTML page
+   * @param file Absolute path of the file to write
+   * @returns Whether screen took the command
+   */
+  async exportHistory(sessionName: string, format: ExportFormat, file: string): Promise<boolean> {
+    // screen expands \, ^ and $ in command arguments
+    const args = ['-S', sessionName, '-X', 'export', '-h', '-f', format, '--', file.replace(/[\\^$]/g, '\\$&')];
+    return new Promise((resolve) => {
+      execFile(getScreenBinary(), args, (error) => resolve(!error));
+    });
+  },
+
   /**
    * Gets the configured screen binary name
    * @returns The screen binary path
@@ -22,11 +22,14 @@ export const SETTINGS = {
   MAX_LOG_SIZE_MB: 'maxLogSizeMb',
   LOG_RETAIN_LINES: 'logRetainLines',
   ENABLE_DEBUG_LOG: 'enableDebugLog',
+  STARTUP_TRACE: 'startupTrace',
 
   // Behavior
   CLOSE_GRACE_PERIOD: 'closeGracePeriod',
   AUTO_CLEANUP_STALE: 'autoCleanupStale',
   STATUS_BAR_ENABLED: 'statusBarEnabled',
+  SESSION_POOL: 'sessionPool',
+  HOST_SESSIONS: 'hostSessions',
 
   // Naming
   NAMING_PATTERN: 'namingPattern',
@@ -54,9 +57,12 @@ export const DEFAULTS = {
   [SETTINGS.MAX_LOG_SIZE_MB]: 300,
   [SETTINGS.LOG_RETAIN_LINES]: 50000,
   [SETTINGS.ENABLE_DEBUG_LOG]: false,
+  [SETTINGS.STARTUP_TRACE]: false,
   [SETTINGS.CLOSE_GRACE_PERIOD]: 60000,
   [SETTINGS.AUTO_CLEANUP_STALE]: true,
   [SETTINGS.STATUS_BAR_ENABLED]: true,
+  [SETTINGS.SESSION_POOL]: 2,
+  [SETTINGS.HOST_SESSIONS]: false,
   [SETTINGS.NAMING_PATTERN]: '${project}-${n}',
   [SETTINGS.CLAUDE_AUTO_RESUME]: true,
   [SETTINGS.CLAUDE_SYNC_INTERVAL]: 30000,
@@ -74,9 +80,12 @@ export interface SettingTypes {
   [SETTINGS.MAX_LOG_SIZE_MB]: number;
   [SETTINGS.LOG_RETAIN_LINES]: number;
   [SETTINGS.ENABLE_DEBUG_LOG]: boolean;
+  [SETTINGS.STARTUP_TRACE]: boolean;
   [SETTINGS.CLOSE_GRACE_PERIOD]: number;
   [SETTINGS.AUTO_CLEANUP_STALE]: boolean;
   [SETTINGS.STATUS_BAR_ENABLED]: boolean;
+  [SETTINGS.SESSION_POOL]: number;
+  [SETTINGS.HOST_SESSIONS]: boolean;
   [SETTINGS.NAMING_PATTERN]: string;
   [SETTINGS.CLAUDE_AUTO_RESUME]: boolean;
   [SETTINGS.CLAUDE_SYNC_INTERVAL]: number;
@@ -204,6 +213,13 @@ export function isDebugLogEnabled(): boolean {
   return getConfig(SETTINGS.ENABLE_DEBUG_LOG);
 }
 
+/**
+ * Checks if Screen should log the timing of its startup phases
+ */
+export function isStartupTraceEnabled(): boolean {
+  return getConfig(SETTINGS.STARTUP_TRACE);
+}
+
 /**
  * Gets the close grace period in milliseconds
  */
@@ -225,6 +241,20 @@ export function isStatusBarEnabled(): boolean {
   return getConfig(SETTINGS.STATUS_BAR_ENABLED);
 }
 
+/**
+ * Gets the number of detached sessions to keep ready for new terminals
+ */
+export function getSessionPoolSize(): number {
+  return getConfig(SETTINGS.SESSION_POOL);
+}
+
+/**
+ * Checks if the sessions of the project should share one Screen process
+ */
+export function isHostSessionsEnabled(): boolean {
+  return getConfig(SETTINGS.HOST_SESSIONS);
+}
+
 /**
  * Gets the naming pattern for terminals
  */
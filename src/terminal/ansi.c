@@ -34,17 +34,30 @@
 #include <sys/time.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "screen.h"
 
+#include "cell.h"
+#include "checkpoint.h"
+#include "events.h"
 #include "encoding.h"
 #include "fileio.h"
 #include "help.h"
+#include "histstore.h"
 #include "logfile.h"
 #include "mark.h"
 #include "misc.h"
 #include "process.h"
 #include "resize.h"
+#include "search.h"
+#include "trace.h"
+#include "vtparse.h"
 #include "winmsg.h"
 
 /* widths for Z0/Z1 switching */
@@ -54,6 +67,11 @@ const int Z1width = 80;
 bool use_altscreen = false;	/* enable alternate screen support? */
 bool use_hardstatus = true;	/* display status line in hs */
 bool visual_bell = 0;
+int scrollback_compress = 0;	/* ImmorTerm: compress history older than this many lines, 0 = off */
+char *scrollback_dir = NULL;	/* ImmorTerm: keep compressed history in files here */
+bool scrollback_dedup = false;	/* ImmorTerm: keep identical history lines once, see cell_share() */
+bool scrollback_settle = false;	/* ImmorTerm: keep only the settled frame of redraws, see RedrawHold() */
+size_t stringlimit = 1024 * 1024;	/* ImmorTerm: longest OSC/DCS/APC/PM string kept */
 
 char *printcmd = NULL;
 
@@ -101,6 +119,7 @@ static void DoESC(Window *, int, int);
 static void DoCSI(Window *, int, int);
 static void StringStart(Window *, enum string_t);
 static void StringChar(Window *, int);
+static size_t StringRun(Window *, const char *, size_t);
 static int StringEnd(Window *);
 static void PrintStart(Window *);
 static void PrintChar(Window *, int);
@@ -119,6 +138,7 @@ static void DeleteChar(Window *, int);
 static void DeleteLine(Window *, int);
 static void InsertLine(Window *, int);
 static void Scroll(char *, int, int, char *);
+static void MSlideLines(Window *, int);
 static void ForwardTab(Window *win);
 static void BackwardTab(Window *win);
 static void ClearScreen(Window *win);
@@ -137,7 +157,16 @@ static void FindAKA(Window *);
 static void Report(Window *, char *, int, int);
 static void ScrollRegion(Window *win, int);
 static void WAddLineToHist(Window *, struct mline *);
+static void HistKeep(Window *, struct mline *);
+static bool RedrawHold(Window *, struct mline *);
+static void RedrawStart(Window *, int);
+static int HistThaw(Window *, int, bool);
+static void HistMapStore(Window *, int);
+static void HistUnmap(Window *);
+static void HistStoreLine(Window *);
 static void WLogString(Window *, char *, size_t);
+static void WLogText(Window *, struct mline *, int);
+static struct mline *HistExpand(const struct hline *, int);
 static void WReverseVideo(Window *, bool);
 static void MFixLine(Window *, int, struct mchar *);
 static void MScrollH(Window *, int, int, int, int, int);
@@ -145,6 +174,7 @@ static void MScrollV(Window *, int, int, int, int);
 static void MClearArea(Window *, int, int, int, int, int);
 static void MInsChar(Window *, struct mchar *, int, int);
 static void MPutChar(Window *, struct mchar *, int, int);
+static void MPutStr(Window *, char *, int, int, int);
 static void MWrapChar(Window *, struct mchar *, int, int, int, bool);
 static void MBceLine(Window *, int, int, int, int);
 static void WChangeSize(Window *, int, int);
@@ -204,6 +234,72 @@ void SetCharsets(Window *win, char *s)
 
 /*****************************************************************/
 
+/*
+ * Length of the leading run of printable ASCII (0x20 - 0x7e) in buf.
+ */
+static size_t PrintableRun(const char *buf, size_t len)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i lo = _mm_set1_epi8(0x1f);
+	const __m128i hi = _mm_set1_epi8(0x7f);
+
+	/* bytes >= 0x80 are negative as signed chars and fail the lower bound */
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+		__m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+		unsigned int mask = _mm_movemask_epi8(ok);
+		if (mask != 0xffff)
+			return i + __builtin_ctz(~mask);
+	}
+#endif
+	while (i < len && (unsigned char)buf[i] >= ' ' && (unsigned char)buf[i] < 0x7f)
+		i++;
+	return i;
+}
+
+/*
+ * Fast path for plain text: lay down as much of a printable ASCII run
+ * as fits on the current line in one go. Only taken when the per-byte
+ * path would produce exactly the same cells, i.e. no pending multibyte
+ * or shift state, no insert mode and the ASCII charset in GL.
+ * Returns the number of bytes consumed.
+ */
+static size_t WritePrintableRun(Window *win, char *buf, size_t len)
+{
+	size_t n;
+
+	if (win->w_state != LIT || win->w_decodestate || win->w_mbcs || win->w_ss
+	    || win->w_insert || win->w_FontL != ASCII || win->w_x >= win->w_width)
+		return 0;
+	n = PrintableRun(buf, len);
+	if (n > (size_t)(win->w_width - win->w_x))
+		n = win->w_width - win->w_x;
+	if (n == 0)
+		return 0;
+
+	win->w_rend.font = 0;
+	win->w_rend.mbcs = 0;
+	win->w_rend.image = (unsigned char)buf[n - 1];
+	MPutStr(win, buf, n, win->w_x, win->w_y);
+	LPutStr(&win->w_layer, buf, n, &win->w_rend, win->w_x, win->w_y);
+	win->w_x += n;
+	if (win->w_x == win->w_width && !win->w_wrap)
+		win->w_x = win->w_width - 1;
+	return n;
+}
+
+/* the entries of the UTF-8 lookahead from i on that are single ASCII bytes */
+static size_t LookaheadAscii(const uint32_t *cps, const uint8_t *cpl, size_t i, size_t n)
+{
+	size_t j;
+
+	for (j = i; j < n && cpl[j] == 1 && cps[j] < 0x80; j++)
+		;
+	return j - i;
+}
+
 /*
  *  Here comes the vt100 emulator
  *  - writes logfiles,
@@ -216,13 +312,32 @@ void WriteString(Window *win, char *buf, size_t len)
 {
 	int c;
 	int font;
+	int act;
 	Canvas *cv;
 
 	if (len == 0)
 		return;
-
-	/* Update last activity timestamp for status bar %A escape */
-	win->w_last_activity = time(NULL);
+	TRACE2(write__string, win->w_number, len);
+	win->w_stats.ws_parsed += len;
+	if (win->w_hibernated)
+		WindowWake(win);
+
+	/* ImmorTerm: the history replays go out before the output moves it */
+	if (win->w_dumps)
+		DumpScrollbackFinish(win, true);
+
+	/* Update last activity timestamp for the status bar %I escape, which
+	 * shows it to the minute: only a new minute changes what it displays,
+	 * so that is the only time the status needs repainting for it */
+	struct timeval tv;
+	SchedWalltime(&tv);
+	time_t now = tv.tv_sec;
+	bool newminute = now / 60 != win->w_last_activity / 60;
+	if (events_clients && now != win->w_last_activity)
+		EventPost("activity", win->w_number, NULL);
+	win->w_last_activity = now;
+	if (newminute)
+		WindowChanged(win, WINESC_LAST_ACTIVITY);
 
 	if (win->w_log)
 		WLogString(win, buf, len);
@@ -235,22 +350,69 @@ void WriteString(Window *win, char *buf, size_t len)
 	}
 
 	if (win->w_width > 0 && win->w_height > 0) {
-		do {
-			c = (unsigned char)*buf++;
+		uint32_t cps[256];	/* decoded lookahead when in UTF8 */
+		uint8_t cpl[256];	/* bytes of buf per entry of cps */
+		size_t cpi = 0, cpn = 0, cprest = 0;
+		int cpstate = 0;
+		size_t clen;
+
+		while (len > 0) {
+			if (cpi == cpn && cpn) {
+				/* lookahead used up, commit decoder state */
+				buf += cprest;
+				len -= cprest;
+				win->w_decodestate = cpstate;
+				cpi = cpn = 0;
+				if (len == 0)
+					break;
+			}
+			/* ImmorTerm: inside the lookahead the runs take its ASCII,
+			 * which is one byte of buf an entry */
+			if (win->w_state == LIT ? (unsigned char)*buf >= ' ' && (unsigned char)*buf < 0x7f
+			    : win->w_state == ASTR && !win->w_decodestate) {
+				size_t n = cpi < cpn ? LookaheadAscii(cps, cpl, cpi, cpn) : len;
+
+				if (n)
+					n = win->w_state == LIT ? WritePrintableRun(win, buf, n) : StringRun(win, buf, n);
+				buf += n;
+				len -= n;
+				if (cpi < cpn) {
+					cpi += n;
+					if (n)
+						continue;
+				} else if (len == 0)
+					break;
+			}
 			if (!win->w_mbcs)
 				win->w_rend.font = win->w_FontL;	/* Default: GL */
 
 			if (win->w_encoding == UTF8) {
-				c = FromUtf8(c, &win->w_decodestate);
-				if (c == -1)
-					continue;
-				if (c == -2) {
-					c = UCS_REPL;
-					/* try char again */
-					buf--;
-					len++;
+				if (cpi == cpn) {
+					size_t used;
+					cpstate = win->w_decodestate;
+					cpn = FromUtf8Buf((unsigned char *)buf, len, cps, cpl, ARRAY_SIZE(cps), &used, &cpstate);
+					cpi = 0;
+					cprest = used;
+					for (size_t i = 0; i < cpn; i++)
+						cprest -= cpl[i];
+					/* the state after the lookahead is only valid once it has been processed */
+					win->w_decodestate = 0;
+					if (cpn == 0) {
+						/* all of it went into a partial sequence */
+						win->w_decodestate = cpstate;
+						break;
+					}
 				}
+				c = cps[cpi];
+				clen = cpl[cpi++];
+			} else {
+				/* per byte; also drops the lookahead if the encoding was switched */
+				cpi = cpn = 0;
+				c = (unsigned char)*buf;
+				clen = 1;
 			}
+			buf += clen;
+			len -= clen;
 
  tryagain:
 			switch (win->w_state) {
@@ -324,7 +486,7 @@ void WriteString(Window *win, char *buf, size_t len)
 			case STRESC:
 				switch (c) {
 				case '\\':
-					if (StringEnd(win) == 0 || len <= 1)
+					if (StringEnd(win) == 0 || len == 0)
 						break;
 					/* check if somewhere a status is displayed */
 					for (cv = win->w_layer.l_cvlist; cv; cv = cv->c_lnext) {
@@ -333,10 +495,10 @@ void WriteString(Window *win, char *buf, size_t len)
 							break;
 					}
 					if (cv) {
-						if (len > IOSIZE + 1)
-							len = IOSIZE + 1;
-						win->w_outlen = len - 1;
-						memmove(win->w_outbuf, buf, len - 1);
+						if (len > IOSIZE)
+							len = IOSIZE;
+						win->w_outlen = len;
+						memmove(win->w_outbuf, buf, len);
 						return;	/* wait till status is gone */
 					}
 					break;
@@ -351,92 +513,68 @@ void WriteString(Window *win, char *buf, size_t len)
 				}
 				break;
 			case ESC:
-				switch (c) {
-				case '[':
+				act = vtp_action(vtp_esc, c);
+				switch (act & VTP_MASK) {
+				case VTP_CSI:
 					win->w_NumArgs = 0;
 					win->w_intermediate = 0;
 					memset((char *)win->w_args, 0, MAXARGS * sizeof(int));
 					win->w_state = CSI;
 					break;
-				case ']':
-					StringStart(win, OSC);
-					break;
-				case '_':
-					StringStart(win, APC);
+				case VTP_STRING:
+					StringStart(win, VTP_ARG(act));
 					break;
-				case 'P':
-					StringStart(win, DCS);
-					break;
-				case '^':
-					StringStart(win, PM);
+				case VTP_EXECUTE:
+					Special(win, c);
+					win->w_state = LIT;
 					break;
-				case '!':
-					StringStart(win, GM);
+				case VTP_COLLECT:
+					if (win->w_intermediate) {
+						if (win->w_intermediate == '$')
+							c |= '$' << 8;
+						else
+							c = -1;
+					}
+					win->w_intermediate = c;
 					break;
-				case '"':
-				case 'k':
-					StringStart(win, AKA);
+				case VTP_DISPATCH:
+					DoESC(win, c, win->w_intermediate);
+					win->w_state = LIT;
 					break;
 				default:
-					if (Special(win, c)) {
-						win->w_state = LIT;
-						break;
-					}
-					if (c >= ' ' && c <= '/') {
-						if (win->w_intermediate) {
-							if (win->w_intermediate == '$')
-								c |= '$' << 8;
-							else
-								c = -1;
-						}
-						win->w_intermediate = c;
-					} else if (c >= '0' && c <= '~') {
-						DoESC(win, c, win->w_intermediate);
-						win->w_state = LIT;
-					} else {
-						win->w_state = LIT;
-						goto tryagain;
-					}
+					win->w_state = LIT;
+					goto tryagain;
 				}
 				break;
 			case CSI:
-				switch (c) {
-				case '0':
-				case '1':
-				case '2':
-				case '3':
-				case '4':
-				case '5':
-				case '6':
-				case '7':
-				case '8':
-				case '9':
+				switch (vtp_action(vtp_csi, c)) {
+				case VTP_PARAM:
 					if (win->w_NumArgs >= 0 && win->w_NumArgs < MAXARGS) {
 						if (win->w_args[win->w_NumArgs] < 100000000)
 							win->w_args[win->w_NumArgs] =
 							    10 * win->w_args[win->w_NumArgs] + (c - '0');
 					}
 					break;
-				case ';':
-				case ':':
+				case VTP_SEP:
 					if (win->w_NumArgs < MAXARGS)
 						win->w_NumArgs++;
 					break;
-				default:
-					if (Special(win, c))
-						break;
-					if (c >= '@' && c <= '~') {
-						if (win->w_NumArgs < MAXARGS)
-							win->w_NumArgs++;
-						DoCSI(win, c, win->w_intermediate);
-						if (win->w_state != PRIN)
-							win->w_state = LIT;
-					} else if ((c >= ' ' && c <= '/') || (c >= '<' && c <= '?'))
-						win->w_intermediate = win->w_intermediate ? -1 : c;
-					else {
+				case VTP_EXECUTE:
+					Special(win, c);
+					break;
+				case VTP_DISPATCH:
+					if (win->w_NumArgs < MAXARGS)
+						win->w_NumArgs++;
+					DoCSI(win, c, win->w_intermediate);
+					if (win->w_state != PRIN)
 						win->w_state = LIT;
-						goto tryagain;
-					}
+					break;
+				case VTP_COLLECT:
+					win->w_intermediate = win->w_intermediate ? -1 : c;
+					break;
+				default:
+					win->w_state = LIT;
+					goto tryagain;
 				}
 				break;
 			case LIT:
@@ -653,7 +791,6 @@ void WriteString(Window *win, char *buf, size_t len)
 				break;
 			}
 		}
-		while (--len);
 	}
 	if (!printcmd && win->w_state == PRIN)
 		PrintFlush(win);
@@ -668,15 +805,84 @@ static void WLogString(Window *win, char *buf, size_t len)
 		logfwrite(win->w_log, t, strlen(t));	/* long time no write */
 	}
 	win->w_logsilence = 0;
+	if (win->w_tlog == win->w_log)
+		return;		/* ImmorTerm: text only, see WLogText() */
 	if (logfwrite(win->w_log, buf, len) < 1) {
 		WMsg(win, errno, "Error writing logfile");
-		logfclose(win->w_log);
-		win->w_log = NULL;
-	}
+		CloseLog(win);
+	} else
+		win->w_stats.ws_logged += len;
 	if (!log_flush)
 		logfflush(win->w_log);
 }
 
+/*
+ * ImmorTerm: write a line of the window as plain text to its text log:
+ * what the parser made of the output, without escape sequences and with
+ * carriage return overwrites already applied, trailing blanks trimmed.
+ */
+static void WLogText(Window *win, struct mline *ml, int width)
+{
+	char buf[16 * 64 + UTF8_CELLMAX];
+	size_t n = 0;
+	int x;
+
+	for (x = width - 1; x >= 0 && ml->image[x] == ' '; x--) ;
+	for (int i = 0; i <= x; i++) {
+		int len;
+
+		if (ml->image[i] == 0xff && ml->font[i] == 0xff)
+			continue;	/* right half of a double width character */
+		if (n > sizeof(buf) - UTF8_CELLMAX) {
+			if (logfwrite(win->w_tlog, buf, n) < 1)
+				goto err;
+			win->w_stats.ws_logged += n;
+			n = 0;
+		}
+		if (win->w_encoding == UTF8)
+			n += ToUtf8_comb(buf + n, ml->image[i]);
+		else if ((len = EncodeChar(buf + n, ml->image[i], win->w_encoding, NULL)) > 0)
+			n += len;
+	}
+	buf[n++] = '\n';
+	if (logfwrite(win->w_tlog, buf, n) < 1)
+		goto err;
+	win->w_stats.ws_logged += n;
+	if (!log_flush)
+		logfflush(win->w_tlog);
+	return;
+err:
+	WMsg(win, errno, "Error writing text logfile");
+	if (win->w_tlog == win->w_log)
+		win->w_log = NULL;
+	logfclose(win->w_tlog);
+	win->w_tlog = NULL;
+}
+
+/*
+ * ImmorTerm: the lines still on screen never scroll into history, so put
+ * them in the text log when the window goes away, up to the last one used.
+ */
+void WLogScreen(Window *win)
+{
+	struct mline *mlines = win->w_alt.on ? win->w_alt.mlines : win->w_mlines;
+	int height = win->w_alt.on ? win->w_alt.height : win->w_height;
+	int width = win->w_alt.on ? win->w_alt.width : win->w_width;
+	int last;
+
+	if (win->w_tlog == NULL || mlines == NULL)
+		return;
+	for (last = height - 1; last >= 0; last--) {
+		int x;
+
+		for (x = width - 1; x >= 0 && mlines[last].image[x] == ' '; x--) ;
+		if (x >= 0)
+			break;
+	}
+	for (int y = 0; y <= last && win->w_tlog; y++)
+		WLogText(win, &mlines[y], width);
+}
+
 static int Special(Window *win, int c)
 {
 	switch (c) {
@@ -860,6 +1066,8 @@ static void DoCSI(Window *win, int c, int intermediate)
 				a2 = 1;
 			if (a2 > win->w_width)
 				a2 = win->w_width;
+			if (a1 == 1)
+				RedrawStart(win, -1);
 			LGotoPos(&win->w_layer, --a2, --a1);
 			win->w_x = a2;
 			win->w_y = a1;
@@ -902,6 +1110,7 @@ static void DoCSI(Window *win, int c, int intermediate)
 			ClearLineRegion(win, win->w_x, a1 < win->w_width ? a1 : win->w_width - 1);
 			break;
 		case 'A':
+			RedrawStart(win, (a1 ? a1 : 1) - win->w_y);
 			CursorUp(win, a1 ? a1 : 1);
 			break;
 		case 'B':
@@ -918,6 +1127,7 @@ static void DoCSI(Window *win, int c, int intermediate)
 			CursorDown(win, a1 ? a1 : 1);	/* positions cursor */
 			break;
 		case 'F':
+			RedrawStart(win, (a1 ? a1 : 1) - win->w_y);
 			win->w_x = 0;
 			CursorUp(win, a1 ? a1 : 1);	/* positions cursor */
 			break;
@@ -1191,6 +1401,9 @@ static void DoCSI(Window *win, int c, int intermediate)
 				win->w_bracketed = i ? true : false;
 				LBracketedPasteMode(&win->w_layer, win->w_bracketed);
 				break;
+			case 2026:	/* synchronized output */
+				WinSyncUpdate(win, i);
+				break;
 			}
 		}
 		break;
@@ -1205,45 +1418,190 @@ static void DoCSI(Window *win, int c, int intermediate)
 	}
 }
 
+/*
+ * Make room for n more bytes and a terminating NUL in w_string. It starts
+ * out at MAXSTR and doubles as needed, up to stringlimit.
+ */
+static bool StringRoom(Window *win, size_t n)
+{
+	size_t used = win->w_stringp - win->w_string;
+	size_t size = win->w_stringsize ? win->w_stringsize : MAXSTR;
+	char *s;
+
+	if (used + n < win->w_stringsize)
+		return true;
+	if (used + n >= stringlimit)
+		return false;
+	while (size <= used + n)
+		size *= 2;
+	if (size > stringlimit)
+		size = stringlimit;
+	if ((s = realloc(win->w_string, size)) == NULL)
+		return false;
+	win->w_string = s;
+	win->w_stringp = s + used;
+	win->w_stringsize = size;
+	return true;
+}
+
+/* Don't hang on to the memory of an unusually long string. */
+static void StringRelease(Window *win)
+{
+	if (win->w_stringsize <= MAXSTR)
+		return;
+	free(win->w_string);
+	win->w_string = win->w_stringp = NULL;
+	win->w_stringsize = 0;
+}
+
 static void StringStart(Window *win, enum string_t type)
 {
 	win->w_StringType = type;
 	win->w_stringp = win->w_string;
-	win->w_state = ASTR;
+	win->w_state = StringRoom(win, 0) ? ASTR : LIT;
 }
 
 static void StringChar(Window *win, int c)
 {
-	if (win->w_stringp >= win->w_string + MAXSTR - 1) {
+	if (!StringRoom(win, 4)) {
 		win->w_state = LIT;
 		return;
 	}
 	/* Re-encode Unicode code points back to UTF-8 for storage */
 	if (win->w_encoding == UTF8 && c >= 0x80) {
 		if (c < 0x800) {
-			if (win->w_stringp < win->w_string + MAXSTR - 2) {
-				*(win->w_stringp)++ = (c >> 6) | 0xc0;
-				*(win->w_stringp)++ = (c & 0x3f) | 0x80;
-			}
+			*(win->w_stringp)++ = (c >> 6) | 0xc0;
+			*(win->w_stringp)++ = (c & 0x3f) | 0x80;
 		} else if (c < 0x10000) {
-			if (win->w_stringp < win->w_string + MAXSTR - 3) {
-				*(win->w_stringp)++ = (c >> 12) | 0xe0;
-				*(win->w_stringp)++ = ((c >> 6) & 0x3f) | 0x80;
-				*(win->w_stringp)++ = (c & 0x3f) | 0x80;
-			}
+			*(win->w_stringp)++ = (c >> 12) | 0xe0;
+			*(win->w_stringp)++ = ((c >> 6) & 0x3f) | 0x80;
+			*(win->w_stringp)++ = (c & 0x3f) | 0x80;
 		} else {
-			if (win->w_stringp < win->w_string + MAXSTR - 4) {
-				*(win->w_stringp)++ = (c >> 18) | 0xf0;
-				*(win->w_stringp)++ = ((c >> 12) & 0x3f) | 0x80;
-				*(win->w_stringp)++ = ((c >> 6) & 0x3f) | 0x80;
-				*(win->w_stringp)++ = (c & 0x3f) | 0x80;
-			}
+			*(win->w_stringp)++ = (c >> 18) | 0xf0;
+			*(win->w_stringp)++ = ((c >> 12) & 0x3f) | 0x80;
+			*(win->w_stringp)++ = ((c >> 6) & 0x3f) | 0x80;
+			*(win->w_stringp)++ = (c & 0x3f) | 0x80;
 		}
 	} else {
 		*(win->w_stringp)++ = c;
 	}
 }
 
+/*
+ * Fast path for control strings: append the leading run of buf that the
+ * per-character path would only have stored, as the raw bytes, without
+ * decoding and re-encoding them. A run stops at anything that may end the
+ * string or is skipped: NUL, ESC, in an OSC any control but ^E, and with
+ * C1 controls on any byte that could be (or start) ST.
+ * Returns the number of bytes consumed.
+ */
+static size_t StringRun(Window *win, const char *buf, size_t len)
+{
+	size_t n, room;
+
+	for (n = 0; n < len; n++) {
+		unsigned char b = buf[n];
+
+		if (b == 0 || b == '\033')
+			break;
+		if (b < ' ' && b != '\005' && win->w_StringType == OSC)
+			break;
+		if (b >= 0x80 && win->w_c1)
+			break;
+	}
+	if (n == 0)
+		return 0;
+	if (!StringRoom(win, n)) {
+		/* take what fits, the rest is text again, as in StringChar() */
+		room = stringlimit - 1 - (win->w_stringp - win->w_string);
+		if (!StringRoom(win, room))
+			room = win->w_stringsize - 1 - (win->w_stringp - win->w_string);
+		if (n > room)
+			n = room;
+		win->w_state = LIT;
+	}
+	memcpy(win->w_stringp, buf, n);
+	win->w_stringp += n;
+	return n;
+}
+
+/*
+ * ImmorTerm: the title file the VS Code extension watches. A program can
+ * change its title on every spinner step, so the file is not rewritten
+ * for each change: the latest title is written from a timer, at most once
+ * every TITLE_DEBOUNCE ms, to a temporary file that is then renamed over
+ * the old one. Readers never see it half written.
+ */
+#define TITLE_DEBOUNCE	250
+
+static Event titleev;
+static char *titlepending;	/* title still to be written */
+static char *titlewritten;	/* what the file holds */
+static int titletime;		/* SchedNow() of the last write */
+static int titlewin;		/* the number of the window it is from */
+
+static void title_fn(Event *event, void *data)
+{
+	char path[MAXPATHLEN], tmp[MAXPATHLEN + 4];
+	char *renames_dir, *session_name;
+	size_t len;
+	int fd;
+
+	(void)event; /* unused */
+	(void)data; /* unused */
+
+	if (!titlepending)
+		return;
+	if (titlewritten && !strcmp(titlewritten, titlepending)) {
+		free(titlepending);
+		titlepending = NULL;
+		return;
+	}
+	if (!SocketName || (session_name = strchr(SocketName, '.')) == NULL)
+		return;
+	session_name++;  /* Skip the dot */
+	renames_dir = getenv("IMMORTERM_RENAMES_DIR");
+	if (renames_dir && *renames_dir)
+		snprintf(path, sizeof(path), "%s/%s", renames_dir, session_name);
+	else
+		snprintf(path, sizeof(path), "/tmp/immorterm-title-%s", session_name);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	titletime = SchedNow();
+	free(titlewritten);
+	titlewritten = titlepending;
+	titlepending = NULL;
+	EventPost("title", titlewin, titlewritten);
+	len = strlen(titlewritten);
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return;
+	if (write(fd, titlewritten, len) != (ssize_t)len) {
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+	close(fd);
+	if (rename(tmp, path))
+		unlink(tmp);
+}
+
+static void TitleFileUpdate(Window *win, const char *title)
+{
+	int wait;
+
+	free(titlepending);
+	titlepending = SaveStr(title);
+	titlewin = win->w_number;
+	if (titleev.queued)
+		return;
+	titleev.type = EV_TIMEOUT;
+	titleev.handler = title_fn;
+	titleev.name = "title_fn";
+	wait = titletime + TITLE_DEBOUNCE - SchedNow();
+	SetTimeout(&titleev, (wait > 0 && wait <= TITLE_DEBOUNCE) ? wait : 0);
+	evenq(&titleev);
+}
+
 /*
  * Do string processing. Returns -1 if output should be suspended
  * until status is gone.
@@ -1274,7 +1632,7 @@ static int StringEnd(Window *win)
 			struct acluser *windowuser;
 
 			windowuser = *FindUserPtr(":window:");
-			if (windowuser && Parse(p, ARRAY_SIZE(win->w_string) - (p - win->w_string), args, argl)) {
+			if (windowuser && Parse(p, win->w_stringsize - (p - win->w_string), args, argl)) {
 				for (display = displays; display; display = display->d_next)
 					if (D_forecv->c_layer->l_bottom == &win->w_layer)
 						break;	/* found it */
@@ -1331,28 +1689,12 @@ static int StringEnd(Window *win)
 		if (win->w_string != win->w_stringp)
 			win->w_hstatus = SaveStr(win->w_string);
 
-		/* ImmorTerm: Write title to file for VS Code extension IPC.
+		/* ImmorTerm: Tell the VS Code extension about the new title.
 		 * This is done here in APC (after the "not changed" check) so it
-		 * only writes when title actually changes, avoiding I/O during resize.
+		 * only happens when the title actually changes, not on resize.
 		 */
-		if (win->w_hstatus && *win->w_hstatus && SocketName && *SocketName) {
-			char title_path[MAXPATHLEN];
-			char *session_name = strchr(SocketName, '.');
-			if (session_name) {
-				session_name++;  /* Skip the dot */
-				char *renames_dir = getenv("IMMORTERM_RENAMES_DIR");
-				if (renames_dir && *renames_dir) {
-					snprintf(title_path, sizeof(title_path), "%s/%s", renames_dir, session_name);
-				} else {
-					snprintf(title_path, sizeof(title_path), "/tmp/immorterm-title-%s", session_name);
-				}
-				int fd = open(title_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-				if (fd >= 0) {
-					write(fd, win->w_hstatus, strlen(win->w_hstatus));
-					close(fd);
-				}
-			}
-		}
+		if (win->w_hstatus && *win->w_hstatus)
+			TitleFileUpdate(win, win->w_hstatus);
 
 		WindowChanged(win, WINESC_HSTATUS);
 		break;
@@ -1365,9 +1707,10 @@ static int StringEnd(Window *win)
 			if (cv || win->w_StringType == GM)
 				MakeStatus(win->w_string);
 		}
+		StringRelease(win);
 		return -1;
 	case DCS:
-		LAY_DISPLAYS(&win->w_layer, AddRawStr(win->w_string));
+		LAY_DISPLAYS(&win->w_layer, AddRawRef(win->w_string));
 		break;
 	case AKA:
 		if (win->w_title == win->w_akabuf && !*win->w_string)
@@ -1380,12 +1723,16 @@ static int StringEnd(Window *win)
 	default:
 		break;
 	}
+	StringRelease(win);
 	return 0;
 }
 
 static void PrintStart(Window *win)
 {
 	win->w_pdisplay = NULL;
+	win->w_stringp = win->w_string;
+	if (!StringRoom(win, MAXSTR - 1))
+		return;
 
 	/* find us a nice display to print on, fore preferred */
 	display = win->w_lastdisp;
@@ -1879,6 +2226,7 @@ void ChangeAKA(Window *win, char *s, size_t len)
 	WindowChanged(win, WINESC_WIN_TITLE);
 	WindowChanged(NULL, WINESC_WIN_NAMES);
 	WindowChanged(NULL, WINESC_WIN_NAMES_NOCUR);
+	EventPost("name", win->w_number, win->w_title);
 }
 
 static void FindAKA(Window *win)
@@ -1959,18 +2307,28 @@ static void Report(Window *win, char *fmt, int n1, int n2)
  *
  */
 
+/* a cleared attribute array for a line of win */
+static uint32_t *MAllocArray(Window *win)
+{
+	uint32_t *a = LinePoolGet(win, win->w_width + 1);
+
+	if (a)
+		memset(a, 0, (win->w_width + 1) * 4);
+	return a;
+}
+
 static void MFixLine(Window *win, int y, struct mchar *mc)
 {
 	struct mline *ml = &win->w_mlines[y];
 	if (mc->attr && ml->attr == null) {
-		if ((ml->attr = calloc(win->w_width + 1, 4)) == NULL) {
+		if ((ml->attr = MAllocArray(win)) == NULL) {
 			ml->attr = null;
 			mc->attr = win->w_rend.attr = 0;
 			WMsg(win, 0, "Warning: no space for attr - turned off");
 		}
 	}
 	if (mc->font && ml->font == null) {
-		if ((ml->font = calloc(win->w_width + 1, 4)) == NULL) {
+		if ((ml->font = MAllocArray(win)) == NULL) {
 			ml->font = null;
 			win->w_FontL = win->w_charsets[win->w_ss ? win->w_ss : win->w_Charset] = 0;
 			win->w_FontR = win->w_charsets[win->w_ss ? win->w_ss : win->w_CharsetR] = 0;
@@ -1979,14 +2337,14 @@ static void MFixLine(Window *win, int y, struct mchar *mc)
 		}
 	}
 	if (mc->colorbg && ml->colorbg == null) {
-		if ((ml->colorbg = calloc(win->w_width + 1, 4)) == NULL) {
+		if ((ml->colorbg = MAllocArray(win)) == NULL) {
 			ml->colorbg = null;
 			mc->colorbg = win->w_rend.colorbg = 0;
 			WMsg(win, 0, "Warning: no space for color background - turned off");
 		}
 	}
 	if (mc->colorfg && ml->colorfg == null) {
-		if ((ml->colorfg = calloc(win->w_width + 1, 4)) == NULL) {
+		if ((ml->colorfg = MAllocArray(win)) == NULL) {
 			ml->colorfg = null;
 			mc->colorfg = win->w_rend.colorfg = 0;
 			WMsg(win, 0, "Warning: no space for color foreground - turned off");
@@ -2070,22 +2428,26 @@ static void MScrollV(Window *win, int n, int ys, int ye, int bce)
 			if (ys == win->w_top)
 				WAddLineToHist(win, ml);
 			if (ml->attr != null)
-				free(ml->attr);
+				LinePoolPut(win, ml->attr, win->w_width + 1);
 			ml->attr = null;
 			if (ml->font != null)
-				free(ml->font);
+				LinePoolPut(win, ml->font, win->w_width + 1);
 			ml->font = null;
 			if (ml->colorbg != null)
-				free(ml->colorbg);
+				LinePoolPut(win, ml->colorbg, win->w_width + 1);
 			ml->colorbg = null;
 			if (ml->colorfg != null)
-				free(ml->colorfg);
+				LinePoolPut(win, ml->colorfg, win->w_width + 1);
 			ml->colorfg = null;
 			memmove(ml->image, blank, (win->w_width + 1) * 4);
 			if (bce)
 				MBceLine(win, i, 0, win->w_width, bce);
 		}
 		/* switch 'em over */
+		if (ys == 0 && ye == win->w_height - 1) {
+			MSlideLines(win, n);
+			return;
+		}
 		cnt1 = n * sizeof(struct mline);
 		cnt2 = (ye - ys + 1 - n) * sizeof(struct mline);
 		if (cnt1 && cnt2)
@@ -2103,21 +2465,25 @@ static void MScrollV(Window *win, int n, int ys, int ye, int bce)
 		/* Clear lines */
 		for (int i = ye; i > ye - n; i--, ml--) {
 			if (ml->attr != null)
-				free(ml->attr);
+				LinePoolPut(win, ml->attr, win->w_width + 1);
 			ml->attr = null;
 			if (ml->font != null)
-				free(ml->font);
+				LinePoolPut(win, ml->font, win->w_width + 1);
 			ml->font = null;
 			if (ml->colorbg != null)
-				free(ml->colorbg);
+				LinePoolPut(win, ml->colorbg, win->w_width + 1);
 			ml->colorbg = null;
 			if (ml->colorfg != null)
-				free(ml->colorfg);
+				LinePoolPut(win, ml->colorfg, win->w_width + 1);
 			ml->colorfg = null;
 			memmove(ml->image, blank, (win->w_width + 1) * 4);
 			if (bce)
 				MBceLine(win, i, 0, win->w_width, bce);
 		}
+		if (ys == 0 && ye == win->w_height - 1) {
+			MSlideLines(win, -n);
+			return;
+		}
 		cnt1 = n * sizeof(struct mline);
 		cnt2 = (ye - ys + 1 - n) * sizeof(struct mline);
 		if (cnt1 && cnt2)
@@ -2125,6 +2491,39 @@ static void MScrollV(Window *win, int n, int ys, int ye, int bce)
 	}
 }
 
+/*
+ * ImmorTerm: scroll the whole screen by n lines (up if n > 0) by moving
+ * w_mlines within w_mlinebuf, which has room for twice the height. The n
+ * lines scrolled out, already cleared, are copied to the other end. Only
+ * when we hit the end of w_mlinebuf is the screen moved back, once every
+ * height lines.
+ */
+static void MSlideLines(Window *win, int n)
+{
+	struct mline *buf = win->w_mlinebuf;
+	int he = win->w_height;
+	int off = win->w_mlines - buf;
+
+	if (n > 0) {
+		if (off + he + n > 2 * he) {
+			memmove(buf, win->w_mlines, he * sizeof(struct mline));
+			win->w_mlines = buf;
+			off = 0;
+		}
+		memcpy(buf + off + he, buf + off, n * sizeof(struct mline));
+		win->w_mlines += n;
+	} else {
+		n = -n;
+		if (off < n) {
+			memmove(buf + he, win->w_mlines, he * sizeof(struct mline));
+			win->w_mlines = buf + he;
+			off = he;
+		}
+		memcpy(buf + off - n, buf + off + he - n, n * sizeof(struct mline));
+		win->w_mlines -= n;
+	}
+}
+
 static void Scroll(char *cp, int cnt1, int cnt2, char *tmp)
 {
 	if (!cnt1 || !cnt2)
@@ -2140,6 +2539,33 @@ static void Scroll(char *cp, int cnt1, int cnt2, char *tmp)
 	}
 }
 
+/* ImmorTerm: an attribute array of a line being cleared as a whole goes
+ * back to the pool, unless the wrap mark past the margin has a rendition */
+static void MDropArray(Window *win, uint32_t **a)
+{
+	if (*a == null)
+		return;
+	if ((*a)[win->w_width]) {
+		memset(*a, 0, win->w_width * 4);
+		return;
+	}
+	LinePoolPut(win, *a, win->w_width + 1);
+	*a = null;
+}
+
+/* ImmorTerm: clears all cells of line ml, leaving the wrap mark. Full
+ * screen programs do this a lot; the line's renditions are given up
+ * rather than overwritten, and come back once something is written with
+ * one (see MFixLine()). */
+static void MClearLine(Window *win, struct mline *ml)
+{
+	memmove(ml->image, blank, win->w_width * 4);
+	MDropArray(win, &ml->attr);
+	MDropArray(win, &ml->font);
+	MDropArray(win, &ml->colorbg);
+	MDropArray(win, &ml->colorfg);
+}
+
 static void MClearArea(Window *win, int xs, int ys, int xe, int ye, int bce)
 {
 	int n;
@@ -2163,7 +2589,9 @@ static void MClearArea(Window *win, int xs, int ys, int xe, int ye, int bce)
 	for (int y = ys; y <= ye; y++, ml++) {
 		xxe = (y == ye) ? xe : win->w_width - 1;
 		n = xxe - xs + 1;
-		if (n > 0)
+		if (n == win->w_width)
+			MClearLine(win, ml);
+		else if (n > 0)
 			clear_mline(ml, xs, n);
 		if (n > 0 && bce)
 			MBceLine(win, y, xs, xs + n - 1, bce);
@@ -2221,6 +2649,34 @@ static void MPutChar(Window *win, struct mchar *c, int x, int y)
 	}
 }
 
+/*
+ * Store n single-width characters with the current rendition,
+ * the bulk version of MPutChar().
+ */
+static void MPutStr(Window *win, char *s, int n, int x, int y)
+{
+	struct mline *ml;
+	struct mchar *r = &win->w_rend;
+
+	MFixLine(win, y, r);
+	ml = &win->w_mlines[y];
+	MKillDwRight(win, ml, x);
+	MKillDwLeft(win, ml, x + n - 1);
+	for (int i = 0; i < n; i++)
+		ml->image[x + i] = (unsigned char)s[i];
+	if (ml->attr != null)
+		for (int i = 0; i < n; i++)
+			ml->attr[x + i] = r->attr;
+	if (ml->font != null)
+		memset(ml->font + x, 0, n * 4);
+	if (ml->colorbg != null)
+		for (int i = 0; i < n; i++)
+			ml->colorbg[x + i] = r->colorbg;
+	if (ml->colorfg != null)
+		for (int i = 0; i < n; i++)
+			ml->colorfg[x + i] = r->colorfg;
+}
+
 static void MWrapChar(Window *win, struct mchar *c, int y, int top, int bot, bool ins)
 {
 	struct mline *ml;
@@ -2262,45 +2718,845 @@ static void MBceLine(Window *win, int y, int xs, int xe, int bce)
 
 static void WAddLineToHist(Window *win, struct mline *ml)
 {
-	uint32_t *q, *o;
-	struct mline *hml;
+	win->w_stats.ws_scrolled++;
+	if (!RedrawHold(win, ml))
+		HistKeep(win, ml);
+}
+
+/* Puts ml into the history and everything that keeps it. */
+static void HistKeep(Window *win, struct mline *ml)
+{
+	/* ImmorTerm: full screen programs in the alternate screen stay out */
+	if (win->w_tlog && !win->w_alt.on)
+		WLogText(win, ml, win->w_width);
+	if (win->w_ckpt && !win->w_alt.on && !win->w_hstore)
+		CheckpointHistLine(win, ml);
+	HistAppend(win, ml);
+}
+
+/*
+ * ImmorTerm: redraws. A program that redraws its output in place without
+ * the alternate screen moves the cursor back up, or home, and paints the
+ * next frame over the last. A frame taller than the screen scrolls its
+ * top into the history every time. With scrollback_settle, the lines
+ * scrolled off after such a move are held back until the next one: those
+ * it moves back above the top of the screen get painted again and are
+ * dropped, the others are kept. Once there was no redraw for
+ * REDRAW_SETTLE ms, or somebody looks at the history, what is held is
+ * kept as well, so the history and the text log only get the frame the
+ * program settled on. The raw log is written before all this and keeps
+ * every frame.
+ */
+#define REDRAW_SETTLE 500
+
+/* most lines held, older ones are kept */
+#define REDRAW_HOLD 1024
+
+/* Keeps the n oldest lines held. */
+static void RedrawKeep(Window *win, int n)
+{
+	for (; n > 0; n--) {
+		struct hline *hl = &win->w_redraw[win->w_redrawfirst];
+
+		HistKeep(win, HistExpand(hl, win->w_width + 1));
+		cell_free(hl);
+		win->w_redrawfirst = (win->w_redrawfirst + 1) % REDRAW_HOLD;
+		win->w_redrawcount--;
+	}
+}
+
+/* Drops the n newest lines held. */
+static void RedrawDrop(Window *win, int n)
+{
+	for (; n > 0; n--) {
+		win->w_redrawcount--;
+		cell_free(&win->w_redraw[(win->w_redrawfirst + win->w_redrawcount) % REDRAW_HOLD]);
+	}
+}
+
+static void redraw_fn(Event *ev, void *data)
+{
+	(void)ev;
+	RedrawSettle((Window *)data);
+}
+
+/* Holds ml back if it scrolled off in a redraw. */
+static bool RedrawHold(Window *win, struct mline *ml)
+{
+	struct hline *hl;
+
+	if (!win->w_redrawing || win->w_alt.on)
+		return false;
+	if (!win->w_redraw && (win->w_redraw = calloc(REDRAW_HOLD, sizeof(struct hline))) == NULL)
+		return false;
+	if (win->w_redrawcount == REDRAW_HOLD)
+		RedrawKeep(win, 1);
+	hl = &win->w_redraw[(win->w_redrawfirst + win->w_redrawcount) % REDRAW_HOLD];
+	if (cell_pack(hl, ml, win->w_width + 1, &win->w_linepool.lp_high)) {
+		/* the line must not overtake those before it */
+		cell_free(hl);
+		RedrawKeep(win, win->w_redrawcount);
+		return false;
+	}
+	win->w_redrawcount++;
+	return true;
+}
 
+/* The program moves the cursor up, wanting to get above rows above the
+ * top of the screen, or home if above is -1. */
+static void RedrawStart(Window *win, int above)
+{
+	if (!scrollback_settle || win->w_alt.on || win->w_top != 0 || !win->w_histheight)
+		return;
+	if (above < 0 || above > win->w_redrawcount)
+		above = win->w_redrawcount;
+	RedrawDrop(win, above);
+	RedrawKeep(win, win->w_redrawcount);
+	win->w_redrawing = true;
+	win->w_redrawev.type = EV_TIMEOUT;
+	win->w_redrawev.data = (char *)win;
+	win->w_redrawev.handler = redraw_fn;
+	win->w_redrawev.name = "redraw_fn";
+	evdeq(&win->w_redrawev);
+	SetTimeout(&win->w_redrawev, REDRAW_SETTLE);
+	evenq(&win->w_redrawev);
+}
+
+/* Keeps all lines held and ends the redraw. */
+void RedrawSettle(Window *win)
+{
+	evdeq(&win->w_redrawev);
+	win->w_redrawing = false;
+	if (!win->w_redraw)
+		return;
+	RedrawKeep(win, win->w_redrawcount);
+	free(win->w_redraw);
+	win->w_redraw = NULL;
+	win->w_redrawfirst = 0;
+}
+
+/* bytes the lines held take */
+size_t RedrawSize(Window *win)
+{
+	size_t n = 0;
+
+	if (!win->w_redraw)
+		return 0;
+	for (int i = 0; i < win->w_redrawcount; i++)
+		cell_size(&win->w_redraw[(win->w_redrawfirst + i) % REDRAW_HOLD], &n, &n);
+	return n + REDRAW_HOLD * sizeof(struct hline);
+}
+
+/* Adds ml as the newest line of the history, without logging it. */
+void HistAppend(Window *win, struct mline *ml)
+{
 	if (win->w_histheight == 0)
 		return;
-	hml = &win->w_hlines[win->w_histidx];
-	q = ml->image;
-	ml->image = hml->image;
-	hml->image = q;
-
-	q = ml->attr;
-	o = hml->attr;
-	hml->attr = q;
-	ml->attr = null;
-	if (o != null)
-		free(o);
-	q = ml->font;
-	o = hml->font;
-	hml->font = q;
-	ml->font = null;
-	if (o != null)
-		free(o);
-	q = ml->colorbg;
-	o = hml->colorbg;
-	hml->colorbg = q;
-	ml->colorbg = null;
-	if (o != null)
-		free(o);
-	q = ml->colorfg;
-	o = hml->colorfg;
-	hml->colorfg = q;
-	ml->colorfg = null;
-	if (o != null)
-		free(o);
+	HistStore(win, win->w_histidx, ml);
 
 	if (++win->w_histidx >= win->w_histheight)
 		win->w_histidx = 0;
 	if (win->w_scrollback_height < win->w_histheight)
 		++win->w_scrollback_height;
+	if (win->w_hstore && !win->w_alt.on)
+		HistStoreLine(win);
+	if (scrollback_compress && win->w_histidx % HBLOCK == 0)
+		HistCompress(win);
+}
+
+/*
+ * History lines are kept packed (see cell.c). HistLine() expands line i
+ * of the history ring into one of a few scratch lines. The result stays
+ * valid for the next NHISTSCRATCH - 1 lookups of other lines and until
+ * the history changes, so callers may look at a couple of lines at once,
+ * but must not modify it; HistStore() writes a line back.
+ */
+#define NHISTSCRATCH 8
+
+static struct histscratch {
+	struct mline ml;	/* what HistLine() hands out */
+	struct mline own;	/* our arrays */
+	int width;
+	int n;			/* cells expanded; shared lines are in windows of any width */
+	const void *key;
+	unsigned long gen;
+} histscratch[NHISTSCRATCH];
+static int histscratch_next;
+static unsigned long histgen = 1;
+
+struct mline *HistLine(Window *win, int i)
+{
+	if (win->w_hblocks && i / HBLOCK < win->w_histheight / HBLOCK
+	    && win->w_hblocks[i / HBLOCK].data && HistThaw(win, i / HBLOCK, true))
+		return &mline_blank;
+	return HistExpand(&win->w_hlines[i], win->w_width + 1);
+}
+
+/* Expands the n cells of hl into a scratch line, see HistLine(). */
+static struct mline *HistExpand(const struct hline *hl, int n)
+{
+	const void *key;
+	struct histscratch *sc;
+	int used;
+
+	key = hl->cells ? (const void *)hl->cells : (const void *)hl->image;
+	if (!key)
+		return &mline_blank;
+	for (sc = histscratch; sc < histscratch + NHISTSCRATCH; sc++)
+		if (sc->key == key && sc->gen == histgen && sc->n == n)
+			return &sc->ml;
+	sc = &histscratch[histscratch_next];
+	histscratch_next = (histscratch_next + 1) % NHISTSCRATCH;
+	sc->key = NULL;
+	if (sc->width < n) {
+		sc->own.image = xrealloc(sc->own.image, n * 4);
+		sc->own.attr = xrealloc(sc->own.attr, n * 4);
+		sc->own.font = xrealloc(sc->own.font, n * 4);
+		sc->own.colorbg = xrealloc(sc->own.colorbg, n * 4);
+		sc->own.colorfg = xrealloc(sc->own.colorfg, n * 4);
+		if (!(sc->own.image && sc->own.attr && sc->own.font && sc->own.colorbg && sc->own.colorfg)) {
+			free(sc->own.image);
+			free(sc->own.attr);
+			free(sc->own.font);
+			free(sc->own.colorbg);
+			free(sc->own.colorfg);
+			memset(&sc->own, 0, sizeof(sc->own));
+			sc->width = 0;
+			return &mline_blank;
+		}
+		sc->width = n;
+	}
+	used = cell_unpack(&sc->own, hl, n);
+	sc->ml.image = sc->own.image;
+	sc->ml.attr = used & CELL_ATTR ? sc->own.attr : null;
+	sc->ml.font = used & CELL_FONT ? sc->own.font : null;
+	sc->ml.colorbg = used & CELL_COLORBG ? sc->own.colorbg : null;
+	sc->ml.colorfg = used & CELL_COLORFG ? sc->own.colorfg : null;
+	sc->key = key;
+	sc->n = n;
+	sc->gen = histgen;
+	return &sc->ml;
+}
+
+/*
+ * ImmorTerm: the history of the main screen, which the alternate screen
+ * sets aside in w_alt while it is on. MainHistLines() tells how many of
+ * its lines hold output; MainHistLine() expands the one i lines back from
+ * the end, 1 being the newest, like HistLine() does.
+ */
+int MainHistLines(Window *win)
+{
+	int n;
+
+	if (!win->w_alt.on) {
+		HistReflow(win);
+		return win->w_scrollback_height < win->w_histheight ? win->w_scrollback_height : win->w_histheight;
+	}
+	/* the set aside ring is not compressed; never written slots are empty */
+	for (n = win->w_alt.histheight; n > 0; n--) {
+		struct hline *hl = &win->w_alt.hlines[(win->w_alt.histidx + win->w_alt.histheight - n) % win->w_alt.histheight];
+
+		if (hl->image || hl->cells)
+			break;
+	}
+	return n;
+}
+
+struct mline *MainHistLine(Window *win, int i)
+{
+	if (!win->w_alt.on)
+		return HistLine(win, (win->w_histidx + win->w_histheight - i) % win->w_histheight);
+	return HistExpand(&win->w_alt.hlines[(win->w_alt.histidx + win->w_alt.histheight - i) % win->w_alt.histheight],
+			  win->w_alt.width + 1);
+}
+
+/* ImmorTerm: replaces line y of the screen with the first cells of ml */
+void WSetLine(Window *win, int y, struct mline *ml)
+{
+	struct mline *dl = &win->w_mlines[y];
+	struct mchar mc = mchar_null;
+	size_t n = win->w_width * 4;
+
+	mc.attr = ml->attr != null;
+	mc.font = ml->font != null;
+	mc.colorbg = ml->colorbg != null;
+	mc.colorfg = ml->colorfg != null;
+	MFixLine(win, y, &mc);
+	memcpy(dl->image, ml->image, n);
+#define SETLINE(a) \
+	if (dl->a != null) { \
+		if (ml->a != null) \
+			memcpy(dl->a, ml->a, n); \
+		else \
+			memset(dl->a, 0, n); \
+	}
+	SETLINE(attr)
+	SETLINE(font)
+	SETLINE(colorbg)
+	SETLINE(colorfg)
+#undef SETLINE
+}
+
+/* Packs ml into line i of the history ring. If there is no memory the
+ * line is lost and reads back blank. */
+void HistStore(Window *win, int i, struct mline *ml)
+{
+	if (win->w_hblocks && i / HBLOCK < win->w_histheight / HBLOCK) {
+		HistThaw(win, i / HBLOCK, false);
+		win->w_hblocks[i / HBLOCK].stored = 0;
+	}
+	histgen++;
+	if (cell_pack(&win->w_hlines[i], ml, win->w_width + 1, &win->w_linepool.lp_high))
+		cell_free(&win->w_hlines[i]);
+	else if (scrollback_dedup)
+		cell_share(&win->w_hlines[i]);
+	SearchIndexLine(win, i, ml);
+}
+
+/* Forget all expanded lines, for code changing history behind our back. */
+void HistFlushCache(void)
+{
+	histgen++;
+}
+
+/*
+ * ImmorTerm: cold scrollback. The history ring is cut into blocks of
+ * HBLOCK slots; once all lines of a block are older than
+ * scrollback_compress lines, the block is compressed as a whole. Reading
+ * a line expands its block again, keeping up to HBLOCK_THAWED such
+ * blocks around before the least recently expanded one is compressed
+ * again. Writing into a compressed block (when the ring wraps around)
+ * expands it for good.
+ */
+#define HBLOCK_THAWED 4
+
+/* ImmorTerm: the data of HB_STORED blocks, whose lines are only in the
+ * history store */
+static char hist_stored[1];
+
+/*
+ * ImmorTerm: with scrollback_dir set, compressed blocks are moved into a
+ * file mapped into memory, one fixed-size slot per block, so the kernel
+ * can page them out instead of them adding to our heap. Each slot starts
+ * with the length of the block. Slots are allocated on disk before use
+ * so that a full disk means staying on the heap rather than SIGBUS. The
+ * file goes away with HistUnmap(); after a crash it is left behind.
+ */
+static char *HistMap(Window *win)
+{
+	struct histmap *hm = &win->w_hmap;
+	long page = sysconf(_SC_PAGESIZE);
+	char *path;
+	void *base;
+	int fd;
+
+	if (hm->hm_base || hm->hm_failed || !scrollback_dir || !*scrollback_dir)
+		return hm->hm_base;
+	if (page <= 0)
+		page = 4096;
+	hm->hm_slot = sizeof(uint32_t) + cell_frozen_max(HBLOCK, win->w_width + 1);
+	hm->hm_slot = (hm->hm_slot + page - 1) / page * page;
+	hm->hm_size = hm->hm_slot * (win->w_histheight / HBLOCK);
+	if ((path = malloc(strlen(scrollback_dir) + strlen(SocketName) + 32)) == NULL) {
+		hm->hm_failed = true;
+		return NULL;
+	}
+	sprintf(path, "%s/scrollback.%s.%d", scrollback_dir, SocketName, win->w_number);
+	if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0)
+		goto fail;
+	if (ftruncate(fd, hm->hm_size)) {
+		close(fd);
+		unlink(path);
+		goto fail;
+	}
+	if ((base = mmap(NULL, hm->hm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		unlink(path);
+		goto fail;
+	}
+	hm->hm_base = base;
+	hm->hm_fd = fd;
+	hm->hm_path = path;
+	return hm->hm_base;
+fail:
+	Msg(errno, "Cannot map scrollback file %s", path);
+	free(path);
+	hm->hm_failed = true;
+	return NULL;
+}
+
+/* Moves the data of block b from the heap to the scrollback file. */
+static void HistMapStore(Window *win, int b)
+{
+	struct histmap *hm = &win->w_hmap;
+	struct hblock *hb = &win->w_hblocks[b];
+	char *slot;
+	uint32_t len32 = hb->len;
+
+	if (!HistMap(win) || sizeof(len32) + hb->len > hm->hm_slot
+	    || posix_fallocate(hm->hm_fd, (off_t)b * hm->hm_slot, sizeof(len32) + hb->len))
+		return;
+	slot = hm->hm_base + b * hm->hm_slot;
+	memcpy(slot, &len32, sizeof(len32));
+	memcpy(slot + sizeof(len32), hb->data, hb->len);
+	free(hb->data);
+	hb->data = slot + sizeof(len32);
+	hb->mapped = HB_MAPPED;
+#ifdef MADV_DONTNEED
+	/* the data is safe in the page cache, drop it from our memory */
+	madvise(slot, hm->hm_slot, MADV_DONTNEED);
+#endif
+}
+
+/* Removes the scrollback file. No block may be stored in it any more. */
+static void HistUnmap(Window *win)
+{
+	struct histmap *hm = &win->w_hmap;
+
+	if (hm->hm_base) {
+		munmap(hm->hm_base, hm->hm_size);
+		close(hm->hm_fd);
+		unlink(hm->hm_path);
+		free(hm->hm_path);
+	}
+	hm->hm_base = NULL;
+	hm->hm_path = NULL;
+}
+
+/* age of the newest line in block b, 0 being the line added last */
+static int HistBlockAge(Window *win, int b)
+{
+	int last = win->w_histidx ? win->w_histidx - 1 : win->w_histheight - 1;
+
+	/* the block we are writing to is never cold */
+	if (last / HBLOCK == b || win->w_histidx / HBLOCK == b)
+		return 0;
+	return (last - ((b + 1) * HBLOCK - 1) + win->w_histheight) % win->w_histheight;
+}
+
+static void HistFreeze(Window *win, int b)
+{
+	struct hblock *hb = &win->w_hblocks[b];
+	struct hline *hl = win->w_hlines + b * HBLOCK;
+	int i;
+
+	hb->thawed = 0;
+	for (i = 0; i < HBLOCK; i++)
+		if (hl[i].image || hl[i].cells)
+			break;
+	if (i == HBLOCK)
+		return;		/* nothing to gain */
+	histgen++;
+	if (hb->stored) {
+		/* ImmorTerm: the history store has them already */
+		for (i = 0; i < HBLOCK; i++)
+			cell_free(&hl[i]);
+		hb->data = hist_stored;
+		hb->len = 0;
+		hb->mapped = HB_STORED;
+		return;
+	}
+	hb->data = cell_freeze(hl, HBLOCK, win->w_width + 1, &hb->len);
+	hb->mapped = HB_HEAP;
+	if (hb->data)
+		HistMapStore(win, b);
+}
+
+static int HistThaw(Window *win, int b, bool reading)
+{
+	struct hblock *hb = &win->w_hblocks[b], *old = NULL;
+	int i, nthawed = 0;
+
+	if (hb->data == NULL) {
+		if (!reading)
+			hb->thawed = 0;
+		return 0;
+	}
+	histgen++;
+	if (hb->mapped == HB_STORED) {
+		struct hstorerec rec;
+		char *data = HistStoreGet(win->w_hstore, hb->stored - 1, &rec);
+
+		/* lines that do not read back are lost, not kept frozen */
+		if (!data || rec.lines != HBLOCK || rec.width != win->w_width + 1
+		    || cell_thaw(win->w_hlines + b * HBLOCK, HBLOCK, win->w_width + 1, data, rec.len))
+			hb->stored = 0;
+		free(data);
+	} else if (cell_thaw(win->w_hlines + b * HBLOCK, HBLOCK, win->w_width + 1, hb->data, hb->len))
+		return -1;
+	if (hb->mapped == HB_MAPPED)
+		memset(hb->data - sizeof(uint32_t), 0, sizeof(uint32_t));
+	else if (hb->mapped == HB_HEAP)
+		free(hb->data);
+	hb->data = NULL;
+	hb->len = 0;
+	hb->mapped = HB_HEAP;
+	if (!reading)
+		return 0;
+	hb->thawed = ++win->w_hthaws;
+	for (i = 0; i < win->w_histheight / HBLOCK; i++) {
+		if (!win->w_hblocks[i].thawed)
+			continue;
+		nthawed++;
+		if (!old || win->w_hblocks[i].thawed < old->thawed)
+			old = win->w_hblocks + i;
+	}
+	if (nthawed > HBLOCK_THAWED)
+		HistFreeze(win, old - win->w_hblocks);
+	return 0;
+}
+
+/* Compress all blocks that are old enough. */
+void HistCompress(Window *win)
+{
+	int b, nblocks = win->w_histheight / HBLOCK;
+
+	if (!scrollback_compress || !nblocks)
+		return;
+	if (!win->w_hblocks && (win->w_hblocks = calloc(nblocks, sizeof(struct hblock))) == NULL)
+		return;
+	for (b = 0; b < nblocks; b++)
+		if (!win->w_hblocks[b].data && HistBlockAge(win, b) >= scrollback_compress)
+			HistFreeze(win, b);
+}
+
+/* ImmorTerm: compress every block, however recent, for a window that
+ * hibernates (see WindowHibernate()). */
+void HistHibernate(Window *win)
+{
+	int b, nblocks = win->w_histheight / HBLOCK;
+
+	if (!nblocks)
+		return;
+	if (!win->w_hblocks && (win->w_hblocks = calloc(nblocks, sizeof(struct hblock))) == NULL)
+		return;
+	/* the block being written is frozen too, what of it is new goes first */
+	HistStoreFlush(win, true);
+	for (b = 0; b < nblocks; b++)
+		if (!win->w_hblocks[b].data)
+			HistFreeze(win, b);
+}
+
+/* Expands again what HistHibernate() compressed and HistCompress() would
+ * not have. */
+void HistWake(Window *win)
+{
+	int b;
+
+	if (!win->w_hblocks)
+		return;
+	if (!scrollback_compress) {
+		HistThawAll(win);
+		return;
+	}
+	for (b = 0; b < win->w_histheight / HBLOCK; b++)
+		if (HistBlockAge(win, b) < scrollback_compress)
+			HistThaw(win, b, false);
+}
+
+/* heap bytes the lines of block b hold, expanded or compressed */
+static size_t HistBlockSize(Window *win, int b)
+{
+	struct hblock *hb = win->w_hblocks + b;
+	size_t cells = 0, rend = 0;
+
+	if (hb->data)
+		return hb->mapped == HB_HEAP ? hb->len : 0;
+	for (int i = 0; i < HBLOCK; i++)
+		cell_size(&win->w_hlines[b * HBLOCK + i], &cells, &rend);
+	return cells + rend;
+}
+
+/*
+ * ImmorTerm: forgets the oldest lines of the history of a window, up to
+ * the newest keep, until want bytes of heap are given back. A compressed
+ * block goes whole once all of its lines are old enough, other lines one
+ * by one. What is left is the newest lines, and w_scrollback_height is
+ * lowered to their number. Returns the bytes given back.
+ */
+static size_t HistDrop(Window *win, int keep, size_t want)
+{
+	int hh = win->w_histheight, nblocks = hh / HBLOCK;
+	int last = (win->w_histidx + hh - 1) % hh;
+	int y = hh - MIN(win->w_scrollback_height, hh), limit = hh - MAX(keep, 1);
+	size_t freed = 0;
+
+	/* y counts from the oldest line of the ring */
+	while (y < limit && freed < want) {
+		int i = (win->w_histidx + y) % hh, b = i / HBLOCK, n = 1;
+		struct hblock *hb = b < nblocks ? win->w_hblocks + b : NULL;
+
+		if (hb && hb->data) {
+			int end = last / HBLOCK == b ? hh - 1 : (b * HBLOCK + HBLOCK - 1 - win->w_histidx + hh) % hh;
+
+			if (end >= limit)
+				break;
+			if (hb->mapped == HB_HEAP) {
+				freed += hb->len;
+				free(hb->data);
+			} else if (hb->mapped == HB_MAPPED)
+				memset(hb->data - sizeof(uint32_t), 0, sizeof(uint32_t));
+			hb->data = NULL;
+			hb->len = 0;
+			hb->mapped = HB_HEAP;
+			n = end + 1 - y;
+		} else {
+			size_t cells = 0, rend = 0;
+
+			cell_size(&win->w_hlines[i], &cells, &rend);
+			cell_free(&win->w_hlines[i]);
+			freed += cells + rend;
+		}
+		if (hb) {
+			hb->thawed = 0;
+			hb->stored = 0;		/* the record has lines no longer here */
+		}
+		for (int j = 0; j < n; j++)
+			SearchIndexLine(win, i + j, &mline_blank);
+		y += n;
+	}
+	if (y > hh - win->w_scrollback_height) {
+		histgen++;
+		win->w_scrollback_height = hh - y;
+	}
+	return freed;
+}
+
+/*
+ * ImmorTerm: gives back up to want bytes of heap from the history of a
+ * window, for scrollback_budget (see BudgetCheck()), going from its
+ * oldest block to the newest one at least keep lines old. Blocks are
+ * compressed, or with drop their lines are forgotten (see HistDrop()),
+ * compressed or not. Returns the bytes given back.
+ */
+size_t HistShrink(Window *win, int keep, size_t want, bool drop)
+{
+	int b, k, nblocks = win->w_histheight / HBLOCK;
+	size_t before, freed = 0;
+
+	if (!nblocks)
+		return 0;
+	if (!win->w_hblocks && (win->w_hblocks = calloc(nblocks, sizeof(struct hblock))) == NULL)
+		return 0;
+	if (drop)
+		return HistDrop(win, keep, want);
+	for (k = 1; k <= nblocks && freed < want; k++) {
+		b = (win->w_histidx / HBLOCK + k) % nblocks;
+		if (HistBlockAge(win, b) < MAX(keep, 1) || !(before = HistBlockSize(win, b)))
+			continue;
+		if (!win->w_hblocks[b].data)
+			HistFreeze(win, b);
+		if (HistBlockSize(win, b) < before)
+			freed += before - HistBlockSize(win, b);
+	}
+	return freed;
+}
+
+/* Expand the whole history, for code working on w_hlines directly. */
+void HistThawAll(Window *win)
+{
+	int b;
+
+	/* the ring may change shape, later records start over from it */
+	HistStoreFlush(win, true);
+	if (!win->w_hblocks)
+		return;
+	for (b = 0; b < win->w_histheight / HBLOCK; b++)
+		HistThaw(win, b, false);
+	free(win->w_hblocks);
+	win->w_hblocks = NULL;
+	HistUnmap(win);
+}
+
+/*
+ * ImmorTerm: the history store (logfile history, see histstore.h). Lines
+ * are counted as they come; those since the last record are written as
+ * one once they fill a block of the ring or reach its end, so a record
+ * holds the lines of one block, and that block points at it from then on.
+ * HistStoreFlush() writes them before then.
+ */
+static void HistStoreLine(Window *win)
+{
+	struct histstore *hs = win->w_hstore;
+
+	if (hs->hs_loading || hs->hs_failed)
+		return;
+	hs->hs_pending++;
+	if (win->w_histidx % HBLOCK == 0)
+		HistStoreFlush(win, true);
+}
+
+/* Before a rotation: takes the blocks out of the file rotated before,
+ * which is closed. */
+static void HistStoreRelease(Window *win)
+{
+	struct histstore *hs = win->w_hstore;
+	int b;
+
+	for (b = 0; win->w_hblocks && b < win->w_histheight / HBLOCK; b++)
+		if (win->w_hblocks[b].stored && win->w_hblocks[b].stored - 1 < hs->hs_base) {
+			HistThaw(win, b, false);
+			win->w_hblocks[b].stored = 0;
+		}
+}
+
+/*
+ * Writes the lines not in a record yet. With done the record ends there;
+ * without, it is a partial one that a later record with the same lines
+ * supersedes, so that what is in the ring gets to the disk when the
+ * process dies before the block is full.
+ */
+void HistStoreFlush(Window *win, bool done)
+{
+	struct histstore *hs = win->w_hstore;
+	int n, start, nblocks = win->w_histheight / HBLOCK;
+	uint64_t off;
+	size_t len;
+	char *data;
+
+	if (!hs || hs->hs_failed || win->w_alt.on || (n = hs->hs_pending) == 0 || (!done && n == hs->hs_synced))
+		return;
+	start = (win->w_histidx ? win->w_histidx : win->w_histheight) - n;
+	if (win->w_hblocks && start / HBLOCK < nblocks)
+		HistThaw(win, start / HBLOCK, false);
+	data = cell_freeze_copy(win->w_hlines + start, n, win->w_width + 1, &len);
+	if (!data || !HistStorePut(hs, hs->hs_seq, win->w_width + 1, n, data, len, &off)) {
+		Msg(data ? errno : ENOMEM, "Cannot write history store %s", hs->hs_name);
+		hs->hs_failed = true;
+		free(data);
+		return;
+	}
+	free(data);
+	if (!done) {
+		hs->hs_synced = n;
+		return;
+	}
+	hs->hs_seq += n;
+	hs->hs_pending = hs->hs_synced = 0;
+	if (n == HBLOCK && start % HBLOCK == 0 && start / HBLOCK < nblocks
+	    && (win->w_hblocks || (win->w_hblocks = calloc(nblocks, sizeof(struct hblock))) != NULL))
+		win->w_hblocks[start / HBLOCK].stored = off + 1;
+	if (HistStoreFull(hs)) {
+		HistStoreRelease(win);
+		if (HistStoreRotate(hs)) {
+			Msg(errno, "Cannot rotate history store %s", hs->hs_name);
+			hs->hs_failed = true;
+		}
+	}
+}
+
+/* Appends the first count lines of n cells in hl to the history, cut or
+ * padded to the width of win. */
+static void HistStoreLines(Window *win, struct hline *hl, int count, int n)
+{
+	int width = win->w_width + 1, m = n < width ? n : width;
+	struct mline ml;
+
+	ml.image = calloc(width, 4);
+	ml.attr = calloc(width, 4);
+	ml.font = calloc(width, 4);
+	ml.colorbg = calloc(width, 4);
+	ml.colorfg = calloc(width, 4);
+	for (int i = 0; i < count && ml.image && ml.attr && ml.font && ml.colorbg && ml.colorfg; i++) {
+		struct mline *l = HistExpand(&hl[i], n);
+
+		for (int x = 0; x < width; x++)
+			ml.image[x] = x < m ? l->image[x] : ' ';
+		memcpy(ml.attr, l->attr, m * 4);
+		memcpy(ml.font, l->font, m * 4);
+		memcpy(ml.colorbg, l->colorbg, m * 4);
+		memcpy(ml.colorfg, l->colorfg, m * 4);
+		HistAppend(win, &ml);
+	}
+	free(ml.image);
+	free(ml.attr);
+	free(ml.font);
+	free(ml.colorbg);
+	free(ml.colorfg);
+}
+
+/* Puts what the record t of the tail holds into the history: a block of
+ * the width of win as it is, other lines expanded. */
+static void HistStoreLoad(Window *win, const struct hstoretail *t)
+{
+	int b = win->w_histidx / HBLOCK, nblocks = win->w_histheight / HBLOCK;
+	struct hline hl[HBLOCK];
+	struct hstorerec rec;
+	struct hblock *hb;
+	char *data;
+
+	if (t->rec.width == win->w_width + 1 && t->rec.lines == HBLOCK && t->used == HBLOCK
+	    && win->w_histidx % HBLOCK == 0 && b < nblocks
+	    && (win->w_hblocks || (win->w_hblocks = calloc(nblocks, sizeof(struct hblock))) != NULL)) {
+		hb = &win->w_hblocks[b];
+		HistThaw(win, b, false);
+		for (int i = 0; i < HBLOCK; i++)
+			cell_free(&win->w_hlines[b * HBLOCK + i]);
+		hb->data = hist_stored;
+		hb->len = 0;
+		hb->mapped = HB_STORED;
+		hb->stored = t->off + 1;
+		hb->thawed = 0;
+		if ((win->w_histidx += HBLOCK) >= win->w_histheight)
+			win->w_histidx = 0;
+		win->w_scrollback_height += HBLOCK;
+		if (win->w_scrollback_height > win->w_histheight)
+			win->w_scrollback_height = win->w_histheight;
+		if (scrollback_compress && win->w_histidx % HBLOCK == 0)
+			HistCompress(win);
+		return;
+	}
+	if (t->rec.lines > HBLOCK || (data = HistStoreGet(win->w_hstore, t->off, &rec)) == NULL)
+		return;
+	memset(hl, 0, sizeof(hl));
+	if (!cell_thaw(hl, rec.lines, rec.width, data, rec.len))
+		HistStoreLines(win, hl, t->used, rec.width);
+	for (int i = 0; i < rec.lines; i++)
+		cell_free(&hl[i]);
+	free(data);
+}
+
+/*
+ * Keeps the history of win in the store hs from now on. A window with no
+ * history yet, a new one taking over from a process that is gone, takes
+ * the tail of the store as its history.
+ */
+void HistStoreAttach(Window *win, struct histstore *hs)
+{
+	struct hstoretail *tail;
+	int n;
+
+	win->w_hstore = hs;
+	if (win->w_scrollback_height || win->w_hpend || win->w_alt.on || win->w_histheight < HBLOCK)
+		return;
+	if ((n = HistStoreTail(hs, win->w_histheight, &tail)) < 0)
+		return;
+	hs->hs_loading = true;
+	for (int i = 0; i < n; i++)
+		HistStoreLoad(win, &tail[i]);
+	hs->hs_loading = false;
+	free(tail);
+	hs->hs_restored = win->w_scrollback_height;
+	histgen++;
+	SearchIndexDrop(win);
+}
+
+/* Writes what is left and closes the store of win; its blocks come back
+ * into the ring, to be compressed as blocks are. */
+void HistStoreDetach(Window *win)
+{
+	int b;
+
+	if (!win->w_hstore)
+		return;
+	HistStoreFlush(win, true);
+	for (b = 0; win->w_hblocks && b < win->w_histheight / HBLOCK; b++) {
+		if (win->w_hblocks[b].mapped == HB_STORED)
+			HistThaw(win, b, false);
+		win->w_hblocks[b].stored = 0;
+	}
+	HistStoreClose(win->w_hstore);
+	win->w_hstore = NULL;
 }
 
 int MFindUsedLine(Window *win, int ye, int ys)
@@ -2337,6 +3593,8 @@ int MFindUsedLine(Window *win, int ye, int ys)
 void WBell(Window *win, bool visual)
 {
 	Canvas *cv;
+
+	EventPost("bell", win->w_number, NULL);
 	if (displays == NULL)
 		win->w_bell = BELL_DONE;
 	for (display = displays; display; display = display->d_next) {
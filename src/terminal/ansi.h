@@ -137,6 +137,8 @@ enum move_t {
 #define UCS_REPL    0xfffd  /* character for illegal codes */
 #define UCS_REPL_DW 0xff1f  /* character for illegal codes */
 #define UCS_HIDDEN  0xffff
+#define UCS_COMB    0x110000	/* first code of a character with combining marks */
+#define UCS_COMBMAX 0x100000	/* number of such codes */
 
 #define is_dw_font(f) ((f) && ((f) & 0x60) == 0)
 
@@ -150,6 +152,7 @@ enum move_t {
 	)
 
 typedef struct Window Window;
+struct histstore;
 
 void  ResetAnsiState (Window *);
 void  ResetCharsets (Window *);
@@ -160,13 +163,36 @@ int   GetAnsiStatus (Window *, char *);
 void  WNewAutoFlow (Window *, int);
 void  WBell (Window *, bool);
 void  WMsg (Window *, int, char *);
+void  WLogScreen (Window *);
 int   MFindUsedLine (Window *, int, int);
+struct mline *HistLine (Window *, int);
+void  HistStore (Window *, int, struct mline *);
+void  HistAppend (Window *, struct mline *);
+void  RedrawSettle (Window *);
+size_t RedrawSize (Window *);
+int   MainHistLines (Window *);
+struct mline *MainHistLine (Window *, int);
+void  WSetLine (Window *, int, struct mline *);
+void  HistFlushCache (void);
+void  HistCompress (Window *);
+void  HistThawAll (Window *);
+void  HistHibernate (Window *);
+void  HistWake (Window *);
+size_t HistShrink (Window *, int, size_t, bool);
+void  HistStoreFlush (Window *, bool);
+void  HistStoreAttach (Window *, struct histstore *);
+void  HistStoreDetach (Window *);
 
 /* global variables */
 
 extern bool visual_bell;
 extern bool use_altscreen;
 extern bool use_hardstatus;
+extern int scrollback_compress;
+extern char *scrollback_dir;
+extern bool scrollback_dedup;
+extern bool scrollback_settle;
+extern size_t stringlimit;
 
 extern char *printcmd;
 
@@ -34,6 +34,7 @@
 #include <pwd.h>
 #include <signal.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <stdint.h>
@@ -95,20 +96,7 @@ static void QueryResultFail(int sigsig)
 
 static int WriteMessage(int sock, Message *msg)
 {
-	ssize_t r, l = sizeof(Message);
-
-	if (msg->type == MSG_ATTACH)
-		return SendAttachMsg(sock, msg, attach_fd);
-
-	while (l > 0) {
-		r = write(sock, (char *)msg + (sizeof(Message) - l), l);
-		if (r == -1 && errno == EINTR)
-			continue;
-		if (r == -1 || r == 0)
-			return -1;
-		l -= r;
-	}
-	return 0;
+	return SendMessage(sock, msg, msg->type == MSG_ATTACH ? attach_fd : -1);
 }
 
 int Attach(int how)
@@ -150,6 +138,7 @@ int Attach(int how)
 		}
 	} else {
 		n = FindSocket(&lasts, NULL, NULL, SocketMatch);
+		StartupTrace(STARTUP_FIND_SOCKET);
 		switch (n) {
 		case 0:
 			if (rflag && (rflag & 1) == 0)
@@ -424,13 +413,140 @@ void Attacher(void)
 	}
 }
 
+/*
+ * ImmorTerm: reads the command lines on stdin for SendBatch(), each
+ * 'Q' if query else 'X' and the line with its NUL, before there is a
+ * connection to the session: it waits on nobody while stdin is slow.
+ * Returns them, their bytes in len and their number in ncmds.
+ */
+static char *ReadBatch(int query, size_t *len, int *ncmds)
+{
+	char line[MAXSTR + 2], *buf = NULL;
+	size_t size = 0;
+
+	*len = 0;
+	*ncmds = 0;
+	while (fgets(line, ARRAY_SIZE(line), stdin)) {
+		size_t l = strcspn(line, "\r\n");
+
+		if (line[l] == 0 && !feof(stdin))
+			Panic(0, "Command line too long.");
+		line[l] = 0;
+		if (l == 0 || *line == '#')
+			continue;
+		if (*len + l + 2 > MSG_COMMANDSMAX)
+			Panic(0, "Too many commands to send.");
+		if (*len + l + 2 > size) {
+			size = size ? size * 2 : 4096;
+			if ((buf = realloc(buf, size)) == NULL)
+				Panic(0, "%s", strnomem);
+		}
+		buf[(*len)++] = query ? 'Q' : 'X';
+		memcpy(buf + *len, line, l + 1);
+		*len += l + 1;
+		(*ncmds)++;
+	}
+	return buf;
+}
+
+/*
+ * ImmorTerm: sends the ncmds commands ReadBatch() read, len bytes in buf,
+ * to the session on s in the one MSG_COMMANDS message m, and prints each
+ * result as '0' or '1' for success or failure, a space, what it printed
+ * and a NUL. Exits with 1 if one failed or the session went away before
+ * the end.
+ */
+static void SendBatch(int s, Message *m, char *buf, size_t len, int ncmds)
+{
+	size_t size = 0;
+	int nres = 0, failed = 0;
+	FILE *in;
+
+	m->type = MSG_COMMANDS;
+	m->m.command.nargs = ncmds;
+	if (WriteMessage(s, m))
+		Msg(errno, "write");
+	for (size_t off = 0; off < len;) {
+		ssize_t r = write(s, buf + off, len - off);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			Panic(errno, "write");
+		off += r;
+	}
+	free(buf);
+	buf = NULL;
+	shutdown(s, SHUT_WR);
+
+	/* what comes back is the output of each, a NUL and its status */
+	if ((in = fdopen(s, "r")) == NULL)
+		Panic(errno, "fdopen");
+	len = 0;
+	for (;;) {
+		int c;
+
+		while ((c = getc(in)) != EOF && c != 0) {
+			if (len + 1 >= size) {
+				size = size ? size * 2 : 4096;
+				if ((buf = realloc(buf, size)) == NULL)
+					Panic(0, "%s", strnomem);
+			}
+			buf[len++] = c;
+		}
+		if (c == EOF || (c = getc(in)) == EOF)
+			break;
+		if (c != '0')
+			failed++;
+		printf("%c ", c);
+		fwrite(buf, 1, len, stdout);
+		putchar(0);
+		len = 0;
+		nres++;
+	}
+	fclose(in);
+	free(buf);
+	if (failed || nres < ncmds)
+		exit(1);
+}
+
+/*
+ * ImmorTerm: turns s into a MSG_EVENTS connection and copies the events
+ * the session sends (see events.h) to stdout until it goes away.
+ */
+static void ReadEvents(int s, Message *m)
+{
+	char buf[4096];
+	ssize_t n;
+
+	m->type = MSG_EVENTS;
+	if (WriteMessage(s, m))
+		Panic(errno, "write");
+	for (;;) {
+		n = read(s, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		if (fwrite(buf, 1, n, stdout) != (size_t)n || fflush(stdout))
+			exit(1);
+	}
+}
+
 void SendCmdMessage(char *sty, char *match, char **av, int query)
 {
 	int i, s;
 	Message m;
 	char *p;
 	int n;
-
+	bool batch = !strcmp(av[0], "-") && !av[1];	/* ImmorTerm: the commands are on stdin */
+	bool events = query && !strcmp(av[0], "events") && !av[1];	/* ImmorTerm: follow the session */
+	char *cmds = NULL;
+	size_t cmdslen = 0;
+	int ncmds = 0;
+
+	if (batch)
+		cmds = ReadBatch(query, &cmdslen, &ncmds);
 	if (sty == NULL) {
 		i = FindSocket(&s, NULL, NULL, match);
 		if (i == 0)
@@ -473,6 +589,16 @@ void SendCmdMessage(char *sty, char *match, char **av, int query)
 	strncpy(m.m.command.preselect, preselect ? preselect : "", ARRAY_SIZE(m.m.command.preselect) - 1);
 	m.m.command.preselect[ARRAY_SIZE(m.m.command.preselect) - 1] = 0;
 	m.m.command.apid = getpid();
+	if (batch) {
+		SendBatch(s, &m, cmds, cmdslen, ncmds);
+		close(s);
+		return;
+	}
+	if (events) {
+		ReadEvents(s, &m);
+		close(s);
+		return;
+	}
 	if (query) {
 		/* Create a server socket so we can get back the result */
 		char *sp = SocketPath + strlen(SocketPath);
@@ -33,6 +33,10 @@
 
 #include "backtick.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
 #include "fileio.h"
 #include "misc.h"
 #include "winmsg.h"
@@ -94,7 +98,141 @@ static void backtick_fn(Event *ev, void *data)
 	bt->bufi = i;
 }
 
-void setbacktick(int num, int lifespan, int tick, char **cmdv)
+/* Key and file of a shared backtick: the command with its arguments
+ * separated by \037, and a dot file named after its hash in the socket
+ * directory, where "screen -ls" does not look. */
+static size_t bt_key(Backtick *bt, char *key, size_t size)
+{
+	size_t len = 0;
+
+	for (char **v = bt->cmdv; *v; v++) {
+		int n = snprintf(key + len, size - len, "%s%s", v == bt->cmdv ? "" : "\037", *v);
+		if (n < 0 || (size_t)n >= size - len)
+			return 0;
+		len += n;
+	}
+	return len;
+}
+
+static bool bt_cachefile(const char *key, char *path, size_t size)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;  /* FNV-1a */
+	int dirlen = SocketName - SocketPath - 1;
+	int n;
+
+	for (const char *k = key; *k; k++)
+		h = (h ^ (unsigned char)*k) * 0x100000001b3ULL;
+	n = snprintf(path, size, "%.*s/.backtick-%016llx", dirlen, SocketPath, (unsigned long long)h);
+	return n > 0 && (size_t)n < size;
+}
+
+/* Take a result another session stored, if it is recent enough for our
+ * lifespan; a lifespan of 0 accepts any stored result. */
+static bool bt_load(Backtick *bt, time_t now)
+{
+	char key[MAXSTR], path[MAXPATHLEN], buf[2 * MAXSTR];
+	struct stat st;
+	size_t klen;
+	ssize_t l;
+	int fd;
+
+	if (!(klen = bt_key(bt, key, sizeof(key))) || !bt_cachefile(key, path, sizeof(path)))
+		return false;
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return false;
+	if (fstat(fd, &st) || (bt->lifespan && st.st_mtime + bt->lifespan <= now)) {
+		close(fd);
+		return false;
+	}
+	l = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	/* "key\nresult" */
+	if (l <= (ssize_t)klen || memcmp(buf, key, klen) || buf[klen] != '\n')
+		return false;
+	buf[l] = 0;
+	strncpy(bt->result, buf + klen + 1, sizeof(bt->result) - 1);
+	bt->result[sizeof(bt->result) - 1] = 0;
+	bt->bestbefore = bt->lifespan ? st.st_mtime + bt->lifespan : now + 1;
+	return true;
+}
+
+static void bt_store(Backtick *bt)
+{
+	char key[MAXSTR], path[MAXPATHLEN], tmp[MAXPATHLEN + 16];
+	size_t klen, rlen = strlen(bt->result);
+	int fd;
+	bool ok;
+
+	if (!(klen = bt_key(bt, key, sizeof(key))) || !bt_cachefile(key, path, sizeof(path)))
+		return;
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+		return;
+	key[klen] = '\n';
+	ok = write(fd, key, klen + 1) == (ssize_t)(klen + 1)
+	    && write(fd, bt->result, rlen) == (ssize_t)rlen;
+	close(fd);
+	/* readers see either the old or the new result, never half of one */
+	if (!ok || rename(tmp, path))
+		unlink(tmp);
+}
+
+/* Output of a periodic backtick: keep the tail and, once the command is
+ * done, use its last line. */
+static void backtick_run_fn(Event *ev, void *data)
+{
+	Backtick *bt = (Backtick *)data;
+	struct timeval now;
+	int i, k, l;
+
+	l = read(ev->fd, bt->buf + bt->bufi, MAXSTR - 1 - bt->bufi);
+	if (l > 0) {
+		bt->bufi += l;
+		if (bt->bufi == MAXSTR - 1) {
+			memmove(bt->buf, bt->buf + MAXSTR / 2, bt->bufi - MAXSTR / 2);
+			bt->bufi -= MAXSTR / 2;
+		}
+		return;
+	}
+	if (l < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+	evdeq(ev);
+	close(ev->fd);
+	ev->fd = -1;
+
+	i = bt->bufi;
+	if (i && bt->buf[i - 1] == '\n')
+		i--;
+	for (k = i; k > 0 && bt->buf[k - 1] != '\n'; k--)
+		;
+	memmove(bt->result, bt->buf + k, i - k);
+	bt->result[i - k] = 0;
+	backtick_filter(bt);
+	/* a lifespan of 0 asks for a new run on every refresh, not for one
+	 * right after the repaint this result triggers */
+	SchedWalltime(&now);
+	bt->bestbefore = now.tv_sec + (bt->lifespan ? bt->lifespan : 1);
+	if (bt->shared)
+		bt_store(bt);
+	WindowChanged(NULL, WINESC_BACKTICK);
+}
+
+/* Start a periodic backtick in the background; the status line keeps
+ * showing the previous result until the command has finished. */
+static void bt_start(Backtick *bt)
+{
+	if (bt->buf == NULL && (bt->buf = malloc(MAXSTR)) == NULL)
+		return;
+	bt->bufi = 0;
+	bt->ev.type = EV_READ;
+	bt->ev.handler = backtick_run_fn;
+	bt->ev.name = "backtick_run_fn";
+	bt->ev.data = (char *)bt;
+	if ((bt->ev.fd = readpipe(bt->cmdv)) >= 0)
+		evenq(&bt->ev);
+}
+
+void setbacktick(int num, int lifespan, int tick, char **cmdv, bool shared)
 {
 	struct backtick **btp, *bt;
 	char **v;
@@ -137,17 +275,21 @@ void setbacktick(int num, int lifespan, int tick, char **cmdv)
 	bt->buf = NULL;
 	bt->bufi = 0;
 	bt->cmdv = cmdv;
+	bt->shared = shared;
 	bt->ev.fd = -1;
-	if (bt->tick == 0 && bt->lifespan == 0) {
+	/* a shared backtick always runs to completion, so that its result can
+	 * be stored; with lifespan and autorefresh 0 it runs just once */
+	if (bt->tick == 0 && bt->lifespan == 0 && !bt->shared) {
 		bt->buf = malloc(MAXSTR);
 		if (bt->buf == NULL) {
 			Msg(0, "%s", strnomem);
-			setbacktick(num, 0, 0, NULL);
+			setbacktick(num, 0, 0, NULL, false);
 			return;
 		}
 		bt->ev.type = EV_READ;
 		bt->ev.fd = readpipe(bt->cmdv);
 		bt->ev.handler = backtick_fn;
+		bt->ev.name = "backtick_fn";
 		bt->ev.data = (char *)bt;
 		if (bt->ev.fd >= 0)
 			evenq(&bt->ev);
@@ -156,40 +298,18 @@ void setbacktick(int num, int lifespan, int tick, char **cmdv)
 
 char *runbacktick(Backtick *bt, int *tickp, time_t now)
 {
-	int f, i, l, j;
-	time_t now2;
-
 	if (bt->tick && (!*tickp || bt->tick < *tickp))
 		*tickp = bt->tick;
-	if ((bt->lifespan == 0 && bt->tick == 0) || now < bt->bestbefore) {
+	if (bt->lifespan == 0 && bt->tick == 0 && !bt->shared)
 		return bt->result;
-	}
-	f = readpipe(bt->cmdv);
-	if (f == -1)
+	/* still running, or not due */
+	if (bt->ev.fd >= 0 || now < bt->bestbefore)
 		return bt->result;
-	i = 0;
-	while ((l = read(f, bt->result + i, ARRAY_SIZE(bt->result) - i)) > 0) {
-		i += l;
-		for (j = 1; j < l; j++)
-			if (bt->result[i - j - 1] == '\n')
-				break;
-		if (j == l && i == ARRAY_SIZE(bt->result)) {
-			j = ARRAY_SIZE(bt->result) / 2;
-			l = j + 1;
-		}
-		if (j < l) {
-			memmove(bt->result, bt->result + i - j, j);
-			i = j;
-		}
-	}
-	close(f);
-	bt->result[ARRAY_SIZE(bt->result) - 1] = '\n';
-	if (i && bt->result[i - 1] == '\n')
-		i--;
-	bt->result[i] = 0;
-	backtick_filter(bt);
-	(void)time(&now2);
-	bt->bestbefore = now2 + bt->lifespan;
+	if (bt->shared && bt->lifespan == 0 && bt->tick == 0 && bt->bestbefore)
+		return bt->result;
+	if (bt->shared && bt_load(bt, now))
+		return bt->result;
+	bt_start(bt);
 	return bt->result;
 }
 
@@ -34,6 +34,7 @@
 #ifndef SCREEN_BACKTICK_H
 #define SCREEN_BACKTICK_H
 
+#include <stdbool.h>
 #include <time.h>
 #include "screen.h"
 
@@ -48,10 +49,11 @@ typedef struct backtick {
 	Event ev;
 	char *buf;
 	int bufi;
+	bool shared;  /* result cached in the socket directory for all sessions */
 } Backtick;
 
 /* TODO: these still need refactoring */
-void setbacktick(int, int, int, char **);
+void setbacktick(int, int, int, char **, bool);
 char *runbacktick(Backtick *bt, int *tickp, time_t now);
 
 /* opaque interface */
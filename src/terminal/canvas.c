@@ -233,6 +233,7 @@ void SetCanvasWindow(Canvas *cv, Window *window)
 
 	/* find right layer to display on canvas */
 	if (window && window->w_type != W_TYPE_GROUP) {
+		WindowWake(window);
 		l = &window->w_layer;
 		if (window->w_savelayer && (window->w_blocked || window->w_savelayer->l_cvlist == NULL))
 			l = window->w_savelayer;
@@ -336,6 +337,7 @@ int MakeDefaultCanvas(void)
 	cv->c_captev.type = EV_TIMEOUT;
 	cv->c_captev.data = (char *)cv;
 	cv->c_captev.handler = cv_winid_fn;
+	cv->c_captev.name = "cv_winid_fn";
 
 	CanvasInitBlank(cv);
 	cv->c_lnext = NULL;
@@ -627,6 +629,7 @@ int AddCanvas(int orient)
 	cv->c_captev.type = EV_TIMEOUT;
 	cv->c_captev.data = (char *)cv;
 	cv->c_captev.handler = cv_winid_fn;
+	cv->c_captev.name = "cv_winid_fn";
 
 	CanvasInitBlank(cv);
 	cv->c_lnext = NULL;
@@ -746,6 +749,7 @@ void DupLayoutCv(Canvas *cvf, Canvas *cvt, bool save)
 				cvt->c_captev.type = EV_TIMEOUT;
 				cvt->c_captev.data = (char *)cvt;
 				cvt->c_captev.handler = cv_winid_fn;
+				cvt->c_captev.name = "cv_winid_fn";
 				cvt->c_blank.l_cvlist = NULL;
 				cvt->c_blank.l_layfn = &BlankLf;
 				cvt->c_blank.l_bottom = &cvt->c_blank;
@@ -0,0 +1,661 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include "cell.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lzblock.h"
+
+static const struct mstyle style_default;
+
+static struct mstyle *styles;	/* styles[0] is the default style */
+static uint32_t nstyles;
+static uint32_t *stylehash;	/* open addressing, 0 marks a free slot */
+static uint32_t hashsize;
+static bool styles_shared;	/* see cell_share_styles() */
+
+/*
+ * ImmorTerm: shared lines. cell_share() looks a packed line up in a table
+ * of lines kept once for all windows and makes it use the copy there,
+ * which counts its users. What is stored is the line's buffer, code
+ * points and runs or packed cells; the hline itself stays in its slot. A
+ * shared line has a buffer but no room of its own (room 0). Its buffer is
+ * never written to: packing another line into the slot lets go of it.
+ */
+struct sharedline {
+	struct sharedline *next;	/* in the same bucket */
+	uint32_t hash;
+	uint32_t refs;
+	uint16_t len;			/* as in the hline */
+	int16_t nruns;			/* as in the hline, -1 for packed cells */
+	uint32_t data[];
+};
+
+/* bytes of data of sl */
+#define SHAREDSIZE(sl)	((sl)->nruns < 0 ? (sl)->len * sizeof(struct mcell) \
+			 : (sl)->len * sizeof(uint32_t) + (sl)->nruns * sizeof(struct mrun))
+
+#define SHARED(hl)	((hl)->room == 0 && ((hl)->image || (hl)->cells))
+#define SHAREDLINE(p)	((struct sharedline *)((char *)(p) - offsetof(struct sharedline, data)))
+
+static struct sharedline **sharedtab;
+static uint32_t sharedbuckets, nshared;
+static size_t sharedbytes, sharedsaved;
+
+static uint32_t style_hash(const struct mstyle *st)
+{
+	uint32_t h;
+
+	h = st->attr * 0x9e3779b1;
+	h = (h ^ st->font) * 0x85ebca6b;
+	h = (h ^ st->colorbg) * 0xc2b2ae35;
+	h = (h ^ st->colorfg) * 0x27d4eb2f;
+	return h ^ h >> 15;
+}
+
+/* Make room for one more style, keeping the hash at most half full. */
+static int style_grow(void)
+{
+	uint32_t size, i, j;
+	uint32_t *hash;
+	struct mstyle *st;
+
+	if ((nstyles + 1) * 2 <= hashsize)
+		return 0;
+	size = hashsize ? hashsize * 2 : 256;
+	if (size / 2 >= MCELL_FONTIMG)
+		return -1;
+	if ((st = realloc(styles, size / 2 * sizeof(struct mstyle))) == NULL)
+		return -1;
+	styles = st;
+	if ((hash = calloc(size, sizeof(uint32_t))) == NULL)
+		return -1;
+	if (nstyles == 0)
+		styles[nstyles++] = style_default;
+	for (i = 1; i < nstyles; i++) {
+		for (j = style_hash(styles + i) & (size - 1); hash[j]; j = (j + 1) & (size - 1))
+			;
+		hash[j] = i;
+	}
+	free(stylehash);
+	stylehash = hash;
+	hashsize = size;
+	return 0;
+}
+
+/* Returns the style index of the given rendition, interning it if it is
+ * new. If there is no memory left the default style is returned. */
+uint32_t cell_style(uint32_t attr, uint32_t font, uint32_t colorbg, uint32_t colorfg)
+{
+	struct mstyle st;
+	uint32_t i;
+
+	if ((attr | font | colorbg | colorfg) == 0)
+		return 0;
+	st.attr = attr;
+	st.font = font;
+	st.colorbg = colorbg;
+	st.colorfg = colorfg;
+	if (hashsize) {
+		for (i = style_hash(&st) & (hashsize - 1); stylehash[i]; i = (i + 1) & (hashsize - 1))
+			if (!memcmp(styles + stylehash[i], &st, sizeof(st)))
+				return stylehash[i];
+	}
+	if (styles_shared || style_grow())
+		return 0;
+	for (i = style_hash(&st) & (hashsize - 1); stylehash[i]; i = (i + 1) & (hashsize - 1))
+		;
+	styles[nstyles] = st;
+	stylehash[i] = nstyles;
+	return nstyles++;
+}
+
+const struct mstyle *cell_getstyle(uint32_t style)
+{
+	style = MCELL_STYLE(style);
+	return style ? styles + style : &style_default;
+}
+
+/* ImmorTerm: while the style table is shared between threads, styles are
+ * only looked up; one that is not there yet comes out as the default. The
+ * resize workers only repack renditions of lines that were packed before,
+ * so for them every style is there. */
+void cell_share_styles(bool on)
+{
+	styles_shared = on;
+}
+
+/* number of distinct styles interned so far, including the default one */
+size_t cell_nstyles(void)
+{
+	return nstyles ? nstyles : 1;
+}
+
+/* bytes the style table and its hash take */
+size_t cell_styles_size(void)
+{
+	return hashsize / 2 * sizeof(struct mstyle) + hashsize * sizeof(uint32_t);
+}
+
+/* the font of cell x as kept in a style word: MCELL_FONTIMG if it
+ * follows from the code point */
+static uint32_t font_key(struct mline *ml, int x)
+{
+	return ml->font[x] == ml->image[x] >> 8 ? MCELL_FONTIMG : ml->font[x];
+}
+
+static int same_rend(struct mline *ml, int x1, int x2)
+{
+	return ml->attr[x1] == ml->attr[x2] && ml->colorbg[x1] == ml->colorbg[x2]
+	    && ml->colorfg[x1] == ml->colorfg[x2] && font_key(ml, x1) == font_key(ml, x2);
+}
+
+static uint32_t style_of(struct mline *ml, int x)
+{
+	uint32_t f = font_key(ml, x);
+
+	if (f == MCELL_FONTIMG)
+		return cell_style(ml->attr[x], 0, ml->colorbg[x], ml->colorfg[x]) | MCELL_FONTIMG;
+	return cell_style(ml->attr[x], f, ml->colorbg[x], ml->colorfg[x]);
+}
+
+/* ImmorTerm: a buffer is reused for any line it holds while it is no
+ * larger than the longest line stored so far for the same user (the high
+ * water of each kind, see struct hlinehigh) or HLINE_SPARE(need) words or
+ * cells, so that the lines of a window, short or full, do not reallocate
+ * once the history went round. One that grows goes to that size at once,
+ * which is never less than a full line of plain text. Without a high
+ * water only HLINE_SPARE() counts. */
+#define HLINE_SPARE(need) (2 * (need) + 32)
+
+/* the room a buffer for need gets, 0 if one of room will do */
+static int hline_room(int need, int room, int *high)
+{
+	if (high == NULL)
+		return room >= need && room <= HLINE_SPARE(need) ? 0 : need;
+	if (need > *high)
+		*high = need;
+	if (room >= need && (room <= HLINE_SPARE(need) || room <= *high))
+		return 0;
+	return *high;
+}
+
+/* (re)allocates the N code points of HL, followed by room for NRUNS runs */
+static int hline_image(struct hline *hl, int n, int nruns, int *high)
+{
+	int need = n + nruns * sizeof(struct mrun) / sizeof(uint32_t), room;
+	uint32_t *p;
+
+	if (SHARED(hl))
+		cell_free(hl);
+	if (!(room = hline_room(need, hl->image ? hl->room : 0, high)))
+		goto done;
+	if ((p = realloc(hl->image, room * sizeof(uint32_t))) == NULL)
+		return -1;
+	hl->image = p;
+	hl->room = room;
+done:
+	hl->len = n;
+	hl->nruns = nruns;
+	return 0;
+}
+
+/* (re)allocates N packed cells of HL */
+static int hline_cells(struct hline *hl, int n, int *high)
+{
+	struct mcell *p;
+	int room;
+
+	if (SHARED(hl))
+		cell_free(hl);
+	if (!(room = hline_room(n, hl->cells ? hl->room : 0, high)))
+		goto done;
+	if ((p = realloc(hl->cells, room * sizeof(struct mcell))) == NULL)
+		return -1;
+	hl->cells = p;
+	hl->room = room;
+done:
+	hl->len = n;
+	hl->nruns = 0;
+	return 0;
+}
+
+/* is cell x of ML a blank of the default rendition? */
+static int blank_cell(struct mline *ml, int x)
+{
+	return ml->image[x] == ' ' && (ml->attr[x] | ml->font[x] | ml->colorbg[x] | ml->colorfg[x]) == 0;
+}
+
+/* Stores the first N cells of ML in HL, reusing its buffers where
+ * possible. ML must have all five arrays (the shared null array is fine).
+ * Trailing blanks of the default rendition are left out. Lines with few
+ * renditions are kept as code points plus style runs, only lines
+ * changing rendition all the time get packed cells. high, if not NULL,
+ * is the high water of the caller's lines (one per thread). Returns -1
+ * if there is no memory. */
+int cell_pack(struct hline *hl, struct mline *ml, int n, struct hlinehigh *high)
+{
+	uint32_t style = 0;
+	struct mcell *mc;
+	struct mrun *run;
+	int x, nruns;
+
+	/* ImmorTerm: any line of plain text fits from the start */
+	if (high && high->image < n)
+		high->image = n;
+	while (n > 0 && blank_cell(ml, n - 1))
+		n--;
+	if (n <= 0) {
+		/* blank, keep nothing */
+		cell_free(hl);
+		return 0;
+	}
+	for (nruns = 1, x = 1; x < n; x++)
+		if (!same_rend(ml, x - 1, x))
+			nruns++;
+	if (nruns == 1 && (ml->attr[0] | ml->colorbg[0] | ml->colorfg[0]) == 0
+	    && font_key(ml, 0) == MCELL_FONTIMG)
+		nruns = 0;
+	if (nruns * sizeof(struct mrun) < n * sizeof(uint32_t)) {
+		if (hl->cells)
+			cell_free(hl);
+		if (hline_image(hl, n, nruns, high ? &high->image : NULL))
+			return -1;
+		memcpy(hl->image, ml->image, n * sizeof(uint32_t));
+		for (run = HLINE_RUNS(hl), x = 0; nruns && x < n; x++)
+			if (x == 0 || !same_rend(ml, x - 1, x)) {
+				run->x = x;
+				run->style = style_of(ml, x);
+				run++;
+			}
+		return 0;
+	}
+	if (hl->image)
+		cell_free(hl);
+	if (hline_cells(hl, n, high ? &high->cells : NULL))
+		return -1;
+	for (mc = hl->cells, x = 0; x < n; x++, mc++) {
+		if (x == 0 || !same_rend(ml, x - 1, x))
+			style = style_of(ml, x);
+		mc->image = ml->image[x];
+		mc->style = style;
+	}
+	return 0;
+}
+
+/* fills cells X to N of ML with blanks of the default rendition */
+static void blank_tail(struct mline *ml, int x, int n)
+{
+	if (x >= n)
+		return;
+	for (int i = x; i < n; i++)
+		ml->image[i] = ' ';
+	memset(ml->attr + x, 0, (n - x) * sizeof(uint32_t));
+	memset(ml->font + x, 0, (n - x) * sizeof(uint32_t));
+	memset(ml->colorbg + x, 0, (n - x) * sizeof(uint32_t));
+	memset(ml->colorfg + x, 0, (n - x) * sizeof(uint32_t));
+}
+
+/* Expands N cells of HL into the five arrays of ML and tells which of
+ * attr, font and colors are not all zero. */
+int cell_unpack(struct mline *ml, const struct hline *hl, int n)
+{
+	const struct mstyle *st = &style_default;
+	uint32_t style = 0;
+	int x, r, used = 0;
+	int len = hl->len < n ? hl->len : n;
+
+	if (hl->cells) {
+		const struct mcell *mc = hl->cells;
+
+		for (x = 0; x < len; x++, mc++) {
+			if (MCELL_STYLE(mc->style) != style) {
+				style = MCELL_STYLE(mc->style);
+				st = cell_getstyle(style);
+			}
+			ml->image[x] = mc->image;
+			ml->attr[x] = st->attr;
+			ml->font[x] = mc->style & MCELL_FONTIMG ? mc->image >> 8 : st->font;
+			ml->colorbg[x] = st->colorbg;
+			ml->colorfg[x] = st->colorfg;
+			used |= (st->attr ? CELL_ATTR : 0) | (ml->font[x] ? CELL_FONT : 0)
+			    | (st->colorbg ? CELL_COLORBG : 0) | (st->colorfg ? CELL_COLORFG : 0);
+		}
+		blank_tail(ml, len, n);
+		return used;
+	}
+	if (hl->image && hl->nruns) {
+		const struct mrun *run = HLINE_RUNS(hl);
+
+		memcpy(ml->image, hl->image, len * sizeof(uint32_t));
+		for (r = 0; r < hl->nruns && (int)run->x < len; r++, run++) {
+			int xe = r + 1 < hl->nruns && (int)run[1].x < len ? (int)run[1].x : len;
+
+			st = cell_getstyle(run->style);
+			for (x = run->x; x < xe; x++) {
+				ml->attr[x] = st->attr;
+				ml->font[x] = run->style & MCELL_FONTIMG ? ml->image[x] >> 8 : st->font;
+				ml->colorbg[x] = st->colorbg;
+				ml->colorfg[x] = st->colorfg;
+				if (ml->font[x])
+					used |= CELL_FONT;
+			}
+			used |= (st->attr ? CELL_ATTR : 0) | (st->colorbg ? CELL_COLORBG : 0)
+			    | (st->colorfg ? CELL_COLORFG : 0);
+		}
+		blank_tail(ml, len, n);
+		return used;
+	}
+	if (!hl->image)
+		len = 0;
+	memcpy(ml->image, hl->image ? hl->image : ml->image, len * sizeof(uint32_t));
+	for (x = 0; x < len; x++)
+		if ((ml->font[x] = ml->image[x] >> 8))
+			used = CELL_FONT;
+	memset(ml->attr, 0, len * sizeof(uint32_t));
+	memset(ml->colorbg, 0, len * sizeof(uint32_t));
+	memset(ml->colorfg, 0, len * sizeof(uint32_t));
+	blank_tail(ml, len, n);
+	return used;
+}
+
+static void shared_put(struct sharedline *);
+static size_t hline_size(const struct hline *);
+
+void cell_free(struct hline *hl)
+{
+	if (SHARED(hl))
+		shared_put(SHAREDLINE(hl->cells ? (void *)hl->cells : (void *)hl->image));
+	else {
+		free(hl->image);
+		free(hl->cells);
+	}
+	hl->image = NULL;
+	hl->cells = NULL;
+	hl->nruns = 0;
+	hl->len = 0;
+	hl->room = 0;
+}
+
+/* Adds the bytes HL takes for code points to *image and for its
+ * renditions (style runs or the style half of packed cells) to *style.
+ * Room to spare in its buffer counts as code points. */
+void cell_size(const struct hline *hl, size_t *image, size_t *style)
+{
+	if (SHARED(hl)) {
+		/* its part of the shared copy */
+		uint32_t refs = SHAREDLINE(hl->cells ? (void *)hl->cells : (void *)hl->image)->refs;
+
+		*image += (hl->len * sizeof(uint32_t) + sizeof(struct sharedline)) / refs;
+		*style += (hl->cells ? hl->len * (sizeof(struct mcell) - sizeof(uint32_t))
+			   : hl->nruns * sizeof(struct mrun)) / refs;
+	} else if (hl->cells) {
+		*image += hl->room * sizeof(uint32_t);
+		*style += hl->room * (sizeof(struct mcell) - sizeof(uint32_t));
+	} else if (hl->image) {
+		*image += hl->room * sizeof(uint32_t) - hl->nruns * sizeof(struct mrun);
+		*style += hl->nruns * sizeof(struct mrun);
+	}
+}
+
+static uint32_t shared_hash(const uint32_t *p, size_t n, uint32_t h)
+{
+	for (; n > 0; n--, p++)
+		h = (h ^ *p) * 0x9e3779b1;
+	return h ^ h >> 16;
+}
+
+/* Doubles the buckets once there are as many lines as buckets. */
+static void shared_grow(void)
+{
+	struct sharedline **tab, *sl, *next;
+	uint32_t size = sharedbuckets ? sharedbuckets * 2 : 1024, i;
+
+	if (nshared < sharedbuckets || (tab = calloc(size, sizeof(*tab))) == NULL)
+		return;
+	for (i = 0; i < sharedbuckets; i++)
+		for (sl = sharedtab[i]; sl; sl = next) {
+			next = sl->next;
+			sl->next = tab[sl->hash & (size - 1)];
+			tab[sl->hash & (size - 1)] = sl;
+		}
+	free(sharedtab);
+	sharedtab = tab;
+	sharedbuckets = size;
+}
+
+static void shared_put(struct sharedline *sl)
+{
+	struct sharedline **slp;
+
+	if (--sl->refs) {
+		sharedsaved -= SHAREDSIZE(sl);
+		return;
+	}
+	for (slp = &sharedtab[sl->hash & (sharedbuckets - 1)]; *slp != sl; slp = &(*slp)->next)
+		;
+	*slp = sl->next;
+	nshared--;
+	sharedbytes -= sizeof(*sl) + SHAREDSIZE(sl);
+	free(sl);
+}
+
+/* Makes HL use the shared copy of its content, adding one if there is
+ * none yet. Blank and shared lines are left as they are, and so is HL if
+ * there is no memory. */
+void cell_share(struct hline *hl)
+{
+	const void *p = hl->cells ? (void *)hl->cells : (void *)hl->image;
+	int nruns = hl->cells ? -1 : hl->nruns;
+	uint32_t size, hash;
+	struct sharedline *sl;
+
+	if (!p || SHARED(hl))
+		return;
+	size = hline_size(hl);
+	hash = shared_hash(p, size / sizeof(uint32_t), hl->len * 0x85ebca6b ^ nruns);
+	shared_grow();
+	if (!sharedbuckets)
+		return;
+	for (sl = sharedtab[hash & (sharedbuckets - 1)]; sl; sl = sl->next)
+		if (sl->hash == hash && sl->len == hl->len && sl->nruns == nruns && !memcmp(sl->data, p, size))
+			break;
+	if (sl) {
+		sl->refs++;
+		sharedsaved += size;
+	} else {
+		if ((sl = malloc(sizeof(*sl) + size)) == NULL)
+			return;
+		sl->hash = hash;
+		sl->refs = 1;
+		sl->nruns = nruns;
+		sl->len = hl->len;
+		memcpy(sl->data, p, size);
+		sl->next = sharedtab[hash & (sharedbuckets - 1)];
+		sharedtab[hash & (sharedbuckets - 1)] = sl;
+		nshared++;
+		sharedbytes += sizeof(*sl) + size;
+	}
+	if (hl->cells) {
+		free(hl->cells);
+		hl->cells = (struct mcell *)sl->data;
+	} else {
+		free(hl->image);
+		hl->image = sl->data;
+	}
+	hl->room = 0;
+}
+
+/* bytes the shared lines and their table take */
+size_t cell_shared_size(void)
+{
+	return sharedbytes + sharedbuckets * sizeof(struct sharedline *);
+}
+
+/* bytes the lines using a shared copy would take with one of their own */
+size_t cell_shared_saved(void)
+{
+	return sharedsaved;
+}
+
+/*
+ * Frozen blocks: a uint32_t with the uncompressed size, followed by the
+ * compressed lines. Each line is a uint32_t telling its kind (blank,
+ * packed cells or else the number of runs) and, unless it is blank, a
+ * uint32_t with the number of cells kept and the line's arrays.
+ */
+#define FROZEN_BLANK	0xffffffff
+#define FROZEN_CELLS	0xfffffffe
+
+static size_t hline_size(const struct hline *hl)
+{
+	if (hl->cells)
+		return hl->len * sizeof(struct mcell);
+	if (hl->image)
+		return hl->len * sizeof(uint32_t) + hl->nruns * sizeof(struct mrun);
+	return 0;
+}
+
+/* Compresses COUNT lines of width N into one block, leaving the lines as
+ * they are. Returns the block and stores its size in *LENP, or returns
+ * NULL if there is no memory. */
+char *cell_freeze_copy(const struct hline *hl, int count, int n, size_t *lenp)
+{
+	size_t raw = 0, len;
+	char *buf, *p, *data, *d;
+	uint32_t kind, raw32;
+	int i;
+
+	if (count <= 0)
+		return NULL;
+	for (i = 0; i < count; i++) {
+		if (hl[i].len > n)
+			return NULL;
+		raw += sizeof(uint32_t) + (hl[i].image || hl[i].cells ? sizeof(uint32_t) : 0) + hline_size(hl + i);
+	}
+	if ((buf = malloc(raw)) == NULL)
+		return NULL;
+	if ((data = malloc(sizeof(uint32_t) + LZB_BOUND(raw))) == NULL) {
+		free(buf);
+		return NULL;
+	}
+	for (p = buf, i = 0; i < count; i++) {
+		kind = hl[i].cells ? FROZEN_CELLS : hl[i].image ? (uint32_t)hl[i].nruns : FROZEN_BLANK;
+		memcpy(p, &kind, sizeof(kind));
+		p += sizeof(kind);
+		if (kind == FROZEN_BLANK)
+			continue;
+		kind = hl[i].len;
+		memcpy(p, &kind, sizeof(kind));
+		p += sizeof(kind);
+		len = hline_size(hl + i);
+		memcpy(p, hl[i].cells ? (void *)hl[i].cells : (void *)hl[i].image, len);
+		p += len;
+	}
+	raw32 = (uint32_t)raw;
+	memcpy(data, &raw32, sizeof(raw32));
+	len = sizeof(uint32_t) + lzb_compress(buf, raw, data + sizeof(uint32_t), LZB_BOUND(raw));
+	free(buf);
+	if ((d = realloc(data, len)) != NULL)
+		data = d;
+	*lenp = len;
+	return data;
+}
+
+/* Like cell_freeze_copy(), but leaves the lines blank. The lines are not
+ * touched if there is no memory. */
+char *cell_freeze(struct hline *hl, int count, int n, size_t *lenp)
+{
+	char *data = cell_freeze_copy(hl, count, n, lenp);
+
+	if (data)
+		for (int i = 0; i < count; i++)
+			cell_free(hl + i);
+	return data;
+}
+
+/* The most cell_freeze() can return for COUNT lines of width N. Packed
+ * cells are the largest form a line takes, see cell_pack(). */
+size_t cell_frozen_max(int count, int n)
+{
+	size_t raw = count * (2 * sizeof(uint32_t) + n * sizeof(struct mcell));
+
+	return sizeof(uint32_t) + LZB_BOUND(raw);
+}
+
+/* Expands a block made by cell_freeze() back into COUNT blank lines.
+ * Returns -1 if there is no memory or the block is corrupt, leaving the
+ * lines blank. */
+int cell_thaw(struct hline *hl, int count, int n, const char *data, size_t len)
+{
+	uint32_t raw, kind, cells;
+	char *buf, *p, *end;
+	size_t l;
+	int i;
+
+	if (len < sizeof(uint32_t))
+		return -1;
+	memcpy(&raw, data, sizeof(raw));
+	if ((buf = malloc(raw ? raw : 1)) == NULL)
+		return -1;
+	if (lzb_decompress(data + sizeof(uint32_t), len - sizeof(uint32_t), buf, raw))
+		goto fail;
+	for (p = buf, end = buf + raw, i = 0; i < count; i++) {
+		if ((size_t)(end - p) < sizeof(kind))
+			goto fail;
+		memcpy(&kind, p, sizeof(kind));
+		p += sizeof(kind);
+		if (kind == FROZEN_BLANK)
+			continue;
+		if ((size_t)(end - p) < sizeof(cells))
+			goto fail;
+		memcpy(&cells, p, sizeof(cells));
+		p += sizeof(cells);
+		if (cells == 0 || cells > (uint32_t)n || (kind != FROZEN_CELLS && kind > cells))
+			goto fail;
+		if (kind == FROZEN_CELLS) {
+			l = cells * sizeof(struct mcell);
+			if ((size_t)(end - p) < l || (hl[i].cells = malloc(l)) == NULL)
+				goto fail;
+			memcpy(hl[i].cells, p, l);
+			hl[i].room = cells;
+		} else {
+			l = cells * sizeof(uint32_t) + kind * sizeof(struct mrun);
+			if ((size_t)(end - p) < l || (hl[i].image = malloc(l)) == NULL)
+				goto fail;
+			memcpy(hl[i].image, p, l);
+			hl[i].nruns = kind;
+			hl[i].room = l / sizeof(uint32_t);
+		}
+		hl[i].len = cells;
+		p += l;
+	}
+	free(buf);
+	return 0;
+fail:
+	free(buf);
+	for (i = 0; i < count; i++)
+		cell_free(hl + i);
+	return -1;
+}
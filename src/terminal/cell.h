@@ -0,0 +1,73 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#ifndef SCREEN_CELL_H
+#define SCREEN_CELL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image.h"
+
+/*
+ * Everything of a cell but its code point lives in a global table of
+ * distinct styles; style 0 is the default rendition. MCELL_FONTIMG marks
+ * cells whose font is simply image >> 8 (always the case for UTF-8), so
+ * those don't need a style of their own per character block.
+ */
+struct mstyle {
+	uint32_t attr;
+	uint32_t font;
+	uint32_t colorbg;
+	uint32_t colorfg;
+};
+
+#define MCELL_FONTIMG	0x80000000
+#define MCELL_STYLE(s)	((s) & ~MCELL_FONTIMG)
+
+/* arrays cell_unpack() had to fill with something else than zeros */
+#define CELL_ATTR	(1 << 0)
+#define CELL_FONT	(1 << 1)
+#define CELL_COLORBG	(1 << 2)
+#define CELL_COLORFG	(1 << 3)
+
+uint32_t cell_style(uint32_t, uint32_t, uint32_t, uint32_t);
+const struct mstyle *cell_getstyle(uint32_t);
+size_t cell_nstyles(void);
+size_t cell_styles_size(void);
+void cell_share_styles(bool);
+
+int  cell_pack(struct hline *, struct mline *, int, struct hlinehigh *);
+int  cell_unpack(struct mline *, const struct hline *, int);
+void cell_free(struct hline *);
+void cell_size(const struct hline *, size_t *, size_t *);
+void cell_share(struct hline *);
+size_t cell_shared_size(void);
+size_t cell_shared_saved(void);
+
+char *cell_freeze(struct hline *, int, int, size_t *);
+char *cell_freeze_copy(const struct hline *, int, int, size_t *);
+int   cell_thaw(struct hline *, int, int, const char *, size_t);
+size_t cell_frozen_max(int, int);
+
+#endif /* SCREEN_CELL_H */
@@ -0,0 +1,860 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include "config.h"
+
+#include "checkpoint.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "screen.h"
+
+#include "ansi.h"
+#include "fileio.h"
+#include "layer.h"
+#include "misc.h"
+#include "resize.h"
+#include "winmsg.h"
+
+_Static_assert(sizeof(struct ckpthdr) == 64, "screen-auto reads the strings after 64 bytes");
+
+char *checkpoint_name = NULL;	/* file name, with window escapes; NULL if off */
+int checkpoint_interval = CKPT_INTERVAL;
+int checkpoint_history = CKPT_HISTORY;
+int checkpoint_journal = 0;	/* seconds between journal writes; 0 if off */
+
+static Event ckptev;
+static Event ckptjev;
+
+struct ckptbuf {
+	char *data;
+	size_t len, size;
+	bool failed;
+};
+
+/* What the journal of a window already holds, on top of its checkpoint. */
+struct ckptstate {
+	char *name;		/* of the checkpoint, as expanded for the window */
+	int jfd;		/* the journal, -1 if there is none */
+	size_t jsize;		/* bytes in it */
+	size_t csize;		/* bytes in the checkpoint */
+	uint32_t sum;		/* of the checkpoint */
+	int width, height;	/* of the main screen */
+	bool alt;
+	int x, y;		/* cursor */
+	uint32_t titlesum;
+	uint32_t *rowsum;	/* of each row of the main screen */
+	time_t jtime;		/* when the journal was last written */
+	struct ckptbuf pending;	/* records not written yet */
+	bool full;		/* the next write has to be a full checkpoint */
+};
+
+static void ckpt_put(struct ckptbuf *b, const void *p, size_t n)
+{
+	if (b->failed)
+		return;
+	if (b->len + n > b->size) {
+		size_t size = b->size ? b->size : 64 * 1024;
+		char *data;
+
+		while (size < b->len + n)
+			size *= 2;
+		if ((data = realloc(b->data, size)) == NULL) {
+			b->failed = true;
+			return;
+		}
+		b->data = data;
+		b->size = size;
+	}
+	memcpy(b->data + b->len, p, n);
+	b->len += n;
+}
+
+static uint32_t ckpt_sum(const char *p, size_t n)
+{
+	uint32_t h = 2166136261u;
+
+	while (n--) {
+		h ^= (unsigned char)*p++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static bool ckpt_blank(struct mline *ml, int x)
+{
+	return ml->image[x] == ' ' && ml->attr[x] == 0 && ml->font[x] == 0
+	    && ml->colorbg[x] == 0 && ml->colorfg[x] == 0;
+}
+
+static void ckpt_putline(struct ckptbuf *b, struct mline *ml, int width)
+{
+	uint16_t n = width;
+	uint8_t flags = 0;
+
+	while (n > 0 && ckpt_blank(ml, n - 1))
+		n--;
+	for (int x = 0; x < n && !flags; x++)
+		if (ml->attr[x] || ml->font[x] || ml->colorbg[x] || ml->colorfg[x])
+			flags = CKPT_STYLED;
+	ckpt_put(b, &n, sizeof(n));
+	ckpt_put(b, &flags, sizeof(flags));
+	ckpt_put(b, ml->image, n * 4);
+	if (flags & CKPT_STYLED) {
+		ckpt_put(b, ml->attr, n * 4);
+		ckpt_put(b, ml->font, n * 4);
+		ckpt_put(b, ml->colorbg, n * 4);
+		ckpt_put(b, ml->colorfg, n * 4);
+	}
+}
+
+static uint32_t ckpt_rowsum(struct mline *ml, int width)
+{
+	uint32_t h = ckpt_sum((const char *)ml->image, width * 4);
+
+	h ^= ckpt_sum((const char *)ml->attr, width * 4);
+	h = h * 31 + ckpt_sum((const char *)ml->font, width * 4);
+	h = h * 31 + ckpt_sum((const char *)ml->colorbg, width * 4);
+	return h * 31 + ckpt_sum((const char *)ml->colorfg, width * 4);
+}
+
+/* A journal record is started with ckpt_begin(), its payload added with
+ * ckpt_put() and ckpt_putline(), and ckpt_end() fills in its frame. */
+static size_t ckpt_begin(struct ckptbuf *b, uint8_t type)
+{
+	size_t at = b->len;
+	uint32_t len = 0;
+
+	ckpt_put(b, &len, sizeof(len));
+	ckpt_put(b, &type, sizeof(type));
+	return at;
+}
+
+static void ckpt_end(struct ckptbuf *b, size_t at)
+{
+	uint32_t len, sum;
+
+	if (b->failed)
+		return;
+	len = b->len - at - sizeof(len) - 1;
+	memcpy(b->data + at, &len, sizeof(len));
+	sum = ckpt_sum(b->data + at + sizeof(len), len + 1);
+	ckpt_put(b, &sum, sizeof(sum));
+}
+
+/* Writes all of b to fd, synced. */
+static int ckpt_writefd(int fd, struct ckptbuf *b)
+{
+	for (size_t off = 0; off < b->len;) {
+		ssize_t n = write(fd, b->data + off, b->len - off);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		off += n;
+	}
+#ifdef HAVE_FDATASYNC
+	return fdatasync(fd);
+#else
+	return fsync(fd);
+#endif
+}
+
+/*
+ * Starts the journal of win over after its checkpoint h has been written
+ * to name: an empty journal that names h replaces the old one, and the
+ * state of the window is what h holds. Should that fail, there is no
+ * journal until the next checkpoint.
+ */
+static void ckpt_startjournal(Window *win, char *name, struct ckpthdr *h, struct mline *mlines)
+{
+	struct ckptstate *cs = win->w_ckpt;
+	struct ckptjnl jh = { CKPT_JMAGIC, CKPT_VERSION, h->sum, 0 };
+	char jname[MAXPATHLEN + 8], tmp[MAXPATHLEN + 12];
+	uint32_t *rowsum;
+
+	if (cs == NULL) {
+		if ((cs = calloc(1, sizeof(*cs))) == NULL)
+			return;
+		cs->jfd = -1;
+		win->w_ckpt = cs;
+	}
+	if (cs->jfd >= 0)
+		close(cs->jfd);
+	cs->jfd = -1;
+	cs->full = true;
+	cs->pending.len = 0;
+	cs->pending.failed = false;
+	free(cs->name);
+	if ((cs->name = strdup(name)) == NULL
+	    || (rowsum = realloc(cs->rowsum, (h->height ? h->height : 1) * sizeof(*rowsum))) == NULL)
+		return;
+	cs->rowsum = rowsum;
+	snprintf(jname, sizeof(jname), "%s.jnl", name);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", jname);
+	if ((cs->jfd = secopen(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600)) < 0)
+		return;
+	if (write(cs->jfd, &jh, sizeof(jh)) != sizeof(jh) || rename(tmp, jname)) {
+		close(cs->jfd);
+		cs->jfd = -1;
+		unlink(tmp);
+		return;
+	}
+	cs->jsize = sizeof(jh);
+	cs->csize = h->size;
+	cs->sum = h->sum;
+	cs->width = h->width;
+	cs->height = h->height;
+	cs->alt = win->w_alt.on;
+	cs->x = h->x;
+	cs->y = h->y;
+	cs->titlesum = ckpt_sum(win->w_title ? win->w_title : "", win->w_title ? strlen(win->w_title) : 0);
+	for (int y = 0; y < h->height; y++)
+		cs->rowsum[y] = ckpt_rowsum(&mlines[y], h->width);
+	cs->jtime = win->w_ckpttime;
+	cs->full = false;
+}
+
+/*
+ * Writes the checkpoint of win to the file checkpoint_name names for it.
+ * Returns 0, or -1 with errno set.
+ */
+int CheckpointWrite(Window *win)
+{
+	struct ckptbuf b = { 0 };
+	struct ckpthdr h = { 0 };
+	struct timeval tv;
+	struct mline *mlines = win->w_alt.on ? win->w_alt.mlines : win->w_mlines;
+	struct cursor *cur = &win->w_alt.cursor;
+	char name[MAXPATHLEN], tmp[MAXPATHLEN + 4], cwd[MAXPATHLEN];
+	int nhist, fd, ret;
+
+	if (!checkpoint_name || mlines == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	strncpy(name, MakeWinMsg(checkpoint_name, win, '%'), sizeof(name) - 1);
+	name[sizeof(name) - 1] = 0;
+	snprintf(tmp, sizeof(tmp), "%s.tmp", name);
+	SchedWalltime(&tv);
+
+	/* ImmorTerm: a history store holds the history, synced up to here */
+	HistStoreFlush(win, false);
+	nhist = win->w_hstore ? 0 : MainHistLines(win);
+	if (nhist > checkpoint_history)
+		nhist = checkpoint_history;
+	h.magic = CKPT_MAGIC;
+	h.version = CKPT_VERSION;
+	h.time = tv.tv_sec;
+	h.histlines = nhist;
+	if (win->w_alt.on) {
+		h.width = win->w_alt.width;
+		h.height = win->w_alt.height;
+		h.x = cur->x;
+		h.y = cur->y;
+		h.top = 0;
+		h.bot = h.height - 1;
+		h.attr = cur->Rend.attr;
+		h.font = cur->Rend.font;
+		h.colorbg = cur->Rend.colorbg;
+		h.colorfg = cur->Rend.colorfg;
+		h.modes |= CKPT_ALTSCREEN;
+	} else {
+		h.width = win->w_width;
+		h.height = win->w_height;
+		h.x = win->w_x;
+		h.y = win->w_y;
+		h.top = win->w_top;
+		h.bot = win->w_bot;
+		h.attr = win->w_rend.attr;
+		h.font = win->w_rend.font;
+		h.colorbg = win->w_rend.colorbg;
+		h.colorfg = win->w_rend.colorfg;
+	}
+	h.modes |= (win->w_wrap ? CKPT_WRAP : 0) | (win->w_origin ? CKPT_ORIGIN : 0)
+	    | (win->w_insert ? CKPT_INSERT : 0) | (win->w_keypad ? CKPT_KEYPAD : 0)
+	    | (win->w_cursorkeys ? CKPT_CURSORKEYS : 0) | (win->w_revvid ? CKPT_REVVID : 0)
+	    | (win->w_curinv ? CKPT_CURINV : 0) | (win->w_autolf ? CKPT_AUTOLF : 0)
+	    | (win->w_bracketed ? CKPT_BRACKETED : 0) | (win->w_extmouse ? CKPT_EXTMOUSE : 0);
+	h.mouse = win->w_mouse;
+	h.cursorstyle = win->w_cursorstyle;
+
+	WindowCwd(win, cwd, sizeof(cwd));
+	ckpt_put(&b, &h, sizeof(h));
+	ckpt_put(&b, cwd, strlen(cwd) + 1);
+	ckpt_put(&b, win->w_title ? win->w_title : "", strlen(win->w_title ? win->w_title : "") + 1);
+	for (int i = nhist; i > 0; i--)
+		ckpt_putline(&b, MainHistLine(win, i), h.width);
+	for (int y = 0; y < h.height; y++)
+		ckpt_putline(&b, &mlines[y], h.width);
+	if (b.failed || b.len > UINT32_MAX) {
+		free(b.data);
+		errno = ENOMEM;
+		return -1;
+	}
+	((struct ckpthdr *)b.data)->size = b.len;
+	((struct ckpthdr *)b.data)->sum = ckpt_sum(b.data + sizeof(h), b.len - sizeof(h));
+
+	if ((fd = secopen(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) {
+		free(b.data);
+		return -1;
+	}
+	ret = ckpt_writefd(fd, &b);
+	if (close(fd) || ret || rename(tmp, name)) {
+		int err = errno;
+
+		free(b.data);
+		unlink(tmp);
+		errno = err;
+		return -1;
+	}
+	win->w_ckpttime = tv.tv_sec;
+	if (checkpoint_journal)
+		ckpt_startjournal(win, name, (struct ckpthdr *)b.data, mlines);
+	free(b.data);
+	return 0;
+}
+
+/* Records a line scrolling into the main history of win for its journal.
+ * Once the window changed its width the journal cannot go on, the lines
+ * are no longer those of the checkpoint. */
+void CheckpointHistLine(Window *win, struct mline *ml)
+{
+	struct ckptstate *cs = win->w_ckpt;
+	size_t at;
+
+	if (cs->jfd < 0 || cs->full)
+		return;
+	if (win->w_width != cs->width) {
+		free(cs->pending.data);
+		memset(&cs->pending, 0, sizeof(cs->pending));
+		cs->full = true;
+		return;
+	}
+	at = ckpt_begin(&cs->pending, CKPT_JHIST);
+	ckpt_putline(&cs->pending, ml, cs->width);
+	ckpt_end(&cs->pending, at);
+	if (cs->pending.failed || cs->pending.len > CKPT_JPENDING) {
+		free(cs->pending.data);
+		memset(&cs->pending, 0, sizeof(cs->pending));
+		cs->full = true;
+	}
+}
+
+/*
+ * Appends what changed in win since the last time to its journal: the
+ * lines CheckpointHistLine() collected, the rows that differ from what
+ * the journal last had in them, the cursor and the title. Returns -1 if a
+ * full checkpoint has to be written instead.
+ */
+static int ckpt_journal(Window *win)
+{
+	struct ckptstate *cs = win->w_ckpt;
+	struct mline *mlines = win->w_alt.on ? win->w_alt.mlines : win->w_mlines;
+	int width = win->w_alt.on ? win->w_alt.width : win->w_width;
+	int height = win->w_alt.on ? win->w_alt.height : win->w_height;
+	int x = win->w_alt.on ? win->w_alt.cursor.x : win->w_x;
+	int y = win->w_alt.on ? win->w_alt.cursor.y : win->w_y;
+	const char *title = win->w_title ? win->w_title : "";
+	uint32_t titlesum = ckpt_sum(title, strlen(title));
+	struct timeval tv;
+	size_t at;
+
+	HistStoreFlush(win, false);
+	if (cs == NULL || cs->full || cs->jfd < 0 || width != cs->width || height != cs->height
+	    || win->w_alt.on != cs->alt || mlines == NULL
+	    || strcmp(cs->name, MakeWinMsg(checkpoint_name, win, '%')))
+		return -1;
+	for (int r = 0; r < height; r++) {
+		uint32_t sum = ckpt_rowsum(&mlines[r], width);
+		uint16_t row = r;
+
+		if (sum == cs->rowsum[r])
+			continue;
+		cs->rowsum[r] = sum;
+		at = ckpt_begin(&cs->pending, CKPT_JROW);
+		ckpt_put(&cs->pending, &row, sizeof(row));
+		ckpt_putline(&cs->pending, &mlines[r], width);
+		ckpt_end(&cs->pending, at);
+	}
+	if (x != cs->x || y != cs->y) {
+		uint16_t pos[2] = { x, y };
+
+		cs->x = x;
+		cs->y = y;
+		at = ckpt_begin(&cs->pending, CKPT_JCURSOR);
+		ckpt_put(&cs->pending, pos, sizeof(pos));
+		ckpt_end(&cs->pending, at);
+	}
+	if (titlesum != cs->titlesum) {
+		cs->titlesum = titlesum;
+		at = ckpt_begin(&cs->pending, CKPT_JTITLE);
+		ckpt_put(&cs->pending, title, strlen(title));
+		ckpt_end(&cs->pending, at);
+	}
+	if (cs->pending.failed) {
+		cs->full = true;
+		return -1;
+	}
+	SchedWalltime(&tv);
+	cs->jtime = tv.tv_sec;
+	if (cs->pending.len == 0)
+		return 0;
+	for (size_t off = 0; off < cs->pending.len;) {
+		ssize_t n = write(cs->jfd, cs->pending.data + off, cs->pending.len - off);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			/* whatever part of it made it in fails its sum */
+			cs->full = true;
+			return -1;
+		}
+		off += n;
+	}
+	cs->jsize += cs->pending.len;
+	cs->pending.len = 0;
+	/* compact it into a new checkpoint once it has outgrown the old one */
+	return cs->jsize > cs->csize ? -1 : 0;
+}
+
+/* bytes of memory the checkpoint state of win holds */
+size_t CheckpointSize(Window *win)
+{
+	struct ckptstate *cs = win->w_ckpt;
+
+	if (cs == NULL)
+		return 0;
+	return sizeof(*cs) + cs->height * sizeof(*cs->rowsum) + cs->pending.size;
+}
+
+void CheckpointFree(Window *win)
+{
+	struct ckptstate *cs = win->w_ckpt;
+
+	if (cs == NULL)
+		return;
+	if (cs->jfd >= 0)
+		close(cs->jfd);
+	free(cs->name);
+	free(cs->rowsum);
+	free(cs->pending.data);
+	free(cs);
+	win->w_ckpt = NULL;
+}
+
+static void ckpt_clearline(struct mline *ml, int width)
+{
+	for (int x = 0; x < width; x++)
+		ml->image[x] = ' ';
+	memset(ml->attr, 0, width * 4);
+	memset(ml->font, 0, width * 4);
+	memset(ml->colorbg, 0, width * 4);
+	memset(ml->colorfg, 0, width * 4);
+}
+
+/* Reads the next line of a checkpoint at *p into ml, width cells wide. */
+static void ckpt_getline(const char **p, struct mline *ml, int width)
+{
+	uint16_t n;
+	uint8_t flags;
+	int w;
+
+	memcpy(&n, *p, sizeof(n));
+	memcpy(&flags, *p + sizeof(n), sizeof(flags));
+	*p += sizeof(n) + sizeof(flags);
+	w = n < width ? n : width;
+	ckpt_clearline(ml, width);
+	memcpy(ml->image, *p, w * 4);
+	*p += n * 4;
+	if (flags & CKPT_STYLED) {
+		memcpy(ml->attr, *p, w * 4);
+		memcpy(ml->font, *p + n * 4, w * 4);
+		memcpy(ml->colorbg, *p + n * 8, w * 4);
+		memcpy(ml->colorfg, *p + n * 12, w * 4);
+		*p += n * 16;
+	}
+}
+
+/* Skips the string at p, NULL if it runs into end. */
+static const char *ckpt_string(const char *p, const char *end)
+{
+	const char *nul = memchr(p, 0, end - p);
+
+	return nul ? nul + 1 : NULL;
+}
+
+/* Skips the line of a checkpoint at p, NULL if it runs into end. */
+static const char *ckpt_checkline(const char *p, const char *end)
+{
+	uint16_t n;
+	uint8_t flags;
+
+	if (end - p < (ptrdiff_t)(sizeof(n) + sizeof(flags)))
+		return NULL;
+	memcpy(&n, p, sizeof(n));
+	memcpy(&flags, p + sizeof(n), sizeof(flags));
+	p += sizeof(n) + sizeof(flags);
+	if (end - p < (ptrdiff_t)n * ((flags & CKPT_STYLED) ? 20 : 4))
+		return NULL;
+	return p + n * ((flags & CKPT_STYLED) ? 20 : 4);
+}
+
+/* Checks that the lines of a checkpoint fill the rest of it exactly. */
+static bool ckpt_checklines(const struct ckpthdr *h, const char *p, const char *end)
+{
+	for (uint32_t i = 0; i < h->histlines + h->height && p; i++)
+		p = ckpt_checkline(p, end);
+	return p == end;
+}
+
+static bool ckpt_allocline(struct mline *ml, int width)
+{
+	ml->image = malloc(width * 4);
+	ml->attr = malloc(width * 4);
+	ml->font = malloc(width * 4);
+	ml->colorbg = malloc(width * 4);
+	ml->colorfg = malloc(width * 4);
+	return ml->image && ml->attr && ml->font && ml->colorbg && ml->colorfg;
+}
+
+static void ckpt_freeline(struct mline *ml)
+{
+	free(ml->image);
+	free(ml->attr);
+	free(ml->font);
+	free(ml->colorbg);
+	free(ml->colorfg);
+}
+
+/*
+ * Replays the journal that follows the checkpoint h in the file name: its
+ * history goes into the history of win, its rows over rows, its cursor
+ * line into *y and its title into title. A journal that belongs to another
+ * checkpoint is ignored, and replaying stops at the first record that is
+ * torn or does not fit.
+ */
+static void ckpt_replay(Window *win, const struct ckpthdr *h, char *name, struct mline *rows,
+			struct mline *ml, int *y, char *title, size_t tsize)
+{
+	const size_t frame = sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t);
+	char jname[MAXPATHLEN + 8];
+	struct stat st;
+	const struct ckptjnl *jh;
+	const char *base, *p, *end;
+	int fd;
+
+	snprintf(jname, sizeof(jname), "%s.jnl", name);
+	if ((fd = secopen(jname, O_RDONLY, 0)) < 0)
+		return;
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*jh)
+	    || (base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return;
+	}
+	close(fd);
+	jh = (const struct ckptjnl *)base;
+	end = base + st.st_size;
+	if (jh->magic != CKPT_JMAGIC || jh->version != CKPT_VERSION || jh->sum != h->sum)
+		goto done;
+	for (p = base + sizeof(*jh); (size_t)(end - p) >= frame;) {
+		uint32_t len, sum;
+		uint8_t type;
+		uint16_t pos[2];
+		const char *q, *qend;
+
+		memcpy(&len, p, sizeof(len));
+		if ((size_t)(end - p) - frame < len)
+			break;
+		memcpy(&type, p + sizeof(len), sizeof(type));
+		memcpy(&sum, p + sizeof(len) + sizeof(type) + len, sizeof(sum));
+		if (sum != ckpt_sum(p + sizeof(len), len + sizeof(type)))
+			break;
+		q = p + sizeof(len) + sizeof(type);
+		qend = q + len;
+		switch (type) {
+		case CKPT_JHIST:
+			if (ckpt_checkline(q, qend) != qend)
+				goto done;
+			ckpt_getline(&q, ml, win->w_width);
+			HistAppend(win, ml);
+			break;
+		case CKPT_JROW:
+			if (len < sizeof(pos[0]))
+				goto done;
+			memcpy(&pos[0], q, sizeof(pos[0]));
+			q += sizeof(pos[0]);
+			if (pos[0] >= h->height || ckpt_checkline(q, qend) != qend)
+				goto done;
+			ckpt_getline(&q, &rows[pos[0]], win->w_width);
+			break;
+		case CKPT_JCURSOR:
+			if (len != sizeof(pos))
+				goto done;
+			memcpy(pos, q, sizeof(pos));
+			if (pos[1] >= h->height)
+				goto done;
+			*y = pos[1];
+			break;
+		case CKPT_JTITLE:
+			if (len >= tsize)
+				len = tsize - 1;
+			memcpy(title, q, len);
+			title[len] = 0;
+			break;
+		default:
+			break;
+		}
+		p += frame + len;
+	}
+ done:
+	munmap((void *)base, st.st_size);
+}
+
+/*
+ * Puts what the checkpoint in the file name holds into win: its history
+ * goes into the history, its screen onto the screen and its title becomes
+ * the title. Whatever the process in win has written already (a new shell
+ * may have printed a prompt by then) stays below the restored screen, with
+ * the cursor; if there is nothing, the cursor goes to the start of the line
+ * below the one it was on. What its journal holds is replayed on top.
+ * The modes of a process that is gone are left alone.
+ * Returns 0, or -1 with errno set.
+ */
+int CheckpointRestore(Window *win, char *name)
+{
+	struct stat st;
+	const struct ckpthdr *h;
+	const char *base, *p, *end, *cwd, *t;
+	char title[MAXSTR];
+	struct mline ml, *rows = NULL, *saved = NULL;
+	int fd, cy, last, nrest, nsaved = 0, total, shift, width = win->w_width;
+	bool ok = false;
+
+	if ((fd = secopen(name, O_RDONLY, 0)) < 0)
+		return -1;
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*h)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return -1;
+	h = (const struct ckpthdr *)base;
+	end = base + st.st_size;
+	cwd = base + sizeof(*h);
+	if (h->magic == CKPT_MAGIC && h->version == CKPT_VERSION && h->size == st.st_size
+	    && h->sum == ckpt_sum(cwd, st.st_size - sizeof(*h)) && h->y < h->height
+	    && (t = ckpt_string(cwd, end)) != NULL && (p = ckpt_string(t, end)) != NULL)
+		ok = ckpt_checklines(h, p, end);
+	if (!ok || win->w_mlines == NULL) {
+		munmap((void *)base, st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+	strncpy(title, t, sizeof(title) - 1);
+	title[sizeof(title) - 1] = 0;
+
+	memset(&ml, 0, sizeof(ml));
+	ok = ckpt_allocline(&ml, width + 1) && (rows = calloc(h->height, sizeof(*rows))) != NULL;
+	for (int y = 0; ok && y < h->height; y++)
+		ok = ckpt_allocline(&rows[y], width + 1);
+	if (!ok) {
+		for (int y = 0; rows && y < h->height; y++)
+			ckpt_freeline(&rows[y]);
+		free(rows);
+		ckpt_freeline(&ml);
+		munmap((void *)base, st.st_size);
+		errno = ENOMEM;
+		return -1;
+	}
+	HistReflow(win);
+	for (uint32_t i = 0; i < h->histlines; i++) {
+		ckpt_getline(&p, &ml, width);
+		HistAppend(win, &ml);
+	}
+	for (int y = 0; y < h->height; y++)
+		ckpt_getline(&p, &rows[y], width);
+	cy = h->y;
+	ckpt_replay(win, h, name, rows, &ml, &cy, title, sizeof(title));
+	last = -1;
+	for (int y = 0; y < h->height; y++)
+		for (int x = 0; x < width && last < y; x++)
+			if (!ckpt_blank(&rows[y], x))
+				last = y;
+
+	/* keep the lines written so far, up to the cursor, unless all blank */
+	for (int y = 0; y <= win->w_y && !nsaved; y++)
+		for (int x = 0; x < width; x++)
+			if (!cmp_mchar_mline(&mchar_blank, &win->w_mlines[y], x)) {
+				nsaved = win->w_y + 1;
+				break;
+			}
+	if (nsaved && (saved = calloc(nsaved, sizeof(*saved))) != NULL)
+		for (int y = 0; y < nsaved; y++) {
+			if (!ckpt_allocline(&saved[y], width + 1)) {
+				while (y >= 0)
+					ckpt_freeline(&saved[y--]);
+				nsaved = 0;
+				break;
+			}
+			memcpy(saved[y].image, win->w_mlines[y].image, width * 4);
+			memcpy(saved[y].attr, win->w_mlines[y].attr, width * 4);
+			memcpy(saved[y].font, win->w_mlines[y].font, width * 4);
+			memcpy(saved[y].colorbg, win->w_mlines[y].colorbg, width * 4);
+			memcpy(saved[y].colorfg, win->w_mlines[y].colorfg, width * 4);
+		}
+	else
+		nsaved = 0;
+
+	/* the restored screen down to its cursor, or its last line if that is
+	 * all there is going to be; then what was kept, or else a blank line
+	 * for the cursor */
+	nrest = cy + 1;
+	if (!nsaved && last >= nrest)
+		nrest = last + 1;
+	total = nrest + nsaved;
+	if (!nsaved && total < cy + 2)
+		total = cy + 2;
+	shift = total > win->w_height ? total - win->w_height : 0;
+	ckpt_clearline(&ml, width);
+	for (int k = 0; k < total; k++) {
+		struct mline *l = &ml;
+
+		if (k < nrest)
+			l = &rows[k];
+		else if (nsaved)
+			l = &saved[k - nrest];
+		if (k < shift)
+			HistAppend(win, l);
+		else
+			WSetLine(win, k - shift, l);
+	}
+	for (int y = total - shift; y < win->w_height; y++)
+		WSetLine(win, y, &ml);
+	if (nsaved)
+		win->w_y = nrest + win->w_y - shift;
+	else {
+		win->w_y = cy + 1 - shift;
+		win->w_x = 0;
+	}
+
+	if (*title)
+		ChangeAKA(win, title, strlen(title));
+	for (int y = 0; y < nsaved; y++)
+		ckpt_freeline(&saved[y]);
+	free(saved);
+	for (int y = 0; y < h->height; y++)
+		ckpt_freeline(&rows[y]);
+	free(rows);
+	ckpt_freeline(&ml);
+	munmap((void *)base, st.st_size);
+	LRefreshAll(&win->w_layer, 0);
+	return 0;
+}
+
+static void ckpt_fn(Event *ev, void *data)
+{
+	(void)data;
+
+	for (Window *win = mru_window; win; win = win->w_prev_mru) {
+		struct ckptstate *cs = win->w_ckpt;
+
+		if (win->w_type == W_TYPE_GROUP || win->w_last_activity < win->w_ckpttime)
+			continue;
+		/* with a journal, only compact it */
+		if (checkpoint_journal && cs && !cs->full && cs->jfd >= 0
+		    && cs->jsize <= sizeof(struct ckptjnl))
+			continue;
+		if (CheckpointWrite(win)) {
+			WMsg(win, errno, "checkpoint");
+			win->w_ckpttime = win->w_last_activity + 1;	/* until there is more */
+		}
+	}
+	SetTimeout(ev, checkpoint_interval * 1000);
+	evenq(ev);
+}
+
+static void ckpt_jfn(Event *ev, void *data)
+{
+	(void)data;
+
+	for (Window *win = mru_window; win; win = win->w_prev_mru) {
+		struct ckptstate *cs = win->w_ckpt;
+
+		if (win->w_type == W_TYPE_GROUP
+		    || win->w_last_activity < (cs ? cs->jtime : win->w_ckpttime))
+			continue;
+		if (ckpt_journal(win) == 0)
+			continue;
+		if (CheckpointWrite(win)) {
+			WMsg(win, errno, "checkpoint");
+			win->w_ckpttime = win->w_last_activity + 1;
+			if (win->w_ckpt)
+				win->w_ckpt->jtime = win->w_ckpttime;
+		}
+	}
+	SetTimeout(ev, checkpoint_journal * 1000);
+	evenq(ev);
+}
+
+/* (Re)starts writing checkpoints every checkpoint_interval seconds and
+ * journals every checkpoint_journal seconds, or stops it when
+ * checkpoint_name is NULL. */
+void CheckpointStart(void)
+{
+	evdeq(&ckptev);
+	evdeq(&ckptjev);
+	if (!checkpoint_name || checkpoint_journal <= 0)
+		for (Window *win = mru_window; win; win = win->w_prev_mru)
+			CheckpointFree(win);
+	if (!checkpoint_name)
+		return;
+	if (checkpoint_interval > 0) {
+		ckptev.type = EV_TIMEOUT;
+		ckptev.handler = ckpt_fn;
+		ckptev.name = "ckpt_fn";
+		SetTimeout(&ckptev, checkpoint_interval * 1000);
+		evenq(&ckptev);
+	}
+	if (checkpoint_journal > 0) {
+		ckptjev.type = EV_TIMEOUT;
+		ckptjev.handler = ckpt_jfn;
+		ckptjev.name = "ckpt_jfn";
+		SetTimeout(&ckptjev, checkpoint_journal * 1000);
+		evenq(&ckptjev);
+	}
+}
@@ -0,0 +1,126 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#ifndef SCREEN_CHECKPOINT_H
+#define SCREEN_CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "window.h"
+
+/*
+ * A checkpoint holds what a window looked like, so that a new window can
+ * take it over after the screen process itself is gone. It is a struct
+ * ckpthdr, the working directory and the title as NUL terminated strings,
+ * then the last histlines lines of the history, oldest first, followed by
+ * the height lines of the screen. The alternate screen is left out: its
+ * program is gone with the process, so the checkpoint holds the main
+ * screen beneath it. A window with a history store (see histstore.h)
+ * leaves the history to it, synced whenever a checkpoint or journal is
+ * written, and has no history lines here or in the journal.
+ *
+ * A line is a uint16_t count of cells, trailing blanks cut off, and a
+ * uint8_t that is CKPT_STYLED if any cell has attributes, a font or
+ * colors. Then come the code points, and for a styled line the attr,
+ * font, colorbg and colorfg of the cells, each a uint32_t array.
+ *
+ * Numbers are in host byte order; a checkpoint is read on the machine that
+ * wrote it. It is written under a temporary name, synced and renamed over
+ * the old one, so that a crash leaves either the old or the new one.
+ */
+#define CKPT_MAGIC	0x54504b43	/* "CKPT" */
+#define CKPT_VERSION	1
+#define CKPT_STYLED	1
+
+/*
+ * With checkpoint journal on, what changes in between goes to <file>.jnl
+ * every few seconds: a struct ckptjnl naming the checkpoint it follows by
+ * its sum, then records of a uint32_t payload length, a uint8_t type, the
+ * payload and a uint32_t FNV-1a of type and payload. The journal is not
+ * synced; a torn tail fails its sum and is ignored from there on. Once it
+ * has grown past the checkpoint, the next tick writes a full checkpoint
+ * and starts a new journal.
+ */
+#define CKPT_JMAGIC	0x4c4e4a43	/* "CJNL" */
+
+#define CKPT_JHIST	1	/* a line that scrolled into the history */
+#define CKPT_JROW	2	/* uint16_t row, then the line now in it */
+#define CKPT_JCURSOR	3	/* uint16_t x, y */
+#define CKPT_JTITLE	4	/* the title, without a NUL */
+
+/* Most history a window collects between two journal writes; past it the
+ * lines are dropped and a full checkpoint is written instead. */
+#define CKPT_JPENDING	(1024 * 1024)
+
+/* defaults of checkpoint interval and checkpoint history */
+#define CKPT_INTERVAL	30	/* seconds */
+#define CKPT_HISTORY	1000	/* lines */
+
+/* ckpthdr.modes */
+#define CKPT_WRAP	(1 << 0)
+#define CKPT_ORIGIN	(1 << 1)
+#define CKPT_INSERT	(1 << 2)
+#define CKPT_KEYPAD	(1 << 3)
+#define CKPT_CURSORKEYS	(1 << 4)
+#define CKPT_REVVID	(1 << 5)
+#define CKPT_CURINV	(1 << 6)
+#define CKPT_AUTOLF	(1 << 7)
+#define CKPT_BRACKETED	(1 << 8)
+#define CKPT_EXTMOUSE	(1 << 9)
+#define CKPT_ALTSCREEN	(1 << 10)	/* was in the alternate screen */
+
+struct ckpthdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;		/* of the whole file */
+	uint32_t sum;		/* FNV-1a of everything after the header */
+	uint64_t time;		/* when it was written */
+	uint16_t width, height;
+	uint16_t x, y;		/* cursor */
+	uint32_t histlines;
+	uint32_t modes;
+	uint16_t top, bot;	/* scroll region */
+	uint32_t attr, font, colorbg, colorfg;	/* current rendition */
+	uint16_t mouse;
+	uint16_t cursorstyle;
+};
+
+struct ckptjnl {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t sum;		/* of the checkpoint */
+	uint32_t reserved;
+};
+
+extern char *checkpoint_name;
+extern int checkpoint_interval;
+extern int checkpoint_history;
+extern int checkpoint_journal;
+
+void CheckpointStart (void);
+int  CheckpointWrite (Window *);
+int  CheckpointRestore (Window *, char *);
+void CheckpointHistLine (Window *, struct mline *);
+void CheckpointFree (Window *);
+size_t CheckpointSize (Window *);
+
+#endif /* SCREEN_CHECKPOINT_H */
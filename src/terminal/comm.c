@@ -66,14 +66,17 @@ struct comm comms[RC_LAST + 1] =
   { "chacl",		ARGS_23,			{NULL} },
   { "charset",          NEED_FORE|ARGS_1,		{NULL} },
   { "chdir",		ARGS_01,			{NULL} },
+  { "checkpoint",	ARGS_12,			{NULL} },  /* ImmorTerm: write window checkpoints */
   { "cjkwidth",		ARGS_01,			{NULL} },
   { "clear",		NEED_FORE|ARGS_0,		{NULL} },
+  { "clipboard",	ARGS_01,			{NULL} },  /* ImmorTerm: copy into the terminal's clipboard (OSC 52) */
   { "collapse",		ARGS_0,				{NULL} },
   { "colon",		NEED_LAYER|ARGS_01,		{NULL} },
   { "command",		NEED_DISPLAY|ARGS_02,		{NULL} },
   { "compacthist",	ARGS_01,			{NULL} },
   { "console",		NEED_FORE|ARGS_01,		{NULL} },
   { "copy",		NEED_FORE|NEED_DISPLAY|ARGS_0,	{NULL} },
+  { "copystream",	ARGS_1,				{NULL} },  /* ImmorTerm: write big selections straight to the exchange file */
   { "crlf",		ARGS_01,			{NULL} },
   { "defautonuke",	ARGS_1,				{NULL} },
   { "defbce",		ARGS_1,				{NULL} },
@@ -97,6 +100,7 @@ struct comm comms[RC_LAST + 1] =
   { "defnonblock",	ARGS_1,				{NULL} },
   { "defobuflimit",	ARGS_1,				{NULL} },
   { "defscrollback",	ARGS_1,				{NULL} },
+  { "defsearchindex",	ARGS_1,				{NULL} },  /* ImmorTerm: index new windows for search */
   { "defshell",		ARGS_1,				{NULL} },
   { "defsilence",	ARGS_1,				{NULL} },
   { "defslowpaste",	ARGS_1,				{NULL} },
@@ -114,11 +118,14 @@ struct comm comms[RC_LAST + 1] =
   { "escape",		ARGS_1,				{NULL} },
   { "eval",		ARGS_1|ARGS_ORMORE,		{NULL} },
   { "exec",		ARGS_0|ARGS_ORMORE,		{NULL} },
+  { "export",		NEED_FORE|ARGS_0|ARGS_ORMORE,	{NULL} },	/* ImmorTerm: write out the history */
+  { "fastforward",	ARGS_01,			{NULL} },  /* ImmorTerm: keep reading when a display falls behind */
   { "fit",		NEED_DISPLAY|ARGS_0,		{NULL} },
   { "flow",		NEED_FORE|ARGS_01,		{NULL} },
   { "focus",		NEED_DISPLAY|ARGS_01,		{NULL} },
   { "focusminsize",	ARGS_02,			{NULL} },
   { "gr",		NEED_FORE|ARGS_01,		{NULL} },
+  { "grep",		CAN_QUERY|ARGS_1|ARGS_ORMORE,	{NULL} },  /* ImmorTerm: search the history of all windows */
   { "group",            NEED_FORE|ARGS_01,		{NULL} },
   { "hardcopy",		NEED_FORE|ARGS_012,		{NULL} },
   { "hardcopy_append",	ARGS_1,				{NULL} },
@@ -126,11 +133,13 @@ struct comm comms[RC_LAST + 1] =
   { "hardstatus",	ARGS_012,			{NULL} },
   { "height",		ARGS_0123,			{NULL} },
   { "help",		NEED_LAYER|ARGS_02,		{NULL} },
+  { "hibernate",	ARGS_01,			{NULL} },  /* ImmorTerm: compact idle windows */
   { "history",		NEED_DISPLAY|NEED_FORE|ARGS_0,	{NULL} },
   { "hstatus",		NEED_FORE|ARGS_1,		{NULL} },
   { "idle",		ARGS_0|ARGS_ORMORE,		{NULL} },
   { "ignorecase",	ARGS_01,			{NULL} },
   { "info",		CAN_QUERY|NEED_LAYER|ARGS_0,	{NULL} },
+  { "iostats",		NEED_DISPLAY|ARGS_0,		{NULL} },  /* ImmorTerm: display output counters */
   { "kanji",		NEED_FORE|ARGS_12,		{NULL} },
   { "kill",		NEED_FORE|ARGS_01,		{NULL} },
   { "lastmsg",		CAN_QUERY|NEED_DISPLAY|ARGS_0,	{NULL} },
@@ -138,7 +147,7 @@ struct comm comms[RC_LAST + 1] =
   { "license",		NEED_LAYER|ARGS_0,		{NULL} },
   { "lockscreen",	NEED_DISPLAY|ARGS_0,		{NULL} },
   { "log",		NEED_FORE|ARGS_01,		{NULL} },
-  { "logfile",		ARGS_012,			{NULL} },
+  { "logfile",		ARGS_0123,			{NULL} },
 #if defined(ENABLE_UTMP)
   { "login",		NEED_FORE|ARGS_01,		{NULL} },
 #endif
@@ -147,6 +156,7 @@ struct comm comms[RC_LAST + 1] =
   { "mapnotnext",	NEED_DISPLAY|ARGS_0,		{NULL} },
   { "maptimeout",	ARGS_01,			{NULL} },
   { "markkeys",		ARGS_1,				{NULL} },
+  { "meminfo",		CAN_QUERY|ARGS_0,		{NULL} },  /* ImmorTerm: memory by window */
   { "meta",		NEED_LAYER|ARGS_0,		{NULL} },
   { "monitor",		NEED_FORE|ARGS_01,		{NULL} },
   { "mousetrack",	NEED_DISPLAY | ARGS_01,		{NULL} },
@@ -162,6 +172,7 @@ struct comm comms[RC_LAST + 1] =
   { "other",		ARGS_0,				{NULL} },
   { "parent",		ARGS_0,				{NULL} },
   { "partial",		NEED_FORE|ARGS_01,		{NULL} },
+  { "passthrough",	ARGS_01,			{NULL} },  /* ImmorTerm: send a window's output as it is */
   { "paste",		NEED_LAYER|ARGS_012,		{NULL} },
   { "pastefont",	ARGS_01,			{NULL} },
   { "pow_break",	NEED_FORE|ARGS_01,		{NULL} },
@@ -171,20 +182,31 @@ struct comm comms[RC_LAST + 1] =
   { "printcmd",		ARGS_01,			{NULL} },
   { "process",		NEED_DISPLAY|ARGS_01,		{NULL} },
   { "quit",		ARGS_01,			{NULL} },
+  { "rccache",		ARGS_1,				{NULL} },	/* ImmorTerm: keep the rc file parsed */
   { "readbuf",		ARGS_0123,			{NULL} },
   { "readreg",          ARGS_0|ARGS_ORMORE,		{NULL} },
   { "redisplay",	NEED_DISPLAY|ARGS_0,		{NULL} },
   { "register",		ARGS_24,			{NULL} },
   { "remove",		NEED_DISPLAY|ARGS_0,		{NULL} },
   { "removebuf",	ARGS_0,				{NULL} },
+  { "render_fps",	ARGS_01,			{NULL} },  /* ImmorTerm: coalesce busy window output into frames */
   { "rendition",	ARGS_2,				{NULL} },
   { "reset",		NEED_FORE|ARGS_0,		{NULL} },
   { "resize",		NEED_DISPLAY|ARGS_0|ARGS_ORMORE,{NULL} },
+  { "schedstats",	CAN_QUERY|ARGS_01,		{NULL} },  /* ImmorTerm: event handler costs */
   { "screen",		ARGS_0|ARGS_ORMORE,		{NULL} },
   { "scrollback",	NEED_FORE|ARGS_1,		{NULL} },
+  { "scrollback_budget",	ARGS_012,			{NULL} },  /* ImmorTerm: cap the history of all windows */
+  { "scrollback_compress",	ARGS_1,			{NULL} },  /* ImmorTerm: compress cold scrollback */
+  { "scrollback_dedup",	ARGS_01,			{NULL} },  /* ImmorTerm: keep identical history lines once */
+  { "scrollback_dir",	ARGS_01,			{NULL} },  /* ImmorTerm: keep compressed scrollback in files */
   { "scrollback_dump",	ARGS_1,				{NULL} },  /* ImmorTerm: dump scrollback on reattach */
+  { "scrollback_settle",	ARGS_01,			{NULL} },  /* ImmorTerm: keep only the settled frame of redraws */
+  { "searchindex",	NEED_FORE|ARGS_01,		{NULL} },  /* ImmorTerm: index the history for search */
+  { "searchregex",	ARGS_01,			{NULL} },  /* ImmorTerm: search with regular expressions */
   { "select",		CAN_QUERY|ARGS_01,		{NULL} },
   { "sessionname",	ARGS_01,			{NULL} },
+  { "sessionstate",	CAN_QUERY|ARGS_0,		{NULL} },  /* ImmorTerm: all windows in one query */
   { "setenv",		ARGS_012,			{NULL} },
   { "setsid",		ARGS_1,				{NULL} },
   { "shell",		ARGS_1,				{NULL} },
@@ -198,10 +220,13 @@ struct comm comms[RC_LAST + 1] =
   { "source",		ARGS_1,				{NULL} },
   { "split",		NEED_DISPLAY|ARGS_01,		{NULL} },
   { "startup_message",	ARGS_1,				{NULL} },
+  { "stats",		CAN_QUERY|ARGS_0,		{NULL} },  /* ImmorTerm: i/o counters */
   { "status",		ARGS_12,			{NULL} },
+  { "stringlimit",	ARGS_01,			{NULL} },  /* ImmorTerm: longest control string kept */
   { "stuff",		NEED_LAYER|ARGS_012,		{NULL} },
   { "su",		NEED_DISPLAY|ARGS_012,		{NULL} },
   { "suspend",		NEED_DISPLAY|ARGS_0,		{NULL} },
+  { "syncoutput",	ARGS_01,			{NULL} },  /* ImmorTerm: send redraws as synchronized updates */
   { "term",		ARGS_1,				{NULL} },
   { "termcap",		ARGS_23,			{NULL} },
   { "termcapinfo",	ARGS_23,			{NULL} },
@@ -92,162 +92,187 @@ struct action
 #define RC_CHACL 28
 #define RC_CHARSET 29
 #define RC_CHDIR 30
-#define RC_CJKWIDTH 31
-#define RC_CLEAR 32
-#define RC_COLLAPSE 33
-#define RC_COLON 34
-#define RC_COMMAND 35
-#define RC_COMPACTHIST 36
-#define RC_CONSOLE 37
-#define RC_COPY 38
-#define RC_CRLF 39
-#define RC_DEFAUTONUKE 40
-#define RC_DEFBCE 41
-#define RC_DEFBREAKTYPE 42
-#define RC_DEFC1 43
-#define RC_DEFCHARSET 44
-#define RC_DEFDYNAMICTITLE 45
-#define RC_DEFENCODING 46
-#define RC_DEFESCAPE 47
-#define RC_DEFFLOW 48
-#define RC_DEFGR 49
-#define RC_DEFHSTATUS 50
-#define RC_DEFKANJI 51
-#define RC_DEFLOG 52
-#define RC_DEFMODE 53
-#define RC_DEFMONITOR 54
-#define RC_DEFMOUSETRACK 55
-#define RC_DEFNONBLOCK 56
-#define RC_DEFOBUFLIMIT 57
-#define RC_DEFSCROLLBACK 58
-#define RC_DEFSHELL 59
-#define RC_DEFSILENCE 60
-#define RC_DEFSLOWPASTE 61
-#define RC_DEFUTF8 62
-#define RC_DEFWRAP 63
-#define RC_DEFWRITELOCK 64
-#define RC_DETACH 65
-#define RC_DIGRAPH 66
-#define RC_DINFO 67
-#define RC_DISPLAYS 68
-#define RC_DUMPTERMCAP 69
-#define RC_DYNAMICTITLE 70
-#define RC_ECHO 71
-#define RC_ENCODING 72
-#define RC_ESCAPE 73
-#define RC_EVAL 74
-#define RC_EXEC 75
-#define RC_FIT 76
-#define RC_FLOW 77
-#define RC_FOCUS 78
-#define RC_FOCUSMINSIZE 79
-#define RC_GR 80
-#define RC_GROUP 81
-#define RC_HARDCOPY 82
-#define RC_HARDCOPY_APPEND 83
-#define RC_HARDCOPYDIR 84
-#define RC_HARDSTATUS 85
-#define RC_HEIGHT 86
-#define RC_HELP 87
-#define RC_HISTORY 88
-#define RC_HSTATUS 89
-#define RC_IDLE 90
-#define RC_IGNORECASE 91
-#define RC_INFO 92
-#define RC_KANJI 93
-#define RC_KILL 94
-#define RC_LASTMSG 95
-#define RC_LAYOUT 96
-#define RC_LICENSE 97
-#define RC_LOCKSCREEN 98
-#define RC_LOG 99
-#define RC_LOGFILE 100
-#define RC_LOGTSTAMP 101
-#define RC_MAPDEFAULT 102
-#define RC_MAPNOTNEXT 103
-#define RC_MAPTIMEOUT 104
-#define RC_MARKKEYS 105
-#define RC_META 106
-#define RC_MONITOR 107
-#define RC_MOUSETRACK 108
-#define RC_MSGMINWAIT 109
-#define RC_MSGWAIT 110
-#define RC_MULTIINPUT 111
-#define RC_MULTIUSER 112
-#define RC_NEXT 113
-#define RC_NONBLOCK 114
-#define RC_NUMBER 115
-#define RC_OBUFLIMIT 116
-#define RC_ONLY 117
-#define RC_OTHER 118
-#define RC_PARENT 119
-#define RC_PARTIAL 120
-#define RC_PASTE 121
-#define RC_PASTEFONT 122
-#define RC_POW_BREAK 123
-#define RC_POW_DETACH 124
-#define RC_POW_DETACH_MSG 125
-#define RC_PREV 126
-#define RC_PRINTCMD 127
-#define RC_PROCESS 128
-#define RC_QUIT 129
-#define RC_READBUF 130
-#define RC_READREG 131
-#define RC_REDISPLAY 132
-#define RC_REGISTER 133
-#define RC_REMOVE 134
-#define RC_REMOVEBUF 135
-#define RC_RENDITION 136
-#define RC_RESET 137
-#define RC_RESIZE 138
-#define RC_SCREEN 139
-#define RC_SCROLLBACK 140
-#define RC_SCROLLBACK_DUMP 141
-#define RC_SELECT 142
-#define RC_SESSIONNAME 143
-#define RC_SETENV 144
-#define RC_SETSID 145
-#define RC_SHELL 146
-#define RC_SHELLTITLE 147
-#define RC_SILENCE 148
-#define RC_SILENCEWAIT 149
-#define RC_SLEEP 150
-#define RC_SLOWPASTE 151
-#define RC_SORENDITION 152
-#define RC_SORT 153
-#define RC_SOURCE 154
-#define RC_SPLIT 155
-#define RC_STARTUP_MESSAGE 156
-#define RC_STATUS 157
-#define RC_STUFF 158
-#define RC_SU 159
-#define RC_SUSPEND 160
-#define RC_TERM 161
-#define RC_TERMCAP 162
-#define RC_TERMCAPINFO 163
-#define RC_TERMINFO 164
-#define RC_TITLE 165
-#define RC_TRUECOLOR 166
-#define RC_UMASK 167
-#define RC_UNBINDALL 168
-#define RC_UNSETENV 169
-#define RC_UTF8 170
-#define RC_VBELL 171
-#define RC_VBELL_MSG 172
-#define RC_VBELLWAIT 173
-#define RC_VERBOSE 174
-#define RC_VERSION 175
-#define RC_WALL 176
-#define RC_WIDTH 177
-#define RC_WINDOWLIST 178
-#define RC_WINDOWS 179
-#define RC_WRAP 180
-#define RC_WRITEBUF 181
-#define RC_WRITELOCK 182
-#define RC_XOFF 183
-#define RC_XON 184
-#define RC_ZMODEM 185
-#define RC_ZOMBIE 186
-#define RC_ZOMBIE_TIMEOUT 187
+#define RC_CHECKPOINT 31
+#define RC_CJKWIDTH 32
+#define RC_CLEAR 33
+#define RC_CLIPBOARD 34
+#define RC_COLLAPSE 35
+#define RC_COLON 36
+#define RC_COMMAND 37
+#define RC_COMPACTHIST 38
+#define RC_CONSOLE 39
+#define RC_COPY 40
+#define RC_COPYSTREAM 41
+#define RC_CRLF 42
+#define RC_DEFAUTONUKE 43
+#define RC_DEFBCE 44
+#define RC_DEFBREAKTYPE 45
+#define RC_DEFC1 46
+#define RC_DEFCHARSET 47
+#define RC_DEFDYNAMICTITLE 48
+#define RC_DEFENCODING 49
+#define RC_DEFESCAPE 50
+#define RC_DEFFLOW 51
+#define RC_DEFGR 52
+#define RC_DEFHSTATUS 53
+#define RC_DEFKANJI 54
+#define RC_DEFLOG 55
+#define RC_DEFMODE 56
+#define RC_DEFMONITOR 57
+#define RC_DEFMOUSETRACK 58
+#define RC_DEFNONBLOCK 59
+#define RC_DEFOBUFLIMIT 60
+#define RC_DEFSCROLLBACK 61
+#define RC_DEFSEARCHINDEX 62
+#define RC_DEFSHELL 63
+#define RC_DEFSILENCE 64
+#define RC_DEFSLOWPASTE 65
+#define RC_DEFUTF8 66
+#define RC_DEFWRAP 67
+#define RC_DEFWRITELOCK 68
+#define RC_DETACH 69
+#define RC_DIGRAPH 70
+#define RC_DINFO 71
+#define RC_DISPLAYS 72
+#define RC_DUMPTERMCAP 73
+#define RC_DYNAMICTITLE 74
+#define RC_ECHO 75
+#define RC_ENCODING 76
+#define RC_ESCAPE 77
+#define RC_EVAL 78
+#define RC_EXEC 79
+#define RC_EXPORT 80
+#define RC_FASTFORWARD 81
+#define RC_FIT 82
+#define RC_FLOW 83
+#define RC_FOCUS 84
+#define RC_FOCUSMINSIZE 85
+#define RC_GR 86
+#define RC_GREP 87
+#define RC_GROUP 88
+#define RC_HARDCOPY 89
+#define RC_HARDCOPY_APPEND 90
+#define RC_HARDCOPYDIR 91
+#define RC_HARDSTATUS 92
+#define RC_HEIGHT 93
+#define RC_HELP 94
+#define RC_HIBERNATE 95
+#define RC_HISTORY 96
+#define RC_HSTATUS 97
+#define RC_IDLE 98
+#define RC_IGNORECASE 99
+#define RC_INFO 100
+#define RC_IOSTATS 101
+#define RC_KANJI 102
+#define RC_KILL 103
+#define RC_LASTMSG 104
+#define RC_LAYOUT 105
+#define RC_LICENSE 106
+#define RC_LOCKSCREEN 107
+#define RC_LOG 108
+#define RC_LOGFILE 109
+#define RC_LOGTSTAMP 110
+#define RC_MAPDEFAULT 111
+#define RC_MAPNOTNEXT 112
+#define RC_MAPTIMEOUT 113
+#define RC_MARKKEYS 114
+#define RC_MEMINFO 115
+#define RC_META 116
+#define RC_MONITOR 117
+#define RC_MOUSETRACK 118
+#define RC_MSGMINWAIT 119
+#define RC_MSGWAIT 120
+#define RC_MULTIINPUT 121
+#define RC_MULTIUSER 122
+#define RC_NEXT 123
+#define RC_NONBLOCK 124
+#define RC_NUMBER 125
+#define RC_OBUFLIMIT 126
+#define RC_ONLY 127
+#define RC_OTHER 128
+#define RC_PARENT 129
+#define RC_PARTIAL 130
+#define RC_PASSTHROUGH 131
+#define RC_PASTE 132
+#define RC_PASTEFONT 133
+#define RC_POW_BREAK 134
+#define RC_POW_DETACH 135
+#define RC_POW_DETACH_MSG 136
+#define RC_PREV 137
+#define RC_PRINTCMD 138
+#define RC_PROCESS 139
+#define RC_QUIT 140
+#define RC_RCCACHE 141
+#define RC_READBUF 142
+#define RC_READREG 143
+#define RC_REDISPLAY 144
+#define RC_REGISTER 145
+#define RC_REMOVE 146
+#define RC_REMOVEBUF 147
+#define RC_RENDER_FPS 148
+#define RC_RENDITION 149
+#define RC_RESET 150
+#define RC_RESIZE 151
+#define RC_SCHEDSTATS 152
+#define RC_SCREEN 153
+#define RC_SCROLLBACK 154
+#define RC_SCROLLBACK_BUDGET 155
+#define RC_SCROLLBACK_COMPRESS 156
+#define RC_SCROLLBACK_DEDUP 157
+#define RC_SCROLLBACK_DIR 158
+#define RC_SCROLLBACK_DUMP 159
+#define RC_SCROLLBACK_SETTLE 160
+#define RC_SEARCHINDEX 161
+#define RC_SEARCHREGEX 162
+#define RC_SELECT 163
+#define RC_SESSIONNAME 164
+#define RC_SESSIONSTATE 165
+#define RC_SETENV 166
+#define RC_SETSID 167
+#define RC_SHELL 168
+#define RC_SHELLTITLE 169
+#define RC_SILENCE 170
+#define RC_SILENCEWAIT 171
+#define RC_SLEEP 172
+#define RC_SLOWPASTE 173
+#define RC_SORENDITION 174
+#define RC_SORT 175
+#define RC_SOURCE 176
+#define RC_SPLIT 177
+#define RC_STARTUP_MESSAGE 178
+#define RC_STATS 179
+#define RC_STATUS 180
+#define RC_STRINGLIMIT 181
+#define RC_STUFF 182
+#define RC_SU 183
+#define RC_SUSPEND 184
+#define RC_SYNCOUTPUT 185
+#define RC_TERM 186
+#define RC_TERMCAP 187
+#define RC_TERMCAPINFO 188
+#define RC_TERMINFO 189
+#define RC_TITLE 190
+#define RC_TRUECOLOR 191
+#define RC_UMASK 192
+#define RC_UNBINDALL 193
+#define RC_UNSETENV 194
+#define RC_UTF8 195
+#define RC_VBELL 196
+#define RC_VBELL_MSG 197
+#define RC_VBELLWAIT 198
+#define RC_VERBOSE 199
+#define RC_VERSION 200
+#define RC_WALL 201
+#define RC_WIDTH 202
+#define RC_WINDOWLIST 203
+#define RC_WINDOWS 204
+#define RC_WRAP 205
+#define RC_WRITEBUF 206
+#define RC_WRITELOCK 207
+#define RC_XOFF 208
+#define RC_XON 209
+#define RC_ZMODEM 210
+#define RC_ZOMBIE 211
+#define RC_ZOMBIE_TIMEOUT 212
 
-#define RC_LAST 187
+#define RC_LAST 212
@@ -36,6 +36,7 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <unistd.h>
@@ -44,12 +45,14 @@
 
 #include "canvas.h"
 #include "encoding.h"
+#include "events.h"
 #include "mark.h"
 #include "misc.h"
 #include "process.h"
 #include "pty.h"
 #include "resize.h"
 #include "termcap.h"
+#include "trace.h"
 #include "tty.h"
 #include "winmsg.h"
 
@@ -68,6 +71,10 @@ enum {
 #define SCROLL_TOP_DEFAULT() ((D_has_hstatus == HSTATUS_FIRSTLINE) ? 1 : 0)
 #define SCROLL_BOT_DEFAULT() ((D_has_hstatus == HSTATUS_LASTLINE) ? D_height - 2 : D_height - 1)
 
+/* ImmorTerm: history replayed per run of disp_dump_fn(), and how often */
+#define DUMP_CHUNK	200	/* lines */
+#define DUMP_DELAY	5	/* milliseconds */
+
 static int CountChars(int);
 static int DoAddChar(int);
 static int BlankResize(int, int);
@@ -81,6 +88,8 @@ static void disp_map_fn(Event *, void *);
 static void disp_idle_fn(Event *, void *);
 static void disp_blanker_fn(Event *, void *);
 static void disp_mousetimeout_fn(Event *, void *);
+static void disp_dump_fn(Event *, void *);
+static void DumpStop(void);
 static void disp_processinput (Display *, unsigned char *, size_t);
 static void WriteLP(int, int);
 static void INSERTCHAR(uint32_t);
@@ -94,6 +103,8 @@ Display *display, *displays;
  *  The default values
  */
 bool defautonuke = false;
+bool syncoutput = false;	/* ImmorTerm: bracket redraws as synchronized updates */
+bool fastforward = false;	/* ImmorTerm: skip the frames of a display that falls behind */
 
 int defobuflimit = OBUF_MAX;
 int defnonblock = -1;
@@ -197,7 +208,12 @@ Display *MakeDisplay(char *uname, char *utty, char *term, int fd, pid_t pid, str
 	D_writeev.type = EV_WRITE;
 	D_readev.data = D_writeev.data = (char *)display;
 	D_readev.handler = disp_readev_fn;
+	D_readev.name = "disp_readev_fn";
+	/* ImmorTerm: keystrokes go before window output that is ready in the
+	 * same wakeup, however much of it a flooding window has */
+	D_readev.priority = 1;
 	D_writeev.handler = disp_writeev_fn;
+	D_writeev.name = "disp_writeev_fn";
 	evenq(&D_readev);
 	D_writeev.condpos = &D_obuflen;
 	D_writeev.condneg = &D_obuffree;
@@ -205,27 +221,40 @@ Display *MakeDisplay(char *uname, char *utty, char *term, int fd, pid_t pid, str
 	D_statusev.type = EV_TIMEOUT;
 	D_statusev.data = (char *)display;
 	D_statusev.handler = disp_status_fn;
+	D_statusev.name = "disp_status_fn";
 	D_hstatusev.type = EV_TIMEOUT;
 	D_hstatusev.data = (char *)display;
 	D_hstatusev.handler = disp_hstatus_fn;
+	D_hstatusev.name = "disp_hstatus_fn";
 	D_blockedev.type = EV_TIMEOUT;
 	D_blockedev.data = (char *)display;
 	D_blockedev.handler = disp_blocked_fn;
+	D_blockedev.name = "disp_blocked_fn";
 	D_blockedev.condpos = &D_obuffree;
 	D_blockedev.condneg = &D_obuflenmax;
 	D_mapev.type = EV_TIMEOUT;
 	D_mapev.data = (char *)display;
 	D_mapev.handler = disp_map_fn;
+	D_mapev.name = "disp_map_fn";
 	D_idleev.type = EV_TIMEOUT;
 	D_idleev.data = (char *)display;
 	D_idleev.handler = disp_idle_fn;
+	D_idleev.name = "disp_idle_fn";
 	D_blankerev.type = EV_READ;
 	D_blankerev.data = (char *)display;
 	D_blankerev.handler = disp_blanker_fn;
+	D_blankerev.name = "disp_blanker_fn";
 	D_blankerev.fd = -1;
 	D_mousetimeoutev.type = EV_TIMEOUT;
 	D_mousetimeoutev.data = (char *)display;
 	D_mousetimeoutev.handler = disp_mousetimeout_fn;
+	D_mousetimeoutev.name = "disp_mousetimeout_fn";
+	D_dumpev.type = EV_TIMEOUT;
+	D_dumpev.data = (char *)display;
+	D_dumpev.handler = disp_dump_fn;
+	D_dumpev.name = "disp_dump_fn";
+	/* ImmorTerm: after everything else that is due */
+	D_dumpev.priority = -5;
 	D_OldMode = *Mode;
 	D_status_obuffree = -1;
 	Resize_obuf();		/* Allocate memory for buffer */
@@ -267,6 +296,8 @@ void FreeDisplay(void)
 	if (D_processinputdata)
 		free(D_processinputdata);
 	D_processinputdata = NULL;
+	if (D_tcinited)
+		EventPost("detach", -1, D_usertty);
 	D_tcinited = 0;
 	evdeq(&D_hstatusev);
 	evdeq(&D_statusev);
@@ -274,14 +305,13 @@ void FreeDisplay(void)
 	evdeq(&D_writeev);
 	evdeq(&D_blockedev);
 	evdeq(&D_mapev);
+	DumpStop();
 	if (D_kmaps) {
 		free(D_kmaps);
 		D_kmaps = NULL;
 		D_aseqs = 0;
 		D_nseqs = 0;
-		D_seqp = NULL;
-		D_seql = 0;
-		D_seqh = NULL;
+		KmapsChanged();
 	}
 	evdeq(&D_idleev);
 	evdeq(&D_blankerev);
@@ -291,8 +321,10 @@ void FreeDisplay(void)
 			break;
 	if (D_status_lastmsg)
 		free(D_status_lastmsg);
+	free(D_hstatus_shown);
 	if (D_obuf)
 		free(D_obuf);
+	free(D_CMcosts);
 	*dp = display->d_next;
 
 	while (D_canvas.c_slperp)
@@ -649,6 +681,31 @@ void BracketedPasteMode(bool mode)
 	}
 }
 
+/*
+ * ImmorTerm: mark a burst of output as one synchronized update (DEC private
+ * mode 2026), so the terminal paints it as a single frame. Calls nest; only
+ * the outermost pair is sent.
+ */
+void SyncBegin(void)
+{
+	if (!display)
+		return;
+	if (D_syncdepth++ == 0 && syncoutput && D_CXT) {
+		AddStr("\033[?2026h");
+		D_synced = true;
+	}
+}
+
+void SyncEnd(void)
+{
+	if (!display || D_syncdepth == 0)
+		return;
+	if (--D_syncdepth == 0 && D_synced) {
+		AddStr("\033[?2026l");
+		D_synced = false;
+	}
+}
+
 void CursorStyle(int mode)
 {
 	char buf[32];
@@ -685,6 +742,88 @@ int CalcCost(char *s)
 		return EXPENSIVE;
 }
 
+static char *MoveBuf;
+static int MoveLen;
+
+static int MoveChar(int c)
+{
+	if (MoveLen < MOVE_STRLEN)
+		MoveBuf[MoveLen] = c;
+	MoveLen++;
+	return c;
+}
+
+/*
+ * ImmorTerm: expand the parametrized motions for every distance up to
+ * MOVE_CACHE once per termcap, so that GotoPos() neither formats nor
+ * measures them on each move. The CM costs depend on the display size and
+ * are filled in lazily by CMCost().
+ */
+void InitMoveCosts(void)
+{
+	char *caps[MV_COUNT] = { D_CRI, D_CLE, D_CDO, D_CUP };
+
+	for (int k = 0; k < MV_COUNT; k++) {
+		struct movecache *mc = &D_moves[k];
+
+		memset(mc->len, 0, sizeof(mc->len));
+		if (!caps[k])
+			continue;
+		for (int n = 1; n < MOVE_CACHE; n++) {
+			MoveBuf = mc->str[n];
+			MoveLen = 0;
+			tputs(tgoto(caps[k], 0, n), 1, MoveChar);
+			if (MoveLen > 0 && MoveLen <= MOVE_STRLEN)
+				mc->len[n] = MoveLen;
+		}
+	}
+	free(D_CMcosts);
+	D_CMcosts = NULL;
+	D_CMcostw = D_CMcosth = 0;
+}
+
+static int MoveCost(int k, char *cap, int n)
+{
+	if (n < MOVE_CACHE && D_moves[k].len[n])
+		return D_moves[k].len[n];
+	return CalcCost(tgoto(cap, 0, n));
+}
+
+static void AddMove(int k, char *cap, int n)
+{
+	if (n < MOVE_CACHE && D_moves[k].len[n]) {
+		for (int i = 0; i < D_moves[k].len[n]; i++)
+			AddChar(D_moves[k].str[n][i]);
+		return;
+	}
+	AddCStr2(cap, n);
+}
+
+/* cost of moving to x,y with CM (or HO for home) */
+static int CMCost(int x, int y)
+{
+	unsigned char *c;
+	int cost;
+
+	if (x < 0 || y < 0 || x >= D_width || y >= D_height)
+		return CalcCost(D_HO && !x && !y ? D_HO : tgoto(D_CM, x, y));
+	if (D_CMcostw != D_width || D_CMcosth != D_height) {
+		free(D_CMcosts);
+		D_CMcosts = calloc(D_width * D_height, 1);
+		D_CMcostw = D_CMcosts ? D_width : 0;
+		D_CMcosth = D_CMcosts ? D_height : 0;
+		if (!D_CMcosts)
+			return CalcCost(D_HO && !x && !y ? D_HO : tgoto(D_CM, x, y));
+	}
+	c = &D_CMcosts[y * D_width + x];
+	if (*c)
+		return *c - 1;
+	cost = CalcCost(D_HO && !x && !y ? D_HO : tgoto(D_CM, x, y));
+	if (cost < 255)
+		*c = cost + 1;
+	return cost;
+}
+
 void GotoPos(int x2, int y2)
 {
 	int dy, dx, x1, y1;
@@ -734,18 +873,14 @@ void GotoPos(int x2, int y2)
 		goto DoCM;
 
 	/* Calculate CMcost */
-	if (D_HO && !x2 && !y2)
-		s = D_HO;
-	else
-		s = tgoto(D_CM, x2, y2);
-	CMcost = CalcCost(s);
+	CMcost = CMCost(x2, y2);
 
 	/* Calculate the cost to move the cursor to the right x position */
 	costx = EXPENSIVE;
 	if (x1 >= 0) {		/* relative x positioning only if we know where we are */
 		if (dx > 0) {
 			if (D_CRI && (dx > 1 || !D_ND)) {
-				costx = CalcCost(tgoto(D_CRI, 0, dx));
+				costx = MoveCost(MV_CRI, D_CRI, dx);
 				xm = M_CRI;
 			}
 			if ((m = D_NDcost * dx) < costx) {
@@ -754,7 +889,7 @@ void GotoPos(int x2, int y2)
 			}
 		} else if (dx < 0) {
 			if (D_CLE && (dx < -1 || !D_BC)) {
-				costx = CalcCost(tgoto(D_CLE, 0, -dx));
+				costx = MoveCost(MV_CLE, D_CLE, -dx);
 				xm = M_CLE;
 			}
 			if ((m = -dx * D_LEcost) < costx) {
@@ -777,7 +912,7 @@ void GotoPos(int x2, int y2)
 	costy = EXPENSIVE;
 	if (dy > 0) {
 		if (D_CDO && dy > 1) {	/* DO & NL are always != 0 */
-			costy = CalcCost(tgoto(D_CDO, 0, dy));
+			costy = MoveCost(MV_CDO, D_CDO, dy);
 			ym = M_CDO;
 		}
 		if ((m = dy * ((x2 == 0) ? D_NLcost : D_DOcost)) < costy) {
@@ -786,7 +921,7 @@ void GotoPos(int x2, int y2)
 		}
 	} else if (dy < 0) {
 		if (D_CUP && (dy < -1 || !D_UP)) {
-			costy = CalcCost(tgoto(D_CUP, 0, -dy));
+			costy = MoveCost(MV_CUP, D_CUP, -dy);
 			ym = M_CUP;
 		}
 		if ((m = -dy * D_UPcost) < costy) {
@@ -806,14 +941,14 @@ void GotoPos(int x2, int y2)
 			AddCStr(D_BC);
 		break;
 	case M_CLE:
-		AddCStr2(D_CLE, -dx);
+		AddMove(MV_CLE, D_CLE, -dx);
 		break;
 	case M_RI:
 		while (dx-- > 0)
 			AddCStr(D_ND);
 		break;
 	case M_CRI:
-		AddCStr2(D_CRI, dx);
+		AddMove(MV_CRI, D_CRI, dx);
 		break;
 	case M_CR:
 		AddCStr(D_CR);
@@ -831,7 +966,7 @@ void GotoPos(int x2, int y2)
 			AddCStr(D_UP);
 		break;
 	case M_CUP:
-		AddCStr2(D_CUP, -dy);
+		AddMove(MV_CUP, D_CUP, -dy);
 		break;
 	case M_DO:
 		s = (x2 == 0) ? D_NL : D_DO;
@@ -839,7 +974,7 @@ void GotoPos(int x2, int y2)
 			AddCStr(s);
 		break;
 	case M_CDO:
-		AddCStr2(D_CDO, dy);
+		AddMove(MV_CDO, D_CDO, dy);
 		break;
 	default:
 		break;
@@ -859,6 +994,12 @@ void ClearArea(int x1, int y1, int xs, int xe, int x2, int y2, int bce, int usel
 	Canvas *cv;
 	Viewport *vp;
 
+	if (display && D_hstatus_shownlen) {
+		int row = D_has_hstatus == HSTATUS_FIRSTLINE ? 0 : D_height - 1;
+		if (y1 <= row && row <= y2)
+			HStatusForget();	/* wipes the hardstatus line */
+	}
+
 	if (x1 == D_width)
 		x1--;
 	if (x2 == D_width)
@@ -950,6 +1091,8 @@ void ClearArea(int x1, int y1, int xs, int xe, int x2, int y2, int bce, int usel
  */
 void Redisplay(int cur_only)
 {
+	SyncBegin();
+	HStatusForget();
 	/* XXX do em all? */
 	InsertMode(false);
 	ChangeScrollRegion(SCROLL_TOP_DEFAULT(), SCROLL_BOT_DEFAULT());
@@ -972,6 +1115,7 @@ void Redisplay(int cur_only)
 	RefreshHStatus();
 	CV_CALL(D_forecv, LayRestore();
 		LaySetCursor());
+	SyncEnd();
 }
 
 void RedisplayDisplays(int cur_only)
@@ -1285,77 +1429,52 @@ int color256to88(int color)
 }
 
 /*
- * SetColor - Sets foreground and background color
- * 0x00000000 <- default color ("transparent")
- * 	one note here that "null" variable is pointer to array of 0 and that's one of reasons to use it this way 
- * 0x0100000x <- 16 base color
- * 0x020000xx <- 256 color
- * 0x04xxxxxx <- truecolor
+ * ImmorTerm: the escape sequences for a color are encoded once per display
+ * and remembered in a small direct-mapped cache, keyed by the color value
+ * (with truecolor on/off folded into bit 31, which colors never use).
  */
-void SetColor(uint32_t foreground, uint32_t background)
+static char *SgrBuf;
+static int SgrLen;
+
+static int SgrChar(int c)
 {
-	uint32_t f, b, of, ob;
-	static unsigned char sftrans[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+	if (SgrLen < SGR_STRLEN)
+		SgrBuf[SgrLen] = c;
+	SgrLen++;
+	return c;
+}
 
-	if (!display)
-		return;
+static const unsigned char sftrans[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
 
-	f = foreground;
-	b = background;
-	of = D_rend.colorfg;
-	ob = D_rend.colorbg;
-	D_rend.colorfg = f;
-	D_rend.colorbg = b;
-
-	if (!D_CAX && D_hascolor && ((f == 0 && f != of) || (b == 0 && b != ob))) {
-		if (D_OP)
-			AddCStr(D_OP);
-		else {
-			int oattr;
-			oattr = D_rend.attr;
-			AddCStr(D_ME ? D_ME : "\033[m");
-			if (D_ME && !D_CG0) {
-				/* D_ME may also reset the alternate charset */
-				D_rend.font = 0;
-				D_realfont = 0;
-			}
-			D_atyp = 0;
-			D_rend.attr = 0;
-			SetAttr(oattr);
-		}
-		of = ob = 0;
-	}
-	if (!D_hascolor)
-		return;
-
-/* FOREGROUND */
-	if (f != of && f == 0) {
-		AddCStr("\033[39m");	/* works because AX is set */
+static void EncodeFg(uint32_t f)
+{
+	if (f == 0) {
+		tputs("\033[39m", 1, SgrChar);	/* works because AX is set */
 	}
-	if (f != of && (f & 0x01000000)) {
+	if (f & 0x01000000) {
 		f &= 0x0f;
 		if (f < 8) {
 			if (D_CAF)
-				AddCStr2(D_CAF, f);
+				tputs(tgoto(D_CAF, 0, f), 1, SgrChar);
 			else if (D_CSF)
-				AddCStr2(D_CSF, sftrans[f]);
+				tputs(tgoto(D_CSF, 0, sftrans[f]), 1, SgrChar);
 		}
 		if (D_CXT && f >= 8 && f <= 15) {
-			AddCStr2("\033[9%p1%dm", f & 7);
+			tputs(tgoto("\033[9%p1%dm", 0, f & 7), 1, SgrChar);
 		}
 	}
-	if (f != of && (f & 0x02000000)) {
+	if (f & 0x02000000) {
 		f &= 0x0ff;
 		if (f > 15 && D_CCO != 256) {
 			f = D_CCO == 88 && D_CAF ? color256to88(f) : color256to16(f);
 		}
 		if (D_CAF) {
 			//AddCStr2(D_CAF, f); //FIXME
-			tputs(tparm("\033[38;5;%dm", f), 1, DoAddChar);
+			tputs(tparm("\033[38;5;%dm", f), 1, SgrChar);
 		}
 		
 	}
-	if (f != of && (f & 0x04000000) && hastruecolor) {
+	if ((f & 0x04000000) && hastruecolor) {
 		uint8_t _r, _g, _b;
 
 		_r = (f & 0x00ff0000) >> 16;
@@ -1363,36 +1482,38 @@ void SetColor(uint32_t foreground, uint32_t background)
 		_b = (f & 0x000000ff);
 
 		/* TODO - properly get escape code */
-		tputs(tparm("\033[38;2;%p1%d;%p2%d;%p3%dm", _r, _g, _b), 1, DoAddChar);
+		tputs(tparm("\033[38;2;%p1%d;%p2%d;%p3%dm", _r, _g, _b), 1, SgrChar);
 	}
+}
 
-/* BACKGROUND */
-	if (b != ob && b == 0) {
-		AddCStr("\033[49m");	/* works because AX is set */
+static void EncodeBg(uint32_t b)
+{
+	if (b == 0) {
+		tputs("\033[49m", 1, SgrChar);	/* works because AX is set */
 	}
-	if (b != ob && (b & 0x01000000)) {
+	if (b & 0x01000000) {
 		b &= 0x0f;
 		if (b < 8) {
 			if (D_CAB)
-				AddCStr2(D_CAB, b);
+				tputs(tgoto(D_CAB, 0, b), 1, SgrChar);
 			else if (D_CSB)
-				AddCStr2(D_CSB, sftrans[b]);
+				tputs(tgoto(D_CSB, 0, sftrans[b]), 1, SgrChar);
 		}
 		if (D_CXT && b >= 8 && b <= 15) {
-			AddCStr2("\033[10%p1%dm", b & 7);
+			tputs(tgoto("\033[10%p1%dm", 0, b & 7), 1, SgrChar);
 		}
 	}
-	if (b != ob && (b & 0x02000000)) {
+	if (b & 0x02000000) {
 		b &= 0x0ff;
 		if (b > 15 && D_CCO != 256) {
 			b = D_CCO == 88 && D_CAB ? color256to88(b) : color256to16(b);
 		}
 		if (D_CAB) {
 		//	AddCStr2(D_CAB, b); // FIXME
-			tputs(tparm("\033[48;5;%dm", b), 1, DoAddChar);
+			tputs(tparm("\033[48;5;%dm", b), 1, SgrChar);
 		}
 	}
-	if (b != ob && (b & 0x04000000) && hastruecolor) {
+	if ((b & 0x04000000) && hastruecolor) {
 		uint8_t _r, _g, _b;
 
 		_r = (b & 0x00ff0000) >> 16;
@@ -1400,8 +1521,123 @@ void SetColor(uint32_t foreground, uint32_t background)
 		_b = (b & 0x000000ff);
 
 		/* TODO - properly get escape code */
-		tputs(tparm("\033[48;2;%p1%d;%p2%d;%p3%dm", _r, _g, _b), 1, DoAddChar);
+		tputs(tparm("\033[48;2;%p1%d;%p2%d;%p3%dm", _r, _g, _b), 1, SgrChar);
+	}
+}
+
+void InitSgrCache(void)
+{
+	memset(D_sgrfg, 0, sizeof(D_sgrfg));
+	memset(D_sgrbg, 0, sizeof(D_sgrbg));
+}
+
+static struct sgrslot *SgrLookup(struct sgrslot *cache, uint32_t c, void (*encode)(uint32_t))
+{
+	uint32_t key = c | (hastruecolor ? 0x80000000 : 0);
+	struct sgrslot *e = &cache[(key * 2654435761u) >> (32 - SGR_CACHE_BITS)];
+
+	if (e->valid && e->key == key)
+		return e;
+	SgrBuf = e->str;
+	SgrLen = 0;
+	encode(c);
+	e->key = key;
+	e->len = SgrLen;
+	e->valid = SgrLen <= SGR_STRLEN;
+	if (!e->valid) {
+		/* too long to keep, encode straight into the output */
+		char *buf;
+
+		if ((buf = malloc(SgrLen)) == NULL)
+			return NULL;
+		SgrBuf = buf;
+		SgrLen = 0;
+		encode(c);
+		for (int i = 0; i < SgrLen; i++)
+			AddChar(buf[i]);
+		free(buf);
+		return NULL;
+	}
+	return e;
+}
+
+/* a single "ESC [ ... m" sequence, which can be merged with another */
+static bool SgrPlain(struct sgrslot *e)
+{
+	if (e->len < 4 || e->str[0] != '\033' || e->str[1] != '[' || e->str[e->len - 1] != 'm')
+		return false;
+	for (int i = 2; i < e->len - 1; i++)
+		if (!((e->str[i] >= '0' && e->str[i] <= '9') || e->str[i] == ';'))
+			return false;
+	return true;
+}
+
+/*
+ * SetColor - Sets foreground and background color
+ * 0x00000000 <- default color ("transparent")
+ * 	one note here that "null" variable is pointer to array of 0 and that's one of reasons to use it this way 
+ * 0x0100000x <- 16 base color
+ * 0x020000xx <- 256 color
+ * 0x04xxxxxx <- truecolor
+ *
+ * Only the colors that change are sent. If both change and both are plain
+ * SGR sequences, they go out as one ("\033[38;5;1;48;5;2m").
+ */
+void SetColor(uint32_t foreground, uint32_t background)
+{
+	uint32_t f, b, of, ob;
+	struct sgrslot *fe = NULL, *be = NULL;
+	int i;
+
+	if (!display)
+		return;
+
+	f = foreground;
+	b = background;
+	of = D_rend.colorfg;
+	ob = D_rend.colorbg;
+	D_rend.colorfg = f;
+	D_rend.colorbg = b;
+
+	if (!D_CAX && D_hascolor && ((f == 0 && f != of) || (b == 0 && b != ob))) {
+		if (D_OP)
+			AddCStr(D_OP);
+		else {
+			int oattr;
+			oattr = D_rend.attr;
+			AddCStr(D_ME ? D_ME : "\033[m");
+			if (D_ME && !D_CG0) {
+				/* D_ME may also reset the alternate charset */
+				D_rend.font = 0;
+				D_realfont = 0;
+			}
+			D_atyp = 0;
+			D_rend.attr = 0;
+			SetAttr(oattr);
+		}
+		of = ob = 0;
+	}
+	if (!D_hascolor)
+		return;
+
+	if (f != of)
+		fe = SgrLookup(D_sgrfg, f, EncodeFg);
+	if (b != ob)
+		be = SgrLookup(D_sgrbg, b, EncodeBg);
+	if (fe && be && SgrPlain(fe) && SgrPlain(be)) {
+		for (i = 0; i < fe->len - 1; i++)
+			AddChar(fe->str[i]);
+		AddChar(';');
+		for (i = 2; i < be->len; i++)
+			AddChar(be->str[i]);
+		return;
 	}
+	if (fe)
+		for (i = 0; i < fe->len; i++)
+			AddChar(fe->str[i]);
+	if (be)
+		for (i = 0; i < be->len; i++)
+			AddChar(be->str[i]);
 }
 
 static void SetBackColor(int new)
@@ -1550,6 +1786,7 @@ void RemoveStatus(void)
 		return;
 	if (!(where = D_status))
 		return;
+	HStatusForget();	/* the message may have covered it */
 
 	if (D_status_obuffree >= 0) {
 		D_obuflen = D_status_obuflen;
@@ -1582,10 +1819,7 @@ static void RemoveStatusMinWait(void)
 {
 	/* XXX: should flush output first if D_status_obufpos is set */
 	if (!D_status_bell && !D_status_obufpos) {
-		struct timeval now;
-		int ti;
-		gettimeofday(&now, NULL);
-		ti = (now.tv_sec - D_status_time.tv_sec) * 1000 + (now.tv_usec - D_status_time.tv_usec) / 1000;
+		int ti = SchedNow() - D_status_time;
 		if (ti < MsgMinWait)
 			DisplaySleep1000(MsgMinWait - ti, 0);
 	}
@@ -1639,10 +1873,68 @@ static int PrePutWinMsg(char *s, int start, int max)
 	}
 }
 
+/*
+ * ImmorTerm: Describe a hardstatus line: where it goes, how wide it is and
+ * its text with the renditions of the last MakeWinMsg(). If that is what the
+ * line shows already, return true; otherwise remember it and return false.
+ * Anything that may paint over the line calls HStatusForget().
+ */
+static bool HStatusShown(char *str, int width, int row)
+{
+	size_t sl = str ? strlen(str) + 1 : 0;
+	size_t len = 3 * sizeof(int) + sl;
+	int head[3];
+	char *p;
+	bool rend = str && str == g_winmsg->buf;
+
+	if (rend)
+		len += sizeof(int) + g_winmsg->numrend * (sizeof(int) + sizeof(uint64_t));
+	if (len > D_hstatus_shownsize) {
+		if ((p = realloc(D_hstatus_shown, len)) == NULL) {
+			D_hstatus_shownlen = 0;
+			return false;
+		}
+		D_hstatus_shown = p;
+		D_hstatus_shownsize = len;
+	}
+	head[0] = width;
+	head[1] = row;
+	head[2] = !captionalways && D_cvlist && !D_cvlist->c_next;
+
+	/* compare piece by piece, then write the new description */
+	p = D_hstatus_shown;
+	if (D_hstatus_shownlen == len && !memcmp(p, head, sizeof(head)) && !memcmp(p + sizeof(head), str ? str : "", sl)
+	    && (!rend || (!memcmp(p + sizeof(head) + sl, &g_winmsg->numrend, sizeof(int))
+			  && !memcmp(p + sizeof(head) + sl + sizeof(int), g_winmsg->rendpos, g_winmsg->numrend * sizeof(int))
+			  && !memcmp(p + sizeof(head) + sl + sizeof(int) + g_winmsg->numrend * sizeof(int), g_winmsg->rend,
+				     g_winmsg->numrend * sizeof(uint64_t)))))
+		return true;
+	memcpy(p, head, sizeof(head));
+	p += sizeof(head);
+	memcpy(p, str ? str : "", sl);
+	p += sl;
+	if (rend) {
+		memcpy(p, &g_winmsg->numrend, sizeof(int));
+		p += sizeof(int);
+		memcpy(p, g_winmsg->rendpos, g_winmsg->numrend * sizeof(int));
+		p += g_winmsg->numrend * sizeof(int);
+		memcpy(p, g_winmsg->rend, g_winmsg->numrend * sizeof(uint64_t));
+	}
+	D_hstatus_shownlen = len;
+	return false;
+}
+
+void HStatusForget(void)
+{
+	if (display)
+		D_hstatus_shownlen = 0;
+}
+
 /* refresh the display's hstatus line */
 void ShowHStatus(char *str)
 {
 	int l, ox, oy, max;
+	size_t shown;
 
 	if (D_status == STATUS_ON_WIN && (D_has_hstatus == HSTATUS_FIRSTLINE || D_has_hstatus == HSTATUS_LASTLINE) && STATLINE() == D_height - 1)
 		return;		/* sorry, in use */
@@ -1662,6 +1954,8 @@ void ShowHStatus(char *str)
 	if (D_HS && D_has_hstatus == HSTATUS_HS) {
 		if (!D_hstatus && (str == NULL || *str == 0))
 			return;
+		if (HStatusShown(str, -1, -1) && D_hstatus)
+			return;
 		SetRendition(&mchar_null);
 		InsertMode(false);
 		if (D_hstatus)
@@ -1705,6 +1999,9 @@ void ShowHStatus(char *str)
 		target_row = actual_height - 1;
 		if (target_row < 0)
 			return;
+		if (HStatusShown(str, actual_width, target_row) && D_hstatus)
+			return;
+		shown = D_hstatus_shownlen;	/* our own ClearArea() forgets it */
 
 		ox = D_x;
 		oy = D_y;
@@ -1743,6 +2040,7 @@ void ShowHStatus(char *str)
 			GotoPos(ox, oy);
 		D_hstatus = (str != NULL);
 		SetRendition(&mchar_null);
+		D_hstatus_shownlen = shown;
 	} else if (D_has_hstatus == HSTATUS_FIRSTLINE) {
 		struct winsize ws;
 		int actual_width = D_width;
@@ -1757,6 +2055,9 @@ void ShowHStatus(char *str)
 		/* ImmorTerm: Don't render status bar if terminal is too narrow */
 		if (actual_width < 20)
 			return;
+		if (HStatusShown(str, actual_width, 0) && D_hstatus)
+			return;
+		shown = D_hstatus_shownlen;	/* our own ClearArea() forgets it */
 
 		ox = D_x;
 		oy = D_y;
@@ -1786,6 +2087,7 @@ void ShowHStatus(char *str)
 			GotoPos(ox, oy);
 		D_hstatus = (str != NULL);
 		SetRendition(&mchar_null);
+		D_hstatus_shownlen = shown;
 	} else if (str && *str && D_has_hstatus == HSTATUS_MESSAGE) {
 		Msg(0, "%s", str);
 	}
@@ -1826,14 +2128,199 @@ void RefreshAll(int isblank)
 	RefreshArea(0, 0, D_width - 1, D_height - 1, isblank);
 }
 
+/* ImmorTerm: write the cells of a line at the cursor, trailing blanks cut off */
+static void PutDumpLine(struct mline *ml, int width)
+{
+	int to = width - 1;
+
+	while (to >= 0 && cmp_mchar_mline(&mchar_blank, ml, to))
+		to--;
+	for (int x = 0; x <= to; x++) {
+		if (x == to && dw_left(ml, x, D_encoding))
+			break;
+		SetRenditionMline(ml, x);
+		PUTCHAR(ml->image[x]);
+		if (dw_left(ml, x, D_encoding))
+			PUTCHAR(ml->image[++x]);
+	}
+	SetRendition(&mchar_null);
+}
+
+/* ImmorTerm: write one line on the bottom row and scroll it up */
+static void DumpLine(struct mline *ml, int width)
+{
+	GotoPos(0, D_height - 1);
+	PutDumpLine(ml, width);
+	GotoPos(0, D_height - 1);
+	AddCStr(D_NL);
+}
+
+/*
+ * ImmorTerm: replay the history of a window to a display that has just been
+ * initialised, so that it ends up in the outer terminal's own scrollback
+ * with its renditions, instead of being re-parsed from the log. The lines
+ * are scrolled off the bottom row, oldest first, followed by the window's
+ * (main) screen so that no history is left in the viewport for the redraw
+ * to wipe. Nothing is flushed: the whole replay goes out in one write
+ * together with that redraw. Of no use if the terminal switches to an
+ * alternate screen, so it is skipped when TI is set. Terminals that cannot
+ * set a scroll region get this; the others DumpScrollbackStart().
+ */
+void DumpScrollback(Window *win)
+{
+	struct mline *mlines = win->w_alt.on ? win->w_alt.mlines : win->w_mlines;
+	int height = win->w_alt.on ? win->w_alt.height : win->w_height;
+	int width = win->w_alt.on ? win->w_alt.width : win->w_width;
+	int maxwidth = D_width - !D_CLP;	/* the last column would wrap */
+
+	if (display == NULL || D_TI || mlines == NULL || D_height < 2)
+		return;
+	if (width > maxwidth)
+		width = maxwidth;
+	ChangeScrollRegion(0, D_height - 1);
+	for (int i = MainHistLines(win); i > 0; i--)
+		DumpLine(MainHistLine(win, i), width);
+	for (int y = 0; y < D_height - 1; y++)
+		DumpLine(y < height ? &mlines[y] : &mline_blank, width);
+	ChangeScrollRegion(SCROLL_TOP_DEFAULT(), SCROLL_BOT_DEFAULT());
+}
+
+/* ImmorTerm: the width the main screen of win has */
+static int DumpWidth(Window *win)
+{
+	return win->w_alt.on ? win->w_alt.width : win->w_width;
+}
+
+static void DumpStop(void)
+{
+	evdeq(&D_dumpev);
+	if (D_dumpwin)
+		D_dumpwin->w_dumps--;
+	D_dumpwin = NULL;
+}
+
+/*
+ * ImmorTerm: replay the next n lines of the history DumpScrollbackStart()
+ * began with. They are written into a scroll region of the top two rows
+ * and scrolled out of it, which puts them into the outer terminal's
+ * scrollback without moving the rest of the viewport; then the two rows
+ * are drawn again.
+ */
+static void DumpChunk(int n)
+{
+	Window *win = D_dumpwin;
+	Layer *oldflayer = flayer;
+	int width = D_dumpwidth;
+
+	if (width > D_width - !D_CLP)
+		width = D_width - !D_CLP;	/* the last column would wrap */
+	if (n > D_dumpleft)
+		n = D_dumpleft;
+	if (n <= 0)
+		return;
+	SyncBegin();
+	ChangeScrollRegion(0, 1);
+	ClearLine(NULL, 1, 0, D_width - 1, 0);
+	ClearLine(NULL, 0, 0, D_width - 1, 0);
+	GotoPos(0, 0);
+	PutDumpLine(MainHistLine(win, D_dumpleft--), width);
+	while (--n > 0) {
+		GotoPos(0, 1);
+		PutDumpLine(MainHistLine(win, D_dumpleft--), width);
+		GotoPos(0, 1);
+		AddCStr(D_NL);	/* the line above goes to the scrollback */
+	}
+	GotoPos(0, 1);
+	AddCStr(D_NL);
+	ChangeScrollRegion(SCROLL_TOP_DEFAULT(), SCROLL_BOT_DEFAULT());
+	RefreshArea(0, 0, D_width - 1, 1, 1);
+	if (D_forecv && (flayer = D_forecv->c_layer) != NULL)
+		LaySetCursor();
+	flayer = oldflayer;
+	SyncEnd();
+}
+
+/*
+ * ImmorTerm: replay the history of win to a display whose viewport has
+ * just been drawn, DUMP_CHUNK lines at a time from a low priority event,
+ * so that the prompt is up before any of it. Output to win sends the rest
+ * first (see DumpScrollbackFinish()), which keeps the scrollback in order.
+ * Skipped for terminals in an alternate screen (TI) and with the hardstatus
+ * on the first line, and done all at once beforehand by DumpScrollback()
+ * for those without scroll regions.
+ */
+void DumpScrollbackStart(Window *win)
+{
+	if (display == NULL || D_TI || !D_CS || D_height < 3 || D_has_hstatus == HSTATUS_FIRSTLINE)
+		return;		/* the region could not start at the top */
+	DumpStop();
+	if ((D_dumpleft = D_dumptotal = MainHistLines(win)) == 0)
+		return;
+	D_dumpwin = win;
+	D_dumpwidth = DumpWidth(win);
+	win->w_dumps++;
+	SetTimeout(&D_dumpev, DUMP_DELAY);
+	evenq(&D_dumpev);
+}
+
+/* ImmorTerm: whether the history DumpScrollbackStart() began with is still
+ * there, at the same place */
+static bool DumpValid(void)
+{
+	return DumpWidth(D_dumpwin) == D_dumpwidth && MainHistLines(D_dumpwin) == D_dumptotal;
+}
+
+/* ImmorTerm: send what is left of the history replays of win at once, or
+ * drop it if !send, before its history changes */
+void DumpScrollbackFinish(Window *win, bool send)
+{
+	Display *olddisplay = display;
+
+	for (display = displays; display; display = display->d_next)
+		if (D_dumpwin == win) {
+			if (send && DumpValid())
+				DumpChunk(D_dumpleft);
+			DumpStop();
+		}
+	display = olddisplay;
+}
+
+static void disp_dump_fn(Event *ev, void *data)
+{
+	Display *olddisplay = display;
+
+	(void)ev;
+	display = (Display *)data;
+	if (!DumpValid())
+		DumpStop();
+	else if (D_fore != D_dumpwin) {
+		/* before the other window scrolls anything above it */
+		DumpChunk(D_dumpleft);
+		DumpStop();
+	} else if (D_blocked || D_obuffree < D_obuflenmax) {
+		SetTimeout(&D_dumpev, DUMP_DELAY);	/* let the terminal catch up */
+		evenq(&D_dumpev);
+	} else {
+		DumpChunk(DUMP_CHUNK);
+		if (D_dumpleft > 0) {
+			SetTimeout(&D_dumpev, DUMP_DELAY);
+			evenq(&D_dumpev);
+		} else
+			DumpStop();
+	}
+	display = olddisplay;
+}
+
 void RefreshArea(int xs, int ys, int xe, int ye, int isblank)
 {
+	SyncBegin();
 	if (!isblank && xs == 0 && xe == D_width - 1 && ye == D_height - 1 && (ys == 0 || D_CD)) {
 		ClearArea(xs, ys, xs, xe, xe, ye, 0, 0);
 		isblank = 1;
 	}
 	for (int y = ys; y <= ye; y++)
 		RefreshLine(y, xs, xe, isblank);
+	SyncEnd();
 }
 
 void RefreshLine(int y, int from, int to, int isblank)
@@ -2021,10 +2508,97 @@ void ClearLine(struct mline *oml, int y, int from, int to, int bce)
 	DisplayLine(oml, &mline_old, y, from, to);
 }
 
+/* ImmorTerm: a line shorter than this many blanks to its end is drawn
+ * with them rather than cleared to the end */
+#define DISPLAYLINE_CLEAR 4
+
+/*
+ * ImmorTerm: the first cell from x to to in which oml and ml differ, or
+ * to + 1. Arrays the two lines share (the null array, mostly) need no
+ * looking at; the others are compared eight cells at a time, in a loop
+ * the compiler turns into vector instructions.
+ */
+static int DiffCell(struct mline *oml, struct mline *ml, int x, int to)
+{
+	const uint32_t *a[5], *b[5];
+	int n = 0;
+
+#define DIFF_ARRAY(f)				\
+	if (oml->f != ml->f) {			\
+		a[n] = oml->f;			\
+		b[n] = ml->f;			\
+		n++;				\
+	}
+	DIFF_ARRAY(image);
+	DIFF_ARRAY(attr);
+	DIFF_ARRAY(font);
+	DIFF_ARRAY(colorbg);
+	DIFF_ARRAY(colorfg);
+#undef DIFF_ARRAY
+	if (n == 0)
+		return to + 1;
+	for (; x + 8 <= to + 1; x += 8) {
+		uint32_t d = 0;
+
+		for (int k = 0; k < n; k++)
+			for (int i = 0; i < 8; i++)
+				d |= a[k][x + i] ^ b[k][x + i];
+		if (d)
+			break;
+	}
+	for (; x <= to; x++)
+		for (int k = 0; k < n; k++)
+			if (a[k][x] != b[k][x])
+				return x;
+	return x;
+}
+
+/*
+ * ImmorTerm: writes the changed cells of ml from x on that go right where
+ * the cursor is, up to to and short of the last column, as long as they
+ * keep the rendition of the one before (the font apart, which UTF-8 does
+ * not switch) and are single width. Returns the first cell not written.
+ * This is what DisplayLine() would do cell by cell, without the cursor
+ * moves and rendition changes it looks at for each of them.
+ */
+static int PutRun(struct mline *oml, struct mline *ml, int x, int to)
+{
+	int e = to < D_width - 2 ? to : D_width - 2;
+
+	if (D_encoding != UTF8 || D_xtable || D_insert || D_mbcs || D_x != x)
+		return x;
+	for (; x <= e; x++) {
+		uint32_t c = ml->image[x];
+
+		if (cmp_mline(oml, ml, x) || c < 32 || utf8_isdouble(c)
+		    || dw_left(ml, x, UTF8) || dw_right(ml, x, UTF8) || ml->attr[x] != D_rend.attr
+		    || ml->colorbg[x] != D_rend.colorbg || ml->colorfg[x] != D_rend.colorfg)
+			break;
+		D_rend.font = ml->font[x];
+		if (c < 0x80)
+			AddChar(c);
+		else
+			AddUtf8(c);
+		D_x++;
+	}
+	return x;
+}
+
 void DisplayLine(struct mline *oml, struct mline *ml, int y, int from, int to)
 {
 	int x;
-	int last2flag = 0, delete_lp = 0;
+	int last2flag = 0, delete_lp = 0, clear = -1;
+
+	/* ImmorTerm: what is on the display is not known and the line ends in
+	 * blanks: clear them in one go instead of writing each */
+	if (oml == &mline_null && ml != NULL && D_CE && to == D_width - 1 && (D_CLP || y != D_bot) && !D_mbcs) {
+		for (x = to; x >= from && cmp_mchar_mline(&mchar_blank, ml, x); x--)
+			;
+		if (to - x >= DISPLAYLINE_CLEAR) {
+			clear = x + 1;
+			to = x;
+		}
+	}
 
 	if (!D_CLP && y == D_bot && to == D_width - 1) {
 		if (D_lp_missing || !cmp_mline(oml, ml, to)) {
@@ -2048,6 +2622,9 @@ void DisplayLine(struct mline *oml, struct mline *ml, int y, int from, int to)
 	}
 	for (x = from; x <= to; x++) {
 		if (ml != NULL) {
+			/* ImmorTerm: skip what is the same in one go */
+			if (x < to)
+				x = DiffCell(oml, ml, x, to - 1);
 			if ((x < to || x != D_width - 1 || ml->image[x + 1]))
 				if (cmp_mline(oml, ml, x))
 					continue;
@@ -2066,6 +2643,8 @@ void DisplayLine(struct mline *oml, struct mline *ml, int y, int from, int to)
 			PUTCHAR(ml->image[x]);
 			if (dw_left(ml, x, D_encoding))
 				PUTCHAR(ml->image[++x]);
+			else
+				x = PutRun(oml, ml, x + 1, to) - 1;
 		}
 	}
 	if (last2flag) {
@@ -2085,6 +2664,8 @@ void DisplayLine(struct mline *oml, struct mline *ml, int y, int from, int to)
 		else if (D_CE)
 			AddCStr(D_CE);
 	}
+	if (clear >= 0)
+		ClearLine(NULL, y, clear, D_width - 1, 0);
 }
 
 void PutChar(struct mchar *c, int x, int y)
@@ -2290,6 +2871,64 @@ void ClearAllXtermOSC(void)
 
 #undef WT_FLAG
 
+/*
+ * Put text into the terminal's clipboard with OSC 52. The text comes
+ * in pieces through ClipboardPut() and is base64 encoded into the
+ * output buffer as it comes, which is flushed every CLIPCHUNK bytes:
+ * a huge selection is never held encoded as a whole.
+ */
+#define CLIPCHUNK 65536
+
+static unsigned char cliprest[3];
+static int clipnrest;
+
+static void clipquad(unsigned char *s, int n)
+{
+	static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	uint32_t v = s[0] << 16 | (n > 1 ? s[1] << 8 : 0) | (n > 2 ? s[2] : 0);
+
+	AddChar(b64[v >> 18]);
+	AddChar(b64[v >> 12 & 63]);
+	AddChar(n > 1 ? b64[v >> 6 & 63] : '=');
+	AddChar(n > 2 ? b64[v & 63] : '=');
+}
+
+void ClipboardStart(void)
+{
+	clipnrest = 0;
+	AddStr("\033]52;c;");
+}
+
+void ClipboardPut(char *buf, size_t len)
+{
+	unsigned char *s = (unsigned char *)buf;
+
+	/* finish the group left over from the last piece first */
+	while (clipnrest && len) {
+		cliprest[clipnrest++] = *s++;
+		len--;
+		if (clipnrest == 3) {
+			clipquad(cliprest, 3);
+			clipnrest = 0;
+		}
+	}
+	for (; len >= 3; s += 3, len -= 3) {
+		clipquad(s, 3);
+		if (D_obufp - D_obuf >= CLIPCHUNK)
+			Flush(0);
+	}
+	while (len--)
+		cliprest[clipnrest++] = *s++;
+}
+
+void ClipboardEnd(void)
+{
+	if (clipnrest)
+		clipquad(cliprest, clipnrest);
+	AddStr("\a");
+	Flush(0);
+}
+
 /*
  *  Output buffering routines
  */
@@ -2343,6 +2982,110 @@ void AddStrn(char *str, int n)
 		AddChar(' ');
 }
 
+/*
+ * ImmorTerm: Add a string without encoding conversion, like AddRawStr().
+ * Long strings (DCS passthrough) are not copied into the output buffer if
+ * the display can take them right now: the pending buffer and the string
+ * go out with a single writev(), and only what the tty did not accept is
+ * buffered.
+ */
+void AddRawRef(char *str)
+{
+	struct iovec iov[2];
+	size_t len = strlen(str);
+	ssize_t wr;
+	int l;
+
+	if (!display)
+		return;
+	if (len < OUTPUT_REF_MIN || D_userfd < 0 || D_blocked || D_status_obufpos) {
+		AddRawStr(str);
+		return;
+	}
+	l = D_obufp - D_obuf;
+	iov[0].iov_base = D_obuf;
+	iov[0].iov_len = l;
+	iov[1].iov_base = str;
+	iov[1].iov_len = len;
+	do
+		wr = writev(D_userfd, iov, ARRAY_SIZE(iov));
+	while (wr < 0 && errno == EINTR);
+	if (wr < 0)
+		wr = 0;
+	D_nwrites++;
+	D_nwritten += wr;
+	if (D_blocked_fuzz) {
+		D_blocked_fuzz -= wr;
+		if (D_blocked_fuzz < 0)
+			D_blocked_fuzz = 0;
+	}
+	if (wr < l) {
+		memmove(D_obuf, D_obuf + wr, l - wr);
+		D_obufp -= wr;
+		D_obuffree += wr;
+		AddRawStr(str);
+		return;
+	}
+	D_obufp = D_obuf;
+	D_obuffree += l;
+	AddRawStr(str + (wr - l));
+}
+
+/*
+ * ImmorTerm: whether d shows what od shows on the same kind of terminal:
+ * then what we send od for a layer also goes to d once their d_out agree,
+ * see Fanout() in layer.c. Only plain displays qualify: one canvas, no
+ * caption and no hardstatus line, as those are rendered per display.
+ */
+bool DisplayMirrors(Display *d, Display *od)
+{
+	Canvas *cv = d->d_cvlist, *ocv = od->d_cvlist;
+	Viewport *vp, *ovp;
+
+	if (d == od || d->d_tchash != od->d_tchash || d->d_encoding != od->d_encoding
+	    || d->d_width != od->d_width || d->d_height != od->d_height)
+		return false;
+	if (d->d_blocked || od->d_blocked || d->d_status || od->d_status
+	    || d->d_status_obufpos || od->d_status_obufpos || captionalways)
+		return false;
+	if (d->d_has_hstatus == HSTATUS_LASTLINE || d->d_has_hstatus == HSTATUS_FIRSTLINE
+	    || od->d_has_hstatus == HSTATUS_LASTLINE || od->d_has_hstatus == HSTATUS_FIRSTLINE)
+		return false;
+	if (!cv || !ocv || cv->c_next || ocv->c_next || cv != d->d_forecv || ocv != od->d_forecv)
+		return false;
+	if (cv->c_layer != ocv->c_layer || cv->c_xs != ocv->c_xs || cv->c_xe != ocv->c_xe
+	    || cv->c_ys != ocv->c_ys || cv->c_ye != ocv->c_ye || cv->c_xoff != ocv->c_xoff
+	    || cv->c_yoff != ocv->c_yoff || cv->c_slorient != ocv->c_slorient)
+		return false;
+	for (vp = cv->c_vplist, ovp = ocv->c_vplist; vp && ovp; vp = vp->v_next, ovp = ovp->v_next)
+		if (vp->v_xs != ovp->v_xs || vp->v_xe != ovp->v_xe || vp->v_ys != ovp->v_ys
+		    || vp->v_ye != ovp->v_ye || vp->v_xoff != ovp->v_xoff || vp->v_yoff != ovp->v_yoff)
+			return false;
+	return vp == ovp;
+}
+
+/*
+ * ImmorTerm: give the display what was added to the output buffer of od
+ * since off, and the state that leaves od in.
+ */
+void MirrorOutput(Display *od, int off)
+{
+	int n = od->d_obufp - od->d_obuf - off;
+
+	if (n > 0) {
+		while (D_obuffree <= n)
+			Resize_obuf();
+		memcpy(D_obufp, od->d_obuf + off, n);
+		D_obufp += n;
+		D_obuffree -= n;
+	}
+	memcpy(&display->d_out, &od->d_out, sizeof(struct dispout));
+}
+
+/*
+ * Write out the whole output buffer. D_userfd stays non-blocking; without
+ * a progress timeout we simply wait in poll() whenever the tty is full.
+ */
 void Flush(int progress)
 {
 	int l;
@@ -2352,15 +3095,14 @@ void Flush(int progress)
 	l = D_obufp - D_obuf;
 	if (l == 0)
 		return;
+	TRACE2(flush, D_userfd, l);
 	if (D_userfd < 0) {
 		D_obuffree += l;
 		D_obufp = D_obuf;
 		return;
 	}
+	D_nflushes++;
 	p = D_obuf;
-	if (!progress) {
-		fcntl(D_userfd, F_SETFL, 0);
-	}
 	while (l) {
 		if (progress) {
 			struct pollfd pfd[1];
@@ -2381,25 +3123,51 @@ void Flush(int progress)
 			}
 		}
 		wr = write(D_userfd, p, l);
+		D_nwrites++;
 		if (wr <= 0) {
 			if (errno == EINTR)
 				continue;
+			if (!progress && (errno == EAGAIN
+#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+					  || errno == EWOULDBLOCK
+#endif
+			    )) {
+				struct pollfd pfd[1];
+
+				pfd[0].fd = D_userfd;
+				pfd[0].events = POLLOUT;
+				if (poll(pfd, ARRAY_SIZE(pfd), -1) >= 0 || errno == EINTR)
+					continue;
+			}
 			break;
 		}
+		D_nwritten += wr;
+		StartupTrace(STARTUP_FLUSH);
 		D_obuffree += wr;
 		p += wr;
 		l -= wr;
 	}
 	D_obuffree += l;
 	D_obufp = D_obuf;
-	if (!progress) {
-		fcntl(D_userfd, F_SETFL, FNBLOCK);
-	}
 	if (D_blocked == 1)
-		D_blocked = 0;
+		SetBlocked(0);
 	D_blocked_fuzz = 0;
 }
 
+/*
+ * ImmorTerm: all changes of D_blocked go through here, so that the time
+ * output to the display was blocked (1, the others are zmodem and the
+ * blanker) can be counted for the stats command.
+ */
+void SetBlocked(int blocked)
+{
+	if (D_blocked != 1 && blocked == 1)
+		D_blockedsince = SchedNow();
+	else if (D_blocked == 1 && blocked != 1)
+		D_blockedms += SchedNow() - D_blockedsince;
+	D_blocked = blocked;
+}
+
 void freetty(void)
 {
 	if (D_userfd >= 0)
@@ -2412,7 +3180,7 @@ void freetty(void)
 	D_obuf = NULL;
 	D_obuflen = 0;
 	D_obuflenmax = -D_obufmax;
-	D_blocked = 0;
+	SetBlocked(0);
 	D_blocked_fuzz = 0;
 }
 
@@ -2543,6 +3311,7 @@ static void disp_writeev_eagain(Event *event, void *data)
 	evdeq(&D_writeev);
 	D_writeev.type = EV_WRITE;
 	D_writeev.handler = disp_writeev_fn;
+	D_writeev.name = "disp_writeev_fn";
 	evenq(&D_writeev);
 }
 
@@ -2559,7 +3328,10 @@ static void disp_writeev_fn(Event *event, void *data)
 	if (D_status_obufpos && size > D_status_obufpos)
 		size = D_status_obufpos;
 	size = write(D_userfd, D_obuf, size);
+	D_nwrites++;
 	if (size >= 0) {
+		D_nwritten += size;
+		StartupTrace(STARTUP_FLUSH);
 		len -= size;
 		if (len) {
 			memmove(D_obuf, D_obuf + size, len);
@@ -2578,7 +3350,7 @@ static void disp_writeev_fn(Event *event, void *data)
 					 * ResizeObuf */
 					D_obuffree = D_obuflen = 0;
 				}
-				gettimeofday(&D_status_time, NULL);
+				D_status_time = SchedNow();
 				SetTimeout(&D_statusev, MsgWait);
 				evenq(&D_statusev);
 			}
@@ -2597,7 +3369,7 @@ static void disp_writeev_fn(Event *event, void *data)
 		}
 		if (D_blocked == 1 && D_obuf == D_obufp) {
 			/* empty again, restart output */
-			D_blocked = 0;
+			SetBlocked(0);
 			Activate(D_fore ? D_fore->w_norefresh : 0);
 			D_blocked_fuzz = D_obufp - D_obuf;
 			/* Check for deferred hardstatus refresh (resize during D_blocked) */
@@ -2612,6 +3384,7 @@ static void disp_writeev_fn(Event *event, void *data)
 			evdeq(&D_writeev);
 			D_writeev.type = EV_TIMEOUT;
 			D_writeev.handler = disp_writeev_eagain;
+			D_writeev.name = "disp_writeev_eagain";
 			SetTimeout(&D_writeev, 100);
 			evenq(&D_writeev);
 		}
@@ -2683,7 +3456,7 @@ static void disp_readev_fn(Event *event, void *data)
 		return;
 	}
 	if (D_blocked == 4) {
-		D_blocked = 0;
+		SetBlocked(0);
 		KillBlanker();
 		Activate(D_fore ? D_fore->w_norefresh : 0);
 		ResetIdle();
@@ -2710,6 +3483,9 @@ static void disp_readev_fn(Event *event, void *data)
 		unsigned char *bp = (unsigned char *)buf;
 		unsigned char *end = bp + size;
 		unsigned char *mark = NULL;
+		unsigned char *motion = NULL;	/* ImmorTerm: see CSI_DONE */
+		int motionlen = 0, motionpb = 0;
+		Layer *motionlayer = NULL;
 
 		/* When mouse mode is enabled, buffer up incoming CSI until we
 		 * know whether it is a mouse sequence. If not a mouse event,
@@ -2829,56 +3605,75 @@ static void disp_readev_fn(Event *event, void *data)
 
 				buf = bp;
 				size = end - bp;
+				motion = NULL;
 				D_mouse_parse.state = CSI_INACTIVE;
 			} else if (D_mouse_parse.state == CSI_DONE) {
-				/* emit whatever came before this sequence */
-				if (buf < mark)
-					disp_processinput(display, buf, mark - buf);
-
-				buf = bp;
-				size = end - bp;
-
 				int x = D_mouse_parse.params[CSI_PX];
 				int y = D_mouse_parse.params[CSI_PY];
 				int bias = D_mouse_parse.sgrmode? 1 : 33;
+				/* ImmorTerm: motion reports (button code 32 and up) */
+				bool moved = (D_mouse_parse.params[CSI_PB] - (D_mouse_parse.sgrmode ? 0 : 32)) & 32;
+				bool inside, forward = false;
 
 				x -= bias;
 				y -= bias;
 
-				if (x >= D_forecv->c_xs && x <= D_forecv->c_xe && y >= D_forecv->c_ys && y <= D_forecv->c_ye) {
-					if ((D_fore && D_fore->w_mouse) || (D_mousetrack && D_forecv->c_layer->l_mode == 1)) {
-						/* Send clicks only if the window is expecting clicks */
-						x -= D_forecv->c_xoff;
-						y -= D_forecv->c_yoff;
-
-						if (x >= 0 && x < D_forecv->c_layer->l_width && y >= 0 && y < D_forecv->c_layer->l_height) {
-							char tmp[MAX_MOUSE_SEQUENCE+1];
-							int n;
-
-							x += bias;
-							y += bias;
-
-							if (D_mouse_parse.sgrmode) {
-								n = snprintf(
-								tmp, MAX_MOUSE_SEQUENCE, "\033[<%d;%d;%d%c",
-								D_mouse_parse.params[CSI_PB], x, y, c);
-							} else {
-								n = snprintf(
-								tmp, MAX_MOUSE_SEQUENCE, "\033[M%c%c%c",
-								D_mouse_parse.params[CSI_PB], x, y);
-							}
-
-							if (n > MAX_MOUSE_SEQUENCE)
-								n = MAX_MOUSE_SEQUENCE;
-
-							/* emit sequence */
-
-							buf -= n;
-							size += n;
-							memmove(buf, tmp, n);
-						}
+				inside = x >= D_forecv->c_xs && x <= D_forecv->c_xe && y >= D_forecv->c_ys && y <= D_forecv->c_ye;
+				if (inside && ((D_fore && D_fore->w_mouse) || (D_mousetrack && D_forecv->c_layer->l_mode == 1))) {
+					/* Send clicks only if the window is expecting clicks */
+					x -= D_forecv->c_xoff;
+					y -= D_forecv->c_yoff;
+					forward = x >= 0 && x < D_forecv->c_layer->l_width && y >= 0 && y < D_forecv->c_layer->l_height;
+				}
+
+				/* ImmorTerm: a motion report right behind another one
+				 * with the same buttons, going to the same layer,
+				 * replaces it: of a drag read at once only the last
+				 * position goes to the window. Presses, releases,
+				 * reports not sent on and anything between stay as
+				 * they came */
+				if (forward && moved && motion == buf && mark == motion + motionlen
+				    && D_mouse_parse.params[CSI_PB] == motionpb && D_forecv->c_layer == motionlayer)
+					;
+				else if (buf < mark)	/* emit whatever came before this sequence */
+					disp_processinput(display, buf, mark - buf);
+				motion = NULL;
+
+				buf = bp;
+				size = end - bp;
+
+				if (forward) {
+					char tmp[MAX_MOUSE_SEQUENCE+1];
+					int n;
+
+					x += bias;
+					y += bias;
+
+					if (D_mouse_parse.sgrmode) {
+						n = snprintf(
+						tmp, MAX_MOUSE_SEQUENCE, "\033[<%d;%d;%d%c",
+						D_mouse_parse.params[CSI_PB], x, y, c);
+					} else {
+						n = snprintf(
+						tmp, MAX_MOUSE_SEQUENCE, "\033[M%c%c%c",
+						D_mouse_parse.params[CSI_PB], x, y);
 					}
-				} else if (D_mousetrack) {
+
+					if (n > MAX_MOUSE_SEQUENCE)
+						n = MAX_MOUSE_SEQUENCE;
+
+					/* emit sequence */
+
+					buf -= n;
+					size += n;
+					memmove(buf, tmp, n);
+					if (moved) {
+						motion = buf;
+						motionlen = n;
+						motionpb = D_mouse_parse.params[CSI_PB];
+						motionlayer = D_forecv->c_layer;
+					}
+				} else if (!inside && D_mousetrack) {
 					/* 'focus' to the clicked region, only on mouse up */
 					int focus = 0;
 					if (D_mouse_parse.sgrmode)
@@ -2990,7 +3785,7 @@ static void disp_blocked_fn(Event *event, void *data)
 
 	display = (Display *)data;
 	if (D_obufp - D_obuf > D_obufmax + D_blocked_fuzz) {
-		D_blocked = 1;
+		SetBlocked(1);
 		/* re-enable all windows */
 		for (Window *p = mru_window; p; p = p->w_prev_mru)
 			if (p->w_readev.condneg == &D_obuflenmax) {
@@ -3001,28 +3796,26 @@ static void disp_blocked_fn(Event *event, void *data)
 
 static void disp_map_fn(Event *event, void *data)
 {
-	char *p;
+	char *p, seq[256];
 	int l, i;
-	unsigned char *q;
 
 	(void)event; /* unused */
 
 	display = (Display *)data;
 	if (!(l = D_seql))
 		return;
-	p = (char *)D_seqp - l;
-	D_seqp = D_kmaps + 3;
+	memcpy(seq, D_seqb, l);
+	p = seq;
+	D_seqn = 0;
 	D_seql = 0;
-	if ((q = D_seqh) != NULL) {
-		D_seqh = NULL;
-		i = q[0] << 8 | q[1];
-		i &= ~KMAP_NOTIMEOUT;
-		if (StuffKey(i))
-			ProcessInput2((char *)q + 3, q[2]);
+	if ((i = D_seqhl) != 0) {
+		D_seqhl = 0;
+		if (StuffKey(D_seqh))
+			ProcessInput2(p, i);
 		if (display == NULL)
 			return;
-		l -= q[2];
-		p += q[2];
+		l -= i;
+		p += i;
 	} else
 		D_dontmap = 1;
 	ProcessInput(p, l);
@@ -3087,7 +3880,7 @@ void KillBlanker(void)
 	if (D_blankerev.fd == -1)
 		return;
 	if (D_blocked == 4)
-		D_blocked = 0;
+		SetBlocked(0);
 	evdeq(&D_blankerev);
 	ClosePTY(D_blankerev.fd);
 	D_blankerev.fd = -1;
@@ -3195,7 +3988,7 @@ void RunBlanker(char **cmdv)
 	}
 	D_blankerpid = pid;
 	evenq(&D_blankerev);
-	D_blocked = 4;
+	SetBlocked(4);
 	ClearAll();
 	if (slave != -1)
 		close(slave);
@@ -50,6 +50,20 @@ struct kmap_ext {
 	struct action mm;
 };
 
+/*
+ * D_kmaps compiled into a trie, see CompileKmaps(). The children of a
+ * node are consecutive and in byte order: bit c of bits says whether c
+ * has one, and which comes from counting the bits below it.
+ */
+struct kmnode {
+	uint64_t bits[4];
+	uint32_t child;		/* first child */
+	uint16_t nr;		/* key of the sequence ending here or KMNODE_NONE */
+	bool	notimeout;	/* a longer sequence is not to time out */
+};
+
+#define KMNODE_NONE 0xffff
+
 typedef enum {
 	STATUS_OFF	= 0,
 	STATUS_ON_WIN	= 1,
@@ -81,6 +95,60 @@ struct mouse_parse {
 	int params[3];			/* parsed params: button, x, y */
 };
 
+/* ImmorTerm: parametrized cursor motions, expanded once per distance */
+enum {
+	MV_CRI,
+	MV_CLE,
+	MV_CDO,
+	MV_CUP,
+	MV_COUNT
+};
+
+#define MOVE_CACHE	256	/* distances kept per motion */
+#define MOVE_STRLEN	12	/* longest motion kept */
+
+#define SGR_CACHE_BITS	8	/* colors kept per display: 1 << SGR_CACHE_BITS */
+#define SGR_STRLEN	23	/* longest color sequence kept */
+
+struct sgrslot {
+	uint32_t key;
+	bool valid;
+	unsigned char len;
+	char str[SGR_STRLEN];
+};
+
+struct movecache {
+	unsigned char len[MOVE_CACHE];	/* 0: not kept, ask termcap */
+	char str[MOVE_CACHE][MOVE_STRLEN];
+};
+
+/*
+ * ImmorTerm: the state our output leaves the terminal of a display in.
+ * Displays in the same state get the same output, see DisplayMirrors().
+ */
+struct dispout {
+	int	top, bot;		/* scrollregion start/end */
+	int	x, y;			/* cursor position */
+	struct mchar rend;		/* current rendition */
+	struct mchar lpchar;		/* missing char */
+	int	mbcs;			/* saved char for multibytes charset */
+	int	realfont;		/* real font of terminal */
+	int	keypad;			/* application keypad flag */
+	int	cursorkeys;		/* application cursorkeys flag */
+	int	curvis;			/* cursor visibility */
+	int	lp_missing;		/* last character on bot line missing */
+	int	mouse;			/* mouse mode */
+	int	extmouse;		/* extended mouse mode */
+	int	bracketed;		/* bracketed paste mode */
+	int	syncdepth;		/* nesting of SyncBegin() */
+	int	cursorstyle;		/* cursor style */
+	int	xtermosc[5];		/* osc used */
+	char	atyp;			/* current attribute types */
+	bool	insert;			/* insert mode flag */
+	bool	revvid;			/* reverse video */
+	bool	synced;			/* sent the start of a synchronized update */
+};
+
 typedef struct Display Display;
 struct Display {
 	Display *d_next;		/* linked list */
@@ -101,36 +169,22 @@ struct Display {
 	char	d_tcinited;		/* termcap inited flag */
 	int	d_width, d_height;	/* width/height of the screen */
 	int	d_defwidth, d_defheight;	/* default width/height of windows */
-	int	d_top, d_bot;		/* scrollregion start/end */
-	int	d_x, d_y;		/* cursor position */
-	struct mchar d_rend;		/* current rendition */
-	char	d_atyp;			/* current attribute types */
-	int   d_mbcs;			/* saved char for multibytes charset */
+	struct dispout d_out;		/* ImmorTerm: state of the terminal */
 	int   d_encoding;		/* what encoding type the display is */
 	int   d_decodestate;		/* state of our decoder */
-	int   d_realfont;		/* real font of terminal */
-	bool	d_insert;		/* insert mode flag */
-	int	d_keypad;		/* application keypad flag */
-	int	d_cursorkeys;		/* application cursorkeys flag */
-	bool	d_revvid;		/* reverse video */
-	int	d_curvis;		/* cursor visibility */
 	HardStatus	d_has_hstatus;		/* display has hardstatus line */
 	bool d_hstatus;		/* hardstatus used */
-	int	d_lp_missing;		/* last character on bot line missing */
-	int	d_mouse;			/* mouse mode */
-	int	d_extmouse;		/* extended mouse mode */
 	struct mouse_parse d_mouse_parse;	/* state of mouse code parsing */
 	int	d_mousetrack;		/* set when user wants to use mouse even when the window
 					   does not */
-	int   d_bracketed;		/* bracketed paste mode */
-	int   d_cursorstyle;		/* cursor style */
-	int   d_xtermosc[5];		/* osc used */
-	struct mchar d_lpchar;		/* missing char */
-	struct timeval d_status_time;	/* time of status display */
+	int	d_status_time;		/* time of status display (SchedNow()) */
 	DisplayStatus   d_status;			/* is status displayed? */
 	char	d_status_bell;		/* is it only a vbell? */
 	int	d_status_len;		/* length of status line */
 	char *d_status_lastmsg;		/* last displayed message */
+	char *d_hstatus_shown;		/* ImmorTerm: what the hardstatus line shows, see HStatusShown() */
+	size_t d_hstatus_shownlen;	/* its length, 0 = unknown */
+	size_t d_hstatus_shownsize;	/* allocated */
 	int   d_status_buflen;		/* last message buffer len */
 	int	d_status_lastx;		/* position of the cursor */
 	int	d_status_lasty;		/*   before status was displayed */
@@ -144,6 +198,7 @@ struct Display {
 	pid_t	d_userpid;		/* pid of attacher */
 	char	d_usertty[MAXPATHLEN];	/* tty we are attached to */
 	int	d_userfd;		/* fd of the tty */
+	struct Hosted *d_hosted;	/* ImmorTerm: the hosted session it is attached to */
 	Event d_readev;		/* userfd read event */
 	Event d_writeev;		/* userfd write event */
 	Event d_blockedev;	/* blocked timeout */
@@ -157,17 +212,26 @@ struct Display {
 	int	d_obuflenmax;		/* len - max */
 	char *d_obufp;			/* pointer in buffer */
 	int   d_obuffree;		/* free bytes in buffer */
+	unsigned long d_nflushes;	/* ImmorTerm: Flush() calls */
+	unsigned long d_nwrites;	/* ImmorTerm: write syscalls to userfd */
+	unsigned long d_nwritten;	/* ImmorTerm: bytes written to userfd */
+	uint64_t d_blockedms;		/* ImmorTerm: time output was blocked, see SetBlocked() */
+	int	d_blockedsince;		/* SchedNow() when it was blocked */
 	bool	d_auto_nuke;		/* autonuke flag */
 	int	d_nseqs;		/* number of valid mappings */
 	int	d_aseqs;		/* number of allocated mappings */
 	unsigned char  *d_kmaps;	/* keymaps */
-	unsigned char *d_seqp;		/* pointer into keymap array */
+	struct kmnode *d_kmtrie;	/* keymaps compiled, NULL if not yet */
+	uint32_t d_seqn;		/* trie node of the parsed chars */
 	int	d_seql;			/* number of parsed chars */
-	unsigned char *d_seqh;		/* last hit */
+	unsigned char d_seqb[256];	/* the parsed chars */
+	int	d_seqh;			/* key of the last hit */
+	int	d_seqhl;		/* its length, 0 if there is none */
 	Event d_mapev;		/* timeout event */
 	int	d_dontmap;		/* do not map next */
 	int	d_mapdefault;		/* do map next to default */
 	union	tcu d_tcs[T_N];		/* terminal capabilities */
+	uint64_t d_tchash;		/* ImmorTerm: hash of them, see DisplayMirrors() */
 	char *d_attrtab[NATTR];		/* attrib emulation table */
 	char  d_attrtyp[NATTR];		/* attrib group table */
 	int   d_hascolor;		/* do we support color */
@@ -175,6 +239,11 @@ struct Display {
 	char ***d_xtable;		/* char translation table */
 	int	d_UPcost, d_DOcost, d_LEcost, d_NDcost;
 	int	d_CRcost, d_IMcost, d_EIcost, d_NLcost;
+	struct movecache d_moves[MV_COUNT];	/* ImmorTerm: expanded CRI/CLE/CDO/CUP */
+	unsigned char *d_CMcosts;	/* ImmorTerm: cost of CM to x,y plus one, 0 = unknown */
+	int	d_CMcostw, d_CMcosth;	/* size of d_CMcosts */
+	struct sgrslot d_sgrfg[1 << SGR_CACHE_BITS];	/* ImmorTerm: encoded foreground colors */
+	struct sgrslot d_sgrbg[1 << SGR_CACHE_BITS];	/* ImmorTerm: encoded background colors */
 	int   d_printfd;		/* fd for vt100 print sequence */
 #ifdef ENABLE_UTMP
 	slot_t d_loginslot;		/* offset, where utmp_logintty belongs */
@@ -188,14 +257,20 @@ struct Display {
 	pid_t   d_blankerpid;
 	Event d_blankerev;
 	Event d_mousetimeoutev;		/* mouse sequence timeout event */
+	Event d_dumpev;			/* ImmorTerm: replays history, see DumpScrollbackStart() */
+	Window *d_dumpwin;		/* whose history, NULL if none */
+	int	d_dumpleft;		/* lines still to go */
+	int	d_dumptotal, d_dumpwidth;	/* history and width it started with */
 };
 
 #define DISPLAY(x) display->x
 
 #define D_user		DISPLAY(d_user)
 #define D_username	(DISPLAY(d_user) ? DISPLAY(d_user)->u_name : 0)
-#define D_bracketed	DISPLAY(d_bracketed)
-#define D_cursorstyle	DISPLAY(d_cursorstyle)
+#define D_bracketed	DISPLAY(d_out.bracketed)
+#define D_syncdepth	DISPLAY(d_out.syncdepth)
+#define D_synced	DISPLAY(d_out.synced)
+#define D_cursorstyle	DISPLAY(d_out.cursorstyle)
 #define D_canvas	DISPLAY(d_canvas)
 #define D_cvlist	DISPLAY(d_cvlist)
 #define D_layout	DISPLAY(d_layout)
@@ -214,35 +289,38 @@ struct Display {
 #define D_height	DISPLAY(d_height)
 #define D_defwidth	DISPLAY(d_defwidth)
 #define D_defheight	DISPLAY(d_defheight)
-#define D_top		DISPLAY(d_top)
-#define D_bot		DISPLAY(d_bot)
-#define D_x		DISPLAY(d_x)
-#define D_y		DISPLAY(d_y)
-#define D_rend		DISPLAY(d_rend)
-#define D_atyp		DISPLAY(d_atyp)
-#define D_mbcs		DISPLAY(d_mbcs)
+#define D_top		DISPLAY(d_out.top)
+#define D_bot		DISPLAY(d_out.bot)
+#define D_x		DISPLAY(d_out.x)
+#define D_y		DISPLAY(d_out.y)
+#define D_rend		DISPLAY(d_out.rend)
+#define D_atyp		DISPLAY(d_out.atyp)
+#define D_mbcs		DISPLAY(d_out.mbcs)
 #define D_encoding	DISPLAY(d_encoding)
 #define D_decodestate	DISPLAY(d_decodestate)
-#define D_realfont	DISPLAY(d_realfont)
-#define D_insert	DISPLAY(d_insert)
-#define D_keypad	DISPLAY(d_keypad)
-#define D_cursorkeys	DISPLAY(d_cursorkeys)
-#define D_revvid	DISPLAY(d_revvid)
-#define D_curvis	DISPLAY(d_curvis)
+#define D_realfont	DISPLAY(d_out.realfont)
+#define D_insert	DISPLAY(d_out.insert)
+#define D_keypad	DISPLAY(d_out.keypad)
+#define D_cursorkeys	DISPLAY(d_out.cursorkeys)
+#define D_revvid	DISPLAY(d_out.revvid)
+#define D_curvis	DISPLAY(d_out.curvis)
 #define D_has_hstatus	DISPLAY(d_has_hstatus)
 #define D_hstatus	DISPLAY(d_hstatus)
-#define D_lp_missing	DISPLAY(d_lp_missing)
-#define D_mouse		DISPLAY(d_mouse)
+#define D_lp_missing	DISPLAY(d_out.lp_missing)
+#define D_mouse		DISPLAY(d_out.mouse)
 #define D_mouse_parse	DISPLAY(d_mouse_parse)
-#define D_extmouse	DISPLAY(d_extmouse)
+#define D_extmouse	DISPLAY(d_out.extmouse)
 #define D_mousetrack	DISPLAY(d_mousetrack)
-#define D_xtermosc	DISPLAY(d_xtermosc)
-#define D_lpchar	DISPLAY(d_lpchar)
+#define D_xtermosc	DISPLAY(d_out.xtermosc)
+#define D_lpchar	DISPLAY(d_out.lpchar)
 #define D_status	DISPLAY(d_status)
 #define D_status_time	DISPLAY(d_status_time)
 #define D_status_bell	DISPLAY(d_status_bell)
 #define D_status_len	DISPLAY(d_status_len)
 #define D_status_lastmsg	DISPLAY(d_status_lastmsg)
+#define D_hstatus_shown	DISPLAY(d_hstatus_shown)
+#define D_hstatus_shownlen	DISPLAY(d_hstatus_shownlen)
+#define D_hstatus_shownsize	DISPLAY(d_hstatus_shownsize)
 #define D_status_buflen	DISPLAY(d_status_buflen)
 #define D_status_lastx	DISPLAY(d_status_lastx)
 #define D_status_lasty	DISPLAY(d_status_lasty)
@@ -256,6 +334,7 @@ struct Display {
 #define D_userpid	DISPLAY(d_userpid)
 #define D_usertty	DISPLAY(d_usertty)
 #define D_userfd	DISPLAY(d_userfd)
+#define D_hosted	DISPLAY(d_hosted)
 #define D_OldMode	DISPLAY(d_OldMode)
 #define D_NewMode	DISPLAY(d_NewMode)
 #define D_flow		DISPLAY(d_flow)
@@ -266,16 +345,25 @@ struct Display {
 #define D_obuflenmax	DISPLAY(d_obuflenmax)
 #define D_obufp		DISPLAY(d_obufp)
 #define D_obuffree	DISPLAY(d_obuffree)
+#define D_nflushes	DISPLAY(d_nflushes)
+#define D_nwrites	DISPLAY(d_nwrites)
+#define D_nwritten	DISPLAY(d_nwritten)
+#define D_blockedms	DISPLAY(d_blockedms)
+#define D_blockedsince	DISPLAY(d_blockedsince)
 #define D_auto_nuke	DISPLAY(d_auto_nuke)
 #define D_nseqs		DISPLAY(d_nseqs)
 #define D_aseqs		DISPLAY(d_aseqs)
-#define D_seqp		DISPLAY(d_seqp)
+#define D_kmtrie	DISPLAY(d_kmtrie)
+#define D_seqn		DISPLAY(d_seqn)
 #define D_seql		DISPLAY(d_seql)
+#define D_seqb		DISPLAY(d_seqb)
 #define D_seqh		DISPLAY(d_seqh)
+#define D_seqhl		DISPLAY(d_seqhl)
 #define D_dontmap	DISPLAY(d_dontmap)
 #define D_mapdefault	DISPLAY(d_mapdefault)
 #define D_kmaps		DISPLAY(d_kmaps)
 #define D_tcs		DISPLAY(d_tcs)
+#define D_tchash	DISPLAY(d_tchash)
 #define D_attrtab	DISPLAY(d_attrtab)
 #define D_attrtyp	DISPLAY(d_attrtyp)
 #define D_hascolor	DISPLAY(d_hascolor)
@@ -286,6 +374,12 @@ struct Display {
 #define D_LEcost	DISPLAY(d_LEcost)
 #define D_NDcost	DISPLAY(d_NDcost)
 #define D_CRcost	DISPLAY(d_CRcost)
+#define D_moves		DISPLAY(d_moves)
+#define D_CMcosts	DISPLAY(d_CMcosts)
+#define D_CMcostw	DISPLAY(d_CMcostw)
+#define D_CMcosth	DISPLAY(d_CMcosth)
+#define D_sgrfg		DISPLAY(d_sgrfg)
+#define D_sgrbg		DISPLAY(d_sgrbg)
 #define D_IMcost	DISPLAY(d_IMcost)
 #define D_EIcost	DISPLAY(d_EIcost)
 #define D_NLcost	DISPLAY(d_NLcost)
@@ -305,12 +399,18 @@ struct Display {
 #define D_blankerev	DISPLAY(d_blankerev)
 #define D_blankerpid	DISPLAY(d_blankerpid)
 #define D_mousetimeoutev	DISPLAY(d_mousetimeoutev)
+#define D_dumpev	DISPLAY(d_dumpev)
+#define D_dumpwin	DISPLAY(d_dumpwin)
+#define D_dumpleft	DISPLAY(d_dumpleft)
+#define D_dumptotal	DISPLAY(d_dumptotal)
+#define D_dumpwidth	DISPLAY(d_dumpwidth)
 
 
 #define GRAIN 4096	/* Allocation grain size for output buffer */
 #define OBUF_MAX 256	/* default for obuflimit */
 
-#define OUTPUT_BLOCK_SIZE 256  /* Block size of output to tty */
+#define OUTPUT_BLOCK_SIZE 16384  /* Block size of output to tty */
+#define OUTPUT_REF_MIN 512	/* AddRawRef() writes strings this long directly */
 
 #define AddChar(c)		\
 do				\
@@ -323,6 +423,7 @@ while (0)
 
 Display *MakeDisplay (char *, char *, char *, int, pid_t, struct mode *);
 void  FreeDisplay (void);
+void  SetBlocked (int);
 void  DefProcess (char **, size_t *);
 void  DefRedisplayLine (int, int, int, int);
 void  DefClearLine (int, int, int, int);
@@ -338,15 +439,21 @@ void  ClearAll (void);
 void  ClearArea (int, int, int, int, int, int, int, int);
 void  ClearLine (struct mline *, int, int, int, int);
 void  RefreshAll (int);
+void  DumpScrollback (Window *);
+void  DumpScrollbackStart (Window *);
+void  DumpScrollbackFinish (Window *, bool);
 void  RefreshArea (int, int, int, int, int);
 void  RefreshLine (int, int, int, int);
 void  Redisplay (int);
 void  RedisplayDisplays (int);
 void  ShowHStatus (char *);
 void  RefreshHStatus (void);
+void  HStatusForget (void);
 void  DisplayLine (struct mline *, struct mline *, int, int, int);
 void  GotoPos (int, int);
 int   CalcCost (char *);
+void  InitMoveCosts (void);
+void  InitSgrCache (void);
 void  ScrollH (int, int, int, int, int, struct mline *);
 void  ScrollV (int, int, int, int, int, int);
 void  PutChar (struct mchar *, int, int);
@@ -361,6 +468,8 @@ void  CursorVisibility (int);
 void  MouseMode (int);
 void  ExtMouseMode (int);
 void  BracketedPasteMode (bool);
+void  SyncBegin (void);
+void  SyncEnd (void);
 void  CursorStyle (int);
 void  SetRendition (struct mchar *);
 void  SetRenditionMline (struct mline *, int);
@@ -370,6 +479,9 @@ int   ResizeDisplay (int, int);
 void  AddStr (char *);
 void  AddRawStr (char *);
 void  AddRawStrn (char *, int);
+void  AddRawRef (char *);
+bool  DisplayMirrors (Display *, Display *);
+void  MirrorOutput (Display *, int);
 void  AddStrn (char *, int);
 void  Flush (int);
 void  freetty (void);
@@ -377,6 +489,9 @@ void  Resize_obuf (void);
 void  NukePending (void);
 void  ClearAllXtermOSC (void);
 void  SetXtermOSC (int, char *, char *);
+void  ClipboardStart (void);
+void  ClipboardPut (char *, size_t);
+void  ClipboardEnd (void);
 void  ResetIdle (void);
 void  RunBlanker (char **);
 void  KillBlanker (void);
@@ -386,6 +501,8 @@ void  ClearScrollbackBuffer (void);
 /* global variables */
 
 extern bool defautonuke;
+extern bool syncoutput;
+extern bool fastforward;
 
 extern int captionalways;
 extern int captiontop;
@@ -27,16 +27,22 @@
 
 #include <sys/types.h>
 #include <stdint.h>
-#include <wchar.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include "screen.h"
+#include "cell.h"
 #include "fileio.h"
 #include "misc.h"
+#include "resize.h"
+#include "unitables.h"
 
 static int encmatch(char *, char *);
 static int recode_char(int, int, int);
 static int recode_char_to_encoding(int, int);
-static void comb_tofront(int);
 static int recode_char_dw(int, int *, int, int);
 static int recode_char_dw_to_encoding(int, int *, int);
 
@@ -531,19 +537,99 @@ struct mline *recode_mline(struct mline *ml, int w, int from, int to)
 	return rl;
 }
 
+/*
+ * A character with combining marks is stored in a cell as one code
+ * from UCS_COMB on: entry code - UCS_COMB of combchars is the character
+ * before the last mark (a code of this kind again for more marks) and
+ * that mark. Entries are interned through a hash table and never
+ * reused, so a code in old history always means what it meant when it
+ * was written.
+ */
 struct combchar {
-	unsigned int c1;
-	unsigned int c2;
-	unsigned int next;
-	unsigned int prev;
+	uint32_t c1;
+	uint32_t c2;
+	unsigned char dw;	/* double width */
+	unsigned char nmarks;
 };
-struct combchar **combchars;
+
+static struct combchar *combchars;
+static size_t ncombchars, combcharsmax;
+static uint32_t *combhash;	/* entry + 1, 0 is empty */
+static size_t combhashsize;
+
+static inline struct combchar *combget(uint32_t c)
+{
+	return c >= UCS_COMB && c - UCS_COMB < ncombchars ? &combchars[c - UCS_COMB] : NULL;
+}
+
+static inline size_t combslot(uint32_t c1, uint32_t c2)
+{
+	return ((c1 * 0x9e3779b1u) ^ (c2 * 0x85ebca6bu)) & (combhashsize - 1);
+}
+
+/* code of c1 followed by mark c2, 0 if the store is full */
+static uint32_t comb_intern(uint32_t c1, uint32_t c2, bool dw, int nmarks)
+{
+	size_t i;
+	uint32_t e;
+
+	if (combhashsize) {
+		for (i = combslot(c1, c2); (e = combhash[i]); i = (i + 1) & (combhashsize - 1))
+			if (combchars[e - 1].c1 == c1 && combchars[e - 1].c2 == c2)
+				return UCS_COMB + e - 1;
+	}
+	if (ncombchars == UCS_COMBMAX)
+		return 0;
+	if (ncombchars == combcharsmax) {
+		size_t n = combcharsmax ? combcharsmax * 2 : 256;
+		struct combchar *nc = realloc(combchars, n * sizeof(struct combchar));
+
+		if (!nc)
+			return 0;
+		combchars = nc;
+		combcharsmax = n;
+	}
+	if (2 * (ncombchars + 1) > combhashsize) {
+		size_t n = combhashsize ? combhashsize * 2 : 512;
+		uint32_t *nh = calloc(n, sizeof(uint32_t));
+
+		if (!nh)
+			return 0;
+		free(combhash);
+		combhash = nh;
+		combhashsize = n;
+		for (e = 0; e < ncombchars; e++) {
+			for (i = combslot(combchars[e].c1, combchars[e].c2); combhash[i]; i = (i + 1) & (n - 1)) ;
+			combhash[i] = e + 1;
+		}
+	}
+	for (i = combslot(c1, c2); combhash[i]; i = (i + 1) & (combhashsize - 1)) ;
+	combchars[ncombchars].c1 = c1;
+	combchars[ncombchars].c2 = c2;
+	combchars[ncombchars].dw = dw;
+	combchars[ncombchars].nmarks = nmarks;
+	combhash[i] = ++ncombchars;
+	return UCS_COMB + ncombchars - 1;
+}
+
+size_t CombCount(void)
+{
+	return ncombchars;
+}
+
+/* bytes the combining table and its hash take */
+size_t CombSize(void)
+{
+	return combcharsmax * sizeof(struct combchar) + combhashsize * sizeof(uint32_t);
+}
 
 void AddUtf8(uint32_t c)
 {
-	if (c >= 0xd800 && c < 0xe000 && combchars && combchars[c - 0xd800]) {
-		AddUtf8(combchars[c - 0xd800]->c1);
-		c = combchars[c - 0xd800]->c2;
+	struct combchar *cc;
+
+	if ((cc = combget(c))) {
+		AddUtf8(cc->c1);
+		c = cc->c2;
 	}
 	if (c >= 0x10000) {
 		AddChar((c & 0x1fc0000) >> 18 ^ 0xf0);
@@ -562,11 +648,12 @@ void AddUtf8(uint32_t c)
 
 size_t ToUtf8_comb(char *p, uint32_t c)
 {
-	int l;
+	struct combchar *cc;
+	size_t l;
 
-	if (c >= 0xd800 && c < 0xe000 && combchars && combchars[c - 0xd800]) {
-		l = ToUtf8_comb(p, combchars[c - 0xd800]->c1);
-		return l + ToUtf8(p ? p + l : NULL, combchars[c - 0xd800]->c2);
+	if ((cc = combget(c))) {
+		l = ToUtf8_comb(p, cc->c1);
+		return l + ToUtf8(p ? p + l : NULL, cc->c2);
 	}
 	return ToUtf8(p, c);
 }
@@ -652,6 +739,89 @@ int FromUtf8(int c, int *utf8charp)
 	return c;
 }
 
+/*
+ * Block version of FromUtf8(): decode up to max code points from buf
+ * into cps. The result is exactly what feeding every byte to FromUtf8()
+ * would give, including UCS_REPL for corrupt sequences and a partial
+ * sequence at the end of buf carried over in *statep.
+ * lens[i] is set to the number of bytes of buf making up cps[i]; this
+ * can be 0 for a sequence that was started in an earlier buffer and
+ * turned out to be corrupt. *usedp is set to the number of bytes
+ * consumed, including those of a trailing partial sequence.
+ */
+size_t FromUtf8Buf(const unsigned char *buf, size_t len, uint32_t *cps, uint8_t *lens, size_t max, size_t *usedp, int *statep)
+{
+	size_t i = 0, n = 0, seqstart = 0;
+	int state = *statep;
+	int c;
+
+	while (i < len && n < max) {
+		if (!state) {
+#if defined(__SSE2__)
+			/* plain ASCII, 16 bytes at a time */
+			while (i + 16 <= len && n + 16 <= max) {
+				const __m128i zero = _mm_setzero_si128();
+				__m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+				__m128i w;
+				if (_mm_movemask_epi8(v))
+					break;
+				w = _mm_unpacklo_epi8(v, zero);
+				_mm_storeu_si128((__m128i *)(cps + n), _mm_unpacklo_epi16(w, zero));
+				_mm_storeu_si128((__m128i *)(cps + n + 4), _mm_unpackhi_epi16(w, zero));
+				w = _mm_unpackhi_epi8(v, zero);
+				_mm_storeu_si128((__m128i *)(cps + n + 8), _mm_unpacklo_epi16(w, zero));
+				_mm_storeu_si128((__m128i *)(cps + n + 12), _mm_unpackhi_epi16(w, zero));
+				memset(lens + n, 1, 16);
+				i += 16;
+				n += 16;
+			}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+			while (i + 16 <= len && n + 16 <= max) {
+				uint8x16_t v = vld1q_u8(buf + i);
+				uint16x8_t w;
+				if (vmaxvq_u8(v) >= 0x80)
+					break;
+				w = vmovl_u8(vget_low_u8(v));
+				vst1q_u32(cps + n, vmovl_u16(vget_low_u16(w)));
+				vst1q_u32(cps + n + 4, vmovl_u16(vget_high_u16(w)));
+				w = vmovl_u8(vget_high_u8(v));
+				vst1q_u32(cps + n + 8, vmovl_u16(vget_low_u16(w)));
+				vst1q_u32(cps + n + 12, vmovl_u16(vget_high_u16(w)));
+				memset(lens + n, 1, 16);
+				i += 16;
+				n += 16;
+			}
+#endif
+			if (i == len || n == max)
+				break;
+			if (buf[i] < 0x80) {
+				cps[n] = buf[i];
+				lens[n++] = 1;
+				i++;
+				continue;
+			}
+			seqstart = i;
+		}
+		c = FromUtf8(buf[i], &state);
+		if (c == -1) {
+			i++;
+			continue;
+		}
+		if (c == -2) {
+			/* emit replacement, then retry this byte */
+			cps[n] = UCS_REPL;
+			lens[n++] = i - seqstart;
+			continue;
+		}
+		i++;
+		cps[n] = c;
+		lens[n++] = i - seqstart;
+	}
+	*statep = state;
+	*usedp = i;
+	return n;
+}
+
 void WinSwitchEncoding(Window *p, int encoding)
 {
 	int i, j, c;
@@ -676,8 +846,16 @@ void WinSwitchEncoding(Window *p, int encoding)
 				}
 			}
 	flayer = oldflayer;
+	HistReflow(p);
+	HistThawAll(p);
 	for (j = 0; j < p->w_height + p->w_histheight; j++) {
-		ml = j < p->w_height ? &p->w_mlines[j] : &p->w_hlines[j - p->w_height];
+		if (j < p->w_height)
+			ml = &p->w_mlines[j];
+		else {
+			/* history lines are packed, recode an expanded copy */
+			ml = &mline_old;
+			cell_unpack(ml, &p->w_hlines[j - p->w_height], p->w_width + 1);
+		}
 		if (ml->font == null && encodings[p->w_encoding].deffont == 0)
 			continue;
 		for (i = 0; i < p->w_width; i++) {
@@ -710,365 +888,61 @@ void WinSwitchEncoding(Window *p, int encoding)
 			ml->image[i] = c & 255;
 			ml->font[i] = c >> 8 & 255;
 		}
+		if (ml == &mline_old)
+			HistStore(p, j - p->w_height, ml);
 	}
+	HistCompress(p);
 	p->w_encoding = encoding;
 	return;
 }
 
-struct interval {
-	uint32_t first;
-	uint32_t last;
-};
-
-/* auxiliary function for binary search in interval table */
-static bool bisearch(const uint32_t ucs, const struct interval *table, const size_t size)
+/*
+ * Width and combining properties come from the two-level tables in
+ * unitables.h: one index byte per 256 code points picks the page they
+ * are in, identical pages are shared.
+ */
+static inline int uniprops(uint32_t c)
 {
-	size_t min = 0;
-	size_t max = size;
-
-	if (ucs < table[0].first || ucs > table[max].last)
+	if (c >= 0x110000)
 		return 0;
-	while (max >= min) {
-		size_t mid = (min + max) / 2;
-		if (ucs > table[mid].last)
-			min = mid + 1;
-		else if (ucs < table[mid].first)
-			max = mid - 1;
-		else
-			return 1;
-	}
-
-	return 0;
+	return uni_pages[uni_index[c >> 8]][c & 0xff];
 }
 
 bool utf8_isdouble(uint32_t c)
 {
-	/* A sorted list of intervals of ambiguous width characters generated by
-	 * https://github.com/GNOME/glib/blob/glib-2-50/glib/gen-unicode-tables.pl */
-	static const struct interval ambiguous[] = {
-		{0x00A1, 0x00A1},
-		{0x00A4, 0x00A4},
-		{0x00A7, 0x00A8},
-		{0x00AA, 0x00AA},
-		{0x00AD, 0x00AE},
-		{0x00B0, 0x00B4},
-		{0x00B6, 0x00BA},
-		{0x00BC, 0x00BF},
-		{0x00C6, 0x00C6},
-		{0x00D0, 0x00D0},
-		{0x00D7, 0x00D8},
-		{0x00DE, 0x00E1},
-		{0x00E6, 0x00E6},
-		{0x00E8, 0x00EA},
-		{0x00EC, 0x00ED},
-		{0x00F0, 0x00F0},
-		{0x00F2, 0x00F3},
-		{0x00F7, 0x00FA},
-		{0x00FC, 0x00FC},
-		{0x00FE, 0x00FE},
-		{0x0101, 0x0101},
-		{0x0111, 0x0111},
-		{0x0113, 0x0113},
-		{0x011B, 0x011B},
-		{0x0126, 0x0127},
-		{0x012B, 0x012B},
-		{0x0131, 0x0133},
-		{0x0138, 0x0138},
-		{0x013F, 0x0142},
-		{0x0144, 0x0144},
-		{0x0148, 0x014B},
-		{0x014D, 0x014D},
-		{0x0152, 0x0153},
-		{0x0166, 0x0167},
-		{0x016B, 0x016B},
-		{0x01CE, 0x01CE},
-		{0x01D0, 0x01D0},
-		{0x01D2, 0x01D2},
-		{0x01D4, 0x01D4},
-		{0x01D6, 0x01D6},
-		{0x01D8, 0x01D8},
-		{0x01DA, 0x01DA},
-		{0x01DC, 0x01DC},
-		{0x0251, 0x0251},
-		{0x0261, 0x0261},
-		{0x02C4, 0x02C4},
-		{0x02C7, 0x02C7},
-		{0x02C9, 0x02CB},
-		{0x02CD, 0x02CD},
-		{0x02D0, 0x02D0},
-		{0x02D8, 0x02DB},
-		{0x02DD, 0x02DD},
-		{0x02DF, 0x02DF},
-		{0x0300, 0x036F},
-		{0x0391, 0x03A1},
-		{0x03A3, 0x03A9},
-		{0x03B1, 0x03C1},
-		{0x03C3, 0x03C9},
-		{0x0401, 0x0401},
-		{0x0410, 0x044F},
-		{0x0451, 0x0451},
-		{0x2010, 0x2010},
-		{0x2013, 0x2016},
-		{0x2018, 0x2019},
-		{0x201C, 0x201D},
-		{0x2020, 0x2022},
-		{0x2024, 0x2027},
-		{0x2030, 0x2030},
-		{0x2032, 0x2033},
-		{0x2035, 0x2035},
-		{0x203B, 0x203B},
-		{0x203E, 0x203E},
-		{0x2074, 0x2074},
-		{0x207F, 0x207F},
-		{0x2081, 0x2084},
-		{0x20AC, 0x20AC},
-		{0x2103, 0x2103},
-		{0x2105, 0x2105},
-		{0x2109, 0x2109},
-		{0x2113, 0x2113},
-		{0x2116, 0x2116},
-		{0x2121, 0x2122},
-		{0x2126, 0x2126},
-		{0x212B, 0x212B},
-		{0x2153, 0x2154},
-		{0x215B, 0x215E},
-		{0x2160, 0x216B},
-		{0x2170, 0x2179},
-		{0x2189, 0x2189},
-		{0x2190, 0x2199},
-		{0x21B8, 0x21B9},
-		{0x21D2, 0x21D2},
-		{0x21D4, 0x21D4},
-		{0x21E7, 0x21E7},
-		{0x2200, 0x2200},
-		{0x2202, 0x2203},
-		{0x2207, 0x2208},
-		{0x220B, 0x220B},
-		{0x220F, 0x220F},
-		{0x2211, 0x2211},
-		{0x2215, 0x2215},
-		{0x221A, 0x221A},
-		{0x221D, 0x2220},
-		{0x2223, 0x2223},
-		{0x2225, 0x2225},
-		{0x2227, 0x222C},
-		{0x222E, 0x222E},
-		{0x2234, 0x2237},
-		{0x223C, 0x223D},
-		{0x2248, 0x2248},
-		{0x224C, 0x224C},
-		{0x2252, 0x2252},
-		{0x2260, 0x2261},
-		{0x2264, 0x2267},
-		{0x226A, 0x226B},
-		{0x226E, 0x226F},
-		{0x2282, 0x2283},
-		{0x2286, 0x2287},
-		{0x2295, 0x2295},
-		{0x2299, 0x2299},
-		{0x22A5, 0x22A5},
-		{0x22BF, 0x22BF},
-		{0x2312, 0x2312},
-		{0x2460, 0x24E9},
-		{0x24EB, 0x254B},
-		{0x2550, 0x2573},
-		{0x2580, 0x258F},
-		{0x2592, 0x2595},
-		{0x25A0, 0x25A1},
-		{0x25A3, 0x25A9},
-		{0x25B2, 0x25B3},
-		{0x25B6, 0x25B7},
-		{0x25BC, 0x25BD},
-		{0x25C0, 0x25C1},
-		{0x25C6, 0x25C8},
-		{0x25CB, 0x25CB},
-		{0x25CE, 0x25D1},
-		{0x25E2, 0x25E5},
-		{0x25EF, 0x25EF},
-		{0x2605, 0x2606},
-		{0x2609, 0x2609},
-		{0x260E, 0x260F},
-		{0x261C, 0x261C},
-		{0x261E, 0x261E},
-		{0x2640, 0x2640},
-		{0x2642, 0x2642},
-		{0x2660, 0x2661},
-		{0x2663, 0x2665},
-		{0x2667, 0x266A},
-		{0x266C, 0x266D},
-		{0x266F, 0x266F},
-		{0x269E, 0x269F},
-		{0x26BF, 0x26BF},
-		{0x26C6, 0x26CD},
-		{0x26CF, 0x26D3},
-		{0x26D5, 0x26E1},
-		{0x26E3, 0x26E3},
-		{0x26E8, 0x26E9},
-		{0x26EB, 0x26F1},
-		{0x26F4, 0x26F4},
-		{0x26F6, 0x26F9},
-		{0x26FB, 0x26FC},
-		{0x26FE, 0x26FF},
-		{0x273D, 0x273D},
-		{0x2776, 0x277F},
-		{0x2B56, 0x2B59},
-		{0x3248, 0x324F},
-		{0xE000, 0xF8FF},
-		{0xFE00, 0xFE0F},
-		{0xFFFD, 0xFFFD},
-		{0x1F100, 0x1F10A},
-		{0x1F110, 0x1F12D},
-		{0x1F130, 0x1F169},
-		{0x1F170, 0x1F18D},
-		{0x1F18F, 0x1F190},
-		{0x1F19B, 0x1F1AC},
-		{0xE0100, 0xE01EF},
-		{0xF0000, 0xFFFFD},
-		{0x100000, 0x10FFFD},
-	};
-
-	if (c >= 0xdf00 && c <= 0xdfff)
-		return 1;			/* dw combining sequence */
-	return (wcwidth(c) == 2 ||
-		(cjkwidth && bisearch(c, ambiguous, ARRAY_SIZE(ambiguous) - 1)));
-}
+	int props;
 
-bool utf8_iscomb(uint32_t c)
-{
-	/* taken from Markus Kuhn's wcwidth */
-	static const struct interval combining[] = {
-		{0x0300, 0x036F}, {0x0483, 0x0486}, {0x0488, 0x0489},
-		{0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2},
-		{0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0600, 0x0603},
-		{0x0610, 0x0615}, {0x064B, 0x065E}, {0x0670, 0x0670},
-		{0x06D6, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED},
-		{0x070F, 0x070F}, {0x0711, 0x0711}, {0x0730, 0x074A},
-		{0x07A6, 0x07B0}, {0x07EB, 0x07F3}, {0x0901, 0x0902},
-		{0x093C, 0x093C}, {0x0941, 0x0948}, {0x094D, 0x094D},
-		{0x0951, 0x0954}, {0x0962, 0x0963}, {0x0981, 0x0981},
-		{0x09BC, 0x09BC}, {0x09C1, 0x09C4}, {0x09CD, 0x09CD},
-		{0x09E2, 0x09E3}, {0x0A01, 0x0A02}, {0x0A3C, 0x0A3C},
-		{0x0A41, 0x0A42}, {0x0A47, 0x0A48}, {0x0A4B, 0x0A4D},
-		{0x0A70, 0x0A71}, {0x0A81, 0x0A82}, {0x0ABC, 0x0ABC},
-		{0x0AC1, 0x0AC5}, {0x0AC7, 0x0AC8}, {0x0ACD, 0x0ACD},
-		{0x0AE2, 0x0AE3}, {0x0B01, 0x0B01}, {0x0B3C, 0x0B3C},
-		{0x0B3F, 0x0B3F}, {0x0B41, 0x0B43}, {0x0B4D, 0x0B4D},
-		{0x0B56, 0x0B56}, {0x0B82, 0x0B82}, {0x0BC0, 0x0BC0},
-		{0x0BCD, 0x0BCD}, {0x0C3E, 0x0C40}, {0x0C46, 0x0C48},
-		{0x0C4A, 0x0C4D}, {0x0C55, 0x0C56}, {0x0CBC, 0x0CBC},
-		{0x0CBF, 0x0CBF}, {0x0CC6, 0x0CC6}, {0x0CCC, 0x0CCD},
-		{0x0CE2, 0x0CE3}, {0x0D41, 0x0D43}, {0x0D4D, 0x0D4D},
-		{0x0DCA, 0x0DCA}, {0x0DD2, 0x0DD4}, {0x0DD6, 0x0DD6},
-		{0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E},
-		{0x0EB1, 0x0EB1}, {0x0EB4, 0x0EB9}, {0x0EBB, 0x0EBC},
-		{0x0EC8, 0x0ECD}, {0x0F18, 0x0F19}, {0x0F35, 0x0F35},
-		{0x0F37, 0x0F37}, {0x0F39, 0x0F39}, {0x0F71, 0x0F7E},
-		{0x0F80, 0x0F84}, {0x0F86, 0x0F87}, {0x0F90, 0x0F97},
-		{0x0F99, 0x0FBC}, {0x0FC6, 0x0FC6}, {0x102D, 0x1030},
-		{0x1032, 0x1032}, {0x1036, 0x1037}, {0x1039, 0x1039},
-		{0x1058, 0x1059}, {0x1160, 0x11FF}, {0x135F, 0x135F},
-		{0x1712, 0x1714}, {0x1732, 0x1734}, {0x1752, 0x1753},
-		{0x1772, 0x1773}, {0x17B4, 0x17B5}, {0x17B7, 0x17BD},
-		{0x17C6, 0x17C6}, {0x17C9, 0x17D3}, {0x17DD, 0x17DD},
-		{0x180B, 0x180D}, {0x18A9, 0x18A9}, {0x1920, 0x1922},
-		{0x1927, 0x1928}, {0x1932, 0x1932}, {0x1939, 0x193B},
-		{0x1A17, 0x1A18}, {0x1B00, 0x1B03}, {0x1B34, 0x1B34},
-		{0x1B36, 0x1B3A}, {0x1B3C, 0x1B3C}, {0x1B42, 0x1B42},
-		{0x1B6B, 0x1B73}, {0x1DC0, 0x1DCA}, {0x1DFE, 0x1DFF},
-		{0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2063},
-		{0x206A, 0x206F}, {0x20D0, 0x20EF}, {0x302A, 0x302F},
-		{0x3099, 0x309A}, {0xA806, 0xA806}, {0xA80B, 0xA80B},
-		{0xA825, 0xA826}, {0xFB1E, 0xFB1E}, {0xFE00, 0xFE0F},
-		{0xFE20, 0xFE23}, {0xFEFF, 0xFEFF}, {0xFFF9, 0xFFFB},
-		{0x10A01, 0x10A03}, {0x10A05, 0x10A06}, {0x10A0C, 0x10A0F},
-		{0x10A38, 0x10A3A}, {0x10A3F, 0x10A3F}, {0x1D167, 0x1D169},
-		{0x1D173, 0x1D182}, {0x1D185, 0x1D18B}, {0x1D1AA, 0x1D1AD},
-		{0x1D242, 0x1D244}, {0xE0001, 0xE0001}, {0xE0020, 0xE007F},
-		{0xE0100, 0xE01EF}
-	};
-
-	return bisearch(c, combining, ARRAY_SIZE(combining) - 1);
+	if (c >= UCS_COMB)
+		return combget(c) && combget(c)->dw;	/* combining sequence */
+	props = uniprops(c);
+	return (props & UNI_WIDE) || (cjkwidth && (props & UNI_AMBIGUOUS));
 }
 
-static void comb_tofront(int i)
+bool utf8_iscomb(uint32_t c)
 {
-	for (;;) {
-		int root = i >= 0x700 ? 0x801 : 0x800;
-		combchars[combchars[i]->prev]->next = combchars[i]->next;
-		combchars[combchars[i]->next]->prev = combchars[i]->prev;
-		combchars[i]->next = combchars[root]->next;
-		combchars[i]->prev = root;
-		combchars[combchars[root]->next]->prev = i;
-		combchars[root]->next = i;
-		i = combchars[i]->c1;
-		if (i < 0xd800 || i >= 0xe000)
-			return;
-		i -= 0xd800;
-	}
+	return uniprops(c) & UNI_COMBINING;
 }
 
 void utf8_handle_comb(unsigned int c, struct mchar *mc)
 {
-	int root;
-	unsigned int i, c1;
-	int isdouble;
+	uint32_t c1, code;
+	struct combchar *cc;
+	int nmarks = 1;
 
 	c1 = mc->image | (mc->font << 8);
-	isdouble = c1 >= 0x1100 && utf8_isdouble(c1);
-	if (!combchars) {
-		combchars = calloc(0x802, sizeof(struct combchar *));
-		if (!combchars)
-			return;
-		combchars[0x800] = malloc(sizeof(struct combchar));
-		combchars[0x801] = malloc(sizeof(struct combchar));
-		if (!combchars[0x800] || !combchars[0x801]) {
-			if (combchars[0x800])
-				free(combchars[0x800]);
-			if (combchars[0x801])
-				free(combchars[0x801]);
-			free(combchars);
-			return;
-		}
-		combchars[0x800]->c1 = 0x000;
-		combchars[0x800]->c2 = 0x700;
-		combchars[0x800]->next = 0x800;
-		combchars[0x800]->prev = 0x800;
-		combchars[0x801]->c1 = 0x700;
-		combchars[0x801]->c2 = 0x800;
-		combchars[0x801]->next = 0x801;
-		combchars[0x801]->prev = 0x801;
+	if ((cc = combget(c1))) {
+		if (cc->nmarks >= UTF8_COMB_MAX)
+			return;		/* keep what there is */
+		nmarks = cc->nmarks + 1;
 	}
-	root = isdouble ? 0x801 : 0x800;
-	for (i = combchars[root]->c1; i < combchars[root]->c2; i++) {
-		if (!combchars[i])
-			break;
-		if (combchars[i]->c1 == c1 && combchars[i]->c2 == c)
-			break;
-	}
-	if (i == combchars[root]->c2) {
-		/* full, recycle old entry */
-		if (c1 >= 0xd800 && c1 < 0xe000)
-			comb_tofront(c1 - 0xd800);
-		i = combchars[root]->prev;
-		if (i == 0x800 || i == 0x801 || c1 == i + 0xd800) {
-			/* completely full, can't recycle */
-			mc->image = '?';
-			mc->font = 0;
-			return;
-		}
-		/* FIXME: delete old char from all buffers */
-	} else if (!combchars[i]) {
-		combchars[i] = malloc(sizeof(struct combchar));
-		if (!combchars[i])
-			return;
-		combchars[i]->prev = i;
-		combchars[i]->next = i;
+	if ((code = comb_intern(c1, c, c1 >= 0x1100 && utf8_isdouble(c1), nmarks)) == 0) {
+		/* store full, can't combine */
+		mc->image = '?';
+		mc->font = 0;
+		return;
 	}
-	combchars[i]->c1 = c1;
-	combchars[i]->c2 = c;
-	mc->image = i & 0xff;
-	mc->font = (i >> 8) + 0xd8;
-	comb_tofront(i);
+	mc->image = code;
+	mc->font = code >> 8;
 }
 
 static int encmatch(char *s1, char *s2)
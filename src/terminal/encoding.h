@@ -3,16 +3,22 @@
 
 #include "window.h"
 
+#define UTF8_COMB_MAX	16	/* combining marks kept on one character */
+#define UTF8_CELLMAX	(4 * (UTF8_COMB_MAX + 1))	/* UTF-8 bytes of a cell */
+
 void  InitBuiltinTabs (void);
 struct mchar *recode_mchar (struct mchar *, int, int);
 struct mline *recode_mline (struct mline *, int, int, int);
 int   FromUtf8 (int, int *);
+size_t FromUtf8Buf (const unsigned char *, size_t, uint32_t *, uint8_t *, size_t, size_t *, int *);
 void  AddUtf8 (uint32_t);
 size_t ToUtf8 (char *, uint32_t);
 size_t ToUtf8_comb (char *, uint32_t);
 bool  utf8_isdouble (uint32_t);
 bool  utf8_iscomb (uint32_t);
 void  utf8_handle_comb (unsigned int, struct mchar *);
+size_t CombCount (void);
+size_t CombSize (void);
 int   ContainsSpecialDeffont (struct mline *, int, int, int);
 int   LoadFontTranslation (int, char *);
 void  LoadFontTranslationsForEncoding (int);
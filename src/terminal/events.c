@@ -0,0 +1,196 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include "config.h"
+
+#include "events.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "screen.h"
+
+#include "misc.h"
+
+struct evclient {
+	struct evclient *next;
+	int fd;
+	Event readev;
+	Event writeev;
+	char *buf;	/* not yet written */
+	int len;
+};
+
+static struct evclient *clients;
+int events_clients = 0;	/* how many are connected */
+
+static void EventsDrop(struct evclient *c)
+{
+	struct evclient **cp;
+
+	for (cp = &clients; *cp; cp = &(*cp)->next)
+		if (*cp == c) {
+			*cp = c->next;
+			break;
+		}
+	evdeq(&c->readev);
+	evdeq(&c->writeev);
+	close(c->fd);
+	free(c->buf);
+	free(c);
+	events_clients--;
+}
+
+/* returns false if c is gone */
+static bool EventsFlush(struct evclient *c)
+{
+	void (*oldpipe)(int);
+	ssize_t n;
+
+	oldpipe = xsignal(SIGPIPE, SIG_IGN);
+	n = write(c->fd, c->buf, c->len);
+	xsignal(SIGPIPE, oldpipe);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return true;
+	if (n <= 0) {
+		EventsDrop(c);
+		return false;
+	}
+	c->len -= n;
+	memmove(c->buf, c->buf + n, c->len);
+	return true;
+}
+
+static void events_writeev_fn(Event *event, void *data)
+{
+	(void)event; /* unused */
+
+	EventsFlush((struct evclient *)data);
+}
+
+/* the reader has nothing to say; when it closes, it is gone */
+static void events_readev_fn(Event *event, void *data)
+{
+	char buf[256];
+	ssize_t n;
+
+	(void)event; /* unused */
+
+	n = read(((struct evclient *)data)->fd, buf, sizeof(buf));
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+		EventsDrop((struct evclient *)data);
+}
+
+/* returns false if c had to be dropped */
+static bool EventsQueue(struct evclient *c, const char *rec, int len)
+{
+	if (c->len + len > EVENTS_BUFMAX) {
+		EventsDrop(c);
+		return false;
+	}
+	memcpy(c->buf + c->len, rec, len);
+	c->len += len;
+	return true;
+}
+
+static int EventRecord(char *rec, size_t size, const char *event, int n, const char *text)
+{
+	int len;
+
+	len = snprintf(rec, size, "%s %d", event, n);
+	if (text) {
+		rec[len++] = ' ';
+		for (; *text && (size_t)len < size - 1; text++)
+			rec[len++] = ((unsigned char)*text < 32 || *text == 127) ? ' ' : *text;
+	}
+	rec[len++] = '\n';
+	return len;
+}
+
+void EventPost(const char *event, int n, const char *text)
+{
+	struct evclient *c, *next;
+	char rec[MAXSTR + 64];
+	int len;
+
+	if (!clients)
+		return;
+	len = EventRecord(rec, sizeof(rec), event, n, text);
+	for (c = clients; c; c = next) {
+		next = c->next;
+		if (EventsQueue(c, rec, len) && c->len == len)
+			EventsFlush(c);	/* nothing was waiting; try right away */
+	}
+}
+
+/*
+ * Takes over fd, the connection a MSG_EVENTS came on, and starts it with
+ * what there is now.
+ */
+void EventsSubscribe(int fd)
+{
+	struct evclient *c;
+	char rec[MAXSTR + 64];
+	Display *d;
+
+	if ((c = calloc(1, sizeof(struct evclient))) == NULL ||
+	    (c->buf = malloc(EVENTS_BUFMAX)) == NULL) {
+		free(c);
+		close(fd);
+		return;
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	c->fd = fd;
+	c->readev.fd = c->writeev.fd = fd;
+	c->readev.type = EV_READ;
+	c->writeev.type = EV_WRITE;
+	c->readev.data = c->writeev.data = (char *)c;
+	c->readev.handler = events_readev_fn;
+	c->readev.name = "events_readev_fn";
+	c->writeev.handler = events_writeev_fn;
+	c->writeev.name = "events_writeev_fn";
+	c->writeev.condpos = &c->len;
+	c->next = clients;
+	clients = c;
+	events_clients++;
+	evenq(&c->readev);
+	evenq(&c->writeev);
+
+	for (Window *win = first_window; win; win = win->w_next) {
+		if (!EventsQueue(c, rec, EventRecord(rec, sizeof(rec), "new", win->w_number, win->w_title)))
+			return;
+		if (win->w_hstatus && *win->w_hstatus &&
+		    !EventsQueue(c, rec, EventRecord(rec, sizeof(rec), "title", win->w_number, win->w_hstatus)))
+			return;
+	}
+	for (d = displays; d; d = d->d_next)
+		if (!EventsQueue(c, rec, EventRecord(rec, sizeof(rec), "attach",
+						       d->d_fore ? d->d_fore->w_number : -1, d->d_usertty)))
+			return;
+	if (c->len)
+		EventsFlush(c);
+}
@@ -0,0 +1,53 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#ifndef SCREEN_EVENTS_H
+#define SCREEN_EVENTS_H
+
+#include "window.h"
+
+/*
+ * ImmorTerm: a MSG_EVENTS connection stays open, and the session writes
+ * what happens to it as one line each: the event, the window number (-1
+ * if none) and, for some, a text with control characters made spaces.
+ *
+ *	new N title		window N was created
+ *	dead N			window N is gone
+ *	title N text		the title (hardstatus) of window N changed
+ *	name N title		window N was renamed
+ *	bell N			window N rang the bell
+ *	activity N		window N printed something, at most once a second
+ *	attach N tty		a display attached on tty, showing window N
+ *	detach -1 tty		the display on tty is gone
+ *
+ * A new connection first gets a new line for each window, its title, and
+ * an attach for each display. A reader that falls EVENTS_BUFMAX behind is
+ * dropped, and has to connect again.
+ */
+#define EVENTS_BUFMAX	(64 * 1024)
+
+extern int events_clients;
+
+void EventsSubscribe (int);
+void EventPost (const char *, int, const char *);
+
+#endif /* SCREEN_EVENTS_H */
@@ -0,0 +1,321 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include "config.h"
+
+#include "export.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "screen.h"
+
+#include "ansi.h"
+#include "encoding.h"
+#include "misc.h"
+#include "resize.h"
+
+/* the colors an HTML page shows, for colors the window left at default */
+#define HTML_BG		0x1e1e1e
+#define HTML_FG		0xd4d4d4
+
+/* xterm's first 16 colors */
+static const uint32_t palette16[16] = {
+	0x000000, 0xcd0000, 0x00cd00, 0xcdcd00, 0x0000ee, 0xcd00cd, 0x00cdcd, 0xe5e5e5,
+	0x7f7f7f, 0xff0000, 0x00ff00, 0xffff00, 0x5c5cff, 0xff00ff, 0x00ffff, 0xffffff
+};
+
+static const char *formats[] = {
+	[EXPORT_PLAIN] = "plain",
+	[EXPORT_ANSI] = "ansi",
+	[EXPORT_HTML] = "html",
+};
+
+/* The format called name, or -1 */
+int ExportFormat(const char *name)
+{
+	for (int i = 0; i < (int)ARRAY_SIZE(formats); i++)
+		if (!strcmp(name, formats[i]))
+			return i;
+	return -1;
+}
+
+/* Writes out what is in the buffer, waiting up to EXPORT_TIMEOUT for a
+ * reader that is behind. */
+static void ExportFlush(struct export *ex)
+{
+	size_t off = 0;
+	ssize_t n;
+
+	while (!ex->failed && off < ex->len) {
+		if ((n = write(ex->fd, ex->buf + off, ex->len - off)) >= 0) {
+			off += n;
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			struct pollfd pfd = { ex->fd, POLLOUT, 0 };
+
+			if (poll(&pfd, 1, EXPORT_TIMEOUT) > 0)
+				continue;
+		}
+		ex->failed = true;
+	}
+	ex->len = 0;
+}
+
+static void ExportPut(struct export *ex, const char *s, size_t n)
+{
+	if (ex->len + n > EXPORT_BUFSIZE)
+		ExportFlush(ex);
+	memcpy(ex->buf + ex->len, s, n);
+	ex->len += n;
+}
+
+static void ExportStr(struct export *ex, const char *s)
+{
+	ExportPut(ex, s, strlen(s));
+}
+
+/* Adds character c of some text to an HTML page */
+static void ExportHtmlChar(struct export *ex, int c)
+{
+	char ch = c;
+
+	if (c == '<' || c == '>' || c == '&')
+		ExportStr(ex, c == '<' ? "&lt;" : c == '>' ? "&gt;" : "&amp;");
+	else
+		ExportPut(ex, &ch, 1);
+}
+
+/* The RGB of color c of a cell (see EncodeFg() in display.c), dflt for
+ * the default */
+static uint32_t ExportRGB(uint32_t c, uint32_t dflt)
+{
+	static const uint8_t levels[6] = { 0, 95, 135, 175, 215, 255 };
+
+	if (c & 0x04000000)
+		return c & 0xffffff;
+	if (c & 0x02000000) {
+		c &= 0xff;
+		if (c < 16)
+			return palette16[c];
+		if (c >= 232)
+			return (8 + 10 * (c - 232)) * 0x010101;
+		c -= 16;
+		return levels[c / 36] << 16 | levels[c / 6 % 6] << 8 | levels[c % 6];
+	}
+	if (c & 0x01000000)
+		return palette16[c & 0x0f];
+	return dflt;
+}
+
+/* The SGR parameters for color c as foreground (base 30) or background
+ * (base 40) */
+static int ExportSgrColor(char *p, uint32_t c, int base)
+{
+	if (c & 0x04000000)
+		return sprintf(p, ";%d;2;%d;%d;%d", base + 8, (int)(c >> 16 & 0xff), (int)(c >> 8 & 0xff), (int)(c & 0xff));
+	if (c & 0x02000000)
+		return sprintf(p, ";%d;5;%d", base + 8, (int)(c & 0xff));
+	if (c & 0x01000000)
+		return sprintf(p, ";%d", (c & 0x0f) < 8 ? base + (int)(c & 0x07) : base + 60 + (int)(c & 0x07));
+	return 0;
+}
+
+static bool ExportPlainRend(struct export *ex)
+{
+	return !ex->attr && !ex->colorbg && !ex->colorfg;
+}
+
+/* Switches the output to the rendition of a cell */
+static void ExportRend(struct export *ex, uint32_t attr, uint32_t colorbg, uint32_t colorfg)
+{
+	char buf[128], *p = buf;
+
+	if (attr == ex->attr && colorbg == ex->colorbg && colorfg == ex->colorfg)
+		return;
+	if (ex->format == EXPORT_HTML && !ExportPlainRend(ex))
+		ExportStr(ex, "</span>");
+	ex->attr = attr;
+	ex->colorbg = colorbg;
+	ex->colorfg = colorfg;
+	if (ex->format == EXPORT_ANSI) {
+		p += sprintf(p, "\033[0");
+		if (attr & A_BD)
+			p += sprintf(p, ";1");
+		if (attr & A_DI)
+			p += sprintf(p, ";2");
+		if (attr & A_IT)
+			p += sprintf(p, ";3");
+		if (attr & A_US)
+			p += sprintf(p, ";4");
+		if (attr & A_BL)
+			p += sprintf(p, ";5");
+		if (attr & (A_RV | A_SO))
+			p += sprintf(p, ";7");
+		p += ExportSgrColor(p, colorfg, 30);
+		p += ExportSgrColor(p, colorbg, 40);
+		*p++ = 'm';
+		ExportPut(ex, buf, p - buf);
+	} else if (ex->format == EXPORT_HTML && !ExportPlainRend(ex)) {
+		uint32_t fg = ExportRGB(colorfg, HTML_FG), bg = ExportRGB(colorbg, HTML_BG);
+
+		if (attr & (A_RV | A_SO)) {
+			uint32_t t = fg;
+
+			fg = bg;
+			bg = t;
+		}
+		p += sprintf(p, "<span style=\"color:#%06x", (unsigned int)fg);
+		if (bg != HTML_BG || (attr & (A_RV | A_SO)))
+			p += sprintf(p, ";background:#%06x", (unsigned int)bg);
+		if (attr & A_BD)
+			p += sprintf(p, ";font-weight:bold");
+		if (attr & A_DI)
+			p += sprintf(p, ";opacity:.6");
+		if (attr & A_IT)
+			p += sprintf(p, ";font-style:italic");
+		if (attr & A_US)
+			p += sprintf(p, ";text-decoration:underline");
+		p += sprintf(p, "\">");
+		ExportPut(ex, buf, p - buf);
+	}
+}
+
+/*
+ * Starts an export in format to fd of lines of the given encoding; title
+ * is that of the HTML page. False if there is no memory for the buffer.
+ */
+bool ExportBegin(struct export *ex, int fd, int format, int encoding, const char *title)
+{
+	memset(ex, 0, sizeof(*ex));
+	if ((ex->buf = malloc(EXPORT_BUFSIZE)) == NULL)
+		return false;
+	ex->fd = fd;
+	ex->format = format;
+	ex->encoding = encoding;
+	if (format == EXPORT_HTML) {
+		char buf[256];
+
+		snprintf(buf, sizeof(buf), "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"%s\">\n<title>",
+			 encoding == UTF8 ? "utf-8" : "iso-8859-1");
+		ExportStr(ex, buf);
+		for (const char *s = title; *s; s++)
+			ExportHtmlChar(ex, *s);
+		snprintf(buf, sizeof(buf), "</title>\n</head>\n<body style=\"margin:0;background:#%06x\">\n"
+			 "<pre style=\"margin:0;padding:8px;color:#%06x;background:#%06x\">", HTML_BG, HTML_FG, HTML_BG);
+		ExportStr(ex, buf);
+	}
+	return true;
+}
+
+/* Adds the first width cells of ml, but for the blanks at the end */
+void ExportLine(struct export *ex, struct mline *ml, int width)
+{
+	char buf[UTF8_CELLMAX + 1];
+	int n, end;
+
+	for (end = width; end > 0; end--) {
+		uint32_t c = ml->image[end - 1];
+
+		if (c != ' ' && !(c == 0xff && ml->font[end - 1] == 0xff))
+			break;
+		if (ex->format != EXPORT_PLAIN && (ml->colorbg[end - 1] || (ml->attr[end - 1] & (A_RV | A_SO | A_US))))
+			break;
+	}
+	for (int x = 0; x < end; x++) {
+		uint32_t c = ml->image[x];
+
+		/* the right half of a double width character */
+		if (c == 0xff && ml->font[x] == 0xff)
+			continue;
+		if (ex->format != EXPORT_PLAIN)
+			ExportRend(ex, ml->attr[x], ml->colorbg[x], ml->colorfg[x]);
+		if (c >= ' ' && c < 0x7f) {
+			if (ex->format == EXPORT_HTML)
+				ExportHtmlChar(ex, c);
+			else {
+				if (ex->len == EXPORT_BUFSIZE)
+					ExportFlush(ex);
+				ex->buf[ex->len++] = c;
+			}
+			continue;
+		}
+		n = ex->encoding == UTF8 ? (int)ToUtf8_comb(buf, c) : EncodeChar(buf, c, ex->encoding, NULL);
+		if (n > 0)
+			ExportPut(ex, buf, n);
+	}
+	if (ex->format != EXPORT_PLAIN && !ExportPlainRend(ex)) {
+		if (ex->format == EXPORT_ANSI)
+			ExportStr(ex, "\033[m");
+		else
+			ExportStr(ex, "</span>");
+		ex->attr = ex->colorbg = ex->colorfg = 0;
+	}
+	ExportStr(ex, "\n");
+}
+
+/* Finishes the export; 0, or -1 if not all of it could be written */
+int ExportEnd(struct export *ex)
+{
+	if (ex->format == EXPORT_HTML)
+		ExportStr(ex, "</pre>\n</body>\n</html>\n");
+	ExportFlush(ex);
+	free(ex->buf);
+	ex->buf = NULL;
+	return ex->failed ? -1 : 0;
+}
+
+/*
+ * Exports the screen of win to fd, after its history if history: the
+ * history of the main screen, as the screen is scrolled into it, and
+ * what the window shows. The number of lines, or -1 if not all of them
+ * could be written.
+ */
+int ExportWindow(Window *win, int fd, int format, bool history)
+{
+	struct export ex;
+	void (*oldpipe)(int);
+	int n = 0;
+
+	if (!ExportBegin(&ex, fd, format, win->w_encoding, win->w_title ? win->w_title : ""))
+		return -1;
+	oldpipe = xsignal(SIGPIPE, SIG_IGN);
+	if (history) {
+		HistReflow(win);
+		for (int i = MainHistLines(win); i > 0 && !ex.failed; i--, n++)
+			ExportLine(&ex, MainHistLine(win, i), win->w_alt.on ? win->w_alt.width : win->w_width);
+	}
+	for (int y = 0; y < win->w_height && !ex.failed; y++, n++)
+		ExportLine(&ex, &win->w_mlines[y], win->w_width);
+	if (ExportEnd(&ex))
+		n = -1;
+	xsignal(SIGPIPE, oldpipe);
+	return n;
+}
@@ -0,0 +1,65 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+
+#ifndef SCREEN_EXPORT_H
+#define SCREEN_EXPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "window.h"
+
+/*
+ * The export command writes the history and screen of a window as plain
+ * text, text with SGR sequences, or an HTML page, straight from the
+ * cells, rendered into a large buffer that is written out whenever it is
+ * full. The file to write to may also be a FIFO, a Unix socket, or a
+ * "|command" to pipe it into (see ExportOpen()).
+ */
+enum {
+	EXPORT_PLAIN,
+	EXPORT_ANSI,
+	EXPORT_HTML
+};
+
+#define EXPORT_BUFSIZE	(1 << 20)
+#define EXPORT_TIMEOUT	5000	/* ms a reader may take to take more */
+
+struct export {
+	int fd;
+	int format;
+	int encoding;
+	char *buf;
+	size_t len;
+	bool failed;
+	/* the rendition the output is in */
+	uint32_t attr, colorbg, colorfg;
+};
+
+int   ExportFormat (const char *);
+bool  ExportBegin (struct export *, int, int, int, const char *);
+void  ExportLine (struct export *, struct mline *, int);
+int   ExportEnd (struct export *);
+int   ExportWindow (Window *, int, int, bool);
+
+#endif /* SCREEN_EXPORT_H */
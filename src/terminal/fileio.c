@@ -35,6 +35,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <pwd.h>
 
 #include <signal.h>
@@ -43,12 +45,14 @@
 
 #include "misc.h"
 #include "process.h"
+#include "resize.h"
 #include "termcap.h"
 #include "dumptermcap.h"
 #include "encoding.h"
 
 static char *CatExtra(char *, char *);
 static char *findrcfile(char *);
+static FILE *openpublic(char *, struct stat *, char *);
 
 char *rc_name = "";
 int rc_recursion = 0;
@@ -132,6 +136,382 @@ static char *findrcfile(char *rcfile)
 	}
 }
 
+/*
+ * ImmorTerm: an rc file with "rccache on" in it keeps its lines parsed in
+ * <file>.cache: each as its command number and arguments, or, for a line
+ * that expands variables or does not parse, as it is, to be parsed when
+ * it runs like any other. The cache is used while the hash and size of
+ * the file are those it was made for, and the command numbers still have
+ * their names; otherwise the file is parsed and, if it still asks for it,
+ * a new cache written.
+ *
+ * The cache is the magic, the number of lines, the hash and the size of
+ * the file, then for each line its command number (-1 to parse it), its
+ * quiet flags (see DoCommand()), its number of arguments, and for each of
+ * them its length and the bytes with a NUL.
+ */
+
+#define RCCACHE_MAGIC	0x53635263	/* "ScRc" */
+#define RCCACHE_MAX	(1024 * 1024)
+
+struct rcline {
+	int nr;			/* RC_ILLEGAL: args[0] is the line to parse */
+	int quiet;
+	int argc;
+	char **args;		/* args[0] is the command as written */
+	int *argl;
+};
+
+struct rcfile {
+	struct rcline *lines;
+	int n;
+	char *buf;		/* what args point into */
+	char **argv;
+	int *argls;
+};
+
+struct rcbuf {
+	char *p;
+	size_t len, size;
+	bool failed;
+};
+
+static void rcput(struct rcbuf *b, const void *p, size_t n)
+{
+	if (b->failed)
+		return;
+	if (b->len + n > b->size) {
+		size_t size = b->size ? b->size * 2 : 4096;
+		char *np;
+
+		while (size < b->len + n)
+			size *= 2;
+		if (size > RCCACHE_MAX || (np = realloc(b->p, size)) == NULL) {
+			b->failed = true;
+			return;
+		}
+		b->p = np;
+		b->size = size;
+	}
+	memcpy(b->p + b->len, p, n);
+	b->len += n;
+}
+
+static void rcput32(struct rcbuf *b, int32_t v)
+{
+	rcput(b, &v, sizeof(v));
+}
+
+static uint64_t rchash(const char *p, size_t n)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;	/* FNV-1a */
+
+	while (n--)
+		h = (h ^ (unsigned char)*p++) * 0x100000001b3ULL;
+	return h;
+}
+
+static void rcheader(struct rcbuf *b, int32_t n, const char *text, size_t len)
+{
+	uint64_t h = rchash(text, len), l = len;
+
+	rcput32(b, RCCACHE_MAGIC);
+	rcput32(b, n);
+	rcput(b, &h, sizeof(h));
+	rcput(b, &l, sizeof(l));
+}
+
+/* Parses the lines of text, the contents of an rc file, into the cache form
+ * in b; *cachep tells whether the file asks for a cache. The lines are
+ * split as fgets() into a buffer of 2048 would. */
+static void rccompile(struct rcbuf *b, const char *text, size_t len, bool *cachep)
+{
+	char buf[2048], *args[MAXARGS];
+	int argl[MAXARGS], argc;
+	int32_t n = 0;
+
+	rcheader(b, 0, text, len);
+	*cachep = false;
+	for (size_t off = 0; off < len;) {
+		size_t l = 0;
+		const char *cmd;
+		int quiet = 0, nr;
+
+		while (off + l < len && l < ARRAY_SIZE(buf) - 1 && text[off + l] != '\n')
+			l++;
+		if (off + l < len && text[off + l] == '\n' && l < ARRAY_SIZE(buf) - 1)
+			l++;
+		memcpy(buf, text + off, l);
+		buf[l] = 0;
+		off += l;
+		if (l && buf[l - 1] == '\n')
+			buf[--l] = 0;
+		if (memchr(buf, '$', l))
+			argc = -1;
+		else {
+			char line[2048];
+
+			memcpy(line, buf, l + 1);
+			argc = Parse(line, ARRAY_SIZE(line), args, argl);
+			if (argc == 0) {
+				char *p = buf + strspn(buf, " \t");
+
+				if (!*p || *p == '#')
+					continue;
+				argc = -1;
+			}
+			if (argc > 0) {
+				cmd = args[0];
+				if (*cmd == '@') {
+					quiet |= 0x01;
+					cmd++;
+				}
+				if (*cmd == '-') {
+					quiet |= 0x02;
+					cmd++;
+				}
+				if ((nr = FindCommnr(cmd)) == RC_ILLEGAL)
+					argc = -1;
+				else if (!strcmp(args[0], "rccache"))
+					*cachep = argc > 1 && !strcmp(args[1], "on");
+			}
+			if (argc > 0) {
+				rcput32(b, nr);
+				rcput32(b, quiet);
+				rcput32(b, argc);
+				for (int i = 0; i < argc; i++) {
+					rcput32(b, argl[i]);
+					rcput(b, args[i], argl[i]);
+					rcput(b, "", 1);
+				}
+				n++;
+				continue;
+			}
+		}
+		rcput32(b, RC_ILLEGAL);
+		rcput32(b, 0);
+		rcput32(b, 1);
+		rcput32(b, l);
+		rcput(b, buf, l + 1);
+		n++;
+	}
+	if (!b->failed)
+		memcpy(b->p + sizeof(int32_t), &n, sizeof(n));
+}
+
+static bool rcget32(const char **p, const char *end, int32_t *v)
+{
+	if ((size_t)(end - *p) < sizeof(*v))
+		return false;
+	memcpy(v, *p, sizeof(*v));
+	*p += sizeof(*v);
+	return true;
+}
+
+/* Takes the lines of an rc file of len bytes and hash h from the cache
+ * form in buf, which rf then owns; false if it is not one for them. */
+static bool rcdecode(struct rcfile *rf, char *buf, size_t size, const char *text, size_t len)
+{
+	const char *p = buf, *q, *end = buf + size;
+	int32_t magic, n, v = 0;
+	uint64_t h, l;
+	size_t nargs = 0;
+
+	memset(rf, 0, sizeof(*rf));
+	if (!rcget32(&p, end, &magic) || magic != RCCACHE_MAGIC || !rcget32(&p, end, &n) || n < 0 ||
+	    (size_t)(end - p) < 2 * sizeof(uint64_t))
+		return false;
+	memcpy(&h, p, sizeof(h));
+	memcpy(&l, p + sizeof(h), sizeof(l));
+	p += 2 * sizeof(uint64_t);
+	if (l != len || h != rchash(text, len))
+		return false;
+	/* once to check it and count the arguments, once to take them */
+	q = p;
+	for (int i = 0; i < n; i++) {
+		int32_t nr, quiet, argc;
+
+		if (!rcget32(&q, end, &nr) || !rcget32(&q, end, &quiet) || !rcget32(&q, end, &argc) ||
+		    argc < 1 || argc >= MAXARGS || (nr != RC_ILLEGAL && (nr < 0 || nr > RC_LAST)) ||
+		    (nr == RC_ILLEGAL && argc != 1))
+			return false;
+		for (int j = 0; j < argc; j++) {
+			if (!rcget32(&q, end, &v) || v < 0 || end - q < v + 1 || q[v])
+				return false;
+			q += v + 1;
+		}
+		nargs += argc + 1;
+	}
+	if (q != end)
+		return false;
+	if ((rf->lines = calloc(n ? n : 1, sizeof(struct rcline))) == NULL ||
+	    (rf->argv = malloc((nargs ? nargs : 1) * sizeof(char *))) == NULL ||
+	    (rf->argls = malloc((nargs ? nargs : 1) * sizeof(int))) == NULL) {
+		free(rf->lines);
+		free(rf->argv);
+		return false;
+	}
+	nargs = 0;
+	for (int i = 0; i < n; i++) {
+		struct rcline *rl = &rf->lines[i];
+
+		rcget32(&p, end, &v);
+		rl->nr = v;
+		rcget32(&p, end, &v);
+		rl->quiet = v;
+		rcget32(&p, end, &v);
+		rl->argc = v;
+		rl->args = rf->argv + nargs;
+		rl->argl = rf->argls + nargs;
+		for (int j = 0; j < rl->argc; j++) {
+			rcget32(&p, end, &v);
+			rl->args[j] = (char *)p;
+			rl->argl[j] = v;
+			p += v + 1;
+		}
+		rl->args[rl->argc] = NULL;
+		rl->argl[rl->argc] = 0;
+		nargs += rl->argc + 1;
+		/* a command must not find the name of another under its number */
+		if (rl->nr != RC_ILLEGAL) {
+			const char *cmd = rl->args[0] + !!(rl->quiet & 1);
+
+			cmd += !!(rl->quiet & 2);
+			if (strcmp(cmd, comms[rl->nr].name)) {
+				free(rf->lines);
+				free(rf->argv);
+				free(rf->argls);
+				return false;
+			}
+		}
+	}
+	rf->n = n;
+	rf->buf = buf;
+	return true;
+}
+
+static void rcfree(struct rcfile *rf)
+{
+	free(rf->lines);
+	free(rf->argv);
+	free(rf->argls);
+	free(rf->buf);
+}
+
+/* The cache of rc file name, if it is one we can trust: ours and only
+ * writable by us, as RegistryRead() wants its file */
+static char *rccache_read(const char *name, size_t *sizep)
+{
+	char path[MAXPATHLEN];
+	struct stat st;
+	char *buf;
+	int fd;
+
+	if (snprintf(path, sizeof(path), "%s.cache", name) >= (int)sizeof(path) ||
+	    (fd = secopen(path, O_RDONLY, 0)) < 0)
+		return NULL;
+	if (fstat(fd, &st) || st.st_uid != real_uid || (st.st_mode & 022) || st.st_size <= 0 ||
+	    st.st_size > RCCACHE_MAX || (buf = malloc(st.st_size)) == NULL) {
+		close(fd);
+		return NULL;
+	}
+	if (read(fd, buf, st.st_size) != st.st_size) {
+		free(buf);
+		buf = NULL;
+	}
+	close(fd);
+	*sizep = st.st_size;
+	return buf;
+}
+
+static void rccache_write(const char *name, struct rcbuf *b)
+{
+	char path[MAXPATHLEN], tmp[MAXPATHLEN + 16];
+	int fd;
+	bool ok;
+
+	if (snprintf(path, sizeof(path), "%s.cache", name) >= (int)sizeof(path))
+		return;
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	if ((fd = secopen(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+		return;
+	ok = write(fd, b->p, b->len) == (ssize_t)b->len;
+	close(fd);
+	/* sessions starting meanwhile read the old cache or the new one */
+	if (!ok || rename(tmp, path))
+		unlink(tmp);
+}
+
+/* Reads the rc file on fp, named name, into rf, from its cache if it has
+ * a good one; false if it cannot be read. */
+static bool RcRead(FILE *fp, const char *name, struct rcfile *rf)
+{
+	struct rcbuf b = { NULL, 0, 0, false };
+	char *text = NULL, *cache;
+	size_t len = 0, size = 0, n, csize;
+	bool want;
+
+	do {
+		if (len == size) {
+			char *nt;
+
+			size = size ? size * 2 : 8192;
+			if (size > RCCACHE_MAX * 16 || (nt = realloc(text, size)) == NULL) {
+				free(text);
+				return false;
+			}
+			text = nt;
+		}
+		n = fread(text + len, 1, size - len, fp);
+		len += n;
+	} while (n > 0);
+
+	if ((cache = rccache_read(name, &csize)) != NULL) {
+		if (rcdecode(rf, cache, csize, text, len)) {
+			free(text);
+			return true;
+		}
+		free(cache);
+	}
+	rccompile(&b, text, len, &want);
+	if (b.failed || !rcdecode(rf, b.p, b.len, text, len)) {
+		free(b.p);
+		free(text);
+		return false;
+	}
+	if (want)
+		rccache_write(name, &b);
+	free(text);
+	return true;
+}
+
+/* Runs line rl of an rc file, as RcLine() runs a line it parses */
+static void RcRun(struct rcline *rl)
+{
+	struct action act;
+
+	if (rl->nr == RC_ILLEGAL) {
+		char buf[2048];
+
+		snprintf(buf, sizeof(buf), "%s", rl->args[0]);
+		RcLine(buf, ARRAY_SIZE(buf));
+		return;
+	}
+	if (display) {
+		fore = D_fore;
+		flayer = D_forecv->c_layer;
+	} else
+		flayer = fore ? fore->w_savelayer : NULL;
+	if (!display)
+		EffectiveAclUser = users;
+	act.nr = rl->nr;
+	act.args = rl->args + 1;
+	act.argl = rl->argl + 1;
+	act.quiet = rl->quiet;
+	DoAction(&act);
+	EffectiveAclUser = NULL;
+}
+
 /*
  * this will be called twice:
  * 1) rcfilename = "/etc/screenrc"
@@ -142,10 +522,10 @@ int StartRc(char *rcfilename, int nopanic)
 	int argc, len;
 	char *p, *cp;
 	char buf[2048];
-	char *args[MAXARGS];
-	int argl[MAXARGS];
+	char **args;
 	FILE *fp;
 	char *oldrc_name = rc_name;
+	struct rcfile rf;
 
 	/* always fix termcap/info capabilities */
 	extra_incap = CatExtra("TF", extra_incap);
@@ -176,11 +556,26 @@ int StartRc(char *rcfilename, int nopanic)
 		rc_name = oldrc_name;
 		return 1;
 	}
-	while (fgets(buf, ARRAY_SIZE(buf), fp) != NULL) {
-		if ((p = strrchr(buf, '\n')) != NULL)
-			*p = '\0';
-		if ((argc = Parse(buf, ARRAY_SIZE(buf), args, argl)) == 0)
-			continue;
+	if (!RcRead(fp, rc_name, &rf)) {
+		fclose(fp);
+		Free(rc_name);
+		rc_name = oldrc_name;
+		return 1;
+	}
+	fclose(fp);
+	for (int i = 0; i < rf.n; i++) {
+		char *pargs[MAXARGS];
+		int pargl[MAXARGS];
+
+		if (rf.lines[i].nr == RC_ILLEGAL) {
+			snprintf(buf, sizeof(buf), "%s", rf.lines[i].args[0]);
+			if ((argc = Parse(buf, ARRAY_SIZE(buf), pargs, pargl)) == 0)
+				continue;
+			args = pargs;
+		} else {
+			argc = rf.lines[i].argc;
+			args = rf.lines[i].args;
+		}
 		if (strcmp(args[0], "echo") == 0) {
 			if (!display)
 				continue;
@@ -233,7 +628,7 @@ int StartRc(char *rcfilename, int nopanic)
 			}
 		}
 	}
-	fclose(fp);
+	rcfree(&rf);
 	Free(rc_name);
 	rc_name = oldrc_name;
 	return 0;
@@ -241,9 +636,9 @@ int StartRc(char *rcfilename, int nopanic)
 
 void FinishRc(char *rcfilename)
 {
-	char buf[2048];
 	FILE *fp;
 	char *oldrc_name = rc_name;
+	struct rcfile rf;
 
 	rc_name = findrcfile(rcfilename);
 
@@ -266,9 +661,13 @@ void FinishRc(char *rcfilename)
 		return;
 	}
 
-	while (fgets(buf, ARRAY_SIZE(buf), fp) != NULL)
-		RcLine(buf, ARRAY_SIZE(buf));
-	(void)fclose(fp);
+	if (RcRead(fp, rc_name, &rf)) {
+		(void)fclose(fp);
+		for (int i = 0; i < rf.n; i++)
+			RcRun(&rf.lines[i]);
+		rcfree(&rf);
+	} else
+		(void)fclose(fp);
 	Free(rc_name);
 	rc_name = oldrc_name;
 }
@@ -315,8 +714,8 @@ static void putc_encoded(FILE *f, uint32_t c, uint32_t font, int encoding) {
 	if (c == 0xff && font == 0xff)
 		return;
 
-	char buf[10];
-	int length = EncodeChar(buf, c, encoding, NULL);
+	char buf[UTF8_CELLMAX + 1];
+	int length = encoding == UTF8 ? (int)ToUtf8_comb(buf, c) : EncodeChar(buf, c, encoding, NULL);
 	if (length < 0) {
 		return;
 	}
@@ -324,6 +723,35 @@ static void putc_encoded(FILE *f, uint32_t c, uint32_t font, int encoding) {
 	fputs(buf, f);
 }
 
+/*
+ * Open the public exchange file without following a link planted in
+ * its place: an existing file (stb from lstat) is only truncated if it
+ * is still the one that was looked at.
+ */
+static FILE *openpublic(char *fn, struct stat *stb, char *mode)
+{
+	struct stat stb2;
+	int fd;
+
+	if (stb) {
+		if ((fd = open(fn, O_WRONLY, 0666)) >= 0) {
+			if (fstat(fd, &stb2) == 0
+			    && stb->st_dev == stb2.st_dev
+			    && stb->st_ino == stb2.st_ino) {
+				if (ftruncate(fd, 0) != 0) {
+					close(fd);
+					fd = -1;
+				}
+			} else {
+				close(fd);
+				fd = -1;
+			}
+		}
+	} else
+		fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, 0666);
+	return fd >= 0 ? fdopen(fd, mode) : NULL;
+}
+
 /*
  * needs display for copybuffer access and termcap dumping
  */
@@ -340,8 +768,8 @@ void WriteFile(struct acluser *user, char *fn, int dump)
 	char fnbuf[FILENAME_MAX];
 	char *mode = "w";
 	int public = 0;
-	struct stat stb, stb2;
-	int fd, exists = 0;
+	struct stat stb;
+	int exists = 0;
 
 	switch (dump) {
 	case DUMP_TERMCAP:
@@ -384,25 +812,9 @@ void WriteFile(struct acluser *user, char *fn, int dump)
 	}
 
 	if (UserContext() > 0) {
-		if (dump == DUMP_EXCHANGE && public) {
-			if (exists) {
-				if ((fd = open(fn, O_WRONLY, 0666)) >= 0) {
-					if (fstat(fd, &stb2) == 0
-					    && stb.st_dev == stb2.st_dev
-					    && stb.st_ino == stb2.st_ino) {
-						if (ftruncate(fd, 0) != 0) {
-							close(fd);
-							fd = -1;
-						}
-					} else {
-						close(fd);
-						fd = -1;
-					}
-				}
-			} else
-				fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, 0666);
-			f = fd >= 0 ? fdopen(fd, mode) : NULL;
-		} else
+		if (dump == DUMP_EXCHANGE && public)
+			f = openpublic(fn, exists ? &stb : NULL, mode);
+		else
 			f = fopen(fn, mode);
 		if (f == NULL) {
 			UserReturn(0);
@@ -420,6 +832,7 @@ void WriteFile(struct acluser *user, char *fn, int dump)
 					fputs("<\n", f);
 				}
 				if (dump == DUMP_SCROLLBACK) {
+					HistReflow(fore);
 					for (i = fore->w_histheight - fore->w_scrollback_height; i < fore->w_histheight; i++) {
 						p = (WIN(i)->image);
 						pf = WIN(i)->font;
@@ -442,12 +855,15 @@ void WriteFile(struct acluser *user, char *fn, int dump)
 				DumpTermcap(fore->w_aflag, f);
 				break;
 			case DUMP_EXCHANGE:
+				/* write the runs between line ends in one go */
 				c = user->u_plop.buf;
-				for (i = user->u_plop.len; i-- > 0; c++)
-					if (*c == '\r' && (i == 0 || c[1] != '\n'))
-						putc('\n', f);
-					else
-						putc(*c, f);
+				for (char *end = c + user->u_plop.len, *cr; c < end; c = cr + 1) {
+					if ((cr = memchr(c, '\r', end - c)) == NULL)
+						cr = end;
+					fwrite(c, 1, cr - c, f);
+					if (cr < end)
+						putc(cr + 1 < end && cr[1] == '\n' ? '\r' : '\n', f);
+				}
 				break;
 			}
 			(void)fclose(f);
@@ -471,6 +887,78 @@ void WriteFile(struct acluser *user, char *fn, int dump)
 	}
 }
 
+/*
+ * ImmorTerm: open what the export command writes to (see export.h): a
+ * "|command" to pipe into, a Unix socket to connect to, or a file, which
+ * may be a FIFO that has a reader. The descriptor does not block; -1 if
+ * it cannot be opened.
+ */
+int ExportOpen(Window *win, char *name)
+{
+	struct stat st;
+	int fd = -1;
+
+	if (*name == '|')
+		fd = printpipe(win, name + 1);
+	else if (UserContext() > 0) {
+		if (stat(name, &st) == 0 && S_ISSOCK(st.st_mode)) {
+			struct sockaddr_un a;
+
+			memset(&a, 0, sizeof(a));
+			a.sun_family = AF_UNIX;
+			if (strlen(name) < sizeof(a.sun_path) && (fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0) {
+				strcpy(a.sun_path, name);
+				if (connect(fd, (struct sockaddr *)&a, sizeof(a)) < 0) {
+					close(fd);
+					fd = -1;
+				}
+			}
+		} else
+			fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK, 0666);
+		UserReturn(fd >= 0);
+	}
+	if (fd >= 0)
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+/*
+ * Write the exchange file like WriteFile(user, NULL, DUMP_EXCHANGE)
+ * does, but with what fill() puts into the file instead of a paste
+ * buffer: for a copy too big to be held in memory first.
+ */
+bool StreamExchange(void (*fill)(FILE *, void *), void *data)
+{
+	FILE *f;
+	struct stat stb;
+	bool public, exists, ok;
+
+	public = !strcmp(BufferFile, DEFAULT_BUFFERFILE);
+	exists = !lstat(BufferFile, &stb);
+	if (public && exists && (S_ISLNK(stb.st_mode) || stb.st_nlink > 1)) {
+		Msg(0, "No write to links, please.");
+		return false;
+	}
+	if (UserContext() > 0) {
+		if (public)
+			f = openpublic(BufferFile, exists ? &stb : NULL, "w");
+		else
+			f = fopen(BufferFile, "w");
+		if (f == NULL)
+			UserReturn(0);
+		else {
+			fill(f, data);
+			ok = !ferror(f);
+			UserReturn(fclose(f) == 0 && ok);
+		}
+	}
+	if (UserStatus() <= 0) {
+		Msg(0, "Cannot write \"%s\"", BufferFile);
+		return false;
+	}
+	return true;
+}
+
 /*
  * returns an allocated buffer which holds a copy of the file named filename.
  * lenp (if nonzero) points to a location, where the buffer size should be
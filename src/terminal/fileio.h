@@ -9,6 +9,8 @@ void  RcLine (char *, int);
 FILE *secfopen (char *, char *);
 int   secopen (char *, int, int);
 void  WriteFile (struct acluser *, char *, int);
+int   ExportOpen (Window *, char *);
+bool  StreamExchange (void (*)(FILE *, void *), void *);
 char *ReadFile (char *, int *);
 void  KillBuffers (void);
 int   printpipe (Window *, char *);
@@ -0,0 +1,360 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include "config.h"
+
+#include "histstore.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "screen.h"
+
+#include "fileio.h"
+#include "logfile.h"
+
+#define HSTORE_FRAME	(sizeof(struct hstorerec) + sizeof(uint32_t))
+
+static uint32_t hs_sum(const char *p, size_t n)
+{
+	uint32_t h = 2166136261u;
+
+	while (n--) {
+		h ^= (unsigned char)*p++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static bool hs_pread(int fd, void *buf, size_t n, off_t at)
+{
+	ssize_t r;
+
+	while ((r = pread(fd, buf, n, at)) < 0 && errno == EINTR)
+		;
+	return r == (ssize_t)n;
+}
+
+/*
+ * Reads the header of the record at at in a file of size bytes into rec,
+ * if it is one that fits. With datap the frozen lines are read too, into
+ * a buffer the caller frees, and must match their sum.
+ */
+static bool hs_readrec(int fd, off_t at, off_t size, struct hstorerec *rec, char **datap)
+{
+	uint32_t total;
+	char *data;
+
+	if (size - at < (off_t)HSTORE_FRAME || !hs_pread(fd, rec, sizeof(*rec), at) || rec->magic != HSTORE_RMAGIC
+	    || rec->len > size - at - HSTORE_FRAME
+	    || !hs_pread(fd, &total, sizeof(total), at + sizeof(*rec) + rec->len) || total != HSTORE_FRAME + rec->len)
+		return false;
+	if (!datap)
+		return true;
+	if ((data = malloc(rec->len ? rec->len : 1)) == NULL)
+		return false;
+	if (!hs_pread(fd, data, rec->len, at + sizeof(*rec)) || hs_sum(data, rec->len) != rec->sum) {
+		free(data);
+		return false;
+	}
+	*datap = data;
+	return true;
+}
+
+/*
+ * Where the records of a file of size bytes end, and the last of them in
+ * *last (a magic of 0 if there is none). The last record is checked
+ * whole; if it is torn, the file is read from the start.
+ */
+static off_t hs_end(int fd, off_t size, struct hstorerec *last)
+{
+	struct hstorerec rec;
+	uint32_t total;
+	off_t at;
+	char *data;
+
+	memset(last, 0, sizeof(*last));
+	if (size <= (off_t)sizeof(struct hstorehdr))
+		return sizeof(struct hstorehdr);
+	if (hs_pread(fd, &total, sizeof(total), size - sizeof(total)) && total >= HSTORE_FRAME
+	    && total <= size - sizeof(struct hstorehdr) && hs_readrec(fd, size - total, size, last, &data)) {
+		free(data);
+		return size;
+	}
+	for (at = sizeof(struct hstorehdr); hs_readrec(fd, at, size, &rec, &data); at += HSTORE_FRAME + rec.len) {
+		free(data);
+		*last = rec;
+	}
+	return at;
+}
+
+/* Opens the file name of a store, creating it if need be; returns its fd
+ * and in *size where its records end. */
+static int hs_open(const char *name, int flags, off_t *size, struct hstorerec *last)
+{
+	struct hstorehdr hdr;
+	struct stat st;
+	int fd;
+
+	if ((fd = secopen((char *)name, flags, 0600)) < 0)
+		return -1;
+	if (fstat(fd, &st))
+		goto fail;
+	if (st.st_size < (off_t)sizeof(hdr) && (flags & O_CREAT)) {
+		hdr.magic = HSTORE_MAGIC;
+		hdr.version = HSTORE_VERSION;
+		hdr.time = time(NULL);
+		if (ftruncate(fd, 0) || pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+			goto fail;
+		st.st_size = sizeof(hdr);
+	} else if (!hs_pread(fd, &hdr, sizeof(hdr), 0) || hdr.magic != HSTORE_MAGIC || hdr.version != HSTORE_VERSION) {
+		errno = EINVAL;
+		goto fail;
+	}
+	*size = hs_end(fd, st.st_size, last);
+	if (*size < st.st_size && (flags & O_CREAT) && ftruncate(fd, *size))
+		goto fail;
+	return fd;
+fail:
+	close(fd);
+	return -1;
+}
+
+/*
+ * Opens the store in the file name, and the one rotated to name.1 if
+ * there is one. Returns NULL with errno set if name cannot be opened or
+ * is not a store.
+ */
+struct histstore *HistStoreOpen(const char *name)
+{
+	struct histstore *hs;
+	struct hstorerec last, prevlast;
+	char prev[MAXPATHLEN + 2];
+
+	if ((hs = calloc(1, sizeof(*hs))) == NULL || (hs->hs_name = strdup(name)) == NULL) {
+		free(hs);
+		errno = ENOMEM;
+		return NULL;
+	}
+	if ((hs->hs_fd = hs_open(name, O_RDWR | O_CREAT, &hs->hs_size, &last)) < 0) {
+		free(hs->hs_name);
+		free(hs);
+		return NULL;
+	}
+	snprintf(prev, sizeof(prev), "%s.1", name);
+	hs->hs_prevfd = hs_open(prev, O_RDONLY, &hs->hs_prevsize, &prevlast);
+	if (hs->hs_prevfd >= 0) {
+		hs->hs_base = hs->hs_prevsize;
+		if (!last.magic)
+			last = prevlast;
+	}
+	if (last.magic)
+		hs->hs_seq = last.seq + last.lines;
+	return hs;
+}
+
+void HistStoreClose(struct histstore *hs)
+{
+	if (!hs)
+		return;
+	HistStoreSync(hs);
+	close(hs->hs_fd);
+	if (hs->hs_prevfd >= 0)
+		close(hs->hs_prevfd);
+	free(hs->hs_name);
+	free(hs);
+}
+
+/*
+ * Appends a record of lines lines of width cells, numbered from seq on,
+ * frozen into data and len bytes. Returns its offset in *offp, or false
+ * with errno set; a record that could not be written whole is cut off.
+ */
+bool HistStorePut(struct histstore *hs, uint64_t seq, int width, int lines, const char *data, size_t len,
+		  uint64_t *offp)
+{
+	struct hstorerec rec;
+	uint32_t total = HSTORE_FRAME + len;
+	char *buf;
+	ssize_t n;
+
+	if ((buf = malloc(total)) == NULL) {
+		errno = ENOMEM;
+		return false;
+	}
+	memset(&rec, 0, sizeof(rec));
+	rec.magic = HSTORE_RMAGIC;
+	rec.len = len;
+	rec.seq = seq;
+	rec.sum = hs_sum(data, len);
+	rec.width = width;
+	rec.lines = lines;
+	rec.time = time(NULL);
+	memcpy(buf, &rec, sizeof(rec));
+	memcpy(buf + sizeof(rec), data, len);
+	memcpy(buf + sizeof(rec) + len, &total, sizeof(total));
+	while ((n = pwrite(hs->hs_fd, buf, total, hs->hs_size)) < 0 && errno == EINTR)
+		;
+	free(buf);
+	if (n != (ssize_t)total) {
+		if (n >= 0)
+			errno = ENOSPC;
+		(void)!ftruncate(hs->hs_fd, hs->hs_size);
+		return false;
+	}
+	*offp = hs->hs_base + hs->hs_size;
+	hs->hs_size += total;
+	hs->hs_dirty = true;
+	return true;
+}
+
+/* Reads the record at off into rec and returns its frozen lines, which
+ * the caller frees; NULL if it is gone or does not read back whole. */
+char *HistStoreGet(struct histstore *hs, uint64_t off, struct hstorerec *rec)
+{
+	char *data;
+
+	if (off >= hs->hs_base) {
+		if (hs_readrec(hs->hs_fd, off - hs->hs_base, hs->hs_size, rec, &data))
+			return data;
+	} else if (hs->hs_prevfd >= 0 && off >= hs->hs_prevbase) {
+		if (hs_readrec(hs->hs_prevfd, off - hs->hs_prevbase, hs->hs_prevsize, rec, &data))
+			return data;
+	}
+	return NULL;
+}
+
+/*
+ * Finds the records holding the last lines lines of the store, walking
+ * back from the end of the file and on into name.1. *tailp is set to an
+ * array of them, oldest first, that the caller frees; returns how many
+ * there are, or -1 if there is no memory.
+ */
+int HistStoreTail(struct histstore *hs, int lines, struct hstoretail **tailp)
+{
+	struct {
+		int fd;
+		off_t size;
+		uint64_t base;
+	} files[2] = {
+		{ hs->hs_fd, hs->hs_size, hs->hs_base },
+		{ hs->hs_prevfd, hs->hs_prevsize, hs->hs_prevbase },
+	};
+	struct hstoretail *tail = NULL, *t;
+	uint64_t lo = UINT64_MAX;
+	int n = 0, size = 0, got = 0;
+
+	for (int f = 0; f < 2 && files[f].fd >= 0 && got < lines; f++) {
+		off_t at = files[f].size;
+		struct hstorerec rec;
+		uint32_t total;
+
+		while (got < lines && at > (off_t)sizeof(struct hstorehdr)
+		       && hs_pread(files[f].fd, &total, sizeof(total), at - sizeof(total))
+		       && total >= HSTORE_FRAME && total <= at - sizeof(struct hstorehdr)
+		       && hs_readrec(files[f].fd, at - total, at, &rec, NULL)) {
+			at -= total;
+			/* superseded by a later record */
+			if (rec.seq >= lo || !rec.lines)
+				continue;
+			if (n == size) {
+				size = size ? size * 2 : 64;
+				if ((t = realloc(tail, size * sizeof(*tail))) == NULL) {
+					free(tail);
+					return -1;
+				}
+				tail = t;
+			}
+			t = &tail[n++];
+			t->off = files[f].base + at;
+			t->rec = rec;
+			t->used = lo - rec.seq < rec.lines ? (int)(lo - rec.seq) : rec.lines;
+			lo = rec.seq;
+			got += t->used;
+		}
+	}
+	for (int i = 0; i < n / 2; i++) {
+		struct hstoretail x = tail[i];
+
+		tail[i] = tail[n - 1 - i];
+		tail[n - 1 - i] = x;
+	}
+	*tailp = tail;
+	return n;
+}
+
+/* Whether the file has reached log_rotate_size. */
+bool HistStoreFull(struct histstore *hs)
+{
+	return log_rotate_size && hs->hs_size >= log_rotate_size;
+}
+
+/*
+ * Renames the file to name.1, or removes it if rotated logs are not
+ * kept, and starts a new one. Records of the old file stay readable until
+ * the next rotation; nothing may still be in the one before it.
+ */
+int HistStoreRotate(struct histstore *hs)
+{
+	char prev[MAXPATHLEN + 2];
+	struct hstorerec last;
+	off_t size;
+	int fd;
+
+	snprintf(prev, sizeof(prev), "%s.1", hs->hs_name);
+	HistStoreSync(hs);
+	if (log_rotate_keep > 0 ? rename(hs->hs_name, prev) : unlink(hs->hs_name))
+		return -1;
+	if ((fd = hs_open(hs->hs_name, O_RDWR | O_CREAT | O_TRUNC, &size, &last)) < 0)
+		return -1;
+	if (hs->hs_prevfd >= 0)
+		close(hs->hs_prevfd);
+	hs->hs_prevfd = hs->hs_fd;
+	hs->hs_prevbase = hs->hs_base;
+	hs->hs_prevsize = hs->hs_size;
+	hs->hs_base += hs->hs_size;
+	hs->hs_fd = fd;
+	hs->hs_size = size;
+	return 0;
+}
+
+/* Forces what was written to the disk, if logs are (log_durability). */
+void HistStoreSync(struct histstore *hs)
+{
+	if (!hs->hs_dirty || log_durability == LOG_DURABLE_NONE)
+		return;
+#ifdef HAVE_FDATASYNC
+	(void)fdatasync(hs->hs_fd);
+#else
+	(void)fsync(hs->hs_fd);
+#endif
+	hs->hs_dirty = false;
+}
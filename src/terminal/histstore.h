@@ -0,0 +1,108 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#ifndef SCREEN_HISTSTORE_H
+#define SCREEN_HISTSTORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * The history store of a window (logfile history) is the log of its
+ * history: <logfile>.hist, written next to the log, holds every line
+ * that scrolled into the history, in the form the history ring keeps
+ * them, and the ring becomes a cache of its tail. It is a struct
+ * hstorehdr and then records, appended and never changed: a struct
+ * hstorerec, the frozen lines (see cell_freeze()) and a uint32_t with the
+ * size of the whole record, so that the file can be walked back from its
+ * end. A record holds the lines of one block of the ring (HBLOCK), or
+ * fewer when the ring was synced, resized or switched in between; lines
+ * are numbered from the first line of the store on (seq), and a record
+ * supersedes the older records holding the same lines.
+ *
+ * A block of the ring that is in a record is not compressed again; it
+ * points at the record, and reading it back reads the record. A window
+ * that starts logging with an empty history takes its history from the
+ * tail, blocks of its width still in the file. Reaching log_rotate_size
+ * the file is renamed to <logfile>.hist.1 and a new one started; the
+ * tail is read across both.
+ *
+ * Numbers are in host byte order. A record is written in one go and the
+ * file is synced like the logs (log_durability); a torn tail is cut off
+ * when the file is opened again.
+ */
+#define HSTORE_MAGIC	0x54534948	/* "HIST" */
+#define HSTORE_VERSION	2
+#define HSTORE_RMAGIC	0x43455248	/* "HREC" */
+
+struct hstorehdr {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t time;		/* when it was created */
+};
+
+struct hstorerec {
+	uint32_t magic;
+	uint32_t len;		/* of the frozen lines */
+	uint64_t seq;		/* number of the first line */
+	uint32_t sum;		/* FNV-1a of the frozen lines */
+	uint16_t width;		/* cells of a line, the window's width + 1 */
+	uint16_t lines;
+	uint64_t time;		/* when it was written */
+};
+
+/* Where a record of the tail is and how many of its lines are used. An
+ * offset counts across the files of a store, older ones first. */
+struct hstoretail {
+	uint64_t off;
+	struct hstorerec rec;
+	int used;		/* the first ones; later records have the rest */
+};
+
+struct histstore {
+	char	*hs_name;
+	int	 hs_fd;
+	off_t	 hs_size;	/* of the file, where the next record goes */
+	uint64_t hs_base;	/* offset of its first byte */
+	int	 hs_prevfd;	/* <name>.1 while blocks may still be in it, else -1 */
+	uint64_t hs_prevbase;
+	off_t	 hs_prevsize;
+	uint64_t hs_seq;	/* number of the first line not in a full record */
+	int	 hs_pending;	/* newest lines of the ring from hs_seq on */
+	int	 hs_synced;	/* of those, written in a partial record */
+	int	 hs_restored;	/* lines the window took from the tail */
+	bool	 hs_loading;	/* the window is taking them, do not store them */
+	bool	 hs_dirty;	/* written since it was last synced */
+	bool	 hs_failed;	/* a write failed, no further records */
+};
+
+struct histstore *HistStoreOpen (const char *);
+void HistStoreClose (struct histstore *);
+bool HistStorePut (struct histstore *, uint64_t, int, int, const char *, size_t, uint64_t *);
+char *HistStoreGet (struct histstore *, uint64_t, struct hstorerec *);
+int  HistStoreTail (struct histstore *, int, struct hstoretail **);
+bool HistStoreFull (struct histstore *);
+int  HistStoreRotate (struct histstore *);
+void HistStoreSync (struct histstore *);
+
+#endif /* SCREEN_HISTSTORE_H */
@@ -30,6 +30,7 @@
 #ifndef SCREEN_IMAGE_H
 #define SCREEN_IMAGE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 /* structure representing single cell of terminal */
@@ -42,6 +43,13 @@ struct mchar {
 	uint32_t mbcs;		/* used for multi byte character sets; TODO: possible to remove? use image now that it has 32 bits*/
 };
 
+/*
+ * Line of the grid on screen. Colors are kept as they came, so that
+ * writing a cell stays a store; attr, font and color arrays a line does
+ * not use point to the shared null array. Lines scrolled into the
+ * history keep indices into the interned style table instead (see
+ * struct hline and cell.c).
+ */
 struct mline {
 	uint32_t *image;
 	uint32_t *attr;
@@ -50,6 +58,58 @@ struct mline {
 	uint32_t *colorfg;
 };
 
+/* packed cell of a history line, see cell.c */
+struct mcell {
+	uint32_t image;		/* code point, as in struct mline */
+	uint32_t style;		/* index into the style table */
+};
+
+/* style run of a history line, it lasts until the next run starts */
+struct mrun {
+	uint32_t x;
+	uint32_t style;
+};
+
+/*
+ * History line at rest. Lines without attributes or colors only keep
+ * their code points; lines with a few renditions keep code points
+ * followed by nruns style runs (see HLINE_RUNS); all others keep packed
+ * cells. Both NULL is a blank line. ImmorTerm: trailing blanks of the
+ * default rendition are not kept; cells past len read as such blanks.
+ */
+struct hline {
+	uint32_t *image;
+	struct mcell *cells;
+	int nruns;
+	uint16_t len;		/* ImmorTerm: cells kept, the rest are blanks */
+	uint16_t room;		/* ImmorTerm: what the buffer holds, in words
+				 * (image) or cells (cells) */
+};
+
+#define HLINE_RUNS(hl) ((struct mrun *)((hl)->image + (hl)->len))
+
+/* ImmorTerm: the longest line of each form cell_pack() stored for one
+ * user, up to which lines keep their buffers (see hline_room()) */
+struct hlinehigh {
+	int image;		/* words of code points and runs */
+	int cells;		/* packed cells */
+};
+
+/* HBLOCK consecutive slots of the history ring, compressed when cold */
+struct hblock {
+	char *data;		/* compressed lines, NULL if they are in the ring */
+	size_t len;
+	unsigned int thawed;	/* expanded for reading at this stamp, 0 if not */
+	int mapped;		/* where data is, HB_HEAP, HB_MAPPED or HB_STORED */
+	uint64_t stored;	/* 1 + offset of the record in the history
+				 * store holding the lines, 0 if none */
+};
+
+#define HB_HEAP		0	/* malloc()ed */
+#define HB_MAPPED	1	/* points into the scrollback file */
+#define HB_STORED	2	/* only in the history store, see histstore.h */
+
+#define HBLOCK 64
 
 
 #define save_mline(ml, n) {					\
@@ -62,6 +62,77 @@ static struct mline *mlineoffset(const struct mline *ml, const int offset)
 #define RECODE_MCHAR(mc) ((l->l_encoding == UTF8) != (D_encoding == UTF8) ? recode_mchar(mc, l->l_encoding, D_encoding) : (mc))
 #define RECODE_MLINE(ml) ((l->l_encoding == UTF8) != (D_encoding == UTF8) ? recode_mline(ml, l->l_width, l->l_encoding, D_encoding) : (ml))
 
+/*
+ * ImmorTerm: a layer shown on displays that mirror each other (see
+ * DisplayMirrors()) is rendered for the first of them only. The others
+ * get a copy of that output if they are in the state the first one was
+ * in before. With a single canvas, the usual case, this costs a test.
+ */
+#define FANOUT_MAX 4
+
+struct fanout {
+	int n;
+	struct fansrc {
+		Canvas *cv;
+		bool seen;			/* its output is done */
+		int off;			/* where it starts in d_obuf */
+		unsigned long nflushes, nwrites;
+		struct dispout out;		/* the state before */
+	} src[FANOUT_MAX];
+};
+
+static void FanoutBegin(struct fanout *fo, Layer *l)
+{
+	Display *d;
+	struct fansrc *s;
+	int i;
+
+	fo->n = 0;
+	if (l->l_cvlist == NULL || l->l_cvlist->c_lnext == NULL)
+		return;
+	for (Canvas *cv = l->l_cvlist; cv && fo->n < FANOUT_MAX; cv = cv->c_lnext) {
+		d = cv->c_display;
+		for (i = 0; i < fo->n; i++)
+			if (DisplayMirrors(d, fo->src[i].cv->c_display)
+			    && !memcmp(&d->d_out, &fo->src[i].out, sizeof(struct dispout)))
+				break;
+		if (i < fo->n)
+			continue;	/* gets a copy */
+		s = fo->src + fo->n++;
+		s->cv = cv;
+		s->seen = false;
+		s->off = d->d_obufp - d->d_obuf;
+		s->nflushes = d->d_nflushes;
+		s->nwrites = d->d_nwrites;
+		memcpy(&s->out, &d->d_out, sizeof(struct dispout));
+	}
+}
+
+/* Called first for each canvas: true if its output was copied. */
+static bool Fanout(struct fanout *fo, Canvas *cv)
+{
+	Display *d = cv->c_display, *od;
+	struct fansrc *s;
+
+	for (int i = 0; i < fo->n; i++) {
+		s = fo->src + i;
+		if (s->cv == cv) {
+			s->seen = true;
+			return false;
+		}
+		od = s->cv->c_display;
+		if (!s->seen || !DisplayMirrors(d, od) || memcmp(&d->d_out, &s->out, sizeof(struct dispout)))
+			continue;
+		/* nothing of the output may have been written already */
+		if (od->d_nflushes != s->nflushes || od->d_nwrites != s->nwrites || od->d_obufp - od->d_obuf < s->off)
+			return false;
+		display = d;
+		MirrorOutput(od, s->off);
+		return true;
+	}
+	return false;
+}
+
 void LGotoPos(Layer *l, int x, int y)
 {
 	int x2, y2;
@@ -70,7 +141,7 @@ void LGotoPos(Layer *l, int x, int y)
 		LayPauseUpdateRegion(l, x, x, y, y);
 
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
-		if (l->l_pause.d && cv->c_slorient)
+		if (LAYPAUSED(l, cv))
 			continue;
 		display = cv->c_display;
 		if (D_blocked)
@@ -100,14 +171,18 @@ void LGotoPos(Layer *l, int x, int y)
 
 void LScrollH(Layer *l, int n, int y, int xs, int xe, int bce, struct mline *ol)
 {
+	struct fanout fo;
 	int y2, xs2, xe2;
 
 	if (n == 0)
 		return;
 	if (l->l_pause.d)
 		LayPauseUpdateRegion(l, xs, xe, y, y);
+	FanoutBegin(&fo, l);
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
-		if (l->l_pause.d && cv->c_slorient)
+		if (Fanout(&fo, cv))
+			continue;
+		if (LAYPAUSED(l, cv))
 			continue;
 		for (Viewport *vp = cv->c_vplist; vp; vp = vp->v_next) {
 			y2 = y + vp->v_yoff;
@@ -146,13 +221,17 @@ void LScrollH(Layer *l, int n, int y, int xs, int xe, int bce, struct mline *ol)
 
 void LScrollV(Layer *l, int n, int ys, int ye, int bce)
 {
+	struct fanout fo;
 	int ys2, ye2, xs2, xe2;
 	if (n == 0)
 		return;
 	if (l->l_pause.d)
 		LayPauseUpdateRegion(l, 0, l->l_width - 1, ys, ye);
+	FanoutBegin(&fo, l);
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
-		if (l->l_pause.d && cv->c_slorient)
+		if (Fanout(&fo, cv))
+			continue;
+		if (LAYPAUSED(l, cv))
 			continue;
 		for (Viewport *vp = cv->c_vplist; vp; vp = vp->v_next) {
 			xs2 = vp->v_xoff;
@@ -194,14 +273,18 @@ void LScrollV(Layer *l, int n, int ys, int ye, int bce)
 
 void LInsChar(Layer *l, struct mchar *c, int x, int y, struct mline *ol)
 {
+	struct fanout fo;
 	int xs2, xe2, y2, f;
 	struct mchar *c2, cc;
 	struct mline *rol;
 
 	if (l->l_pause.d)
 		LayPauseUpdateRegion(l, x, l->l_width - 1, y, y);
+	FanoutBegin(&fo, l);
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
-		if (l->l_pause.d && cv->c_slorient)
+		if (Fanout(&fo, cv))
+			continue;
+		if (LAYPAUSED(l, cv))
 			continue;
 		for (Viewport *vp = cv->c_vplist; vp; vp = vp->v_next) {
 			y2 = y + vp->v_yoff;
@@ -248,7 +331,7 @@ void LPutChar(Layer *l, struct mchar *c, int x, int y)
 				     , y, y);
 
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
-		if (l->l_pause.d && cv->c_slorient)
+		if (LAYPAUSED(l, cv))
 			continue;
 		display = cv->c_display;
 		if (D_blocked)
@@ -268,6 +351,7 @@ void LPutChar(Layer *l, struct mchar *c, int x, int y)
 
 void LPutStr(Layer *l, char *s, int n, struct mchar *r, int x, int y)
 {
+	struct fanout fo;
 	char *s2;
 	int xs2, xe2, y2;
 
@@ -276,8 +360,11 @@ void LPutStr(Layer *l, char *s, int n, struct mchar *r, int x, int y)
 	if (l->l_pause.d)
 		LayPauseUpdateRegion(l, x, x + n - 1, y, y);
 
+	FanoutBegin(&fo, l);
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
-		if (l->l_pause.d && cv->c_slorient)
+		if (Fanout(&fo, cv))
+			continue;
+		if (LAYPAUSED(l, cv))
 			continue;
 		for (Viewport *vp = cv->c_vplist; vp; vp = vp->v_next) {
 			y2 = y + vp->v_yoff;
@@ -314,6 +401,7 @@ void LPutStr(Layer *l, char *s, int n, struct mchar *r, int x, int y)
 
 void LPutWinMsg(Layer *l, char *s, int n, struct mchar *r, int x, int y)
 {
+	struct fanout fo;
 	int xs2, xe2, y2, len, len2;
 	struct mchar or;
 
@@ -324,8 +412,11 @@ void LPutWinMsg(Layer *l, char *s, int n, struct mchar *r, int x, int y)
 	len = strlen(s);
 	if (len > n)
 		len = n;
+	FanoutBegin(&fo, l);
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
-		if (l->l_pause.d && cv->c_slorient)
+		if (Fanout(&fo, cv))
+			continue;
+		if (LAYPAUSED(l, cv))
 			continue;
 		for (Viewport *vp = cv->c_vplist; vp; vp = vp->v_next) {
 			y2 = y + vp->v_yoff;
@@ -362,6 +453,7 @@ void LPutWinMsg(Layer *l, char *s, int n, struct mchar *r, int x, int y)
 
 void LClearLine(Layer *l, int y, int xs, int xe, int bce, struct mline *ol)
 {
+	struct fanout fo;
 	int y2, xs2, xe2;
 
 	/* check for magic margin condition */
@@ -371,8 +463,11 @@ void LClearLine(Layer *l, int y, int xs, int xe, int bce, struct mline *ol)
 		xe = l->l_width - 1;
 	if (l->l_pause.d)
 		LayPauseUpdateRegion(l, xs, xe, y, y);
+	FanoutBegin(&fo, l);
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
-		if (l->l_pause.d && cv->c_slorient)
+		if (Fanout(&fo, cv))
+			continue;
+		if (LAYPAUSED(l, cv))
 			continue;
 		for (Viewport *vp = cv->c_vplist; vp; vp = vp->v_next) {
 			xs2 = xs + vp->v_xoff;
@@ -397,6 +492,7 @@ void LClearLine(Layer *l, int y, int xs, int xe, int bce, struct mline *ol)
 
 void LClearArea(Layer *l, int xs, int ys, int xe, int ye, int bce, int uself)
 {
+	struct fanout fo;
 	int xs2, ys2, xe2, ye2;
 	/* Check for zero-height window */
 	if (ys < 0 || ye < ys)
@@ -409,8 +505,11 @@ void LClearArea(Layer *l, int xs, int ys, int xe, int ye, int bce, int uself)
 		xe = l->l_width - 1;
 	if (l->l_pause.d)
 		LayPauseUpdateRegion(l, xs, xe, ys, ye);
+	FanoutBegin(&fo, l);
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
-		if (l->l_pause.d && cv->c_slorient)
+		if (Fanout(&fo, cv))
+			continue;
+		if (LAYPAUSED(l, cv))
 			continue;
 		display = cv->c_display;
 		if (D_blocked)
@@ -453,11 +552,15 @@ void LClearArea(Layer *l, int xs, int ys, int xe, int ye, int bce, int uself)
 
 void LCDisplayLine(Layer *l, struct mline *ml, int y, int xs, int xe, int isblank)
 {
+	struct fanout fo;
 	int xs2, xe2, y2;
 	if (l->l_pause.d)
 		LayPauseUpdateRegion(l, xs, xe, y, y);
+	FanoutBegin(&fo, l);
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
-		if (l->l_pause.d && cv->c_slorient)
+		if (Fanout(&fo, cv))
+			continue;
+		if (LAYPAUSED(l, cv))
 			continue;
 		display = cv->c_display;
 		if (D_blocked)
@@ -524,7 +627,7 @@ void LWrapChar(Layer *l, struct mchar *c, int y, int top, int bot, bool ins)
 		yy = y == l->l_height - 1 ? y : y + 1;
 
 		for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
-			if (l->l_pause.d && cv->c_slorient)
+			if (LAYPAUSED(l, cv))
 				continue;
 			y2 = 0;	/* gcc -Wall */
 			display = cv->c_display;
@@ -567,7 +670,7 @@ void LWrapChar(Layer *l, struct mchar *c, int y, int top, int bot, bool ins)
 		/* hard case: scroll up */
 
 		for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
-			if (l->l_pause.d && cv->c_slorient)
+			if (LAYPAUSED(l, cv))
 				continue;
 			display = cv->c_display;
 			if (D_blocked)
@@ -960,20 +1063,21 @@ void LayPause(Layer *layer, bool pause)
 		win = NULL;
 
 	for (Canvas *cv = layer->l_cvlist; cv; cv = cv->c_lnext) {
-		if (!cv->c_slorient)
+		if (!cv->c_slorient && !layer->l_pause.frame)
 			continue;	/* Wasn't split, so already updated. */
 
 		display = cv->c_display;
+		SyncBegin();
 
 		for (Viewport *vp = cv->c_vplist; vp; vp = vp->v_next) {
-			for (int line = layer->l_pause.top; line <= layer->l_pause.bottom; line++) {
-				int xs, xe;
+			for (int line = layer->l_pause.top; line <= layer->l_pause.bottom && line < layer->l_height; line++) {
+				struct pausespan *sp = layer->l_pause.spans + line * LAYPAUSE_SPANS;
 
-				if (line + vp->v_yoff >= vp->v_ys && line + vp->v_yoff <= vp->v_ye &&
-				    ((xs = layer->l_pause.left[line]) >= 0) &&
-				    ((xe = layer->l_pause.right[line]) >= 0)) {
-					xs += vp->v_xoff;
-					xe += vp->v_xoff;
+				if (line + vp->v_yoff < vp->v_ys || line + vp->v_yoff > vp->v_ye)
+					continue;
+				for (int i = 0; i < layer->l_pause.nspans[line]; i++) {
+					int xs = sp[i].xs + vp->v_xoff;
+					int xe = sp[i].xe + vp->v_xoff;
 
 					if (xs < vp->v_xs)
 						xs = vp->v_xs;
@@ -982,7 +1086,7 @@ void LayPause(Layer *layer, bool pause)
 
 					if (layer->l_encoding == UTF8 && xe < vp->v_xe && win) {
 						struct mline *ml = win->w_mlines + line;
-						if (dw_left(ml, xe, UTF8))
+						if (dw_left(ml, xe - vp->v_xoff, UTF8))
 							xe++;
 					}
 
@@ -1007,10 +1111,70 @@ void LayPause(Layer *layer, bool pause)
 
 			GotoPos(cx, cy);
 		}
+		SyncEnd();
 	}
 
 	for (int line = layer->l_pause.top; line <= layer->l_pause.bottom; line++)
-		layer->l_pause.left[line] = layer->l_pause.right[line] = -1;
+		layer->l_pause.nspans[line] = 0;
+	layer->l_pause.top = layer->l_pause.bottom = -1;
+}
+
+/*
+ * ImmorTerm: stop pausing without refreshing anything, as the canvases
+ * already show what changed (see WinPassthru() in window.c).
+ */
+void LayPauseDrop(Layer *layer)
+{
+	for (int line = layer->l_pause.top; line >= 0 && line <= layer->l_pause.bottom; line++)
+		layer->l_pause.nspans[line] = 0;
+	layer->l_pause.top = layer->l_pause.bottom = -1;
+	layer->l_pause.d = false;
+	layer->l_pause.frame = false;
+}
+
+/* ImmorTerm: adds columns xs to xe to the spans of a line, see struct
+ * pausespan */
+static void LayPauseSpan(struct pausespan *sp, unsigned char *np, int xs, int xe)
+{
+	int n = *np, i, j;
+
+	/* the spans it reaches become one */
+	for (i = 0; i < n && sp[i].xe + LAYPAUSE_GAP < xs; i++)
+		;
+	for (j = i; j < n && sp[j].xs <= xe + LAYPAUSE_GAP; j++) {
+		if (sp[j].xs < xs)
+			xs = sp[j].xs;
+		if (sp[j].xe > xe)
+			xe = sp[j].xe;
+	}
+	if (j == i && n == LAYPAUSE_SPANS) {
+		int best = 0;
+
+		/* no room: join the two closest of the spans and the new one */
+		for (int k = 1; k < n; k++)
+			if (sp[k].xs - sp[k - 1].xe < sp[best + 1].xs - sp[best].xe)
+				best = k - 1;
+		if ((i > 0 && xs - sp[i - 1].xe < sp[best + 1].xs - sp[best].xe) ||
+		    (i < n && sp[i].xs - xe < sp[best + 1].xs - sp[best].xe)) {
+			/* nearer to a neighbour than those are to each other */
+			if (i > 0 && (i == n || xs - sp[i - 1].xe <= sp[i].xs - xe))
+				sp[i - 1].xe = xe;
+			else
+				sp[i].xs = xs;
+			return;
+		}
+		sp[best].xe = sp[best + 1].xe;
+		memmove(sp + best + 1, sp + best + 2, (n - best - 2) * sizeof(*sp));
+		n--;
+		if (i > best + 1)
+			i--;
+		j = i;
+	}
+	/* spans i to j - 1 go, the new one takes their place */
+	memmove(sp + i + 1, sp + j, (n - j) * sizeof(*sp));
+	sp[i].xs = xs;
+	sp[i].xe = xe;
+	*np = n - (j - i) + 1;
 }
 
 void LayPauseUpdateRegion(Layer *layer, int xs, int xe, int ys, int ye)
@@ -1021,38 +1185,37 @@ void LayPauseUpdateRegion(Layer *layer, int xs, int xe, int ys, int ye)
 		ys = 0;
 	if (ye >= layer->l_height)
 		ye = layer->l_height - 1;
+	if (xs < 0)
+		xs = 0;
 	if (xe >= layer->l_width)
 		xe = layer->l_width - 1;
+	if (ys > ye || xs > xe)
+		return;
 
+	if (layer->l_pause.lines <= ye) {
+		int lines = ye + 32;
+		struct pausespan *spans = realloc(layer->l_pause.spans, sizeof(*spans) * LAYPAUSE_SPANS * lines);
+		unsigned char *nspans;
+
+		if (spans)
+			layer->l_pause.spans = spans;
+		if (!spans || (nspans = realloc(layer->l_pause.nspans, lines)) == NULL)
+			return;
+		memset(nspans + layer->l_pause.lines, 0, lines - layer->l_pause.lines);
+		layer->l_pause.nspans = nspans;
+		layer->l_pause.lines = lines;
+	}
 	if (layer->l_pause.top == -1 || layer->l_pause.top > ys)
 		layer->l_pause.top = ys;
-	if (layer->l_pause.bottom < ye) {
+	if (layer->l_pause.bottom < ye)
 		layer->l_pause.bottom = ye;
-		if (layer->l_pause.lines <= ye) {
-			int o = layer->l_pause.lines;
-			layer->l_pause.lines = ye + 32;
-			layer->l_pause.left = realloc(layer->l_pause.left, sizeof(int) * layer->l_pause.lines);
-			layer->l_pause.right = realloc(layer->l_pause.right, sizeof(int) * layer->l_pause.lines);
-			while (o < layer->l_pause.lines) {
-				layer->l_pause.left[o] = layer->l_pause.right[o] = -1;
-				o++;
-			}
-		}
-	}
 
-	while (ys <= ye) {
-		if (layer->l_pause.left[ys] == -1 || layer->l_pause.left[ys] > xs)
-			layer->l_pause.left[ys] = xs;
-		if (layer->l_pause.right[ys] < xe)
-			layer->l_pause.right[ys] = xe;
-		ys++;
-	}
+	for (; ys <= ye; ys++)
+		LayPauseSpan(layer->l_pause.spans + ys * LAYPAUSE_SPANS, layer->l_pause.nspans + ys, xs, xe);
 }
 
 void LayerCleanupMemory(Layer *layer)
 {
-	if (layer->l_pause.left)
-		free(layer->l_pause.left);
-	if (layer->l_pause.right)
-		free(layer->l_pause.right);
+	free(layer->l_pause.spans);
+	free(layer->l_pause.nspans);
 }
@@ -54,6 +54,19 @@ struct LayFuncs {
 						   flayer->l_data (but not flayer->l_data itself). */
 };
 
+/*
+ * ImmorTerm: columns of a line of a paused layer that changed. Changes
+ * closer than LAYPAUSE_GAP columns to a span join it, as going there is
+ * about as dear as drawing what is between; past LAYPAUSE_SPANS spans
+ * the two closest ones are joined.
+ */
+#define LAYPAUSE_SPANS	4
+#define LAYPAUSE_GAP	8
+
+struct pausespan {
+	int xs, xe;
+};
+
 typedef struct Layer Layer;
 struct Layer {
 	Canvas *l_cvlist;	/* list of canvases displaying layer */
@@ -81,14 +94,20 @@ struct Layer {
 
 	struct {
 		bool d;		/* Is the output for the layer blocked? */
+		bool frame;	/* ImmorTerm: blocked on all canvases until the next frame */
 
-		/* After unpausing, what region should we refresh? */
-		int *left, *right;
+		/* After unpausing, what region should we refresh? ImmorTerm: up
+		 * to LAYPAUSE_SPANS spans of each line, apart and in order */
+		struct pausespan *spans;	/* LAYPAUSE_SPANS for each line */
+		unsigned char *nspans;
 		int top, bottom;
 		int lines;
 	} l_pause;
 };
 
+/* Is output to this canvas of the layer held back? */
+#define LAYPAUSED(l, cv)	((l)->l_pause.d && ((l)->l_pause.frame || (cv)->c_slorient))
+
 #define LayProcess		(*flayer->l_layfn->lf_LayProcess)
 #define LayAbort		(*flayer->l_layfn->lf_LayAbort)
 #define LayRedisplayLine	(*flayer->l_layfn->lf_LayRedisplayLine)
@@ -143,6 +162,13 @@ struct Layer {
  */
 void LayPause (Layer *layer, bool pause);
 
+/**
+ * Unpauses a layer without refreshing the region, which is up to date.
+ *
+ * @param layer The layer.
+ */
+void LayPauseDrop (Layer *layer);
+
 /**
  * Update the region to refresh after a layer is unpaused.
  *
@@ -35,6 +35,7 @@
 #include "layer.h"
 #include "misc.h"
 #include "process.h"
+#include "socket.h"
 #include "winmsg.h"
 
 static char ListID[] = "window";
@@ -112,7 +113,7 @@ static ListRow *gl_Window_add_group(ListData *ldata, ListRow *row)
 	Window *group = row->data, *w;
 	ListRow *cur = row;
 
-	FOR_EACH_WINDOW(wdata, w, if (w->w_group != group)
+	FOR_EACH_WINDOW(wdata, w, if (w->w_group != group || OtherSession(w))
 			continue; cur = glist_add_row(ldata, w, cur); if (w == wdata->fore)
 			ldata->selected = cur; if (w->w_type == W_TYPE_GROUP)
 			cur = gl_Window_add_group(ldata, cur);) ;
@@ -129,7 +130,7 @@ static int gl_Window_rebuild(ListData *ldata)
 	if (flayer->l_width < 10 || flayer->l_height < 6)
 		return -1;
 
-	FOR_EACH_WINDOW(wdata, w, if (w->w_group != wdata->group)
+	FOR_EACH_WINDOW(wdata, w, if (w->w_group != wdata->group || OtherSession(w))
 			continue; row = glist_add_row(ldata, w, row); if (w == wdata->fore)
 			ldata->selected = row; if (w->w_type == W_TYPE_GROUP && wdata->nested)
 			row = gl_Window_add_group(ldata, row);) ;
@@ -504,7 +505,7 @@ void display_windows(int onblank, int order, Window *group)
 
 	/* Set the most recent window as selected. */
 	wdata->fore = mru_window;
-	while (wdata->fore && wdata->fore->w_group != group)
+	while (wdata->fore && (wdata->fore->w_group != group || OtherSession(wdata->fore)))
 		wdata->fore = wdata->fore->w_prev_mru;
 
 	ldata->data = wdata;
@@ -537,6 +538,8 @@ static void WListUpdate(Window *p, ListData *ldata)
 				d = window_ancestor(wdata->group, p);
 		}
 	}
+	if (OtherSession(p))
+		d = 0;	/* ImmorTerm: see HostedOpen() */
 
 	if (!d) {
 		if (gl_Window_remove(ldata, p))
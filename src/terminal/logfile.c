@@ -36,17 +36,41 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>		/* memcpy for write buffering */
+#ifdef HAVE_PTHREAD_CREATE
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#endif
+#ifdef LOG_GZIP
+#include <zlib.h>
+#endif
 
 #include "screen.h"
 
 #include "misc.h"
+#include "trace.h"
 
 static void changed_logfile(Log *);
 static Log *lookup_logfile(char *);
 static int stolen_logfile(Log *);
+#ifdef LOG_GZIP
+static void logz_close(Log *);
+#endif
+static void logcommit(void);
+static void logsync_fn(Event *, void *);
 
 static Log *logroot = NULL;
 
+bool log_async = false;
+off_t log_rotate_size = 0;
+int log_rotate_keep = 1;
+int log_index_step = 0;
+int log_compress = 0;
+int log_durability = LOG_DURABLE_NONE;
+
+static Event logsyncev;		/* LOG_DURABLE_NEWLINE commit */
+
 /*
  * Update cached stat info if file has grown.
  * Called only periodically now (every LOG_STAT_CHECK_INTERVAL flushes)
@@ -91,6 +115,7 @@ static int flush_log_buffer(Log *l)
 	if (!l->buffer || l->buflen == 0)
 		return 0;
 
+	TRACE1(log__flush, l->buflen);
 	if (fwrite(l->buffer, l->buflen, 1, l->fp) != 1) {
 		l->buflen = 0;
 		return -1;
@@ -101,6 +126,265 @@ static int flush_log_buffer(Log *l)
 	return 0;
 }
 
+/* Force what was written to fd to the disk. */
+static void log_datasync(int fd)
+{
+#ifdef HAVE_FDATASYNC
+	(void)fdatasync(fd);
+#else
+	(void)fsync(fd);
+#endif
+}
+
+/*
+ * Rename name<suffix> to name.1<suffix>, name.1<suffix> to name.2<suffix>
+ * and so on, dropping name.<keep><suffix>. With keep 0 the file is removed.
+ */
+static void rotate_suffix(char *name, char *suffix, int keep)
+{
+	char from[MAXPATHLEN], to[MAXPATHLEN];
+
+	if (keep <= 0) {
+		snprintf(from, sizeof(from), "%s%s", name, suffix);
+		unlink(from);
+		return;
+	}
+	for (int i = keep - 1; i > 0; i--) {
+		snprintf(from, sizeof(from), "%s.%d%s", name, i, suffix);
+		snprintf(to, sizeof(to), "%s.%d%s", name, i + 1, suffix);
+		rename(from, to);
+	}
+	snprintf(from, sizeof(from), "%s%s", name, suffix);
+	snprintf(to, sizeof(to), "%s.1%s", name, suffix);
+	rename(from, to);
+}
+
+/* Rotate a logfile and its index. name.gz becomes name.1.gz and so on. */
+static void rotate_names(Log *l)
+{
+	char base[MAXPATHLEN];
+	size_t len = strlen(l->name);
+
+	if (!l->zs || len < 3 || len >= sizeof(base) || strcmp(l->name + len - 3, ".gz")) {
+		rotate_suffix(l->name, "", l->keep);
+		rotate_suffix(l->name, ".idx", l->keep);
+		return;
+	}
+	memcpy(base, l->name, len - 3);
+	base[len - 3] = 0;
+	rotate_suffix(base, ".gz", l->keep);
+	rotate_suffix(base, ".gz.idx", l->keep);
+}
+
+/*
+ * The line index. It belongs to the main thread: records describe the
+ * output as logfwrite() passes it on, which is what ends up in the file.
+ */
+static void index_flush(Log *l)
+{
+	size_t off = 0;
+	ssize_t w;
+
+	if (l->idxfd < 0)
+		return;
+	while (off < l->idxlen) {
+		if ((w = write(l->idxfd, l->idxbuf + off, l->idxlen - off)) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;	/* a broken index is not worth an error */
+		}
+		off += w;
+	}
+	l->idxlen = 0;
+}
+
+static void index_record(Log *l, off_t at)
+{
+	l->idxlines = 0;
+	if (l->idxsize - l->idxlen < 24) {
+		size_t size = l->idxsize ? l->idxsize * 2 : 256;
+		char *nb = realloc(l->idxbuf, size);
+
+		if (!nb)
+			return;
+		l->idxbuf = nb;
+		l->idxsize = size;
+	}
+	l->idxlen += sprintf(l->idxbuf + l->idxlen, "%lld\n", (long long)at);
+}
+
+/* Count the newlines in buf, which starts at offset at of the logfile. */
+static void index_add(Log *l, const char *buf, size_t n, off_t at)
+{
+	const char *p = buf, *e = buf + n;
+
+	while ((p = memchr(p, '\n', e - p))) {
+		p++;
+		if (++l->idxlines >= l->idxstep)
+			index_record(l, at + (p - buf));
+	}
+}
+
+#ifdef LOG_GZIP
+/*
+ * Index the gzip members of a compressed logfile from offset from up to
+ * to: a record goes after the first member that completes idxstep lines.
+ * The end of the last complete member is returned.
+ */
+static off_t index_zscan(Log *l, int fd, off_t from, off_t to)
+{
+	z_stream zs;
+	unsigned char in[4096], out[16384];
+	off_t at = from, good = from;
+	bool full = false;	/* more output may come without more input */
+	int lines = 0;		/* in the current member */
+	ssize_t r;
+	int ret;
+
+	memset(&zs, 0, sizeof(zs));
+	if (inflateInit2(&zs, 15 + 16) != Z_OK)
+		return from;
+	for (;;) {
+		if (!zs.avail_in && !full) {
+			size_t want = to - at < (off_t)sizeof(in) ? (size_t)(to - at) : sizeof(in);
+
+			if (!want || (r = pread(fd, in, want, at)) <= 0)
+				break;
+			zs.next_in = in;
+			zs.avail_in = r;
+			at += r;
+		}
+		zs.next_out = out;
+		zs.avail_out = sizeof(out);
+		ret = inflate(&zs, Z_NO_FLUSH);
+		full = !zs.avail_out;
+		for (unsigned char *p = out, *e = out + sizeof(out) - zs.avail_out;
+		     (p = memchr(p, '\n', e - p)); p++)
+			lines++;
+		if (ret == Z_STREAM_END) {
+			good = at - zs.avail_in;
+			l->idxlines += lines;
+			lines = 0;
+			if (l->idxlines >= l->idxstep)
+				index_record(l, good);
+			inflateReset(&zs);
+			full = false;
+		} else if (ret != Z_OK && !(ret == Z_BUF_ERROR && !zs.avail_in))
+			break;
+	}
+	inflateEnd(&zs);
+	return good;
+}
+#endif
+
+/* Start an empty index, for an empty logfile. */
+static void index_create(Log *l)
+{
+	char path[MAXPATHLEN];
+	char hdr[24];
+
+	snprintf(path, sizeof(path), "%s.idx", l->name);
+	snprintf(hdr, sizeof(hdr), "step %d\n", l->idxstep);
+	if ((l->idxfd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666)) < 0)
+		l->idxstep = 0;	/* no index then */
+	else if (write(l->idxfd, hdr, strlen(hdr)) < 0) {
+		close(l->idxfd);
+		l->idxfd = -1;
+		l->idxstep = 0;
+	}
+}
+
+/*
+ * Open the index of a logfile that holds size bytes. An index that fits
+ * the logfile is continued from its last record; otherwise, or with
+ * rebuild set, it is made anew. Either way the part of the logfile after
+ * the last record is scanned for newlines. Returns how much of the
+ * logfile is intact, which is less than size only for a compressed one
+ * that ends in an unfinished member.
+ */
+static off_t index_open(Log *l, off_t size, bool rebuild)
+{
+	char path[MAXPATHLEN];
+	char buf[4096];
+	off_t last = 0, ilen;
+	int step = 0, fd, rfd;
+	ssize_t r;
+
+	snprintf(path, sizeof(path), "%s.idx", l->name);
+	l->idxlines = 0;
+	l->idxlen = 0;
+	if ((fd = open(path, O_RDONLY)) >= 0) {
+		if (!rebuild && (r = read(fd, buf, sizeof(buf) - 1)) > 0) {
+			buf[r] = 0;
+			sscanf(buf, "step %d", &step);
+		}
+		if (step == l->idxstep && (ilen = lseek(fd, 0, SEEK_END)) > 0) {
+			/* the last record, if there is one */
+			off_t at = ilen > 32 ? ilen - 32 : 0;
+			char *p;
+
+			step = 0;
+			if ((r = pread(fd, buf, ilen - at, at)) > 1 && buf[r - 1] == '\n') {
+				buf[r - 1] = 0;
+				if ((p = strrchr(buf, '\n')) && p[1] >= '0' && p[1] <= '9') {
+					last = strtoll(p + 1, NULL, 10);
+					step = l->idxstep;
+				} else if (!p && at == 0)
+					step = l->idxstep;	/* just the header */
+			}
+		}
+		close(fd);
+	}
+	rfd = open(l->name, O_RDONLY);
+	if (step == l->idxstep && last > 0) {
+		unsigned char c[2] = { 0, 0 };
+
+		/* a record is the offset after a newline, or where a member starts */
+		if (last > size || rfd < 0)
+			step = 0;
+		else if (l->zs) {
+			if (last < size && (pread(rfd, c, 2, last) != 2 || c[0] != 0x1f || c[1] != 0x8b))
+				step = 0;
+		} else if (pread(rfd, c, 1, last - 1) != 1 || c[0] != '\n')
+			step = 0;
+	}
+	if (step != l->idxstep) {
+		index_create(l);
+		last = 0;
+	} else if ((l->idxfd = open(path, O_WRONLY | O_APPEND)) < 0)
+		l->idxstep = 0;
+	if (rfd < 0 || !l->idxstep) {
+		if (rfd >= 0)
+			close(rfd);
+		return size;
+	}
+#ifdef LOG_GZIP
+	if (l->zs) {
+		size = index_zscan(l, rfd, last, size);
+		last = size;
+	}
+#endif
+	while (last < size) {
+		size_t want = size - last < (off_t)sizeof(buf) ? (size_t)(size - last) : sizeof(buf);
+
+		if ((r = pread(rfd, buf, want, last)) <= 0)
+			break;
+		index_add(l, buf, r, last);
+		last += r;
+	}
+	close(rfd);
+	index_flush(l);
+	return size;
+}
+
+static void index_close(Log *l)
+{
+	index_flush(l);
+	if (l->idxfd >= 0)
+		close(l->idxfd);
+	l->idxfd = -1;
+}
+
 /*
  * Requires fd to be open and need_fd to be closed.
  * If possible, need_fd will be open afterwards and refer to
@@ -153,6 +437,45 @@ void logreopen_register(int (*fn) (char *, int, struct Log *))
 	lf_reopen_fn = fn ? fn : logfile_reopen;
 }
 
+/* Account for output that is on its way to the logfile. Compressed
+ * output is indexed before it is compressed. */
+static void logaccount(Log *l, const char *buf, size_t n)
+{
+	if (l->idxstep && !l->zs)
+		index_add(l, buf, n, l->size);
+	l->size += n;
+}
+
+/*
+ * Call the reopen function for a stolen logfile. The output that is still
+ * on its way to the file is passed in (up to) two pieces, it ends up in the
+ * new one. Size and index are brought up to date, unless the reopen
+ * function opened the file we had before, as far as inode and size tell
+ * (inode numbers get reused). 0 is returned on success, else -1.
+ */
+static int reopen_stolen(Log *l, const char *p1, size_t n1, const char *p2, size_t n2)
+{
+	struct stat o, st;
+
+	fflush(l->fp);	/* so that the old file is as long as we think */
+	if (fstat(fileno(l->fp), &o) < 0)
+		o.st_dev = o.st_ino = 0;
+	if (lf_reopen_fn(l->name, fileno(l->fp), l))
+		return -1;
+	if (fstat(fileno(l->fp), &st) < 0)
+		return 0;
+	if (st.st_dev == o.st_dev && st.st_ino == o.st_ino && st.st_size + (off_t)(n1 + n2) == l->size)
+		return 0;
+	l->size = st.st_size;
+	if (l->idxstep) {
+		index_close(l);
+		index_open(l, st.st_size, true);
+	}
+	logaccount(l, p1, n1);
+	logaccount(l, p2, n2);
+	return 0;
+}
+
 /*
  * If the logfile has been removed, truncated, unlinked or the like,
  * return nonzero.
@@ -192,6 +515,409 @@ static Log *lookup_logfile(char *name)
 	return NULL;
 }
 
+#ifdef HAVE_PTHREAD_CREATE
+
+/*
+ * The writer thread.
+ *
+ * Every Log opened with log_async set gets a LogRing, a single producer
+ * single consumer queue: the main thread only advances head, the writer
+ * thread only advances tail. The state says which thread may use the
+ * Log's fp and st:
+ *   LR_RUN     the writer; it writes, and checks for a stolen logfile
+ *   LR_STOLEN  the main thread; it calls the reopen function, then LR_RUN
+ *   LR_FAILED  the main thread; a write failed, logfwrite reports it
+ *   LR_ROTATED the main thread; the writer has written everything up to
+ *              the rotation mark and renamed the file, the main thread
+ *              opens the new one through the reopen function, then LR_RUN
+ *   LR_CLOSED  the writer; logfclose gave the Log up, the writer writes
+ *              what is left and frees it
+ * The writer changes LR_RUN into LR_STOLEN or LR_FAILED with a compare and
+ * swap, so that it cannot undo a concurrent LR_CLOSED.
+ */
+enum { LR_RUN, LR_STOLEN, LR_FAILED, LR_ROTATED, LR_CLOSED };
+
+#define LR_NOMARK SIZE_MAX
+
+struct LogRing {
+	LogRing *next;		/* writer's list */
+	Log *log;
+	char *data;		/* LOG_RING_SIZE bytes */
+	atomic_size_t head;	/* bytes queued */
+	atomic_size_t tail;	/* bytes written */
+	atomic_size_t rotate;	/* head at which to rotate, or LR_NOMARK */
+	atomic_int state;
+	atomic_bool sync;	/* sync once written, see logcommit() */
+	int error;		/* errno of the failed write, for LR_FAILED */
+	size_t dropped;		/* bytes that found the ring full; main thread */
+};
+
+static pthread_mutex_t logw_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t logw_cond = PTHREAD_COND_INITIALIZER;
+static LogRing *logw_new;	/* rings the writer has not seen yet */
+static bool logw_stop;		/* logfdrain() was called */
+static atomic_bool logw_idle;	/* writer sleeps until there is output */
+static atomic_bool logw_flush;	/* write out everything now */
+static pthread_t logw_thread;
+static pid_t logw_pid;		/* process the writer runs in */
+
+static void logw_kick(void)
+{
+	pthread_mutex_lock(&logw_lock);
+	pthread_cond_signal(&logw_cond);
+	pthread_mutex_unlock(&logw_lock);
+}
+
+static void logw_flushreq(void)
+{
+	if (!atomic_exchange(&logw_flush, true))
+		logw_kick();
+}
+
+/* There is output now; wake the writer if it sleeps until there is. */
+static void logw_wake(void)
+{
+	if (atomic_load(&logw_idle) && atomic_exchange(&logw_idle, false))
+		logw_kick();
+}
+
+/* Is there anything for the writer to do with r (1), or to do now (2)? */
+static int logw_pending(LogRing *r)
+{
+	size_t used;
+
+	switch (atomic_load(&r->state)) {
+	case LR_CLOSED:
+		return 2;
+	case LR_RUN:
+		used = atomic_load(&r->head) - atomic_load(&r->tail);
+		if (used >= LOG_RING_SIZE / 2)
+			return 2;
+		return used || atomic_load(&r->rotate) != LR_NOMARK || atomic_load(&r->sync);
+	}
+	return 0;
+}
+
+static int logw_pending_all(LogRing *rings)
+{
+	int p = 0;
+
+	for (LogRing *r = rings; r && p < 2; r = r->next)
+		if (logw_pending(r) > p)
+			p = logw_pending(r);
+	return p;
+}
+
+static void logw_write(LogRing *r, bool force)
+{
+	Log *l = r->log;
+	size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+	size_t mark = atomic_load(&r->rotate);
+	int state = LR_RUN;
+
+	if (!force && atomic_load(&r->state) != LR_RUN)
+		return;
+	if (force)
+		mark = LR_NOMARK;	/* nobody left to reopen the file */
+	else if (mark != LR_NOMARK && mark - tail <= head - tail)
+		head = mark;
+	if (tail != head && !force && stolen_logfile(l)) {
+		if (atomic_compare_exchange_strong(&r->state, &state, LR_STOLEN))
+			return;
+	}
+	if (tail == head && tail != mark)
+		return;
+	while (tail != head) {
+		size_t off = tail % LOG_RING_SIZE;
+		size_t len = head - tail;
+		ssize_t w;
+
+		if (len > LOG_RING_SIZE - off)
+			len = LOG_RING_SIZE - off;
+		TRACE1(log__flush, len);
+		if ((w = write(fileno(l->fp), r->data + off, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			r->error = errno;
+			state = LR_RUN;
+			if (atomic_compare_exchange_strong(&r->state, &state, LR_FAILED))
+				return;
+			tail = head;	/* closed meanwhile, nobody to tell */
+		} else
+			tail += w;
+		atomic_store_explicit(&r->tail, tail, memory_order_release);
+	}
+	l->writecount++;
+	changed_logfile(l);
+	if (tail == mark) {
+		rotate_names(l);
+		atomic_store(&r->rotate, LR_NOMARK);
+		state = LR_RUN;
+		atomic_compare_exchange_strong(&r->state, &state, LR_ROTATED);
+	}
+}
+
+/* A commit asked for the file to be synced, after what it queued before. */
+static void logw_sync(LogRing *r)
+{
+	if (atomic_load(&r->state) == LR_RUN && atomic_exchange(&r->sync, false))
+		log_datasync(fileno(r->log->fp));
+}
+
+static void logw_free(LogRing *r)
+{
+	Log *l = r->log;
+
+	if (l->durable != LOG_DURABLE_NONE)
+		log_datasync(fileno(l->fp));
+	fclose(l->fp);
+	free(l->buffer);
+	free(l->idxbuf);
+	free(l->zs);
+	free(l->zbuf);
+	free(l->name);
+	free((char *)l->st);
+	free((char *)l);
+	free(r->data);
+	free(r);
+}
+
+static void *logw_main(void *arg)
+{
+	LogRing *rings = NULL, **rp, *r;
+	bool waited = false;
+	bool stop;
+
+	(void)arg; /* unused */
+
+	pthread_mutex_lock(&logw_lock);
+	for (;;) {
+		while ((r = logw_new)) {
+			logw_new = r->next;
+			r->next = rings;
+			rings = r;
+		}
+		stop = logw_stop;
+		if (!stop && !atomic_load(&logw_flush) && logw_pending_all(rings) < 2) {
+			if (!logw_pending_all(rings)) {
+				/* logw_put() kicks us once it sees this */
+				atomic_store(&logw_idle, true);
+				if (!logw_pending_all(rings))
+					pthread_cond_wait(&logw_cond, &logw_lock);
+				atomic_store(&logw_idle, false);
+				continue;
+			}
+			if (!waited) {
+				/* let output collect for a while */
+				struct timespec ts;
+
+				clock_gettime(CLOCK_REALTIME, &ts);
+				ts.tv_nsec += LOG_WRITER_DELAY * 1000000L;
+				ts.tv_sec += ts.tv_nsec / 1000000000L;
+				ts.tv_nsec %= 1000000000L;
+				pthread_cond_timedwait(&logw_cond, &logw_lock, &ts);
+				waited = true;
+				continue;
+			}
+		}
+		waited = false;
+		atomic_store(&logw_flush, false);
+		pthread_mutex_unlock(&logw_lock);
+
+		for (rp = &rings; (r = *rp);) {
+			bool closed = atomic_load(&r->state) == LR_CLOSED;
+
+			logw_write(r, stop || closed);
+			logw_sync(r);
+			if (closed) {
+				*rp = r->next;
+				logw_free(r);
+			} else
+				rp = &r->next;
+		}
+		if (stop)
+			return NULL;
+		pthread_mutex_lock(&logw_lock);
+	}
+}
+
+static int logw_start(void)
+{
+	sigset_t all, old;
+	int r;
+
+	if (logw_pid == getpid())
+		return 0;
+	/* signals are for the main thread */
+	logw_stop = false;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	r = pthread_create(&logw_thread, NULL, logw_main, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (r)
+		return -1;
+	logw_pid = getpid();
+	return 0;
+}
+
+/* Hand a new Log to the writer thread. If that fails it stays synchronous. */
+static void logw_attach(Log *l)
+{
+	LogRing *r;
+
+	if (logw_start() || !(r = calloc(1, sizeof(LogRing))))
+		return;
+	if (!(r->data = malloc(LOG_RING_SIZE))) {
+		free(r);
+		return;
+	}
+	r->log = l;
+	atomic_init(&r->head, 0);
+	atomic_init(&r->tail, 0);
+	atomic_init(&r->rotate, LR_NOMARK);
+	atomic_init(&r->state, LR_RUN);
+	atomic_init(&r->sync, false);
+	l->ring = r;
+
+	pthread_mutex_lock(&logw_lock);
+	r->next = logw_new;
+	logw_new = r;
+	pthread_mutex_unlock(&logw_lock);
+}
+
+static bool logw_copy(LogRing *r, const char *buf, size_t n)
+{
+	size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	size_t used = head - atomic_load_explicit(&r->tail, memory_order_acquire);
+	size_t off = head % LOG_RING_SIZE;
+	size_t len = n;
+
+	if (n > LOG_RING_SIZE - used)
+		return false;
+	if (len > LOG_RING_SIZE - off)
+		len = LOG_RING_SIZE - off;
+	memcpy(r->data + off, buf, len);
+	memcpy(r->data, buf + len, n - len);
+	atomic_store_explicit(&r->head, head + n, memory_order_release);
+
+	if (used < LOG_RING_SIZE / 2 && used + n >= LOG_RING_SIZE / 2)
+		logw_kick();
+	else
+		logw_wake();
+	return true;
+}
+
+/* Take the Log back from the writer if it asks us to reopen the file. */
+static int logw_reopen(Log *l)
+{
+	LogRing *r = l->ring;
+	int state = atomic_load(&r->state);
+
+	if (state == LR_FAILED) {
+		errno = r->error;
+		return -1;
+	}
+	if (state == LR_STOLEN) {
+		size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+		size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+		size_t off = tail % LOG_RING_SIZE;
+		size_t n1 = head - tail;
+
+		if (n1 > LOG_RING_SIZE - off)
+			n1 = LOG_RING_SIZE - off;
+		if (reopen_stolen(l, r->data + off, n1, r->data, head - tail - n1))
+			return -1;
+	} else if (state == LR_ROTATED) {
+		if (lf_reopen_fn(l->name, fileno(l->fp), l))
+			return -1;
+		l->st->st_ino = l->st->st_dev = 0;	/* a new file */
+		if (l->idxstep) {
+			index_create(l);
+			index_flush(l);
+		}
+	} else
+		return 0;
+	atomic_store(&r->state, LR_RUN);
+	logw_wake();
+	return 0;
+}
+
+/* Mark where the old file ends, the writer renames it once it gets there. */
+static int logw_rotate(Log *l)
+{
+	LogRing *r = l->ring;
+
+	if (logw_reopen(l))
+		return -1;	/* the last one must be finished first */
+	if (atomic_load(&r->rotate) != LR_NOMARK)
+		return 1;	/* not done with the last one yet */
+	atomic_store(&r->rotate, atomic_load_explicit(&r->head, memory_order_relaxed));
+	index_close(l);	/* the new one is made with the new file */
+	l->size = 0;
+	l->idxlines = 0;
+	logw_flushreq();
+	return 0;
+}
+
+static int logw_put(Log *l, char *buf, size_t n)
+{
+	LogRing *r = l->ring;
+
+	if (logw_reopen(l))
+		return -1;
+	if (r->dropped && l->zs)
+		r->dropped = 0;	/* a note would not be gzip; the members are whole */
+	if (r->dropped) {
+		char note[64];
+
+		snprintf(note, sizeof(note), "\r\n[screen: %zu bytes not logged]\r\n", r->dropped);
+		if (!logw_copy(r, note, strlen(note))) {
+			r->dropped += n;
+			return 1;
+		}
+		logaccount(l, note, strlen(note));
+		r->dropped = 0;
+	}
+	if (!logw_copy(r, buf, n)) {
+		/* the disk is too slow, rather lose output than stall */
+		r->dropped += n;
+		logw_flushreq();
+		return 1;
+	}
+	logaccount(l, buf, n);
+	return 1;
+}
+
+static void logw_close(Log *l)
+{
+	/* what is left belongs into the new file after a rotation */
+	if (atomic_load(&l->ring->state) == LR_ROTATED)
+		(void)logw_reopen(l);
+	atomic_store(&l->ring->state, LR_CLOSED);
+	logw_kick();
+}
+
+void logfdrain(void)
+{
+	if (logw_pid != getpid())
+		return;
+	pthread_mutex_lock(&logw_lock);
+	logw_stop = true;
+	pthread_cond_signal(&logw_cond);
+	pthread_mutex_unlock(&logw_lock);
+	pthread_join(logw_thread, NULL);
+	logw_pid = 0;
+}
+
+#else /* HAVE_PTHREAD_CREATE */
+
+void logfdrain(void)
+{
+}
+
+#endif /* HAVE_PTHREAD_CREATE */
+
 Log *logfopen(char *name, FILE * fp)
 {
 	Log *l;
@@ -224,6 +950,35 @@ Log *logfopen(char *name, FILE * fp)
 	l->buflen = 0;
 	l->stat_countdown = LOG_STAT_CHECK_INTERVAL;
 	changed_logfile(l);
+	l->size = l->st->st_size;
+	l->maxsize = log_rotate_size;
+	l->keep = log_rotate_keep;
+	l->idxfd = -1;
+	if ((l->durable = log_durability) == LOG_DURABLE_NEWLINE && !logsyncev.handler) {
+		logsyncev.type = EV_TIMEOUT;
+		logsyncev.handler = logsync_fn;
+		logsyncev.name = "logsync_fn";
+	}
+#ifdef LOG_GZIP
+	if (log_compress && (l->zs = calloc(1, sizeof(z_stream)))
+	    && deflateInit2(l->zs, log_compress, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		free(l->zs);
+		l->zs = NULL;
+	}
+#endif
+	if ((l->idxstep = log_index_step) > 0) {
+		off_t size = index_open(l, l->size, false);
+
+		/* cut off the member a crash left unfinished */
+		if (size < l->size && ftruncate(fileno(fp), size) == 0) {
+			l->size = size;
+			fstat(fileno(fp), l->st);
+		}
+	}
+#ifdef HAVE_PTHREAD_CREATE
+	if (log_async)
+		logw_attach(l);
+#endif
 
 	l->next = logroot;
 	logroot = l;
@@ -237,6 +992,29 @@ int islogfile(char *name)
 	return lookup_logfile(name) ? 1 : 0;
 }
 
+/*
+ * ImmorTerm: bytes held in memory for l: its write buffer, the queue to
+ * the writer thread, pending index records and the compressed member.
+ * deflate keeps about 256 KB of state for the window and memory levels
+ * used here, counted as that.
+ */
+size_t logfsize(Log *l)
+{
+	size_t n = sizeof(*l) + l->idxsize;
+
+	if (l->buffer)
+		n += LOG_BUFFER_SIZE;
+#ifdef HAVE_PTHREAD_CREATE
+	if (l->ring)
+		n += sizeof(LogRing) + LOG_RING_SIZE;
+#endif
+#ifdef LOG_GZIP
+	if (l->zs)
+		n += sizeof(z_stream) + (1 << (15 + 2)) + (1 << (8 + 9)) + l->zsize;
+#endif
+	return n;
+}
+
 int logfclose(Log *l)
 {
 	Log **lp;
@@ -254,12 +1032,28 @@ int logfclose(Log *l)
 		abort();
 
 	*lp = l->next;
+#ifdef LOG_GZIP
+	if (l->zs)
+		logz_close(l);
+#endif
+	index_close(l);
+#ifdef HAVE_PTHREAD_CREATE
+	if (l->ring) {
+		logw_close(l);	/* the writer thread frees it */
+		return 0;
+	}
+#endif
 	/* Flush any buffered data before closing */
 	if (l->buffer && l->buflen > 0) {
 		fwrite(l->buffer, l->buflen, 1, l->fp);
 	}
+	if (l->durable != LOG_DURABLE_NONE && !fflush(l->fp))
+		log_datasync(fileno(l->fp));
 	fclose(l->fp);
 	free(l->buffer);	/* free write buffer if allocated */
+	free(l->idxbuf);
+	free(l->zs);
+	free(l->zbuf);
 	free(l->name);
 	free((char *)l->st);
 	free((char *)l);
@@ -276,7 +1070,7 @@ int logfclose(Log *l)
  * Stat checks are now periodic (every LOG_STAT_CHECK_INTERVAL flushes)
  * instead of every write, reducing fstat() syscall overhead significantly.
  */
-int logfwrite(Log *l, char *buf, size_t n)
+static int logfbuffer(Log *l, char *buf, size_t n)
 {
 	/* Lazy buffer allocation on first write */
 	if (!l->buffer) {
@@ -297,7 +1091,7 @@ int logfwrite(Log *l, char *buf, size_t n)
 
 	/* Buffer would overflow - flush it first */
 	/* Periodic stat check only on buffer flush, not every write */
-	if (periodic_stat_check(l) && lf_reopen_fn(l->name, fileno(l->fp), l))
+	if (periodic_stat_check(l) && reopen_stolen(l, l->buffer, l->buflen, NULL, 0))
 		return -1;
 
 	if (flush_log_buffer(l) < 0)
@@ -318,6 +1112,177 @@ int logfwrite(Log *l, char *buf, size_t n)
 	return 1;
 }
 
+static int logfput(Log *l, char *buf, size_t n)
+{
+	int r;
+
+#ifdef HAVE_PTHREAD_CREATE
+	if (l->ring)
+		return logw_put(l, buf, n);
+#endif
+	if ((r = logfbuffer(l, buf, n)) == 1)
+		logaccount(l, buf, n);
+	return r;
+}
+
+/*
+ * Rename the logfile away and continue in a new one. The writer thread
+ * does the renaming for an asynchronous Log, 1 is returned if it is still
+ * busy with the last rotation.
+ */
+static int logrotate(Log *l)
+{
+#ifdef HAVE_PTHREAD_CREATE
+	if (l->ring)
+		return logw_rotate(l);
+#endif
+	if (flush_log_buffer(l) < 0 || fflush(l->fp))
+		return -1;
+	index_close(l);
+	rotate_names(l);
+	if (lf_reopen_fn(l->name, fileno(l->fp), l))
+		return -1;
+	l->st->st_ino = l->st->st_dev = 0;	/* a new file */
+	l->size = 0;
+	l->idxlines = 0;
+	if (l->idxstep)
+		index_create(l);
+	return 0;
+}
+
+#ifdef LOG_GZIP
+/* Compress output into the current member, or finish it. */
+static int logz_deflate(Log *l, char *buf, size_t n, int flush)
+{
+	z_stream *zs = l->zs;
+	int ret;
+
+	zs->next_in = (Bytef *)buf;
+	zs->avail_in = n;
+	do {
+		if (l->zsize - l->zlen < 4096) {
+			size_t size = l->zsize ? l->zsize * 2 : 16384;
+			char *nb = realloc(l->zbuf, size);
+
+			if (!nb)
+				return -1;
+			l->zbuf = nb;
+			l->zsize = size;
+		}
+		zs->next_out = (Bytef *)l->zbuf + l->zlen;
+		zs->avail_out = l->zsize - l->zlen;
+		ret = deflate(zs, flush);
+		l->zlen = (char *)zs->next_out - l->zbuf;
+		if (ret == Z_STREAM_ERROR)
+			return -1;
+	} while (flush == Z_FINISH ? ret != Z_STREAM_END : (zs->avail_in || !zs->avail_out));
+	l->zin += n;
+	return 0;
+}
+
+/* Finish the current member and pass it on to the logfile. */
+static int logz_frame(Log *l)
+{
+	int r;
+
+	if (!l->zin)
+		return 1;
+	if (logz_deflate(l, NULL, 0, Z_FINISH) < 0)
+		return -1;
+	r = logfput(l, l->zbuf, l->zlen);
+	deflateReset(l->zs);
+	l->zlen = l->zin = 0;
+	return r;
+}
+
+/*
+ * logfwrite() for a compressed logfile. Members end where index records
+ * go and where a rotation is due, both after a line, so that records
+ * point at whole lines and a new file starts with one.
+ */
+static int logz_write(Log *l, char *buf, size_t n)
+{
+	int r;
+
+	while (n) {
+		size_t k = LOG_FRAME_SIZE - l->zin;
+		bool rotate = l->maxsize && l->size >= l->maxsize;
+		bool cut = false;
+
+		if (k > n)
+			k = n;
+		for (char *p = buf; (p = memchr(p, '\n', buf + k - p));) {
+			p++;
+			if (rotate || (l->idxstep && ++l->idxlines >= l->idxstep)) {
+				k = p - buf;
+				cut = true;
+				break;
+			}
+		}
+		if (logz_deflate(l, buf, k, Z_NO_FLUSH) < 0)
+			return -1;
+		buf += k;
+		n -= k;
+		if (!cut && l->zin < LOG_FRAME_SIZE)
+			continue;
+		if ((r = logz_frame(l)) < 1)
+			return r;
+		if (l->idxstep && l->idxlines >= l->idxstep)
+			index_record(l, l->size);
+		if (cut && rotate && logrotate(l) < 0)
+			return -1;
+	}
+	return 1;
+}
+
+/* Finish a compressed logfile for logfclose(). */
+static void logz_close(Log *l)
+{
+	(void)logz_frame(l);
+	deflateEnd(l->zs);
+}
+#endif /* LOG_GZIP */
+
+int logfwrite(Log *l, char *buf, size_t n)
+{
+	int r;
+
+	if (l->durable != LOG_DURABLE_NONE) {
+		l->unsynced = true;
+		if (l->durable == LOG_DURABLE_NEWLINE && !logsyncev.queued && memchr(buf, '\n', n)) {
+			SetTimeout(&logsyncev, LOG_SYNC_DELAY);
+			evenq(&logsyncev);
+		}
+	}
+#ifdef LOG_GZIP
+	if (l->zs)
+		return logz_write(l, buf, n);
+#endif
+	while (l->maxsize && l->size + (off_t)n > l->maxsize) {
+		size_t room = l->size < l->maxsize ? l->maxsize - l->size : 0;
+		size_t k = room < n ? room : n;
+
+		/* the old file gets the lines that still fit */
+		while (k > 0 && buf[k - 1] != '\n')
+			k--;
+		if (!k && !l->size)
+			k = room;	/* not even one line fits */
+		if (k) {
+			if ((r = logfput(l, buf, k)) < 1)
+				return r;
+			buf += k;
+			n -= k;
+		}
+		if ((r = logrotate(l)) < 0)
+			return -1;
+		if (r > 0)
+			break;
+	}
+	if (!n)
+		return 1;
+	return logfput(l, buf, n);
+}
+
 int logfflush(Log *l)
 {
 	int r = 0;
@@ -325,8 +1290,21 @@ int logfflush(Log *l)
 	if (!l) {
 		/* Flush all logfiles */
 		for (l = logroot; l; l = l->next) {
+#ifdef LOG_GZIP
+			if (l->zs && logz_frame(l) < 1)
+				return -1;
+#endif
+			index_flush(l);
+#ifdef HAVE_PTHREAD_CREATE
+			if (l->ring) {
+				if (logw_reopen(l))
+					return -1;
+				logw_flushreq();
+				continue;
+			}
+#endif
 			/* Periodic stat check on flush */
-			if (periodic_stat_check(l) && lf_reopen_fn(l->name, fileno(l->fp), l))
+			if (periodic_stat_check(l) && reopen_stolen(l, l->buffer, l->buflen, NULL, 0))
 				return -1;
 			/* Flush our write buffer first */
 			if (flush_log_buffer(l) < 0)
@@ -334,9 +1312,23 @@ int logfflush(Log *l)
 			r |= fflush(l->fp);
 			l->flushcount++;
 		}
+		logcommit();
 	} else {
 		/* Flush specific logfile */
-		if (periodic_stat_check(l) && lf_reopen_fn(l->name, fileno(l->fp), l))
+#ifdef LOG_GZIP
+		if (l->zs && logz_frame(l) < 1)
+			return -1;
+#endif
+		index_flush(l);
+#ifdef HAVE_PTHREAD_CREATE
+		if (l->ring) {
+			if (logw_reopen(l))
+				return -1;
+			logw_flushreq();
+			return 0;
+		}
+#endif
+		if (periodic_stat_check(l) && reopen_stolen(l, l->buffer, l->buflen, NULL, 0))
 			return -1;
 		/* Flush our write buffer first */
 		if (flush_log_buffer(l) < 0)
@@ -346,3 +1338,32 @@ int logfflush(Log *l)
 	}
 	return r;
 }
+
+/*
+ * Group commit: write out every logfile with output since the last commit
+ * whose durability asks for it, then sync them all. The writer thread
+ * syncs its own after writing what was queued.
+ */
+static void logcommit(void)
+{
+	for (Log *l = logroot; l; l = l->next) {
+		if (!l->unsynced || l->durable == LOG_DURABLE_NONE)
+			continue;
+		l->unsynced = false;
+#ifdef HAVE_PTHREAD_CREATE
+		if (l->ring)
+			atomic_store(&l->ring->sync, true);	/* logfflush() wakes it */
+#endif
+		if (logfflush(l) || l->ring)
+			continue;
+		log_datasync(fileno(l->fp));
+	}
+}
+
+static void logsync_fn(Event *event, void *data)
+{
+	(void)event; /* unused */
+	(void)data; /* unused */
+
+	logcommit();
+}
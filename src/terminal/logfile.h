@@ -30,6 +30,7 @@
 #ifndef SCREEN_LOGFILE_H
 #define SCREEN_LOGFILE_H
 
+#include <stdbool.h>
 #include <stdio.h>
 
 /* Buffer size for write buffering optimization.
@@ -41,6 +42,29 @@
  * while still catching external modifications reasonably quickly. */
 #define LOG_STAT_CHECK_INTERVAL 100
 
+/* Size of the queue between a Log and the writer thread (logfile async).
+ * Output that finds it full is dropped and counted, so this is how far the
+ * disk may fall behind before anything is lost. */
+#define LOG_RING_SIZE (256 * 1024)
+
+/* How long the writer thread lets output collect in a queue before it
+ * writes it, unless the queue is half full or a flush is asked for. */
+#define LOG_WRITER_DELAY 100	/* ms */
+
+/* Logfiles can be written as gzip streams when zlib is there. */
+#if defined(HAVE_ZLIB_H) && defined(HAVE_DEFLATE)
+#define LOG_GZIP
+#endif
+
+/* How long the first completed line waits for the ones after it before a
+ * logfile with LOG_DURABLE_NEWLINE is synced, see log_durability. */
+#define LOG_SYNC_DELAY 50	/* ms */
+
+/* Most output a compressed logfile collects into one gzip member before
+ * the member is finished and written. */
+#define LOG_FRAME_SIZE (64 * 1024)
+
+typedef struct LogRing LogRing;
 typedef struct Log Log;
 struct Log {
 	Log *next;
@@ -54,8 +78,89 @@ struct Log {
 	char *buffer;		/* write buffer, allocated on first write */
 	size_t buflen;		/* current bytes in buffer */
 	int stat_countdown;	/* counts down to next fstat() check */
+	LogRing *ring;		/* queue to the writer thread, NULL if synchronous */
+	/* Size based rotation */
+	off_t size;		/* bytes in the file, counted as they are written */
+	off_t maxsize;		/* rotate before the file grows past this, 0: never */
+	int keep;		/* rotated files kept as name.1 ... name.<keep> */
+	/* Line index, see log_index_step */
+	int idxfd;		/* name.idx, -1 while there is none */
+	int idxstep;		/* lines per record, 0: no index */
+	int idxlines;		/* newlines since the last record */
+	char *idxbuf;		/* records not written yet */
+	size_t idxlen, idxsize;
+	/* Compression, see log_compress */
+	void *zs;		/* z_stream of the current member, NULL: plain */
+	char *zbuf;		/* the member compressed so far */
+	size_t zlen, zsize;
+	size_t zin;		/* bytes of output in it */
+	/* Durability, see log_durability */
+	int durable;		/* LOG_DURABLE_*, from log_durability */
+	bool unsynced;		/* output since the last commit */
 };
 
+/*
+ * Logfiles opened while this is set are written by a separate thread:
+ * logfwrite() copies into the Log's ring and returns, the writer thread
+ * does the write(), the fstat() checks and reports a stolen logfile back,
+ * so that the reopen function still runs in the main thread.
+ */
+extern bool log_async;
+
+/*
+ * Logfiles opened while log_rotate_size is nonzero are rotated when they
+ * would grow past it: the file is renamed to name.1 (name.1 to name.2 and
+ * so on, up to log_rotate_keep; with keep 0 it is removed) and reopened
+ * through the reopen function. Output up to its last newline still goes
+ * to the old file, so that the new one starts with a line.
+ */
+extern off_t log_rotate_size;
+extern int log_rotate_keep;
+
+/*
+ * Logfiles opened while log_index_step is nonzero get a sidecar index,
+ * name.idx, so that their last lines can be found with one seek. The
+ * index is text: a first line "step <N>", then the byte offset after
+ * every Nth newline of the logfile, one per line. So the logfile holds at
+ * least k * N lines from the offset k records before the last one:
+ *   off=$(tail -n $((k + 1)) name.idx | head -1)
+ * (a result of "step" means the whole file). It is rotated along with the
+ * logfile, and rebuilt when it does not match the logfile it is opened
+ * with. Records are added as output is logged and written on logfflush().
+ */
+extern int log_index_step;
+
+/*
+ * Logfiles opened while log_compress is nonzero are written as gzip with
+ * that compression level, as a series of independent members: a member is
+ * finished after LOG_FRAME_SIZE bytes of output, on logfflush() and, with
+ * an index, wherever a record goes, so all records are member offsets:
+ *   tail -c +$((off + 1)) name | gzip -dc
+ * Crashing loses the unfinished member; at the next logfopen() the index,
+ * if there is one, finds where the last complete member ends, and what
+ * follows is cut off. Rotation waits for the end of a line and then for
+ * the member to be finished, so the file may grow a little past its size.
+ */
+extern int log_compress;
+
+/*
+ * When the output of logfiles opened while log_durability is set is
+ * forced to the disk with fdatasync():
+ *   LOG_DURABLE_NONE     never, the kernel writes it back when it likes
+ *   LOG_DURABLE_INTERVAL on logfflush(NULL), which the logflush timer calls
+ *   LOG_DURABLE_NEWLINE  LOG_SYNC_DELAY after output completed a line
+ * A commit syncs every such logfile that had output since the last one,
+ * so a burst of lines in many windows costs one round of syncs (group
+ * commit). Logfiles of the writer thread are synced by it, otherwise
+ * the main thread waits for the disk.
+ */
+enum { LOG_DURABLE_NONE, LOG_DURABLE_INTERVAL, LOG_DURABLE_NEWLINE };
+extern int log_durability;
+
+/* Compression level of "logfile compress gzip" without one. Low levels
+ * already shrink escape heavy output a lot, at a fraction of the time. */
+#define LOG_GZIP_LEVEL 3
+
 /*
  * open a logfile, The second argument must be NULL, when the named file
  * is already a logfile or must be a appropriatly opened file pointer
@@ -77,6 +182,11 @@ int islogfile (char *name);
 int logfclose (Log *);
 int logfwrite (Log *, char *, size_t);
 
+/*
+ * logfsize tells the bytes of memory a log holds
+ */
+size_t logfsize (Log *);
+
 /*
  * logfflush should be called periodically. If no argument is passed,
  * all logfiles are flushed, else the specified file
@@ -84,6 +194,12 @@ int logfwrite (Log *, char *, size_t);
  */
 int logfflush (Log *ifany);
 
+/*
+ * write out everything queued for the writer thread and stop it.
+ * Called before exiting; a no-op if there is no writer thread.
+ */
+void logfdrain (void);
+
 /*
  * a reopen function may be registered here, in case you want to bring your
  * own (more secure open), it may come along with a private data pointer.
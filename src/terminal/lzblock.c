@@ -0,0 +1,171 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include "lzblock.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define HASHLOG		12
+#define MINMATCH	4
+#define LASTLITERALS	5	/* the last bytes are always literals */
+#define MFLIMIT		12	/* no match may start this close to the end */
+#define MAXOFFSET	65535
+
+static uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t hash32(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - HASHLOG);
+}
+
+/* writes the remainder of a length that didn't fit in its token nibble */
+static uint8_t *put_length(uint8_t *op, size_t l)
+{
+	for (; l >= 255; l -= 255)
+		*op++ = 255;
+	*op++ = (uint8_t)l;
+	return op;
+}
+
+/* Compresses LEN bytes of SRC into DST, which has room for CAP bytes.
+ * Returns the compressed size, or 0 if it does not fit. CAP of at least
+ * LZB_BOUND(len) always fits. */
+size_t lzb_compress(const void *srcv, size_t len, void *dstv, size_t cap)
+{
+	const uint8_t *src = srcv, *ip = src, *anchor = src, *end = src + len;
+	uint8_t *dst = dstv, *op = dst, *oend = dst + cap;
+	uint32_t table[1 << HASHLOG];
+	size_t litlen;
+
+	memset(table, 0, sizeof(table));
+	if (len >= MFLIMIT + 1) {
+		const uint8_t *mflimit = end - MFLIMIT;
+		const uint8_t *matchlimit = end - LASTLITERALS;
+
+		for (ip++; ip < mflimit;) {
+			uint32_t seq = read32(ip);
+			uint32_t h = hash32(seq);
+			const uint8_t *ref = src + table[h];
+			const uint8_t *mp;
+			size_t mlen, off;
+			uint8_t *token;
+
+			table[h] = (uint32_t)(ip - src);
+			if (ip - ref > MAXOFFSET || read32(ref) != seq) {
+				ip++;
+				continue;
+			}
+			while (ip > anchor && ref > src && ip[-1] == ref[-1])
+				ip--, ref--;
+			for (mp = ip + MINMATCH; mp < matchlimit && *mp == ref[mp - ip]; mp++)
+				;
+			litlen = ip - anchor;
+			mlen = mp - ip - MINMATCH;
+			off = ip - ref;
+			if ((size_t)(oend - op) < 1 + litlen / 255 + 1 + litlen + 2 + mlen / 255 + 1 + 1 + LASTLITERALS)
+				return 0;
+			token = op++;
+			*token = (uint8_t)((litlen >= 15 ? 15 : litlen) << 4);
+			if (litlen >= 15)
+				op = put_length(op, litlen - 15);
+			memcpy(op, anchor, litlen);
+			op += litlen;
+			*op++ = (uint8_t)off;
+			*op++ = (uint8_t)(off >> 8);
+			*token |= (uint8_t)(mlen >= 15 ? 15 : mlen);
+			if (mlen >= 15)
+				op = put_length(op, mlen - 15);
+			ip = anchor = mp;
+			if (ip < mflimit)
+				table[hash32(read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+		}
+	}
+	litlen = end - anchor;
+	if ((size_t)(oend - op) < 1 + litlen / 255 + 1 + litlen)
+		return 0;
+	*op++ = (uint8_t)((litlen >= 15 ? 15 : litlen) << 4);
+	if (litlen >= 15)
+		op = put_length(op, litlen - 15);
+	memcpy(op, anchor, litlen);
+	op += litlen;
+	return op - dst;
+}
+
+/* Expands LEN bytes of compressed SRC into exactly DLEN bytes at DST.
+ * Returns 0 on success, -1 if the data is corrupt. */
+int lzb_decompress(const void *srcv, size_t len, void *dstv, size_t dlen)
+{
+	const uint8_t *ip = srcv, *iend = ip + len;
+	uint8_t *dst = dstv, *op = dst, *oend = dst + dlen;
+
+	while (ip < iend) {
+		unsigned int token = *ip++;
+		size_t litlen = token >> 4, mlen, off;
+		const uint8_t *ref;
+		uint8_t b;
+
+		if (litlen == 15)
+			do {
+				if (ip >= iend)
+					return -1;
+				litlen += b = *ip++;
+			} while (b == 255);
+		if (litlen > (size_t)(iend - ip) || litlen > (size_t)(oend - op))
+			return -1;
+		memcpy(op, ip, litlen);
+		op += litlen;
+		ip += litlen;
+		if (ip == iend)
+			break;
+		if (iend - ip < 2)
+			return -1;
+		off = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (off == 0 || off > (size_t)(op - dst))
+			return -1;
+		mlen = token & 15;
+		if (mlen == 15)
+			do {
+				if (ip >= iend)
+					return -1;
+				mlen += b = *ip++;
+			} while (b == 255);
+		mlen += MINMATCH;
+		if (mlen > (size_t)(oend - op))
+			return -1;
+		ref = op - off;
+		if (off >= mlen)
+			memcpy(op, ref, mlen);
+		else
+			for (size_t i = 0; i < mlen; i++)
+				op[i] = ref[i];
+		op += mlen;
+	}
+	return op == oend ? 0 : -1;
+}
@@ -0,0 +1,40 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#ifndef SCREEN_LZBLOCK_H
+#define SCREEN_LZBLOCK_H
+
+#include <stddef.h>
+
+/*
+ * Small, fast LZ77 compressor producing the LZ4 block format, for data
+ * that is compressed and expanded in memory (cold scrollback). There is
+ * no framing; callers keep the uncompressed size themselves.
+ */
+
+/* worst case size of compressing len bytes */
+#define LZB_BOUND(len)	((len) + (len) / 255 + 16)
+
+size_t lzb_compress(const void *, size_t, void *, size_t);
+int    lzb_decompress(const void *, size_t, void *, size_t);
+
+#endif /* SCREEN_LZBLOCK_H */
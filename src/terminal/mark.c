@@ -41,6 +41,7 @@
 #include "encoding.h"
 #include "fileio.h"
 #include "process.h"
+#include "resize.h"
 #include "search.h"
 #include "winmsg.h"
 
@@ -57,7 +58,11 @@ static int is_letter(int);
 static void nextword(int *, int *, int, int);
 static int linestart(int);
 static int lineend(int);
+static int remspan(struct mline *, int, int, int, int, int, int *);
+static int remcells(struct mline *, int, int, char *);
+static int remglue(struct mline *, int, int, int, char *);
 static int rem(int, int, int, int, int, char *, int);
+static size_t remstream(int, int, int, int, void (*)(char *, size_t, void *), void *);
 static bool eq(int, int);
 static int MarkScrollDownDisplay(int);
 static int MarkScrollUpDisplay(int);
@@ -69,6 +74,8 @@ static void MarkRedisplayLine(int, int, int, int);
 bool compacthist = false;
 bool join_with_cr = false;
 bool pastefont = true;
+bool clipboard = false;
+int copystream = 10000;
 
 const struct LayFuncs MarkLf = {
 	MarkProcess,
@@ -229,6 +236,120 @@ static void nextword(int *xp, int *yp, int flags, int num)
 	}
 }
 
+/*
+ * Last column of line i of the selection that is copied, and
+ * through *fromp the first one.
+ */
+static int remspan(struct mline *ml, int i, int x1, int y1, int x2, int y2, int *fromp)
+{
+	int from, to;
+	uint32_t *im;
+
+	from = (i == y1) ? x1 : 0;
+	if (from < markdata->left_mar)
+		from = markdata->left_mar;
+	for (to = fore->w_width, im = ml->image + to; to >= 0; to--)
+		if (*im-- != ' ')
+			break;
+	if (i == y2 && x2 < to)
+		to = x2;
+	if (to > markdata->right_mar)
+		to = markdata->right_mar;
+	*fromp = from;
+	return to;
+}
+
+/*
+ * Encode the cells from..to of a line into pt and return how many
+ * bytes that took. With pt == NULL only count.
+ */
+static int remcells(struct mline *ml, int from, int to, char *pt)
+{
+	int j, l = 0;
+	int font = ASCII;
+	uint32_t *im, *fo;
+	int enc = fore->w_encoding;
+
+	j = from;
+	if (dw_right(ml, j, enc))
+		j--;
+	im = ml->image + j;
+	fo = ml->font + j;
+	for (; j <= to; j++) {
+		uint32_t c = *im++;
+		uint32_t cf = *fo++;
+		if (enc == UTF8) {
+			/* most cells are plain ASCII, copy those without encoding */
+			if (c < 0x80 && cf == 0) {
+				if (pt)
+					*pt++ = c;
+				l++;
+				continue;
+			}
+			c |= cf << 8;
+			if (c == UCS_HIDDEN)
+				continue;
+			c = ToUtf8_comb(pt, c);
+			l += c;
+			if (pt)
+				pt += c;
+			continue;
+		}
+		if (is_dw_font(cf)) {
+			c = c << 8 | *im++;
+			fo++;
+			j++;
+		}
+		if (pastefont) {
+			c = EncodeChar(pt, c | cf << 16, enc, &font);
+			l += c;
+			if (pt)
+				pt += c;
+			continue;
+		}
+		if (pt)
+			*pt++ = c;
+		l++;
+	}
+	if (pastefont && font != ASCII) {
+		if (pt)
+			memcpy(pt, "\033(B", 3);
+		l += 3;
+	}
+	return l;
+}
+
+/*
+ * What goes between line i and the next one of the selection, into
+ * pt if that is not NULL. Returns its length.
+ */
+static int remglue(struct mline *ml, int i, int y2, int to, char *pt)
+{
+	char *s;
+
+	if (i == y2 || (to == fore->w_width - 1 && ml->image[to + 1] != ' '))
+		return 0;
+	/*
+	 * this code defines, what glues lines together
+	 */
+	switch (markdata->nonl) {
+	case 0:	/* lines separated by newlines */
+		s = join_with_cr ? "\r\n" : "\r";
+		break;
+	case 2:	/* lines separated by blanks */
+		s = " ";
+		break;
+	case 3:	/* seperate by comma, for csh junkies */
+		s = ",";
+		break;
+	default:	/* nothing to separate lines */
+		return 0;
+	}
+	if (pt)
+		memcpy(pt, s, strlen(s));
+	return strlen(s);
+}
+
 /*
  * y1, y2 are WIN coordinates
  *
@@ -239,12 +360,9 @@ static void nextword(int *xp, int *yp, int flags, int num)
 
 static int rem(int x1, int y1, int x2, int y2, int redisplay, char *pt, int yend)
 {
-	int i, j, from, to, ry;
+	int i, from, to, ry, n;
 	int l = 0;
-	uint32_t *im;
 	struct mline *ml;
-	int font;
-	uint32_t *fo;
 
 	markdata->second = 0;
 	if (y2 < y1 || ((y2 == y1) && (x2 < x1))) {
@@ -266,93 +384,125 @@ static int rem(int x1, int y1, int x2, int y2, int redisplay, char *pt, int yend
 		if (redisplay != 2 && pt == NULL && ry > yend)
 			break;
 		ml = WIN(i);
-		from = (i == y1) ? x1 : 0;
-		if (from < markdata->left_mar)
-			from = markdata->left_mar;
-		for (to = fore->w_width, im = ml->image + to; to >= 0; to--)
-			if (*im-- != ' ')
-				break;
-		if (i == y2 && x2 < to)
-			to = x2;
-		if (to > markdata->right_mar)
-			to = markdata->right_mar;
+		to = remspan(ml, i, x1, y1, x2, y2, &from);
 		if (redisplay == 1 && from <= to && ry >= 0 && ry <= yend)
 			MarkRedisplayLine(ry, from, to, 0);
 		if (redisplay != 2 && pt == NULL)	/* don't count/copy */
 			continue;
-		j = from;
-		if (dw_right(ml, j, fore->w_encoding))
-			j--;
-		im = ml->image + j;
-		fo = ml->font + j;
-		font = ASCII;
-		for (; j <= to; j++) {
-			uint32_t c = *im++;
-			uint32_t cf = *fo++;
-			if (fore->w_encoding == UTF8) {
-				c |= cf << 8;
-				if (c == UCS_HIDDEN)
-					continue;
-				c = ToUtf8_comb(pt, c);
-				l += c;
-				if (pt)
-					pt += c;
-				continue;
-			}
-			if (is_dw_font(cf)) {
-				c = c << 8 | *im++;
-				fo++;
-				j++;
-			}
-			if (pastefont) {
-				c = EncodeChar(pt, c | cf << 16, fore->w_encoding, &font);
-				l += c;
-				if (pt)
-					pt += c;
-				continue;
-			}
-			if (pt)
-				*pt++ = c;
-			l++;
-		}
-		if (pastefont && font != ASCII) {
-			if (pt) {
-				strncpy(pt, "\033(B", 4);
-				pt += 3;
-			}
-			l += 3;
-		}
-		if (i != y2 && (to != fore->w_width - 1 || ml->image[to + 1] == ' ')) {
-			/*
-			 * this code defines, what glues lines together
-			 */
-			switch (markdata->nonl) {
-			case 0:	/* lines separated by newlines */
-				if (pt)
-					*pt++ = '\r';
-				l++;
-				if (join_with_cr) {
-					if (pt)
-						*pt++ = '\n';
-					l++;
-				}
-				break;
-			case 1:	/* nothing to separate lines */
-				break;
-			case 2:	/* lines separated by blanks */
-				if (pt)
-					*pt++ = ' ';
-				l++;
-				break;
-			case 3:	/* seperate by comma, for csh junkies */
-				if (pt)
-					*pt++ = ',';
-				l++;
-				break;
+		n = remcells(ml, from, to, pt);
+		n += remglue(ml, i, y2, to, pt ? pt + n : NULL);
+		l += n;
+		if (pt)
+			pt += n;
+	}
+	return l;
+}
+
+/*
+ * Hand the selection to out() in chunks instead of building it in one
+ * buffer, so a selection of any size costs a buffer of REMCHUNK bytes
+ * and one pass over the lines. Returns the number of bytes written.
+ */
+#define REMCHUNK 65536
+
+static size_t remstream(int x1, int y1, int x2, int y2, void (*out)(char *, size_t, void *), void *data)
+{
+	int i, from, to, n;
+	size_t l = 0, len = 0, size = REMCHUNK;
+	struct mline *ml;
+	char *buf, *nbuf;
+
+	if (y2 < y1 || ((y2 == y1) && (x2 < x1))) {
+		i = y2;
+		y2 = y1;
+		y1 = i;
+		i = x2;
+		x2 = x1;
+		x1 = i;
+	}
+	if ((buf = malloc(size)) == NULL)
+		return 0;
+	for (i = y1; i <= y2; i++) {
+		ml = WIN(i);
+		to = remspan(ml, i, x1, y1, x2, y2, &from);
+		/* the line is in the cache now, sizing it first is cheap */
+		n = remcells(ml, from, to, NULL) + 3;
+		if (len + n > size) {
+			out(buf, len, data);
+			l += len;
+			len = 0;
+			if ((size_t)n > size) {
+				if ((nbuf = realloc(buf, n)) == NULL)
+					break;
+				buf = nbuf;
+				size = n;
 			}
 		}
+		len += remcells(ml, from, to, buf + len);
+		len += remglue(ml, i, y2, to, buf + len);
 	}
-	return l;
+	if (len)
+		out(buf, len, data);
+	free(buf);
+	return l + len;
+}
+
+/*
+ * Lines of the paste buffer end in a lone \r, for pasting into a tty;
+ * outside of screen they end in \n. next is the byte after s[len - 1],
+ * or -1 at the end.
+ */
+static void crtonl(char *s, size_t len, int next)
+{
+	for (size_t i = 0; i < len; i++)
+		if (s[i] == '\r' && (i + 1 < len ? s[i + 1] : next) != '\n')
+			s[i] = '\n';
+}
+
+/* Send len bytes of text to the terminal's clipboard */
+static void clipsend(char *buf, size_t len)
+{
+	char piece[4096];
+	size_t n;
+
+	while (len) {
+		n = len < sizeof(piece) ? len : sizeof(piece);
+		memcpy(piece, buf, n);
+		crtonl(piece, n, n < len ? buf[n] : -1);
+		ClipboardPut(piece, n);
+		buf += n;
+		len -= n;
+	}
+}
+
+struct copysink {
+	int x1, y1, x2, y2;
+	size_t len;
+	bool clip;
+	FILE *f;
+};
+
+/* remstream() output: chunks end with a line, so no \r\n is split */
+static void copyout(char *buf, size_t len, void *data)
+{
+	struct copysink *cs = data;
+
+	crtonl(buf, len, -1);
+	fwrite(buf, 1, len, cs->f);
+	if (cs->clip)
+		ClipboardPut(buf, len);
+}
+
+static void copyfill(FILE *f, void *data)
+{
+	struct copysink *cs = data;
+
+	cs->f = f;
+	if (cs->clip)
+		ClipboardStart();
+	cs->len = remstream(cs->x1, cs->y1, cs->x2, cs->y2, copyout, cs);
+	if (cs->clip)
+		ClipboardEnd();
 }
 
 /* Check if two chars are identical. All digits are treated
@@ -378,6 +528,7 @@ int GetHistory(void)
 	uint32_t *linep;
 	struct mline *ml;
 
+	HistReflow(fore);
 	x = fore->w_x;
 	if (x >= fore->w_width)
 		x = fore->w_width - 1;
@@ -417,6 +568,7 @@ void MarkRoutine(void)
 {
 	int x, y;
 
+	HistReflow(fore);
 	if (InitOverlayPage(sizeof(struct markdata), &MarkLf, 1))
 		return;
 	flayer->l_encoding = fore->w_encoding;
@@ -860,17 +1012,45 @@ static void MarkProcess(char **inbufp, size_t *inlenp)
 				int append_mode = markdata->append_mode;
 				int write_buffer = markdata->write_buffer;
 
+				/* a big selection for the exchange file bypasses the paste buffer */
+				bool stream;
+				struct copysink cs;
+
 				x2 = cx;
 				y2 = cy;
-				newcopylen = rem(markdata->x1, markdata->y1, x2, y2, 2, NULL, 0);	/* count */
-				if (md_user->u_plop.buf && !append_mode)
-					UserFreeCopyBuffer(md_user);
+				stream = write_buffer && !append_mode && copystream > 0
+				    && abs(y2 - markdata->y1) >= copystream;
+				newcopylen = 0;
+				if (!stream) {
+					newcopylen = rem(markdata->x1, markdata->y1, x2, y2, 2, NULL, 0);	/* count */
+					if (md_user->u_plop.buf && !append_mode)
+						UserFreeCopyBuffer(md_user);
+				}
 				yend = fore->w_height - 1;
 				if (fore->w_histheight - markdata->hist_offset < fore->w_height) {
 					markdata->second = 0;
 					yend -= MarkScrollUpDisplay(fore->w_histheight - markdata->hist_offset);
 				}
-				if (newcopylen > 0) {
+				if (stream) {
+					cs.x1 = markdata->x1;
+					cs.y1 = markdata->y1;
+					cs.x2 = x2;
+					cs.y2 = y2;
+					cs.len = 0;
+					cs.clip = clipboard && display;
+					stream = StreamExchange(copyfill, &cs);
+					write_buffer = 0;
+					rem(markdata->x1, markdata->y1, x2, y2, markdata->hist_offset == fore->w_histheight,
+					    NULL, yend);
+					if (!stream) {
+						if (markdata->hist_offset != fore->w_histheight)
+							LAY_CALL_UP(LRefreshAll(flayer, 0));
+						ExitOverlayPage();
+						WindowChanged(fore, WINESC_COPY_MODE);
+						in_mark = 0;
+						break;
+					}
+				} else if (newcopylen > 0) {
 					/* the +3 below is for : cr + lf + \0 */
 					if (md_user->u_plop.buf)
 						md_user->u_plop.buf = realloc(md_user->u_plop.buf,
@@ -923,7 +1103,14 @@ static void MarkProcess(char **inbufp, size_t *inlenp)
 				}
 				ExitOverlayPage();
 				WindowChanged(fore, WINESC_COPY_MODE);
-				if (append_mode)
+				if (!stream && clipboard && display && newcopylen > 0) {
+					ClipboardStart();
+					clipsend(md_user->u_plop.buf, md_user->u_plop.len);
+					ClipboardEnd();
+				}
+				if (stream)
+					LMsg(0, "Wrote %zu characters to \"%s\"", cs.len, BufferFile);
+				else if (append_mode)
 					LMsg(0, "Appended %d characters to buffer", newcopylen);
 				else
 					LMsg(0, "Copied %zu characters into buffer", md_user->u_plop.len);
@@ -1246,9 +1433,24 @@ static int MarkScrollDownDisplay(int n)
 	return n;
 }
 
+static char bracket_start[] = "\033[200~";
+static char bracket_end[] = "\033[201~";
+
 void MakePaster(struct paster *pa, char *buf, size_t len, int bufiscopy)
 {
+	Window *p = Layer2Window(flayer);
+
 	FreePaster(pa);
+	/* a window that turned on bracketed paste gets the paste wrapped the
+	 * way a terminal would do it, the end sequence going after the data */
+	if (p && flayer == &p->w_layer && p->w_bracketed) {
+		char start[sizeof(bracket_start)], *s = start;
+		size_t l = sizeof(bracket_start) - 1;
+
+		memcpy(start, bracket_start, sizeof(start));
+		DoProcess(p, &s, &l, NULL);
+		pa->pa_bracketed = true;
+	}
 	pa->pa_pasteptr = buf;
 	pa->pa_pastelen = len;
 	if (bufiscopy)
@@ -1265,5 +1467,22 @@ void FreePaster(struct paster *pa)
 	pa->pa_pasteptr = NULL;
 	pa->pa_pastelen = 0;
 	pa->pa_pastelayer = NULL;
+	pa->pa_bracketed = false;
 	evdeq(&pa->pa_slowev);
 }
+
+/* The paste is used up: paste the end of its bracket, if it has one
+ * open, else let go of it. */
+void EndPaster(struct paster *pa)
+{
+	if (pa->pa_bracketed && pa->pa_pastelayer) {
+		if (pa->pa_pastebuf)
+			free(pa->pa_pastebuf);
+		pa->pa_pastebuf = NULL;
+		pa->pa_pasteptr = bracket_end;
+		pa->pa_pastelen = sizeof(bracket_end) - 1;
+		pa->pa_bracketed = false;
+		return;
+	}
+	FreePaster(pa);
+}
@@ -66,12 +66,15 @@ void  revto (int, int);
 int   InMark (void);
 void  MakePaster (struct paster *, char *, size_t, int);
 void  FreePaster (struct paster *);
+void  EndPaster (struct paster *);
 
 /* global variables */
 
 extern bool compacthist;
 extern bool join_with_cr;
 extern bool pastefont;
+extern bool clipboard;
+extern int copystream;
 
 extern unsigned char mark_key_tab[];
 
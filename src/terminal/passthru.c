@@ -0,0 +1,285 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include "config.h"
+
+#include "passthru.h"
+
+#include "screen.h"
+#include "encoding.h"
+
+/*
+ * What goes through is what the emulator and any xterm-like terminal do
+ * alike: text of single width characters, CR, LF and BS (HT with the
+ * default tab stops), the colors and attributes screen keeps, erasing,
+ * inserting and deleting characters and lines, scrolling, cursor moves
+ * and cursor visibility, and synchronized output. Everything else (OSC
+ * and DCS strings, modes, queries, saved cursors, bells) has effects
+ * outside of the window's cells and goes through the emulator.
+ *
+ * Scroll regions would let the terminal's cursor leave the window: only
+ * the one over the full window is allowed, which the caller starts with.
+ * A cursor position is taken as long as it is inside of the window. What
+ * erases the rest of the display is let through, and reported, so that
+ * the caller can restore the rows below the window.
+ */
+
+#define PT_MAXARGS	16
+
+/* An SGR sequence of the attributes and colors SelectRendition() knows */
+static bool ScanSGR(const struct passthru *pt, const int *args, int nargs)
+{
+	for (int i = 0; i < nargs; i++) {
+		int a = args[i];
+
+		if (a == 38 || a == 48) {
+			if (i + 2 < nargs && args[i + 1] == 5 && args[i + 2] <= 255) {
+				i += 2;
+				continue;
+			}
+			if (pt->truecolor && i + 4 < nargs && args[i + 1] == 2
+			    && args[i + 2] <= 255 && args[i + 3] <= 255 && args[i + 4] <= 255) {
+				i += 4;
+				continue;
+			}
+			return false;
+		}
+		if (a <= 5 || a == 7 || (a >= 22 && a <= 25) || a == 27 || (a >= 30 && a <= 49)
+		    || (a >= 90 && a <= 97) || (a >= 100 && a <= 107))
+			continue;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * A CSI sequence from after its introducer; returns where it ends, or
+ * NULL if it does not go through. Missing parameters count as 0, as they
+ * do for the emulator.
+ */
+static const unsigned char *ScanCSI(const struct passthru *pt, const unsigned char *s, const unsigned char *end,
+				    int *x, int *flags, bool *sync)
+{
+	int args[PT_MAXARGS] = { 0 }, nargs = 0;
+	bool private = false;
+	int c;
+
+	if (s < end && *s == '?') {
+		private = true;
+		s++;
+	}
+	for (; s < end; s++) {
+		if (*s >= '0' && *s <= '9') {
+			if (args[nargs] < 100000)
+				args[nargs] = 10 * args[nargs] + (*s - '0');
+		} else if (*s == ';') {
+			if (++nargs == PT_MAXARGS)
+				return NULL;
+		} else
+			break;
+	}
+	if (s == end)
+		return NULL;
+	nargs++;
+	c = *s++;
+
+	if (private) {
+		if (nargs != 1 || (c != 'h' && c != 'l'))
+			return NULL;
+		if (args[0] == 2026)
+			*sync = c == 'h';
+		else if (args[0] != 25)
+			return NULL;
+		return s;
+	}
+	if (c == 'm')
+		return ScanSGR(pt, args, nargs) ? s : NULL;
+	if (c == 'r') {
+		/* only back to the full window, which homes the cursor */
+		if (nargs != 2 || args[0] > 1 || args[1] != pt->height)
+			return NULL;
+		*x = 0;
+		return s;
+	}
+	if (nargs > 2 || (nargs == 2 && c != 'H' && c != 'f'))
+		return NULL;
+	switch (c) {
+	case 'H':
+	case 'f':
+		if (args[0] > pt->height || (nargs == 2 && args[1] > pt->width))
+			return NULL;
+		*x = nargs == 2 && args[1] ? args[1] - 1 : 0;
+		return s;
+	case 'G':
+	case '`':
+		*x = args[0] == 0 ? 0 : args[0] < pt->width ? args[0] - 1 : pt->width - 1;
+		return s;
+	case 'E':
+	case 'F':
+		*x = 0;
+		return s;
+	}
+	/* the rest would start out differently from after the last column */
+	if (*x == pt->width)
+		return NULL;
+	switch (c) {
+	case 'C':
+		if ((*x += args[0] ? args[0] : 1) >= pt->width)
+			*x = pt->width - 1;
+		return s;
+	case 'D':
+		if ((*x -= args[0] ? args[0] : 1) < 0)
+			*x = 0;
+		return s;
+	case 'd':
+		return args[0] <= pt->height ? s : NULL;
+	case 'J':
+		if (args[0] > 2)
+			return NULL;
+		if (args[0] != 1)
+			*flags |= PASSTHRU_ERASED;
+		return s;
+	case 'K':
+		return args[0] <= 2 ? s : NULL;
+	case 'A':
+	case 'B':
+	case 'X':
+	case 'P':
+	case '@':
+	case 'S':
+	case 'T':
+		return s;
+	}
+	return NULL;
+}
+
+/*
+ * A UTF-8 character of single width from s; returns its length, or 0 if
+ * it is malformed, cut off at end, or of another width. Characters out of
+ * the BMP, where terminals disagree most on widths, and the invisible
+ * formatting ones are left to the emulator, too.
+ */
+static int ScanUtf8(const unsigned char *s, const unsigned char *end)
+{
+	uint32_t c = *s;
+	int n;
+
+	if (c >= 0xc2 && c < 0xe0) {
+		c &= 0x1f;
+		n = 2;
+	} else if (c >= 0xe0 && c < 0xf0) {
+		c &= 0x0f;
+		n = 3;
+	} else
+		return 0;
+	if (end - s < n)
+		return 0;
+	for (int i = 1; i < n; i++) {
+		if ((s[i] & 0xc0) != 0x80)
+			return 0;
+		c = c << 6 | (s[i] & 0x3f);
+	}
+	if (c < 0xa0 || (n == 3 && c < 0x800) || (c >= 0xd800 && c < 0xe000) || c == 0xad
+	    || (c >= 0x200b && c <= 0x200f) || (c >= 0x2028 && c <= 0x202e) || (c >= 0x2060 && c <= 0x206f)
+	    || c == 0xfeff || c >= 0xfff0)
+		return 0;
+	if (utf8_isdouble(c) || utf8_iscomb(c))
+		return 0;
+	return n;
+}
+
+/*
+ * Whether output can go to the terminal as it is: returns -1 if not, or
+ * the PASSTHRU_* flags of what it does. It must begin and end outside of
+ * any sequence, and leave no synchronized update open.
+ *
+ * The cursor's column is followed along, as the emulator keeps one past
+ * the last column after a character was put there, where the terminal
+ * stays in the last one until the next character wraps: from there, and
+ * for a BS in the first column (which the emulator takes back to the end
+ * of the line above), only text, CR and what sets the column agree.
+ */
+int PassthruScan(const struct passthru *pt, const char *buf, size_t len)
+{
+	const unsigned char *s = (const unsigned char *)buf, *end = s + len;
+	bool sync = false;
+	int x = pt->x, flags = 0;
+	int n;
+
+	while (s < end) {
+		if (*s >= ' ' && *s < 0x7f) {
+			x = x == pt->width ? 1 : x + 1;
+			s++;
+			continue;
+		}
+		if (*s >= 0x80) {
+			if ((n = ScanUtf8(s, end)) == 0)
+				return -1;
+			x = x == pt->width ? 1 : x + 1;
+			s += n;
+			continue;
+		}
+		if (*s == '\r') {
+			x = 0;
+			s++;
+			continue;
+		}
+		if (*s == '\033' && s + 1 < end && s[1] == '[') {
+			if ((s = ScanCSI(pt, s + 2, end, &x, &flags, &sync)) == NULL)
+				return -1;
+			continue;
+		}
+		if (x == pt->width)
+			return -1;
+		switch (*s++) {
+		case '\n':
+			continue;
+		case '\b':
+			if (x == 0)
+				return -1;
+			x--;
+			continue;
+		case '\t':
+			if (!pt->tabs)
+				return -1;
+			if ((x = (x / 8 + 1) * 8) >= pt->width)
+				x = pt->width - 1;
+			continue;
+		case '\033':
+			break;
+		default:
+			return -1;
+		}
+		if (s == end)
+			return -1;
+		switch (*s++) {
+		case 'D':
+		case 'M':
+			continue;
+		case 'E':
+			x = 0;
+			continue;
+		}
+		return -1;
+	}
+	return sync ? -1 : flags;
+}
@@ -0,0 +1,49 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#ifndef SCREEN_PASSTHRU_H
+#define SCREEN_PASSTHRU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Output of a window that may go to a terminal as it is: the window is
+ * the only thing on the display and covers its full width from the top
+ * row, so a sequence the terminal carries out the way the emulator does,
+ * and that stays within the window's rows, shows there exactly what the
+ * emulator would draw. PassthruScan() tells whether all of a piece of
+ * output is made of such sequences.
+ */
+
+struct passthru {
+	int	width, height;		/* of the window */
+	int	x;			/* column of its cursor */
+	bool	tabs;			/* tab stops every 8 columns */
+	bool	truecolor;		/* 24 bit colors reach the terminal */
+};
+
+#define PASSTHRU_ERASED	1	/* rows below the window were erased */
+
+int PassthruScan(const struct passthru *, const char *, size_t);
+
+#endif /* SCREEN_PASSTHRU_H */
@@ -47,8 +47,12 @@
 
 #include "screen.h"
 
+#include "cell.h"
+#include "checkpoint.h"
 #include "display.h"
 #include "encoding.h"
+#include "events.h"
+#include "export.h"
 #include "fileio.h"
 #include "help.h"
 #include "input.h"
@@ -619,9 +623,11 @@ void ProcessInput(char *ibuf, size_t ilen)
 {
 	int ch;
 	size_t slen;
-	unsigned char *s, *q;
+	unsigned char *s;
 	int i, l;
-	char *p;
+	char *p, seq[256];
+	struct kmnode *kn;
+	uint32_t n;
 
 	if (display == NULL || ilen == 0)
 		return;
@@ -631,89 +637,90 @@ void ProcessInput(char *ibuf, size_t ilen)
 	s = (unsigned char *)ibuf;
 	while (ilen-- > 0) {
 		ch = *s++;
-		if (D_dontmap || !D_nseqs) {
+		if (D_dontmap || (!D_kmtrie && !CompileKmaps())) {
 			D_dontmap = 0;
 			continue;
 		}
 		for (;;) {
-			if (*D_seqp != ch) {
-				l = D_seqp[D_seqp[-D_seql - 1] + 1];
-				if (l) {
-					D_seqp += l * 2 + 4;
-					continue;
-				}
+			kn = D_kmtrie + D_seqn;
+			if (!(kn->bits[ch >> 6] >> (ch & 63) & 1)) {
 				D_mapdefault = 0;
-				l = D_seql;
-				p = (char *)D_seqp - l;
-				D_seql = 0;
-				D_seqp = D_kmaps + 3;
-				if (l == 0)
+				if ((l = D_seql) == 0)
 					break;
-				if ((q = D_seqh) != NULL) {
-					D_seqh = NULL;
-					i = q[0] << 8 | q[1];
-					i &= ~KMAP_NOTIMEOUT;
-					if (StuffKey(i))
-						ProcessInput2((char *)q + 3, q[2]);
+				/* no sequence goes on with ch: give up on what was parsed */
+				memcpy(seq, D_seqb, l);
+				p = seq;
+				D_seql = 0;
+				D_seqn = 0;
+				if ((i = D_seqhl) != 0) {
+					D_seqhl = 0;
+					if (StuffKey(D_seqh))
+						ProcessInput2(p, i);
 					if (display == NULL)
 						return;
-					l -= q[2];
-					p += q[2];
+					l -= i;
+					p += i;
 				} else
 					D_dontmap = 1;
 				ProcessInput(p, l);
 				if (display == NULL)
 					return;
 				evdeq(&D_mapev);
+				if (!D_kmtrie && !CompileKmaps())
+					break;
 				continue;
 			}
-			if (D_seql++ == 0) {
+			if (D_seql == 0) {
 				/* Finish old stuff */
 				slen -= ilen + 1;
 				if (slen)
 					ProcessInput2(ibuf, slen);
 				if (display == NULL)
 					return;
-				D_seqh = NULL;
+				D_seqhl = 0;
+				if (!D_kmtrie) {
+					/* that changed the bindings, start over with ch */
+					ibuf = (char *)s - 1;
+					slen = ilen + 1;
+					if (!CompileKmaps())
+						break;
+					continue;
+				}
 			}
 			ibuf = (char *)s;
 			slen = ilen;
-			D_seqp++;
-			l = D_seql;
-			if (l == D_seqp[-l - 1]) {
-				if (D_seqp[l] != l) {
-					q = D_seqp + 1 + l;
-					if (D_kmaps + D_nseqs > q && q[2] > l && !memcmp(D_seqp - l, q + 3, l)) {
-						D_seqh = D_seqp - 3 - l;
-						D_seqp = q + 3 + l;
-						break;
-					}
+			/* the child of kn for ch: count the children before it */
+			n = kn->child;
+			for (i = 0; i < ch >> 6; i++)
+				n += __builtin_popcountll(kn->bits[i]);
+			n += __builtin_popcountll(kn->bits[ch >> 6] & (((uint64_t)1 << (ch & 63)) - 1));
+			D_seqn = n;
+			D_seqb[D_seql++] = ch;
+			kn = D_kmtrie + n;
+			if (kn->nr != KMNODE_NONE) {
+				i = kn->nr & ~KMAP_NOTIMEOUT;
+				if (kn->bits[0] | kn->bits[1] | kn->bits[2] | kn->bits[3]) {
+					/* a longer sequence may follow, hold this hit */
+					D_seqh = i;
+					D_seqhl = D_seql;
+					break;
 				}
-				i = D_seqp[-l - 3] << 8 | D_seqp[-l - 2];
-				i &= ~KMAP_NOTIMEOUT;
-				p = (char *)D_seqp - l;
+				l = D_seql;
+				memcpy(seq, D_seqb, l);
 				D_seql = 0;
-				D_seqp = D_kmaps + 3;
-				D_seqh = NULL;
+				D_seqn = 0;
+				D_seqhl = 0;
 				if (StuffKey(i))
-					ProcessInput2(p, l);
+					ProcessInput2(seq, l);
 				if (display == NULL)
 					return;
 			}
 			break;
 		}
 	}
-	if (D_seql) {
-		l = D_seql;
-		for (s = D_seqp;; s += i * 2 + 4) {
-			if (s[-l - 3] & KMAP_NOTIMEOUT >> 8)
-				break;
-			if ((i = s[s[-l - 1] + 1]) == 0) {
-				SetTimeout(&D_mapev, maptimeout);
-				evenq(&D_mapev);
-				break;
-			}
-		}
+	if (D_seql && D_kmtrie && !D_kmtrie[D_seqn].notimeout) {
+		SetTimeout(&D_mapev, maptimeout);
+		evenq(&D_mapev);
 	}
 	ProcessInput2(ibuf, slen);
 }
@@ -815,7 +822,7 @@ void DoProcess(Window *window, char **bufp, size_t *lenp, struct paster *pa)
 	*lenp = 0;
 	display = d;
 	if (pa && pa->pa_pastelen == 0)
-		FreePaster(pa);
+		EndPaster(pa);
 }
 
 int FindCommnr(const char *str)
@@ -916,6 +923,10 @@ static void StuffFin(char *buf, size_t len, void *data)
  */
 #define OutputMsg	(!act->quiet ? Msg : queryflag >= 0 ? QueryMsg : Dummy)
 
+/* ImmorTerm: the command failed. A query of it returns an error, and so
+ * does a line of a batch (see DoCommandsMsg() in socket.c) */
+#define CommandFailed()	(queryflag = -1, cmderrors++)
+
 static void DoCommandSelect(struct action *act)
 {
 	char **args = act->args;
@@ -929,15 +940,15 @@ static void DoCommandSelect(struct action *act)
 	} else if (args[0][0] == '.' && !args[0][1]) {
 		if (!fore) {
 			OutputMsg(0, "select . needs a window");
-			queryflag = -1;
+			CommandFailed();
 		} else {
 			SetForeWindow(fore);
 			Activate(0);
 		}
 	} else if (ParseWinNum(act, &n) == 0)
 		SwitchWindow(GetWindowByNumber(n));
-	else if (queryflag >= 0)
-		queryflag = -1;	/* ParseWinNum already prints out an appropriate error message. */
+	else
+		CommandFailed();	/* ParseWinNum already prints out an appropriate error message. */
 
 }
 
@@ -1040,6 +1051,56 @@ static void DoCommandHardcopy(struct action *act)
 	WriteFile(user, file, mode);
 }
 
+/* ImmorTerm: export [-h] [-f plain|ansi|html] [file|"|command"], see
+ * export.h */
+static void DoCommandExport(struct action *act)
+{
+	static const char *exts[] = { [EXPORT_PLAIN] = "txt", [EXPORT_ANSI] = "ans", [EXPORT_HTML] = "html" };
+	char **args = act->args;
+	int msgok = display && !*rc_name;
+	int format = EXPORT_PLAIN, fd, n;
+	bool history = false;
+	char fnbuf[FILENAME_MAX], *file;
+
+	for (; *args && **args == '-' && args[0][1]; args++) {
+		if (!strcmp(*args, "--")) {
+			args++;
+			break;
+		} else if (!strcmp(*args, "-h"))
+			history = true;
+		else if (!strcmp(*args, "-f") && args[1]) {
+			if ((format = ExportFormat(*++args)) < 0) {
+				OutputMsg(0, "%s: export: format is one of plain, ansi or html", rc_name);
+				return;
+			}
+		} else {
+			OutputMsg(0, "%s: export: unknown option %s", rc_name, *args);
+			return;
+		}
+	}
+	if ((file = *args) != NULL && args[1]) {
+		OutputMsg(0, "%s: export: too many arguments", rc_name);
+		return;
+	}
+	if (file == NULL) {
+		if (hardcopydir && *hardcopydir && strlen(hardcopydir) < ARRAY_SIZE(fnbuf) - 24)
+			sprintf(fnbuf, "%s/export.%d.%s", hardcopydir, fore->w_number, exts[format]);
+		else
+			sprintf(fnbuf, "export.%d.%s", fore->w_number, exts[format]);
+		file = fnbuf;
+	}
+	if ((fd = ExportOpen(fore, file)) < 0) {
+		OutputMsg(errno, "Cannot open \"%s\"", file);
+		return;
+	}
+	n = ExportWindow(fore, fd, format, history);
+	close(fd);
+	if (n < 0)
+		OutputMsg(0, "Could not write all of the export to \"%s\"", file);
+	else if (msgok)
+		OutputMsg(0, "%d lines exported to \"%s\".", n, file);
+}
+
 static void DoCommandDeflog(struct action *act)
 {
 	(void)ParseOnOff(act, &nwin_default.Lflag);
@@ -1122,6 +1183,7 @@ static void DoCommandKill(struct action *act)
 static void DoCommandQuit(struct action *act)
 {
 	char **args = act->args;
+	Hosted *h;
 
 	if (*args) {
 		if (!strcmp(*args, "--confirm")) {
@@ -1132,6 +1194,17 @@ static void DoCommandQuit(struct action *act)
 			return;
 		}
 	}
+	/* ImmorTerm: a hosted session goes with its windows, see HostedOpen() */
+	if ((h = CommandHosted())) {
+		Window *win, *next;
+
+		for (win = first_window; win; win = next) {
+			next = win->w_next;
+			if (win->w_hosted == h)
+				KillWindow(win);
+		}
+		return;
+	}
 	Finit(0);
 	/* does not return */
 }
@@ -1252,6 +1325,9 @@ static void DoCommandAt(struct action *act)
 	char **args = act->args;
 	int *argl = act->argl;
 	struct acluser *user = display ? D_user : users;
+	/* ImmorTerm: the loops below change display, so the session is taken
+	 * first; windows and displays of other sessions are left alone */
+	Hosted *hosted = CommandHosted();
 	char *s;
 	size_t n;
 
@@ -1294,7 +1370,7 @@ static void DoCommandAt(struct action *act)
 					continue;
 				flayer = D_forecv->c_layer;
 				fore = D_fore;
-				if (D_user != u)
+				if (D_user != u || D_hosted != hosted)
 					continue;
 				DoCommand(args + 1, argl + 1);
 				if (display)
@@ -1316,6 +1392,8 @@ static void DoCommandAt(struct action *act)
 					continue;
 				fore = D_fore;
 				flayer = D_forecv->c_layer;
+				if (D_hosted != hosted)
+					continue;
 				if (strncmp(args[0], D_usertty, n) &&
 				    (strncmp("/dev/", D_usertty, 5) ||
 				     strncmp(args[0], D_usertty + 5, n)) &&
@@ -1346,7 +1424,7 @@ static void DoCommandAt(struct action *act)
 				args[0][n] = ch;	/* must restore string in case of bind */
 				/* try looping over titles */
 				for (fore = mru_window; fore; fore = fore->w_prev_mru) {
-					if (strncmp(args[0], fore->w_title, n))
+					if (fore->w_hosted != hosted || strncmp(args[0], fore->w_title, n))
 						continue;
 					/*
 					 * consider this a bug or a feature:
@@ -1369,10 +1447,12 @@ static void DoCommandAt(struct action *act)
 				}
 				display = NULL;
 				fore = NULL;
-				if (i < 0)
+				if (i < 0) {
 					OutputMsg(0, "%s: at '%s': no such window.\n", rc_name, args[0]);
+					CommandFailed();
+				}
 				goto out;
-			} else if ((fore = GetWindowByNumber(i))) {
+			} else if ((fore = GetWindowByNumber(i)) && fore->w_hosted == hosted) {
 				args[0][n] = ch;	/* must restore string in case of bind */
 				if (fore->w_layer.l_cvlist)
 					display = fore->w_layer.l_cvlist->c_display;
@@ -1385,8 +1465,11 @@ static void DoCommandAt(struct action *act)
 				}
 				display = NULL;
 				fore = NULL;
-			} else
+			} else {
+				fore = NULL;
 				OutputMsg(0, "%s: at [identifier][%%|*|#] command [args]", rc_name);
+				CommandFailed();
+			}
 		}
 	}
 out:
@@ -1552,8 +1635,12 @@ static void DoCommandStuff(struct action *act)
 			return;
 		len = strlen(s);
 	}
-	while (len)
+	while (len) {
+		size_t l = len;
 		LayProcess(&s, &len);
+		if (len == l)
+			break;	/* the window's input buffer is full */
+	}
 }
 
 static void DoCommandRedisplay(struct action *act)
@@ -1594,6 +1681,69 @@ static void DoCommandDinfo(struct action *act)
 	ShowDInfo();
 }
 
+/* ImmorTerm: show how the output to this display was written */
+static void DoCommandIostats(struct action *act)
+{
+	(void)act; /* unused */
+
+	OutputMsg(0, "%lu flushes, %lu writes, %lu bytes, %lu bytes/write",
+		  D_nflushes, D_nwrites, D_nwritten, D_nwrites ? D_nwritten / D_nwrites : 0);
+}
+
+static int schedstats_cmp(const void *a, const void *b)
+{
+	const SchedHandlerStats *ha = a, *hb = b;
+
+	return (ha->time < hb->time) - (ha->time > hb->time);
+}
+
+/* ImmorTerm: scheduler and event handler costs. A query prints a line per
+ * handler, most expensive first, for scripts to pick up. */
+static void DoCommandSchedstats(struct action *act)
+{
+	char **args = act->args;
+	int msgok = display && !*rc_name;
+	bool on = schedstats.enabled;
+
+	if (*args) {
+		if (!strcmp(*args, "reset"))
+			SchedStatsReset();
+		else {
+			if (ParseOnOff(act, &on))
+				return;
+			if (on && !schedstats.enabled)
+				SchedStatsReset();
+			schedstats.enabled = on;
+		}
+		if (msgok)
+			OutputMsg(0, "scheduler statistics %s", schedstats.enabled ? "on" : "off");
+		return;
+	}
+
+	qsort(schedstats.handlers, schedstats.nhandlers, sizeof(SchedHandlerStats), schedstats_cmp);
+	if (queryflag >= 0) {
+		/* straight to the querying client: Msg() would also put every
+		 * line on the displays, and strip the newlines doing so */
+		QueryMsg(0, "sched %s wakeups %lu wait_us %llu work_us %llu\n", on ? "on" : "off",
+			 schedstats.wakeups, schedstats.waittime, schedstats.worktime);
+		for (int i = 0; i < schedstats.nhandlers; i++) {
+			SchedHandlerStats *hs = &schedstats.handlers[i];
+			QueryMsg(0, "handler %s calls %lu total_us %llu max_us %lu\n",
+				 hs->name ? hs->name : "?", hs->calls, hs->time, hs->maxtime);
+		}
+		return;
+	}
+	if (!on) {
+		OutputMsg(0, "scheduler statistics are off");
+		return;
+	}
+	OutputMsg(0, "%lu wakeups, %llu ms waiting, %llu ms working; most time in %s (%lu calls, %lu us max)",
+		  schedstats.wakeups, schedstats.waittime / 1000, schedstats.worktime / 1000,
+		  schedstats.nhandlers && schedstats.handlers[0].name ? schedstats.handlers[0].name : "-",
+		  schedstats.nhandlers ? schedstats.handlers[0].calls : 0,
+		  schedstats.nhandlers ? schedstats.handlers[0].maxtime : 0);
+}
+
 static void DoCommandCommand(struct action *act)
 {
 	char **args = act->args;
@@ -1933,7 +2083,7 @@ static void DoCommandTitle(struct action *act)
 		if (fore)
 			OutputMsg(0, "%s", fore->w_title);
 		else
-			queryflag = -1;
+			CommandFailed();
 		return;
 	}
 	if (*args == NULL)
@@ -1971,6 +2121,7 @@ static void DoCommandTitle(struct action *act)
 		 * ChangeAKA's three calls were: WINESC_WIN_TITLE, WINESC_WIN_NAMES, WINESC_WIN_NAMES_NOCUR
 		 * We only need the first one to refresh the hardstatus bar. */
 		WindowChanged(fore, WINESC_WIN_TITLE);
+		EventPost("name", fore->w_number, fore->w_title);
 	}
 }
 
@@ -2563,6 +2714,16 @@ static void DoCommandIgnorecase(struct action *act)
 		OutputMsg(0, "Will %signore case in searches", search_ic ? "" : "not ");
 }
 
+/* ImmorTerm: / and ? in copy mode take regular expressions */
+static void DoCommandSearchregex(struct action *act)
+{
+	int msgok = display && !*rc_name;
+
+	(void)ParseSwitch(act, &search_re);
+	if (msgok)
+		OutputMsg(0, "Will %ssearch for regular expressions", search_re ? "" : "not ");
+}
+
 static void DoCommandEscape(struct action *act)
 {
 	char **args = act->args;
@@ -2615,6 +2776,75 @@ static void DoCommandChdir(struct action *act)
 		OutputMsg(errno, "%s", s);
 }
 
+/* ImmorTerm: periodic checkpoints of the windows, see checkpoint.h */
+static void DoCommandCheckpoint(struct action *act)
+{
+	char **args = act->args;
+	int msgok = display && !*rc_name;
+
+	if (args[1] && !strcmp(*args, "interval")) {
+		if (atoi(args[1]) <= 0) {
+			OutputMsg(0, "%s: checkpoint interval: give a number of seconds", rc_name);
+			return;
+		}
+		checkpoint_interval = atoi(args[1]);
+		if (msgok)
+			OutputMsg(0, "checkpoints every %ds", checkpoint_interval);
+	} else if (args[1] && !strcmp(*args, "history")) {
+		if (atoi(args[1]) < 0) {
+			OutputMsg(0, "%s: checkpoint history: give a number of lines", rc_name);
+			return;
+		}
+		checkpoint_history = atoi(args[1]);
+		if (msgok)
+			OutputMsg(0, "checkpoints keep %d lines of history", checkpoint_history);
+		return;
+	} else if (args[1] && !strcmp(*args, "journal")) {
+		if (atoi(args[1]) < 0) {
+			OutputMsg(0, "%s: checkpoint journal: give a number of seconds, 0 for off", rc_name);
+			return;
+		}
+		checkpoint_journal = atoi(args[1]);
+		if (msgok) {
+			if (checkpoint_journal)
+				OutputMsg(0, "checkpoint journal every %ds", checkpoint_journal);
+			else
+				OutputMsg(0, "checkpoint journal off");
+		}
+	} else if (args[1] && !strcmp(*args, "restore")) {
+		if (!fore) {
+			OutputMsg(0, "%s: checkpoint restore: no window", rc_name);
+			return;
+		}
+		if (CheckpointRestore(fore, args[1]))
+			OutputMsg(errno, "checkpoint %s", args[1]);
+		return;
+	} else if (args[1]) {
+		OutputMsg(0, "%s: checkpoint: give a file, 'off', 'now', 'interval', 'history', 'journal' or 'restore'", rc_name);
+		return;
+	} else if (!strcmp(*args, "now")) {
+		if (!checkpoint_name) {
+			OutputMsg(0, "%s: checkpoint now: checkpoints are off", rc_name);
+			return;
+		}
+		for (Window *win = mru_window; win; win = win->w_prev_mru)
+			if (win->w_type != W_TYPE_GROUP && CheckpointWrite(win))
+				OutputMsg(errno, "checkpoint of window %d", win->w_number);
+		return;
+	} else if (!strcmp(*args, "off")) {
+		free(checkpoint_name);
+		checkpoint_name = NULL;
+		if (msgok)
+			OutputMsg(0, "checkpoints off");
+	} else {
+		if (ParseSaveStr(act, &checkpoint_name))
+			return;
+		if (msgok)
+			OutputMsg(0, "checkpoints go to %s", checkpoint_name);
+	}
+	CheckpointStart();
+}
+
 static void DoCommandShell(struct action *act)
 {
 	if (ParseSaveStr(act, &ShellProg) == 0)
@@ -2645,6 +2875,118 @@ static void DoCommandLogfile(struct action *act)
 				OutputMsg(0, "log flush timeout set to %ds\n", log_flush);
 			return;
 		}
+		if (args[1] && !(strcmp(*args, "rotate"))) {
+			/* ImmorTerm: rotate logfiles opened from now on by size */
+			char *end;
+			unsigned long long size = strtoull(args[1], &end, 10);
+
+			switch (*end) {
+			case 'k': case 'K': size <<= 10; end++; break;
+			case 'm': case 'M': size <<= 20; end++; break;
+			case 'g': case 'G': size <<= 30; end++; break;
+			}
+			if (*end || end == args[1] || (args[2] && atoi(args[2]) < 0)) {
+				OutputMsg(0, "%s: logfile rotate: give a size and optionally a count", rc_name);
+				return;
+			}
+			log_rotate_size = size;
+			if (args[2])
+				log_rotate_keep = atoi(args[2]);
+			if (!msgok)
+				return;
+			if (log_rotate_size)
+				OutputMsg(0, "logfiles rotate at %llu bytes, keeping %d", size, log_rotate_keep);
+			else
+				OutputMsg(0, "logfile rotation off");
+			return;
+		}
+		if (args[1] && !(strcmp(*args, "index"))) {
+			/* ImmorTerm: keep a line index next to logfiles opened from now on */
+			if (atoi(args[1]) < 0 || args[2]) {
+				OutputMsg(0, "%s: logfile index: give the number of lines per record", rc_name);
+				return;
+			}
+			log_index_step = atoi(args[1]);
+			if (msgok)
+				OutputMsg(0, log_index_step ? "logfiles get an index of every %d lines" : "logfile index off", log_index_step);
+			return;
+		}
+		if (args[1] && !(strcmp(*args, "sync"))) {
+			/* ImmorTerm: when output of logfiles opened from now on is synced */
+			static const char *modes[] = { "none", "interval", "newline" };
+			int i;
+
+			for (i = 0; i < (int)ARRAY_SIZE(modes); i++)
+				if (!strcmp(args[1], modes[i]))
+					break;
+			if (i == (int)ARRAY_SIZE(modes) || args[2]) {
+				OutputMsg(0, "%s: logfile sync: give 'none', 'interval' or 'newline'", rc_name);
+				return;
+			}
+			log_durability = i;
+			if (msgok)
+				OutputMsg(0, "logfile sync %s", modes[i]);
+			return;
+		}
+		if (args[1] && !(strcmp(*args, "compress"))) {
+			/* ImmorTerm: gzip logfiles opened from now on */
+			int level = args[2] ? atoi(args[2]) : LOG_GZIP_LEVEL;
+
+			if (!strcmp(args[1], "off"))
+				level = 0;
+			else if (strcmp(args[1], "gzip") || level < 1 || level > 9) {
+				OutputMsg(0, "%s: logfile compress: give 'off' or 'gzip' and a level from 1 to 9", rc_name);
+				return;
+			}
+#ifndef LOG_GZIP
+			if (level) {
+				OutputMsg(0, "%s: logfile compress: screen was built without zlib", rc_name);
+				return;
+			}
+#endif
+			log_compress = level;
+			if (msgok)
+				OutputMsg(0, level ? "logfiles are gzipped at level %d" : "logfile compression off", level);
+			return;
+		}
+		if (args[1] && !(strcmp(*args, "text"))) {
+			/* ImmorTerm: log lines as they scroll into history, as plain text */
+			static const char *modes[] = { "off", "on", "only" };
+			int i;
+
+			for (i = 0; i < (int)ARRAY_SIZE(modes); i++)
+				if (!strcmp(args[1], modes[i]))
+					break;
+			if (i == (int)ARRAY_SIZE(modes) || args[2]) {
+				OutputMsg(0, "%s: logfile text: give 'off', 'on' or 'only'", rc_name);
+				return;
+			}
+			log_text = i;
+			if (msgok)
+				OutputMsg(0, "text logging %s", modes[i]);
+			return;
+		}
+		if (args[1] && !(strcmp(*args, "history"))) {
+			/* ImmorTerm: keep the history of logfiles opened from now on
+			 * in <logfile>.hist, see histstore.h */
+			if (!strcmp(args[1], "on") || !strcmp(args[1], "off")) {
+				log_history = !strcmp(args[1], "on");
+				if (msgok)
+					OutputMsg(0, "history store %s", log_history ? "on" : "off");
+			} else
+				OutputMsg(0, "%s: logfile history: give 'on' or 'off'", rc_name);
+			return;
+		}
+		if (args[1] && !(strcmp(*args, "async"))) {
+			/* ImmorTerm: write logfiles opened from now on in a thread */
+			if (!strcmp(args[1], "on") || !strcmp(args[1], "off")) {
+				log_async = !strcmp(args[1], "on");
+				if (msgok)
+					OutputMsg(0, "log writer thread %s", log_async ? "on" : "off");
+			} else
+				OutputMsg(0, "%s: logfile async: give 'on' or 'off'", rc_name);
+			return;
+		}
 		if (ParseSaveStr(act, &screenlogfile))
 			return;
 		if (fore && fore->w_log)
@@ -2747,7 +3089,7 @@ static void DoCommandEcho(struct action *act)
 		OutputMsg(0, "%s", s);
 	else {
 		OutputMsg(0, "%s: 'echo [-n] [-p] \"string\"' expected.", rc_name);
-		queryflag = -1;
+		CommandFailed();
 	}
 }
 
@@ -3209,7 +3551,7 @@ static void DoCommandNumber(struct action *act)
 			n = old - n;
 		if (!SwapWindows(old, n)) {
 			/* Window number could not be changed. */
-			queryflag = -1;
+			CommandFailed();
 			return;
 		}
 	}
@@ -3322,11 +3664,49 @@ static void DoCommandScrollback(struct action *act)
 		OutputMsg(0, "scrollback set to %d", fore->w_histheight);
 }
 
+/* ImmorTerm: keep a trigram index of the history, see search.c */
+static void DoCommandDefsearchindex(struct action *act)
+{
+	bool b;
+
+	if (ParseOnOff(act, &b) == 0)
+		nwin_default.searchindex = b ? 1 : 0;
+}
+
+static void DoCommandSearchindex(struct action *act)
+{
+	int msgok = display && !*rc_name;
+
+	if (*act->args && ParseSwitch(act, &fore->w_searchindex))
+		return;
+	if (!fore->w_searchindex)
+		SearchIndexDrop(fore);
+	if (!msgok)
+		return;
+	if (!fore->w_searchindex)
+		OutputMsg(0, "Window %d history is not indexed", fore->w_number);
+	else if (!fore->w_sindex)
+		OutputMsg(0, "Window %d history is indexed on the next search", fore->w_number);
+	else
+		OutputMsg(0, "Window %d history is indexed, %zu KB", fore->w_number, (SearchIndexSize(fore) + 1023) / 1024);
+}
+
 static void DoCommandSessionname(struct action *act)
 {
 	char **args = act->args;
+	Hosted *h = CommandHosted();
 
-	if (*args == NULL)
+	if (h && *args == NULL)
+		OutputMsg(0, "This session is named '%s'\n", h->h_name);
+	else if (h) {
+		char *s = NULL;
+
+		if (ParseSaveStr(act, &s))
+			return;
+		if (!HostedRename(h, s))
+			WindowChanged(NULL, WINESC_SESS_NAME);
+		free(s);
+	} else if (*args == NULL)
 		OutputMsg(0, "This session is named '%s'\n", SocketName);
 	else {
 		char buf[MAXPATHLEN];
@@ -3350,12 +3730,234 @@ static void DoCommandSessionname(struct action *act)
 			OutputMsg(errno, "%s: failed to rename(%s, %s)", rc_name, SocketPath, buf);
 			return;
 		}
+		RegistryRemove();
 		strncpy(SocketPath, buf, ARRAY_SIZE(SocketPath));
+		RegistryUpdate();
 		MakeNewEnv();
 		WindowChanged(NULL, WINESC_SESS_NAME);
 	}
 }
 
+/* appends a tab, key, '=' and value to the line in buf of size, control
+ * characters in value made spaces */
+static void StateField(char *buf, size_t size, const char *key, const char *value)
+{
+	size_t len = strlen(buf);
+
+	len += snprintf(buf + len, size - len, "\t%s=", key);
+	for (; *value && len < size - 2; value++)
+		buf[len++] = ((unsigned char)*value < 32 || *value == 127) ? ' ' : *value;
+	buf[len] = 0;
+}
+
+/*
+ * ImmorTerm: the state of the session and each of its windows in one go.
+ * A query prints a session line, then a window line for each, of tab
+ * separated key=value fields for scripts to pick up.
+ */
+static void DoCommandSessionstate(struct action *act)
+{
+	char line[MAXPATHLEN * 2 - 128], num[64], cwd[MAXPATHLEN], fgname[64];
+	int ndisplays = 0, nwindows = 0;
+	Hosted *h = CommandHosted();
+	char *name = h ? h->h_name : SocketName;
+
+	(void)act; /* unused */
+
+	/* ImmorTerm: of the session it is sent to, see HostedOpen() */
+	for (Display *d = displays; d; d = d->d_next)
+		if (d->d_hosted == h)
+			ndisplays++;
+	for (Window *w = first_window; w; w = w->w_next)
+		if (w->w_hosted == h)
+			nwindows++;
+	if (queryflag < 0) {
+		OutputMsg(0, "%s: %d windows, %d displays", name, nwindows, ndisplays);
+		return;
+	}
+
+	strcpy(line, "session");
+	StateField(line, sizeof(line), "name", name);
+	snprintf(num, sizeof(num), "%d", (int)getpid());
+	StateField(line, sizeof(line), "pid", num);
+	snprintf(num, sizeof(num), "%d", ndisplays);
+	StateField(line, sizeof(line), "displays", num);
+	snprintf(num, sizeof(num), "%d", nwindows);
+	StateField(line, sizeof(line), "windows", num);
+	QueryMsg(0, "%s\n", line);
+
+	for (Window *w = first_window; w; w = w->w_next) {
+		pid_t fg;
+
+		if (w->w_hosted != h)
+			continue;
+		fg = WindowForeground(w, fgname, sizeof(fgname));
+
+		strcpy(line, "window");
+		snprintf(num, sizeof(num), "%d", w->w_number);
+		StateField(line, sizeof(line), "number", num);
+		snprintf(num, sizeof(num), "%d", (int)w->w_pid);
+		StateField(line, sizeof(line), "pid", num);
+		StateField(line, sizeof(line), "tty", w->w_tty);
+		snprintf(num, sizeof(num), "%d", (int)fg);
+		StateField(line, sizeof(line), "fgpid", num);
+		StateField(line, sizeof(line), "fg", fgname);
+		snprintf(num, sizeof(num), "%lld", (long long)w->w_last_activity);
+		StateField(line, sizeof(line), "activity", num);
+		snprintf(num, sizeof(num), "%d", w->w_histheight);
+		StateField(line, sizeof(line), "scrollback", num);
+		snprintf(num, sizeof(num), "%d", w->w_scrollback_height);
+		StateField(line, sizeof(line), "histlines", num);
+		StateField(line, sizeof(line), "shown", w->w_layer.l_cvlist ? "1" : "0");
+		StateField(line, sizeof(line), "title", w->w_title ? w->w_title : "");
+		StateField(line, sizeof(line), "hstatus", w->w_hstatus ? w->w_hstatus : "");
+		StateField(line, sizeof(line), "log", w->w_log ? w->w_log->name : "");
+		WindowCwd(w, cwd, sizeof(cwd));
+		StateField(line, sizeof(line), "cwd", cwd);
+		QueryMsg(0, "%s\n", line);
+	}
+}
+
+static void SizeField(char *buf, size_t size, const char *key, unsigned long long value)
+{
+	char num[32];
+
+	snprintf(num, sizeof(num), "%llu", value);
+	StateField(buf, size, key, num);
+}
+
+/*
+ * ImmorTerm: bytes of memory held by each window, by part (see struct
+ * winmem), and by what all of them share. Like sessionstate a query
+ * prints a session line, then a window line for each. Shared history
+ * lines count in the hist of each window using them, by its part.
+ */
+static void DoCommandMeminfo(struct action *act)
+{
+	char line[1024];
+	struct winmem wm;
+	size_t windows = 0, hist = 0, paste = 0;
+	int nwindows = 0;
+
+	(void)act; /* unused */
+
+	for (int i = 0; i < MAX_PLOP_DEFS; i++)
+		paste += plop_tab[i].len;
+	for (struct acluser *u = users; u; u = u->u_next)
+		paste += u->u_plop.len;
+	for (Window *w = first_window; w; w = w->w_next) {
+		WindowMemory(w, &wm);
+		windows += wm.total;
+		hist += wm.hist + wm.histrend + wm.histring + wm.frozen + wm.pending;
+		nwindows++;
+	}
+	if (queryflag < 0) {
+		OutputMsg(0, "%d windows hold %zu KB, %zu KB of it history; %zu KB shared, %zu KB saved by sharing lines",
+			  nwindows, (windows + 1023) / 1024, (hist + 1023) / 1024,
+			  (paste + cell_styles_size() + CombSize() + 1023) / 1024, (cell_shared_saved() + 1023) / 1024);
+		return;
+	}
+
+	strcpy(line, "session");
+	SizeField(line, sizeof(line), "windows", windows);
+	SizeField(line, sizeof(line), "paste", paste);
+	SizeField(line, sizeof(line), "styles", cell_styles_size());
+	SizeField(line, sizeof(line), "combining", CombSize());
+	SizeField(line, sizeof(line), "sharedlines", cell_shared_size());
+	SizeField(line, sizeof(line), "sharedsaved", cell_shared_saved());
+	SizeField(line, sizeof(line), "total", windows + paste + cell_styles_size() + CombSize());
+	QueryMsg(0, "%s\n", line);
+
+	for (Window *w = first_window; w; w = w->w_next) {
+		WindowMemory(w, &wm);
+		strcpy(line, "window");
+		SizeField(line, sizeof(line), "number", w->w_number);
+		SizeField(line, sizeof(line), "screen", wm.screen);
+		SizeField(line, sizeof(line), "screenrend", wm.screenrend);
+		SizeField(line, sizeof(line), "hist", wm.hist);
+		SizeField(line, sizeof(line), "histrend", wm.histrend);
+		SizeField(line, sizeof(line), "histring", wm.histring);
+		SizeField(line, sizeof(line), "frozen", wm.frozen);
+		SizeField(line, sizeof(line), "mapped", wm.mapped);
+		SizeField(line, sizeof(line), "pending", wm.pending);
+		SizeField(line, sizeof(line), "alt", wm.alt);
+		SizeField(line, sizeof(line), "pool", wm.pool);
+		SizeField(line, sizeof(line), "search", wm.search);
+		SizeField(line, sizeof(line), "log", wm.log);
+		SizeField(line, sizeof(line), "paste", wm.paste);
+		SizeField(line, sizeof(line), "other", wm.other);
+		SizeField(line, sizeof(line), "total", wm.total);
+		SizeField(line, sizeof(line), "hibernated", w->w_hibernated);
+		QueryMsg(0, "%s\n", line);
+	}
+}
+
+/*
+ * ImmorTerm: the counters kept for each window (struct winstats) and
+ * display, as a session line with the sums, then a window line for each
+ * window and a display line for each display.
+ */
+static void DoCommandStats(struct action *act)
+{
+	char line[MAXPATHLEN + 512];
+	uint64_t read = 0, parsed = 0, scrolled = 0, logged = 0, rate = 0, written = 0;
+
+	(void)act; /* unused */
+
+	for (Window *w = first_window; w; w = w->w_next) {
+		read += w->w_stats.ws_read;
+		parsed += w->w_stats.ws_parsed;
+		scrolled += w->w_stats.ws_scrolled;
+		logged += w->w_stats.ws_logged;
+		rate += WindowRate(w);
+	}
+	for (Display *d = displays; d; d = d->d_next)
+		written += d->d_nwritten;
+	if (queryflag < 0) {
+		OutputMsg(0, "%llu bytes read, %llu written, %llu lines scrolled, %llu bytes/s now",
+			  (unsigned long long)read, (unsigned long long)written,
+			  (unsigned long long)scrolled, (unsigned long long)rate);
+		return;
+	}
+
+	strcpy(line, "session");
+	SizeField(line, sizeof(line), "read", read);
+	SizeField(line, sizeof(line), "parsed", parsed);
+	SizeField(line, sizeof(line), "scrolled", scrolled);
+	SizeField(line, sizeof(line), "logged", logged);
+	SizeField(line, sizeof(line), "written", written);
+	SizeField(line, sizeof(line), "rate", rate);
+	QueryMsg(0, "%s\n", line);
+
+	for (Window *w = first_window; w; w = w->w_next) {
+		struct winstats *ws = &w->w_stats;
+
+		strcpy(line, "window");
+		SizeField(line, sizeof(line), "number", w->w_number);
+		SizeField(line, sizeof(line), "read", ws->ws_read);
+		SizeField(line, sizeof(line), "parsed", ws->ws_parsed);
+		SizeField(line, sizeof(line), "passed", ws->ws_passed);
+		SizeField(line, sizeof(line), "scrolled", ws->ws_scrolled);
+		SizeField(line, sizeof(line), "logged", ws->ws_logged);
+		SizeField(line, sizeof(line), "gatedms", ws->ws_gatedms
+			  + (ws->ws_gated ? SchedNow() - ws->ws_gatedsince : 0));
+		SizeField(line, sizeof(line), "rate", WindowRate(w));
+		QueryMsg(0, "%s\n", line);
+	}
+	for (Display *d = displays; d; d = d->d_next) {
+		strcpy(line, "display");
+		StateField(line, sizeof(line), "tty", d->d_usertty);
+		StateField(line, sizeof(line), "user", d->d_user ? d->d_user->u_name : "");
+		SizeField(line, sizeof(line), "written", d->d_nwritten);
+		SizeField(line, sizeof(line), "writes", d->d_nwrites);
+		SizeField(line, sizeof(line), "flushes", d->d_nflushes);
+		SizeField(line, sizeof(line), "blockedms", d->d_blockedms
+			  + (d->d_blocked == 1 ? SchedNow() - d->d_blockedsince : 0));
+		SizeField(line, sizeof(line), "pending", d->d_obufp - d->d_obuf);
+		QueryMsg(0, "%s\n", line);
+	}
+}
+
 static void DoCommandSetenv(struct action *act)
 {
 	char **args = act->args;
@@ -3414,6 +4016,26 @@ static void DoCommandPastefont(struct action *act)
 		OutputMsg(0, "Will %spaste font settings", pastefont ? "" : "not ");
 }
 
+static void DoCommandClipboard(struct action *act)
+{
+	int msgok = display && !*rc_name;
+
+	if (ParseSwitch(act, &clipboard) == 0 && msgok)
+		OutputMsg(0, "Will %scopy into the terminal's clipboard", clipboard ? "" : "not ");
+}
+
+static void DoCommandCopystream(struct action *act)
+{
+	int msgok = display && !*rc_name;
+
+	if (ParseNum(act, &copystream) == 0 && msgok) {
+		if (copystream > 0)
+			OutputMsg(0, "Selections of %d lines and more are written straight to the exchange file", copystream);
+		else
+			OutputMsg(0, "Selections are always copied into the buffer");
+	}
+}
+
 static void DoCommandCrlf(struct action *act)
 {
 	(void)ParseSwitch(act, &join_with_cr);
@@ -3467,6 +4089,210 @@ static void DoCommandAutodetach(struct action *act)
 	(void)ParseOnOff(act, &auto_detach);
 }
 
+/* ImmorTerm: keep the history of all windows within a number of bytes,
+ * sparing the given number of lines of each, see BudgetCheck() */
+static void DoCommandScrollbackBudget(struct action *act)
+{
+	char **args = act->args;
+	int msgok = display && !*rc_name;
+
+	if (*args) {
+		char *end;
+		unsigned long long size = strtoull(args[0], &end, 10);
+
+		switch (*end) {
+		case 'k': case 'K': size <<= 10; end++; break;
+		case 'm': case 'M': size <<= 20; end++; break;
+		case 'g': case 'G': size <<= 30; end++; break;
+		}
+		if (*end || end == args[0] || (args[1] && atoi(args[1]) < 0)) {
+			OutputMsg(0, "%s: scrollback_budget: give a size and optionally a number of lines", rc_name);
+			return;
+		}
+		scrollback_budget = size;
+		if (args[1])
+			scrollback_budget_keep = atoi(args[1]);
+		BudgetStart();
+	}
+	if (!msgok)
+		return;
+	if (scrollback_budget)
+		OutputMsg(0, "history kept within %zu bytes, %d lines of each window spared", scrollback_budget,
+			  scrollback_budget_keep);
+	else
+		OutputMsg(0, "history not budgeted");
+}
+
+/* ImmorTerm: Compress history lines older than the given number of lines */
+static void DoCommandScrollbackCompress(struct action *act)
+{
+	int msgok = display && !*rc_name;
+	int n = scrollback_compress;
+
+	if (ParseNum(act, &n) || n < 0)
+		return;
+	scrollback_compress = n;
+	for (Window *w = mru_window; w; w = w->w_prev_mru) {
+		if (n)
+			HistCompress(w);
+		else
+			HistThawAll(w);
+	}
+	if (msgok) {
+		if (n)
+			OutputMsg(0, "compressing scrollback older than %d lines", n);
+		else
+			OutputMsg(0, "not compressing scrollback");
+	}
+}
+
+/* ImmorTerm: keep identical history lines once, see cell_share() */
+static void DoCommandScrollbackDedup(struct action *act)
+{
+	int msgok = display && !*rc_name;
+
+	if (*act->args)
+		(void)ParseSwitch(act, &scrollback_dedup);
+	if (msgok)
+		OutputMsg(0, "Will %skeep identical history lines once", scrollback_dedup ? "" : "not ");
+}
+
+/* ImmorTerm: keep only the settled frame of redraws, see RedrawHold() */
+static void DoCommandScrollbackSettle(struct action *act)
+{
+	int msgok = display && !*rc_name;
+
+	if (*act->args)
+		(void)ParseSwitch(act, &scrollback_settle);
+	if (!scrollback_settle)
+		for (Window *w = mru_window; w; w = w->w_prev_mru)
+			RedrawSettle(w);
+	if (msgok)
+		OutputMsg(0, "Will %skeep only the last frame of redraws in the history", scrollback_settle ? "" : "not ");
+}
+
+/* ImmorTerm: keep the rc file this is in parsed in <file>.cache; the
+ * line is looked for when the file is read, see RcRead() */
+static void DoCommandRccache(struct action *act)
+{
+	bool on;
+
+	if (ParseOnOff(act, &on))
+		return;
+	if (display && !*rc_name)
+		OutputMsg(0, "rccache only applies to the rc file it is in");
+}
+
+/* ImmorTerm: compact windows with no output for the given number of
+ * seconds that are not shown, see WindowHibernate() */
+static void DoCommandHibernate(struct action *act)
+{
+	int msgok = display && !*rc_name;
+	int n = hibernate;
+
+	if (*act->args) {
+		if (ParseNum(act, &n))
+			return;
+		hibernate = n;
+		HibernateStart();
+	}
+	if (msgok) {
+		if (hibernate)
+			OutputMsg(0, "windows idle for %ds hibernate", hibernate);
+		else
+			OutputMsg(0, "windows do not hibernate");
+	}
+}
+
+/* ImmorTerm: how long an OSC/DCS/APC/PM string may get before it is
+ * given up and its payload shown as text */
+static void DoCommandStringlimit(struct action *act)
+{
+	int msgok = display && !*rc_name;
+	int n = stringlimit;
+
+	if (*act->args) {
+		if (ParseNum(act, &n))
+			return;
+		if (n < MAXSTR) {
+			OutputMsg(0, "%s: stringlimit: at least %d bytes", rc_name, MAXSTR);
+			return;
+		}
+		stringlimit = n;
+	}
+	if (msgok)
+		OutputMsg(0, "control strings are kept up to %zu bytes", stringlimit);
+}
+
+/* ImmorTerm: move compressed scrollback into files in a directory */
+static void DoCommandScrollbackDir(struct action *act)
+{
+	char **args = act->args;
+	int msgok = display && !*rc_name;
+
+	if (*args) {
+		for (Window *w = mru_window; w; w = w->w_prev_mru)
+			HistThawAll(w);
+		(void)ParseSaveStr(act, &scrollback_dir);
+		for (Window *w = mru_window; w; w = w->w_prev_mru) {
+			w->w_hmap.hm_failed = false;
+			HistCompress(w);
+		}
+	}
+	if (msgok)
+		OutputMsg(0, "scrollback_dir is %s", scrollback_dir && *scrollback_dir ? scrollback_dir : "<none>");
+}
+
+/* ImmorTerm: bracket redraws with synchronized output (mode 2026) */
+static void DoCommandSyncoutput(struct action *act)
+{
+	int msgok = display && !*rc_name;
+
+	if (*act->args)
+		(void)ParseSwitch(act, &syncoutput);
+	if (msgok)
+		OutputMsg(0, "Will %ssend synchronized updates", syncoutput ? "" : "not ");
+}
+
+/* ImmorTerm: never hold a window back for a display that is behind */
+static void DoCommandFastforward(struct action *act)
+{
+	int msgok = display && !*rc_name;
+
+	if (*act->args)
+		(void)ParseSwitch(act, &fastforward);
+	if (msgok)
+		OutputMsg(0, "Will %sfast-forward displays that fall behind", fastforward ? "" : "not ");
+}
+
+/* ImmorTerm: let a window alone on its display write to the terminal */
+static void DoCommandPassthrough(struct action *act)
+{
+	int msgok = display && !*rc_name;
+
+	if (*act->args)
+		(void)ParseSwitch(act, &passthrough);
+	if (msgok)
+		OutputMsg(0, "Will %spass window output through", passthrough ? "" : "not ");
+}
+
+/* ImmorTerm: limit how often a busy window is redrawn */
+static void DoCommandRenderFps(struct action *act)
+{
+	int msgok = display && !*rc_name;
+	int n = render_fps;
+
+	if (*act->args && (ParseNum(act, &n) || n < 0 || n > 1000))
+		return;
+	render_fps = n;
+	if (msgok) {
+		if (n)
+			OutputMsg(0, "rendering at most %d frames per second", n);
+		else
+			OutputMsg(0, "rendering output immediately");
+	}
+}
+
 /* ImmorTerm: Configure scrollback dump on reattach */
 static void DoCommandScrollbackDump(struct action *act)
 {
@@ -3847,6 +4673,83 @@ static void DoCommandDefnonblock(struct action *act)
 	}
 }
 
+struct grepstate {
+	int matches;
+	int windows;
+	int max;
+	Window *last;
+};
+
+static bool GrepLine(Window *w, int y, int x, char *text, void *data)
+{
+	struct grepstate *gs = data;
+	int first = w->w_scrollback_height < w->w_histheight ? w->w_histheight - w->w_scrollback_height : 0;
+
+	(void)x; /* unused */
+
+	if (gs->last != w) {
+		gs->last = w;
+		gs->windows++;
+	}
+	gs->matches++;
+	if (queryflag >= 0) {
+		for (char *p = text; *p; p++)
+			if ((unsigned char)*p < 32 || *p == 127)
+				*p = ' ';
+		QueryMsg(0, "%d\t%d\t%.*s\n", w->w_number, y - first + 1, MAXPATHLEN, text);
+	}
+	return gs->max == 0 || gs->matches < gs->max;
+}
+
+/*
+ * ImmorTerm: grep [-i] [-E] [-m max] [--] pattern searches the history
+ * and screen of every window. A query prints a line for each line that
+ * matches: the window number, the line number counted from the oldest
+ * line kept and the text, separated by tabs.
+ */
+static void DoCommandGrep(struct action *act)
+{
+	char **args = act->args;
+	struct grepstate gs = { 0, 0, 1000, NULL };
+	bool ic = search_ic, re = false;
+	char err[256];
+
+	for (; *args && **args == '-' && args[1]; args++) {
+		if (!strcmp(*args, "--")) {
+			args++;
+			break;
+		} else if (!strcmp(*args, "-i"))
+			ic = true;
+		else if (!strcmp(*args, "-E"))
+			re = true;
+		else if (!strcmp(*args, "-m") && args[2] && IsNum(args[1]))
+			gs.max = atoi(*++args);
+		else {
+			OutputMsg(0, "%s: grep: unknown option %s", rc_name, *args);
+			CommandFailed();
+			return;
+		}
+	}
+	if (!*args || args[1]) {
+		OutputMsg(0, "%s: grep: usage: grep [-i] [-E] [-m max] [--] pattern", rc_name);
+		CommandFailed();
+		return;
+	}
+	for (Window *w = first_window; w; w = w->w_next) {
+		if (!SearchLines(w, *args, ic, re, err, sizeof(err), GrepLine, &gs)) {
+			OutputMsg(0, "%s: grep: %s", rc_name, err);
+			CommandFailed();
+			return;
+		}
+		if (gs.max && gs.matches >= gs.max)
+			break;
+	}
+	if (queryflag < 0)
+		OutputMsg(0, "%d matching lines in %d windows", gs.matches, gs.windows);
+	else if (gs.matches == 0)
+		CommandFailed();	/* like grep, fail if nothing matched */
+}
+
 static void DoCommandGr(struct action *act)
 {
 	int msgok = display && !*rc_name;
@@ -4350,22 +5253,29 @@ static void DoCommandBacktick(struct action *act)
 	char **args = act->args;
 	int argc = CheckArgNum(act->nr, args);
 	int n = 0;
+	bool shared = false;
 
+	/* ImmorTerm: -s shares the result with other sessions */
+	if (argc > 1 && !strcmp(*args, "-s")) {
+		shared = true;
+		args++;
+		argc--;
+	}
 	if (ParseBase(act, *args, &n, 10, "decimal"))
 		return;
 	if (!args[1])
-		setbacktick(n, 0, 0, NULL);
+		setbacktick(n, 0, 0, NULL, false);
 	else {
 		int lifespan, tick;
 		if (argc < 4) {
-			OutputMsg(0, "%s: usage: backtick num [lifespan tick cmd args...]", rc_name);
+			OutputMsg(0, "%s: usage: backtick [-s] num [lifespan tick cmd args...]", rc_name);
 			return;
 		}
 		if (ParseBase(act, args[1], &lifespan, 10, "decimal"))
 			return;
 		if (ParseBase(act, args[2], &tick, 10, "decimal"))
 			return;
-		setbacktick(n, lifespan, tick, SaveArgs(args + 3));
+		setbacktick(n, lifespan, tick, SaveArgs(args + 3), shared);
 	}
 	WindowChanged(NULL, WINESC_BACKTICK);
 }
@@ -4380,7 +5290,7 @@ static void DoCommandBlanker(struct action *act)
 	}
 	ClearAll();
 	CursorVisibility(-1);
-	D_blocked = 4;
+	SetBlocked(4);
 }
 
 static void DoCommandBlankerprg(struct action *act)
@@ -4734,31 +5644,33 @@ void DoAction(struct action *act)
 	if (!(n & CAN_QUERY) && queryflag >= 0) {
 		/* Query flag is set, but this command cannot be queried. */
 		OutputMsg(0, "%s command cannot be queried.", comms[nr].name);
-		queryflag = -1;
+		CommandFailed();
 		return;
 	}
 	if ((n & NEED_DISPLAY) && display == NULL) {
 		OutputMsg(0, "%s: %s: display required", rc_name, comms[nr].name);
-		queryflag = -1;
+		CommandFailed();
 		return;
 	}
 	if ((n & NEED_FORE) && fore == NULL) {
 		OutputMsg(0, "%s: %s: window required", rc_name, comms[nr].name);
-		queryflag = -1;
+		CommandFailed();
 		return;
 	}
 	if ((n & NEED_LAYER) && flayer == NULL) {
 		OutputMsg(0, "%s: %s: display or window required", rc_name, comms[nr].name);
-		queryflag = -1;
+		CommandFailed();
 		return;
 	}
-	if ((argc = CheckArgNum(nr, args)) < 0)
+	if ((argc = CheckArgNum(nr, args)) < 0) {
+		CommandFailed();
 		return;
+	}
 	if (display) {
 		if (AclCheckPermCmd(D_user, ACL_EXEC, &comms[nr])) {
 			OutputMsg(0, "%s: %s: permission denied (user %s)",
 				  rc_name, comms[nr].name, (EffectiveAclUser ? EffectiveAclUser : D_user)->u_name);
-			queryflag = -1;
+			CommandFailed();
 			return;
 		}
 	}
@@ -4833,6 +5745,9 @@ void DoAction(struct action *act)
 	case RC_AT:
 		DoCommandAt(act);
 		break;
+	case RC_RCCACHE:
+		DoCommandRccache(act);
+		break;
 	case RC_READREG:
 		DoCommandReadreg(act);
 		break;
@@ -4860,6 +5775,12 @@ void DoAction(struct action *act)
 	case RC_DINFO:
 		DoCommandDinfo(act);
 		break;
+	case RC_IOSTATS:
+		DoCommandIostats(act);
+		break;
+	case RC_SCHEDSTATS:
+		DoCommandSchedstats(act);
+		break;
 	case RC_COMMAND:
 		DoCommandCommand(act);
 		break;
@@ -4975,6 +5896,9 @@ void DoAction(struct action *act)
 	case RC_CHDIR:
 		DoCommandChdir(act);
 		break;
+	case RC_CHECKPOINT:
+		DoCommandCheckpoint(act);
+		break;
 	case RC_SHELL:
 	case RC_DEFSHELL:
 		DoCommandShell(act);
@@ -5050,6 +5974,9 @@ void DoAction(struct action *act)
 	case RC_MOUSETRACK:
 		DoCommandMousetrack(act);
 		break;
+	case RC_MEMINFO:
+		DoCommandMeminfo(act);
+		break;
 	case RC_DEFSILENCE:
 		DoCommandDefsilence(act);
 		break;
@@ -5059,6 +5986,9 @@ void DoAction(struct action *act)
 	case RC_HARDSTATUS:
 		DoCommandHardstatus(act);
 		break;
+	case RC_STATS:
+		DoCommandStats(act);
+		break;
 	case RC_STATUS:
 		DoCommandStatus(act);
 		break;
@@ -5104,6 +6034,39 @@ void DoAction(struct action *act)
 	case RC_ZOMBIE_TIMEOUT:
 		DoCommandZombie_timeout(act);
 		break;
+	case RC_SCROLLBACK_BUDGET:
+		DoCommandScrollbackBudget(act);
+		break;
+	case RC_SCROLLBACK_COMPRESS:
+		DoCommandScrollbackCompress(act);
+		break;
+	case RC_SCROLLBACK_DEDUP:
+		DoCommandScrollbackDedup(act);
+		break;
+	case RC_SCROLLBACK_DIR:
+		DoCommandScrollbackDir(act);
+		break;
+	case RC_SCROLLBACK_SETTLE:
+		DoCommandScrollbackSettle(act);
+		break;
+	case RC_HIBERNATE:
+		DoCommandHibernate(act);
+		break;
+	case RC_PASSTHROUGH:
+		DoCommandPassthrough(act);
+		break;
+	case RC_RENDER_FPS:
+		DoCommandRenderFps(act);
+		break;
+	case RC_SYNCOUTPUT:
+		DoCommandSyncoutput(act);
+		break;
+	case RC_STRINGLIMIT:
+		DoCommandStringlimit(act);
+		break;
+	case RC_FASTFORWARD:
+		DoCommandFastforward(act);
+		break;
 	case RC_SCROLLBACK_DUMP:
 		DoCommandScrollbackDump(act);
 		break;
@@ -5119,9 +6082,21 @@ void DoAction(struct action *act)
 	case RC_SCROLLBACK:
 		DoCommandScrollback(act);
 		break;
+	case RC_DEFSEARCHINDEX:
+		DoCommandDefsearchindex(act);
+		break;
+	case RC_SEARCHINDEX:
+		DoCommandSearchindex(act);
+		break;
+	case RC_SEARCHREGEX:
+		DoCommandSearchregex(act);
+		break;
 	case RC_SESSIONNAME:
 		DoCommandSessionname(act);
 		break;
+	case RC_SESSIONSTATE:
+		DoCommandSessionstate(act);
+		break;
 	case RC_SETENV:
 		DoCommandSetenv(act);
 		break;
@@ -5140,6 +6115,12 @@ void DoAction(struct action *act)
 	case RC_PASTEFONT:
 		DoCommandPastefont(act);
 		break;
+	case RC_CLIPBOARD:
+		DoCommandClipboard(act);
+		break;
+	case RC_COPYSTREAM:
+		DoCommandCopystream(act);
+		break;
 	case RC_CRLF:
 		DoCommandCrlf(act);
 		break;
@@ -5198,6 +6179,9 @@ void DoAction(struct action *act)
 	case RC_EXEC:
 		DoCommandExec(act);
 		break;
+	case RC_EXPORT:
+		DoCommandExport(act);
+		break;
 	case RC_NONBLOCK:
 		DoCommandNonblock(act);
 		break;
@@ -5207,6 +6191,9 @@ void DoAction(struct action *act)
 	case RC_GR:
 		DoCommandGr(act);
 		break;
+	case RC_GREP:
+		DoCommandGrep(act);
+		break;
 	case RC_C1:
 		DoCommandC1(act);
 		break;
@@ -5818,7 +6805,7 @@ int IsNumColon(char *s, char *p, int psize)
 
 void SwitchWindow(Window *window)
 {
-	if (window == NULL) {
+	if (window == NULL || OtherSession(window)) {
 		ShowWindows(-1);
 		return;
 	}
@@ -5896,9 +6883,11 @@ static Window *NextWindow(void)
 	Window *group = fore ? fore->w_group : NULL;
 
 	for (w = fore ? fore->w_next : first_window; w != fore; w = w->w_next) {
+		if (w == NULL && !fore)
+			break;
 		if (w == NULL)
 			w = first_window;
-		if (!fore || group == w->w_group)
+		if ((!fore || group == w->w_group) && !OtherSession(w))
 			break;
 	}
 	return w;
@@ -5910,9 +6899,11 @@ static Window *PreviousWindow(void)
 	Window *group = fore ? fore->w_group : NULL;
 
 	for (w = fore ? fore->w_prev : last_window; w != fore; w = w->w_prev) {
+		if (w == NULL && !fore)
+			break;
 		if (w == NULL)
 			w = last_window;
-		if (!fore || group == w->w_group)
+		if ((!fore || group == w->w_group) && !OtherSession(w))
 			break;
 	}
 	return w;
@@ -5943,6 +6934,7 @@ void KillWindow(Window *window)
 	Canvas *cv;
 	int gotone;
 	Layout *lay;
+	Hosted *h = window->w_hosted;
 
 	/*
 	 * Remove window from linked list.
@@ -5986,7 +6978,7 @@ void KillWindow(Window *window)
 		}
 		if (gotone) {
 			if (window->w_zdisplay == display) {
-				D_blocked = 0;
+				SetBlocked(0);
 				D_readev.condpos = D_readev.condneg = NULL;
 			}
 			Activate(-1);
@@ -5998,6 +6990,9 @@ void KillWindow(Window *window)
 		UpdateLayoutCanvas(&lay->lay_canvas, window);
 
 	FreeWindow(window);
+	/* ImmorTerm: a hosted session ends with its last window */
+	if (h && --h->h_windows == 0)
+		HostedClose(h);
 	WindowChanged(NULL, WINESC_WIN_NAMES);
 	WindowChanged(NULL, WINESC_WIN_NAMES_NOCUR);
 	WindowChanged(NULL, 0);
@@ -6014,8 +7009,7 @@ static void LogToggle(bool on)
 	}
 	if (fore->w_log != NULL) {
 		Msg(0, "Logfile \"%s\" closed.", fore->w_log->name);
-		logfclose(fore->w_log);
-		fore->w_log = NULL;
+		CloseLog(fore);
 		WindowChanged(fore, WINESC_WFLAGS);
 		return;
 	}
@@ -6059,6 +7053,8 @@ char *AddWindows(WinMsgBufContext *wmbc, int len, int flags, int where)
 			continue;
 		if (display && D_fore && D_fore->w_group != win->w_group)
 			continue;
+		if (OtherSession(win))
+			continue;
 
 		cmd = win->w_title;
 		l = strlen(cmd);
@@ -6213,7 +7209,8 @@ void ShowWindows(int where)
 static void ShowWindowsX(char *str)
 {
 	for (Window *w = first_window; w; w = w->w_next)
-		Msg(0, "%s", MakeWinMsg(str, w, '%'));
+		if (!OtherSession(w))
+			Msg(0, "%s", MakeWinMsg(str, w, '%'));
 }
 
 static void ShowInfo(void)
@@ -6534,6 +7531,7 @@ void DoScreen(char *fn, char **av)
 	struct NewWindow nwin;
 	int num;
 	char buf[20];
+	char *sname = NULL;
 
 	nwin = nwin_undef;
 	while (av && *av && av[0][0] == '-') {
@@ -6613,6 +7611,14 @@ void DoScreen(char *fn, char **av)
 		case 'L':
 			nwin.Lflag = true;
 			break;
+		case 'S':
+			if (av[0][2])
+				sname = &av[0][2];
+			else if (*++av)
+				sname = *av;
+			else
+				--av;
+			break;
 		default:
 			Msg(0, "%s: screen: invalid option -%c.", fn, av[0][1]);
 			break;
@@ -6635,6 +7641,21 @@ void DoScreen(char *fn, char **av)
 		if (!nwin.aka)
 			nwin.aka = Filename(*av);
 	}
+	/* ImmorTerm: -S starts the window in a new session hosted by this
+	 * one, out of sight of the display it is made on */
+	if (sname) {
+		Display *olddisplay = display;
+
+		if ((nwin.hosted = HostedOpen(sname)) == NULL)
+			return;
+		display = NULL;
+		MakeWindow(&nwin);
+		display = olddisplay;
+		if (!nwin.hosted->h_windows)
+			HostedClose(nwin.hosted);
+		return;
+	}
+	nwin.hosted = CommandHosted();
 	MakeWindow(&nwin);
 }
 
@@ -6951,38 +7972,38 @@ Window *FindNiceWindow(Window *win, char *presel)
 	}
 	if (!display)
 		return win;
-	if (win && AclCheckPermWin(D_user, ACL_READ, win))
+	if (win && (AclCheckPermWin(D_user, ACL_READ, win) || OtherSession(win)))
 		win = NULL;
 	if (!win || (IsOnDisplay(win) && !presel)) {
 		/* try to get another window */
 		win = NULL;
 		for (win = mru_window; win; win = win->w_prev_mru)
-			if (!win->w_layer.l_cvlist && !AclCheckPermWin(D_user, ACL_WRITE, win))
+			if (!OtherSession(win) && !win->w_layer.l_cvlist && !AclCheckPermWin(D_user, ACL_WRITE, win))
 				break;
 		if (!win)
 			for (win = mru_window; win; win = win->w_prev_mru)
-				if (win->w_layer.l_cvlist && !IsOnDisplay(win)
+				if (!OtherSession(win) && win->w_layer.l_cvlist && !IsOnDisplay(win)
 				    && !AclCheckPermWin(D_user, ACL_WRITE, win))
 					break;
 		if (!win)
 			for (win = mru_window; win; win = win->w_prev_mru)
-				if (!win->w_layer.l_cvlist && !AclCheckPermWin(D_user, ACL_READ, win))
+				if (!OtherSession(win) && !win->w_layer.l_cvlist && !AclCheckPermWin(D_user, ACL_READ, win))
 					break;
 		if (!win)
 			for (win = mru_window; win; win = win->w_prev_mru)
-				if (win->w_layer.l_cvlist && !IsOnDisplay(win)
+				if (!OtherSession(win) && win->w_layer.l_cvlist && !IsOnDisplay(win)
 				    && !AclCheckPermWin(D_user, ACL_READ, win))
 					break;
 		if (!win)
 			for (win = mru_window; win; win = win->w_prev_mru)
-				if (!win->w_layer.l_cvlist)
+				if (!OtherSession(win) && !win->w_layer.l_cvlist)
 					break;
 		if (!win)
 			for (win = mru_window; win; win = win->w_prev_mru)
-				if (win->w_layer.l_cvlist && !IsOnDisplay(win))
+				if (!OtherSession(win) && win->w_layer.l_cvlist && !IsOnDisplay(win))
 					break;
 	}
-	if (win && AclCheckPermWin(D_user, ACL_READ, win))
+	if (win && (AclCheckPermWin(D_user, ACL_READ, win) || OtherSession(win)))
 		win = NULL;
 	return win;
 }
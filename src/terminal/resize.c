@@ -35,22 +35,33 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/ioctl.h>
+#include <unistd.h>
+#ifdef HAVE_PTHREAD_CREATE
+#include <pthread.h>
+#endif
 
 #include "screen.h"
 
+#include "cell.h"
 #include "process.h"
+#include "search.h"
 #include "telnet.h"
+#include "trace.h"
 
 /* maximum window width */
 #define MAXWIDTH 1000
 
 static void CheckMaxSize(int);
-static void FreeMline(struct mline *);
-static int AllocMline(struct mline *ml, int);
+static void FreeMline(Window *, struct mline *, int);
+static int AllocMline(Window *, struct mline *, int);
+static int UnpackHline(Window *, struct mline *, struct hline *, int);
+static void FreeHlines(struct hline *, int);
 static void MakeBlankLine(uint32_t *, int);
 static void kaablamm(void);
 static int BcopyMline(struct mline *, int, struct mline *, int, int, int);
 static void SwapAltScreen(Window *);
+static int HistSetAside(Window *, int);
+static void HistReflowDue(Window *);
 
 struct winsize glwz;
 
@@ -302,24 +313,74 @@ void ResizeLayer(Layer *l, int wi, int he, Display *norefdisp)
 	display = olddisplay;
 }
 
-static void FreeMline(struct mline *ml)
+/*
+ * ImmorTerm: line arrays of a window are recycled through a small pool
+ * instead of going back to malloc, as scrolling colored output frees and
+ * allocates several of them per line. Only arrays of the size the pool
+ * was last reset to are kept, others are simply freed. Pooled arrays are
+ * plain malloc()ed memory, so they may also be freed directly.
+ */
+#define LINEPOOL_MAX 64
+
+uint32_t *LinePoolGet(Window *p, int w)
+{
+	struct linepool *lp = &p->w_linepool;
+	uint32_t *a;
+
+	if (w == lp->lp_width && lp->lp_free) {
+		a = lp->lp_free;
+		lp->lp_free = *(uint32_t **)a;
+		lp->lp_count--;
+		return a;
+	}
+	return malloc(w * 4);
+}
+
+void LinePoolPut(Window *p, uint32_t *a, int w)
+{
+	struct linepool *lp = &p->w_linepool;
+
+	if (w != lp->lp_width || lp->lp_count >= LINEPOOL_MAX || w * 4 < (int)sizeof(uint32_t *)) {
+		free(a);
+		return;
+	}
+	*(uint32_t **)a = lp->lp_free;
+	lp->lp_free = a;
+	lp->lp_count++;
+}
+
+/* Empties the pool and makes it collect arrays of w entries. */
+void LinePoolReset(Window *p, int w)
+{
+	struct linepool *lp = &p->w_linepool;
+	uint32_t *a;
+
+	while ((a = lp->lp_free) != NULL) {
+		lp->lp_free = *(uint32_t **)a;
+		free(a);
+	}
+	lp->lp_count = 0;
+	lp->lp_width = w;
+}
+
+static void FreeMline(Window *p, struct mline *ml, int w)
 {
 	if (ml->image)
-		free(ml->image);
+		LinePoolPut(p, ml->image, w);
 	if (ml->attr && ml->attr != null)
-		free(ml->attr);
+		LinePoolPut(p, ml->attr, w);
 	if (ml->font && ml->font != null)
-		free(ml->font);
+		LinePoolPut(p, ml->font, w);
 	if (ml->colorbg && ml->colorbg != null)
-		free(ml->colorbg);
+		LinePoolPut(p, ml->colorbg, w);
 	if (ml->colorfg && ml->colorfg != null)
-		free(ml->colorfg);
+		LinePoolPut(p, ml->colorfg, w);
 	*ml = mline_zero;
 }
 
-static int AllocMline(struct mline *ml, int w)
+static int AllocMline(Window *p, struct mline *ml, int w)
 {
-	ml->image = malloc(w * 4);
+	ml->image = LinePoolGet(p, w);
 	ml->attr = null;
 	ml->font = null;
 	ml->colorbg = null;
@@ -329,6 +390,389 @@ static int AllocMline(struct mline *ml, int w)
 	return 0;
 }
 
+/* Expands a packed history line into a line of its own, which only has
+ * the attribute arrays it needs. */
+static int UnpackHline(Window *p, struct mline *ml, struct hline *hl, int w)
+{
+	int used;
+
+	if (AllocMline(p, ml, w))
+		return -1;
+	if (!hl->image && !hl->cells) {
+		MakeBlankLine(ml->image, w);
+		return 0;
+	}
+	ml->attr = LinePoolGet(p, w);
+	ml->font = LinePoolGet(p, w);
+	ml->colorbg = LinePoolGet(p, w);
+	ml->colorfg = LinePoolGet(p, w);
+	if (!ml->attr || !ml->font || !ml->colorbg || !ml->colorfg) {
+		free(ml->image);
+		free(ml->attr);
+		free(ml->font);
+		free(ml->colorbg);
+		free(ml->colorfg);
+		*ml = mline_zero;
+		return -1;
+	}
+	used = cell_unpack(ml, hl, w);
+	if (!(used & CELL_ATTR)) {
+		LinePoolPut(p, ml->attr, w);
+		ml->attr = null;
+	}
+	if (!(used & CELL_FONT)) {
+		LinePoolPut(p, ml->font, w);
+		ml->font = null;
+	}
+	if (!(used & CELL_COLORBG)) {
+		LinePoolPut(p, ml->colorbg, w);
+		ml->colorbg = null;
+	}
+	if (!(used & CELL_COLORFG)) {
+		LinePoolPut(p, ml->colorfg, w);
+		ml->colorfg = null;
+	}
+	return 0;
+}
+
+static void FreeHlines(struct hline *hl, int n)
+{
+	int i;
+
+	if (!hl)
+		return;
+	for (i = 0; i < n; i++)
+		cell_free(hl + i);
+	free(hl);
+	HistFlushCache();
+}
+
+/*
+ * ImmorTerm: lazy reflow. When a window is resized, only the screen and
+ * the newest few history lines are rewrapped right away. The older
+ * history is set aside as it is, in w_hpend, and put back in front of
+ * the rest once the resizing has settled for REFLOW_DELAY ms, or as soon
+ * as somebody wants to look at the whole history. Dragging a panel thus
+ * costs a rewrap of the whole history once instead of at every step.
+ */
+#define REFLOW_DELAY 300
+
+/* other windows whose reflow is due within this many ms join in */
+#define REFLOW_SLACK 100
+
+/* most threads to rewrap the histories of several windows with */
+#define REFLOW_THREADS 4
+
+/* history lines to rewrap at once for a window of height he */
+#define REFLOW_MARGIN(he) (2 * (he))
+
+/* does history line hl of a window with width w continue on the next? */
+static bool HlineWraps(struct hline *hl, int w)
+{
+	/* trailing blanks are not kept, a line that wraps keeps cell w */
+	if (w >= hl->len)
+		return false;
+	if (hl->cells)
+		return hl->cells[w].image != ' ';
+	if (hl->image)
+		return hl->image[w] != ' ';
+	return false;
+}
+
+static void reflow_fn(Event *ev, void *data)
+{
+	(void)ev;
+	HistReflowDue((Window *)data);
+}
+
+/*
+ * Moves all but the last REFLOW_MARGIN(he) lines of the scrollback out of
+ * the ring into w_hpend, without breaking up wrapped lines. Returns the
+ * index of the first line left, counting from the oldest slot. Slots
+ * before w_scrollback_height lines hold nothing copy mode shows; they
+ * are dropped.
+ */
+static int HistSetAside(Window *p, int he)
+{
+	struct hpending *hp;
+	int hh = p->w_histheight;
+	int first = hh - (p->w_scrollback_height < hh ? p->w_scrollback_height : hh);
+	int ob = hh - REFLOW_MARGIN(he), y;
+
+	if (ob <= first)
+		return first;
+	while (ob > first && HlineWraps(&p->w_hlines[(p->w_histidx + ob - 1) % hh], p->w_width))
+		ob--;
+	if (ob == first)
+		return first;
+	if ((hp = malloc(sizeof(*hp))) == NULL || (hp->hp_lines = malloc((ob - first) * sizeof(struct hline))) == NULL) {
+		free(hp);
+		return first;	/* rewrap it all now */
+	}
+	for (y = first; y < ob; y++) {
+		struct hline *hl = &p->w_hlines[(p->w_histidx + y) % hh];
+
+		hp->hp_lines[y - first] = *hl;
+		memset(hl, 0, sizeof(*hl));
+	}
+	hp->hp_count = ob - first;
+	hp->hp_width = p->w_width;
+	hp->hp_older = p->w_hpend;
+	p->w_hpend = hp;
+	HistFlushCache();
+
+	p->w_reflowev.type = EV_TIMEOUT;
+	p->w_reflowev.data = (char *)p;
+	p->w_reflowev.handler = reflow_fn;
+	p->w_reflowev.name = "reflow_fn";
+	evdeq(&p->w_reflowev);
+	SetTimeout(&p->w_reflowev, REFLOW_DELAY);
+	evenq(&p->w_reflowev);
+	return ob;
+}
+
+/* Stores hl as the line before the oldest one of the scrollback. */
+static void HistPrepend(Window *p, struct hline *hl)
+{
+	int i = (p->w_histidx - p->w_scrollback_height - 1 + 2 * p->w_histheight) % p->w_histheight;
+
+	SearchIndexDrop(p);
+	cell_free(&p->w_hlines[i]);
+	p->w_hlines[i] = *hl;
+	memset(hl, 0, sizeof(*hl));
+	p->w_scrollback_height++;
+}
+
+/* Rewraps the lines of hp to the window width and stores them in front
+ * of the scrollback, as many as there is room for. */
+static void ReflowPending(Window *p, struct hpending *hp)
+{
+	int wf = hp->hp_width, wt = p->w_width;
+	struct mline ml, *src;
+	struct hline hl;
+	int a, b, i, j, k, l, lf, x;
+
+	ml.image = malloc((wt + 1) * 4);
+	ml.attr = malloc((wt + 1) * 4);
+	ml.font = malloc((wt + 1) * 4);
+	ml.colorbg = malloc((wt + 1) * 4);
+	ml.colorfg = malloc((wt + 1) * 4);
+	src = NULL;
+	if (!ml.image || !ml.attr || !ml.font || !ml.colorbg || !ml.colorfg)
+		goto out;
+	for (b = hp->hp_count - 1; b >= 0 && p->w_scrollback_height < p->w_histheight; b = a - 1) {
+		/* the wrapped line is made of lines a to b */
+		for (a = b; a > 0 && HlineWraps(&hp->hp_lines[a - 1], wf); a--)
+			;
+		if (wf == wt) {
+			for (i = b; i >= a && p->w_scrollback_height < p->w_histheight; i--)
+				HistPrepend(p, &hp->hp_lines[i]);
+			continue;
+		}
+		if ((src = calloc(b - a + 1, sizeof(struct mline))) == NULL)
+			goto out;
+		for (i = 0; i <= b - a; i++) {
+			if (UnpackHline(p, &src[i], &hp->hp_lines[a + i], wf + 1)) {
+				for (; i >= 0; i--)
+					FreeMline(p, &src[i], wf + 1);
+				free(src);
+				goto out;
+			}
+		}
+		/* same length as ChangeWindowSize() computes */
+		for (l = wf - 1; l > 0; l--)
+			if (src[b - a].image[l] != ' ' || src[b - a].attr[l])
+				break;
+		lf = (b - a) * wf + l + 1;
+		k = (lf - 1) / wt + 1;
+		for (j = k - 1; j >= 0 && p->w_scrollback_height < p->w_histheight; j--) {
+			MakeBlankLine(ml.image, wt);
+			ml.image[wt] = j == k - 1 ? ' ' : 0;
+			memset(ml.attr, 0, (wt + 1) * 4);
+			memset(ml.font, 0, (wt + 1) * 4);
+			memset(ml.colorbg, 0, (wt + 1) * 4);
+			memset(ml.colorfg, 0, (wt + 1) * 4);
+			for (x = 0; x < wt && j * wt + x < lf; x++) {
+				struct mline *m = &src[(j * wt + x) / wf];
+				int sx = (j * wt + x) % wf;
+
+				ml.image[x] = m->image[sx];
+				ml.attr[x] = m->attr[sx];
+				ml.font[x] = m->font[sx];
+				ml.colorbg[x] = m->colorbg[sx];
+				ml.colorfg[x] = m->colorfg[sx];
+			}
+			memset(&hl, 0, sizeof(hl));
+			if (cell_pack(&hl, &ml, wt + 1, &p->w_linepool.lp_high))
+				cell_free(&hl);
+			HistPrepend(p, &hl);
+		}
+		for (i = 0; i <= b - a; i++)
+			FreeMline(p, &src[i], wf + 1);
+		free(src);
+	}
+out:
+	free(ml.image);
+	free(ml.attr);
+	free(ml.font);
+	free(ml.colorbg);
+	free(ml.colorfg);
+}
+
+/* Rewraps all the history set aside of p. Touches nothing but p, so the
+ * lines of several windows can be rewrapped at the same time. */
+static void ReflowWindow(Window *p)
+{
+	struct hpending *hp;
+
+	if (!p->w_histheight || !p->w_width)
+		return;
+	for (hp = p->w_hpend; hp; hp = hp->hp_older)
+		ReflowPending(p, hp);
+}
+
+/* Forgets what p had set aside, once it is rewrapped. */
+static void ReflowDone(Window *p)
+{
+	struct hpending *hp;
+	int y;
+
+	while ((hp = p->w_hpend) != NULL) {
+		p->w_hpend = hp->hp_older;
+		FreeHlines(hp->hp_lines, hp->hp_count);
+		free(hp);
+	}
+	for (y = 0; scrollback_dedup && y < p->w_histheight; y++)
+		cell_share(&p->w_hlines[y]);
+	HistFlushCache();
+	HistCompress(p);
+}
+
+/* Puts the history set aside by ChangeWindowSize() back. */
+void HistReflow(Window *p)
+{
+	RedrawSettle(p);
+	evdeq(&p->w_reflowev);
+	if (!p->w_hpend)
+		return;
+	HistThawAll(p);
+	ReflowWindow(p);
+	ReflowDone(p);
+}
+
+#ifdef HAVE_PTHREAD_CREATE
+/* Empties the slots outside the scrollback, which HistPrepend() fills,
+ * so that the workers do not let go of shared lines (see cell_share()). */
+static void HistDropUnused(Window *p)
+{
+	int y, hh = p->w_histheight;
+
+	for (y = 0; hh && y < hh - p->w_scrollback_height; y++)
+		cell_free(&p->w_hlines[(p->w_histidx + y) % hh]);
+}
+
+struct reflowjob {
+	pthread_mutex_t lock;
+	Window **wins;
+	int n, next;
+};
+
+static void *reflow_worker(void *arg)
+{
+	struct reflowjob *job = arg;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+		i = job->next++;
+		pthread_mutex_unlock(&job->lock);
+		if (i >= job->n)
+			break;
+		ReflowWindow(job->wins[i]);
+	}
+	return NULL;
+}
+
+/* Rewraps the windows on up to REFLOW_THREADS threads, this one included,
+ * and returns once all are done. Does it all here if there are no
+ * threads to be had. */
+static void ReflowParallel(Window **wins, int n)
+{
+	struct reflowjob job = { .lock = PTHREAD_MUTEX_INITIALIZER, .wins = wins, .n = n };
+	pthread_t threads[REFLOW_THREADS - 1];
+	sigset_t all, old;
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	int nt, t;
+
+	nt = n < REFLOW_THREADS ? n : REFLOW_THREADS;
+	if (ncpu > 0 && nt > ncpu)
+		nt = ncpu;
+	/* the signals are for the main thread */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (t = 0; t < nt - 1; t++)
+		if (pthread_create(&threads[t], NULL, reflow_worker, &job))
+			break;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	reflow_worker(&job);
+	while (t-- > 0)
+		pthread_join(threads[t], NULL);
+	pthread_mutex_destroy(&job.lock);
+}
+#endif
+
+/*
+ * Puts the history of p back, together with that of all other windows
+ * whose reflow is due about now, as after the whole display was resized.
+ * Each window has its own lines, so they are rewrapped in parallel; this
+ * thread waits for all of them, so the event loop sees each history
+ * either as it was set aside or rewrapped completely.
+ */
+static void HistReflowDue(Window *p)
+{
+#ifdef HAVE_PTHREAD_CREATE
+	Window *q, **wins;
+	int n = 0, i, now = SchedNow();
+
+	for (q = mru_window; q; q = q->w_prev_mru)
+		if (q != p && q->w_hpend && q->w_reflowev.queued && q->w_reflowev.timeout - now <= REFLOW_SLACK)
+			n++;
+	if (n && p->w_hpend && (wins = malloc((n + 1) * sizeof(Window *))) != NULL) {
+		wins[0] = p;
+		n = 1;
+		for (q = mru_window; q; q = q->w_prev_mru)
+			if (q != p && q->w_hpend && q->w_reflowev.queued && q->w_reflowev.timeout - now <= REFLOW_SLACK)
+				wins[n++] = q;
+		for (i = 0; i < n; i++) {
+			evdeq(&wins[i]->w_reflowev);
+			HistThawAll(wins[i]);
+			HistDropUnused(wins[i]);
+		}
+		cell_share_styles(true);
+		ReflowParallel(wins, n);
+		cell_share_styles(false);
+		for (i = 0; i < n; i++)
+			ReflowDone(wins[i]);
+		free(wins);
+		return;
+	}
+#endif
+	HistReflow(p);
+}
+
+/* Forgets the history set aside, for windows going away. */
+void HistDropPending(Window *p)
+{
+	struct hpending *hp;
+
+	evdeq(&p->w_reflowev);
+	while ((hp = p->w_hpend) != NULL) {
+		p->w_hpend = hp->hp_older;
+		FreeHlines(hp->hp_lines, hp->hp_count);
+		free(hp);
+	}
+}
+
 static int BcopyMline(struct mline *mlf, int xf, struct mline *mlt, int xt, int l, int w)
 {
 	int r = 0;
@@ -419,14 +863,11 @@ do {						\
 } while (0)
 
 	/* We have to run through all windows to substitute
-	 * the null and blank references.
+	 * the null and blank references. Packed history lines
+	 * don't have any.
 	 */
 	for (p = mru_window; p; p = p->w_prev_mru) {
 		RESET_LINES(p->w_mlines, p->w_height);
-
-		RESET_LINES(p->w_hlines, p->w_histheight);
-		RESET_LINES(p->w_alt.hlines, p->w_alt.histheight);
-
 		RESET_LINES(p->w_alt.mlines, p->w_alt.height);
 	}
 }
@@ -450,17 +891,19 @@ static void MakeBlankLine(uint32_t *p, int n)
 }
 
 #define OLDWIN(y) ((y < p->w_histheight) \
-        ? &p->w_hlines[(p->w_histidx + y) % p->w_histheight] \
+        ? &ohlines[y] \
         : &p->w_mlines[y - p->w_histheight])
 
 #define NEWWIN(y) ((y < hi) ? &nhlines[y] : &nmlines[y - hi])
 
 int ChangeWindowSize(Window *p, int wi, int he, int hi)
 {
-	struct mline *mlf = NULL, *mlt = NULL, *ml, *nmlines, *nhlines;
+	struct mline *mlf = NULL, *mlt = NULL, *ml, *nmlines, *nhlines, *ohlines;
+	struct hline *nh;
 	int fy, ty, l, lx, lf, lt, yy, oty, addone;
 	int ncx, ncy, naka, t;
-	int y, shift;
+	int y, shift, ob, filled;
+	bool lazy;
 
 	if (wi <= 0 || he <= 0)
 		wi = he = hi = 0;
@@ -482,19 +925,31 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 		return 0;
 	}
 
+	RedrawSettle(p);
 	CheckMaxSize(wi);
+	TRACE4(resize__entry, p->w_number, wi, he, hi);
+
+	/* rewrap the bulk of the history later, unless somebody looks at it */
+	if (!wi)
+		HistDropPending(p);
+	else if (p->w_savelayer && p->w_savelayer != &p->w_layer)
+		HistReflow(p);
+	lazy = wi && p->w_width && p->w_histheight && !(p->w_savelayer && p->w_savelayer != &p->w_layer);
 
 	fy = p->w_histheight + p->w_height - 1;
 	ty = hi + he - 1;
 
-	nmlines = nhlines = NULL;
+	nmlines = nhlines = ohlines = NULL;
+	nh = NULL;
 	ncx = 0;
 	ncy = 0;
 	naka = 0;
 
 	if (wi) {
 		if (wi != p->w_width || he != p->w_height) {
-			if ((nmlines = calloc(he, sizeof(struct mline))) == NULL) {
+			/* room to slide the screen down, see MScrollV() */
+			if ((nmlines = calloc(2 * he, sizeof(struct mline))) == NULL) {
+				TRACE2(resize__return, p->w_number, -1);
 				KillWindow(p);
 				Msg(0, "%s", strnomem);
 				return -1;
@@ -509,13 +964,34 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 		}
 	}
 	if (hi) {
-		if ((nhlines = calloc(hi, sizeof(struct mline))) == NULL) {
+		nhlines = calloc(hi, sizeof(struct mline));
+		nh = calloc(hi, sizeof(struct hline));
+		if (nhlines == NULL || nh == NULL) {
+			free(nhlines);
+			free(nh);
+			nhlines = NULL;
+			nh = NULL;
 			Msg(0, "No memory for history buffer - turned off");
 			hi = 0;
 			ty = he - 1;
 		}
 	}
 
+	/* rewrapping works on expanded lines, unpack the old history */
+	HistThawAll(p);
+	ob = lazy ? HistSetAside(p, he) : 0;
+	if (p->w_histheight) {
+		if ((ohlines = calloc(p->w_histheight, sizeof(struct mline))) == NULL)
+			goto nomem;
+		for (y = ob; y < p->w_histheight; y++) {
+			struct hline *hl = &p->w_hlines[(p->w_histidx + y) % p->w_histheight];
+
+			if (UnpackHline(p, &ohlines[y], hl, p->w_width + 1))
+				goto nomem;
+			cell_free(hl);
+		}
+	}
+
 	/* special case: cursor is at magic margin position */
 	addone = 0;
 	if (p->w_width && p->w_x == p->w_width) {
@@ -529,7 +1005,7 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 		ncy = p->w_y + he - p->w_height;
 		/* never lose sight of the line with the cursor on it */
 		shift = -ncy;
-		for (yy = p->w_y + p->w_histheight - 1; yy >= 0 && ncy + shift < he; yy--) {
+		for (yy = p->w_y + p->w_histheight - 1; yy >= ob && ncy + shift < he; yy--) {
 			ml = OLDWIN(yy);
 			if (!ml->image)
 				break;
@@ -547,21 +1023,21 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 		}
 		while (shift-- > 0) {
 			ml = OLDWIN(fy);
-			FreeMline(ml);
+			FreeMline(p, ml, p->w_width + 1);
 			fy--;
 		}
 	}
-	if (fy >= 0)
+	if (fy >= ob)
 		mlf = OLDWIN(fy);
 	if (ty >= 0)
 		mlt = NEWWIN(ty);
 
-	while (fy >= 0 && ty >= 0) {
+	while (fy >= ob && ty >= 0) {
 		if (p->w_width == wi) {
 			/* here is a simple shortcut: just copy over */
 			*mlt = *mlf;
 			*mlf = mline_zero;
-			if (--fy >= 0)
+			if (--fy >= ob)
 				mlf = OLDWIN(fy);
 			if (--ty >= 0)
 				mlt = NEWWIN(ty);
@@ -578,7 +1054,7 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 		lf = l;
 
 		/* add wrapped lines to length */
-		for (yy = fy - 1; yy >= 0; yy--) {
+		for (yy = fy - 1; yy >= ob; yy--) {
 			ml = OLDWIN(yy);
 			if (ml->image[p->w_width] == ' ')
 				break;
@@ -588,10 +1064,10 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 		/* rewrap lines */
 		lt = (l - 1) % wi + 1;	/* lf is set above */
 		oty = ty;
-		while (l > 0 && fy >= 0 && ty >= 0) {
+		while (l > 0 && fy >= ob && ty >= 0) {
 			lx = lt > lf ? lf : lt;
 			if (mlt->image == NULL) {
-				if (AllocMline(mlt, wi + 1))
+				if (AllocMline(p, mlt, wi + 1))
 					goto nomem;
 				MakeBlankLine(mlt->image + lt, wi - lt);
 				mlt->image[wi] = ((oty == ty) ? ' ' : 0);
@@ -609,7 +1085,7 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 				if (shift > 0) {
 					for (y = hi + he - 1; y >= ty; y--) {
 						mlt = NEWWIN(y);
-						FreeMline(mlt);
+						FreeMline(p, mlt, wi + 1);
 						if (y - shift < ty)
 							continue;
 						ml = NEWWIN(y - shift);
@@ -631,9 +1107,9 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 			lt -= lx;
 			l -= lx;
 			if (lf == 0) {
-				FreeMline(mlf);
+				FreeMline(p, mlf, p->w_width + 1);
 				lf = p->w_width;
-				if (--fy >= 0)
+				if (--fy >= ob)
 					mlf = OLDWIN(fy);
 			}
 			if (lt == 0) {
@@ -643,26 +1119,41 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 			}
 		}
 	}
-	while (fy >= 0) {
-		FreeMline(mlf);
-		if (--fy >= 0)
+	while (fy >= ob) {
+		FreeMline(p, mlf, p->w_width + 1);
+		if (--fy >= ob)
 			mlf = OLDWIN(fy);
 	}
-	while (ty >= 0) {
-		if (AllocMline(mlt, wi + 1))
+	filled = ty < hi ? hi - 1 - ty : 0;
+	/* the rest of the history stays blank, fill the screen */
+	while (ty >= hi) {
+		if (AllocMline(p, mlt, wi + 1))
 			goto nomem;
 		MakeBlankLine(mlt->image, wi + 1);
-		if (--ty >= 0)
+		if (--ty >= hi)
 			mlt = NEWWIN(ty);
 	}
 
-	if (p->w_mlines && p->w_mlines != nmlines)
-		free((char *)p->w_mlines);
+	if (p->w_mlines != nmlines) {
+		free((char *)p->w_mlinebuf);
+		p->w_mlinebuf = nmlines;
+	}
 	p->w_mlines = nmlines;
-	if (p->w_hlines && p->w_hlines != nhlines)
-		free((char *)p->w_hlines);
-	p->w_hlines = nhlines;
-	nmlines = nhlines = 0;
+	/* pack the new history */
+	for (y = 0; y < hi; y++) {
+		if (nhlines[y].image && cell_pack(&nh[y], &nhlines[y], wi + 1, &p->w_linepool.lp_high))
+			cell_free(&nh[y]);
+		else if (scrollback_dedup)
+			cell_share(&nh[y]);
+		FreeMline(p, &nhlines[y], wi + 1);
+	}
+	free(nhlines);
+	free(ohlines);
+	FreeHlines(p->w_hlines, p->w_histheight);
+	p->w_hlines = nh;
+	SearchIndexDrop(p);
+	nmlines = nhlines = ohlines = 0;
+	nh = NULL;
 
 	/* change tabs */
 	if (p->w_width != wi) {
@@ -722,29 +1213,41 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 	/* store new size */
 	p->w_width = wi;
 	p->w_height = he;
-	if(p->w_scrollback_height > hi)
+	if (lazy)
+		p->w_scrollback_height = filled;	/* HistReflow() counts on it */
+	else if(p->w_scrollback_height > hi)
 		p->w_scrollback_height = hi;
 	p->w_histidx = 0;
 	p->w_histheight = hi;
+	if (p->w_linepool.lp_width != (wi ? wi + 1 : 0))
+		LinePoolReset(p, wi ? wi + 1 : 0);
+	HistCompress(p);
 
 #ifdef ENABLE_TELNET
 	if (p->w_type == W_TYPE_TELNET)
 		TelWindowSize(p);
 #endif
 
+	TRACE2(resize__return, p->w_number, 0);
 	return 0;
 
 nomem:
 	if (nmlines) {
 		for (ty = he + hi - 1; ty >= 0; ty--) {
 			mlt = NEWWIN(ty);
-			FreeMline(mlt);
+			FreeMline(p, mlt, wi + 1);
 		}
 		if (nmlines && p->w_mlines != nmlines)
 			free((char *)nmlines);
-		if (nhlines && p->w_hlines != nhlines)
-			free((char *)nhlines);
 	}
+	free(nhlines);
+	free(nh);
+	if (ohlines) {
+		for (y = 0; y < p->w_histheight; y++)
+			FreeMline(p, &ohlines[y], p->w_width + 1);
+		free(ohlines);
+	}
+	TRACE2(resize__return, p->w_number, -1);
 	KillWindow(p);
 	Msg(0, "%s", strnomem);
 	return -1;
@@ -756,17 +1259,14 @@ void FreeAltScreen(Window *p)
 
 	if (p->w_alt.mlines) {
 		for (i = 0; i < p->w_alt.height; i++)
-			FreeMline(p->w_alt.mlines + i);
-		free(p->w_alt.mlines);
+			FreeMline(p, p->w_alt.mlines + i, p->w_alt.width + 1);
+		free(p->w_alt.mlinebuf);
 	}
 	p->w_alt.mlines = NULL;
+	p->w_alt.mlinebuf = NULL;
 	p->w_alt.width = 0;
 	p->w_alt.height = 0;
-	if (p->w_alt.hlines) {
-		for (i = 0; i < p->w_alt.histheight; i++)
-			FreeMline(p->w_alt.hlines + i);
-		free(p->w_alt.hlines);
-	}
+	FreeHlines(p->w_alt.hlines, p->w_alt.histheight);
 	p->w_alt.hlines = NULL;
 	p->w_alt.histidx = 0;
 	p->w_alt.histheight = 0;
@@ -775,8 +1275,13 @@ void FreeAltScreen(Window *p)
 static void SwapAltScreen(Window *p)
 {
 	struct mline *ml;
+	struct hline *hl;
 	int t;
 
+	/* the alternate history has no compressed blocks, nor lines set aside */
+	HistReflow(p);
+	HistThawAll(p);
+
 #define SWAP(item, t)			\
 do {					\
 	(t) = p->w_alt. item;		\
@@ -785,13 +1290,15 @@ do {					\
 } while (0)
 
 	SWAP(mlines, ml);
+	SWAP(mlinebuf, ml);
 	SWAP(width, t);
 	SWAP(height, t);
 
 	SWAP(histheight, t);
-	SWAP(hlines, ml);
+	SWAP(hlines, hl);
 	SWAP(histidx, t);
 #undef SWAP
+	SearchIndexDrop(p);
 }
 
 void EnterAltScreen(Window *p)
@@ -799,6 +1306,7 @@ void EnterAltScreen(Window *p)
 	if (!p->w_alt.on) {
 		/* If not already using the alternate screen buffer, then create
 		   a new one and swap it with the 'real' screen buffer. */
+		RedrawSettle(p);
 		FreeAltScreen(p);
 		SwapAltScreen(p);
 	} else {
@@ -13,6 +13,11 @@ int   MayResizeLayer (Layer *);
 void  FreeAltScreen (Window *);
 void  EnterAltScreen (Window *);
 void  LeaveAltScreen (Window *);
+uint32_t *LinePoolGet (Window *, int);
+void  LinePoolPut (Window *, uint32_t *, int);
+void  LinePoolReset (Window *, int);
+void  HistReflow (Window *);
+void  HistDropPending (Window *);
 
 /* global variables */
 
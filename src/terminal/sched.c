@@ -30,52 +30,503 @@
 
 #include "sched.h"
 
+#include <fcntl.h>
 #include <poll.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <time.h>
 #include <sys/time.h>
 
+#if defined(HAVE_EPOLL_CREATE1)
+# include <sys/epoll.h>
+# define SCHED_KQUEUE
+#elif defined(HAVE_KQUEUE)
+# include <sys/event.h>
+# define SCHED_KQUEUE
+#endif
+
 #include "screen.h"
+#include "trace.h"
 
 static Event *evs;
-static Event *tevs;
 static Event *nextev;
-static int calctimeout;
+static Event **tevs;	/* EV_TIMEOUT events, a binary min-heap (see tbefore()) */
+static int ntevs, tevs_cnt;
+static unsigned int tseq;
 static struct pollfd *pfd;
 static int pfd_cnt;
+static int nfdevs;	/* queued EV_READ and EV_WRITE events */
 
+SchedStats schedstats;
+unsigned int schedround;
+static int handlers_cnt;
+static unsigned long long lastwake;
 
-static Event *calctimo(void);
+#define EVMASK(type)	(1 << (type))
 
-void evenq(Event *ev)
+/* events gated by condpos/condneg are not waited for */
+static inline bool evgated(Event *ev)
+{
+	return ev->condpos && *ev->condpos <= (ev->condneg ? *ev->condneg : 0);
+}
+
+#ifdef SCHED_KQUEUE
+/*
+ * With epoll (Linux) or kqueue (BSD, macOS) the kernel keeps the set of
+ * descriptors we wait for, so it only has to be told about changes. The
+ * queued fd events are indexed by descriptor here; before every wait the
+ * gates are re-evaluated (they are plain variables that change behind our
+ * back) and the descriptors whose interest changed are updated. If the
+ * kernel queue cannot be created we stay with poll().
+ */
+typedef struct {
+	Event *evs;	/* queued fd events on this descriptor */
+	int mask;	/* interest registered with the kernel */
+	uint32_t gen;	/* bumped on every new registration */
+	bool dirty;	/* interest may have changed */
+	bool always;	/* refused by the kernel queue; always ready, as
+			 * poll() would report it */
+} EvFd;
+
+static int kq = -1;
+static EvFd *evfds;
+static int evfds_cnt;
+static int *dirty;
+static int ndirty, dirty_cnt;
+
+static EvFd *evfd(int fd)
+{
+	if (fd >= evfds_cnt) {
+		int n = fd + 16;
+		EvFd *nfds = realloc(evfds, n * sizeof(EvFd));
+		int *ndirty_ = realloc(dirty, n * sizeof(int));
+
+		if (nfds == NULL || ndirty_ == NULL)
+			Panic(0, "%s", strnomem);
+		memset(nfds + evfds_cnt, 0, (n - evfds_cnt) * sizeof(EvFd));
+		evfds = nfds;
+		dirty = ndirty_;
+		evfds_cnt = dirty_cnt = n;
+	}
+	return &evfds[fd];
+}
+
+static void evfd_dirty(int fd)
+{
+	EvFd *f = evfd(fd);
+
+	if (!f->dirty) {
+		f->dirty = true;
+		dirty[ndirty++] = fd;
+	}
+}
+
+/* Tell the kernel queue about a new interest mask; returns the mask now
+ * registered. */
+static int kq_ctl(int fd, EvFd *f, int mask)
+{
+#ifdef HAVE_EPOLL_CREATE1
+	struct epoll_event e;
+	int op;
+
+	memset(&e, 0, sizeof(e));
+	if (mask & EVMASK(EV_READ))
+		e.events |= EPOLLIN;
+	if (mask & EVMASK(EV_WRITE))
+		e.events |= EPOLLOUT;
+	if (mask == 0)
+		op = EPOLL_CTL_DEL;
+	else if (f->mask == 0) {
+		op = EPOLL_CTL_ADD;
+		f->gen++;
+	} else
+		op = EPOLL_CTL_MOD;
+	e.data.u64 = (uint64_t)f->gen << 32 | (uint32_t)fd;
+	if (epoll_ctl(kq, op, fd, &e) == 0 || op == EPOLL_CTL_DEL)
+		return mask;
+	/* the descriptor was closed and reused behind our back */
+	if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+		e.data.u64 = (uint64_t)++f->gen << 32 | (uint32_t)fd;
+		if (epoll_ctl(kq, EPOLL_CTL_ADD, fd, &e) == 0)
+			return mask;
+	} else if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+		if (epoll_ctl(kq, EPOLL_CTL_MOD, fd, &e) == 0)
+			return mask;
+	}
+#else
+	struct kevent kev;
+	static const short filter[] = { [EV_READ] = EVFILT_READ, [EV_WRITE] = EVFILT_WRITE };
+
+	if (f->mask == 0)
+		f->gen++;
+	for (int type = EV_READ; type <= EV_WRITE; type++) {
+		if (!((mask ^ f->mask) & EVMASK(type)))
+			continue;
+		EV_SET(&kev, fd, filter[type], (mask & EVMASK(type)) ? EV_ADD : EV_DELETE,
+		       0, 0, (void *)(uintptr_t)f->gen);
+		/* deleting fails harmlessly once the descriptor is closed */
+		if (kevent(kq, &kev, 1, NULL, 0, NULL) < 0 && (mask & EVMASK(type)))
+			goto refused;
+	}
+	return mask;
+refused:
+#endif
+	/* regular files and closed descriptors: poll() reports them as
+	 * ready, so do the same */
+	f->always = true;
+	return 0;
+}
+
+static void evfd_update(int fd)
+{
+	EvFd *f = &evfds[fd];
+	int mask = 0;
+
+	f->dirty = false;
+	for (Event *ev = f->evs; ev; ev = ev->fdnext)
+		if (ev->armed)
+			mask |= EVMASK(ev->type);
+	if (f->always) {
+		if (f->evs)
+			return;
+		f->always = false;
+	}
+	if (mask != f->mask)
+		f->mask = kq_ctl(fd, f, mask);
+}
+
+static void evfd_link(Event *ev)
+{
+	EvFd *f = evfd(ev->regfd);
+
+	ev->fdnext = f->evs;
+	f->evs = ev;
+	ev->armed = false;
+}
+
+static void evfd_unlink(Event *ev)
+{
+	EvFd *f = &evfds[ev->regfd];
+	Event **evpp;
+
+	for (evpp = &f->evs; *evpp; evpp = &(*evpp)->fdnext)
+		if (*evpp == ev) {
+			*evpp = ev->fdnext;
+			break;
+		}
+	if (ev->armed)
+		evfd_dirty(ev->regfd);
+	/* drop the registration now: the descriptor is probably about to be
+	 * closed, and a new one with the same number is not registered */
+	if (f->evs == NULL && kq >= 0) {
+		f->always = false;
+		if (f->mask)
+			f->mask = kq_ctl(ev->regfd, f, 0);
+	}
+}
+
+/* Start over with a fresh kernel queue; everything is registered again by
+ * the next kq_sync(). */
+static void kq_open(void)
 {
-	int i = 0;
+	if (kq >= 0)
+		close(kq);
+#ifdef HAVE_EPOLL_CREATE1
+	kq = epoll_create1(EPOLL_CLOEXEC);
+#else
+	if ((kq = kqueue()) >= 0)
+		fcntl(kq, F_SETFD, FD_CLOEXEC);
+#endif
+	for (int fd = 0; fd < evfds_cnt; fd++) {
+		evfds[fd].mask = 0;
+		evfds[fd].always = false;
+	}
+	for (Event *ev = evs; ev; ev = ev->next)
+		ev->armed = false;
+}
+
+/* Bring the kernel queue up to date; returns the number of events that are
+ * ready without asking it. */
+static int kq_sync(void)
+{
+	int n = 0;
+
+	for (Event *ev = evs; ev; ev = ev->next) {
+		bool armed;
 
+		if ((ev->type != EV_READ && ev->type != EV_WRITE) || ev->regfd < 0)
+			continue;
+		ev->ready = false;
+		armed = !evgated(ev);
+		if (armed != ev->armed) {
+			ev->armed = armed;
+			evfd_dirty(ev->regfd);
+		}
+	}
+	while (ndirty)
+		evfd_update(dirty[--ndirty]);
+	for (Event *ev = evs; ev; ev = ev->next)
+		if ((ev->type == EV_READ || ev->type == EV_WRITE) && ev->armed && evfds[ev->regfd].always) {
+			ev->ready = true;
+			n++;
+		}
+	return n;
+}
+
+static void kq_ready(int fd, uint32_t gen, int mask, bool *stale)
+{
+	EvFd *f;
+
+	if (fd < 0 || fd >= evfds_cnt || (f = &evfds[fd])->gen != gen || !f->mask) {
+		/* a registration we no longer know about: the descriptor was
+		 * closed while another process still holds it open */
+		*stale = true;
+		return;
+	}
+	for (Event *ev = f->evs; ev; ev = ev->fdnext)
+		if (ev->armed && (mask & EVMASK(ev->type)))
+			ev->ready = true;
+}
+
+static int kq_wait(int timeout)
+{
+#ifdef HAVE_EPOLL_CREATE1
+	static struct epoll_event *kev;
+#else
+	static struct kevent *kev;
+	struct timespec ts;
+#endif
+	static int kev_cnt;
+	bool stale = false;
+	int n, forced;
+
+	forced = kq_sync();
+	if (forced)
+		timeout = 0;
+#ifdef HAVE_EPOLL_CREATE1
+	if (kev_cnt < nfdevs) {
+		kev_cnt = nfdevs + 16;
+		if ((kev = realloc(kev, kev_cnt * sizeof(*kev))) == NULL)
+			Panic(0, "%s", strnomem);
+	}
+	n = epoll_wait(kq, kev, kev_cnt, timeout);
+	for (int i = 0; i < n; i++) {
+		int mask = 0;
+
+		/* hangups and errors wake readers and writers alike, like
+		 * POLLHUP and POLLERR do */
+		if (kev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			mask |= EVMASK(EV_READ);
+		if (kev[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+			mask |= EVMASK(EV_WRITE);
+		kq_ready((int)(uint32_t)kev[i].data.u64, (uint32_t)(kev[i].data.u64 >> 32), mask, &stale);
+	}
+#else
+	if (kev_cnt < 2 * nfdevs) {
+		kev_cnt = 2 * nfdevs + 16;
+		if ((kev = realloc(kev, kev_cnt * sizeof(*kev))) == NULL)
+			Panic(0, "%s", strnomem);
+	}
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+	n = kevent(kq, NULL, 0, kev, kev_cnt, timeout < 0 ? NULL : &ts);
+	for (int i = 0; i < n; i++)
+		kq_ready((int)kev[i].ident, (uint32_t)(uintptr_t)kev[i].udata,
+			 EVMASK(kev[i].filter == EVFILT_WRITE ? EV_WRITE : EV_READ), &stale);
+#endif
+	if (stale)
+		kq_open();
+	return n < 0 ? n : n + forced;
+}
+#endif /* SCHED_KQUEUE */
+
+/* The portable fallback: hand the whole set to poll() every time. */
+static int poll_wait(int timeout)
+{
+	Event *ev;
+	int i, n;
+
+	if (nfdevs > pfd_cnt) {
+		pfd_cnt = nfdevs;
+		if ((pfd = realloc(pfd, pfd_cnt * sizeof(struct pollfd))) == NULL)
+			Panic(0, "%s", strnomem);
+	}
+	i = 0;
+	for (ev = evs; ev; ev = ev->next) {
+		if (ev->type != EV_READ && ev->type != EV_WRITE)
+			continue;
+		pfd[i].fd = evgated(ev) ? -1 : ev->fd;
+		pfd[i].events = (ev->type == EV_READ) ? POLLIN : POLLOUT;
+		pfd[i].revents = 0;
+		i++;
+	}
+
+	n = poll(pfd, i, timeout);
+
+	i = 0;
+	for (ev = evs; ev; ev = ev->next)
+		if (ev->type == EV_READ || ev->type == EV_WRITE)
+			ev->ready = n > 0 && pfd[i++].revents != 0;
+	return n;
+}
+
+/*
+ * Timers may fire a little late, so that timers which come due close
+ * together are served by one wakeup: up to 1/32 of the time they were set
+ * for, and never more than SCHED_SLACK_MAX milliseconds. Short timers
+ * (frame pacing, slowpaste) get no slack at all.
+ */
+#define SCHED_SLACK_MAX	50
+
+/*
+ * Inside the loop the clocks are sampled once per wakeup, and everyone
+ * gets the time the wait ended; before that (startup) every call reads
+ * them. Timers run on the monotonic clock, so setting the system time or
+ * waking from sleep does not misfire them.
+ */
+static bool clockcached;
+static int mononow;
+static struct timeval wallnow;
+
+static void sampleclock(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	mononow = ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+	gettimeofday(&wallnow, NULL);
+#ifndef CLOCK_MONOTONIC
+	mononow = wallnow.tv_sec * 1000 + wallnow.tv_usec / 1000;
+#endif
+}
+
+/* Monotonic time in milliseconds; it wraps, so compare differences. */
+int SchedNow(void)
+{
+	if (!clockcached)
+		sampleclock();
+	return mononow;
+}
+
+/* Wall clock time, for showing it and for aligning to it. */
+void SchedWalltime(struct timeval *tv)
+{
+	if (!clockcached)
+		sampleclock();
+	*tv = wallnow;
+}
+
+
+/* Event.timeout is an int and wraps; compare the difference */
+static inline int tdiff(int a, int b)
+{
+	return (int)((unsigned int)a - (unsigned int)b);
+}
+
+static void tslack(Event *ev)
+{
+	int slack = tdiff(ev->timeout, SchedNow()) / 32;
+
+	if (slack < 0)
+		slack = 0;
+	else if (slack > SCHED_SLACK_MAX)
+		slack = SCHED_SLACK_MAX;
+	ev->latest = ev->timeout + slack;
+}
+
+/* heap order: latest acceptable time, then priority and queue order as
+ * the old sorted list had it */
+static inline bool tbefore(Event *a, Event *b)
+{
+	int d = tdiff(a->latest, b->latest);
+
+	if (d != 0)
+		return d < 0;
+	if (a->priority != b->priority)
+		return a->priority > b->priority;
+	return (int)(a->tseq - b->tseq) < 0;
+}
+
+static inline void tset(int i, Event *ev)
+{
+	tevs[i] = ev;
+	ev->heapidx = i;
+}
+
+static void tsift(int i)
+{
+	Event *ev = tevs[i];
+
+	while (i > 0 && tbefore(ev, tevs[(i - 1) / 2])) {
+		tset(i, tevs[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	for (;;) {
+		int c = 2 * i + 1;
+
+		if (c >= ntevs)
+			break;
+		if (c + 1 < ntevs && tbefore(tevs[c + 1], tevs[c]))
+			c++;
+		if (!tbefore(tevs[c], ev))
+			break;
+		tset(i, tevs[c]);
+		i = c;
+	}
+	tset(i, ev);
+}
+
+static void tpush(Event *ev)
+{
+	if (ntevs == tevs_cnt) {
+		tevs_cnt = tevs_cnt ? tevs_cnt * 2 : 32;
+		if ((tevs = realloc(tevs, tevs_cnt * sizeof(Event *))) == NULL)
+			Panic(0, "%s", strnomem);
+	}
+	ev->tseq = tseq++;
+	tslack(ev);
+	tset(ntevs++, ev);
+	tsift(ev->heapidx);
+}
+
+static void tremove(Event *ev)
+{
+	int i = ev->heapidx;
+
+	if (i != --ntevs) {
+		tset(i, tevs[ntevs]);
+		tsift(i);
+	}
+}
+
+void evenq(Event *ev)
+{
 	Event *evp, **evpp;
 	if (ev->queued)
 		return;
-	evpp = &evs;
+	ev->queued = true;
 	if (ev->type == EV_TIMEOUT) {
-		calctimeout = 1;
-		evpp = &tevs;
+		tpush(ev);
+		return;
 	}
 
+	evpp = &evs;
 	for (; (evp = *evpp); evpp = &evp->next)
 		if (ev->priority > evp->priority)
 			break;
 	ev->next = evp;
 	*evpp = ev;
-	ev->queued = true;
-
-	/* check if we need more pollfd */
-	for (evp = evs; evp; evp = evp->next)
-		if (evp->type == EV_READ || evp->type == EV_WRITE)
-			i++;
+	ev->ready = false;
 
-	if (i > pfd_cnt) {
-		pfd_cnt = i;
-		pfd = realloc(pfd, pfd_cnt * sizeof(struct pollfd));
+	if (ev->type == EV_READ || ev->type == EV_WRITE) {
+		nfdevs++;
+		ev->regfd = ev->fd;
+#ifdef SCHED_KQUEUE
+		if (ev->regfd >= 0)
+			evfd_link(ev);
+#endif
 	}
 }
 
@@ -84,11 +535,13 @@ void evdeq(Event *ev)
 	Event *evp, **evpp;
 	if (!ev || !ev->queued)
 		return;
-	evpp = &evs;
 	if (ev->type == EV_TIMEOUT) {
-		calctimeout = 1;
-		evpp = &tevs;
+		tremove(ev);
+		ev->queued = false;
+		return;
 	}
+
+	evpp = &evs;
 	for (; (evp = *evpp); evpp = &evp->next)
 		if (evp == ev)
 			break;
@@ -97,119 +550,172 @@ void evdeq(Event *ev)
 	if (ev == nextev)
 		nextev = nextev->next;
 
-	/* mark fd to be skipped (see checks in sched()) */
-	for (int i = 0; i < pfd_cnt; i++)
-		if (pfd[i].fd == ev->fd)
-			pfd[i].fd = -pfd[i].fd;
+	/* it is not dispatched even if it was reported ready (see sched()) */
+	ev->ready = false;
+	if (ev->type == EV_READ || ev->type == EV_WRITE) {
+		nfdevs--;
+#ifdef SCHED_KQUEUE
+		if (ev->regfd >= 0)
+			evfd_unlink(ev);
+#endif
+	}
+}
+
+static unsigned long long usecs(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+void SchedStatsReset(void)
+{
+	schedstats.wakeups = 0;
+	schedstats.waittime = schedstats.worktime = 0;
+	schedstats.nhandlers = 0;
+	lastwake = usecs();
 }
 
-static Event *calctimo(void)
+static void statsaccount(void (*handler) (Event *, void *), const char *name, unsigned long long t)
 {
-	Event *ev, *min;
-	long mins;
+	SchedHandlerStats *hs;
+	int i;
 
-	if ((min = tevs) == NULL)
-		return NULL;
-	mins = min->timeout;
-	for (ev = tevs->next; ev; ev = ev->next) {
-		if (mins > ev->timeout) {
-			min = ev;
-			mins = ev->timeout;
+	for (i = 0; i < schedstats.nhandlers; i++)
+		if (schedstats.handlers[i].handler == handler)
+			break;
+	if (i == schedstats.nhandlers) {
+		if (i == handlers_cnt) {
+			int n = handlers_cnt ? handlers_cnt * 2 : 32;
+			hs = realloc(schedstats.handlers, n * sizeof(SchedHandlerStats));
+			if (hs == NULL)
+				return;
+			schedstats.handlers = hs;
+			handlers_cnt = n;
 		}
+		hs = &schedstats.handlers[schedstats.nhandlers++];
+		memset(hs, 0, sizeof(SchedHandlerStats));
+		hs->handler = handler;
+		hs->name = name;
+	}
+	hs = &schedstats.handlers[i];
+	hs->calls++;
+	hs->time += t;
+	if (t > hs->maxtime)
+		hs->maxtime = t;
+}
+
+static void evrun(Event *ev)
+{
+	void (*handler) (Event *, void *);
+	const char *name;
+	unsigned long long t;
+
+	if (!schedstats.enabled) {
+		ev->handler(ev, ev->data);
+		return;
 	}
-	return min;
+	/* the handler may free the event */
+	handler = ev->handler;
+	name = ev->name;
+	t = usecs();
+	handler(ev, ev->data);
+	statsaccount(handler, name, usecs() - t);
 }
 
 void sched(void)
 {
 	Event *ev;
-	Event *timeoutev = NULL;
-	int timeout = 0;
-	int i, n;
+	int timeout;
+	int n;
+
+#ifdef SCHED_KQUEUE
+	/* created here rather than on the first evenq(), so that it belongs
+	 * to the server and not to the process that forked it */
+	kq_open();
+#endif
 
+	clockcached = true;
 	for (;;) {
-		if (calctimeout)
-			timeoutev = calctimo();
-		if (timeoutev) {
-			struct timeval now;
-			gettimeofday(&now, NULL);
-			/* tp - timeout */
-			timeout = timeoutev->timeout - (now.tv_sec * 1000 + now.tv_usec / 1000);
+		/* with no timer queued there is nothing to wake up for; signal
+		 * handlers interrupt the wait through their own pipe */
+		timeout = -1;
+		if (ntevs) {
+			sampleclock();	/* the handlers took some time */
+			timeout = tdiff(tevs[0]->latest, mononow);
 			if (timeout < 0)
 				timeout = 0;
 		}
 
-		memset(pfd, 0, sizeof(struct pollfd) * pfd_cnt);
-		i = 0;
-		for (ev = evs; ev; ev = ev->next) {
-			if (ev->condpos && *ev->condpos <= (ev->condneg ? *ev->condneg : 0))
-				goto skip;
-			if (ev->type == EV_READ) {
-				pfd[i].fd = ev->fd;
-				pfd[i].events = POLLIN;
-			} else if (ev->type == EV_WRITE) {
-				pfd[i].fd = ev->fd;
-				pfd[i].events = POLLOUT;
-			}
-skip:
-			if (ev->type == EV_READ || ev->type == EV_WRITE)
-				i++;
+		if (schedstats.enabled) {
+			unsigned long long t = usecs();
+
+			schedstats.worktime += t - lastwake;
+			lastwake = t;
 		}
+		TRACE1(sched__wait__entry, timeout);
+#ifdef SCHED_KQUEUE
+		if (kq >= 0)
+			n = kq_wait(timeout);
+		else
+#endif
+			n = poll_wait(timeout);
+		TRACE1(sched__wait__return, n);
+		schedround++;
+		sampleclock();
+		if (schedstats.enabled) {
+			unsigned long long t = usecs();
 
-		n = poll(pfd, i, timeoutev ? timeout : 1000);
+			schedstats.wakeups++;
+			schedstats.waittime += t - lastwake;
+			lastwake = t;
+		}
 		if (n < 0) {
 			if (errno != EINTR) {
 				Panic(errno, "poll");
 			}
 			n = 0;
-		} else if (n == 0) {	/* timeout */
-			if (timeoutev) {
-				evdeq(timeoutev);
-				timeoutev->handler(timeoutev, timeoutev->data);
-			}
+		} else if (n == 0 && ntevs) {	/* timeout */
+			/* serve every timer that is due, so that timers set for
+			 * the same moment (the status lines of all displays), or
+			 * within each other's slack, share a single wakeup */
+			do {
+				ev = tevs[0];
+				evdeq(ev);
+				evrun(ev);
+			} while (ntevs && tdiff(tevs[0]->timeout, mononow) <= 0);
 		}
 
-		i = 0;
-
 		for (ev = evs; ev; ev = nextev) {
 			nextev = ev->next;
-			switch (ev->type) {
-			case EV_READ:
-			case EV_WRITE:
-				/* check if we parsed all events from poll()
-				 * if we did just continue, as we may still
-				 * need to run EV_ALWAYS event */
-				if (n == 0)
+			/* fd events run if the wait reported them and nothing
+			 * has dequeued them since (evdeq() clears the flag) */
+			if (ev->type == EV_READ || ev->type == EV_WRITE) {
+				if (!ev->ready)
 					continue;
-				/* check if we have anything to do for EV_READ
-				 * or EV_WRITE, or if event is still queued,
-				 * if not skip to the next event */
-				if (!pfd[i].revents || pfd[i].fd < 0) {
-					i++;
-					continue;
-				}
-				/* this is one of events from poll(), decrease
-				 * counter */
-				n--;
-				/* advance pollfd pointer */
-				i++;
-				__attribute__ ((fallthrough));
-			default:
-				if (ev->condpos && *ev->condpos <= (ev->condneg ? *ev->condneg : 0))
-					continue;
-				ev->handler(ev, ev->data);
+				ev->ready = false;
 			}
+			if (evgated(ev))
+				continue;
+			evrun(ev);
 		}
 	}
 }
 
 void SetTimeout(Event *ev, int timo)
 {
-	struct timeval now;
-	gettimeofday(&now, NULL);
-
-	ev->timeout = (now.tv_sec * 1000 + now.tv_usec / 1000) + timo;
+	ev->timeout = SchedNow() + timo;
 
-	if (ev->queued)
-		calctimeout = 1;
+	if (ev->queued && ev->type == EV_TIMEOUT) {
+		tslack(ev);
+		tsift(ev->heapidx);
+	}
 }
@@ -52,11 +52,44 @@ struct Event {
 	bool queued;		/* in evs queue */
 	int *condpos;		/* only active if condpos - condneg > 0 */
 	int *condneg;
+	const char *name;	/* handler name, for schedstats */
+	/* private to sched.c */
+	bool ready;		/* reported by the last wait */
+	bool armed;		/* registered with the kernel queue */
+	int regfd;		/* fd it was queued with */
+	Event *fdnext;		/* next event queued for regfd */
+	int latest;		/* timeout plus slack */
+	int heapidx;		/* position in the timer heap */
+	unsigned int tseq;	/* timer queue order */
 };
 
+/* optional cost accounting, see the schedstats command */
+typedef struct {
+	void (*handler) (Event *, void *);
+	const char *name;
+	unsigned long calls;
+	unsigned long long time;	/* total run time in microseconds */
+	unsigned long maxtime;		/* longest run in microseconds */
+} SchedHandlerStats;
+
+typedef struct {
+	bool enabled;
+	unsigned long wakeups;
+	unsigned long long waittime;	/* microseconds spent waiting */
+	unsigned long long worktime;	/* microseconds spent between waits */
+	SchedHandlerStats *handlers;
+	int nhandlers;
+} SchedStats;
+
+extern SchedStats schedstats;
+extern unsigned int schedround;	/* ImmorTerm: waits so far, see winread_share() */
+
 void evenq (Event *);
 void evdeq (Event *);
 void SetTimeout (Event *, int);
+int  SchedNow (void);
+void SchedWalltime (struct timeval *);
+void SchedStatsReset (void);
 void sched (void) __attribute__((__noreturn__));
 
 #endif /* SCREEN_SCHED_H */
@@ -52,7 +52,7 @@
 #include <langinfo.h>
 #endif
 
-#include "logfile.h"		/* islogfile, logfflush, logfopen/logfclose */
+#include "logfile.h"		/* islogfile, logfflush, logfopen/logfclose, logfdrain */
 #include "fileio.h"
 #include "list_generic.h"
 #include "mark.h"
@@ -76,11 +76,14 @@ static struct passwd *getpwbyname(char *, struct passwd *);
 static void   SigChldHandler(void);
 static void   SigChld(int);
 static void   SigInt(int);
+static void   InitSigWake(void);
+static void   SigWake(void);
 static void   CoreDump(int);
 static void   FinitHandler(int);
 static void   DoWait(void);
 static void   serv_read_fn(Event *, void *);
 static void   serv_select_fn(Event *, void *);
+static void   serv_sigwake_fn(Event *, void *);
 static void   logflush_fn(Event *, void *);
 static int    IsSymbol(char *, char *);
 static char  *ParseChar(char *, char *);
@@ -111,6 +114,8 @@ int       ServerSocket = -1;
 Event     serv_read;
 Event     serv_select;
 Event     logflushev;
+Event     serv_sigwake;
+static int sigwakefd = -1;	/* write end of the signal wakeup pipe */
 
 char    **NewEnv = NULL;
 char     *RcFileName = NULL;
@@ -132,7 +137,7 @@ char     *captionstring;
 char     *wliststr;
 char     *wlisttit;
 bool      auto_detach = true;
-bool      scrollback_dump = false; /* ImmorTerm: dump scrollback on reattach (default: off, incomplete feature) */
+bool      scrollback_dump = false; /* ImmorTerm: replay scrollback on reattach */
 bool      adaptflag;
 bool      iflag;
 bool      lsflag;
@@ -142,6 +147,7 @@ bool      xflag;
 int       rflag;
 int       dflag;
 int       queryflag = -1;
+int       cmderrors;	/* ImmorTerm: errors commands reported, see CommandError() */
 bool      hastruecolor = false;
 
 char     *multi;
@@ -183,11 +189,13 @@ int       af;
 #include "attacher.h"
 #include "encoding.h"
 #include "help.h"
+#include "histstore.h"
 #include "misc.h"
 #include "process.h"
 #include "socket.h"
 #include "termcap.h"
 #include "tty.h"
+#include "trace.h"
 
 char strnomem[] = "Out of memory.";
 
@@ -252,6 +260,64 @@ static char *locale_name(void)
 	return s;
 }
 
+/*
+ * ImmorTerm: with IMMORTERM_STARTUP_TRACE set to a file, the processes of
+ * screen append a line to it at the end of each phase of their startup,
+ * the first time it ends: when it was, how long after main() and after
+ * the phase before. The server inherits the time of main() from the
+ * process that forked it; a later attacher has its own.
+ */
+static char *startup_trace;
+static struct timeval startup_main, startup_last;
+static unsigned int startup_done;
+
+static const char *startup_phases[] = {
+	[STARTUP_FIND_SOCKET] = "find-socket",
+	[STARTUP_FORK] = "fork",
+	[STARTUP_SERVER_SOCKET] = "server-socket",
+	[STARTUP_RC] = "rc",
+	[STARTUP_TERMCAP] = "termcap",
+	[STARTUP_FINISH_RC] = "finish-rc",
+	[STARTUP_FORK_WINDOW] = "fork-window",
+	[STARTUP_WINDOW] = "window",
+	[STARTUP_OUTPUT] = "output",
+	[STARTUP_FLUSH] = "flush",
+	[STARTUP_ATTACH] = "attach",
+};
+
+static double ms_between(struct timeval *a, struct timeval *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1000.0 + (b->tv_usec - a->tv_usec) / 1000.0;
+}
+
+void StartupTrace(enum startup_phase phase)
+{
+	struct timeval now;
+	char buf[160], tbuf[32];
+	struct tm *tm;
+	time_t t;
+	int fd, n;
+
+	TRACE1(startup, phase);
+	if (!startup_trace || (startup_done & (1u << phase)))
+		return;
+	startup_done |= 1u << phase;
+	gettimeofday(&now, NULL);
+	t = now.tv_sec;
+	tm = localtime(&t);
+	strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", tm);
+	n = snprintf(buf, sizeof(buf), "[%s.%03d] startup %d %s +%.1fms (%.1fms)\n", tbuf, (int)(now.tv_usec / 1000),
+		     (int)getpid(), startup_phases[phase], ms_between(&startup_main, &now),
+		     ms_between(&startup_last, &now));
+	startup_last = now;
+	/* one write, so that the lines of the processes do not mix */
+	if ((fd = secopen(startup_trace, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600)) < 0)
+		return;
+	if (write(fd, buf, n) < 0)
+		startup_trace = NULL;
+	close(fd);
+}
+
 static void exit_with_usage(char *myname, char *message, char *arg)
 {
 	printf("Use: %s [-opts] [cmd [args]]\n", myname);
@@ -295,6 +361,8 @@ static void exit_with_usage(char *myname, char *message, char *arg)
 	printf("-wipe [match] Do nothing, just clean up SocketDir [on possible matches].\n");
 	printf("-x            Attach to a not detached screen. (Multi display mode).\n");
 	printf("-X            Execute <cmd> as a screen command in the specified session.\n");
+	printf("-X -, -Q -    Execute the commands on stdin, one per line, in one go.\n");
+	printf("-Q events     Print window, title, bell and attach events as they happen.\n");
 	if (message && *message) {
 		printf("\nError: ");
 		printf(message, arg);
@@ -327,6 +395,10 @@ int main(int argc, char **argv)
 	 *  (otherwise, we might have problems with the select() call)
 	 */
 	closeallfiles(0);
+	gettimeofday(&startup_main, NULL);
+	startup_last = startup_main;
+	if ((ap = getenv("IMMORTERM_STARTUP_TRACE")) != NULL && *ap)
+		startup_trace = SaveStr(ap);
 	snprintf(version, 59, "1.0.0", VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION);
 	nversion = VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION;
 
@@ -383,6 +455,8 @@ int main(int argc, char **argv)
 	while (argc > 0) {
 		ap = *++argv;
 		if (--argc > 0 && *ap == '-') {
+			if (ap[1] == 0 && cmdflag)
+				break;	/* ImmorTerm: -X - and -Q - read the commands from stdin */
 			if (ap[1] == '-' && ap[2] == 0) {
 				argv++;
 				argc--;
@@ -985,6 +1059,7 @@ int main(int argc, char **argv)
 		Panic(errno, "fork");
 		/* NOTREACHED */
 	case 0:
+		StartupTrace(STARTUP_FORK);
 		break;
 	default:
 		if (detached)
@@ -1066,10 +1141,13 @@ int main(int argc, char **argv)
 	snprintf(SocketPath + strlen(SocketPath), sizeof(SocketPath) - strlen(SocketPath), "/%s", socknamebuf);
 
 	ServerSocket = MakeServerSocket();
+	StartupTrace(STARTUP_SERVER_SOCKET);
+	RegistryUpdate();
 #ifdef SYSTEM_SCREENRC
 	(void)StartRc(SYSTEM_SCREENRC, 0);
 #endif
 	(void)StartRc(RcFileName, 0);
+	StartupTrace(STARTUP_RC);
 #ifdef ENABLE_UTMP
 	InitUtmp();
 #endif				/* ENABLE_UTMP */
@@ -1088,6 +1166,7 @@ int main(int argc, char **argv)
 #endif
 	} else
 		MakeTermcap(1);
+	StartupTrace(STARTUP_TERMCAP);
 	InitKeytab();
 	MakeNewEnv();
 	xsignal(SIGHUP, SigHup);
@@ -1106,11 +1185,13 @@ int main(int argc, char **argv)
 			Msg(errno, "Warning: NBLOCK fcntl failed");
 	} else
 		brktty(-1);	/* just try */
+	InitSigWake();
 	xsignal(SIGCHLD, SigChld);
 #ifdef SYSTEM_SCREENRC
 	FinishRc(SYSTEM_SCREENRC);
 #endif
 	FinishRc(RcFileName);
+	StartupTrace(STARTUP_FINISH_RC);
 
 	if (mru_window == NULL) {
 		if (MakeWindow(&nwin) == -1) {
@@ -1128,6 +1209,7 @@ int main(int argc, char **argv)
 	} else if (argc) {	/* Screen was invoked with a command */
 		MakeWindow(&nwin);
 	}
+	StartupTrace(STARTUP_WINDOW);
 
 	if (display && default_startup)
 		display_license();
@@ -1140,21 +1222,73 @@ int main(int argc, char **argv)
 	serv_read.type = EV_READ;
 	serv_read.fd = ServerSocket;
 	serv_read.handler = serv_read_fn;
+	serv_read.name = "serv_read_fn";
 	evenq(&serv_read);
 
+	if (serv_sigwake.fd >= 0)
+		evenq(&serv_sigwake);
+
 	serv_select.priority = -10;
 	serv_select.type = EV_ALWAYS;
 	serv_select.handler = serv_select_fn;
+	serv_select.name = "serv_select_fn";
 	evenq(&serv_select);
 
 	logflushev.type = EV_TIMEOUT;
 	logflushev.handler = logflush_fn;
+	logflushev.name = "logflush_fn";
 
 	sched();
 	/* NOTREACHED */
 	return 0;
 }
 
+/*
+ * The scheduler sleeps until there is I/O or a timer is due, so a signal
+ * arriving just before poll() would only be noticed at the next event.
+ * Handlers write a byte to this pipe to end the sleep instead; the flags
+ * they set are acted upon by serv_select_fn().
+ */
+static void InitSigWake(void)
+{
+	int pi[2];
+
+	serv_sigwake.fd = -1;
+	serv_sigwake.type = EV_READ;
+	serv_sigwake.handler = serv_sigwake_fn;
+	serv_sigwake.name = "serv_sigwake_fn";
+	if (pipe(pi))
+		return;
+	for (int i = 0; i < 2; i++) {
+		fcntl(pi[i], F_SETFD, FD_CLOEXEC);
+		fcntl(pi[i], F_SETFL, O_NONBLOCK);
+	}
+	serv_sigwake.fd = pi[0];
+	sigwakefd = pi[1];
+}
+
+static void SigWake(void)
+{
+	int err = errno;
+
+	if (sigwakefd >= 0) {
+		/* if the pipe is full a wakeup is pending anyway */
+		ssize_t r = write(sigwakefd, "", 1);
+		(void)r;
+	}
+	errno = err;
+}
+
+static void serv_sigwake_fn(Event *event, void *data)
+{
+	char buf[64];
+
+	(void)data; /* unused */
+
+	while (read(event->fd, buf, sizeof(buf)) > 0)
+		;
+}
+
 static void SigChldHandler(void)
 {
 	struct stat st;
@@ -1173,6 +1307,7 @@ static void SigChld(int sigsig)
 {
 	(void)sigsig; /* unused */
 	GotSigChld = 1;
+	SigWake();
 }
 
 void SigHup(int sigsig)
@@ -1195,6 +1330,7 @@ static void SigInt(int sigsig)
 	xsignal(SIGINT, SigInt);
 
 	InterruptPlease = 1;
+	SigWake();
 }
 
 static void CoreDump(int sigsig)
@@ -1297,7 +1433,10 @@ void Finit(int i)
 		mru_window = mru_window->w_prev_mru;
 		FreeWindow(p);
 	}
+	logfdrain();
+	HostedRemoveAll();
 	if (ServerSocket != -1) {
+		RegistryRemove();
 		xseteuid(real_uid);
 		xsetegid(real_gid);
 		(void)unlink(SocketPath);
@@ -1327,7 +1466,10 @@ void Finit(int i)
 
 void eexit(int e)
 {
+	logfdrain();
+	HostedRemoveAll();
 	if (ServerSocket != -1) {
+		RegistryRemove();
 		if (setgid(real_gid))
 			AddStr("Failed to set gid\r\n");
 		if (setuid(real_uid))
@@ -1371,12 +1513,19 @@ void Detach(int mode)
 	pid_t pid;
 	Canvas *cv;
 	Window *p;
+	Hosted *h;
 
 	if (display == NULL)
 		return;
 
 #define AddStrSocket(msg) do { \
-    if (SocketName) \
+    if (D_hosted) \
+      { \
+	AddStr("[" msg " from "); \
+	AddStr(D_hosted->h_name); \
+	AddStr("]\r\n"); \
+      } \
+    else if (SocketName) \
       { \
 	AddStr("[" msg " from "); \
 	AddStr(SocketName); \
@@ -1467,8 +1616,11 @@ void Detach(int mode)
 	}
 
 	pid = D_userpid;
+	h = D_hosted;
 	FreeDisplay();
-	if (displays == NULL)
+	if (h)
+		HostedChsock(h);
+	else if (displays == NULL || hosteds)
 		/* Flag detached-ness */
 		(void)chsock();
 	/*
@@ -1508,7 +1660,7 @@ void MakeNewEnv(void)
 
 	for (op = environ; *op; ++op) {
 		if (!IsSymbol(*op, "TERM") && !IsSymbol(*op, "TERMCAP")
-		    && !IsSymbol(*op, "STY") && !IsSymbol(*op, "WINDOW")
+		    && !IsSymbol(*op, "STY") && !IsSymbol(*op, "WINDOW") && !IsSymbol(*op, "IMMORTERM_STARTUP_TRACE")
 		    && !IsSymbol(*op, "SCREENCAP") && !IsSymbol(*op, "SHELL")
 		    && !IsSymbol(*op, "LINES") && !IsSymbol(*op, "COLUMNS")
 		    )
@@ -1533,10 +1685,24 @@ void MakeNewEnv(void)
       }	\
   } while (0)
 
+/*
+ * ImmorTerm: counts msg in cmderrors if it reports an error: one with
+ * errno err, or one that names the source of the command (rc_name, "-X"
+ * for a remote command), the way the errors of commands start.
+ */
+static void CommandError(int err, const char *msg)
+{
+	size_t l;
+
+	if (err || (rc_name && (l = strlen(rc_name)) && !strncmp(msg, rc_name, l) && msg[l] == ':'))
+		cmderrors++;
+}
+
 void Msg(int err, const char *fmt, ...)
 {
 	char buf[MAXPATHLEN * 2];
 	PROCESS_MESSAGE(buf);
+	CommandError(err, buf);
 
 	if (display && displays)
 		MakeStatus(buf);
@@ -1556,7 +1722,7 @@ void Msg(int err, const char *fmt, ...)
 		printf("%s\r\n", buf);
 
 	if (queryflag >= 0)
-		write(queryflag, buf, strlen(buf));
+		QueryWrite(buf, strlen(buf));
 }
 
 /*
@@ -1608,7 +1774,62 @@ void QueryMsg(int err, const char *fmt, ...)
 		return;
 
 	PROCESS_MESSAGE(buf);
-	write(queryflag, buf, strlen(buf));
+	CommandError(err, buf);
+	QueryWrite(buf, strlen(buf));
+}
+
+/*
+ * ImmorTerm: the client of a query only reads the answer once it is told
+ * that the query is done. With queryhold set, what a query prints is
+ * kept here until QueryFlush() sends it after telling the client, so that
+ * a long answer cannot fill the socket and hang us.
+ */
+#define QUERYMAX	(64 * 1024 * 1024)
+
+bool queryhold;
+static char *querybuf;
+static size_t querylen, querysize;
+
+void QueryWrite(const char *buf, size_t len)
+{
+	if (!queryhold) {
+		(void)write(queryflag, buf, len);
+		return;
+	}
+	if (querylen + len > querysize) {
+		size_t size = querysize ? querysize : 4096;
+		char *nbuf;
+
+		while (size < querylen + len)
+			size *= 2;
+		if (size > QUERYMAX || (nbuf = realloc(querybuf, size)) == NULL)
+			return;
+		querybuf = nbuf;
+		querysize = size;
+	}
+	memcpy(querybuf + querylen, buf, len);
+	querylen += len;
+}
+
+/* Sends what QueryWrite() held back to fd, or drops it if fd is -1. */
+void QueryFlush(int fd)
+{
+	void (*oldpipe)(int) = xsignal(SIGPIPE, SIG_IGN);
+	size_t off = 0;
+	ssize_t n;
+
+	while (fd >= 0 && off < querylen) {
+		if ((n = write(fd, querybuf + off, querylen - off)) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		off += n;
+	}
+	xsignal(SIGPIPE, oldpipe);
+	free(querybuf);
+	querybuf = NULL;
+	querylen = querysize = 0;
 }
 
 void Dummy(int err, const char *fmt, ...)
@@ -1693,7 +1914,7 @@ static void serv_read_fn(Event *event, void *data)
 	(void)event; /* unused */
 	(void)data; /* unused */
 
-	ReceiveMsg();
+	ReceiveMsg(NULL);
 }
 
 static void serv_select_fn(Event *event, void *data)
@@ -1858,6 +2079,12 @@ static void logflush_fn(Event *event, void *data)
 	if (!islogfile(NULL))
 		return;		/* no more logfiles */
 	logfflush(NULL);
+	/* ImmorTerm: the history stores, with lines of blocks not yet full */
+	for (p = mru_window; p; p = p->w_prev_mru)
+		if (p->w_hstore) {
+			HistStoreFlush(p, false);
+			HistStoreSync(p->w_hstore);
+		}
 	n = log_flush ? log_flush : (logtstamp_after + 4) / 5;
 	if (n) {
 		SetTimeout(event, n * 1000);
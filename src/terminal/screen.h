@@ -95,6 +95,11 @@ struct mode {
 #define MSG_HANGUP	7
 #define MSG_COMMAND	8
 #define MSG_QUERY       9
+#define MSG_COMMANDS	10	/* ImmorTerm: the commands follow, see DoCommandsMsg() */
+#define MSG_EVENTS	11	/* ImmorTerm: events go back until closed, see events.h */
+
+/* ImmorTerm: most bytes of commands a MSG_COMMANDS can carry */
+#define MSG_COMMANDSMAX	(1024 * 1024)
 
 /*
  * versions of struct Message:
@@ -105,10 +110,21 @@ struct mode {
  * 2:	screen version 4.1.0devel	(revisions 8b46d8a upto YYYYYYY)
  * 3:	screen version 4.2.0		(was incorrectly originally. Patched here)
  * 4:	screen version 4.2.1		(bumped once again due to changed terminal and login length)
+ * 5:	ImmorTerm			(the compact format below, on the wire only)
  */
 #define MSG_VERSION	4
 
 #define MSG_REVISION	(('m'<<24) | ('s'<<16) | ('g'<<8) | MSG_VERSION)
+
+/*
+ * ImmorTerm: in the compact format a message is its revision and type as
+ * in struct Message, a uint32_t count of bytes, then for each member that
+ * is not all zeros a uint8_t id, a uint16_t length and its bytes up to the
+ * last one that is not zero (see MsgEncode()). A session reads both; the
+ * registry says which a session reads, so that old ones get the old one.
+ */
+#define MSG_COMPACT_VERSION	5
+#define MSG_COMPACT_REVISION	(('m'<<24) | ('s'<<16) | ('g'<<8) | MSG_COMPACT_VERSION)
 typedef struct Message Message;
 struct Message {
 	int protocol_revision;	/* reduce harm done by incompatible messages */
@@ -217,6 +233,23 @@ struct baud_values {
 #define WLIST_MRU 1
 #define WLIST_NESTED 2
 
+/*
+ * ImmorTerm: phases of startup, see StartupTrace()
+ */
+enum startup_phase {
+	STARTUP_FIND_SOCKET,	/* the attacher found the session */
+	STARTUP_FORK,		/* the server was forked */
+	STARTUP_SERVER_SOCKET,	/* MakeServerSocket() */
+	STARTUP_RC,		/* StartRc() */
+	STARTUP_TERMCAP,	/* InitTermcap() and InitTerm() */
+	STARTUP_FINISH_RC,	/* FinishRc() */
+	STARTUP_FORK_WINDOW,	/* ForkWindow() of the first window */
+	STARTUP_WINDOW,		/* MakeWindow() of the first window */
+	STARTUP_OUTPUT,		/* first output of a window */
+	STARTUP_FLUSH,		/* first write to a display */
+	STARTUP_ATTACH		/* first attach done */
+};
+
 void  SigHup (int);
 void  eexit (int) __attribute__((__noreturn__));
 void  Detach (int);
@@ -225,11 +258,14 @@ void  Kill (pid_t, int);
 void  Msg (int, const char *, ...) __attribute__((format(printf, 2, 3)));
 void  Panic (int, const char *, ...) __attribute__((format(printf, 2, 3))) __attribute__((__noreturn__));
 void  QueryMsg (int, const char *, ...) __attribute__((format(printf, 2, 3)));
+void  QueryWrite (const char *, size_t);
+void  QueryFlush (int);
 void  Dummy (int, const char *, ...) __attribute__((format(printf, 2, 3)));
 void  Finit (int) __attribute__((__noreturn__));
 void  MakeNewEnv (void);
 void  PutWinMsg (char *, int, int);
-void  setbacktick (int, int, int, char **);
+void  setbacktick (int, int, int, char **, bool);
+void  StartupTrace (enum startup_phase);
 
 /* global variables */
 
@@ -291,6 +327,8 @@ extern int multiattach;
 extern int nversion;
 extern uid_t own_uid;
 extern int queryflag;
+extern int cmderrors;
+extern bool queryhold;
 extern int rflag;
 extern pid_t MasterPid;
 extern int MsgMinWait;
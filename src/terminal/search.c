@@ -30,16 +30,426 @@
 
 #include "search.h"
 
+#include <regex.h>
 #include <stdint.h>
 #include <sys/types.h>
-
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "ansi.h"
+#include "encoding.h"
 #include "mark.h"
 #include "misc.h"
 #include "input.h"
+#include "resize.h"
 
 #define INPUTLINE (flayer->l_height - 1)
 
 bool search_ic;
+bool search_re;		/* ImmorTerm: / and ? take regular expressions */
+
+/********************************************************************
+ *  ImmorTerm: search index
+ *
+ *  A window with searchindex on keeps, next to each line of its history
+ *  ring, a 256 bit signature with one bit set for every three cells in a
+ *  row, and the first and last two cells. A match starting on line y lies
+ *  within y and y + 1 if it is no longer than a line, so all three in a
+ *  row of the pattern must be in the signatures of the two lines or in
+ *  the few that cross from y into y + 1. Lines that fail this are not
+ *  looked at. Cells are taken the way the searches compare them: the low
+ *  byte, ASCII letters folded to lower case.
+ *
+ *  The index is built on the first search and kept up to date by
+ *  HistStore(); anything that shuffles the ring drops it, and the next
+ *  search builds it again.
+ */
+
+struct siline {
+	uint64_t sig[4];
+	unsigned char edge[4];	/* first two and last two cells */
+};
+
+struct searchindex {
+	int height;
+	int width;
+	struct siline *lines;	/* by slot of w_hlines */
+};
+
+struct sipattern {
+	Window *win;
+	uint64_t sig[4];
+};
+
+static inline unsigned char sifold(uint32_t c)
+{
+	c &= 0xff;
+	if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')
+		c |= 0x20;
+	return c;
+}
+
+static inline int sibit(unsigned char a, unsigned char b, unsigned char c)
+{
+	return (((uint32_t)a << 16 | (uint32_t)b << 8 | c) * 0x9e3779b1u) >> 24;
+}
+
+#define SISET(sig, bit)	((sig)[(bit) >> 6] |= (uint64_t)1 << ((bit) & 63))
+
+static void siline(struct siline *sl, struct mline *ml, int width)
+{
+	unsigned char a, b, c;
+	int x;
+
+	memset(sl->sig, 0, sizeof(sl->sig));
+	a = sifold(ml->image[0]);
+	b = sifold(ml->image[1]);
+	for (x = 2; x < width; x++) {
+		c = sifold(ml->image[x]);
+		SISET(sl->sig, sibit(a, b, c));
+		a = b;
+		b = c;
+	}
+	sl->edge[0] = sifold(ml->image[0]);
+	sl->edge[1] = sifold(ml->image[1]);
+	sl->edge[2] = a;
+	sl->edge[3] = b;
+}
+
+static struct searchindex *SearchIndexBuild(Window *p)
+{
+	struct searchindex *si;
+	int i;
+
+	if (p->w_histheight == 0 || p->w_width < 3)
+		return NULL;
+	if ((si = malloc(sizeof(*si))) == NULL)
+		return NULL;
+	if ((si->lines = malloc(p->w_histheight * sizeof(struct siline))) == NULL) {
+		free(si);
+		return NULL;
+	}
+	si->height = p->w_histheight;
+	si->width = p->w_width;
+	for (i = 0; i < si->height; i++)
+		siline(&si->lines[i], HistLine(p, i), si->width);
+	p->w_sindex = si;
+	return si;
+}
+
+/* Called by HistStore() for line i of the history ring. */
+void SearchIndexLine(Window *p, int i, struct mline *ml)
+{
+	struct searchindex *si = p->w_sindex;
+
+	if (si && i < si->height)
+		siline(&si->lines[i], ml, si->width);
+}
+
+void SearchIndexDrop(Window *p)
+{
+	if (!p->w_sindex)
+		return;
+	free(p->w_sindex->lines);
+	free(p->w_sindex);
+	p->w_sindex = NULL;
+}
+
+size_t SearchIndexSize(Window *p)
+{
+	if (!p->w_sindex)
+		return 0;
+	return sizeof(struct searchindex) + p->w_sindex->height * sizeof(struct siline);
+}
+
+/*
+ * Prepares the index of p for a search of the len bytes of pattern in a
+ * layer width cells wide. Returns false if it cannot help, and every
+ * line has to be looked at.
+ */
+static bool sipattern(struct sipattern *sp, Window *p, const char *pattern, int len, int width)
+{
+	struct searchindex *si = p->w_sindex;
+	const unsigned char *s = (const unsigned char *)pattern;
+	int i;
+
+	sp->win = NULL;
+	if (!p->w_searchindex || len < 3 || len > width || width != p->w_width)
+		return false;
+	if ((si && (si->height != p->w_histheight || si->width != p->w_width)))
+		SearchIndexDrop(p);
+	if (!p->w_sindex && !SearchIndexBuild(p))
+		return false;
+	memset(sp->sig, 0, sizeof(sp->sig));
+	for (i = 0; i + 2 < len; i++)
+		SISET(sp->sig, sibit(sifold(s[i]), sifold(s[i + 1]), sifold(s[i + 2])));
+	sp->win = p;
+	return true;
+}
+
+/* Tells whether a match may start on line y of the whole image of the
+ * window, 0 being the oldest line of the history. */
+static bool simaybe(struct sipattern *sp, int y)
+{
+	Window *p = sp->win;
+	struct siline *a, *b;
+	uint64_t sig[4];
+	int i;
+
+	if (!p || y < 0 || y >= p->w_histheight - 1)
+		return true;
+	a = &p->w_sindex->lines[(p->w_histidx + y) % p->w_histheight];
+	b = &p->w_sindex->lines[(p->w_histidx + y + 1) % p->w_histheight];
+	for (i = 0; i < 4; i++)
+		sig[i] = a->sig[i] | b->sig[i];
+	SISET(sig, sibit(a->edge[2], a->edge[3], b->edge[0]));
+	SISET(sig, sibit(a->edge[3], b->edge[0], b->edge[1]));
+	for (i = 0; i < 4; i++)
+		if (sp->sig[i] & ~sig[i])
+			return false;
+	return true;
+}
+
+/*
+ * ImmorTerm: the first column in sx to ex of image whose low byte is c1
+ * or c2, or -1. This is where a match can start; the searches compare
+ * the rest cell by cell.
+ */
+static int scanfirst(const uint32_t *image, int sx, int ex, uint32_t c1, uint32_t c2)
+{
+#if defined(__SSE2__)
+	const __m128i m = _mm_set1_epi32(0xff);
+	const __m128i a = _mm_set1_epi32(c1);
+	const __m128i b = _mm_set1_epi32(c2);
+
+	for (; sx + 4 <= ex + 1; sx += 4) {
+		__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(image + sx)), m);
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(v, a), _mm_cmpeq_epi32(v, b))));
+		if (mask)
+			return sx + __builtin_ctz(mask);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	const uint32x4_t m = vdupq_n_u32(0xff);
+	const uint32x4_t a = vdupq_n_u32(c1);
+	const uint32x4_t b = vdupq_n_u32(c2);
+
+	for (; sx + 4 <= ex + 1; sx += 4) {
+		uint32x4_t v = vandq_u32(vld1q_u32(image + sx), m);
+		if (vmaxvq_u32(vorrq_u32(vceqq_u32(v, a), vceqq_u32(v, b))))
+			break;
+	}
+#endif
+	for (; sx <= ex; sx++)
+		if ((image[sx] & 0xff) == c1 || (image[sx] & 0xff) == c2)
+			return sx;
+	return -1;
+}
+
+/* the first byte of pattern, and its other case if we ignore case */
+static void firstbyte(const char *pattern, bool ic, uint32_t *c1, uint32_t *c2)
+{
+	*c1 = *c2 = *(const unsigned char *)pattern;
+	if (ic && (*c1 | 0x20) >= 'a' && (*c1 | 0x20) <= 'z')
+		*c2 = *c1 ^ 0x20;
+}
+
+/* Does a cell hold c? Like is_find() we look at the low byte only. */
+static inline bool cellis(uint32_t cell, unsigned char c, bool ic)
+{
+	unsigned char b = cell;
+
+	return b == c || (ic && !((b ^ c) & 0xdf) && (b | 0x20) >= 'a' && (b | 0x20) <= 'z');
+}
+
+/********************************************************************
+ *  ImmorTerm: regular expression search
+ *
+ *  With searchregex on, / and ? take a POSIX extended regular expression.
+ *  Lines are matched one at a time, as the text copy mode would copy out
+ *  of them, so a match does not run on into the next line.
+ */
+
+static regex_t rx;
+static char *rxtext;		/* the line as text */
+static int *rxcols;		/* the column of each byte of it */
+static size_t rxsize;
+
+/* Compiles pattern, or puts why not into err. */
+static bool rx_begin(char *pattern, bool ic, char *err, size_t size)
+{
+	int rc;
+
+	if ((rc = regcomp(&rx, pattern, REG_EXTENDED | (ic ? REG_ICASE : 0))) != 0) {
+		regerror(rc, &rx, err, size);
+		return false;
+	}
+	return true;
+}
+
+/* rx_begin() for copy mode */
+static bool rx_search(char *pattern)
+{
+	char err[256];
+
+	if (!rx_begin(pattern, search_ic, err, sizeof(err))) {
+		LMsg(0, "%s", err);
+		return false;
+	}
+	return true;
+}
+
+static void rx_end(void)
+{
+	regfree(&rx);
+}
+
+/* Makes rxtext and rxcols hold line y of p; returns the length. */
+static int rx_line(Window *p, int y)
+{
+	struct mline *ml;
+	size_t len = 0, n;
+	uint32_t c;
+	int x;
+
+	fore = p;
+	ml = WIN(y);
+	for (x = 0; x < p->w_width; x++) {
+		c = ml->image[x];
+		if (p->w_encoding == UTF8) {
+			c |= ml->font[x] << 8;
+			if (c == UCS_HIDDEN)
+				continue;
+			n = ToUtf8_comb(NULL, c);
+		} else
+			n = 1;
+		if (len + n + 1 > rxsize) {
+			size_t size = 2 * (len + n + 1);
+			char *text = realloc(rxtext, size);
+			int *cols;
+
+			if (text)
+				rxtext = text;
+			if (!text || !(cols = realloc(rxcols, size * sizeof(int))))
+				break;
+			rxcols = cols;
+			rxsize = size;
+		}
+		if (p->w_encoding == UTF8)
+			ToUtf8_comb(rxtext + len, c);
+		else
+			rxtext[len] = c ? c : ' ';
+		while (n--)
+			rxcols[len++] = x;
+	}
+	if (rxsize)
+		rxtext[len] = 0;
+	return len;
+}
+
+/*
+ * The column of the first match starting on line y of p between sx and
+ * ex, or of the last one if last is set; -1 if there is none.
+ */
+static int rx_match(Window *p, int y, int sx, int ex, bool last)
+{
+	regmatch_t m;
+	int len, off, col, found = -1;
+
+	if (sx > ex || (len = rx_line(p, y)) == 0 || !rxtext)
+		return -1;
+	for (off = 0; off < len && rxcols[off] < sx; off++)
+		;
+	while (off <= len) {
+		if (regexec(&rx, rxtext + off, 1, &m, off ? REG_NOTBOL : 0) != 0)
+			break;
+		off += m.rm_so;
+		col = off < len ? rxcols[off] : p->w_width;
+		if (col > ex)
+			break;
+		found = col;
+		if (!last)
+			break;
+		/* on to the next character */
+		while (off < len && rxcols[off] == col)
+			off++;
+		if (off == len)
+			break;
+	}
+	return found;
+}
+
+/********************************************************************
+ *  ImmorTerm: grep the whole image of a window
+ */
+
+/* The first column of line ml, width cells wide, that starts the len
+ * bytes of pattern, or -1. */
+static int linefind(struct mline *ml, int width, const char *pattern, int len, bool ic)
+{
+	const unsigned char *s = (const unsigned char *)pattern;
+	uint32_t c1, c2;
+	int x, i;
+
+	firstbyte(pattern, ic, &c1, &c2);
+	for (x = 0; (x = scanfirst(ml->image, x, width - len, c1, c2)) >= 0; x++) {
+		for (i = 1; i < len && cellis(ml->image[x + i], s[i], ic); i++)
+			;
+		if (i == len)
+			return x;
+	}
+	return -1;
+}
+
+/*
+ * Calls fn for each line of the whole image of p that holds pattern,
+ * oldest first, with its line number, the column of the first match and
+ * the text of the line, trailing blanks cut off. Lines are looked at one
+ * by one; a match does not run from one into the next. The index of p
+ * skips lines if it is on. fn returns false to stop. Returns false if
+ * re is set and pattern does not compile, with the reason in err.
+ */
+bool SearchLines(Window *p, char *pattern, bool ic, bool re, char *err, size_t errsize,
+		 bool (*fn)(Window *, int, int, char *, void *), void *data)
+{
+	Window *ofore = fore;
+	struct sipattern sp;
+	struct mline *ml;
+	int y, x, len, n;
+
+	if (re && !rx_begin(pattern, ic, err, errsize))
+		return false;
+	len = strlen(pattern);
+	HistReflow(p);
+	fore = p;
+	sipattern(&sp, p, pattern, re ? 0 : len, p->w_width);
+	y = p->w_scrollback_height < p->w_histheight ? p->w_histheight - p->w_scrollback_height : 0;
+	for (; y < p->w_histheight + p->w_height; y++) {
+		if (re)
+			x = rx_match(p, y, 0, p->w_width - 1, false);
+		else if (len && len <= p->w_width && simaybe(&sp, y)) {
+			fore = p;
+			ml = WIN(y);
+			x = linefind(ml, p->w_width, pattern, len, ic);
+		} else
+			continue;
+		if (x < 0)
+			continue;
+		if ((n = rx_line(p, y)) == 0)
+			continue;
+		while (n > 0 && rxtext[n - 1] == ' ')
+			n--;
+		rxtext[n] = 0;
+		if (!fn(p, y, x, rxtext, data))
+			break;
+	}
+	if (re)
+		rx_end();
+	fore = ofore;
+	return true;
+}
 
 /********************************************************************
  *  VI style Search
@@ -69,6 +479,7 @@ static void searchend(char *buf, size_t len, void *data)
 {
 	int x = 0, sx, ex, y;
 	struct markdata *markdata;
+	struct sipattern sp;
 	Window *p;
 
 	(void)data; /* unused */
@@ -78,12 +489,23 @@ static void searchend(char *buf, size_t len, void *data)
 	markdata->isdir = 1;
 	if (len)
 		strcpy(markdata->isstr, buf);
+	if (search_re && !rx_search(markdata->isstr))
+		return;
+	sipattern(&sp, p, markdata->isstr, strlen(markdata->isstr), flayer->l_width);
 	sx = markdata->cx + 1;
 	ex = flayer->l_width - 1;
 	for (y = markdata->cy; y < p->w_histheight + flayer->l_height; y++, sx = 0) {
-		if ((x = matchword(markdata->isstr, y, sx, ex)) >= 0)
+		if (search_re)
+			x = rx_match(p, y, sx, ex, false);
+		else if (simaybe(&sp, y))
+			x = matchword(markdata->isstr, y, sx, ex);
+		else
+			continue;
+		if (x >= 0)
 			break;
 	}
+	if (search_re)
+		rx_end();
 	if (y >= p->w_histheight + flayer->l_height) {
 		LGotoPos(flayer, markdata->cx, W2D(markdata->cy));
 		LMsg(0, "Pattern not found");
@@ -95,6 +517,7 @@ static void backsearchend(char *buf, size_t len, void *data)
 {
 	int sx, ex, x = -1, y;
 	struct markdata *markdata;
+	struct sipattern sp;
 
 	(void)data; /* unused */
 
@@ -102,14 +525,22 @@ static void backsearchend(char *buf, size_t len, void *data)
 	markdata->isdir = -1;
 	if (len)
 		strcpy(markdata->isstr, buf);
+	if (search_re && !rx_search(markdata->isstr))
+		return;
+	sipattern(&sp, markdata->md_window, markdata->isstr, strlen(markdata->isstr), flayer->l_width);
 	ex = markdata->cx - 1;
 	for (y = markdata->cy; y >= 0; y--, ex = flayer->l_width - 1) {
 		sx = 0;
-		while ((sx = matchword(markdata->isstr, y, sx, ex)) >= 0)
-			x = sx++;
+		if (search_re)
+			x = rx_match(markdata->md_window, y, sx, ex, true);
+		else if (simaybe(&sp, y))
+			while ((sx = matchword(markdata->isstr, y, sx, ex)) >= 0)
+				x = sx++;
 		if (x >= 0)
 			break;
 	}
+	if (search_re)
+		rx_end();
 	if (y < 0) {
 		LGotoPos(flayer, markdata->cx, W2D(markdata->cy));
 		LMsg(0, "Pattern not found");
@@ -128,14 +559,20 @@ static int matchword(char *pattern, int y, int sx, int ex)
 {
 	uint32_t *cp, *cpe;
 	unsigned char *pp;
+	uint32_t c1, c2;
+	struct mline *ml;
 	int cy;
 
 	fore = ((struct markdata *)flayer->l_data)->md_window;
 
-	for (; sx <= ex; sx++) {
+	if (!*pattern)
+		return -1;
+	firstbyte(pattern, search_ic, &c1, &c2);
+	ml = WIN(y);
+	for (; (sx = scanfirst(ml->image, sx, ex, c1, c2)) >= 0; sx++) {
 		cy = y;
-		cp = WIN(cy)->image + sx;
-		cpe = WIN(cy)->image + flayer->l_width;
+		cp = ml->image + sx;
+		cpe = ml->image + flayer->l_width;
 		pp = (unsigned char *)pattern;
 		for (;;) {
 			if ((char)*cp != *pp)
@@ -163,6 +600,8 @@ static int matchword(char *pattern, int y, int sx, int ex)
 				cpe = WIN(cy)->image + flayer->l_width;
 			}
 		}
+		if (cy != y)
+			ml = WIN(y);
 	}
 	return -1;
 }
@@ -178,14 +617,40 @@ static char *isprompts[] = {
 
 static int is_redo(struct markdata *);
 static void is_process(char *, size_t, void *);
-static int is_bm(char *, int, int, int, int);
+static int is_find(char *, int, int, int, int);
+
+/* Does the whole image, taken as one long line, hold the l bytes of str
+ * at position q? */
+static bool is_match(const char *str, int l, int q, int w)
+{
+	const unsigned char *s = (const unsigned char *)str;
+	int y = q / w, x = q % w;
+	struct mline *ml = WIN(y);
+	int i;
+
+	for (i = 0; i < l; i++, x++) {
+		if (x == w) {
+			ml = WIN(++y);
+			x = 0;
+		}
+		if (!cellis(ml->image[x], s[i], search_ic))
+			return false;
+	}
+	return true;
+}
 
-static int is_bm(char *str, int l, int p, int end, int dir)
+/*
+ * Finds the l bytes of str in the whole image, taken as one long line,
+ * starting at position p and going in direction dir; a match must end
+ * before end. Returns its position, or -1.
+ */
+static int is_find(char *str, int l, int p, int end, int dir)
 {
-	int tab[256];
-	int i, q;
-	unsigned char *s, c;
 	int w = flayer->l_width;
+	int y, sx, ex, last;
+	uint32_t c1, c2;
+	struct sipattern sp;
+	struct mline *ml;
 
 	/* *sigh* to make WIN work */
 	fore = ((struct markdata *)flayer->l_next->l_data)->md_window;
@@ -193,33 +658,28 @@ static int is_bm(char *str, int l, int p, int end, int dir)
 		return -1;
 	if (l == 0)
 		return p;
-	if (dir < 0)
-		str += l - 1;
-	for (i = 0; i < 256; i++)
-		tab[i] = l * dir;
-	for (i = 0; i < l - 1; i++, str += dir) {
-		q = *(unsigned char *)str;
-		tab[q] = (l - 1 - i) * dir;
-		if (search_ic && (q | 0x20) >= 'a' && ((q | 0x20) <= 'z'))
-			tab[q ^ 0x20] = (l - 1 - i) * dir;
-	}
-	if (dir > 0)
-		p += l - 1;
-	while (p >= 0 && p < end) {
-		q = p;
-		s = (unsigned char *)str;
-		for (i = 0;;) {
-			c = (WIN(q / w))->image[q % w];
-			if (i == 0)
-				p += tab[(int)(unsigned char)c];
-			if (c != *s)
-				if (!search_ic || ((c ^ *s) & 0xdf) || (c | 0x20) < 'a' || (c | 0x20) > 'z')
-					break;
-			q -= dir;
-			s -= dir;
-			if (++i == l)
-				return q + (dir > 0 ? 1 : -l);
+	firstbyte(str, search_ic, &c1, &c2);
+	sipattern(&sp, fore, str, l, w);
+	if (dir > 0) {
+		for (y = p / w, sx = p % w; y * w + sx + l <= end; y++, sx = 0) {
+			if (!simaybe(&sp, y))
+				continue;
+			ex = end - l - y * w < w - 1 ? end - l - y * w : w - 1;
+			for (ml = WIN(y); (sx = scanfirst(ml->image, sx, ex, c1, c2)) >= 0; sx++, ml = WIN(y))
+				if (is_match(str, l, y * w + sx, w))
+					return y * w + sx;
 		}
+		return -1;
+	}
+	for (y = p / w, ex = p % w; y >= 0; y--, ex = w - 1) {
+		if (!simaybe(&sp, y))
+			continue;
+		last = -1;
+		for (ml = WIN(y), sx = 0; (sx = scanfirst(ml->image, sx, ex, c1, c2)) >= 0; sx++, ml = WIN(y))
+			if (is_match(str, l, y * w + sx, w))
+				last = sx;
+		if (last >= 0)
+			return y * w + last;
 	}
 	return -1;
 }
@@ -279,7 +739,7 @@ static void is_process(char *p, size_t len, void *data)
 	}
 	if (*p && *p != '\b')
 		pos =
-		    is_bm(markdata->isstr, markdata->isstrl, pos,
+		    is_find(markdata->isstr, markdata->isstrl, pos,
 			  flayer->l_width * (markdata->md_window->w_histheight + flayer->l_height), markdata->isdir);
 	if (pos >= 0) {
 		x = pos % flayer->l_width;
@@ -319,7 +779,7 @@ static int is_redo(struct markdata *markdata)
 			markdata->isstr[markdata->isstrl++] = c;
 		if (pos >= 0) {
 			npos =
-			    is_bm(markdata->isstr, markdata->isstrl, pos,
+			    is_find(markdata->isstr, markdata->isstrl, pos,
 				  flayer->l_width * (markdata->md_window->w_histheight + flayer->l_height), dir);
 			if (npos >= 0)
 				pos = npos;
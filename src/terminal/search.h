@@ -3,11 +3,19 @@
 
 #include <stdbool.h>
 
+#include "window.h"
+
 void  Search (int);
 void  ISearch (int);
+void  SearchIndexLine (Window *, int, struct mline *);
+void  SearchIndexDrop (Window *);
+size_t SearchIndexSize (Window *);
+bool  SearchLines (Window *, char *, bool, bool, char *, size_t,
+		    bool (*)(Window *, int, int, char *, void *), void *);
 
 /* global variables */
 
 extern bool search_ic;
+extern bool search_re;
 
 #endif /* SCREEN_SEARCH_H */
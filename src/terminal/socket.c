@@ -40,9 +40,13 @@
 #endif
 #include <sys/un.h>
 #include <utime.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <signal.h>
 
@@ -73,18 +77,25 @@
 #endif
 
 #include "encoding.h"
+#include "events.h"
 #include "fileio.h"
 #include "list_generic.h"
 #include "misc.h"
 #include "process.h"
 #include "resize.h"
 #include "termcap.h"
+#include "trace.h"
 #include "tty.h"
 #include "utmp.h"
 
 static int CheckPid(pid_t);
 static void ExecCreate(Message *);
 static void DoCommandMsg(Message *);
+static void DoCommandLine(Message *, char *, size_t);
+static void DoCommandsMsg(Message *, int, char *, size_t);
+static void BatchReceive(Message *, int);
+static void BatchCancel(Hosted *);
+static Display *TtyDisplay(char *, Window **);
 static void FinishAttach(Message *);
 static void FinishDetach(Message *);
 static void AskPassword(Message *);
@@ -96,7 +107,226 @@ static void KillUnpriv(pid_t pid, int sig) {
        UserReturn(kill(pid, sig));
 }
 
-#define SOCKMODE (S_IWRITE | S_IREAD | (displays ? S_IEXEC : 0) | (multi ? 1 : 0))
+Hosted *hosteds;
+Hosted *HostedMsg;
+
+/* ImmorTerm: whether a display is on session h (NULL: this one) */
+static bool SessionAttached(Hosted *h)
+{
+	for (Display *d = displays; d; d = d->d_next)
+		if (d->d_hosted == h)
+			return true;
+	return false;
+}
+
+#define SOCKMODE (S_IWRITE | S_IREAD | (SessionAttached(NULL) ? S_IEXEC : 0) | (multi ? 1 : 0))
+
+/*
+ * ImmorTerm: the session registry. Each session keeps a line about itself
+ * in REGISTRY_FILE in the socket directory: its pid, the mode its socket
+ * has, when it started, the MSG_VERSION it reads, its host and its name.
+ * FindSocket() takes the state of a socket from there while the pid is
+ * alive, instead of a stat() and a connect() for each. Writers hold a lock
+ * on REGISTRY_LOCK and rename a new file over the old one, so readers need
+ * no lock.
+ */
+#define REGISTRY_FILE	".registry"
+#define REGISTRY_LOCK	".registry.lock"
+#define REGISTRY_MAGIC	"immorterm-registry 2\n"
+
+struct regent {
+	struct regent *next;
+	pid_t pid;
+	int mode;
+	long long created;
+	int version;
+	char *host;
+	char *name;
+};
+
+static void RegistryFree(struct regent *r)
+{
+	struct regent *next;
+
+	for (; r; r = next) {
+		next = r->next;
+		free(r->host);
+		free(r->name);
+		free(r);
+	}
+}
+
+/* reads the registry of directory dir; NULL if there is none */
+static struct regent *RegistryRead(const char *dir)
+{
+	char path[MAXPATHLEN], line[2 * MAXSTR + 1100], host[1024];
+	struct regent *list = NULL, **tail = &list, *r;
+	struct stat st;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, REGISTRY_FILE);
+	if ((f = fopen(path, "r")) == NULL)
+		return NULL;
+	if (fstat(fileno(f), &st) || st.st_uid != real_uid || (st.st_mode & 022) ||
+	    !fgets(line, sizeof(line), f) || strcmp(line, REGISTRY_MAGIC)) {
+		fclose(f);
+		return NULL;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		int pid, mode, version, n = 0;
+		long long created;
+
+		line[strcspn(line, "\n")] = 0;
+		if (sscanf(line, "%d %o %lld %d %1023s %n", &pid, &mode, &created, &version, host, &n) < 5 ||
+		    !n || !line[n] || pid < 2)
+			continue;
+		if ((r = calloc(1, sizeof(struct regent))) == NULL)
+			break;
+		r->pid = pid;
+		r->mode = mode;
+		r->created = created;
+		r->version = version;
+		r->host = SaveStr(host);
+		r->name = SaveStr(line + n);
+		*tail = r;
+		tail = &r->next;
+	}
+	fclose(f);
+	return list;
+}
+
+/* writes list as the registry of dir; the caller holds the lock */
+static void RegistryStore(const char *dir, struct regent *list)
+{
+	char path[MAXPATHLEN], tmp[MAXPATHLEN + 8];
+	FILE *f;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, REGISTRY_FILE);
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+		return;
+	if ((f = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+	fputs(REGISTRY_MAGIC, f);
+	for (; list; list = list->next)
+		fprintf(f, "%d %o %lld %d %s %s\n", (int)list->pid, list->mode, list->created, list->version,
+			list->host, list->name);
+	if (fclose(f) || rename(tmp, path))
+		unlink(tmp);
+}
+
+static int RegistryLock(const char *dir)
+{
+	char path[MAXPATHLEN];
+	struct flock fl;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, REGISTRY_LOCK);
+	if ((fd = open(path, O_RDWR | O_CREAT, 0600)) < 0)
+		return -1;
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	while (fcntl(fd, F_SETLKW, &fl) < 0)
+		if (errno != EINTR) {
+			close(fd);
+			return -1;
+		}
+	return fd;	/* closing it unlocks */
+}
+
+/*
+ * Puts session name into the registry of dir with its socket in the given
+ * mode, or takes it out if mode is -1. Drops the entries of sessions on
+ * this host whose process or socket is gone on the way.
+ */
+static void RegistryEdit(const char *dir, const char *name, int mode)
+{
+	static long long created;
+	char path[MAXPATHLEN];
+	struct regent *list, **rp, *r;
+	struct stat st;
+	int lock;
+
+	if (!created)
+		created = (long long)time(NULL);
+	xseteuid(real_uid);
+	xsetegid(real_gid);
+	if ((lock = RegistryLock(dir)) >= 0) {
+		list = RegistryRead(dir);
+		for (rp = &list; (r = *rp);) {
+			bool gone = false;
+
+			if (!strcmp(r->host, HostName)) {
+				snprintf(path, sizeof(path), "%s/%s", dir, r->name);
+				gone = (kill(r->pid, 0) && errno == ESRCH) || stat(path, &st);
+			}
+			if (*name && !strcmp(r->name, name))
+				gone = true;
+			else if (!gone) {
+				rp = &r->next;
+				continue;
+			}
+			*rp = r->next;
+			r->next = NULL;
+			RegistryFree(r);
+		}
+		if (*name && mode >= 0 && (r = calloc(1, sizeof(struct regent)))) {
+			r->pid = getpid();
+			r->mode = mode;
+			r->created = created;
+			r->version = MSG_COMPACT_VERSION;
+			r->host = SaveStr(HostName);
+			r->name = SaveStr(name);
+			*rp = r;
+		}
+		RegistryStore(dir, list);
+		RegistryFree(list);
+		close(lock);
+	}
+	xseteuid(eff_uid);
+	xsetegid(eff_gid);
+}
+
+static void RegistrySelf(int mode)
+{
+	char dir[MAXPATHLEN], *name;
+
+	strncpy(dir, SocketPath, sizeof(dir) - 1);
+	dir[sizeof(dir) - 1] = 0;
+	if ((name = strrchr(dir, '/')) == NULL)
+		return;
+	*name++ = 0;
+	RegistryEdit(dir, name, mode);
+}
+
+/* records the state of this session's socket */
+void RegistryUpdate(void)
+{
+	RegistrySelf(SOCKMODE);
+}
+
+/* takes this session out, when it ends */
+void RegistryRemove(void)
+{
+	RegistrySelf(-1);
+}
+
+/* the entry for name, if its session looks alive */
+static struct regent *RegistryFind(struct regent *list, const char *name)
+{
+	for (; list; list = list->next)
+		if (!strcmp(list->name, name)) {
+			if (strcmp(list->host, HostName) || (kill(list->pid, 0) && errno == ESRCH))
+				return NULL;
+			return list;
+		}
+	return NULL;
+}
 
 /*
  *  Socket directory manager
@@ -131,6 +361,7 @@ int FindSocket(int *fdp, int *nfoundp, int *notherp, char *match)
 	char *firstn = NULL;
 	int nfound = 0, ngood = 0, ndead = 0, nwipe = 0, npriv = 0;
 	int nperfect = 0;
+	struct regent *registry, *reg;
 	struct sent {
 		struct sent *next;
 		int mode;
@@ -191,6 +422,9 @@ int FindSocket(int *fdp, int *nfoundp, int *notherp, char *match)
 		}
 	}
 
+	/* ImmorTerm: -wipe looks at each socket itself, and prunes the registry */
+	registry = wipeflag ? NULL : RegistryRead(SocketPath);
+
 	slist = NULL;
 	slisttail = &slist;
 	while ((dp = readdir(dirp))) {
@@ -225,17 +459,21 @@ int FindSocket(int *fdp, int *nfoundp, int *notherp, char *match)
 		}
 		sprintf(SocketPath + sdirlen, "/%s", name);
 
-		errno = 0;
-		if (stat(SocketPath, &st)) {
-			continue;
-		}
+		if ((reg = RegistryFind(registry, name)) != NULL)
+			mode = reg->mode & 0777;
+		else {
+			errno = 0;
+			if (stat(SocketPath, &st)) {
+				continue;
+			}
 
 #ifdef SOCKET_DIR	/* if SOCKET_DIR is not defined, the socket is in $HOME.
 			   in that case it does not make sense to compare uids. */
-		if (st.st_uid != real_uid)
-			continue;
+			if (st.st_uid != real_uid)
+				continue;
 #endif
-		mode = (int)st.st_mode & 0777;
+			mode = (int)st.st_mode & 0777;
+		}
 		if (multi && ((mode & 0677) != 0601)) {
 			if (strcmp(multi, LoginName)) {
 				mode = -4;
@@ -250,10 +488,15 @@ int FindSocket(int *fdp, int *nfoundp, int *notherp, char *match)
 		*slisttail = sent;
 		slisttail = &sent->next;
 		nfound++;
-		sockfd = MakeClientSocket(0);
-		/* MakeClientSocket sets ids back to eff */
-		xseteuid(real_uid);
-		xsetegid(real_gid);
+		/* a registered session is only connected to if it is the one */
+		if (reg && !(fdp && (firsts == -1 || (cmatch && nperfect == 0))))
+			sockfd = -2;
+		else {
+			sockfd = MakeClientSocket(0);
+			/* MakeClientSocket sets ids back to eff */
+			xseteuid(real_uid);
+			xsetegid(real_gid);
+		}
 		if (sockfd == -1) {
 			sent->mode = -3;
 #ifndef SOCKDIR_IS_LOCAL_TO_HOST
@@ -295,7 +538,8 @@ int FindSocket(int *fdp, int *nfoundp, int *notherp, char *match)
 		if ((mode != 0700 && mode != 0600) ||
 		    (dflag && !rflag && !xflag && mode == 0600) ||
 		    (!dflag && rflag && mode == 0700 && !xflag) || (!dflag && !rflag && !xflag)) {
-			close(sockfd);
+			if (sockfd >= 0)
+				close(sockfd);
 			npriv++;	/* a good socket that was not for us */
 			continue;
 		}
@@ -307,11 +551,12 @@ int FindSocket(int *fdp, int *nfoundp, int *notherp, char *match)
 				close(firsts);
 			firsts = sockfd;
 			firstn = sent->name;
-		} else {
+		} else if (sockfd >= 0) {
 			close(sockfd);
 		}
 	}
 	(void)closedir(dirp);
+	RegistryFree(registry);
 	if (!lsflag && nperfect == 1)
 		ngood = nperfect;
 	if (nfound && (lsflag || ngood != 1) && !quietflag) {
@@ -363,6 +608,12 @@ int FindSocket(int *fdp, int *nfoundp, int *notherp, char *match)
 		else
 			Msg(0, m, ndead > 1 ? "s" : "", ndead > 1 ? "" : "es");
 	}
+	if (wipeflag) {
+		SocketPath[sdirlen] = 0;
+		RegistryEdit(SocketPath, "", -1);
+		xseteuid(real_uid);
+		xsetegid(real_gid);
+	}
 	if (firsts != -1) {
 		sprintf(SocketPath + sdirlen, "/%s", firstn);
 		*fdp = firsts;
@@ -440,6 +691,9 @@ int MakeServerSocket(void)
 	return s;
 }
 
+/* ImmorTerm: what MakeClientSocket() connected to last, see PeerCompact() */
+static char peerpath[MAXPATHLEN];
+
 int MakeClientSocket(int err)
 {
 	int s;
@@ -457,12 +711,198 @@ int MakeClientSocket(int err)
 			Msg(errno, "%s: connect", SocketPath);
 		close(s);
 		s = -1;
-	}
+	} else
+		strncpy(peerpath, a.sun_path, ARRAY_SIZE(peerpath) - 1);
 	xseteuid(eff_uid);
 	xsetegid(eff_gid);
 	return s;
 }
 
+/*
+ * ImmorTerm: the members of struct Message in the compact format, by id,
+ * for each part of its union. A struct detach is the start of a struct
+ * attach.
+ */
+struct msgfield {
+	uint16_t off;
+	uint16_t size;
+};
+
+#define MSGF(member)	{ offsetof(Message, member), sizeof(((Message *)0)->member) }
+
+_Static_assert(offsetof(Message, m.detach.dpid) == offsetof(Message, m.attach.apid),
+	       "struct detach must overlay struct attach");
+
+static const struct msgfield msgf_create[] = {
+	MSGF(m_tty), MSGF(m.create.lflag), MSGF(m.create.Lflag), MSGF(m.create.aflag),
+	MSGF(m.create.flowflag), MSGF(m.create.hheight), MSGF(m.create.nargs), MSGF(m.create.line),
+	MSGF(m.create.dir), MSGF(m.create.screenterm)
+};
+static const struct msgfield msgf_attach[] = {
+	MSGF(m_tty), MSGF(m.attach.auser), MSGF(m.attach.apid), MSGF(m.attach.adaptflag),
+	MSGF(m.attach.lines), MSGF(m.attach.columns), MSGF(m.attach.preselect), MSGF(m.attach.esc),
+	MSGF(m.attach.meta_esc), MSGF(m.attach.envterm), MSGF(m.attach.encoding),
+	MSGF(m.attach.detachfirst)
+};
+static const struct msgfield msgf_command[] = {
+	MSGF(m_tty), MSGF(m.command.auser), MSGF(m.command.nargs), MSGF(m.command.cmd),
+	MSGF(m.command.apid), MSGF(m.command.preselect), MSGF(m.command.writeback)
+};
+static const struct msgfield msgf_message[] = {
+	MSGF(m_tty), MSGF(m.message)
+};
+
+static const struct msgfield *MsgFields(int type, size_t *n)
+{
+	switch (type) {
+	case MSG_CREATE:
+		*n = ARRAY_SIZE(msgf_create);
+		return msgf_create;
+	case MSG_ERROR:
+		*n = ARRAY_SIZE(msgf_message);
+		return msgf_message;
+	case MSG_COMMAND:
+	case MSG_QUERY:
+	case MSG_COMMANDS:
+	case MSG_EVENTS:
+		*n = ARRAY_SIZE(msgf_command);
+		return msgf_command;
+	default:
+		*n = ARRAY_SIZE(msgf_attach);
+		return msgf_attach;
+	}
+}
+
+/* the longest a compact message can get */
+#define MSG_COMPACTMAX	(sizeof(Message) + 3 * ARRAY_SIZE(msgf_attach) + sizeof(uint32_t))
+
+/* Writes m in the compact format to buf, which holds MSG_COMPACTMAX bytes;
+ * returns its length. */
+static size_t MsgEncode(Message *m, char *buf)
+{
+	const struct msgfield *fields;
+	size_t n, len = 2 * sizeof(int) + sizeof(uint32_t);
+	uint32_t body;
+
+	fields = MsgFields(m->type, &n);
+	for (size_t i = 0; i < n; i++) {
+		const char *data = (const char *)m + fields[i].off;
+		uint16_t flen = fields[i].size;
+		uint8_t id = i;
+
+		while (flen && !data[flen - 1])
+			flen--;
+		if (!flen)
+			continue;
+		buf[len] = id;
+		memcpy(buf + len + 1, &flen, sizeof(flen));
+		memcpy(buf + len + 3, data, flen);
+		len += 3 + flen;
+	}
+	memcpy(buf, &(int){ MSG_COMPACT_REVISION }, sizeof(int));
+	memcpy(buf + sizeof(int), &m->type, sizeof(int));
+	body = len - 2 * sizeof(int) - sizeof(uint32_t);
+	memcpy(buf + 2 * sizeof(int), &body, sizeof(body));
+	return len;
+}
+
+/* Fills in m, all zeros but its revision and type, from the len bytes of
+ * members in buf; returns false if they do not fit. */
+static bool MsgDecode(Message *m, const char *buf, size_t len)
+{
+	const struct msgfield *fields;
+	size_t n;
+
+	fields = MsgFields(m->type, &n);
+	while (len) {
+		uint16_t flen;
+		uint8_t id;
+
+		if (len < 3)
+			return false;
+		id = buf[0];
+		memcpy(&flen, buf + 1, sizeof(flen));
+		if (id >= n || flen > fields[id].size || flen > len - 3)
+			return false;
+		memcpy((char *)m + fields[id].off, buf + 3, flen);
+		buf += 3 + flen;
+		len -= 3 + flen;
+	}
+	return true;
+}
+
+/* Whether the session MakeClientSocket() connected to reads the compact
+ * format, as its registry entry says. */
+static bool PeerCompact(void)
+{
+	char dir[MAXPATHLEN], *name;
+	struct regent *list, *r;
+	bool compact;
+
+	strncpy(dir, peerpath, ARRAY_SIZE(dir) - 1);
+	dir[ARRAY_SIZE(dir) - 1] = 0;
+	if ((name = strrchr(dir, '/')) == NULL)
+		return false;
+	*name++ = 0;
+	list = RegistryRead(dir);
+	r = RegistryFind(list, name);
+	compact = r && r->version >= MSG_COMPACT_VERSION;
+	RegistryFree(list);
+	return compact;
+}
+
+/*
+ * Sends m on s, passing fd along with it unless it is -1: in the compact
+ * format if the session reads it, else as the whole struct Message.
+ */
+int SendMessage(int s, Message *m, int fd)
+{
+	char cbuf[CMSG_SPACE(sizeof(int))], buf[MSG_COMPACTMAX];
+	struct msghdr msg;
+	struct iovec iov;
+	size_t off = 0, len;
+	char *data;
+
+	if (PeerCompact()) {
+		len = MsgEncode(m, buf);
+		data = buf;
+	} else {
+		len = sizeof(Message);
+		data = (char *)m;
+	}
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (fd != -1) {
+		struct cmsghdr *cmsg;
+
+		msg.msg_control = cbuf;
+		msg.msg_controllen = ARRAY_SIZE(cbuf);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memmove(CMSG_DATA(cmsg), &fd, sizeof(int));
+		msg.msg_controllen = cmsg->cmsg_len;
+	}
+	while (off < len) {
+		ssize_t r;
+
+		iov.iov_base = data + off;
+		iov.iov_len = len - off;
+		r = sendmsg(s, &msg, 0);
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return -1;
+		off += r;
+		/* the fd goes with the first part only */
+		msg.msg_control = NULL;
+		msg.msg_controllen = 0;
+	}
+	return 0;
+}
+
 /*
 **
 **       Message send and receive routines
@@ -516,7 +956,7 @@ void SendCreateMsg(char *sty, struct NewWindow *nwin)
 		strncpy(m.m.create.screenterm, nwin->term, MAXTERMLEN);
 	m.m.create.screenterm[MAXTERMLEN] = '\0';
 	m.protocol_revision = MSG_REVISION;
-	if (write(s, (char *)&m, sizeof(Message)) != sizeof(Message))
+	if (SendMessage(s, &m, -1))
 		Msg(errno, "write");
 end:
 	close(s);
@@ -537,7 +977,7 @@ int SendErrorMsg(char *tty, char *buf)
 	strncpy(m.m_tty, tty, ARRAY_SIZE(m.m_tty) - 1);
 	m.m_tty[ARRAY_SIZE(m.m_tty) - 1] = 0;
 	m.protocol_revision = MSG_REVISION;
-	if (write(s, (char *)&m, sizeof(Message)))
+	if (SendMessage(s, &m, -1))
 		ret = -2;
 	close(s);
 	return ret;
@@ -589,6 +1029,7 @@ static void ExecCreate(Message *mp)
 	nwin.histheight = mp->m.create.hheight;
 	if (*mp->m.create.screenterm)
 		nwin.term = mp->m.create.screenterm;
+	nwin.hosted = HostedMsg;
 	MakeWindow(&nwin);
 }
 
@@ -716,6 +1157,7 @@ static int CreateTempDisplay(Message *m, int recvfd, Window *win)
 		KillUnpriv(pid, SIG_BYE);
 		return -1;
 	}
+	D_hosted = HostedMsg;
 	if (attach) {
 		D_encoding = m->m.attach.encoding == 1 ? UTF8 : m->m.attach.encoding ? m->m.attach.encoding - 1 : 0;
 		if (D_encoding < 0 || !EncodingName(D_encoding))
@@ -735,12 +1177,63 @@ static int CreateTempDisplay(Message *m, int recvfd, Window *win)
 	return 0;
 }
 
-void ReceiveMsg(void)
+/* The display a message from tty is about: the one on it, or else the one
+ * showing the window on it, which goes into *winp. */
+static Display *TtyDisplay(char *tty, Window **winp)
+{
+	Display *d;
+
+	for (d = displays; d; d = d->d_next)
+		if (strcmp(d->d_usertty, tty) == 0)
+			return d;
+	for (Window *win = mru_window; win; win = win->w_prev_mru)
+		if (!strcmp(tty, win->w_tty)) {
+			/* XXX: hmmm, rework this? */
+			*winp = win;
+			return win->w_layer.l_cvlist ? win->w_layer.l_cvlist->c_display : NULL;
+		}
+	return NULL;
+}
+
+/* Reads up to left bytes from fd to p, with the last read() in *len;
+ * returns how many it did not get. */
+static int MsgRead(int fd, char *p, int left, int *len)
+{
+	while (left > 0) {
+		*len = read(fd, p, left);
+		if (*len < 0 && errno == EINTR)
+			continue;
+		if (*len <= 0)
+			break;
+		p += *len;
+		left -= *len;
+	}
+	return left;
+}
+
+/* Reads the rest of a compact message into m, whose revision and type are
+ * in; makes it look like it came as a whole struct Message. */
+static bool ReadCompactMsg(int fd, Message *m)
+{
+	char buf[MSG_COMPACTMAX];
+	uint32_t body;
+	int len, type = m->type;
+
+	if (MsgRead(fd, (char *)&body, sizeof(body), &len) || body > sizeof(buf) ||
+	    MsgRead(fd, buf, body, &len))
+		return false;
+	memset(m, 0, sizeof(Message));
+	m->protocol_revision = MSG_REVISION;
+	m->type = type;
+	return MsgDecode(m, buf, body);
+}
+
+static void ReceiveMsgOn(int s)
 {
 	int left, len;
 	static Message m;
 	char *p;
-	int ns = ServerSocket;
+	int ns = s;
 	Window *win = NULL;
 	int recvfd = -1;
 
@@ -755,8 +1248,9 @@ void ReceiveMsg(void)
 		return;
 	}
 
+	/* ImmorTerm: the revision and type come first in either format */
 	p = (char *)&m;
-	left = sizeof(Message);
+	left = 2 * sizeof(int);
 	memset(&msg, 0, sizeof(struct msghdr));
 	iov.iov_base = &m;
 	iov.iov_len = left;
@@ -797,16 +1291,39 @@ void ReceiveMsg(void)
 		break;
 	}
 
-	while (left > 0) {
-		len = read(ns, p, left);
-		if (len < 0 && errno == EINTR)
-			continue;
-		if (len <= 0)
-			break;
-		p += len;
-		left -= len;
-	}
+	left = MsgRead(ns, p, left, &len);
+	if (left == 0 && m.protocol_revision == MSG_COMPACT_REVISION) {
+		if (!ReadCompactMsg(ns, &m)) {
+			close(ns);
+			if (recvfd != -1)
+				close(recvfd);
+			Msg(0, "Invalid compact message (type %d).", m.type);
+			return;
+		}
+	} else if (left == 0)
+		left = MsgRead(ns, (char *)&m + 2 * sizeof(int), sizeof(Message) - 2 * sizeof(int), &len);
+	else
+		left += sizeof(Message) - 2 * sizeof(int);
 
+	/* ImmorTerm: the commands of a batch come after it, and the results
+	 * go back the same way */
+	if (left == 0 && m.type == MSG_COMMANDS && m.protocol_revision == MSG_REVISION) {
+		if (recvfd != -1)
+			close(recvfd);
+		BatchReceive(&m, ns);
+		return;
+	}
+	if (left == 0 && m.type == MSG_EVENTS && m.protocol_revision == MSG_REVISION) {
+		if (recvfd != -1)
+			close(recvfd);
+		if (*FindUserPtr(m.m.command.auser) == NULL) {
+			Msg(0, "Unknown user %s tried to read events!", m.m.command.auser);
+			close(ns);
+			return;
+		}
+		EventsSubscribe(ns);
+		return;
+	}
 	close(ns);
 
 	if (len < 0) {
@@ -832,17 +1349,7 @@ void ReceiveMsg(void)
 		recvfd = -1;
 	}
 
-	for (display = displays; display; display = display->d_next)
-		if (strcmp(D_usertty, m.m_tty) == 0)
-			break;
-	if (!display) {
-		for (win = mru_window; win; win = win->w_prev_mru)
-			if (!strcmp(m.m_tty, win->w_tty)) {
-				/* XXX: hmmm, rework this? */
-				display = win->w_layer.l_cvlist ? win->w_layer.l_cvlist->c_display : NULL;
-				break;
-			}
-	}
+	display = TtyDisplay(m.m_tty, &win);
 
 	/* Remove the status to prevent garbage on the screen */
 	if (display && D_status)
@@ -911,17 +1418,23 @@ void ReceiveMsg(void)
 			Free(oldSocketPath);
 			if (s >= 0) {
 				queryflag = s;
+				queryhold = true;
 				DoCommandMsg(&m);
-				close(s);
 			} else
 				queryflag = -1;
+			queryhold = false;
 			if (CheckPid(m.m.command.apid)) {
 				Msg(0, "Query attempt with bad pid(%d)!", m.m.command.apid);
+				QueryFlush(-1);
 			}
 			else {
 				KillUnpriv(m.m.command.apid, (queryflag >= 0) ? SIGCONT : SIG_BYE);     /* Send SIG_BYE if an error happened */
 				queryflag = -1;
+				/* ImmorTerm: the client reads once told, see QueryWrite() */
+				QueryFlush(s);
 			}
+			if (s >= 0)
+				close(s);
 		}
 		break;
 	case MSG_COMMAND:
@@ -932,6 +1445,14 @@ void ReceiveMsg(void)
 	}
 }
 
+/* Takes a message on the socket of hosted session h, or of this session */
+void ReceiveMsg(Hosted *h)
+{
+	HostedMsg = h;
+	ReceiveMsgOn(h ? h->h_fd : ServerSocket);
+	HostedMsg = NULL;
+}
+
 void ReceiveRaw(int s)
 {
 	char rd[256];
@@ -970,6 +1491,7 @@ int chsock(void)
 
 	if (euid != real_uid)
 		UserReturn(ret);
+	RegistryUpdate();
 	return ret;
 }
 
@@ -988,18 +1510,294 @@ int RecoverSocket(void)
 
 	if ((ServerSocket = MakeServerSocket()) < 0)
 		return 0;
+	RegistryUpdate();
 	evdeq(&serv_read);
 	serv_read.fd = ServerSocket;
 	evenq(&serv_read);
 	return 1;
 }
 
+/*
+ * ImmorTerm: hosted sessions. "screen -S name" in a session starts a
+ * session of that name in this process instead of a new process: it has a
+ * socket of its own, pid.name next to this one, and so looks like any
+ * other session to -ls, -r, -x, -S and the registry, but its windows share
+ * this process with those of all other sessions hosted here. A display
+ * attached through its socket (d_hosted) works with its windows
+ * (w_hosted) only, and commands sent to it act on them. It ends when its
+ * last window does; the process when the last window of all does.
+ */
+
+static void HostedRead(Event *ev, void *data)
+{
+	(void)ev; /* unused */
+
+	ReceiveMsg((Hosted *)data);
+}
+
+/* the directory of the socket of h, for the registry */
+static void HostedDir(Hosted *h, char *dir)
+{
+	size_t l = h->h_name - h->h_path - 1;
+
+	memcpy(dir, h->h_path, l);
+	dir[l] = 0;
+}
+
+static int HostedMode(Hosted *h)
+{
+	return S_IWRITE | S_IREAD | (SessionAttached(h) ? S_IEXEC : 0) | (multi ? 1 : 0);
+}
+
+/* a listening socket at path; -1 if it cannot be had, or is in use */
+static int ListenSocket(char *path)
+{
+	struct sockaddr_un a;
+	int s;
+
+	if (strlen(path) >= ARRAY_SIZE(a.sun_path))
+		return -1;
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		return -1;
+	a.sun_family = AF_UNIX;
+	strcpy(a.sun_path, path);
+	xseteuid(real_uid);
+	xsetegid(real_gid);
+	if (connect(s, (struct sockaddr *)&a, strlen(path) + 2) != -1) {
+		close(s);
+		s = -1;
+	} else {
+		close(s);
+		(void)unlink(path);
+		if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ||
+		    bind(s, (struct sockaddr *)&a, strlen(path) + 2) == -1 ||
+		    chmod(path, S_IWRITE | S_IREAD) || chown(path, real_uid, real_gid) ||
+		    listen(s, 5) == -1) {
+			if (s != -1) {
+				close(s);
+				(void)unlink(path);
+			}
+			s = -1;
+		}
+#ifdef F_SETOWN
+		else
+			fcntl(s, F_SETOWN, getpid());
+#endif
+	}
+	xseteuid(eff_uid);
+	xsetegid(eff_gid);
+	return s;
+}
+
+/* Starts hosting session name; NULL if it cannot be, after saying why. */
+Hosted *HostedOpen(char *name)
+{
+	Hosted *h;
+	size_t dl = SocketName - SocketPath;
+
+	if (!*name || strchr(name, '/') || strlen(name) > MAXSTR - 20) {
+		Msg(0, "%s: bad session name.", name);
+		return NULL;
+	}
+	if (ServerSocket == -1 || !SocketName) {
+		Msg(0, "No socket to host sessions next to.");
+		return NULL;
+	}
+	if ((h = calloc(1, sizeof(Hosted))) == NULL) {
+		Msg(0, "%s", strnomem);
+		return NULL;
+	}
+	memcpy(h->h_path, SocketPath, dl);
+	if (snprintf(h->h_path + dl, sizeof(h->h_path) - dl, "%d.%s", (int)getpid(), name)
+	    >= (int)(sizeof(h->h_path) - dl)) {
+		free(h);
+		Msg(0, "%s: session name too long.", name);
+		return NULL;
+	}
+	h->h_name = h->h_path + dl;
+	if (!strcmp(h->h_path, SocketPath)) {
+		free(h);
+		Msg(0, "This is session %s.", name);
+		return NULL;
+	}
+	for (Hosted *o = hosteds; o; o = o->h_next)
+		if (!strcmp(o->h_path, h->h_path)) {
+			free(h);
+			Msg(0, "Session %s is already hosted here.", name);
+			return NULL;
+		}
+	if ((h->h_fd = ListenSocket(h->h_path)) < 0) {
+		Msg(errno, "Cannot make socket %s", h->h_name);
+		free(h);
+		return NULL;
+	}
+	h->h_ev.type = EV_READ;
+	h->h_ev.fd = h->h_fd;
+	h->h_ev.handler = HostedRead;
+	h->h_ev.data = (char *)h;
+	h->h_ev.name = "HostedRead";
+	evenq(&h->h_ev);
+	h->h_next = hosteds;
+	hosteds = h;
+	{
+		char dir[MAXPATHLEN];
+
+		HostedDir(h, dir);
+		RegistryEdit(dir, h->h_name, HostedMode(h));
+	}
+	return h;
+}
+
+/* Ends hosting h: its displays go, as they do when a session ends. */
+void HostedClose(Hosted *h)
+{
+	Hosted **hp;
+	Display *d, *next;
+	char dir[MAXPATHLEN];
+
+	for (hp = &hosteds; *hp; hp = &(*hp)->h_next)
+		if (*hp == h)
+			break;
+	if (!*hp)
+		return;
+	*hp = h->h_next;
+	for (d = displays; d; d = next) {
+		next = d->d_next;
+		if (d->d_hosted != h)
+			continue;
+		display = d;
+		if (D_status)
+			RemoveStatus();
+		FinitTerm();
+#ifdef ENABLE_UTMP
+		RestoreLoginSlot();
+#endif
+		AddStr("[screen is terminating]\r\n");
+		Flush(3);
+		SetTTY(D_userfd, &D_OldMode);
+		fcntl(D_userfd, F_SETFL, 0);
+		Kill(D_userpid, SIG_BYE);
+		FreeDisplay();
+	}
+	display = NULL;
+	evdeq(&h->h_ev);
+	close(h->h_fd);
+	xseteuid(real_uid);
+	xsetegid(real_gid);
+	(void)unlink(h->h_path);
+	xseteuid(eff_uid);
+	xsetegid(eff_gid);
+	HostedDir(h, dir);
+	RegistryEdit(dir, h->h_name, -1);
+	if (HostedMsg == h)
+		HostedMsg = NULL;
+	BatchCancel(h);
+	for (Window *win = mru_window; win; win = win->w_prev_mru)
+		if (win->w_hosted == h)
+			win->w_hosted = NULL;
+	free(h);
+}
+
+/* Renames hosted session h to name; 0 if it worked. */
+int HostedRename(Hosted *h, char *name)
+{
+	char path[MAXPATHLEN], dir[MAXPATHLEN];
+	size_t dl = h->h_name - h->h_path;
+	int r;
+
+	if (!*name || strchr(name, '/') ||
+	    snprintf(path, sizeof(path), "%.*s%d.%s", (int)dl, h->h_path, (int)getpid(), name)
+	    >= (int)sizeof(path)) {
+		Msg(0, "%s: bad session name.", name);
+		return -1;
+	}
+	for (Hosted *o = hosteds; o; o = o->h_next)
+		if (!strcmp(o->h_path, path) || !strcmp(SocketPath, path)) {
+			Msg(0, "Session %s is already hosted here.", name);
+			return -1;
+		}
+	xseteuid(real_uid);
+	xsetegid(real_gid);
+	r = rename(h->h_path, path);
+	xseteuid(eff_uid);
+	xsetegid(eff_gid);
+	if (r) {
+		Msg(errno, "Could not rename session %s", h->h_name);
+		return -1;
+	}
+	HostedDir(h, dir);
+	RegistryEdit(dir, h->h_name, -1);
+	strcpy(h->h_path, path);
+	RegistryEdit(dir, h->h_name, HostedMode(h));
+	return 0;
+}
+
+/* Sets the mode of the socket of h to whether it is attached, as chsock() */
+void HostedChsock(Hosted *h)
+{
+	char dir[MAXPATHLEN];
+	int mode = HostedMode(h);
+
+	xseteuid(real_uid);
+	xsetegid(real_gid);
+	(void)chmod(h->h_path, mode);
+	(void)utimes(h->h_path, NULL);
+	xseteuid(eff_uid);
+	xsetegid(eff_gid);
+	HostedDir(h, dir);
+	RegistryEdit(dir, h->h_name, mode);
+}
+
+/* Removes the sockets of all hosted sessions, when this process ends */
+void HostedRemoveAll(void)
+{
+	char dir[MAXPATHLEN];
+
+	for (Hosted *h = hosteds; h; h = h->h_next) {
+		xseteuid(real_uid);
+		xsetegid(real_gid);
+		(void)unlink(h->h_path);
+		xseteuid(eff_uid);
+		xsetegid(eff_gid);
+		HostedDir(h, dir);
+		RegistryEdit(dir, h->h_name, -1);
+	}
+}
+
+/* The session a command is for: the one its message came to, or else the
+ * one of the display it runs on; NULL for this one. */
+Hosted *CommandHosted(void)
+{
+	if (HostedMsg)
+		return HostedMsg;
+	return display ? D_hosted : NULL;
+}
+
+/* Whether win is in a session other than the one a command is for, see
+ * CommandHosted() */
+bool OtherSession(Window *win)
+{
+	return win && win->w_hosted != CommandHosted();
+}
+
+/* The window of session h worked with last */
+static Window *HostedFore(Hosted *h)
+{
+	Window *win;
+
+	for (win = mru_window; win; win = win->w_prev_mru)
+		if (win->w_hosted == h)
+			break;
+	return win;
+}
+
 static void FinishAttach(Message *m)
 {
 	pid_t pid;
 	int noshowwin;
 
 	pid = D_userpid;
+	TRACE1(attach__entry, pid);
 
 	if (m->m.attach.detachfirst == MSG_DETACH || m->m.attach.detachfirst == MSG_POW_DETACH)
 		FinishDetach(m);
@@ -1021,11 +1819,14 @@ static void FinishAttach(Message *m)
 	if (InitTermcap(m->m.attach.columns, m->m.attach.lines)) {
 		FreeDisplay();
 		Kill(pid, SIG_BYE);
+		TRACE1(attach__return, pid);
 		return;
 	}
 	MakeDefaultCanvas();
 	InitTerm(m->m.attach.adaptflag);	/* write init string on fd */
-	if (displays->d_next == NULL)
+	if (D_hosted)
+		HostedChsock(D_hosted);
+	else if (displays->d_next == NULL || hosteds)
 		(void)chsock();
 	xsignal(SIGHUP, SigHup);
 	if (m->m.attach.esc != -1 && m->m.attach.meta_esc != -1) {
@@ -1062,10 +1863,14 @@ static void FinishAttach(Message *m)
 		fore = GetWindowByNumber(D_user->u_detachwin);
 	else
 		fore = NULL;
+	if (OtherSession(fore))
+		fore = NULL;
 
 	/* Wayne wants us to restore the other window too. */
 	if (D_user->u_detachotherwin >= 0)
 		D_other = GetWindowByNumber(D_user->u_detachotherwin);
+	if (OtherSession(D_other))
+		D_other = NULL;
 
 	noshowwin = 0;
 	if (*m->m.attach.preselect) {
@@ -1096,7 +1901,18 @@ static void FinishAttach(Message *m)
 			display = olddisplay;	/* display_windows can change display */
 		}
 	}
+	if (scrollback_dump && D_fore && !D_CS) {
+		/* without a scroll region it has to go before the redraw; replay
+		 * the history at the size Activate() gives the window */
+		if (MayResizeLayer(D_forecv->c_layer))
+			ResizeLayer(D_forecv->c_layer, D_forecv->c_xe - D_forecv->c_xs + 1,
+				    D_forecv->c_ye - D_forecv->c_ys + 1, display);
+		DumpScrollback(D_fore);
+	}
 	Activate(0);
+	if (scrollback_dump && D_fore && D_CS)
+		DumpScrollbackStart(D_fore);	/* the viewport first, then the history */
+	EventPost("attach", D_fore ? D_fore->w_number : -1, D_usertty);
 	ResetIdle();
 	if (!D_fore && !noshowwin)
 		ShowWindows(-1);
@@ -1104,11 +1920,14 @@ static void FinishAttach(Message *m)
 		if (TtyGrabConsole(console_window->w_ptyfd, true, "reattach") == 0)
 			Msg(0, "console %s is on window %d", HostName, console_window->w_number);
 	}
+	StartupTrace(STARTUP_ATTACH);
+	TRACE1(attach__return, pid);
 }
 
 static void FinishDetach(Message *m)
 {
 	Display *next, **d, *det;
+	Hosted *h;
 	pid_t pid;
 
 	if (m->type == MSG_ATTACH)
@@ -1126,8 +1945,12 @@ static void FinishDetach(Message *m)
 		det->d_next = NULL;
 	}
 
+	/* ImmorTerm: the displays of the session it came to, see HostedOpen() */
+	h = det ? det->d_hosted : HostedMsg;
 	for (display = displays; display; display = next) {
 		next = display->d_next;
+		if (D_hosted != h)
+			continue;
 		if (m->type == MSG_POW_DETACH)
 			Detach(D_REMOTE_POWER);
 		else if (m->type == MSG_DETACH)
@@ -1139,7 +1962,11 @@ static void FinishDetach(Message *m)
 				Detach(D_REMOTE);
 		}
 	}
-	display = displays = det;
+	if (det) {
+		det->d_next = displays;
+		displays = det;
+	}
+	display = det;
 	if (m->type != MSG_ATTACH) {
 		if (display)
 			FreeDisplay();
@@ -1371,13 +2198,10 @@ static char *strncpy_escape_quote(char *dst, const char *src, const char *end)
 
 static void DoCommandMsg(Message *mp)
 {
-	char *args[MAXARGS];
-	int argl[MAXARGS];
 	char fullcmd[MAXSTR];
 	char *fc;
 	int n;
 	char *p = mp->m.command.cmd;
-	struct acluser *user;
 
 	n = mp->m.command.nargs;
 	if (n > MAXARGS - 1)
@@ -1396,14 +2220,26 @@ static void DoCommandMsg(Message *mp)
 	}
 	if (fc != fullcmd)
 		*--fc = 0;
-	if (Parse(fullcmd, ARRAY_SIZE(fullcmd), args, argl) <= 0) {
+	DoCommandLine(mp, fullcmd, ARRAY_SIZE(fullcmd));
+}
+
+/* Runs the command line fullcmd on behalf of the sender of mp. */
+static void DoCommandLine(Message *mp, char *fullcmd, size_t size)
+{
+	char *args[MAXARGS];
+	int argl[MAXARGS];
+	struct acluser *user;
+
+	if (Parse(fullcmd, size, args, argl) <= 0) {
 		queryflag = -1;
+		cmderrors++;
 		return;
 	}
 	user = *FindUserPtr(mp->m.attach.auser);
 	if (user == NULL) {
 		Msg(0, "Unknown user %s tried to send a command!", mp->m.attach.auser);
 		queryflag = -1;
+		cmderrors++;
 		return;
 	}
 	/*if (user->u_password && *user->u_password) {
@@ -1412,12 +2248,16 @@ static void DoCommandMsg(Message *mp)
 		queryflag = -1;
 		return;
 	}*/
+	/* ImmorTerm: a command sent to a session acts on it only, see
+	 * HostedOpen() */
+	if (display && D_hosted != HostedMsg)
+		display = NULL;
 	if (!display)
 		for (display = displays; display; display = display->d_next)
-			if (D_user == user)
+			if (D_user == user && D_hosted == HostedMsg)
 				break;
 	for (fore = mru_window; fore; fore = fore->w_prev_mru)
-		if (!strcmp(mp->m_tty, fore->w_tty)) {
+		if (!strcmp(mp->m_tty, fore->w_tty) && fore->w_hosted == HostedMsg) {
 			if (!display)
 				display = fore->w_layer.l_cvlist ? fore->w_layer.l_cvlist->c_display : NULL;
 
@@ -1430,14 +2270,17 @@ static void DoCommandMsg(Message *mp)
 			break;
 		}
 	if (!display)
-		display = displays;	/* sigh */
+		for (display = displays; display; display = display->d_next)
+			if (D_hosted == HostedMsg)
+				break;	/* sigh */
 	if (*mp->m.command.preselect) {
 		int i = -1;
 		if (strcmp(mp->m.command.preselect, "-")) {
 			i = WindowByNoN(mp->m.command.preselect);
-			if (i < 0 || !GetWindowByNumber(i)) {
+			if (i < 0 || !GetWindowByNumber(i) || GetWindowByNumber(i)->w_hosted != HostedMsg) {
 				Msg(0, "Could not find pre-select window.");
 				queryflag = -1;
+				cmderrors++;
 				return;
 			}
 		}
@@ -1447,11 +2290,13 @@ static void DoCommandMsg(Message *mp)
 			fore = Layer2Window(display->d_forecv->c_layer);
 		if (!fore) {
 			fore = user->u_detachwin >= 0 ? GetWindowByNumber(user->u_detachwin) : NULL;
+			if (fore && fore->w_hosted != HostedMsg)
+				fore = NULL;
 			fore = FindNiceWindow(fore, NULL);
 		}
 	}
-	if (!fore)
-		fore = mru_window;	/* sigh */
+	if (!fore || fore->w_hosted != HostedMsg)
+		fore = HostedFore(HostedMsg);	/* sigh */
 	EffectiveAclUser = user;
 	if (*args) {
 		char *oldrcname = rc_name;
@@ -1465,34 +2310,180 @@ static void DoCommandMsg(Message *mp)
 	EffectiveAclUser = NULL;
 }
 
-int SendAttachMsg(int s, Message *m, int fd)
+/*
+ * ImmorTerm: the commands that follow a MSG_COMMANDS message come in on
+ * its connection while the session goes on, and run once the sender has
+ * shut it down (see DoCommandsMsg()). A sender that is not done within
+ * BATCH_TIMEOUT seconds is dropped.
+ */
+#define BATCH_TIMEOUT	10
+
+struct batch {
+	struct batch *next;
+	Message m;
+	Hosted *hosted;		/* the session it came to, see HostedMsg */
+	char *buf;
+	size_t len, size;
+	Event readev;
+	Event timeoutev;
+};
+
+static struct batch *batches;
+
+static void BatchUnlink(struct batch *b)
 {
-	struct msghdr msg;
-	struct iovec iov;
-	char buf[CMSG_SPACE(sizeof(int))];
-	struct cmsghdr *cmsg;
+	struct batch **bp;
 
-	iov.iov_base = (char *)m;
-	iov.iov_len = sizeof(Message);
-	memset(&msg, 0, sizeof(struct msghdr));
-	msg.msg_name = NULL;
-	msg.msg_namelen = 0;
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
-	msg.msg_control = buf;
-	msg.msg_controllen = ARRAY_SIZE(buf);
-	cmsg = CMSG_FIRSTHDR(&msg);
-	cmsg->cmsg_level = SOL_SOCKET;
-	cmsg->cmsg_type = SCM_RIGHTS;
-	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
-	memmove(CMSG_DATA(cmsg), &fd, sizeof(int));
-	msg.msg_controllen = cmsg->cmsg_len;
-	while (1) {
-		int ret = sendmsg(s, &msg, 0);
-		if (ret == -1 && errno == EINTR)
-			continue;
-		if (ret == -1)
-			return -1;
-		return 0;
+	for (bp = &batches; *bp && *bp != b; bp = &(*bp)->next)
+		;
+	if (*bp)
+		*bp = b->next;
+}
+
+static void BatchFree(struct batch *b)
+{
+	BatchUnlink(b);
+	evdeq(&b->readev);
+	evdeq(&b->timeoutev);
+	close(b->readev.fd);
+	free(b->buf);
+	free(b);
+}
+
+static void batch_read_fn(Event *ev, void *data)
+{
+	struct batch *b = (struct batch *)data;
+	ssize_t n;
+
+	(void)ev; /* unused */
+	if (b->len == b->size) {
+		char *nbuf;
+
+		if (b->size >= MSG_COMMANDSMAX || (nbuf = realloc(b->buf, b->size * 2)) == NULL) {
+			Msg(0, "Batch of commands too large.");
+			BatchFree(b);
+			return;
+		}
+		b->buf = nbuf;
+		b->size *= 2;
+	}
+	n = read(b->readev.fd, b->buf + b->len, b->size - b->len);
+	if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	if (n < 0) {
+		Msg(errno, "read");
+		BatchFree(b);
+		return;
+	}
+	if (n > 0) {
+		b->len += n;
+		return;
+	}
+	/* all there: the results go back in order, as the commands run,
+	 * and a command ending its session leaves it to us */
+	BatchUnlink(b);
+	evdeq(&b->readev);
+	evdeq(&b->timeoutev);
+	fcntl(b->readev.fd, F_SETFL, 0);
+	HostedMsg = b->hosted;
+	DoCommandsMsg(&b->m, b->readev.fd, b->buf, b->len);
+	HostedMsg = NULL;
+	BatchFree(b);
+}
+
+static void batch_timeout_fn(Event *ev, void *data)
+{
+	(void)ev; /* unused */
+	Msg(0, "Batch of commands timed out.");
+	BatchFree((struct batch *)data);
+}
+
+/* Takes over s, the connection MSG_COMMANDS m came on. */
+static void BatchReceive(Message *m, int s)
+{
+	struct batch *b;
+
+	if ((b = calloc(1, sizeof(*b))) == NULL || (b->buf = malloc(4096)) == NULL) {
+		free(b);
+		close(s);
+		return;
+	}
+	b->m = *m;
+	b->hosted = HostedMsg;
+	b->size = 4096;
+	fcntl(s, F_SETFL, O_NONBLOCK);
+	b->readev.fd = s;
+	b->readev.type = EV_READ;
+	b->readev.data = (char *)b;
+	b->readev.handler = batch_read_fn;
+	b->readev.name = "batch_read_fn";
+	b->timeoutev.type = EV_TIMEOUT;
+	b->timeoutev.data = (char *)b;
+	b->timeoutev.handler = batch_timeout_fn;
+	b->timeoutev.name = "batch_timeout_fn";
+	SetTimeout(&b->timeoutev, BATCH_TIMEOUT * 1000);
+	b->next = batches;
+	batches = b;
+	evenq(&b->readev);
+	evenq(&b->timeoutev);
+}
+
+/* Drops the batches sent to hosted session h, which ends. */
+static void BatchCancel(Hosted *h)
+{
+	struct batch *b, *next;
+
+	for (b = batches; b; b = next) {
+		next = b->next;
+		if (b->hosted == h)
+			BatchFree(b);
+	}
+}
+
+/*
+ * ImmorTerm: runs the len bytes of commands in buf, which followed a
+ * MSG_COMMANDS message on its connection s up to where the sender shut
+ * it down, one after the other as separate MSG_COMMAND and MSG_QUERY
+ * messages would run them. Each is a 'X' (a command) or 'Q' (a query),
+ * then a line in screenrc syntax ending in a NUL. Back on s goes, for
+ * each, what it printed if a query, a NUL, and '0' if it worked or '1' if
+ * not: if it was no command, reported an error (see cmderrors) or, as a
+ * query, failed.
+ */
+static void DoCommandsMsg(Message *mp, int s, char *buf, size_t len)
+{
+	void (*oldpipe)(int);
+	char *p, *end, fullcmd[MAXSTR];
+
+	/* the sender may be gone before all results are back */
+	oldpipe = xsignal(SIGPIPE, SIG_IGN);
+	end = buf + len;
+	for (p = buf; p < end;) {
+		char *nul = memchr(p, 0, end - p);
+		bool query = *p == 'Q';
+		Window *win = NULL;
+		char result[2] = { 0, '0' };
+		int errors = cmderrors;
+
+		if (nul == NULL || nul == p)
+			break;
+		if ((size_t)(nul - p) > ARRAY_SIZE(fullcmd)) {
+			Msg(0, "Remote command too long.");
+			result[1] = '1';
+		} else {
+			strcpy(fullcmd, p + 1);
+			display = TtyDisplay(mp->m_tty, &win);
+			if (display && D_status)
+				RemoveStatus();
+			queryflag = query ? s : -1;
+			DoCommandLine(mp, fullcmd, ARRAY_SIZE(fullcmd));
+			if ((query && queryflag < 0) || cmderrors != errors)
+				result[1] = '1';
+			queryflag = -1;
+		}
+		if (write(s, result, sizeof(result)) != sizeof(result))
+			break;
+		p = nul + 1;
 	}
+	xsignal(SIGPIPE, oldpipe);
 }
@@ -3,15 +3,41 @@
 
 #include "window.h"
 
+/*
+ * ImmorTerm: a session hosted by this one, see socket.c. h_name points
+ * into h_path as SocketName does into SocketPath.
+ */
+typedef struct Hosted Hosted;
+struct Hosted {
+	Hosted	*h_next;
+	int	 h_fd;			/* its listening socket */
+	Event	 h_ev;
+	int	 h_windows;		/* how many windows are in it */
+	char	 h_path[MAXPATHLEN];
+	char	*h_name;
+};
+
+extern Hosted *hosteds;
+extern Hosted *HostedMsg;
+
 int   FindSocket (int *, int *, int *, char *);
 int   MakeClientSocket (int);
 int   MakeServerSocket (void);
 int   RecoverSocket (void);
 int   chsock (void);
-void  ReceiveMsg (void);
+void  RegistryUpdate (void);
+void  RegistryRemove (void);
+void  ReceiveMsg (Hosted *);
 void  SendCreateMsg (char *, struct NewWindow *);
 int   SendErrorMsg (char *, char *);
-int   SendAttachMsg (int, Message *, int);
+int   SendMessage (int, Message *, int);
 void  ReceiveRaw (int);
+Hosted *HostedOpen (char *);
+void  HostedClose (Hosted *);
+int   HostedRename (Hosted *, char *);
+void  HostedChsock (Hosted *);
+void  HostedRemoveAll (void);
+Hosted *CommandHosted (void);
+bool  OtherSession (Window *);
 
 #endif /* SCREEN_SOCKET_H */
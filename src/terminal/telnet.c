@@ -151,6 +151,7 @@ int TelOpenAndConnect(Window *win)
 				win->w_telstate = TEL_CONNECTING;
 				win->w_telconnev.fd = fd;
 				win->w_telconnev.handler = tel_connev_fn;
+				win->w_telconnev.name = "tel_connev_fn";
 				win->w_telconnev.data = (void *)win;
 				win->w_telconnev.type = EV_WRITE;
 				win->w_telconnev.priority = 1;
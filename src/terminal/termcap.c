@@ -31,6 +31,8 @@
 #include "termcap.h"
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <stdint.h>
 
 #include "screen.h"
@@ -53,6 +55,11 @@ static int findseq_ge(char *, int, unsigned char **);
 static void setseqoff(unsigned char *, int, int);
 static int addmapseq(char *, int, int);
 static int remmapseq(char *, int);
+static bool tcsource(char *, struct stat *);
+static char *tccache_key(char *, size_t);
+static bool tccache_load(char *, char *, bool *);
+static void tccache_store(char *, char *);
+static uint64_t tchash(void);
 
 char Termcap[TERMCAP_BUFSIZE + 8];	/* new termcap +8:"TERMCAP=" */
 static int Termcaplen;
@@ -82,6 +89,190 @@ char *gettermcapstring(char *s)
 	return NULL;
 }
 
+/*
+ * The capabilities that InitTermcap() reads from the terminfo entry and
+ * the termcapinfo overrides are kept in a dot file of the socket
+ * directory, so that the next display of the same terminal does not read
+ * and parse them again. The key of an entry is everything they depend
+ * on: the terminal name, the terminfo file it came from, the overrides
+ * and our table of capabilities.
+ */
+
+#define TCCACHE_MAGIC 0x53635463	/* "ScTc" */
+
+/* The terminfo file tgetent() reads for name; there is none if the
+ * entry may come from somewhere we do not know about. */
+static bool tcsource(char *name, struct stat *st)
+{
+	char *dirs[6], home[MAXPATHLEN], path[MAXPATHLEN], *s;
+	int n = 0;
+
+	if (getenv("TERMINFO_DIRS") || getenv("TERMCAP") || strchr(name, '/'))
+		return false;
+	if ((s = getenv("TERMINFO")) != NULL)
+		dirs[n++] = s;
+	if ((s = getenv("HOME")) != NULL && snprintf(home, sizeof(home), "%s/.terminfo", s) < (int)sizeof(home))
+		dirs[n++] = home;
+	dirs[n++] = "/etc/terminfo";
+	dirs[n++] = "/lib/terminfo";
+	dirs[n++] = "/usr/share/terminfo";
+	dirs[n++] = "/usr/lib/terminfo";
+	for (int i = 0; i < n; i++) {
+		snprintf(path, sizeof(path), "%s/%c/%s", dirs[i], *name, name);
+		if (stat(path, st) == 0)
+			return true;
+		/* some systems name the subdirectories in hex */
+		snprintf(path, sizeof(path), "%s/%02x/%s", dirs[i], (unsigned char)*name, name);
+		if (stat(path, st) == 0)
+			return true;
+	}
+	return false;
+}
+
+/* The key of our entry, NULL if it must not be cached. */
+static char *tccache_key(char *path, size_t size)
+{
+	struct stat st;
+	uint32_t h = 2166136261U;
+	uint64_t fh = 0xcbf29ce484222325ULL;	/* FNV-1a */
+	char *key;
+	size_t len;
+	int n;
+
+	if (SocketName == NULL || *D_termname == 0 || !tcsource(D_termname, &st))
+		return NULL;
+	for (int i = 0; i < T_N; i++)
+		for (char *c = term[i].tcname; *c; c++)
+			h = (h ^ (unsigned char)*c) * 16777619U;
+	len = strlen(D_termname) + (extra_incap ? strlen(extra_incap) : 0) + 100;
+	if ((key = malloc(len)) == NULL)
+		return NULL;
+	snprintf(key, len, "%s\037%llu.%lld.%lld\037%d.%08x\037%s", D_termname,
+		 (unsigned long long)st.st_ino, (long long)st.st_mtime, (long long)st.st_size,
+		 T_N, h, extra_incap ? extra_incap : "");
+	for (char *k = key; *k; k++)
+		fh = (fh ^ (unsigned char)*k) * 0x100000001b3ULL;
+	n = snprintf(path, size, "%.*s/.termcap-%016llx", (int)(SocketName - SocketPath - 1), SocketPath,
+		     (unsigned long long)fh);
+	if (n <= 0 || (size_t)n >= size) {
+		free(key);
+		return NULL;
+	}
+	return key;
+}
+
+/* "key\n", the magic, a value for each capability (string offset + 1 or
+ * 0 for strings), then the strings. padp tells whether they have padding,
+ * which tputs() needs the entry loaded for. */
+static bool tccache_load(char *path, char *key, bool *padp)
+{
+	char *buf, *strs;
+	struct stat st;
+	int32_t v[T_N + 1];
+	size_t klen = strlen(key), hl = klen + 1 + sizeof(v), sl;
+	int fd;
+	bool ok;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return false;
+	if (fstat(fd, &st) || (size_t)st.st_size <= hl || st.st_size > (off_t)(hl + TERMCAP_BUFSIZE)
+	    || (buf = malloc(st.st_size)) == NULL) {
+		close(fd);
+		return false;
+	}
+	ok = read(fd, buf, st.st_size) == st.st_size;
+	close(fd);
+	sl = st.st_size - hl;
+	strs = buf + hl;
+	memcpy(v, buf + klen + 1, sizeof(v));
+	if (!ok || memcmp(buf, key, klen) || buf[klen] != '\n' || v[0] != TCCACHE_MAGIC || strs[sl - 1]) {
+		free(buf);
+		return false;
+	}
+	for (int i = 0; i < T_N; i++)
+		if (term[i].type == T_STR && (v[i + 1] < 0 || (size_t)v[i + 1] > sl)) {
+			free(buf);
+			return false;
+		}
+	/* the strings are what D_tentry holds */
+	memmove(buf, strs, sl);
+	*padp = false;
+	for (char *c = buf; c < buf + sl; c += strlen(c) + 1)
+		if (strstr(c, "$<"))
+			*padp = true;
+	D_tentry = buf;
+	for (int i = 0; i < T_N; i++) {
+		if (term[i].type == T_FLG)
+			D_tcs[i].flg = v[i + 1];
+		else if (term[i].type == T_NUM)
+			D_tcs[i].num = v[i + 1];
+		else
+			D_tcs[i].str = v[i + 1] ? D_tentry + v[i + 1] - 1 : NULL;
+	}
+	return true;
+}
+
+static void tccache_store(char *path, char *key)
+{
+	char tmp[MAXPATHLEN + 16], strs[TERMCAP_BUFSIZE];
+	int32_t v[T_N + 1];
+	size_t klen = strlen(key), sl = 0, l;
+	int fd;
+	bool ok;
+
+	v[0] = TCCACHE_MAGIC;
+	for (int i = 0; i < T_N; i++) {
+		if (term[i].type == T_FLG)
+			v[i + 1] = D_tcs[i].flg;
+		else if (term[i].type == T_NUM)
+			v[i + 1] = D_tcs[i].num;
+		else if (D_tcs[i].str == NULL)
+			v[i + 1] = 0;
+		else {
+			if ((l = strlen(D_tcs[i].str) + 1) > sizeof(strs) - sl)
+				return;
+			memcpy(strs + sl, D_tcs[i].str, l);
+			v[i + 1] = sl + 1;
+			sl += l;
+		}
+	}
+	if (sl == 0)
+		strs[sl++] = 0;
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+		return;
+	ok = write(fd, key, klen) == (ssize_t)klen && write(fd, "\n", 1) == 1
+	    && write(fd, v, sizeof(v)) == (ssize_t)sizeof(v)
+	    && write(fd, strs, sl) == (ssize_t)sl;
+	close(fd);
+	/* displays attaching meanwhile see the old entry or the new one */
+	if (!ok || rename(tmp, path))
+		unlink(tmp);
+}
+
+/* Displays whose capabilities hash the same after InitTermcap() fixed
+ * them up get the same output from us. */
+static uint64_t tchash(void)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;	/* FNV-1a */
+	unsigned char *p;
+	size_t n;
+
+	for (int i = 0; i < T_N; i++) {
+		if (term[i].type != T_STR) {
+			p = (unsigned char *)&D_tcs[i].num;
+			n = sizeof(D_tcs[i].num);
+		} else if ((p = (unsigned char *)D_tcs[i].str) != NULL)
+			n = strlen(D_tcs[i].str) + 1;
+		else
+			n = 0;
+		while (n--)
+			h = (h ^ *p++) * 0x100000001b3ULL;
+		h = (h ^ 0xff) * 0x100000001b3ULL;
+	}
+	return h;
+}
+
 /*
  * Compile the terminal capabilities for a display.
  * Input: tgetent(, D_termname) extra_incap, extra_outcap.
@@ -92,15 +283,22 @@ int InitTermcap(int width, int height)
 	char *s;
 	int i;
 	char tbuf[TERMCAP_BUFSIZE], *tp;
+	char cpath[MAXPATHLEN], *ckey;
+	bool cached = false, padded = true;
 	int t, xue, xse, xme;
 
+	if ((ckey = tccache_key(cpath, sizeof(cpath))) != NULL)
+		cached = tccache_load(cpath, ckey, &padded);
+
 	memset(tbuf, 0, ARRAY_SIZE(tbuf));
-	if (*D_termname == 0 || e_tgetent(tbuf, D_termname) != 1) {
+	if (!cached && (*D_termname == 0 || e_tgetent(tbuf, D_termname) != 1)) {
+		free(ckey);
 		Msg(0, "Cannot find terminfo entry for '%s'.", D_termname);
 		return -1;
 	}
 
-	if ((D_tentry = malloc(TERMCAP_BUFSIZE + (extra_incap ? strlen(extra_incap) + 1 : 0))) == NULL) {
+	if (!cached && (D_tentry = malloc(TERMCAP_BUFSIZE + (extra_incap ? strlen(extra_incap) + 1 : 0))) == NULL) {
+		free(ckey);
 		Msg(0, "%s", strnomem);
 		return -1;
 	}
@@ -109,7 +307,7 @@ int InitTermcap(int width, int height)
 	 * loop through all needed capabilities, record their values in the display
 	 */
 	tp = D_tentry;
-	for (i = 0; i < T_N; i++) {
+	for (i = 0; !cached && i < T_N; i++) {
 		switch (term[i].type) {
 		case T_FLG:
 			D_tcs[i].flg = e_tgetflag(term[i].tcname);
@@ -127,6 +325,9 @@ int InitTermcap(int width, int height)
 			Panic(0, "Illegal tc type in entry #%d", i);
 		 /*NOTREACHED*/}
 	}
+	if (ckey && !cached)
+		tccache_store(cpath, ckey);
+	free(ckey);
 
 	/*
 	 * Now a good deal of sanity checks on the retrieved capabilities.
@@ -365,6 +566,8 @@ int InitTermcap(int width, int height)
 	D_CRcost = CalcCost(D_CR);
 	D_IMcost = CalcCost(D_IM);
 	D_EIcost = CalcCost(D_EI);
+	InitMoveCosts();
+	InitSgrCache();
 
 	if (D_CAN) {
 		D_auto_nuke = true;
@@ -384,19 +587,21 @@ int InitTermcap(int width, int height)
 	if (D_tcs[T_CURSOR + 3].str && !strcmp(D_tcs[T_CURSOR + 3].str, "\008"))
 		D_tcs[T_CURSOR + 3].str = NULL;
 
+	D_tchash = tchash();
+
 	D_nseqs = 0;
 	for (i = 0; i < T_OCAPS - T_CAPS; i++)
 		remap(i, 1);
 	for (i = 0; i < kmap_extn; i++)
 		remap(i + (KMAP_KEYS + KMAP_AKEYS), 1);
-	D_seqp = D_kmaps + 3;
-	D_seql = 0;
-	D_seqh = NULL;
+	KmapsChanged();
 
 	D_tcinited = 1;
 	MakeTermcap(0);
-	/* Make sure libterm uses external term properties for our tputs() calls.  */
-	e_tgetent(tbuf, D_termname);
+	/* Make sure libterm uses external term properties for our tputs() calls.
+	 * Without padding tputs() needs none, so a cached entry may skip that. */
+	if (padded)
+		e_tgetent(tbuf, D_termname);
 	CheckEscape();
 	return 0;
 }
@@ -501,6 +706,96 @@ void CheckEscape(void)
 	display = odisplay;
 }
 
+/*
+ * The keymaps of the display changed: drop their trie and what was
+ * parsed with it.
+ */
+void KmapsChanged(void)
+{
+	free(D_kmtrie);
+	D_kmtrie = NULL;
+	D_seqn = 0;
+	D_seql = 0;
+	D_seqhl = 0;
+}
+
+/*
+ * Compile D_kmaps into D_kmtrie, so that ProcessInput() takes one step
+ * per input char instead of walking the sequences that share a prefix.
+ * The sequences are inserted into a first-child/next-sibling tree first,
+ * which is then laid out breadth first. Returns false if there is
+ * nothing to map or no memory.
+ */
+bool CompileKmaps(void)
+{
+	struct tnode {
+		int child, sib;
+		int nr;
+		unsigned char c;
+	} *t;
+	int nt = 1, *order, i, j, k, n, q, m;
+	unsigned char *p;
+	struct kmnode *kn;
+
+	if (D_nseqs == 0)
+		return false;
+	if ((t = malloc((D_nseqs + 1) * sizeof(*t))) == NULL)
+		return false;
+	t[0].child = t[0].sib = -1;
+	t[0].nr = KMNODE_NONE;
+	for (i = 0; i < D_nseqs; i += D_kmaps[i + 2] * 2 + 4) {
+		p = D_kmaps + i;
+		for (n = 0, j = 0; j < p[2]; j++) {
+			int *lp = &t[n].child;
+
+			/* siblings are kept sorted */
+			while (*lp >= 0 && t[*lp].c < p[3 + j])
+				lp = &t[*lp].sib;
+			if (*lp < 0 || t[*lp].c != p[3 + j]) {
+				t[nt].c = p[3 + j];
+				t[nt].child = -1;
+				t[nt].sib = *lp;
+				t[nt].nr = KMNODE_NONE;
+				*lp = nt++;
+			}
+			n = *lp;
+		}
+		t[n].nr = p[0] << 8 | p[1];
+	}
+	order = malloc(nt * sizeof(int));
+	kn = calloc(nt, sizeof(struct kmnode));
+	if (!order || !kn) {
+		free(order);
+		free(kn);
+		free(t);
+		return false;
+	}
+	order[0] = 0;
+	for (q = 0, m = 1; q < m; q++) {
+		k = order[q];
+		kn[q].child = m;
+		kn[q].nr = t[k].nr;
+		for (j = t[k].child; j >= 0; j = t[j].sib) {
+			kn[q].bits[t[j].c >> 6] |= (uint64_t)1 << (t[j].c & 63);
+			order[m++] = j;
+		}
+	}
+	/* children come after their parent, so go backwards */
+	for (q = nt - 1; q >= 0; q--) {
+		uint32_t c = kn[q].child;
+
+		for (j = 0; j < 4; j++)
+			for (uint64_t b = kn[q].bits[j]; b; b &= b - 1, c++)
+				if (kn[c].notimeout || (kn[c].nr != KMNODE_NONE && kn[c].nr & KMAP_NOTIMEOUT))
+					kn[q].notimeout = true;
+	}
+	free(order);
+	free(t);
+	free(D_kmtrie);
+	D_kmtrie = kn;
+	return true;
+}
+
 static int findseq_ge(char *seq, int k, unsigned char **sp)
 {
 	unsigned char *p;
@@ -560,6 +855,7 @@ static int addmapseq(char *seq, int k, int nr)
 	if (j == 0) {
 		p[0] = nr >> 8;
 		p[1] = nr;
+		KmapsChanged();
 		return 0;
 	}
 	i = p - D_kmaps;
@@ -568,9 +864,7 @@ static int addmapseq(char *seq, int k, int nr)
 		D_aseqs += 256;
 		p = D_kmaps + i;
 	}
-	D_seqp = D_kmaps + 3;
-	D_seql = 0;
-	D_seqh = NULL;
+	KmapsChanged();
 	evdeq(&D_mapev);
 	if (j > 0)
 		memmove((char *)p + 2 * k + 4, (char *)p, D_nseqs - i);
@@ -626,9 +920,7 @@ static int remmapseq(char *seq, int k)
 	if (D_kmaps + D_nseqs > p + 2 * k + 4)
 		memmove((char *)p, (char *)p + 2 * k + 4, (D_kmaps + D_nseqs) - (p + 2 * k + 4));
 	D_nseqs -= 2 * k + 4;
-	D_seqp = D_kmaps + 3;
-	D_seql = 0;
-	D_seqh = NULL;
+	KmapsChanged();
 	evdeq(&D_mapev);
 	return 0;
 }
@@ -8,6 +8,8 @@ char *MakeTermcap (bool);
 char *gettermcapstring (char *);
 int   remap (int, int);
 void  CheckEscape (void);
+void  KmapsChanged (void);
+bool  CompileKmaps (void);
 int   CreateTransTable (char *);
 void  FreeTransTable (void);
 
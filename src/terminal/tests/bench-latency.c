@@ -0,0 +1,293 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+/*
+ * Keystroke to echo latency of a real session: screen runs attached to a
+ * pty this program holds the other end of, and a window whose tty echoes
+ * what is typed (cat with the line discipline in -icanon). A key written
+ * here goes through the display's input, ProcessInput(), the window's
+ * pty and its echo, the window's output, WriteString() and Flush(), and
+ * the time until it is read back is taken.
+ *
+ *	bench-latency [-n samples] [-m mode] [screen]
+ *
+ * Three runs, or the one of mode: idle, while a window in the background
+ * floods output (flood), and while one in a split region shown beside it
+ * does (split). Each reports the p50, p99 and p99.9 latency of samples
+ * keys, 500 by default. screen is ./screen unless given.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SETTLE_MS	300	/* screen has started when quiet for this long, */
+#define START_MS	3000	/* or this long after it was started */
+#define TIMEOUT_MS	2000	/* a key not echoed by then is lost */
+
+static const char *screen = "./screen";
+static char sockdir[] = "/tmp/bench-latency.XXXXXX";
+static char session[64];
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Read what comes until it is quiet for ms, or for max ms; false on EOF */
+static bool drain(int fd, int ms, int max)
+{
+	struct pollfd p = { fd, POLLIN, 0 };
+	double end = now_us() + max * 1000.0;
+	char buf[4096];
+
+	while (now_us() < end && poll(&p, 1, ms) > 0) {
+		if (read(fd, buf, sizeof(buf)) <= 0)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Whether key is in the text of what screen wrote, skipping its control
+ * sequences (their final bytes are letters too). The state carries over
+ * from one read to the next.
+ */
+static bool echoed(const char *buf, size_t len, char key, int *state)
+{
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = buf[i];
+
+		switch (*state) {
+		case 0:		/* text */
+			if (c == 033)
+				*state = 1;
+			else if (c == (unsigned char)key)
+				return true;
+			break;
+		case 1:		/* after ESC */
+			*state = c == '[' ? 2 : strchr("]P_^", c) ? 3 : strchr("()*+#", c) ? 4 : 0;
+			break;
+		case 2:		/* CSI, up to its final byte */
+			if (c >= 0x40 && c <= 0x7e)
+				*state = 0;
+			break;
+		case 3:		/* a string, up to BEL or ESC \ */
+			if (c == 007)
+				*state = 0;
+			else if (c == 033)
+				*state = 4;
+			break;
+		case 4:		/* the one byte that ends it */
+			*state = 0;
+			break;
+		}
+	}
+	return false;
+}
+
+/* Start screen on a new pty with rc; returns the pty's master and sets *pid */
+static int start(const char *rc, pid_t *pid)
+{
+	struct winsize ws = { 24, 160, 0, 0 };
+	char rcfile[sizeof(sockdir) + 8];
+	FILE *f;
+	int master, slave;
+
+	snprintf(rcfile, sizeof(rcfile), "%s/rc", sockdir);
+	if (!(f = fopen(rcfile, "w")) || fputs(rc, f) == EOF || fclose(f))
+		return -1;
+
+	if ((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master) || unlockpt(master))
+		return -1;
+	if ((slave = open(ptsname(master), O_RDWR | O_NOCTTY)) < 0)
+		return -1;
+	ioctl(slave, TIOCSWINSZ, &ws);
+
+	if ((*pid = fork()) == 0) {
+		setsid();
+		ioctl(slave, TIOCSCTTY, 0);
+		dup2(slave, 0);
+		dup2(slave, 1);
+		dup2(slave, 2);
+		close(master);
+		close(slave);
+		setenv("TERM", "xterm", 1);
+		setenv("SCREENDIR", sockdir, 1);
+		execl(screen, screen, "-c", rcfile, "-S", session, (char *)NULL);
+		_exit(127);
+	}
+	close(slave);
+	if (*pid < 0 || !drain(master, SETTLE_MS, START_MS))
+		return -1;
+	return master;
+}
+
+static void stop(int master, pid_t pid)
+{
+	char cmd[512];
+
+	snprintf(cmd, sizeof(cmd), "SCREENDIR=%s '%s' -S %s -X quit >/dev/null 2>&1", sockdir, screen, session);
+	if (system(cmd) != 0)
+		kill(pid, SIGTERM);
+	drain(master, 100, 1000);
+	close(master);
+	waitpid(pid, NULL, 0);
+}
+
+/* Remove the socket directory, with what screen keeps in it */
+static void cleanup(void)
+{
+	DIR *dir = opendir(sockdir);
+	struct dirent *d;
+	char path[sizeof(sockdir) + 256];
+
+	while (dir && (d = readdir(dir))) {
+		if (strcmp(d->d_name, ".") && strcmp(d->d_name, "..")) {
+			snprintf(path, sizeof(path), "%s/%s", sockdir, d->d_name);
+			unlink(path);
+		}
+	}
+	if (dir)
+		closedir(dir);
+	rmdir(sockdir);
+}
+
+static int compare(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Type letters one at a time, a little apart as a person would, and time
+ * each until it is read back. The flooding window prints only digits, so
+ * a letter in the text screen writes is the echo.
+ */
+static void run(const char *name, const char *rc, int samples)
+{
+	double *lat = calloc(samples, sizeof(double));
+	int master, lost = 0, n = 0, state = 0;
+	pid_t pid;
+
+	if (!lat || (master = start(rc, &pid)) < 0) {
+		fprintf(stderr, "%s: cannot start %s\n", name, screen);
+		cleanup();
+		exit(1);
+	}
+	for (int i = 0; i < samples; i++) {
+		struct pollfd p = { master, POLLIN, 0 };
+		char key = 'a' + i % 26, buf[4096];
+		double t = now_us(), left;
+		bool seen = false;
+
+		if (write(master, &key, 1) != 1)
+			break;
+		while (!seen && (left = TIMEOUT_MS - (now_us() - t) / 1000) > 0 && poll(&p, 1, left) > 0) {
+			ssize_t len = read(master, buf, sizeof(buf));
+
+			if (len <= 0)
+				break;
+			seen = echoed(buf, len, key, &state);
+		}
+		if (seen)
+			lat[n++] = now_us() - t;
+		else
+			lost++;
+		/* a line at a time keeps the window from scrolling */
+		if (i % 26 == 25 && write(master, "\n", 1) != 1)
+			break;
+		drain(master, 2 + i % 5, 2 + i % 5);
+	}
+	stop(master, pid);
+
+	if (n == 0) {
+		fprintf(stderr, "%s: no key was echoed\n", name);
+		cleanup();
+		exit(1);
+	}
+	qsort(lat, n, sizeof(double), compare);
+	printf("%-10s %6d keys  p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %8.1f us  lost %d\n", name, n,
+	       lat[n / 2], lat[(int)(n * 0.99)], lat[(int)(n * 0.999)], lat[n - 1], lost);
+	free(lat);
+}
+
+#define PROBE	"screen -t probe sh -c 'stty -icanon; exec cat >/dev/null'\n"
+#define FLOOD	"screen -t flood sh -c 'exec yes 0123456789012345678901234567890123456789'\n"
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		const char *name, *rc;
+	} modes[] = {
+		{ "idle", "startup_message off\n" PROBE },
+		{ "flood", "startup_message off\n" FLOOD PROBE },
+		{ "split", "startup_message off\n" FLOOD PROBE "split -v\nfocus\nselect flood\nfocus\n" },
+	};
+	const char *mode = NULL;
+	int samples = 500, ran = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:m:")) != -1) {
+		if (c == 'm')
+			mode = optarg;
+		else if (c != 'n' || (samples = atoi(optarg)) < 1) {
+			fprintf(stderr, "usage: %s [-n samples] [-m idle|flood|split] [screen]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind < argc)
+		screen = argv[optind];
+	if (!mkdtemp(sockdir)) {
+		perror(sockdir);
+		return 1;
+	}
+	chmod(sockdir, 0700);
+	snprintf(session, sizeof(session), "bench-latency-%d", (int)getpid());
+
+	for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+		if (!mode || !strcmp(mode, modes[i].name)) {
+			run(modes[i].name, modes[i].rc, samples);
+			ran++;
+		}
+	cleanup();
+	if (!ran) {
+		fprintf(stderr, "%s: no mode %s\n", argv[0], mode);
+		return 1;
+	}
+	return 0;
+}
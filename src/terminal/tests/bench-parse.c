@@ -0,0 +1,287 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+/*
+ * Throughput of the terminal engine: output replayed through
+ * WriteString() into a window on no display (see headless.c), in the
+ * pieces a pty read hands over. Reports MB/s, ns per byte and the
+ * allocations made per MB of output.
+ *
+ *	bench-parse [-r passes] [-w width] [-h height] [file ...]
+ *
+ * Without files it replays streams made up here: a plain log, colored
+ * compiler output, frames of a full screen TUI (Claude Code's kind) and
+ * CJK and emoji text. A file is replayed as it is, e.g. a pty stream
+ * recorded with script(1).
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../screen.h"
+#include "../ansi.h"
+#include "../misc.h"
+#include "../resize.h"
+#include "../window.h"
+
+extern size_t _mallocmock_malloc_count, _mallocmock_realloc_count;
+extern size_t _mallocmock_malloc_size, _mallocmock_realloc_size;
+void mallocmock_reset(void);
+
+#define STREAM_SIZE	(2 << 20)	/* bytes of each stream made up */
+#define READ_SIZE	4096		/* bytes of a pty read */
+
+struct stream {
+	const char *name;
+	char *buf;
+	size_t len, size;
+};
+
+static unsigned long seed = 1;
+
+static unsigned long rnd(unsigned long n)
+{
+	seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+	return (seed >> 33) % n;
+}
+
+static void put(struct stream *s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void put(struct stream *s, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(s->buf + s->len, s->size - s->len, fmt, ap);
+		va_end(ap);
+		if (n >= 0 && (size_t)n < s->size - s->len)
+			break;
+		s->size = s->size * 2 + n + 1;
+		if (!(s->buf = realloc(s->buf, s->size)))
+			Panic(0, "out of memory");
+	}
+	s->len += n;
+}
+
+static const char *words[] = {
+	"request", "worker", "processed", "cache", "miss", "session", "flush",
+	"upstream", "latency", "retry", "connection", "accepted", "closed", "queue",
+};
+
+static void make_plain(struct stream *s)
+{
+	static const char *levels[] = { "INFO ", "DEBUG", "WARN ", "ERROR" };
+
+	while (s->len < STREAM_SIZE) {
+		put(s, "2026-10-14 08:%02lu:%02lu.%03lu %s [worker-%lu]", rnd(60), rnd(60), rnd(1000),
+		    levels[rnd(4)], rnd(16));
+		for (unsigned long i = 3 + rnd(10); i; i--)
+			put(s, " %s", words[rnd(ARRAY_SIZE(words))]);
+		put(s, " id=%lu in %lums\r\n", rnd(100000), rnd(500));
+	}
+}
+
+static void make_compiler(struct stream *s)
+{
+	while (s->len < STREAM_SIZE) {
+		unsigned long line = 1 + rnd(2000), col = 1 + rnd(60);
+		int err = !rnd(3);
+
+		put(s, "\033[01m\033[Ksrc/%s.c:%lu:%lu:\033[m\033[K \033[01;%sm\033[K%s:\033[m\033[K "
+		       "%s '\033[01m\033[K%s\033[m\033[K' [\033[01;%sm\033[K-W%s\033[m\033[K]\r\n",
+		    words[rnd(ARRAY_SIZE(words))], line, col, err ? "31" : "35", err ? "error" : "warning",
+		    "unused variable", words[rnd(ARRAY_SIZE(words))], err ? "31" : "35", "unused-variable");
+		put(s, " %4lu |   int \033[01;%sm\033[K%s\033[m\033[K = %lu;\r\n", line, err ? "31" : "35",
+		    words[rnd(ARRAY_SIZE(words))], rnd(100));
+		put(s, "      |       \033[01;%sm\033[K^~~~~~~\033[m\033[K\r\n", err ? "31" : "35");
+	}
+}
+
+static void make_tui(struct stream *s)
+{
+	static const char *spinner[] = { "\xe2\x9c\xb3", "\xe2\x9c\xb6", "\xe2\x9c\xbb", "\xe2\x9c\xbd" };
+	int frame = 0;
+
+	while (s->len < STREAM_SIZE) {
+		/* a synchronized frame redrawing the bottom of the screen */
+		put(s, "\033[?2026h\033[?25l");
+		for (int y = 10; y < 20; y++) {
+			put(s, "\033[%d;1H\033[38;2;%lu;%lu;%lum", y, 100 + rnd(156), 100 + rnd(156), 100 + rnd(156));
+			for (unsigned long i = 2 + rnd(8); i; i--)
+				put(s, "%s ", words[rnd(ARRAY_SIZE(words))]);
+			put(s, "\033[39m\033[K");
+		}
+		put(s, "\033[20;1H\033[2m\xe2\x95\xad");
+		for (int x = 0; x < 78; x++)
+			put(s, "\xe2\x94\x80");
+		put(s, "\xe2\x95\xae\033[22m\r\n\xe2\x94\x82 \033[1m> \033[22m%s", words[rnd(ARRAY_SIZE(words))]);
+		put(s, "\033[21;80H\xe2\x94\x82\r\n\033[38;5;%lum%s Thinking\xe2\x80\xa6 \033[2m(%lus \xc2\xb7 esc to interrupt)\033[m\033[K",
+		    16 + rnd(216), spinner[frame++ % 4], rnd(100));
+		put(s, "\033[?25h\033[?2026l");
+	}
+}
+
+static void make_cjk(struct stream *s)
+{
+	static const char *texts[] = {
+		"\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\x86\xe3\x82\xad\xe3\x82\xb9\xe3\x83\x88",	/* 日本語のテキスト */
+		"\xe4\xbd\xa0\xe5\xa5\xbd\xef\xbc\x8c\xe4\xb8\x96\xe7\x95\x8c",						/* 你好，世界 */
+		"\xed\x95\x9c\xea\xb5\xad\xec\x96\xb4",									/* 한국어 */
+		"\xf0\x9f\x98\x80\xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd",							/* 😀👍🏽 */
+		"\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x92\xbb",							/* 👩‍💻 */
+		"caf\x65\xcc\x81 na\xc3\xafve",										/* café naïve, decomposed e */
+		"\xe2\x9c\x85 done",											/* ✅ done */
+	};
+
+	while (s->len < STREAM_SIZE) {
+		for (unsigned long i = 2 + rnd(6); i; i--)
+			put(s, "%s ", texts[rnd(ARRAY_SIZE(texts))]);
+		put(s, "\r\n");
+	}
+}
+
+static void load(struct stream *s, const char *file)
+{
+	FILE *f = fopen(file, "rb");
+	size_t n;
+
+	if (!f)
+		Panic(0, "cannot open %s", file);
+	s->name = strrchr(file, '/') ? strrchr(file, '/') + 1 : file;
+	do {
+		if (s->len == s->size) {
+			s->size = s->size ? s->size * 2 : 1 << 16;
+			if (!(s->buf = realloc(s->buf, s->size)))
+				Panic(0, "out of memory");
+		}
+		n = fread(s->buf + s->len, 1, s->size - s->len, f);
+		s->len += n;
+	} while (n);
+	fclose(f);
+}
+
+static Window *newwin(int width, int height)
+{
+	Window *win = calloc(1, sizeof(Window));
+
+	if (!win)
+		Panic(0, "out of memory");
+	win->w_layer.l_bottom = &win->w_layer;
+	win->w_layer.l_data = (char *)win;
+	win->w_savelayer = &win->w_layer;
+	win->w_title = win->w_akachange = win->w_akabuf;
+	win->w_ptyfd = -1;
+	if (ChangeWindowSize(win, width, height, DEFAULTHISTHEIGHT))
+		Panic(0, "cannot size the window");
+	win->w_encoding = UTF8;
+	ResetWindow(win);
+	return win;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(struct stream *s, int passes, int width, int height)
+{
+	Window *win = newwin(width, height);
+	double t;
+	size_t total = 0, allocs, bytes;
+
+	/* a first pass fills the history, so that its lines get reused */
+	for (size_t off = 0; off < s->len; off += READ_SIZE)
+		WriteString(win, s->buf + off, MIN(READ_SIZE, s->len - off));
+	mallocmock_reset();
+	t = now();
+	for (int p = 0; p < passes; p++) {
+		for (size_t off = 0; off < s->len; off += READ_SIZE)
+			WriteString(win, s->buf + off, MIN(READ_SIZE, s->len - off));
+		total += s->len;
+	}
+	t = now() - t;
+	allocs = _mallocmock_malloc_count + _mallocmock_realloc_count;
+	bytes = _mallocmock_malloc_size + _mallocmock_realloc_size;
+	printf("%-12s %9.1f MB/s %8.2f ns/byte %10.1f allocs/MB %12.0f bytes/MB\n", s->name,
+	       total / t / 1e6, t * 1e9 / total, allocs * 1e6 / total, bytes * 1e6 / total);
+	ChangeWindowSize(win, 0, 0, 0);
+	free(win);
+}
+
+int main(int argc, char **argv)
+{
+	int passes = 8, width = 80, height = 24;
+	int c;
+
+	while ((c = getopt(argc, argv, "r:w:h:")) != -1) {
+		switch (c) {
+		case 'r':
+			passes = atoi(optarg);
+			break;
+		case 'w':
+			width = atoi(optarg);
+			break;
+		case 'h':
+			height = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r passes] [-w width] [-h height] [file ...]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (passes < 1 || width < 1 || height < 1) {
+		fprintf(stderr, "%s: passes, width and height must be positive\n", argv[0]);
+		return 1;
+	}
+
+	if (optind == argc) {
+		static void (*const make[])(struct stream *) = { make_plain, make_compiler, make_tui, make_cjk };
+		static const char *names[] = { "plain", "compiler", "tui", "cjk" };
+
+		for (size_t i = 0; i < ARRAY_SIZE(make); i++) {
+			struct stream s = { names[i], NULL, 0, 0 };
+
+			make[i](&s);
+			run(&s, passes, width, height);
+			free(s.buf);
+		}
+		return 0;
+	}
+	for (; optind < argc; optind++) {
+		struct stream s = { NULL, NULL, 0, 0 };
+
+		load(&s, argv[optind]);
+		if (s.len)
+			run(&s, passes, width, height);
+		free(s.buf);
+	}
+	return 0;
+}
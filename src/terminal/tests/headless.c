@@ -0,0 +1,222 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+/*
+ * A headless screen for the terminal engine: what ansi.c, encoding.c and
+ * the window model (resize.c, cell.c) call outside of themselves, for a
+ * window that is on no display. The layer calls have no canvas to draw
+ * on and the display calls no terminal to write to, so they do nothing,
+ * as they would in screen for a window nobody looks at.
+ */
+
+#include "config.h"	/* before the system headers, for strdup() */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "../screen.h"
+
+#include "../acls.h"
+#include "../backtick.h"
+#include "../canvas.h"
+#include "../checkpoint.h"
+#include "../display.h"
+#include "../events.h"
+#include "../fileio.h"
+#include "../help.h"
+#include "../layer.h"
+#include "../logfile.h"
+#include "../mark.h"
+#include "../misc.h"
+#include "../process.h"
+#include "../sched.h"
+#include "../search.h"
+#include "../socket.h"
+#include "../viewport.h"
+#include "../window.h"
+#include "../winmsg.h"
+
+/* globals of screen.c, display.c, window.c and friends */
+Display *display, *displays;
+Window *fore, *mru_window;
+Layer *flayer;
+struct acluser *EffectiveAclUser;
+char *SocketName;
+char HostName[MAXSTR] = "headless";
+char *hstatusstring = "%h", *captionstring = "%4n %t", *wliststr = "%4n %t%=%f";
+char *screenencodings;
+char *logtstamp_string;
+char strnomem[] = "Out of memory.";
+bool cjkwidth, compacthist, logtstamp_on;
+int captionalways, captiontop, events_clients, log_flush, logtstamp_after, nversion;
+off_t log_rotate_size;
+int log_rotate_keep = 1, log_durability;
+
+struct NewWindow nwin_default = {
+	.wrap = true,
+	.c1 = true,
+	.histheight = DEFAULTHISTHEIGHT,
+};
+
+/* the layer: no canvases */
+void LGotoPos(Layer *l, int x, int y) { (void)l; (void)x; (void)y; }
+void LPutChar(Layer *l, struct mchar *c, int x, int y) { (void)l; (void)c; (void)x; (void)y; }
+void LInsChar(Layer *l, struct mchar *c, int x, int y, struct mline *ol) { (void)l; (void)c; (void)x; (void)y; (void)ol; }
+void LPutStr(Layer *l, char *s, int n, struct mchar *r, int x, int y) { (void)l; (void)s; (void)n; (void)r; (void)x; (void)y; }
+void LScrollH(Layer *l, int n, int y, int xs, int xe, int bce, struct mline *ol) { (void)l; (void)n; (void)y; (void)xs; (void)xe; (void)bce; (void)ol; }
+void LScrollV(Layer *l, int n, int ys, int ye, int bce) { (void)l; (void)n; (void)ys; (void)ye; (void)bce; }
+void LClearAll(Layer *l, int uself) { (void)l; (void)uself; }
+void LClearArea(Layer *l, int xs, int ys, int xe, int ye, int bce, int uself) { (void)l; (void)xs; (void)ys; (void)xe; (void)ye; (void)bce; (void)uself; }
+void LRefreshAll(Layer *l, int isblank) { (void)l; (void)isblank; }
+void LSetRendition(Layer *l, struct mchar *r) { (void)l; (void)r; }
+void LWrapChar(Layer *l, struct mchar *c, int y, int top, int bot, bool ins) { (void)l; (void)c; (void)y; (void)top; (void)bot; (void)ins; }
+void LCursorVisibility(Layer *l, int vis) { (void)l; (void)vis; }
+void LSetFlow(Layer *l, bool flow) { (void)l; (void)flow; }
+void LKeypadMode(Layer *l, int on) { (void)l; (void)on; }
+void LCursorkeysMode(Layer *l, int on) { (void)l; (void)on; }
+void LMouseMode(Layer *l, int on) { (void)l; (void)on; }
+void LExtMouseMode(Layer *l, int on) { (void)l; (void)on; }
+void LBracketedPasteMode(Layer *l, bool on) { (void)l; (void)on; }
+void LCursorStyle(Layer *l, int style) { (void)l; (void)style; }
+void LMsg(int err, const char *fmt, ...) { (void)err; (void)fmt; }
+void ExitOverlayPage(void) { }
+const struct LayFuncs MarkLf;
+
+/* the display: none */
+void AddCStr(char *s) { (void)s; }
+void AddRawRef(char *s) { (void)s; }
+void AddStrn(char *s, int n) { (void)s; (void)n; }
+void Flush(int progress) { (void)progress; }
+void InsertMode(bool on) { (void)on; }
+void ReverseVideo(bool on) { (void)on; }
+void KillBlanker(void) { }
+void MakeStatus(char *msg) { (void)msg; }
+void Redisplay(int cur_only) { (void)cur_only; }
+void RefreshArea(int xs, int ys, int xe, int ye, int isblank) { (void)xs; (void)ys; (void)xe; (void)ye; (void)isblank; }
+void ResetIdle(void) { }
+int ResizeDisplay(int wi, int he) { (void)wi; (void)he; return 0; }
+void Resize_obuf(void) { }
+void SetXtermOSC(int i, char *s, char *t) { (void)i; (void)s; (void)t; }
+void DumpScrollbackFinish(Window *win, bool all) { (void)win; (void)all; }
+void ResizeCanvas(Canvas *cv) { (void)cv; }
+void RecreateCanvasChain(void) { }
+void RethinkViewportOffsets(Canvas *cv) { (void)cv; }
+int RethinkDisplayViewports(void) { return 0; }
+void GotoPos(int x, int y) { (void)x; (void)y; }
+void RefreshLine(int y, int xs, int xe, int isblank) { (void)y; (void)xs; (void)xe; (void)isblank; }
+void RefreshHStatus(void) { }
+void WListUpdatecv(Canvas *cv, Window *win) { (void)cv; (void)win; }
+
+/* the rest of the server */
+int AddXChar(char *buf, int ch) { buf[0] = ch; return 1; }
+char *SaveStr(const char *str) { char *s = strdup(str); if (!s) abort(); return s; }
+void Msg(int err, const char *fmt, ...) { (void)err; (void)fmt; }
+void Panic(int err, const char *fmt, ...)
+{
+	va_list ap;
+
+	(void)err;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	exit(1);
+}
+int Parse(char *buf, int bufl, char **args, int *argl) { (void)buf; (void)bufl; args[0] = NULL; argl[0] = 0; return 0; }
+void DoCommand(char **argv, int *argl) { (void)argv; (void)argl; }
+void KillWindow(Window *win) { (void)win; }
+struct acluser **FindUserPtr(char *name) { (void)name; return NULL; }
+void EventPost(const char *event, int n, const char *text) { (void)event; (void)n; (void)text; }
+Hosted *CommandHosted(void) { return NULL; }
+/* weak: tests/test-checkpoint links the real one */
+__attribute__((weak)) void CheckpointHistLine(Window *win, struct mline *ml) { (void)win; (void)ml; }
+void SearchIndexLine(Window *win, int i, struct mline *ml) { (void)win; (void)i; (void)ml; }
+void SearchIndexDrop(Window *win) { (void)win; }
+void CloseLog(Window *win) { (void)win; }
+void WindowWake(Window *win) { (void)win; }
+int logfclose(Log *l) { (void)l; return 0; }
+int logfwrite(Log *l, char *buf, size_t n) { (void)l; (void)buf; (void)n; return 0; }
+int logfflush(Log *l) { (void)l; return 0; }
+FILE *secfopen(char *name, char *mode) { (void)name; (void)mode; return NULL; }
+int secopen(char *name, int flags, int mode) { return open(name, flags, mode); }
+void (*xsignal(int sig, void (*func)(int)))(int) { return signal(sig, func); }
+int printpipe(Window *win, char *cmd) { (void)win; (void)cmd; return -1; }
+uint64_t ParseAttrColor(char *str, int msgok) { (void)str; (void)msgok; return 0; }
+char *AddWindowFlags(char *buf, int len, Window *win) { (void)len; (void)win; *buf = 0; return buf; }
+uint64_t WindowRate(Window *win) { (void)win; return 0; }
+Backtick *bt_find_id(int id) { (void)id; return NULL; }
+char *runbacktick(Backtick *bt, int *tickp, time_t now) { (void)bt; (void)tickp; (void)now; return ""; }
+void evenq(Event *ev) { (void)ev; }
+void evdeq(Event *ev) { (void)ev; }
+void SetTimeout(Event *ev, int timo) { (void)ev; (void)timo; }
+int SchedNow(void) { struct timeval tv; gettimeofday(&tv, NULL); return tv.tv_sec * 1000 + tv.tv_usec / 1000; }
+void SchedWalltime(struct timeval *tv) { gettimeofday(tv, NULL); }
+
+/* the window list of a session with only the one window: nothing before
+ * (flag 8) or after (flag 4) it */
+char *AddWindows(WinMsgBufContext *wmbc, int len, int flags, int where)
+{
+	if (flags & (4 | 8))
+		*wmbc->p = '\0';
+	else
+		snprintf(wmbc->p, len, "%d shell", where);
+	return wmbc->p;
+}
+
+void WinSyncUpdate(Window *win, bool on)
+{
+	win->w_syncupdate = on;
+}
+
+/* as in window.c */
+void ResetWindow(Window *win)
+{
+	win->w_wrap = nwin_default.wrap;
+	win->w_origin = 0;
+	win->w_insert = false;
+	win->w_revvid = 0;
+	win->w_mouse = 0;
+	win->w_bracketed = false;
+	win->w_cursorstyle = 0;
+	win->w_curinv = 0;
+	win->w_curvvis = 0;
+	win->w_autolf = 0;
+	win->w_keypad = 0;
+	win->w_cursorkeys = 0;
+	win->w_top = 0;
+	win->w_bot = win->w_height - 1;
+	win->w_saved.on = 0;
+	win->w_x = win->w_y = 0;
+	win->w_state = LIT;
+	win->w_StringType = NONE;
+	memset(win->w_tabs, 0, win->w_width);
+	for (int i = 8; i < win->w_width; i += 8)
+		win->w_tabs[i] = 1;
+	win->w_rend = mchar_null;
+	ResetCharsets(win);
+	WinSyncUpdate(win, false);
+}
@@ -25,11 +25,18 @@
 
 extern void *__libc_malloc(size_t);
 extern void *__libc_realloc(void *, size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void __libc_free(void *);
 
 /* Total number of bytes requested via *alloc */
 size_t _mallocmock_malloc_size = 0;
 size_t _mallocmock_realloc_size = 0;
 
+/* Number of calls, for counting allocations */
+size_t _mallocmock_malloc_count = 0;
+size_t _mallocmock_realloc_count = 0;
+size_t _mallocmock_free_count = 0;
+
 /* Cause calls to return NULL */
 bool _mallocmock_fail = false;
 
@@ -42,21 +49,43 @@ void *malloc(size_t size)
 		return NULL;
 
 	_mallocmock_malloc_size += size;
+	_mallocmock_malloc_count++;
 	return __libc_malloc(size);
 }
 
+void *calloc(size_t n, size_t size)
+{
+	if (_mallocmock_fail)
+		return NULL;
+
+	_mallocmock_malloc_size += n * size;
+	_mallocmock_malloc_count++;
+	return __libc_calloc(n, size);
+}
+
 void *realloc(void *ptr, size_t size)
 {
 	if (_mallocmock_fail)
 		return NULL;
 
 	_mallocmock_realloc_size += size;
+	_mallocmock_realloc_count++;
 	return __libc_realloc(ptr, size);
 }
 
+void free(void *ptr)
+{
+	if (ptr)
+		_mallocmock_free_count++;
+	__libc_free(ptr);
+}
+
 void mallocmock_reset()
 {
 	_mallocmock_malloc_size = 0;
 	_mallocmock_realloc_size = 0;
+	_mallocmock_malloc_count = 0;
+	_mallocmock_realloc_count = 0;
+	_mallocmock_free_count = 0;
 }
 #endif
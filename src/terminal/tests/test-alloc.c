@@ -0,0 +1,287 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+/*
+ * Allocations of the hot paths in their steady state, on a headless
+ * screen (see headless.c): output parsed and scrolled into the history,
+ * a window resized back and forth and a hardstatus rendered. Each is
+ * warmed up first, so that what is left is what every further MB of
+ * output, resize or rendering costs, and held to a budget.
+ *
+ * A budget is a ceiling, not a target: lower it when a change makes a
+ * path cheaper, and raise it only with a reason.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../screen.h"
+#include "../ansi.h"
+#include "../misc.h"
+#include "../resize.h"
+#include "../window.h"
+#include "../winmsg.h"
+#include "macros.h"
+
+extern size_t _mallocmock_malloc_count, _mallocmock_realloc_count, _mallocmock_free_count;
+
+#define STREAM_SIZE	(1 << 20)	/* bytes of output replayed */
+#define READ_SIZE	4096		/* bytes of a pty read */
+#define RESIZES		200		/* resizes, half of them back */
+#define RENDERINGS	10000		/* hardstatus renderings */
+
+/*
+ * Budgets: calls to malloc, calloc and realloc (allocs) and to free per
+ * MB of output, per resize and per rendering. A line scrolled into the
+ * history reuses the buffer of the one it pushes out, which is kept at
+ * the size of the window's longest line so far, unless it has too many
+ * style runs for it (packed cells) or the other way round. A resize
+ * builds the new grid and rewraps the history, a few arrays a line.
+ */
+static const struct budget {
+	const char *name, *unit;
+	double allocs, frees;
+} budgets[] = {
+	/* a log scrolling into the history */
+	{ "plain",	"MB",		0,	0 },
+	/* compiler output, rendition changes */
+	{ "colored",	"MB",		0,	0 },
+	/* CJK, emoji and combining marks */
+	{ "wide",	"MB",		6000,	6000 },
+	/* full screen frames, cursor moves */
+	{ "tui",	"MB",		0,	0 },
+	/* 80x24 to 132x43 and back, full history */
+	{ "resize",	"resize",	600,	600 },
+	/* a hardstatus with windows and time, the zone reread once a second */
+	{ "status",	"rendering",	0.001,	0.001 },
+};
+
+static size_t allocs, frees;
+
+static void counted(void)
+{
+	allocs = _mallocmock_malloc_count + _mallocmock_realloc_count;
+	frees = _mallocmock_free_count;
+}
+
+static void check(const char *name, double units)
+{
+	const struct budget *b = NULL;
+
+	for (size_t i = 0; i < SIZEOF(budgets); i++)
+		if (!strcmp(budgets[i].name, name))
+			b = &budgets[i];
+	ASSERT(b);
+	printf("%-8s %10.1f allocs %10.1f frees per %-9s (budget %g, %g)\n", name, allocs / units, frees / units,
+	       b->unit, b->allocs, b->frees);
+	ASSERT(allocs <= b->allocs * units);
+	ASSERT(frees <= b->frees * units);
+}
+
+struct stream {
+	char *buf;
+	size_t len, size;
+};
+
+static unsigned long seed = 1;
+
+static unsigned long rnd(unsigned long n)
+{
+	seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+	return (seed >> 33) % n;
+}
+
+static void put(struct stream *s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void put(struct stream *s, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(s->buf + s->len, s->size - s->len, fmt, ap);
+		va_end(ap);
+		if (n >= 0 && (size_t)n < s->size - s->len)
+			break;
+		s->size = s->size * 2 + n + 1;
+		s->buf = realloc(s->buf, s->size);
+		ASSERT(s->buf);
+	}
+	s->len += n;
+}
+
+static const char *words[] = {
+	"request", "worker", "processed", "cache", "miss", "session", "flush",
+	"upstream", "latency", "retry", "connection", "accepted", "closed", "queue",
+};
+
+static void make_plain(struct stream *s)
+{
+	while (s->len < STREAM_SIZE) {
+		put(s, "2026-10-14 08:%02lu:%02lu.%03lu INFO [worker-%lu]", rnd(60), rnd(60), rnd(1000), rnd(16));
+		for (unsigned long i = 3 + rnd(10); i; i--)
+			put(s, " %s", words[rnd(SIZEOF(words))]);
+		put(s, " id=%lu\r\n", rnd(100000));
+	}
+}
+
+static void make_colored(struct stream *s)
+{
+	while (s->len < STREAM_SIZE) {
+		int err = !rnd(3);
+
+		put(s, "\033[01m\033[Ksrc/%s.c:%lu:%lu:\033[m\033[K \033[01;%sm\033[K%s:\033[m\033[K unused '\033[01m\033[K%s\033[m\033[K'\r\n",
+		    words[rnd(SIZEOF(words))], 1 + rnd(2000), 1 + rnd(60), err ? "31" : "35", err ? "error" : "warning",
+		    words[rnd(SIZEOF(words))]);
+		put(s, "      |   int \033[01;%sm\033[K%s\033[m\033[K = %lu;\r\n", err ? "31" : "35",
+		    words[rnd(SIZEOF(words))], rnd(100));
+		put(s, "      |       \033[01;%sm\033[K^~~~~~~\033[m\033[K\r\n", err ? "31" : "35");
+	}
+}
+
+static void make_wide(struct stream *s)
+{
+	static const char *texts[] = {
+		"\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\x86\xe3\x82\xad\xe3\x82\xb9\xe3\x83\x88",	/* 日本語のテキスト */
+		"\xf0\x9f\x98\x80\xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd",							/* 😀👍🏽 */
+		"caf\x65\xcc\x81",											/* café, decomposed e */
+		"ok",
+	};
+
+	while (s->len < STREAM_SIZE) {
+		for (unsigned long i = 2 + rnd(6); i; i--)
+			put(s, "%s ", texts[rnd(SIZEOF(texts))]);
+		put(s, "\r\n");
+	}
+}
+
+static void make_tui(struct stream *s)
+{
+	while (s->len < STREAM_SIZE) {
+		put(s, "\033[?2026h\033[?25l");
+		for (int y = 10; y < 20; y++) {
+			put(s, "\033[%d;1H\033[38;2;%lu;%lu;%lum", y, rnd(256), rnd(256), rnd(256));
+			for (unsigned long i = 2 + rnd(8); i; i--)
+				put(s, "%s ", words[rnd(SIZEOF(words))]);
+			put(s, "\033[39m\033[K");
+		}
+		put(s, "\033[21;1H\033[2m> \033[22m%s\033[m\033[K\033[?25h\033[?2026l", words[rnd(SIZEOF(words))]);
+	}
+}
+
+static Window *newwin(int width, int height)
+{
+	Window *win = calloc(1, sizeof(Window));
+
+	ASSERT(win);
+	win->w_layer.l_bottom = &win->w_layer;
+	win->w_layer.l_data = (char *)win;
+	win->w_savelayer = &win->w_layer;
+	win->w_title = win->w_akachange = win->w_akabuf;
+	win->w_ptyfd = -1;
+	/* on the list of windows, whose lines a wider window's blank and
+	 * null arrays get swapped into */
+	mru_window = win;
+	ASSERT(ChangeWindowSize(win, width, height, DEFAULTHISTHEIGHT) == 0);
+	win->w_encoding = UTF8;
+	ResetWindow(win);
+	return win;
+}
+
+static void freewin(Window *win)
+{
+	ChangeWindowSize(win, 0, 0, 0);
+	mru_window = NULL;
+	free(win);
+}
+
+static void replay(Window *win, struct stream *s)
+{
+	for (size_t off = 0; off < s->len; off += READ_SIZE)
+		WriteString(win, s->buf + off, MIN(READ_SIZE, s->len - off));
+}
+
+static void parse(const char *name, void (*make)(struct stream *))
+{
+	struct stream s = { NULL, 0, 0 };
+	Window *win = newwin(80, 24);
+
+	make(&s);
+	/* a first pass fills the history and interns the styles */
+	replay(win, &s);
+	mallocmock_reset();
+	replay(win, &s);
+	counted();
+	check(name, s.len / 1e6);
+	freewin(win);
+	free(s.buf);
+}
+
+static void resize(void)
+{
+	struct stream s = { NULL, 0, 0 };
+	Window *win = newwin(80, 24);
+
+	make_colored(&s);
+	replay(win, &s);
+	ChangeWindowSize(win, 132, 43, DEFAULTHISTHEIGHT);
+	ChangeWindowSize(win, 80, 24, DEFAULTHISTHEIGHT);
+	mallocmock_reset();
+	for (int i = 0; i < RESIZES / 2; i++) {
+		ASSERT(ChangeWindowSize(win, 132, 43, DEFAULTHISTHEIGHT) == 0);
+		ASSERT(ChangeWindowSize(win, 80, 24, DEFAULTHISTHEIGHT) == 0);
+	}
+	counted();
+	check("resize", RESIZES);
+	freewin(win);
+	free(s.buf);
+}
+
+static void status(void)
+{
+	static char hstatus[] = "%{= kw}%H %-w%{= BW}%n %t%{-}%+w %=%?%R %R/s %?%c:%s %d.%m.%Y";
+	Window *win = newwin(80, 24);
+
+	strcpy(win->w_akabuf, "build");
+	win->w_number = 3;
+	MakeWinMsg(hstatus, win, '%');
+	mallocmock_reset();
+	for (int i = 0; i < RENDERINGS; i++)
+		ASSERT(*MakeWinMsg(hstatus, win, '%'));
+	counted();
+	check("status", RENDERINGS);
+	freewin(win);
+}
+
+int main(void)
+{
+	parse("plain", make_plain);
+	parse("colored", make_colored);
+	parse("wide", make_wide);
+	parse("tui", make_tui);
+	resize();
+	status();
+	return 0;
+}
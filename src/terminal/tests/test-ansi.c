@@ -0,0 +1,130 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+/*
+ * WriteString() leaves the same screen whether output comes in one
+ * piece, where the fast paths take the ASCII inside the UTF-8 lookahead,
+ * or a byte at a time, where there is none to speak of.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../screen.h"
+#include "../ansi.h"
+#include "../resize.h"
+#include "../window.h"
+#include "macros.h"
+
+static Window *newwin(int width, int height)
+{
+	Window *win = calloc(1, sizeof(Window));
+
+	ASSERT(win);
+	win->w_layer.l_bottom = &win->w_layer;
+	win->w_layer.l_data = (char *)win;
+	win->w_savelayer = &win->w_layer;
+	win->w_title = win->w_akachange = win->w_akabuf;
+	win->w_ptyfd = -1;
+	mru_window = win;
+	ASSERT(ChangeWindowSize(win, width, height, DEFAULTHISTHEIGHT) == 0);
+	win->w_encoding = UTF8;
+	ResetWindow(win);
+	return win;
+}
+
+static void freewin(Window *win)
+{
+	ChangeWindowSize(win, 0, 0, 0);
+	mru_window = NULL;
+	free(win);
+}
+
+/* the cells, cursor and title of a and b agree */
+static bool same(Window *a, Window *b)
+{
+	size_t n = a->w_width * sizeof(uint32_t);
+
+	if (a->w_x != b->w_x || a->w_y != b->w_y || strcmp(a->w_title, b->w_title))
+		return false;
+	for (int y = 0; y < a->w_height; y++) {
+		struct mline *ma = &a->w_mlines[y], *mb = &b->w_mlines[y];
+
+		if (memcmp(ma->image, mb->image, n) || memcmp(ma->attr, mb->attr, n)
+		    || memcmp(ma->font, mb->font, n) || memcmp(ma->colorbg, mb->colorbg, n)
+		    || memcmp(ma->colorfg, mb->colorfg, n))
+			return false;
+	}
+	return true;
+}
+
+/* s in one piece into one window and a byte at a time into another */
+static bool agree(const char *s)
+{
+	Window *a = newwin(80, 24), *b = newwin(80, 24);
+	size_t len = strlen(s);
+	char *buf = malloc(len);
+	bool ok;
+
+	ASSERT(buf);
+	memcpy(buf, s, len);
+	WriteString(a, buf, len);
+	memcpy(buf, s, len);
+	for (size_t i = 0; i < len; i++)
+		WriteString(b, buf + i, 1);
+	ok = same(a, b);
+	freewin(a);
+	freewin(b);
+	free(buf);
+	return ok;
+}
+
+int main(void)
+{
+	char long_line[4096];
+	size_t n = 0;
+
+	/* text between SGR sequences, as ls --color and compilers write it */
+	ASSERT(agree("\033[01;34mbin\033[0m  \033[01;32mconfigure\033[0m  README\r\n"
+		     "src/ansi.c:359:9: \033[01;35mwarning:\033[m unused \xe2\x80\x98x\xe2\x80\x99\r\n"));
+	/* wide and combining characters between the runs */
+	ASSERT(agree("\033[31m\xe6\x97\xa5\xe6\x9c\xac\033[m text caf\x65\xcc\x81 \033[1m\xf0\x9f\x98\x80 ok\033[m\r\n"));
+	/* runs reaching the end of the line wrap as the slow path does */
+	ASSERT(agree("\033[32m0123456789012345678901234567890123456789"
+		     "0123456789012345678901234567890123456789wrapped\033[m\r\n"));
+	/* a title, UTF-8 and ASCII, in between */
+	ASSERT(agree("\033]0;build \xe2\x9c\xb3 done\007\033[1mafter\033[m\033]2;plain title\033\\x"));
+	/* a sequence cut off at the end */
+	ASSERT(agree("\033[33mtext \xe2\x94"));
+
+	/* more than a lookahead's worth of code points */
+	for (int i = 0; i < 200; i++)
+		n += snprintf(long_line + n, sizeof(long_line) - n, "\033[3%dm%c\xc3\xa9", i % 8, 'a' + i % 26);
+	n += snprintf(long_line + n, sizeof(long_line) - n, "\r\n");
+	for (int i = 0; i < 40; i++)
+		n += snprintf(long_line + n, sizeof(long_line) - n, "\033[m%d plain words\r\n", i);
+	ASSERT(agree(long_line));
+	return 0;
+}
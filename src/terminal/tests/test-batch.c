@@ -0,0 +1,99 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+/*
+ * The exit status of -X - against a real session of the screen built
+ * here: 0 when every line of the batch worked, and not when one was no
+ * command or a command that reported an error.
+ *
+ *	test-batch [screen]
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "macros.h"
+
+static const char *screen = "./screen";
+static char sockdir[] = "/tmp/test-batch.XXXXXX";
+static const char session[] = "test-batch";
+
+/* The exit status of screen -S name -X - with lines on its stdin */
+static int batch_on(const char *name, const char *lines)
+{
+	char cmd[1024];
+	int status;
+
+	snprintf(cmd, sizeof(cmd), "printf '%s' | '%s' -S %s -X - >/dev/null 2>&1", lines, screen, name);
+	status = system(cmd);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int batch(const char *lines)
+{
+	return batch_on(session, lines);
+}
+
+int main(int argc, char **argv)
+{
+	char cmd[1024];
+	int tries;
+
+	if (argc > 1)
+		screen = argv[1];
+	if (!mkdtemp(sockdir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	setenv("SCREENDIR", sockdir, 1);
+	setenv("TERM", "xterm", 1);
+	snprintf(cmd, sizeof(cmd), "'%s' -c /dev/null -dmS %s sleep 60", screen, session);
+	ASSERT(system(cmd) == 0);
+
+	/* the session takes a moment to listen */
+	for (tries = 0; tries < 50 && batch("echo up\\n") != 0; tries++)
+		usleep(100000);
+	ASSERT(tries < 50);
+
+	ASSERT(batch("echo one\\necho two\\n") == 0);
+	ASSERT(batch("nosuchcommand\\n") != 0);
+	ASSERT(batch("echo one\\nnosuchcommand\\necho two\\n") != 0);
+	ASSERT(batch("select 99\\n") != 0);
+	ASSERT(batch("echo\\n") != 0);
+	ASSERT(batch("echo again\\n") == 0);
+
+	/* a hosted session, window 1, gets at its own windows only */
+	ASSERT(batch("screen -S test-hosted sleep 60\\n") == 0);
+	ASSERT(batch_on("test-hosted", "at 1 echo x\\n") == 0);
+	ASSERT(batch_on("test-hosted", "at 0 echo x\\n") != 0);
+	ASSERT(batch_on("test-hosted", "at sleep echo x\\n") == 0);
+	ASSERT(batch("at 1 echo x\\n") != 0);
+
+	batch("quit\\n");
+	snprintf(cmd, sizeof(cmd), "rm -rf '%s'", sockdir);
+	return system(cmd) != 0;
+}
@@ -0,0 +1,329 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+
+#include <string.h>
+
+#include "../cell.h"
+#include "signature.h"
+#include "macros.h"
+
+SIGNATURE_CHECK(cell_style, uint32_t, (uint32_t, uint32_t, uint32_t, uint32_t));
+SIGNATURE_CHECK(cell_getstyle, const struct mstyle *, (uint32_t));
+SIGNATURE_CHECK(cell_nstyles, size_t, (void));
+SIGNATURE_CHECK(cell_pack, int, (struct hline *, struct mline *, int, struct hlinehigh *));
+SIGNATURE_CHECK(cell_unpack, int, (struct mline *, const struct hline *, int));
+SIGNATURE_CHECK(cell_free, void, (struct hline *));
+SIGNATURE_CHECK(cell_size, void, (const struct hline *, size_t *, size_t *));
+SIGNATURE_CHECK(cell_freeze_copy, char *, (const struct hline *, int, int, size_t *));
+
+#define W 81
+
+/* the high water of the lines packed here, as a window keeps it */
+static struct hlinehigh high;
+
+static uint32_t image[W], attr[W], font[W], colorbg[W], colorfg[W];
+static struct mline ml = { image, attr, font, colorbg, colorfg };
+
+static uint32_t image2[W], attr2[W], font2[W], colorbg2[W], colorfg2[W];
+static struct mline ml2 = { image2, attr2, font2, colorbg2, colorfg2 };
+
+static void clear(void)
+{
+	for (int x = 0; x < W; x++)
+		image[x] = ' ';
+	memset(attr, 0, sizeof(attr));
+	memset(font, 0, sizeof(font));
+	memset(colorbg, 0, sizeof(colorbg));
+	memset(colorfg, 0, sizeof(colorfg));
+}
+
+static bool same(void)
+{
+	return !memcmp(image, image2, sizeof(image)) && !memcmp(attr, attr2, sizeof(attr))
+	    && !memcmp(font, font2, sizeof(font)) && !memcmp(colorbg, colorbg2, sizeof(colorbg))
+	    && !memcmp(colorfg, colorfg2, sizeof(colorfg));
+}
+
+int main(void)
+{
+	struct hline hl = { NULL, NULL, 0, 0, 0 };
+
+	/* the default style needs no interning */
+	ASSERT(cell_style(0, 0, 0, 0) == 0);
+	ASSERT(cell_nstyles() == 1);
+	ASSERT(cell_getstyle(0)->attr == 0 && cell_getstyle(0)->colorfg == 0);
+
+	/* styles are interned */
+	{
+		uint32_t a = cell_style(1, 0, 0, 0x04ff0000);
+		uint32_t b = cell_style(2, 0, 0, 0x04ff0000);
+
+		ASSERT(a != 0 && b != 0 && a != b);
+		ASSERT(cell_style(1, 0, 0, 0x04ff0000) == a);
+		ASSERT(cell_getstyle(a)->attr == 1 && cell_getstyle(a)->colorfg == 0x04ff0000);
+		ASSERT(cell_getstyle(a | MCELL_FONTIMG) == cell_getstyle(a));
+		for (uint32_t i = 0; i < 5000; i++)
+			ASSERT(cell_style(0, 0, 0, 0x04000000 | i) == cell_style(0, 0, 0, 0x04000000 | i));
+		ASSERT(cell_style(2, 0, 0, 0x04ff0000) == b);
+		ASSERT(cell_nstyles() == 5003);
+	}
+
+	/* blank lines keep nothing */
+	clear();
+	ASSERT(cell_pack(&hl, &ml, W, &high) == 0);
+	ASSERT(!hl.image && !hl.cells);
+	ASSERT(cell_unpack(&ml2, &hl, W) == 0);
+	ASSERT(same());
+
+	/* plain lines only keep their code points, UTF-8 fonts included */
+	clear();
+	memcpy(image, (uint32_t[]){ 'a', 'b', 0x4e2d, 0xff }, 4 * sizeof(uint32_t));
+	font[2] = 0x4e;
+	font[3] = 0;
+	image[W - 1] = 0;
+	ASSERT(cell_pack(&hl, &ml, W, &high) == 0);
+	ASSERT(hl.image && !hl.cells);
+	ASSERT(cell_unpack(&ml2, &hl, W) == CELL_FONT);
+	ASSERT(same());
+
+	/* lines with a few renditions keep style runs */
+	clear();
+	for (int x = 0; x < 40; x++) {
+		image[x] = 'A' + x % 26;
+		attr[x] = x < 20 ? 1 : 0;
+		colorfg[x] = x < 10 ? 0x04123456 : 0;
+		colorbg[x] = x >= 30 ? 4 : 0;
+	}
+	image[40] = 0xff;	/* right half of a double width char */
+	font[40] = 0xff;
+	ASSERT(cell_pack(&hl, &ml, W, &high) == 0);
+	ASSERT(hl.image && !hl.cells && hl.nruns == 5 && hl.len == 41);
+	ASSERT(HLINE_RUNS(&hl)[1].x == 10);
+	ASSERT(HLINE_RUNS(&hl)[4].x == 40 && !(HLINE_RUNS(&hl)[4].style & MCELL_FONTIMG));
+	ASSERT(cell_unpack(&ml2, &hl, W) == (CELL_ATTR | CELL_FONT | CELL_COLORBG | CELL_COLORFG));
+	ASSERT(same());
+
+	/* lines changing rendition all the time keep packed cells */
+	for (int x = 0; x < W; x++)
+		attr[x] = x & 1;
+	ASSERT(cell_pack(&hl, &ml, W, &high) == 0);
+	ASSERT(!hl.image && hl.cells && hl.nruns == 0);
+	ASSERT(MCELL_STYLE(hl.cells[0].style) == MCELL_STYLE(hl.cells[2].style));
+	ASSERT(MCELL_STYLE(hl.cells[0].style) != MCELL_STYLE(hl.cells[1].style));
+	ASSERT(!(hl.cells[40].style & MCELL_FONTIMG));
+	ASSERT(hl.cells[50].style & MCELL_FONTIMG);
+	ASSERT(cell_unpack(&ml2, &hl, W) == (CELL_ATTR | CELL_FONT | CELL_COLORBG | CELL_COLORFG));
+	ASSERT(same());
+
+	/* and go back to plain, trailing blanks left out */
+	clear();
+	image[0] = 'x';
+	ASSERT(cell_pack(&hl, &ml, W, &high) == 0);
+	ASSERT(hl.image && !hl.cells && hl.nruns == 0 && hl.len == 1);
+	ASSERT(cell_unpack(&ml2, &hl, W) == 0);
+	ASSERT(same());
+
+	/* trailing blanks with a rendition are kept */
+	clear();
+	image[0] = 'x';
+	for (int x = 60; x < W; x++)
+		colorbg[x] = 4;
+	ASSERT(cell_pack(&hl, &ml, W, &high) == 0);
+	ASSERT(hl.image && hl.nruns == 2 && hl.len == W);
+	ASSERT(cell_unpack(&ml2, &hl, W) == CELL_COLORBG);
+	ASSERT(same());
+
+	/* a short line reuses the buffer of a longer one, which keeps the
+	 * size of the longest line so far */
+	{
+		size_t img = 0, rend = 0;
+		uint32_t *buf;
+		int room;
+
+		cell_free(&hl);
+		clear();
+		for (int x = 0; x < 40; x++)
+			image[x] = 'a';
+		ASSERT(cell_pack(&hl, &ml, W, &high) == 0);
+		buf = hl.image;
+		room = hl.room;
+		ASSERT(room >= 40);
+		image[30] = ' ';
+		for (int x = 31; x < 40; x++)
+			image[x] = ' ';
+		ASSERT(cell_pack(&hl, &ml, W, &high) == 0);
+		ASSERT(hl.image == buf && hl.len == 30 && hl.room == room);
+		ASSERT(cell_unpack(&ml2, &hl, W) == 0);
+		ASSERT(same());
+		cell_size(&hl, &img, &rend);
+		ASSERT(img == room * sizeof(uint32_t) && rend == 0);
+		/* and so does one much shorter */
+		clear();
+		image[0] = 'x';
+		ASSERT(cell_pack(&hl, &ml, W, &high) == 0);
+		ASSERT(hl.image == buf && hl.len == 1 && hl.room == room);
+	}
+
+	/* the high water is the caller's: a line with many runs leaves its
+	 * room to the lines of the same user only */
+	{
+		struct hlinehigh other = { 0, 0 };
+		int room;
+
+		clear();
+		for (int x = 0; x < 80; x++) {
+			image[x] = 'a';
+			colorfg[x] = x / 3 % 2;
+		}
+		ASSERT(cell_pack(&hl, &ml, W, &high) == 0);
+		ASSERT(hl.image && hl.nruns == 27);
+		room = hl.room;
+		ASSERT(room > W && high.image == room);
+		clear();
+		image[0] = 'x';
+		ASSERT(cell_pack(&hl, &ml, W, &other) == 0);
+		ASSERT(hl.len == 1 && hl.room == W && other.image == W);
+		ASSERT(cell_pack(&hl, &ml, W, &high) == 0);
+		ASSERT(hl.room == W);
+		/* and without one only a line a good deal shorter reallocates */
+		ASSERT(cell_pack(&hl, &ml, W, NULL) == 0);
+		ASSERT(hl.len == 1 && hl.room == 1);
+	}
+
+	/* identical lines share one copy, which goes with its last user */
+	{
+		struct hline a = { NULL, NULL, 0, 0, 0 }, b = a, c = a;
+		size_t img = 0, rend = 0;
+
+		clear();
+		for (int x = 0; x < 20; x++) {
+			image[x] = '-';
+			colorfg[x] = x < 10 ? 2 : 0;
+		}
+		ASSERT(cell_pack(&a, &ml, W, &high) == 0 && cell_pack(&b, &ml, W, &high) == 0);
+		image[0] = '+';
+		ASSERT(cell_pack(&c, &ml, W, &high) == 0);
+		cell_share(&a);
+		cell_share(&b);
+		cell_share(&c);
+		ASSERT(a.image == b.image && a.image != c.image);
+		ASSERT(a.room == 0 && a.len == 20 && a.nruns == 2);
+		ASSERT(cell_shared_saved() == 20 * sizeof(uint32_t) + 2 * sizeof(struct mrun));
+		ASSERT(cell_unpack(&ml2, &c, W) == CELL_COLORFG);
+		ASSERT(same());
+		image[0] = '-';
+		ASSERT(cell_unpack(&ml2, &a, W) == CELL_COLORFG);
+		ASSERT(same());
+		cell_size(&a, &img, &rend);
+		ASSERT(img > 10 * sizeof(uint32_t) && img < 20 * sizeof(uint32_t) && rend == sizeof(struct mrun));
+		/* packing into a shared line leaves the copy alone */
+		clear();
+		image[0] = 'x';
+		ASSERT(cell_pack(&a, &ml, W, &high) == 0);
+		ASSERT(a.image != b.image && a.room >= 1 && cell_shared_saved() == 0);
+		ASSERT(b.image[0] == '-' && b.len == 20);
+		cell_free(&a);
+		cell_free(&b);
+		cell_free(&c);
+		ASSERT(cell_shared_size() == 1024 * sizeof(void *));
+	}
+
+	/* blocks of lines freeze and thaw */
+	{
+		struct hline block[64];
+
+		memset(block, 0, sizeof(block));
+		for (int i = 0; i < 64; i++) {
+			clear();
+			for (int x = 0; x < i; x++) {
+				image[x] = 'a' + x % 26;
+				attr[x] = i % 3 == 0 ? 1 : 0;
+				colorfg[x] = i % 5 == 0 ? (x & 1) + 1 : 0;
+			}
+			ASSERT(cell_pack(block + i, &ml, W, &high) == 0);
+		}
+		size_t len;
+		char *data = cell_freeze(block, 64, W, &len);
+
+		ASSERT(data != NULL && len < 64 * W);
+		for (int i = 0; i < 64; i++)
+			ASSERT(!block[i].image && !block[i].cells);
+		ASSERT(cell_thaw(block, 64, W, data, len) == 0);
+		for (int i = 0; i < 64; i++) {
+			clear();
+			for (int x = 0; x < i; x++) {
+				image[x] = 'a' + x % 26;
+				attr[x] = i % 3 == 0 ? 1 : 0;
+				colorfg[x] = i % 5 == 0 ? (x & 1) + 1 : 0;
+			}
+			cell_unpack(&ml2, block + i, W);
+			ASSERT(same());
+			cell_free(block + i);
+		}
+		/* a damaged block is refused */
+		data[len / 2] ^= 0xff;
+		data[len / 2 + 1] ^= 0x55;
+		if (cell_thaw(block, 64, W, data, len) == 0)
+			for (int i = 0; i < 64; i++)
+				cell_free(block + i);
+		free(data);
+	}
+
+	/* incompressible lines stay within cell_frozen_max() */
+	{
+		struct hline block[64];
+		uint32_t seed = 1;
+
+		memset(block, 0, sizeof(block));
+		for (int i = 0; i < 64; i++) {
+			for (int x = 0; x < W; x++) {
+				seed = seed * 1103515245 + 12345;
+				image[x] = seed >> 8;
+				attr[x] = seed & 0xff;
+				font[x] = 0;
+				colorbg[x] = seed >> 16;
+				colorfg[x] = seed >> 4;
+			}
+			ASSERT(cell_pack(block + i, &ml, W, &high) == 0);
+			ASSERT(block[i].cells != NULL);
+		}
+		size_t len, copylen;
+		char *copy = cell_freeze_copy(block, 64, W, &copylen);
+
+		/* a copy leaves the lines as they are */
+		ASSERT(copy != NULL);
+		for (int i = 0; i < 64; i++)
+			ASSERT(block[i].cells != NULL);
+		char *data = cell_freeze(block, 64, W, &len);
+
+		ASSERT(data != NULL && len <= cell_frozen_max(64, W));
+		ASSERT(len == copylen && !memcmp(data, copy, len));
+		free(copy);
+		free(data);
+	}
+
+	cell_free(&hl);
+	ASSERT(!hl.image && !hl.cells);
+
+	return 0;
+}
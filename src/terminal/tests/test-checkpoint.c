@@ -0,0 +1,116 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+
+/*
+ * The journal of a checkpoint keeps the lines scrolling into the history
+ * at the width of the checkpoint; once the window is resized it stops
+ * until the next full checkpoint, without looking at the new lines with
+ * the old width.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../screen.h"
+#include "../ansi.h"
+#include "../checkpoint.h"
+#include "../resize.h"
+#include "../window.h"
+#include "macros.h"
+
+static char dir[] = "/tmp/test-checkpoint.XXXXXX";
+static char name[sizeof(dir) + 16];
+
+/* the cwd of a window, from its process in screen */
+void WindowCwd(Window *win, char *buf, size_t size) { (void)win; snprintf(buf, size, "/"); }
+
+static Window *newwin(int width, int height)
+{
+	Window *win = calloc(1, sizeof(Window));
+
+	ASSERT(win);
+	win->w_layer.l_bottom = &win->w_layer;
+	win->w_layer.l_data = (char *)win;
+	win->w_savelayer = &win->w_layer;
+	win->w_title = win->w_akachange = win->w_akabuf;
+	win->w_ptyfd = -1;
+	mru_window = win;
+	ASSERT(ChangeWindowSize(win, width, height, DEFAULTHISTHEIGHT) == 0);
+	win->w_encoding = UTF8;
+	ResetWindow(win);
+	return win;
+}
+
+/* scrolls n full lines into the history */
+static void scroll(Window *win, int n)
+{
+	char line[256];
+
+	memset(line, 'x', win->w_width);
+	for (int i = 0; i < n; i++) {
+		WriteString(win, line, win->w_width);
+		WriteString(win, "\r\n", 2);
+	}
+}
+
+int main(void)
+{
+	Window *win;
+	size_t empty;
+
+	ASSERT(mkdtemp(dir));
+	snprintf(name, sizeof(name), "%s/ckpt", dir);
+	checkpoint_name = name;
+	checkpoint_journal = 1;
+	win = newwin(80, 24);
+	scroll(win, 30);
+
+	/* lines scrolled off after the checkpoint wait for the journal */
+	ASSERT(CheckpointWrite(win) == 0);
+	empty = CheckpointSize(win);
+	scroll(win, 30);
+	ASSERT(CheckpointSize(win) > empty);
+
+	/* narrowed, the next line stops it */
+	ASSERT(ChangeWindowSize(win, 40, 24, DEFAULTHISTHEIGHT) == 0);
+	scroll(win, 30);
+	ASSERT(CheckpointSize(win) == empty);
+
+	/* and a checkpoint at the new width starts it again */
+	ASSERT(CheckpointWrite(win) == 0);
+	scroll(win, 30);
+	ASSERT(CheckpointSize(win) > empty);
+
+	CheckpointFree(win);
+	ChangeWindowSize(win, 0, 0, 0);
+	free(win);
+	unlink(name);
+	strcat(name, ".jnl");
+	unlink(name);
+	rmdir(dir);
+	return 0;
+}
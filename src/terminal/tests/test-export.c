@@ -0,0 +1,185 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+/*
+ * The export command's renderings of history lines: trailing blanks cut
+ * off, SGR sequences only where the rendition changes and reset at the
+ * end of a line, HTML escaped and in spans, and a line running past the
+ * export buffer written out in pieces without losing any of it.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../screen.h"
+#include "../ansi.h"
+#include "../encoding.h"
+#include "../export.h"
+#include "macros.h"
+
+#define WIDTH 16
+
+static uint32_t image[WIDTH], attr[WIDTH], font[WIDTH], colorbg[WIDTH], colorfg[WIDTH];
+static struct mline ml = { image, attr, font, colorbg, colorfg };
+
+static void line(const char *s)
+{
+	memset(attr, 0, sizeof(attr));
+	memset(font, 0, sizeof(font));
+	memset(colorbg, 0, sizeof(colorbg));
+	memset(colorfg, 0, sizeof(colorfg));
+	for (int x = 0; x < WIDTH; x++)
+		image[x] = *s ? (unsigned char)*s++ : ' ';
+}
+
+/* what exporting the line in format gives, up to and with the newline */
+static char *export(int format)
+{
+	static char buf[4096];
+	struct export ex;
+	FILE *f = tmpfile();
+	size_t n;
+
+	ASSERT(f);
+	ASSERT(ExportBegin(&ex, fileno(f), format, UTF8, "t<1>"));
+	ExportLine(&ex, &ml, WIDTH);
+	ASSERT(ExportEnd(&ex) == 0);
+	rewind(f);
+	n = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[n] = 0;
+	fclose(f);
+	if (format == EXPORT_HTML) {
+		char *p = strstr(buf, "<pre");
+
+		ASSERT(p && (p = strchr(p, '>')));
+		memmove(buf, p + 1, strlen(p + 1) + 1);
+		ASSERT((p = strstr(buf, "</pre>")));
+		*p = 0;
+	}
+	return buf;
+}
+
+int main(void)
+{
+	/* plain text */
+	line("hello   ");
+	ASSERT(!strcmp(export(EXPORT_PLAIN), "hello\n"));
+	ASSERT(!strcmp(export(EXPORT_ANSI), "hello\n"));
+	ASSERT(!strcmp(export(EXPORT_HTML), "hello\n"));
+	line("");
+	ASSERT(!strcmp(export(EXPORT_PLAIN), "\n"));
+
+	/* code points above ASCII in UTF-8, the filler of a wide one dropped */
+	line("a");
+	image[1] = 0x65e5;
+	image[2] = 0xff;
+	font[2] = 0xff;
+	image[3] = 'b';
+	ASSERT(!strcmp(export(EXPORT_PLAIN), "a\xe6\x97\xa5" "b\n"));
+
+	/* renditions */
+	line("ab cd");
+	attr[1] = A_BD;
+	colorfg[1] = 0x01000000 | 1;
+	colorfg[3] = colorfg[4] = 0x02000000 | 196;
+	ASSERT(!strcmp(export(EXPORT_PLAIN), "ab cd\n"));
+	ASSERT(!strcmp(export(EXPORT_ANSI), "a\033[0;1;31mb\033[0m \033[0;38;5;196mcd\033[m\n"));
+	ASSERT(!strcmp(export(EXPORT_HTML),
+		       "a<span style=\"color:#cd0000;font-weight:bold\">b</span> "
+		       "<span style=\"color:#ff0000\">cd</span>\n"));
+
+	line("x");
+	colorbg[0] = 0x04000000 | 0x102030;
+	colorfg[0] = 0x01000000 | 12;
+	ASSERT(!strcmp(export(EXPORT_ANSI), "\033[0;94;48;2;16;32;48mx\033[m\n"));
+
+	/* a colored background is not a blank to cut off */
+	line("x");
+	colorbg[1] = colorbg[2] = 0x01000000 | 4;
+	ASSERT(!strcmp(export(EXPORT_PLAIN), "x\n"));
+	ASSERT(!strcmp(export(EXPORT_ANSI), "x\033[0;44m  \033[m\n"));
+
+	/* reverse video swaps the colors of the page */
+	line("r");
+	attr[0] = A_RV;
+	ASSERT(!strcmp(export(EXPORT_HTML), "<span style=\"color:#1e1e1e;background:#d4d4d4\">r</span>\n"));
+
+	/* HTML is escaped, the title too */
+	line("<a&b>");
+	ASSERT(!strcmp(export(EXPORT_HTML), "&lt;a&amp;b&gt;\n"));
+	{
+		struct export ex;
+		FILE *f = tmpfile();
+		char buf[512];
+		size_t n;
+
+		ASSERT(ExportBegin(&ex, fileno(f), EXPORT_HTML, UTF8, "t<1>"));
+		ASSERT(ExportEnd(&ex) == 0);
+		rewind(f);
+		n = fread(buf, 1, sizeof(buf) - 1, f);
+		buf[n] = 0;
+		ASSERT(strstr(buf, "<title>t&lt;1&gt;</title>"));
+		ASSERT(strstr(buf, "</html>\n"));
+		fclose(f);
+	}
+
+	/* more than the buffer holds goes out in pieces */
+	{
+		struct export ex;
+		FILE *f = tmpfile();
+		size_t lines = 3 * EXPORT_BUFSIZE / (WIDTH + 1), n = 0;
+		int c;
+
+		line("0123456789abcdef");
+		ASSERT(ExportBegin(&ex, fileno(f), EXPORT_PLAIN, UTF8, ""));
+		for (size_t i = 0; i < lines; i++)
+			ExportLine(&ex, &ml, WIDTH);
+		ASSERT(ExportEnd(&ex) == 0);
+		rewind(f);
+		while ((c = getc(f)) != EOF)
+			if (c == '\n')
+				n++;
+		ASSERT(n == lines);
+		ASSERT(ftell(f) == (long)(lines * (WIDTH + 1)));
+		fclose(f);
+	}
+
+	/* a reader that is gone fails the export */
+	{
+		struct export ex;
+		int pfd[2];
+
+		ASSERT(pipe(pfd) == 0);
+		close(pfd[0]);
+		signal(SIGPIPE, SIG_IGN);
+		ASSERT(ExportBegin(&ex, pfd[1], EXPORT_PLAIN, UTF8, ""));
+		line("gone");
+		ExportLine(&ex, &ml, WIDTH);
+		ASSERT(ExportEnd(&ex) == -1);
+		close(pfd[1]);
+	}
+	return 0;
+}
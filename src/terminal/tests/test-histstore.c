@@ -0,0 +1,178 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../histstore.h"
+#include "signature.h"
+#include "macros.h"
+
+SIGNATURE_CHECK(HistStoreOpen, struct histstore *, (const char *));
+SIGNATURE_CHECK(HistStorePut, bool, (struct histstore *, uint64_t, int, int, const char *, size_t, uint64_t *));
+SIGNATURE_CHECK(HistStoreGet, char *, (struct histstore *, uint64_t, struct hstorerec *));
+SIGNATURE_CHECK(HistStoreTail, int, (struct histstore *, int, struct hstoretail **));
+
+/* of logfile.c and fileio.c */
+off_t log_rotate_size;
+int log_rotate_keep = 1;
+int log_durability;
+
+int secopen(char *name, int flags, int mode)
+{
+	return open(name, flags, mode);
+}
+
+static char dir[] = "/tmp/test-histstore.XXXXXX";
+static char name[sizeof(dir) + 16], prev[sizeof(name) + 2];
+
+/* a record of lines lines from seq on, its payload made from seq */
+static uint64_t put(struct histstore *hs, uint64_t seq, int lines)
+{
+	char data[100];
+	uint64_t off;
+
+	memset(data, 'a' + seq % 26, sizeof(data));
+	ASSERT(HistStorePut(hs, seq, 81, lines, data, 10 + lines, &off));
+	return off;
+}
+
+static void check(struct histstore *hs, uint64_t off, uint64_t seq, int lines)
+{
+	struct hstorerec rec;
+	char *data = HistStoreGet(hs, off, &rec);
+
+	ASSERT(data != NULL);
+	ASSERT(rec.seq == seq && rec.lines == lines && rec.width == 81 && rec.len == (uint32_t)(10 + lines));
+	for (uint32_t i = 0; i < rec.len; i++)
+		ASSERT(data[i] == (char)('a' + seq % 26));
+	free(data);
+}
+
+int main(void)
+{
+	struct histstore *hs;
+	struct hstoretail *tail;
+	uint64_t off[4];
+	int n, fd;
+
+	ASSERT(mkdtemp(dir));
+	snprintf(name, sizeof(name), "%s/w.hist", dir);
+	snprintf(prev, sizeof(prev), "%s.1", name);
+
+	/* a new store is empty */
+	hs = HistStoreOpen(name);
+	ASSERT(hs && hs->hs_seq == 0);
+	ASSERT(HistStoreTail(hs, 1000, &tail) == 0);
+	free(tail);
+
+	/* a full record, a partial one and the record superseding it */
+	off[0] = put(hs, 0, 64);
+	off[1] = put(hs, 64, 10);
+	off[2] = put(hs, 64, 64);
+	check(hs, off[0], 0, 64);
+	check(hs, off[1], 64, 10);
+	check(hs, off[2], 64, 64);
+	ASSERT(HistStoreTail(hs, 1000, &tail) == 2);
+	ASSERT(tail[0].off == off[0] && tail[0].used == 64);
+	ASSERT(tail[1].off == off[2] && tail[1].used == 64);
+	free(tail);
+	/* what is asked for and no more */
+	ASSERT(HistStoreTail(hs, 50, &tail) == 1);
+	ASSERT(tail[0].off == off[2]);
+	free(tail);
+	/* a partial record after the lines it has been superseded by is
+	 * used up to them */
+	off[3] = put(hs, 100, 20);
+	ASSERT(HistStoreTail(hs, 1000, &tail) == 3);
+	ASSERT(tail[2].off == off[3] && tail[2].used == 20);
+	free(tail);
+	HistStoreClose(hs);
+
+	/* reopened, it goes on after its last line */
+	hs = HistStoreOpen(name);
+	ASSERT(hs && hs->hs_seq == 120);
+	check(hs, off[2], 64, 64);
+	HistStoreClose(hs);
+
+	/* a torn tail is cut off */
+	ASSERT((fd = open(name, O_WRONLY | O_APPEND)) >= 0);
+	ASSERT(write(fd, "HREC torn", 9) == 9);
+	close(fd);
+	hs = HistStoreOpen(name);
+	ASSERT(hs && hs->hs_seq == 120);
+	ASSERT(HistStoreTail(hs, 1000, &tail) == 3);
+	free(tail);
+	off[0] = put(hs, 120, 64);
+	check(hs, off[0], 120, 64);
+	HistStoreClose(hs);
+
+	/* a damaged record does not read back */
+	hs = HistStoreOpen(name);
+	ASSERT(hs);
+	ASSERT((fd = open(name, O_WRONLY)) >= 0);
+	ASSERT(pwrite(fd, "x", 1, off[2] + sizeof(struct hstorerec) + 3) == 1);
+	close(fd);
+	ASSERT(HistStoreGet(hs, off[2], &(struct hstorerec){ 0 }) == NULL);
+	HistStoreClose(hs);
+
+	/* rotated, the old file stays readable and the tail goes across */
+	hs = HistStoreOpen(name);
+	ASSERT(hs);
+	log_rotate_size = 100;
+	ASSERT(HistStoreFull(hs));
+	ASSERT(HistStoreRotate(hs) == 0);
+	ASSERT(access(prev, F_OK) == 0);
+	ASSERT(!HistStoreFull(hs));
+	check(hs, off[0], 120, 64);
+	off[1] = put(hs, 184, 64);
+	check(hs, off[1], 184, 64);
+	ASSERT((n = HistStoreTail(hs, 128, &tail)) == 2);
+	ASSERT(tail[0].off == off[0] && tail[1].off == off[1]);
+	free(tail);
+	HistStoreClose(hs);
+	log_rotate_size = 0;
+	hs = HistStoreOpen(name);
+	ASSERT(hs && hs->hs_seq == 248);
+	ASSERT(HistStoreTail(hs, 128, &tail) == 2);
+	check(hs, tail[0].off, 120, 64);
+	check(hs, tail[1].off, 184, 64);
+	free(tail);
+	HistStoreClose(hs);
+
+	/* a file that is not a store is left alone */
+	unlink(prev);
+	ASSERT((fd = open(name, O_WRONLY | O_TRUNC)) >= 0);
+	ASSERT(write(fd, "not a history store", 19) == 19);
+	close(fd);
+	ASSERT(HistStoreOpen(name) == NULL);
+
+	unlink(name);
+	rmdir(dir);
+	return 0;
+}
@@ -0,0 +1,95 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../lzblock.h"
+#include "signature.h"
+#include "macros.h"
+
+SIGNATURE_CHECK(lzb_compress, size_t, (const void *, size_t, void *, size_t));
+SIGNATURE_CHECK(lzb_decompress, int, (const void *, size_t, void *, size_t));
+
+static unsigned char in[70000], out[LZB_BOUND(70000)], back[70000];
+
+static size_t roundtrip(size_t len)
+{
+	size_t clen = lzb_compress(in, len, out, sizeof(out));
+
+	ASSERT(clen > 0 && clen <= LZB_BOUND(len));
+	memset(back, 0xaa, sizeof(back));
+	ASSERT(lzb_decompress(out, clen, back, len) == 0);
+	ASSERT(memcmp(in, back, len) == 0);
+	return clen;
+}
+
+int main(void)
+{
+	uint32_t r = 1;
+	size_t len, clen;
+
+	/* short inputs are all literals */
+	for (len = 0; len < 40; len++) {
+		for (size_t i = 0; i < len; i++)
+			in[i] = 'a' + i % 3;
+		roundtrip(len);
+	}
+
+	/* a terminal line: code points as uint32_t, mostly blanks */
+	memset(in, 0, sizeof(in));
+	for (size_t i = 0; i < 201 * 64; i++)
+		in[i * 4] = i % 201 < 30 ? 'A' + i % 26 : ' ';
+	clen = roundtrip(201 * 64 * 4);
+	ASSERT(clen < 201 * 64 * 4 / 10);
+
+	/* random data doesn't grow beyond the bound */
+	for (size_t i = 0; i < sizeof(in); i++) {
+		r = r * 1103515245 + 12345;
+		in[i] = r >> 16;
+	}
+	roundtrip(sizeof(in));
+
+	/* long runs, matches overlapping their own output, far offsets */
+	memset(in, 'x', sizeof(in));
+	roundtrip(sizeof(in));
+	memcpy(in + 66000, in + 100, 1000);
+	roundtrip(sizeof(in));
+
+	/* too small a buffer is refused, not overrun */
+	ASSERT(lzb_compress(in, 1000, out, 5) == 0);
+
+	/* corrupt input doesn't crash and is detected */
+	clen = lzb_compress(in, 1000, out, sizeof(out));
+	ASSERT(lzb_decompress(out, clen, back, 999) == -1);
+	ASSERT(lzb_decompress(out, clen, back, 1001) == -1);
+	ASSERT(lzb_decompress(out, clen - 1, back, 1000) == -1);
+	for (size_t i = 0; i < clen; i++) {
+		unsigned char c = out[i];
+
+		out[i] ^= 0x5a;
+		(void)lzb_decompress(out, clen, back, 1000);
+		out[i] = c;
+	}
+	return 0;
+}
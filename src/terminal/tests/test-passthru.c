@@ -0,0 +1,130 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include <string.h>
+
+#include "../passthru.h"
+#include "macros.h"
+
+static struct passthru pt = { 80, 23, 0, true, false };
+
+static int scan(const char *s)
+{
+	return PassthruScan(&pt, s, strlen(s));
+}
+
+int main(void)
+{
+	/* text, from ASCII to single width UTF-8 */
+	ASSERT(scan("") == 0);
+	ASSERT(scan("hello, world\r\n") == 0);
+	ASSERT(scan("\xe2\x94\x82 \xe2\x9c\xb3 caf\xc3\xa9\r\n") == 0);	/* │ ✳ café */
+	ASSERT(scan("\xe6\x97\xa5") == -1);				/* 日, double width */
+	ASSERT(scan("cafe\xcc\x81") == -1);				/* a combining mark */
+	ASSERT(scan("\xf0\x9f\x98\x80") == -1);				/* 😀, out of the BMP */
+	ASSERT(scan("\xe2\x80\x8b") == -1);				/* zero width space */
+	ASSERT(scan("\xc2\x9b") == -1);					/* C1 CSI */
+	ASSERT(scan("\xe2\x94") == -1);					/* cut off */
+	ASSERT(scan("\xc0\xaf") == -1);					/* overlong */
+
+	/* controls and sequences that touch only the window's cells */
+	ASSERT(scan("\033[1;32mok\033[m\033[K\033[2K\033[1X\033[3P\033[2@") == 0);
+	ASSERT(scan("\033[38;5;214m\033[48;5;0m\033[1;2;3;4;5;7m\033[22;23;24;25;27;39;49m\033[91;101m") == 0);
+	ASSERT(scan("\033[5A\033[B\033[3C\033[D\033[E\033[2F\033[10G\033[5`\033[3d\033[2S\033[T") == 0);
+	ASSERT(scan("\033[?25l\033[?2026hframe\033[?2026l\033[?25h") == 0);
+	ASSERT(scan("\033D\033M\033E") == 0);
+	ASSERT(scan("\033[H\033[23;80H\033[1;1f\033[1;23r\033[;23r") == 0);
+	ASSERT(scan("a\tb") == 0);
+	ASSERT(scan("ab\b\b") == 0);
+
+	/* truecolor only if the terminal gets it */
+	ASSERT(scan("\033[38;2;1;2;3m") == -1);
+	pt.truecolor = true;
+	ASSERT(scan("\033[38;2;1;2;3m\033[48;2;255;255;255m") == 0);
+	ASSERT(scan("\033[38;2;1;2;300m") == -1);
+	pt.truecolor = false;
+
+	/* leaving the window's rows */
+	ASSERT(scan("\033[24;1H") == -1);
+	ASSERT(scan("\033[1;81H") == -1);
+	ASSERT(scan("\033[24d") == -1);
+	ASSERT(scan("\033[r") == -1);
+	ASSERT(scan("\033[;r") == -1);
+	ASSERT(scan("\033[2;23r") == -1);
+	ASSERT(scan("\033[1;22r") == -1);
+
+	/* erasing the rest of the display is reported */
+	ASSERT(scan("\033[J") == PASSTHRU_ERASED);
+	ASSERT(scan("\033[2J\033[H") == PASSTHRU_ERASED);
+	ASSERT(scan("\033[1J") == 0);
+	ASSERT(scan("\033[3J") == -1);
+
+	/* the rest goes through the emulator */
+	ASSERT(scan("\033]0;title\007") == -1);
+	ASSERT(scan("\007") == -1);
+	ASSERT(scan("\033[?1049h") == -1);
+	ASSERT(scan("\033[?25;1000h") == -1);
+	ASSERT(scan("\033[4h") == -1);
+	ASSERT(scan("\033[6n") == -1);
+	ASSERT(scan("\033[s") == -1);
+	ASSERT(scan("\0337") == -1);
+	ASSERT(scan("\033(0") == -1);
+	ASSERT(scan("\033[9m") == -1);
+	ASSERT(scan("\033[4:3m") == -1);
+	ASSERT(scan("\033[>4;1m") == -1);
+	ASSERT(scan("\033[2 q") == -1);
+	ASSERT(scan("\033[L") == -1);
+	ASSERT(scan("\033[1;2;3;4;5T") == -1);
+	ASSERT(scan("\016") == -1);
+
+	/* neither cut off in a sequence nor with a frame left open */
+	ASSERT(scan("\033") == -1);
+	ASSERT(scan("\033[1;3") == -1);
+	ASSERT(scan("\033[?2026hframe") == -1);
+
+	/* after the last column only text, CR and setting the column agree */
+	pt.width = 10;
+	ASSERT(scan("0123456789") == 0);
+	ASSERT(scan("0123456789wrapped") == 0);
+	ASSERT(scan("0123456789\r\n") == 0);
+	ASSERT(scan("0123456789\033[1G\033[K") == 0);
+	ASSERT(scan("0123456789\033[1;1H\b") == -1);
+	ASSERT(scan("0123456789\033[1;2H\b") == 0);
+	ASSERT(scan("0123456789\033[31m\033[?25lx\n") == 0);
+	ASSERT(scan("0123456789\n") == -1);
+	ASSERT(scan("0123456789\b") == -1);
+	ASSERT(scan("0123456789\033[K") == -1);
+	ASSERT(scan("0123456789\033[C") == -1);
+	ASSERT(scan("0123456789\t") == -1);
+	ASSERT(scan("012345678\033[5Cx\r\n") == 0);
+	ASSERT(scan("0\tx\t\t\n") == 0);
+	pt.x = 9;
+	ASSERT(scan("x\n") == -1);
+	ASSERT(scan("\033[3Dx\n") == 0);
+	pt.x = 0;
+	ASSERT(scan("\b") == -1);
+
+	/* tabs elsewhere than every 8 columns */
+	pt.tabs = false;
+	ASSERT(scan("a\tb") == -1);
+	return 0;
+}
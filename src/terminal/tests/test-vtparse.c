@@ -0,0 +1,98 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include "../vtparse.h"
+#include "../ansi.h"
+#include "macros.h"
+
+/* the C0 controls Special() takes care of */
+static bool is_special(int c)
+{
+	return c == '\b' || c == '\r' || c == '\n' || c == '\013' || c == '\007'
+	    || c == '\t' || c == '\017' || c == '\016';
+}
+
+int main(void)
+{
+	/* every character after ESC, checked against the classic switch */
+	for (int c = 0; c < 0x200; c++) {
+		int a = vtp_action(vtp_esc, c);
+
+		switch (c) {
+		case '[':
+			ASSERT(a == VTP_CSI);
+			continue;
+		case ']':
+			ASSERT((a & VTP_MASK) == VTP_STRING && VTP_ARG(a) == OSC);
+			continue;
+		case '_':
+			ASSERT((a & VTP_MASK) == VTP_STRING && VTP_ARG(a) == APC);
+			continue;
+		case 'P':
+			ASSERT((a & VTP_MASK) == VTP_STRING && VTP_ARG(a) == DCS);
+			continue;
+		case '^':
+			ASSERT((a & VTP_MASK) == VTP_STRING && VTP_ARG(a) == PM);
+			continue;
+		case '!':
+			ASSERT((a & VTP_MASK) == VTP_STRING && VTP_ARG(a) == GM);
+			continue;
+		case '"':
+		case 'k':
+			ASSERT((a & VTP_MASK) == VTP_STRING && VTP_ARG(a) == AKA);
+			continue;
+		}
+		if (is_special(c))
+			ASSERT(a == VTP_EXECUTE);
+		else if (c >= ' ' && c <= '/')
+			ASSERT(a == VTP_COLLECT);
+		else if (c >= '0' && c <= '~')
+			ASSERT(a == VTP_DISPATCH);
+		else
+			ASSERT(a == VTP_LIT);
+	}
+
+	/* and inside CSI */
+	for (int c = 0; c < 0x200; c++) {
+		int a = vtp_action(vtp_csi, c);
+
+		if (c >= '0' && c <= '9')
+			ASSERT(a == VTP_PARAM);
+		else if (c == ';' || c == ':')
+			ASSERT(a == VTP_SEP);
+		else if (is_special(c))
+			ASSERT(a == VTP_EXECUTE);
+		else if (c >= '@' && c <= '~')
+			ASSERT(a == VTP_DISPATCH);
+		else if ((c >= ' ' && c <= '/') || (c >= '<' && c <= '?'))
+			ASSERT(a == VTP_COLLECT);
+		else
+			ASSERT(a == VTP_LIT);
+	}
+
+	/* code points beyond 7 bit always abort the sequence */
+	ASSERT(vtp_action(vtp_esc, 0x9b) == VTP_LIT);
+	ASSERT(vtp_action(vtp_csi, 0x2500) == VTP_LIT);
+	ASSERT(vtp_action(vtp_csi, -1) == VTP_LIT);
+
+	return 0;
+}
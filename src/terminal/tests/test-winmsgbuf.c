@@ -21,6 +21,7 @@
  */
 
 #include "../winmsgbuf.h"
+#include "../winmsgprog.h"
 #include "signature.h"
 #include "macros.h"
 
@@ -31,8 +32,11 @@ SIGNATURE_CHECK(wmb_size, size_t, (const WinMsgBuf *));
 SIGNATURE_CHECK(wmb_contents, const char *, (const WinMsgBuf *));
 SIGNATURE_CHECK(wmb_reset, void, (WinMsgBuf *));
 SIGNATURE_CHECK(wmb_free, void, (WinMsgBuf *));
+SIGNATURE_CHECK(wmb_acquire, WinMsgBuf *, ());
+SIGNATURE_CHECK(wmb_release, void, (WinMsgBuf *));
 
 SIGNATURE_CHECK(wmbc_create, WinMsgBufContext *, (WinMsgBuf *));
+SIGNATURE_CHECK(wmbc_init, void, (WinMsgBufContext *, WinMsgBuf *));
 SIGNATURE_CHECK(wmbc_rewind, void, (WinMsgBufContext *));
 SIGNATURE_CHECK(wmbc_fastfw0, void, (WinMsgBufContext *));
 SIGNATURE_CHECK(wmbc_fastfw_end, void, (WinMsgBufContext *));
@@ -46,6 +50,121 @@ SIGNATURE_CHECK(wmbc_mergewmb, const char *, (WinMsgBufContext *, WinMsgBuf *));
 SIGNATURE_CHECK(wmbc_finish, const char *, (WinMsgBufContext *));
 SIGNATURE_CHECK(wmbc_free, void, (WinMsgBufContext *));
 
+SIGNATURE_CHECK(wmp_compile, WinMsgProg *, (const char *, int));
+SIGNATURE_CHECK(wmp_free, void, (WinMsgProg *));
+
+/* The character scan MakeWinMsgEv() performed on the raw format string
+ * before formats were compiled; escapes are written as "[<flags><num><chr>]"
+ * and a terminated rendition is recorded with its spec length. */
+static void scan_format(WinMsgBufContext *wmbc, const char *str, int chesc)
+{
+	for (const char *s = str; *s; s++) {
+		if (*s != chesc) {
+			if ((chesc == '%') && (*s == '^')) {
+				s++;
+				if (!*s)
+					break;
+				if (*s != '^' && *s >= 64)
+					wmbc_putchar(wmbc, *s & 0x1f);
+				continue;
+			}
+			wmbc_putchar(wmbc, *s);
+			continue;
+		}
+
+		if (*++s == chesc)
+			continue;
+
+		bool plus, minus, zero, lng;
+		int num = 0;
+		if ((plus = (*s == '+')) != 0)
+			s++;
+		if ((minus = (*s == '-')) != 0)
+			s++;
+		if ((zero = (*s == '0')) != 0)
+			s++;
+		while (*s >= '0' && *s <= '9')
+			num = num * 10 + (*s++ - '0');
+		if ((lng = (*s == 'L')) != 0)
+			s++;
+		if (!*s)
+			break;
+
+		if (*s == WINESC_REND_START) {
+			int i;
+
+			s++;
+			for (i = 0; i < (RENDBUF_SIZE-1); i++)
+				if (!s[i] || s[i] == WINESC_REND_END)
+					break;
+			if (s[i] == WINESC_REND_END)
+				wmb_rendadd(wmbc->buf, i, wmbc_offset(wmbc));
+			s += i;
+			if (!*s)
+				break;
+			continue;
+		}
+		wmbc_printf(wmbc, "[%s%s%s%s%d%c]", plus ? "+" : "", minus ? "-" : "",
+			zero ? "0" : "", lng ? "L" : "", num, *s);
+	}
+}
+
+/* the same output, produced from the compiled ops */
+static void run_prog(WinMsgBufContext *wmbc, const WinMsgProg *prog)
+{
+	for (int i = 0; i < prog->nops; i++) {
+		const WinMsgOp *op = &prog->ops[i];
+
+		switch (op->type) {
+		case WMOP_TEXT:
+			wmbc_strncpy(wmbc, op->str, op->len);
+			break;
+		case WMOP_REND:
+			if (op->closed)
+				wmb_rendadd(wmbc->buf, op->len, wmbc_offset(wmbc));
+			break;
+		case WMOP_ESC:
+			if (!op->chr)
+				break;
+			wmbc_printf(wmbc, "[%s%s%s%s%d%c]", op->esc.flags.plus ? "+" : "",
+				op->esc.flags.minus ? "-" : "", op->esc.flags.zero ? "0" : "",
+				op->esc.flags.lng ? "L" : "", op->esc.num, op->chr);
+			break;
+		}
+	}
+}
+
+/* compiled and scanned evaluation of STR must agree */
+static void assert_same(const char *str, int chesc)
+{
+	WinMsgBuf *a = wmb_create();
+	WinMsgBuf *b = wmb_create();
+	WinMsgBufContext *ca = wmbc_create(a);
+	WinMsgBufContext *cb = wmbc_create(b);
+	WinMsgProg *prog = wmp_compile(str, chesc);
+
+	ASSERT(prog != NULL);
+	ASSERT(STREQ(prog->src, str));
+	ASSERT(prog->chesc == chesc);
+
+	scan_format(ca, str, chesc);
+	run_prog(cb, prog);
+
+	ASSERT(wmbc_offset(ca) == wmbc_offset(cb));
+	ASSERT(memcmp(wmb_contents(a), wmb_contents(b), wmbc_offset(ca)) == 0);
+	ASSERT(a->numrend == b->numrend);
+	for (int i = 0; i < a->numrend; i++) {
+		ASSERT(a->rend[i] == b->rend[i]);
+		ASSERT(a->rendpos[i] == b->rendpos[i]);
+	}
+
+	wmp_free(prog);
+	wmbc_free(cb);
+	wmbc_free(ca);
+	wmb_free(b);
+	wmb_free(a);
+}
+
 int main(void)
 {
 	{
@@ -85,6 +204,23 @@ int main(void)
 		ASSERT_GCC(FAILLOC(wmb_create()) == NULL);
 	}
 
+	/* released buffers are handed out again, emptied, without allocating */
+	{
+		WinMsgBuf *wmb = wmb_acquire();
+		WinMsgBufContext wmbc;
+
+		wmbc_init(&wmbc, wmb);
+		wmbc_strcpy(&wmbc, "abc");
+		wmbc_finish(&wmbc);
+		wmb_release(wmb);
+
+		WinMsgBuf *again;
+		ASSERT_NOALLOC(again = wmb_acquire());
+		ASSERT(again == wmb);
+		ASSERT(*wmb_contents(again) == '\0');
+		wmb_release(again);
+	}
+
 	/* scenerio: writing to single buffer via separate contexts---while
 	 * maintaining separate pointers between them---and retrieving a final
 	 * result */
@@ -393,5 +529,129 @@ int main(void)
 		wmb_free(wmb);
 	}
 
+	/* compiled format strings evaluate to exactly what scanning the raw
+	 * string produces, malformed input included */
+	{
+		static const char *formats[] = {
+			"",
+			"plain text",
+			"%{= #FFFFFF;#2D004D} %2` %{= #FFFFFF;#3D1A6D} / %{= #FFFFFF;#4D2A7D} %t "
+				"%{= #FFFFFF;#4D2A7D} %=%{= #E0B0FF;#5B2C8A} Last Active: "
+				"%{= #FFFFFF;#6B3FA0} %I %{= #FFFFFF;#7B52B8} ImmorTerm %{-}",
+			"%-Lw%{= BW}%50>%n%f* %t%{-}%+Lw%<",
+			"%?%F%{= kr}%:%{= kw}%?%3n %t%? @%h%?",
+			"a%%b%%%c %+-05Lx %0=",
+			"^G^^^a^@x^1 ^",
+			"%{unterminated",
+			"%{= kr}x%",
+			"tail %",
+			"%-",
+		};
+
+		for (size_t i = 0; i < SIZEOF(formats); i++)
+			assert_same(formats[i], '%');
+
+		/* backtick output uses its own escape and no ^ escapes */
+		assert_same("a^b\005{= r}c\005\005\005n", '\005');
+
+		/* a rendition spec is cut off like the scanner's buffer was */
+		char longspec[RENDBUF_SIZE + 16];
+		memset(longspec, 'x', sizeof(longspec) - 1);
+		longspec[0] = '%';
+		longspec[1] = '{';
+		longspec[sizeof(longspec) - 2] = '}';
+		longspec[sizeof(longspec) - 1] = '\0';
+		assert_same(longspec, '%');
+	}
+
+	/* text runs are merged and renditions keep their spec */
+	{
+		WinMsgProg *prog = wmp_compile("ab^Gc%{+b r}%n%%d", '%');
+
+		ASSERT(prog->nops == 4);
+		ASSERT(prog->ops[0].type == WMOP_TEXT);
+		ASSERT(prog->ops[0].len == 4);
+		ASSERT(memcmp(prog->ops[0].str, "ab\ac", 4) == 0);
+		ASSERT(prog->ops[1].type == WMOP_REND);
+		ASSERT(prog->ops[1].closed);
+		ASSERT(prog->ops[1].len == 4);
+		ASSERT(memcmp(prog->ops[1].str, "+b r", 4) == 0);
+		ASSERT(prog->ops[2].type == WMOP_ESC);
+		ASSERT(prog->ops[2].chr == 'n');
+		ASSERT(prog->ops[3].type == WMOP_TEXT);
+		ASSERT(prog->ops[3].len == 1);
+
+		wmp_free(prog);
+	}
+
+	/* an else branch without side effects jumps to the closing %? */
+	{
+		WinMsgProg *prog = wmp_compile("%?%F%{= kr}x%:y%{= kw}%c%?z", '%');
+
+		ASSERT(prog->nops == 10);
+		ASSERT(prog->ops[4].chr == WINESC_COND_ELSE);
+		ASSERT(prog->ops[4].jump == 8);
+		ASSERT(prog->ops[4].jumptick == 60);
+		ASSERT(prog->ops[0].jump == -1);
+		wmp_free(prog);
+
+		prog = wmp_compile("%?%F%:y%?", '%');
+		ASSERT(prog->ops[2].jump == 4);
+		ASSERT(prog->ops[2].jumptick == 0);
+		wmp_free(prog);
+
+		/* pads, truncation and nested evaluation have to run */
+		static const char *keep[] = {
+			"%?%F%:y%=%?",
+			"%?%F%:y%<%?",
+			"%?%F%:%10>y%?",
+			"%?%F%:%1`%?",
+			"%?%F%:%h%?",
+			"%?%F%:a%:b%?",
+			"%?%F%:y",
+			"%:y%?",
+		};
+		for (size_t i = 0; i < SIZEOF(keep); i++) {
+			prog = wmp_compile(keep[i], '%');
+			for (int j = 0; j < prog->nops; j++)
+				ASSERT(prog->ops[j].jump == -1);
+			wmp_free(prog);
+		}
+	}
+
+	/* escapes report when their output can change by itself: clocks every
+	 * minute, event-driven ones never, the rest hourly */
+	{
+		WinMsgProg *prog = wmp_compile("%c%I%t%{= r}%=%D%2`", '%');
+
+		ASSERT(prog->nops == 7);
+		ASSERT(prog->ops[0].tick == 60);
+		ASSERT(prog->ops[1].tick == 0);
+		ASSERT(prog->ops[2].tick == 0);
+		ASSERT(prog->ops[3].tick == 0);
+		ASSERT(prog->ops[4].tick == 0);
+		ASSERT(prog->ops[5].tick == 3600);
+		ASSERT(prog->ops[6].tick == 0);
+		wmp_free(prog);
+
+		prog = wmp_compile("%?%F%:%t%I%?", '%');
+		ASSERT(prog->ops[2].jump == 5);
+		ASSERT(prog->ops[2].jumptick == 0);
+		wmp_free(prog);
+	}
+
+	/* only strings showing the date or time need the local time */
+	{
+		WinMsgProg *prog = wmp_compile("%n %t %I", '%');
+		ASSERT(!prog->clock);
+		wmp_free(prog);
+		prog = wmp_compile("%n %D", '%');
+		ASSERT(prog->clock);
+		wmp_free(prog);
+	}
+
+	/* allocation failure */
+	ASSERT_GCC(FAILLOC(wmp_compile("%n %t", '%')) == NULL);
+
 	return 0;
 }
@@ -0,0 +1,50 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#ifndef SCREEN_TRACE_H
+#define SCREEN_TRACE_H
+
+/*
+ * Static tracepoints of the provider "screen" on the hot paths, for
+ * bpftrace and DTrace (see HACKING for the list). configure
+ * --enable-usdt builds them with <sys/sdt.h>; a probe nobody traces is a
+ * nop instruction. Without it they are not compiled at all, and their
+ * arguments must not have side effects. DTrace shows a double
+ * underscore in a name as a dash (screen*:::win-read-entry), bpftrace
+ * keeps it (usdt:./screen:screen:win__read__entry).
+ */
+
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+
+#define TRACE(name)			DTRACE_PROBE(screen, name)
+#define TRACE1(name, a)			DTRACE_PROBE1(screen, name, a)
+#define TRACE2(name, a, b)		DTRACE_PROBE2(screen, name, a, b)
+#define TRACE4(name, a, b, c, d)	DTRACE_PROBE4(screen, name, a, b, c, d)
+#else
+#define TRACE(name)			do { } while (0)
+#define TRACE1(name, a)			do { (void)(a); } while (0)
+#define TRACE2(name, a, b)		do { (void)(a); (void)(b); } while (0)
+#define TRACE4(name, a, b, c, d)	do { (void)(a); (void)(b); (void)(c); (void)(d); } while (0)
+#endif
+
+#endif /* SCREEN_TRACE_H */
@@ -879,6 +879,7 @@ int TtyGrabConsole(int fd, bool on, char *rc_name)
 	consredir_ev.fd = consredirfd[0];
 	consredir_ev.type = EV_READ;
 	consredir_ev.handler = consredir_readev_fn;
+	consredir_ev.name = "consredir_readev_fn";
 	evenq(&consredir_ev);
 	return 0;
 }
@@ -0,0 +1,118 @@
+#! /bin/sh
+#
+# Build unitables.h, the character width and combining tables of
+# encoding.c, from the Unicode Character Database: run
+#	make unitables UCD=/path/to/ucd
+# with a directory holding EastAsianWidth.txt and
+# DerivedGeneralCategory.txt of the wanted Unicode version.
+
+if test -z "$AWK"; then
+  AWK=awk
+fi
+if test -z "$srcdir"; then
+  srcdir=.
+fi
+if test -z "$UCD" || test ! -f "$UCD/EastAsianWidth.txt" || test ! -f "$UCD/DerivedGeneralCategory.txt"; then
+  echo "unitables.sh: set UCD to a directory with EastAsianWidth.txt and DerivedGeneralCategory.txt" >&2
+  exit 1
+fi
+
+LC_ALL=C
+export LC_ALL
+
+version=`sed -n '1s/.*-\([0-9][0-9.]*\)\.txt.*/\1/p' "$UCD/EastAsianWidth.txt"`
+
+rm -f $srcdir/unitables.h
+cat << EOF > $srcdir/unitables.h
+/*
+ * This file is automagically created by unitables.sh from the
+ * Unicode ${version:-?} character database -- DO NOT EDIT
+ *
+ * The properties of code point c are
+ *	uni_pages[uni_index[c >> 8]][c & 0xff]
+ */
+
+#define UNI_WIDE	1	/* east asian wide or fullwidth */
+#define UNI_AMBIGUOUS	2	/* east asian ambiguous */
+#define UNI_COMBINING	4	/* zero width: Mn, Me, Cf and the medial/final jamos */
+
+EOF
+
+$AWK '
+function range(s) {
+	gsub(/[ \t]/, "", s)
+	if (split(s, r, /\.\./) == 1)
+		r[2] = r[1]
+	lo = hex(r[1])
+	hi = hex(r[2])
+}
+function hex(s,    i, v) {
+	v = 0
+	s = toupper(s)
+	for (i = 1; i <= length(s); i++)
+		v = v * 16 + index("0123456789ABCDEF", substr(s, i, 1)) - 1
+	return v
+}
+FILENAME ~ /EastAsianWidth/ {
+	# defaults for unlisted code points, e.g. W for unassigned CJK
+	if (sub(/^# @missing:/, ""))
+		;
+	sub(/#.*/, "")
+	if (split($0, f, ";") < 2)
+		next
+	range(f[1])
+	gsub(/[ \t]/, "", f[2])
+	for (c = lo; c <= hi; c++)
+		if (f[2] == "W" || f[2] == "F")
+			eaw[c] = 1
+		else if (f[2] == "A")
+			eaw[c] = 2
+		else
+			delete eaw[c]
+	next
+}
+FILENAME ~ /DerivedGeneralCategory/ {
+	sub(/#.*/, "")
+	if (split($0, f, ";") < 2)
+		next
+	gsub(/[ \t]/, "", f[2])
+	if (f[2] != "Mn" && f[2] != "Me" && f[2] != "Cf")
+		next
+	range(f[1])
+	for (c = lo; c <= hi; c++)
+		if (c != 173)		# the soft hyphen is shown
+			comb[c] = 4
+}
+END {
+	# hangul jamo vowels and final consonants join the leading consonant
+	for (c = 4448; c <= 4607; c++)		# 1160..11FF
+		comb[c] = 4
+	for (c = 55216; c <= 55295; c++)	# D7B0..D7FF
+		comb[c] = 4
+	npages = 0
+	for (p = 0; p < 4352; p++) {
+		s = ""
+		for (c = p * 256; c < p * 256 + 256; c++) {
+			if (c % 16 == 0)
+				s = s "\n\t\t"
+			s = s sprintf("%d,", eaw[c] + comb[c])
+		}
+		if (!(s in page)) {
+			page[s] = npages
+			text[npages++] = s
+		}
+		index1[p] = page[s]
+	}
+	if (npages > 256) {
+		print "unitables.sh: too many distinct pages" > "/dev/stderr"
+		exit 1
+	}
+	printf "static const unsigned char uni_index[0x1100] = {"
+	for (p = 0; p < 4352; p++)
+		printf "%s%d,", (p % 16 == 0) ? "\n\t" : " ", index1[p]
+	printf "\n};\n\nstatic const unsigned char uni_pages[%d][256] = {\n", npages
+	for (i = 0; i < npages; i++)
+		printf "\t{%s\n\t},\n", text[i]
+	printf "};\n"
+}
+' "$UCD/EastAsianWidth.txt" "$UCD/DerivedGeneralCategory.txt" >> $srcdir/unitables.h
@@ -0,0 +1,65 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include "vtparse.h"
+
+#include "ansi.h"
+
+#define L_	VTP_LIT
+#define X_	VTP_EXECUTE
+#define C_	VTP_COLLECT
+#define P_	VTP_PARAM
+#define S_	VTP_SEP
+#define D_	VTP_DISPATCH
+#define I_	VTP_CSI
+#define T_(t)	(VTP_STRING | (t) << 4)
+
+/*
+ * C0 controls executed inside a sequence are the ones Special() in ansi.c
+ * handles: BEL BS HT LF VT CR SO SI.
+ */
+
+/* after ESC */
+const uint8_t vtp_esc[0x80] = {
+/*        0       1       2       3       4       5       6       7       8       9       a       b       c       d       e       f */
+/* 0 */	L_,	L_,	L_,	L_,	L_,	L_,	L_,	X_,	X_,	X_,	X_,	X_,	L_,	X_,	X_,	X_,
+/* 1 */	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,
+/* 2 */	C_,	T_(GM),	T_(AKA),C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,
+/* 3 */	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,
+/* 4 */	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,
+/* 5 */	T_(DCS),D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	I_,	D_,	T_(OSC),T_(PM),	T_(APC),
+/* 6 */	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	T_(AKA),D_,	D_,	D_,	D_,
+/* 7 */	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	L_
+};
+
+/* after CSI, while reading parameters */
+const uint8_t vtp_csi[0x80] = {
+/*        0       1       2       3       4       5       6       7       8       9       a       b       c       d       e       f */
+/* 0 */	L_,	L_,	L_,	L_,	L_,	L_,	L_,	X_,	X_,	X_,	X_,	X_,	L_,	X_,	X_,	X_,
+/* 1 */	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,	L_,
+/* 2 */	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,	C_,
+/* 3 */	P_,	P_,	P_,	P_,	P_,	P_,	P_,	P_,	P_,	P_,	S_,	S_,	C_,	C_,	C_,	C_,
+/* 4 */	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,
+/* 5 */	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,
+/* 6 */	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,
+/* 7 */	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	D_,	L_
+};
@@ -0,0 +1,55 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#ifndef SCREEN_VTPARSE_H
+#define SCREEN_VTPARSE_H
+
+#include <stdint.h>
+
+/*
+ * Transition tables for the escape sequence recognizer, in the spirit of
+ * Paul Williams' DEC VT500 parser. One table per parser state maps every
+ * 7-bit character to the action the emulator has to take; anything outside
+ * the table aborts the sequence.
+ */
+
+enum {
+	VTP_LIT = 0,		/* abort sequence, redo char as literal */
+	VTP_EXECUTE,		/* C0 control, executed inside the sequence */
+	VTP_COLLECT,		/* intermediate character */
+	VTP_PARAM,		/* parameter digit */
+	VTP_SEP,		/* parameter separator */
+	VTP_DISPATCH,		/* final character */
+	VTP_CSI,		/* ESC [: enter CSI state */
+	VTP_STRING		/* start of a control string, type in VTP_ARG */
+};
+
+#define VTP_MASK	0x0f
+#define VTP_ARG(a)	((a) >> 4)
+
+/* action for char c in a state's table */
+#define vtp_action(table, c)	((unsigned int)(c) < 0x80 ? (table)[c] : VTP_LIT)
+
+extern const uint8_t vtp_esc[0x80];
+extern const uint8_t vtp_csi[0x80];
+
+#endif /* SCREEN_VTPARSE_H */
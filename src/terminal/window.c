@@ -41,17 +41,31 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/wait.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef __APPLE__
+#include <libproc.h>
+#endif
 
+#include "cell.h"
+#include "checkpoint.h"
+#include "events.h"
 #include "fileio.h"
 #include "help.h"
+#include "histstore.h"
 #include "input.h"
 #include "mark.h"
 #include "misc.h"
+#include "passthru.h"
 #include "process.h"
 #include "pty.h"
 #include "resize.h"
+#include "search.h"
+#include "socket.h"
 #include "telnet.h"
 #include "termcap.h"
+#include "trace.h"
 #include "tty.h"
 #include "utmp.h"
 #include "winmsg.h"
@@ -70,15 +84,38 @@ static int muchpending(Window *, Event *);
 static void paste_slowev_fn(Event *, void *);
 static void pseu_readev_fn(Event *, void *);
 static void pseu_writeev_fn(Event *, void *);
+#ifdef HAVE_SPLICE
+static void pseu_pipes(struct pseudowin *);
+static ssize_t pseu_tee(Window *, int, char *, size_t, int *);
+#endif
 static void win_silenceev_fn(Event *, void *);
 static void win_destroyev_fn(Event *, void *);
+static void win_frameev_fn(Event *, void *);
+static void win_syncev_fn(Event *, void *);
 
 static int ForkWindow(Window *, char **, char *);
 static void zmodem_found(Window *, int, char *, size_t);
 static void zmodemFin(char *, size_t, void *);
 static int zmodem_parse(Window *, char *, size_t);
 
+#define SYNC_TIMEOUT	1000	/* ms an application may hold back its output */
+#define WINREAD_MAX	(16 * IOSIZE)	/* most an undrawn flooding window reads at once */
+#define FASTFORWARD_MAX	WINREAD_MAX	/* output a display may lag behind in fastforward */
+#define WINREAD_QUANTUM	(IOSIZE / 4)	/* what a flooding window earns a round, see winread_share() */
+#define HIBERNATE_CHECK	60	/* most seconds between looks for idle windows */
+#define HIBERNATE_WAIT	(hibernate < HIBERNATE_CHECK ? hibernate : HIBERNATE_CHECK)
+#define BUDGET_CHECK	5	/* seconds between looks at scrollback_budget */
+
 bool VerboseCreate = false;		/* XXX move this to user.h */
+int render_fps = 0;			/* ImmorTerm: max. redraws per second of a busy window, 0 = off */
+int log_text = LOGTEXT_OFF;		/* ImmorTerm: rendered text log, see DoStartLog */
+bool log_history = false;		/* ImmorTerm: history store next to the log, see histstore.h */
+int hibernate = 0;			/* ImmorTerm: seconds idle before a window hibernates, 0 = never */
+size_t scrollback_budget = 0;		/* ImmorTerm: bytes of history all windows may hold, 0 = no limit */
+int scrollback_budget_keep = 1000;	/* ImmorTerm: lines of each window scrollback_budget leaves alone */
+bool passthrough = false;		/* ImmorTerm: send output as it is where it can, see WinPassthru() */
+
+static Window *passwin;			/* ImmorTerm: whose output WinPassthru() passes */
 
 char DefaultShell[] = "/bin/sh";
 #ifndef HAVE_EXECVPE
@@ -110,7 +147,9 @@ struct NewWindow nwin_undef = {
 	.encoding            = -1,
 	.hstatus             = NULL,
 	.charset             = NULL,
-	.poll_zombie_timeout = 0
+	.poll_zombie_timeout = 0,
+	.searchindex         = -1,
+	.hosted              = NULL
 };
 
 struct NewWindow nwin_default = {
@@ -137,7 +176,9 @@ struct NewWindow nwin_default = {
 	.bce        = 0,
 	.encoding   = 0,
 	.hstatus    = NULL,
-	.charset    = NULL
+	.charset    = NULL,
+	.searchindex = 0,
+	.hosted     = NULL
 };
 
 struct NewWindow nwin_options;
@@ -170,9 +211,11 @@ void nwin_compose(struct NewWindow *def, struct NewWindow *new, struct NewWindow
 	COMPOSE(c1);
 	COMPOSE(bce);
 	COMPOSE(encoding);
+	COMPOSE(searchindex);
 	COMPOSE(hstatus);
 	COMPOSE(charset);
 	COMPOSE(poll_zombie_timeout);
+	COMPOSE(hosted);
 #undef COMPOSE
 }
 
@@ -370,17 +413,37 @@ static void WinRestore(void)
 int DoStartLog(Window *window, char *buf, int bufsize)
 {
 	int n;
+	char tbuf[MAXPATHLEN], hbuf[MAXPATHLEN];
+	struct histstore *hs;
+	/* ImmorTerm: a compressed log is <logfile>.gz */
+	const char *gz = log_compress ? ".gz" : "";
+
 	if (!window || !buf)
 		return -1;
 
 	strncpy(buf, MakeWinMsg(screenlogfile, window, '%'), bufsize - 1);
 	buf[bufsize - 1] = 0;
+	snprintf(tbuf, sizeof(tbuf), "%s.txt%s", buf, gz);
+	snprintf(hbuf, sizeof(hbuf), "%s.hist", buf);
+	if (strlen(buf) + strlen(gz) < (size_t)bufsize)
+		strcat(buf, gz);
 
-	if (window->w_log != NULL)
-		logfclose(window->w_log);
+	CloseLog(window);
 
 	if ((window->w_log = logfopen(buf, islogfile(buf) ? NULL : secfopen(buf, "a"))) == NULL)
 		return -2;
+	/* ImmorTerm: lines that scroll into history, as plain text */
+	if (log_text == LOGTEXT_ONLY)
+		window->w_tlog = window->w_log;
+	else if (log_text == LOGTEXT_ON)
+		window->w_tlog = logfopen(tbuf, islogfile(tbuf) ? NULL : secfopen(tbuf, "a"));
+	/* ImmorTerm: the history, kept on disk */
+	if (log_history) {
+		if ((hs = HistStoreOpen(hbuf)) != NULL)
+			HistStoreAttach(window, hs);
+		else
+			Msg(errno, "Cannot open history store %s", hbuf);
+	}
 	if (!logflushev.queued) {
 		n = log_flush ? log_flush : (logtstamp_after + 4) / 5;
 		if (n) {
@@ -540,6 +603,7 @@ int MakeWindow(struct NewWindow *newwin)
 		p->w_group = fore;
 	else if (fore && fore->w_group)
 		p->w_group = fore->w_group;
+	p->w_hosted = nwin.hosted;
 	/*
 	 * This is dangerous: without a display we use creators umask
 	 * This is intended to be useful for detached startup.
@@ -583,6 +647,7 @@ int MakeWindow(struct NewWindow *newwin)
 		p->w_title = p->w_akachange = p->w_akabuf;
 	if (nwin.hstatus)
 		p->w_hstatus = SaveStr(nwin.hstatus);
+	p->w_searchindex = nwin.searchindex > 0;
 	p->w_monitor = nwin.monitor;
 	if (p->w_monitor == MON_ON) {
 		/* always tell all users */
@@ -648,6 +713,7 @@ int MakeWindow(struct NewWindow *newwin)
 			FreeWindow(p);
 			return -1;
 		}
+		StartupTrace(STARTUP_FORK_WINDOW);
 	}
 
 	/*
@@ -657,6 +723,8 @@ int MakeWindow(struct NewWindow *newwin)
 		D_other = D_fore;
 
 	add_window_to_list(p, win);
+	if (p->w_hosted)
+		p->w_hosted->h_windows++;
 
 	if (type == W_TYPE_GROUP) {
 		SetForeWindow(p);
@@ -692,22 +760,28 @@ int MakeWindow(struct NewWindow *newwin)
 	p->w_zombieev.type = EV_TIMEOUT;
 	p->w_zombieev.data = (char *)p;
 	p->w_zombieev.handler = win_resurrect_zombie_fn;
+	p->w_zombieev.name = "win_resurrect_zombie_fn";
 
 	p->w_readev.fd = p->w_writeev.fd = p->w_ptyfd;
 	p->w_readev.type = EV_READ;
 	p->w_writeev.type = EV_WRITE;
 	p->w_readev.data = p->w_writeev.data = (char *)p;
 	p->w_readev.handler = win_readev_fn;
+	p->w_readev.name = "win_readev_fn";
 	p->w_writeev.handler = win_writeev_fn;
+	p->w_writeev.name = "win_writeev_fn";
+	p->w_writeev.priority = 1;	/* ImmorTerm: input ahead of output, see MakeDisplay() */
 	p->w_writeev.condpos = (int *)&p->w_inlen;
 	evenq(&p->w_readev);
 	evenq(&p->w_writeev);
 	p->w_paster.pa_slowev.type = EV_TIMEOUT;
 	p->w_paster.pa_slowev.data = (char *)&p->w_paster;
 	p->w_paster.pa_slowev.handler = paste_slowev_fn;
+	p->w_paster.pa_slowev.name = "paste_slowev_fn";
 	p->w_silenceev.type = EV_TIMEOUT;
 	p->w_silenceev.data = (char *)p;
 	p->w_silenceev.handler = win_silenceev_fn;
+	p->w_silenceev.name = "win_silenceev_fn";
 	if (p->w_silence > 0) {
 		SetTimeout(&p->w_silenceev, p->w_silencewait * 1000);
 		evenq(&p->w_silenceev);
@@ -715,12 +789,22 @@ int MakeWindow(struct NewWindow *newwin)
 	p->w_destroyev.type = EV_TIMEOUT;
 	p->w_destroyev.data = NULL;
 	p->w_destroyev.handler = win_destroyev_fn;
+	p->w_destroyev.name = "win_destroyev_fn";
+	p->w_frameev.type = EV_TIMEOUT;
+	p->w_frameev.data = (char *)p;
+	p->w_frameev.handler = win_frameev_fn;
+	p->w_frameev.name = "win_frameev_fn";
+	p->w_syncev.type = EV_TIMEOUT;
+	p->w_syncev.data = (char *)p;
+	p->w_syncev.handler = win_syncev_fn;
+	p->w_syncev.name = "win_syncev_fn";
 
 	SetForeWindow(p);
 	Activate(p->w_norefresh);
 	WindowChanged(NULL, WINESC_WIN_NAMES);
 	WindowChanged(NULL, WINESC_WIN_NAMES_NOCUR);
 	WindowChanged(NULL, 0);
+	EventPost("new", p->w_number, p->w_title);
 	return startat;
 }
 
@@ -825,6 +909,18 @@ void CloseDevice(Window *window)
 	window->w_readev.fd = window->w_writeev.fd = -1;
 }
 
+/* Close the logfiles of a window. */
+void CloseLog(Window *window)
+{
+	HistStoreDetach(window);
+	if (window->w_tlog != NULL && window->w_tlog != window->w_log)
+		logfclose(window->w_tlog);
+	window->w_tlog = NULL;
+	if (window->w_log != NULL)
+		logfclose(window->w_log);
+	window->w_log = NULL;
+}
+
 void FreeWindow(Window *window)
 {
 	if (window->w_pwin)
@@ -838,8 +934,13 @@ void FreeWindow(Window *window)
 		TtyGrabConsole(-1, false, "free");
 		console_window = NULL;
 	}
-	if (window->w_log != NULL)
-		logfclose(window->w_log);
+	RedrawSettle(window);
+	WLogScreen(window);
+	CloseLog(window);
+	CheckpointFree(window);
+	EventPost("dead", window->w_number, NULL);
+	if (window->w_dumps)
+		DumpScrollbackFinish(window, false);
 	ChangeWindowSize(window, 0, 0, 0);
 
 	if (window->w_type == W_TYPE_GROUP) {
@@ -850,6 +951,8 @@ void FreeWindow(Window *window)
 
 	if (window->w_hstatus)
 		free(window->w_hstatus);
+	free(window->w_readbuf);
+	free(window->w_string);
 	for (int i = 0; window->w_cmdargs[i]; i++)
 		free(window->w_cmdargs[i]);
 	if (window->w_dir)
@@ -896,6 +999,8 @@ void FreeWindow(Window *window)
 	evdeq(&window->w_silenceev);
 	evdeq(&window->w_zombieev);
 	evdeq(&window->w_destroyev);
+	evdeq(&window->w_frameev);
+	evdeq(&window->w_syncev);
 	FreePaster(&window->w_paster);
 	free((char *)window);
 }
@@ -1016,6 +1121,7 @@ static int ForkWindow(Window *win, char **args, char *ttyn)
 	pid_t pid;
 	char tebuf[MAXTERMLEN + 5 + 1]; /* MAXTERMLEN + strlen("TERM=") + '\0' */
 	char ebuf[20];
+	char stybuf[MAXSTR];
 	char shellbuf[7 + MAXPATHLEN];
 	char *proc;
 	int newfd;
@@ -1169,6 +1275,11 @@ static int ForkWindow(Window *win, char **args, char *ttyn)
 		}
 		snprintf(ebuf, ARRAY_SIZE(ebuf), "WINDOW=%d", win->w_number);
 		NewEnv[3] = ebuf;
+		/* ImmorTerm: the session it is in, see HostedOpen() */
+		if (win->w_hosted) {
+			snprintf(stybuf, ARRAY_SIZE(stybuf), "STY=%s", win->w_hosted->h_name);
+			NewEnv[0] = stybuf;
+		}
 
 		if (*proc == '-')
 			proc++;
@@ -1250,6 +1361,7 @@ int winexec(char **av)
 		Msg(0, "%s", strnomem);
 		return -1;
 	}
+	pwin->p_pipe[0] = pwin->p_pipe[1] = pwin->p_spill[0] = pwin->p_spill[1] = -1;
 
 	/* allow ^a:!!./ttytest as a short form for ^a:exec !.. ./ttytest */
 	for (s = *av; *s == ' '; s++) ;
@@ -1343,8 +1455,18 @@ int winexec(char **av)
 	pwin->p_writeev.type = EV_WRITE;
 	pwin->p_readev.data = pwin->p_writeev.data = (char *)w;
 	pwin->p_readev.handler = pseu_readev_fn;
+	pwin->p_readev.name = "pseu_readev_fn";
 	pwin->p_writeev.handler = pseu_writeev_fn;
+	pwin->p_writeev.name = "pseu_writeev_fn";
 	pwin->p_writeev.condpos = (int *)&pwin->p_inlen;
+#ifdef HAVE_SPLICE
+	/* ImmorTerm: the window output goes to the pseudo unchanged */
+	if (W_WTOP(w) && !W_UWP(w) && (w->w_type == W_TYPE_PTY || w->w_type == W_TYPE_PLAIN)) {
+		pseu_pipes(pwin);
+		if (pwin->p_pipe[0] >= 0)
+			pwin->p_writeev.condpos = &pwin->p_pipelen;
+	}
+#endif
 	if (pwin->p_fdpat & (F_PFRONT << F_PSHIFT * 2 | F_PFRONT << F_PSHIFT))
 		evenq(&pwin->p_readev);
 	evenq(&pwin->p_writeev);
@@ -1376,6 +1498,12 @@ void FreePseudowin(Window *w)
 		else
 			close(pwin->p_ptyfd);
 	}
+	for (int i = 0; i < 2; i++) {
+		if (pwin->p_pipe[i] >= 0)
+			close(pwin->p_pipe[i]);
+		if (pwin->p_spill[i] >= 0)
+			close(pwin->p_spill[i]);
+	}
 	evdeq(&pwin->p_readev);
 	evdeq(&pwin->p_writeev);
 	if (w->w_readev.condneg == (int *)&pwin->p_inlen)
@@ -1434,6 +1562,8 @@ static void paste_slowev_fn(Event *event, void *data)
 	p = Layer2Window(flayer);
 	DoProcess(p, &pa->pa_pasteptr, &len, pa);
 	pa->pa_pastelen -= 1 - len;
+	if (pa->pa_pastelen == 0)
+		EndPaster(pa);
 	if (pa->pa_pastelen > 0) {
 		SetTimeout(&pa->pa_slowev, p->w_slowpaste);
 		evenq(&pa->pa_slowev);
@@ -1453,10 +1583,15 @@ static int muchpending(Window *p, Event *event)
 		if (D_blocked)
 			continue;
 		if (D_obufp - D_obuf > D_obufmax + D_blocked_fuzz) {
-			if (D_nonblock == 0) {
-				D_blocked = 1;
+			/* In fastforward, a display that is a whole batch behind
+			 * stops being drawn; once it has caught up it is redrawn
+			 * in one go with whatever the window shows by then. */
+			if (D_nonblock == 0 || (fastforward && D_obufp - D_obuf > FASTFORWARD_MAX)) {
+				SetBlocked(1);
 				continue;
 			}
+			if (fastforward)
+				continue;
 			event->condpos = &D_obuffree;
 			event->condneg = &D_obuflenmax;
 			if (D_nonblock > 0 && !D_blockedev.queued) {
@@ -1469,12 +1604,265 @@ static int muchpending(Window *p, Event *event)
 	return 0;
 }
 
-static void win_readev_fn(Event *event, void *data)
+/*
+ * How much a flooding window may read in one go. Only a window without a
+ * canvas gets to batch: drawn output is queued for a display in the order
+ * it was read, so a big batch would hold up the echo of a keystroke in
+ * every other region, and output held back for a status message has to
+ * fit w_outbuf.
+ */
+static int winread_budget(Window *p)
+{
+	return p->w_layer.l_cvlist ? IOSIZE : WINREAD_MAX;
+}
+
+/*
+ * ImmorTerm: deficit round robin between windows that flood at once. A
+ * round is one pass of sched() over what is ready. While more than one
+ * window had more to read than it could in the last round, a window
+ * earns WINREAD_QUANTUM a round, reads once it has earned IOSIZE and
+ * then no more than it earned. The window of a focused canvas earns
+ * nothing and reads its whole budget every round, so that it keeps four
+ * times the pace of each of the others, and its echo comes back within
+ * a round whatever floods behind it.
+ */
+static unsigned int floodround;
+static int flooders, lastflooders;
+
+static bool window_focused(Window *p)
+{
+	for (Display *d = displays; d; d = d->d_next)
+		if (d->d_forecv && d->d_forecv->c_layer->l_bottom == &p->w_layer)
+			return true;
+	return false;
+}
+
+/* How much of size p may read this round, 0 if it is to wait */
+static int winread_share(Window *p, int size)
+{
+	if (floodround != schedround) {
+		floodround = schedround;
+		lastflooders = flooders;
+		flooders = 0;
+	}
+	if (lastflooders < 2 || window_focused(p)) {
+		p->w_deficit = 0;
+		return size;
+	}
+	if (p->w_deficit < IOSIZE) {
+		p->w_deficit += WINREAD_QUANTUM;
+		if (p->w_deficit < IOSIZE) {
+			flooders++;	/* still flooding, as far as anyone knows */
+			return 0;
+		}
+	}
+	return size < p->w_deficit ? size : p->w_deficit;
+}
+
+/* Accounts for what p read of the size winread_share() let it */
+static void winread_shared(Window *p, int size, int len)
+{
+	if (len < size) {
+		p->w_deficit = 0;	/* drained, it earns anew */
+		return;
+	}
+	flooders++;
+	if (p->w_deficit)
+		p->w_deficit -= len;
+}
+
+/*
+ * Read on until the window has nothing more to give or the budget is used
+ * up. A pty hands out at most its buffer's worth per read, so the writer
+ * may well have refilled it by the next one. In packet mode every read
+ * starts with a status byte: it is read over the last data byte, which is
+ * put back afterwards.
+ */
+static int winread_more(Window *p, int fd, char *bp, int len, int budget)
+{
+	while (len < budget) {
+		int want = budget - len;
+		char *at = bp + len;
+		int n;
+#ifdef TIOCPKT
+		char save = 0;
+
+		if (p->w_type == W_TYPE_PTY) {
+			save = *--at;
+			want++;
+		}
+#endif
+		n = read(fd, at, want);
+#ifdef TIOCPKT
+		if (p->w_type == W_TYPE_PTY) {
+			char status = *at;
+
+			*at = save;
+			if (n > 0 && status) {
+				if (status & TIOCPKT_NOSTOP)
+					WNewAutoFlow(p, 0);
+				if (status & TIOCPKT_DOSTOP)
+					WNewAutoFlow(p, 1);
+				break;
+			}
+			n--;
+		}
+#endif
+		/* errors and EOF are seen again at the next poll */
+		if (n <= 0)
+			break;
+		len += n;
+	}
+	return len;
+}
+
+/*
+ * ImmorTerm: counts len bytes read by p, for the stats command, and the
+ * bytes of each second for WindowRate().
+ */
+static void WindowStatsRead(Window *p, int len)
+{
+	struct winstats *ws = &p->w_stats;
+	int sec = SchedNow() / 1000;
+
+	if (sec != ws->ws_sec) {
+		ws->ws_rate = sec == ws->ws_sec + 1 ? ws->ws_secbytes : 0;
+		ws->ws_sec = sec;
+		ws->ws_secbytes = 0;
+	}
+	ws->ws_secbytes += len;
+	ws->ws_read += len;
+}
+
+/* counts the time p's reading waits for a display to catch up */
+static void WindowStatsGated(Window *p, bool gated)
+{
+	struct winstats *ws = &p->w_stats;
+
+	if (gated == ws->ws_gated)
+		return;
+	if (gated)
+		ws->ws_gatedsince = SchedNow();
+	else
+		ws->ws_gatedms += SchedNow() - ws->ws_gatedsince;
+	ws->ws_gated = gated;
+}
+
+/* ImmorTerm: bytes p read in the last full second */
+uint64_t WindowRate(Window *p)
+{
+	struct winstats *ws = &p->w_stats;
+	int sec = SchedNow() / 1000;
+
+	if (sec == ws->ws_sec)
+		return ws->ws_rate;
+	return sec == ws->ws_sec + 1 ? ws->ws_secbytes : 0;
+}
+
+/*
+ * ImmorTerm: output of a window alone on its display goes to the terminal
+ * as it is, when PassthruScan() finds that the terminal makes of it what
+ * the emulator does. The emulator still takes it in, with the layer
+ * paused, so that the window is the same as ever when it is drawn anew,
+ * but what it would have drawn is dropped: the terminal is brought to the
+ * cursor, rendition and scroll region the emulator had before, gets the
+ * output, and is then where the emulator is, but for the rows below the
+ * window if they were erased. Messages, overlays such as copy mode and
+ * splits make the output go the usual way.
+ */
+static bool WinPassthru(Window *p, char *buf, int len)
+{
+	Canvas *cv = p->w_layer.l_cvlist;
+	struct passthru pt;
+	struct dispout out;
+	struct mchar rend;
+	Display *d;
+	int flags, mark, vis, x, y;
+	uint64_t nwrites;
+
+	if (!cv || cv->c_lnext || cv->c_layer != &p->w_layer || p->w_savelayer != &p->w_layer)
+		return false;
+	display = d = cv->c_display;
+	if (D_cvlist != cv || cv->c_next || D_forecv != cv || D_fore != p || D_blocked || D_status
+	    || D_status_obufpos || D_revvid || D_encoding != UTF8 || p->w_encoding != UTF8)
+		return false;
+	if (cv->c_xs || cv->c_ys || cv->c_xoff || cv->c_yoff || p->w_width != D_width
+	    || p->w_height != cv->c_ye + 1 || cv->c_vplist->v_next)
+		return false;
+	if (!D_CLP || !D_AM || !D_BE || !D_CS || !D_CM || strncmp(D_termname, "xterm", 5))
+		return false;
+	if (p->w_state != LIT || p->w_syncupdate || p->w_layer.l_pause.d || !p->w_wrap || p->w_origin
+	    || p->w_insert || p->w_autolf || p->w_revvid || p->w_curvvis || p->w_ss || p->w_FontL != ASCII
+	    || p->w_top != 0 || p->w_bot != p->w_height - 1 || p->w_x >= p->w_width)
+		return false;
+
+	pt.width = p->w_width;
+	pt.height = p->w_height;
+	pt.x = p->w_x;
+	pt.tabs = true;
+	for (int i = 0; i < p->w_width && pt.tabs; i++)
+		pt.tabs = p->w_tabs[i] == (i && i % 8 == 0);
+	pt.truecolor = hastruecolor;
+	if ((flags = PassthruScan(&pt, buf, len)) < 0)
+		return false;
+
+	x = p->w_x;
+	y = p->w_y;
+	rend = p->w_rend;
+	vis = p->w_curinv ? -1 : 0;
+
+	/* the emulator takes it in, what its layer sends the display is undone */
+	out = d->d_out;
+	mark = D_obufp - D_obuf;
+	nwrites = D_nwrites;
+	passwin = p;
+	p->w_layer.l_pause.frame = true;
+	LayPause(&p->w_layer, 1);
+	WriteString(p, buf, len);
+	LayPauseDrop(&p->w_layer);
+	passwin = NULL;
+	display = d;
+	if (D_nwrites == nwrites && D_obufp - D_obuf >= mark) {
+		D_obuffree += D_obufp - D_obuf - mark;
+		D_obufp = D_obuf + mark;
+		d->d_out = out;
+	}
+
+	ChangeScrollRegion(0, p->w_height - 1);
+	InsertMode(false);
+	CursorVisibility(vis);
+	GotoPos(x, y);
+	SetRendition(&rend);
+	AddRawStrn(buf, len);
+
+	/* SGR leaves the font alone, and \E[m resets what any attribute type set */
+	D_rend.attr = p->w_rend.attr;
+	D_rend.colorfg = p->w_rend.colorfg;
+	D_rend.colorbg = p->w_rend.colorbg;
+	D_atyp = ATYP_M | ATYP_S | ATYP_U;
+	D_curvis = p->w_curinv ? -1 : 0;
+	D_top = 0;
+	D_bot = p->w_height - 1;
+	D_x = p->w_x;
+	D_y = p->w_y;
+	D_lp_missing = 0;
+	if (flags & PASSTHRU_ERASED) {
+		D_hstatus = false;	/* not there anymore */
+		for (int row = p->w_height; row < D_height; row++)
+			RefreshLine(row, 0, D_width - 1, 1);
+		GotoPos(p->w_x, p->w_y);
+	}
+	p->w_stats.ws_passed += len;
+	return true;
+}
+
+/* Reads and processes what p has to give, returns the bytes it read */
+static int win_read(Window *p, Event *event)
 {
-	Window *p = (Window *)data;
 	char buf[IOSIZE], *bp;
 	int size, len;
-	int wtop;
+	int wtop, teed = 0;
+	bool batch;
 
 	bp = buf;
 	size = IOSIZE;
@@ -1485,16 +1873,19 @@ static void win_readev_fn(Event *event, void *data)
 		if (size <= 0) {
 			event->condpos = &const_IOSIZE;
 			event->condneg = (int *)&p->w_pwin->p_inlen;
-			return;
+			return 0;
 		}
 	}
-	if (p->w_layer.l_cvlist && muchpending(p, event))
-		return;
+	if (p->w_layer.l_cvlist && muchpending(p, event)) {
+		WindowStatsGated(p, true);
+		return 0;
+	}
+	WindowStatsGated(p, false);
 	if (!p->w_zdisplay)
 		if (p->w_blocked) {
 			event->condpos = &const_one;
 			event->condneg = &p->w_blocked;
-			return;
+			return 0;
 		}
 	if (event->condpos)
 		event->condpos = event->condneg = NULL;
@@ -1502,25 +1893,54 @@ static void win_readev_fn(Event *event, void *data)
 	if ((len = p->w_outlen)) {
 		p->w_outlen = 0;
 		WriteString(p, p->w_outbuf, len);
-		return;
+		return len;
 	}
 
-	if ((len = read(event->fd, buf, size)) <= 0) {
+	/* Batch the reads of a flooding window that is not being drawn, so
+	 * that it is processed once per budget rather than once per IOSIZE.
+	 * Pseudo windows have their own buffer (and their fd may be
+	 * blocking), telnet converts in place. */
+	batch = !p->w_pwin && (p->w_type == W_TYPE_PTY || p->w_type == W_TYPE_PLAIN);
+	if (batch && p->w_readbuf) {
+		bp = p->w_readbuf;
+		size = winread_budget(p);
+	}
+	if ((size = winread_share(p, size)) == 0)
+		return 0;
+#ifdef HAVE_SPLICE
+	if (wtop && p->w_pwin->p_spill[0] >= 0 && !p->w_pwin->p_inlen && !zmodem_mode)
+		len = pseu_tee(p, event->fd, bp, size, &teed);
+	else
+#endif
+		len = read(event->fd, bp, size);
+	if (len <= 0) {
 		if (errno == EINTR || errno == EAGAIN)
-			return;
+			return 0;
 #if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
 		if (errno == EWOULDBLOCK)
-			return;
+			return 0;
 #endif
 		WindowDied(p, 0, 0);
-		return;
+		return 0;
+	}
+	/* a full tty buffer: the window is likely flooding */
+	if (batch && len >= IOSIZE) {
+		if (bp == buf && (p->w_readbuf = malloc(WINREAD_MAX + 1)) != NULL) {
+			memcpy(p->w_readbuf, buf, len);
+			bp = p->w_readbuf;
+			size = winread_share(p, winread_budget(p));
+		}
+		if (bp != buf)
+			len = winread_more(p, event->fd, bp, len, size);
 	}
+	winread_shared(p, size, len);
+	WindowStatsRead(p, len);
 #ifdef TIOCPKT
 	if (p->w_type == W_TYPE_PTY) {
-		if (buf[0]) {
-			if (buf[0] & TIOCPKT_NOSTOP)
+		if (bp[0]) {
+			if (bp[0] & TIOCPKT_NOSTOP)
 				WNewAutoFlow(p, 0);
-			if (buf[0] & TIOCPKT_DOSTOP)
+			if (bp[0] & TIOCPKT_DOSTOP)
 				WNewAutoFlow(p, 1);
 		}
 		bp++;
@@ -1532,19 +1952,59 @@ static void win_readev_fn(Event *event, void *data)
 		len = TelIn(p, bp, len, buf + ARRAY_SIZE(buf) - (bp + len));
 #endif
 	if (len == 0)
-		return;
+		return 0;
 	if (zmodem_mode && zmodem_parse(p, bp, len))
-		return;
-	if (wtop) {
-		memmove(p->w_pwin->p_inbuf + p->w_pwin->p_inlen, bp, len);
-		p->w_pwin->p_inlen += len;
+		return len;
+	if (wtop && len > teed) {
+		struct pseudowin *pw = p->w_pwin;
+		int n;
+
+		/* ImmorTerm: what p_pipe did not take from pseu_tee() goes
+		 * behind it, or in it while it is empty */
+		if (pw->p_pipe[1] >= 0 && !pw->p_pipelen && !pw->p_inlen && (n = write(pw->p_pipe[1], bp + teed, len - teed)) > 0) {
+			pw->p_pipelen += n;
+			teed += n;
+		}
+		if (len > teed) {
+			memmove(pw->p_inbuf + pw->p_inlen, bp + teed, len - teed);
+			pw->p_inlen += len - teed;
+		}
+	}
+
+	if (passthrough && !(render_fps > 0 && p->w_frameev.queued) && WinPassthru(p, bp, len))
+		return len;
+
+	if (p->w_syncupdate || (render_fps > 0 && p->w_frameev.queued)) {
+		/* inside a frame: only note what changed, the end of the frame draws it */
+		p->w_layer.l_pause.frame = true;
+		LayPause(&p->w_layer, 1);
+		WriteString(p, bp, len);
+		return len;
 	}
 
 	LayPause(&p->w_layer, 1);
 	WriteString(p, bp, len);
-	LayPause(&p->w_layer, 0);
+	if (!p->w_syncupdate)
+		LayPause(&p->w_layer, 0);
 
-	return;
+	if (render_fps > 0 && !p->w_frameev.queued) {
+		/* drawn at once, anything more within this frame waits for its end */
+		SetTimeout(&p->w_frameev, 1000 / render_fps);
+		evenq(&p->w_frameev);
+	}
+	return len;
+}
+
+static void win_readev_fn(Event *event, void *data)
+{
+	Window *p = (Window *)data;
+	int number = p->w_number, len;
+
+	TRACE1(win__read__entry, number);
+	len = win_read(p, event);
+	TRACE2(win__read__return, number, len);
+	if (len > 0)
+		StartupTrace(STARTUP_OUTPUT);
 }
 
 static void win_resurrect_zombie_fn(Event *event, void *data)
@@ -1560,6 +2020,20 @@ static void win_resurrect_zombie_fn(Event *event, void *data)
 	RemakeWindow(p);
 }
 
+/*
+ * A paste going straight into a pty does not have to be squeezed through
+ * w_inbuf: it is written from the paste buffer itself, as much at a time
+ * as the pty takes.
+ */
+static bool paste_direct(Window *p)
+{
+	struct paster *pa = &p->w_paster;
+
+	return pa->pa_pastelen && !p->w_slowpaste && pa->pa_pastelayer == &p->w_layer &&
+	    p->w_ptyfd >= 0 && (p->w_type == W_TYPE_PTY || p->w_type == W_TYPE_PLAIN) &&
+	    !W_UWP(p) && !p->w_autolf && !p->w_miflag;
+}
+
 static void win_writeev_fn(Event *event, void *data)
 {
 	Window *p = (Window *)data;
@@ -1580,10 +2054,24 @@ static void win_writeev_fn(Event *event, void *data)
 	}
 	if (p->w_paster.pa_pastelen && !p->w_slowpaste) {
 		struct paster *pa = &p->w_paster;
-		flayer = pa->pa_pastelayer;
-		if (flayer)
-			DoProcess(p, &pa->pa_pasteptr, &pa->pa_pastelen, pa);
+
+		if (!p->w_inlen && paste_direct(p)) {
+			ssize_t n = write(event->fd, pa->pa_pasteptr, pa->pa_pastelen);
+
+			if (n > 0) {
+				pa->pa_pasteptr += n;
+				if ((pa->pa_pastelen -= n) == 0)
+					EndPaster(pa);
+			} else if (n < 0 && errno != EAGAIN && errno != EINTR)
+				FreePaster(pa);	/* dead window */
+		} else {
+			flayer = pa->pa_pastelayer;
+			if (flayer)
+				DoProcess(p, &pa->pa_pasteptr, &pa->pa_pastelen, pa);
+		}
 	}
+	/* wait for room in the pty until a direct paste is done */
+	event->condpos = paste_direct(p) ? &const_one : (int *)&p->w_inlen;
 	return;
 }
 
@@ -1639,12 +2127,83 @@ static void pseu_readev_fn(Event *event, void *data)
 	return;
 }
 
+#ifdef HAVE_SPLICE
+/*
+ * ImmorTerm: output of a window that also goes to its pseudo (exec with
+ * stdin ':') passes it in the kernel: the window output is spliced into
+ * p_spill and teed from there into p_pipe, and screen reads its own copy
+ * back from p_spill. p_pipe is spliced into the pseudo as it takes it and
+ * queues up to PSEUDO_PIPESZ, rather than the IOSIZE of p_inbuf, before
+ * the window has to wait for a filter that falls behind. p_inbuf takes
+ * only what p_pipe does not, and goes after it.
+ */
+static void pseu_pipes(struct pseudowin *pw)
+{
+	if (pipe2(pw->p_pipe, O_NONBLOCK | O_CLOEXEC) == 0 && pipe2(pw->p_spill, O_NONBLOCK | O_CLOEXEC) == 0) {
+		(void)fcntl(pw->p_pipe[1], F_SETPIPE_SZ, PSEUDO_PIPESZ);
+		return;
+	}
+	for (int i = 0; i < 2; i++) {
+		if (pw->p_pipe[i] >= 0)
+			close(pw->p_pipe[i]);
+		pw->p_pipe[i] = -1;
+	}
+}
+
+/* Reads the window like read() and puts in *teedp how much of it already
+ * is in p_pipe for the pseudo */
+static ssize_t pseu_tee(Window *p, int fd, char *buf, size_t size, int *teedp)
+{
+	struct pseudowin *pw = p->w_pwin;
+	ssize_t len, n, off = 0;
+
+	if ((len = splice(fd, NULL, pw->p_spill[1], NULL, size, SPLICE_F_NONBLOCK)) < 0 && errno == EINVAL) {
+		/* a tty that cannot splice: it all goes through screen */
+		for (int i = 0; i < 2; i++) {
+			close(pw->p_spill[i]);
+			pw->p_spill[i] = -1;
+		}
+		return read(fd, buf, size);
+	}
+	if (len <= 0)
+		return len;
+#ifdef TIOCPKT
+	/* the packet header is for screen alone */
+	if (p->w_type == W_TYPE_PTY && read(pw->p_spill[0], buf, 1) == 1)
+		off = 1;
+#endif
+	if (len > off && (n = tee(pw->p_spill[0], pw->p_pipe[1], len - off, SPLICE_F_NONBLOCK)) > 0) {
+		pw->p_pipelen += n;
+		*teedp = n;
+	}
+	n = read(pw->p_spill[0], buf + off, len - off);
+	return n < 0 ? n : off + n;
+}
+#endif
+
 static void pseu_writeev_fn(Event *event, void *data)
 {
 	Window *p = (Window *)data;
 	struct pseudowin *pw = p->w_pwin;
 	size_t len;
 
+#ifdef HAVE_SPLICE
+	if (pw->p_pipe[0] >= 0) {
+		ssize_t n = splice(pw->p_pipe[0], NULL, event->fd, NULL, pw->p_pipelen, SPLICE_F_NONBLOCK | SPLICE_F_MOVE);
+
+		if (n > 0)
+			pw->p_pipelen -= n;
+		else if (n < 0 && errno != EAGAIN && errno != EINTR)
+			pw->p_pipelen = pw->p_inlen = 0;	/* dead pseudo */
+		/* p_pipe has room for what waits behind it once it is empty */
+		if (!pw->p_pipelen && pw->p_inlen && (n = write(pw->p_pipe[1], pw->p_inbuf, pw->p_inlen)) > 0) {
+			pw->p_pipelen += n;
+			if ((pw->p_inlen -= n))
+				memmove(pw->p_inbuf, pw->p_inbuf + n, pw->p_inlen);
+		}
+		return;
+	}
+#endif
 	if (pw->p_inlen == 0)
 		return;
 	if ((len = write(event->fd, pw->p_inbuf, pw->p_inlen)) <= 0)
@@ -1674,6 +2233,62 @@ static void win_silenceev_fn(Event *event, void *data)
 	}
 }
 
+/*
+ * ImmorTerm: a frame of a window's output is over. Whatever the window drew
+ * since the frame began was only recorded in the layer's pause region, so
+ * bring the canvases up to date with one refresh of the damaged spans and
+ * start the next frame. If the window stayed quiet, stop; its next output
+ * is then drawn right away.
+ */
+static void win_frameev_fn(Event *event, void *data)
+{
+	Window *p = (Window *)data;
+
+	(void)event; /* unused */
+
+	if (!p->w_layer.l_pause.frame || p->w_syncupdate)
+		return;
+	LayPause(&p->w_layer, 0);
+	p->w_layer.l_pause.frame = false;
+	if (render_fps > 0) {
+		SetTimeout(&p->w_frameev, 1000 / render_fps);
+		evenq(&p->w_frameev);
+	}
+}
+
+/*
+ * ImmorTerm: the application brackets a frame with CSI ? 2026 h/l
+ * (synchronized output). Hold back the window's output on all canvases
+ * from the start until the end of the frame, then draw what changed at
+ * once. Applications that never end the frame are cut off after
+ * SYNC_TIMEOUT ms.
+ */
+void WinSyncUpdate(Window *p, bool on)
+{
+	if (p->w_syncupdate == on)
+		return;
+	p->w_syncupdate = on;
+	if (p == passwin)
+		return;		/* the terminal holds the frame back itself */
+	if (on) {
+		p->w_layer.l_pause.frame = true;
+		LayPause(&p->w_layer, 1);
+		SetTimeout(&p->w_syncev, SYNC_TIMEOUT);
+		evenq(&p->w_syncev);
+		return;
+	}
+	evdeq(&p->w_syncev);
+	LayPause(&p->w_layer, 0);
+	p->w_layer.l_pause.frame = false;
+}
+
+static void win_syncev_fn(Event *event, void *data)
+{
+	(void)event; /* unused */
+
+	WinSyncUpdate((Window *)data, false);
+}
+
 static void win_destroyev_fn(Event *event, void *data)
 {
 	Window *p = (Window *)event->data;
@@ -1716,7 +2331,7 @@ static int zmodem_parse(Window *p, char *bp, size_t len)
 						break;
 				if (i < len) {
 					zmodem_abort(p, NULL);
-					D_blocked = 0;
+					SetBlocked(0);
 					D_readev.condpos = D_readev.condneg = NULL;
 					while (len-- > 0)
 						AddChar(*bp++);
@@ -1786,7 +2401,7 @@ static void zmodem_found(Window *p, int send, char *bp, size_t len)
 		display = d;
 		RemoveStatus();
 		p->w_zdisplay = display;
-		D_blocked = 2 + send;
+		SetBlocked(2 + send);
 		flayer = &p->w_layer;
 		ZmodemPage();
 		display = d;
@@ -1826,7 +2441,7 @@ void zmodem_abort(Window *p, Display *d)
 	}
 	if (d) {
 		display = d;
-		D_blocked = 0;
+		SetBlocked(0);
 		D_readev.condpos = D_readev.condneg = NULL;
 		Activate(D_fore ? D_fore->w_norefresh : 0);
 	}
@@ -1986,6 +2601,7 @@ void ResetWindow(Window *win)
 		win->w_tabs[i] = 1;
 	win->w_rend = mchar_null;
 	ResetCharsets(win);
+	WinSyncUpdate(win, false);
 }
 
 Window *GetWindowByNumber(uint16_t n)
@@ -2010,3 +2626,282 @@ Window *GetWindowByNumber(uint16_t n)
 	}
 	return NULL;
 }
+
+/* ImmorTerm: working directory of the process in the window, "" if unknown. */
+void WindowCwd(Window *win, char *buf, size_t size)
+{
+	*buf = 0;
+	if (win->w_pid <= 0)
+		return;
+#if defined(__APPLE__)
+	struct proc_vnodepathinfo vpi;
+
+	if (proc_pidinfo(win->w_pid, PROC_PIDVNODEPATHINFO, 0, &vpi, sizeof(vpi)) == sizeof(vpi))
+		strncpy(buf, vpi.pvi_cdir.vip_path, size - 1);
+	buf[size - 1] = 0;
+#else
+	char link[64];
+	ssize_t n;
+
+	snprintf(link, sizeof(link), "/proc/%d/cwd", (int)win->w_pid);
+	if ((n = readlink(link, buf, size - 1)) < 0)
+		n = 0;
+	buf[n] = 0;
+#endif
+}
+
+/*
+ * ImmorTerm: the process group in the foreground of the window's terminal
+ * and, in name, the command of its leader ("" if unknown); -1 if none.
+ */
+pid_t WindowForeground(Window *win, char *name, size_t size)
+{
+	pid_t pgrp;
+
+	*name = 0;
+	if (win->w_ptyfd < 0 || (pgrp = tcgetpgrp(win->w_ptyfd)) <= 0)
+		return -1;
+#if defined(__APPLE__)
+	if (proc_name(pgrp, name, size) <= 0)
+		*name = 0;
+#else
+	char path[64];
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof(path), "/proc/%d/comm", (int)pgrp);
+	if ((fd = open(path, O_RDONLY)) >= 0) {
+		if ((n = read(fd, name, size - 1)) < 0)
+			n = 0;
+		name[n] = 0;
+		name[strcspn(name, "\n")] = 0;
+		close(fd);
+	}
+#endif
+	return pgrp;
+}
+
+/* adds the arrays of n lines of width w to *image and *rend */
+static void MlinesSize(struct mline *ml, int n, int w, size_t *image, size_t *rend)
+{
+	for (; n > 0; n--, ml++) {
+		if (ml->image)
+			*image += w * sizeof(uint32_t);
+		if (ml->attr && ml->attr != null)
+			*rend += w * sizeof(uint32_t);
+		if (ml->font && ml->font != null)
+			*rend += w * sizeof(uint32_t);
+		if (ml->colorbg && ml->colorbg != null)
+			*rend += w * sizeof(uint32_t);
+		if (ml->colorfg && ml->colorfg != null)
+			*rend += w * sizeof(uint32_t);
+	}
+}
+
+/*
+ * ImmorTerm: what the window keeps in memory, by part. Allocator
+ * overhead is not counted, nor the lines HistLine() expands, which are
+ * shared by all windows.
+ */
+void WindowMemory(Window *win, struct winmem *wm)
+{
+	int i, nblocks = win->w_histheight / HBLOCK;
+	size_t rend = 0;
+
+	memset(wm, 0, sizeof(*wm));
+	if (win->w_mlinebuf)
+		wm->screen = 2 * win->w_height * sizeof(struct mline);
+	MlinesSize(win->w_mlines, win->w_height, win->w_width + 1, &wm->screen, &wm->screenrend);
+
+	wm->histring = win->w_histheight * sizeof(struct hline);
+	for (i = 0; win->w_hlines && i < win->w_histheight; i++)
+		cell_size(&win->w_hlines[i], &wm->hist, &wm->histrend);
+	if (win->w_hblocks) {
+		wm->histring += nblocks * sizeof(struct hblock);
+		for (i = 0; i < nblocks; i++) {
+			if (!win->w_hblocks[i].data || win->w_hblocks[i].mapped == HB_STORED)
+				continue;
+			if (win->w_hblocks[i].mapped == HB_MAPPED)
+				wm->mapped += win->w_hblocks[i].len;
+			else
+				wm->frozen += win->w_hblocks[i].len;
+		}
+	}
+	wm->pending += RedrawSize(win);
+	for (struct hpending *hp = win->w_hpend; hp; hp = hp->hp_older) {
+		wm->pending += sizeof(*hp) + hp->hp_count * sizeof(struct hline);
+		for (i = 0; i < hp->hp_count; i++)
+			cell_size(&hp->hp_lines[i], &wm->pending, &wm->pending);
+	}
+
+	if (win->w_alt.mlinebuf)
+		wm->alt = 2 * win->w_alt.height * sizeof(struct mline);
+	MlinesSize(win->w_alt.mlines, win->w_alt.height, win->w_alt.width + 1, &wm->alt, &rend);
+	wm->alt += rend + win->w_alt.histheight * sizeof(struct hline);
+	for (i = 0; win->w_alt.hlines && i < win->w_alt.histheight; i++)
+		cell_size(&win->w_alt.hlines[i], &wm->alt, &wm->alt);
+
+	wm->pool = win->w_linepool.lp_count * win->w_linepool.lp_width * sizeof(uint32_t);
+	wm->search = SearchIndexSize(win);
+	if (win->w_log)
+		wm->log = logfsize(win->w_log);
+	if (win->w_tlog && win->w_tlog != win->w_log)
+		wm->log += logfsize(win->w_tlog);
+	if (win->w_paster.pa_pastebuf)
+		wm->paste = win->w_paster.pa_pasteptr - win->w_paster.pa_pastebuf + win->w_paster.pa_pastelen;
+	wm->other = win->w_stringsize + CheckpointSize(win);
+	if (win->w_readbuf)
+		wm->other += WINREAD_MAX + 1;
+	if (win->w_tabs)
+		wm->other += (win->w_width + 1) * 4;
+	if (win->w_pwin)
+		wm->other += sizeof(*win->w_pwin);
+
+	wm->total = sizeof(*win) + wm->screen + wm->screenrend + wm->hist + wm->histrend + wm->histring
+	    + wm->frozen + wm->pending + wm->alt + wm->pool + wm->search + wm->log + wm->paste + wm->other;
+}
+
+/*
+ * ImmorTerm: hibernation. A window that has had no output for hibernate
+ * seconds and is not shown gives back what can be rebuilt: its history
+ * is compressed as a whole (into the scrollback file with
+ * scrollback_dir), its search index, line pool and read buffer are
+ * freed. Output or being shown again wakes it up; before that, reading
+ * its history expands blocks one at a time, as for cold scrollback.
+ */
+static Event hibernateev;
+
+void WindowHibernate(Window *win)
+{
+	win->w_hibernated = true;
+	HistHibernate(win);
+	SearchIndexDrop(win);
+	LinePoolReset(win, win->w_width + 1);
+	free(win->w_readbuf);
+	win->w_readbuf = NULL;
+}
+
+void WindowWake(Window *win)
+{
+	if (!win->w_hibernated)
+		return;
+	win->w_hibernated = false;
+	HistWake(win);
+}
+
+static void hibernate_fn(Event *ev, void *data)
+{
+	time_t now = time(NULL);
+	bool slept = false;
+
+	(void)data;
+	for (Window *win = mru_window; win; win = win->w_prev_mru) {
+		/* an overlay, e.g. copy mode, means it is in use */
+		if (win->w_type == W_TYPE_GROUP || win->w_layer.l_cvlist || win->w_savelayer != &win->w_layer
+		    || now - win->w_last_activity < hibernate)
+			continue;
+		/* again for one already asleep, for what was read meanwhile */
+		WindowHibernate(win);
+		slept = true;
+	}
+#ifdef __GLIBC__
+	/* give the freed pages back rather than keep them for us */
+	if (slept)
+		malloc_trim(0);
+#endif
+	SetTimeout(ev, HIBERNATE_WAIT * 1000);
+	evenq(ev);
+}
+
+/* (Re)starts looking for windows to hibernate, or wakes them all up
+ * when hibernate is 0. */
+void HibernateStart(void)
+{
+	evdeq(&hibernateev);
+	if (hibernate <= 0) {
+		for (Window *win = mru_window; win; win = win->w_prev_mru)
+			WindowWake(win);
+		return;
+	}
+	hibernateev.type = EV_TIMEOUT;
+	hibernateev.handler = hibernate_fn;
+	hibernateev.name = "hibernate_fn";
+	SetTimeout(&hibernateev, HIBERNATE_WAIT * 1000);
+	evenq(&hibernateev);
+}
+
+/*
+ * ImmorTerm: scrollback_budget. Every BUDGET_CHECK seconds the history
+ * all windows hold on the heap is added up; when it is over the budget,
+ * it is brought back under by compressing history, then by forgetting
+ * it, older than the newest scrollback_budget_keep lines of each window.
+ * Each step goes through the windows least recently used first, so that
+ * a busy window shown all day does not cost the quiet ones their
+ * history before its own. Windows in copy mode only get compressed.
+ */
+static Event budgetev;
+
+static size_t HistMemory(Window *win)
+{
+	struct winmem wm;
+
+	WindowMemory(win, &wm);
+	return wm.hist + wm.histrend + wm.frozen;
+}
+
+void BudgetCheck(void)
+{
+	Window **wins, *win;
+	size_t total = 0, freed = 0;
+	int n = 0;
+
+	if (!scrollback_budget)
+		return;
+	for (win = mru_window; win; win = win->w_prev_mru)
+		n++;
+	if (!n || (wins = malloc(n * sizeof(*wins))) == NULL)
+		return;
+	n = 0;
+	for (win = mru_window; win; win = win->w_prev_mru)
+		if (win->w_type != W_TYPE_GROUP) {
+			wins[n++] = win;
+			total += HistMemory(win);
+		}
+	for (int drop = 0; drop < 2 && total > scrollback_budget; drop++)
+		for (int i = n - 1; i >= 0 && total > scrollback_budget; i--) {
+			size_t f;
+
+			if (drop && wins[i]->w_savelayer != &wins[i]->w_layer)
+				continue;
+			f = HistShrink(wins[i], scrollback_budget_keep, total - scrollback_budget, drop);
+			total -= MIN(total, f);
+			freed += f;
+		}
+	free(wins);
+#ifdef __GLIBC__
+	if (freed)
+		malloc_trim(0);
+#endif
+}
+
+static void budget_fn(Event *ev, void *data)
+{
+	(void)data;
+	BudgetCheck();
+	SetTimeout(ev, BUDGET_CHECK * 1000);
+	evenq(ev);
+}
+
+/* (Re)starts keeping the history within scrollback_budget. */
+void BudgetStart(void)
+{
+	evdeq(&budgetev);
+	if (!scrollback_budget)
+		return;
+	BudgetCheck();
+	budgetev.type = EV_TIMEOUT;
+	budgetev.handler = budget_fn;
+	budgetev.name = "budget_fn";
+	SetTimeout(&budgetev, BUDGET_CHECK * 1000);
+	evenq(&budgetev);
+}
@@ -67,6 +67,8 @@ struct NewWindow {
 	char	*hstatus;
 	char	*charset;
 	int	poll_zombie_timeout;
+	int	searchindex;	/* ImmorTerm: index the history for search */
+	struct Hosted *hosted;	/* ImmorTerm: the hosted session it goes in */
 };
 
 
@@ -80,8 +82,16 @@ struct pseudowin {
 	char	p_tty[MAXSTR];
 	char	p_inbuf[IOSIZE];	/* buffered writing to p_ptyfd */
 	size_t	p_inlen;
+	/* ImmorTerm: window output for p_ptyfd goes through a pipe, see
+	 * pseu_tee() in window.c */
+	int	p_pipe[2];	/* queued for p_ptyfd, ahead of p_inbuf */
+	int	p_spill[2];	/* what screen reads of the window */
+	int	p_pipelen;	/* bytes in p_pipe */
 };
 
+/* ImmorTerm: the most window output queued in p_pipe */
+#define PSEUDO_PIPESZ	(1024 * 1024)
+
 /* bits for fdpat: */
 #define F_PMASK 	0x0003
 #define F_PSHIFT	2
@@ -133,8 +143,73 @@ struct paster {
 	size_t	 pa_pastelen;		/* bytes left to paste */
 	Layer	*pa_pastelayer;		/* layer to paste into */
 	Event	 pa_slowev;		/* slowpaste event */
+	bool	 pa_bracketed;		/* ImmorTerm: bracketed paste end still to send */
+};
+
+/* ImmorTerm: recycled line arrays, see LinePoolGet() */
+struct linepool {
+	uint32_t *lp_free;		/* free arrays, each starting with a pointer to the next */
+	int	 lp_count;		/* number of arrays in lp_free */
+	int	 lp_width;		/* size of the arrays, in uint32_t */
+	struct hlinehigh lp_high;	/* of the lines packed for the window */
+};
+
+/* ImmorTerm: history waiting to be rewrapped, see HistReflow() */
+struct hpending {
+	struct hline *hp_lines;		/* oldest first */
+	int	 hp_count;
+	int	 hp_width;		/* window width of the lines */
+	struct hpending *hp_older;
+};
+
+/* ImmorTerm: file holding the compressed history, see scrollback_dir */
+struct histmap {
+	char	*hm_base;		/* mapping of the file, NULL if none */
+	size_t	 hm_slot;		/* bytes per history block */
+	size_t	 hm_size;
+	int	 hm_fd;
+	char	*hm_path;
+	bool	 hm_failed;		/* could not set it up, use the heap */
 };
 
+/* ImmorTerm: counters for the stats command and the %R escape */
+struct winstats {
+	uint64_t ws_read;		/* bytes read from the pty */
+	uint64_t ws_parsed;		/* bytes through WriteString() */
+	uint64_t ws_passed;		/* of them, sent to the terminal as they are */
+	uint64_t ws_scrolled;		/* lines scrolled into the history */
+	uint64_t ws_logged;		/* bytes written to w_log and w_tlog */
+	uint64_t ws_gatedms;		/* time reading waited for a display */
+	int	 ws_gatedsince;		/* SchedNow() when it began waiting */
+	bool	 ws_gated;
+	int	 ws_sec;		/* second of SchedNow() ws_secbytes were read in */
+	uint64_t ws_secbytes;
+	uint64_t ws_rate;		/* bytes read in the second before it */
+};
+
+/* ImmorTerm: bytes of memory a window holds, see WindowMemory() */
+struct winmem {
+	size_t screen;		/* w_mlines: code points */
+	size_t screenrend;	/* w_mlines: attr, font and color arrays */
+	size_t hist;		/* w_hlines: code points */
+	size_t histrend;	/* w_hlines: style runs and packed styles */
+	size_t histring;	/* w_hlines and w_hblocks themselves */
+	size_t frozen;		/* compressed history blocks on the heap */
+	size_t mapped;		/* compressed history in the scrollback file */
+	size_t pending;		/* history not rewrapped yet, in w_hpend, or held back by a redraw */
+	size_t alt;		/* the screen and history set aside in w_alt */
+	size_t pool;		/* spare line arrays in w_linepool */
+	size_t search;		/* w_sindex */
+	size_t log;		/* buffers of w_log and w_tlog */
+	size_t paste;		/* paste still going into the window */
+	size_t other;		/* read buffer, control string, tabs, checkpoint */
+	size_t total;		/* all of the above but mapped */
+};
+
+struct ckptstate;
+struct histstore;
+struct searchindex;
+
 typedef struct Window Window;
 struct Window {
 	Window *w_prev;			/* previous window */
@@ -160,6 +235,8 @@ struct Window {
 	size_t	 w_inlen;
 	char	 w_outbuf[IOSIZE];
 	size_t	 w_outlen;
+	char	*w_readbuf;		/* ImmorTerm: batched reads of a flooding window */
+	int	 w_deficit;		/* ImmorTerm: see winread_share() */
 	bool	 w_aflag;		/* (-a option) */
 	bool	 w_dynamicaka;		/* should we change name */
 	char	*w_title;		/* name of the window */
@@ -167,6 +244,7 @@ struct Window {
 	char	 w_akabuf[MAXSTR];	/* aka buffer */
 	int	 w_autoaka;		/* autoaka hack */
 	Window  *w_group;		/* window group we belong to */
+	struct Hosted *w_hosted;	/* ImmorTerm: the hosted session it is in */
 	int	 w_intermediate;	/* char used while parsing ESC-seq */
 	int	 w_args[MAXARGS];	/* emulator args */
 	int	 w_NumArgs;
@@ -180,6 +258,8 @@ struct Window {
 	enum state_t w_state;		/* parser state */
 	enum string_t w_StringType;
 	struct mline *w_mlines;
+	struct mline *w_mlinebuf;	/* ImmorTerm: holds w_mlines, twice the height */
+	struct linepool w_linepool;	/* spare arrays for w_mlines */
 	struct mchar w_rend;		/* current rendition */
 	char	 w_FontL;		/* character font GL */
 	char	 w_FontR;		/* character font GR */
@@ -211,13 +291,19 @@ struct Window {
 	bool     w_c1;			/* enable C1 flag */
 	int	 w_decodestate;		/* state of our input decoder */
 	int	 w_mbcs;		/* saved char for multibytes charset */
-	char	 w_string[MAXSTR];
+	char	*w_string;		/* control string or print data being collected */
 	char	*w_stringp;
+	size_t	 w_stringsize;		/* ImmorTerm: allocated size of w_string */
 	char	*w_tabs;		/* line with tabs */
 	int	 w_bell;		/* bell status of this window */
 	int	 w_flow;		/* flow flags */
 	Log	 *w_log;	/* log to file */
+	Log	 *w_tlog;		/* ImmorTerm: rendered text log, may be w_log */
 	time_t	 w_last_activity;	/* timestamp of last I/O activity (for status bar) */
+	struct	 winstats w_stats;	/* ImmorTerm: see WindowStatsRead() */
+	time_t	 w_ckpttime;		/* ImmorTerm: when the last checkpoint was written */
+	struct ckptstate *w_ckpt;	/* ImmorTerm: its journal, see checkpoint.c */
+	int	 w_dumps;		/* ImmorTerm: displays still replaying its history */
 	int	 w_logsilence;		/* silence in secs */
 	int	 w_monitor;		/* monitor status */
 	int	 w_silencewait;		/* wait for silencewait secs */
@@ -233,7 +319,24 @@ struct Window {
 	int	 w_histheight;		/* all histbases are malloced with width * histheight */
 	int	 w_histidx;		/* 0 <= histidx < histheight; where we insert lines */
 	int	 w_scrollback_height;	/* number of lines of output stored, to be updated with w_histidx, w_histheight */
-	struct	 mline *w_hlines;	/* history buffer */
+	struct	 hline *w_hlines;	/* history buffer, packed */
+	struct	 hblock *w_hblocks;	/* ImmorTerm: compressed parts of w_hlines */
+	unsigned int w_hthaws;		/* last stamp handed out in w_hblocks */
+	struct	 histmap w_hmap;	/* where w_hblocks keeps its data */
+	struct	 histstore *w_hstore;	/* ImmorTerm: the history on disk, see histstore.h */
+	bool	 w_hibernated;		/* ImmorTerm: compacted while idle, see WindowHibernate() */
+	struct	 searchindex *w_sindex;	/* ImmorTerm: trigrams of w_hlines, see search.c */
+	bool	 w_searchindex;		/* keep w_sindex */
+	struct	 hpending *w_hpend;	/* ImmorTerm: older history, not rewrapped yet */
+	Event	 w_reflowev;		/* rewraps w_hpend */
+	struct	 hline *w_redraw;	/* ImmorTerm: lines a redraw scrolled off, see RedrawHold() */
+	int	 w_redrawfirst;		/* oldest of them, w_redraw is a ring */
+	int	 w_redrawcount;
+	bool	 w_redrawing;		/* a redraw is going on */
+	Event	 w_redrawev;		/* it settles */
+	Event	 w_frameev;		/* ImmorTerm: end of the current frame, see render_fps */
+	bool	 w_syncupdate;		/* ImmorTerm: application holds output (mode 2026) */
+	Event	 w_syncev;		/* gives up on a w_syncupdate that never ends */
 	struct	 paster w_paster;	/* paste info */
 	pid_t	 w_pid;			/* process at the other end of ptyfd */
 	pid_t	 w_deadpid;		/* saved w_pid of a process that closed the ptyfd to us */
@@ -266,10 +369,11 @@ struct Window {
 	struct {
 		int    on;    		/* Is the alternate buffer currently being used? */
 		struct mline *mlines;
+		struct mline *mlinebuf;
 		int    width;
 		int    height;
 		int    histheight;
-		struct mline *hlines;
+		struct hline *hlines;
 		int    histidx;
 		struct cursor cursor;
 	} w_alt;
@@ -314,10 +418,11 @@ struct Window {
  * WIN gives us a reference to line y of the *whole* image
  * where line 0 is the oldest line in our history.
  * y must be in whole image coordinate system, not in display.
+ * History lines are expanded on the fly, see HistLine().
  */
 
 #define WIN(y) ((y < fore->w_histheight) ? \
-      &fore->w_hlines[(fore->w_histidx + y) % fore->w_histheight] \
+      HistLine(fore, (fore->w_histidx + y) % fore->w_histheight) \
     : &fore->w_mlines[y - fore->w_histheight])
 
 #define Layer2Window(l) ((Window *)(l)->l_bottom->l_data)
@@ -330,6 +435,7 @@ int   winexec (char **);
 void  FreePseudowin (Window *);
 void  nwin_compose (struct NewWindow *, struct NewWindow *, struct NewWindow *);
 int   DoStartLog (Window *, char *, int);
+void  CloseLog (Window *);
 int   ReleaseAutoWritelock (Display *, Window *);
 int   ObtainAutoWritelock (Display *, Window *);
 int   OpenDevice(char **, int, int *, char **);
@@ -337,7 +443,17 @@ void  CloseDevice (Window *);
 void  zmodem_abort(Window *, Display *);
 void  WindowDied (Window *, int, int);
 void  ResetWindow (Window *);
+void  WinSyncUpdate (Window *, bool);
 Window *GetWindowByNumber(uint16_t);
+void  WindowCwd (Window *, char *, size_t);
+pid_t WindowForeground (Window *, char *, size_t);
+void  WindowMemory (Window *, struct winmem *);
+uint64_t WindowRate (Window *);
+void  WindowHibernate (Window *);
+void  WindowWake (Window *);
+void  HibernateStart (void);
+void  BudgetCheck (void);
+void  BudgetStart (void);
 #ifndef HAVE_EXECVPE
 #include <unistd.h>
 void execvpe(char *, char **, char **);
@@ -348,6 +464,20 @@ void execvpe(char *, char **, char **);
 extern char DefaultShell[];
 
 extern bool VerboseCreate;
+extern int render_fps;
+extern bool passthrough;
+extern int log_text;
+extern bool log_history;
+extern int hibernate;
+extern size_t scrollback_budget;
+extern int scrollback_budget_keep;
+
+/* ImmorTerm: what "logfile text" asks DoStartLog for */
+enum {
+	LOGTEXT_OFF,		/* raw output only */
+	LOGTEXT_ON,		/* raw output, plus rendered lines in <logfile>.txt */
+	LOGTEXT_ONLY		/* rendered lines instead of raw output */
+};
 
 extern const struct LayFuncs WinLf;
 extern struct NewWindow nwin_undef, nwin_default, nwin_options;
@@ -45,6 +45,7 @@
 #include "mark.h"
 #include "process.h"
 #include "sched.h"
+#include "socket.h"
 
 /* TODO: rid global variable (has been renamed to point this out; see commit
  * history) */
@@ -60,6 +61,9 @@ static const char days[]   = "SunMonTueWedThuFriSat";
 static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
 #endif
 
+/* number of compiled format strings kept */
+#define WINMSG_PROGCACHE 8
+
 /* escape char for backtick output */
 #define WINMSG_BT_ESC '\005'
 
@@ -326,37 +330,21 @@ winmsg_esc_ex(PadOrTrunc, int *numpad, int *lastpad, int padlen)
 /**
  * Processes rendition
  *
- * The first character of SRC is assumed to be (unverified) the opening brace
- * of the sequence.
+ * The spec was parsed when the format string was compiled; an unterminated
+ * spec adds nothing.
  */
-winmsg_esc(Rend)
+winmsg_esc_ex(Rend, const WinMsgOp *op)
 {
-	char rbuf[RENDBUF_SIZE];
-	uint8_t i;
-	uint64_t r;
-
-	(*src)++;
-	for (i = 0; i < (RENDBUF_SIZE-1); i++) {
-		char c = (*src)[i];
-		if (c && c != WINESC_REND_END)
-			rbuf[i] = c;
-		else
-			break;
-	}
-
-	if (((*src)[i] == WINESC_REND_END) && (wmbc->buf->numrend < MAX_WINMSG_REND)) {
-		r = 0;
-		rbuf[i] = '\0';
-		if (i != 1 || rbuf[0] != WINESC_REND_POP)
-			r = ParseAttrColor(rbuf, 0);
-		AddWinMsgRend(wmbc->buf, wmbc->p, r);
-	}
-	*src += i;
+	if (op->closed && (wmbc->buf->numrend < MAX_WINMSG_REND))
+		AddWinMsgRend(wmbc->buf, wmbc->p, op->rend);
 }
 
 winmsg_esc(SessName)
 {
-	char *session_name = strchr(SocketName, '.') + 1;
+	/* ImmorTerm: of the hosted session the command or display is for, see
+	 * HostedOpen() */
+	Hosted *h = CommandHosted();
+	char *session_name = strchr(h ? h->h_name : SocketName, '.') + 1;
 
 	if (*wmbc_strcpy(wmbc, session_name))
 		wmc_set(cond);
@@ -563,6 +551,28 @@ winmsg_esc_ex(WinSize, Window *win)
 		wmbc_printf(wmbc, "%dx%d", win->w_width, win->w_height);
 }
 
+/* ImmorTerm: what the window read in the last second, as ls -h shows
+ * sizes; the condition is true if it read anything */
+winmsg_esc_ex(WinRate, Window *win)
+{
+	static const char units[] = "KMGT";
+	double rate;
+	int u;
+
+	if (!win)
+		return;
+	rate = WindowRate(win);
+	if (rate < 1024) {
+		wmbc_printf(wmbc, "%*.0f", esc->num, rate);
+	} else {
+		for (u = 0; rate >= 1024 && units[u]; u++)
+			rate /= 1024;
+		wmbc_printf(wmbc, rate < 10 ? "%*.1f%c" : "%*.0f%c", esc->num ? esc->num - 1 : 0, rate, units[u - 1]);
+	}
+	if (rate > 0)
+		wmc_set(cond);
+}
+
 winmsg_esc_ex(WinTitle, Window *win)
 {
 	if (!win)
@@ -620,7 +630,7 @@ static void _MakeWinMsgEvRec(WinMsgBufContext *wmbc, WinMsgCond *cond, char *str
                              Window *win, int *tick, int rec)
 {
 	int oldtick = *tick;
-	WinMsgBuf *tmp = wmb_create();
+	WinMsgBuf *tmp = wmb_acquire();
 
 	if (tmp == NULL)
 		Panic(0, "%s", strnomem);
@@ -634,7 +644,58 @@ static void _MakeWinMsgEvRec(WinMsgBufContext *wmbc, WinMsgCond *cond, char *str
 	if (!*tick || oldtick < *tick)
 		*tick = oldtick;
 
-	wmb_free(tmp);
+	wmb_release(tmp);
+}
+
+/* Look up the compiled form of a format string, compiling it on a miss.
+ * Format strings are few and evaluated over and over (hardstatus, caption,
+ * windowlist), so a handful of them are kept; the contents are compared
+ * because callers may rewrite a string in place. Backtick and %h output
+ * gets a cache of its own, so that a backtick whose output keeps changing
+ * cannot push the format strings out. */
+static WinMsgProg *WinMsgProgram(const char *str, int chesc)
+{
+	static WinMsgProg *caches[2][WINMSG_PROGCACHE];
+	WinMsgProg **cache = caches[chesc == WINMSG_BT_ESC];
+	WinMsgProg *prog;
+	int i;
+
+	for (i = 0; i < WINMSG_PROGCACHE && cache[i]; i++) {
+		prog = cache[i];
+		if (prog->chesc == chesc && !strcmp(prog->src, str)) {
+			memmove(cache + 1, cache, i * sizeof(*cache));
+			cache[0] = prog;
+			return prog;
+		}
+	}
+
+	if ((prog = wmp_compile(str, chesc)) == NULL)
+		Panic(0, "%s", strnomem);
+
+	for (i = 0; i < prog->nops; i++) {
+		WinMsgOp *op = &prog->ops[i];
+		char rbuf[RENDBUF_SIZE];
+
+		if (op->type != WMOP_REND || !op->closed)
+			continue;
+		if (op->len == 1 && op->str[0] == WINESC_REND_POP)
+			continue;
+		memcpy(rbuf, op->str, op->len);
+		rbuf[op->len] = '\0';
+		op->rend = ParseAttrColor(rbuf, 0);
+	}
+
+	/* evict the least recently used program that is not being evaluated */
+	for (i = WINMSG_PROGCACHE - 1; i >= 0; i--)
+		if (!cache[i] || !cache[i]->refs)
+			break;
+	if (i < 0)
+		return prog;
+	wmp_free(cache[i]);
+	memmove(cache + 1, cache, i * sizeof(*cache));
+	cache[0] = prog;
+	prog->cached = true;
+	return prog;
 }
 
 /* TODO: const char *str for safety and reassurance */
@@ -645,16 +706,13 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 	int qmnumrend = 0;
 	int numpad = 0;
 	int lastpad = 0;
-	WinMsgBufContext *wmbc;
+	WinMsgBufContext wmbcs, *wmbc = &wmbcs;
 	WinMsgEsc esc;
-	WinMsgCond *cond;
+	WinMsgCond conds, *cond = &conds;
+	WinMsgProg *prog;
 
 	struct tm *tm;
 	struct timeval now;
-	tm = 0;
-	gettimeofday(&now, NULL);
-	time_t nowsec = now.tv_sec;
-	tm = localtime(&nowsec);
 
 	/* TODO: temporary to work into existing code */
 	if (winmsg == NULL) {
@@ -668,10 +726,6 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 	if (rec > WINMSG_RECLIMIT)
 		return winmsg->buf;
 
-	cond = calloc(1, sizeof(WinMsgCond));
-	if (cond == NULL)
-		Panic(0, "%s", strnomem);
-
 	/* set to sane state (clear garbage) */
 	wmc_deinit(cond);
 
@@ -680,54 +734,45 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 		winmsg->numrend = 0;
 
 	wmb_reset(winmsg);
-	wmbc = wmbc_create(winmsg);
-
-	if (wmbc == NULL)
-		Panic(0, "%s", strnomem);
+	wmbc_init(wmbc, winmsg);
 
 	tick = 0;
-	gettimeofday(&now, NULL);
-	for (char *s = str; *s; s++) {
-		if (*s != chesc) {
-			if ((chesc == '%') && (*s == '^')) {
-				s++;
-				if (*s != '^' && *s >= 64)
-					wmbc_putchar(wmbc, *s & 0x1f);
-				continue;
-			}
-			wmbc_putchar(wmbc, *s);
-			continue;
+	SchedWalltime(&now);
+	prog = WinMsgProgram(str, chesc);
+	prog->refs++;
+	/* localtime() is not free (it may reread the zone, which without TZ
+	 * glibc does on every call, opening the file); skip it for strings
+	 * that never show the date or the time and call it once a second */
+	if (prog->clock) {
+		static time_t lastsec = -1;
+		static struct tm lasttm;
+
+		if (now.tv_sec != lastsec) {
+			lastsec = now.tv_sec;
+			lasttm = *localtime(&lastsec);
 		}
-
-		if (*++s == chesc)	/* double escape ? */
+		tm = &lasttm;
+	} else
+		tm = NULL;
+	for (int i = 0; i < prog->nops; i++) {
+		WinMsgOp *op = &prog->ops[i];
+		char *s = &op->chr;
+
+		if (op->type == WMOP_TEXT) {
+			wmbc_strncpy(wmbc, op->str, op->len);
 			continue;
+		}
 
-		/* initialize escape */
-		if ((esc.flags.plus = (*s == '+')) != 0)
-			s++;
-		if ((esc.flags.minus = (*s == '-')) != 0)
-			s++;
-		if ((esc.flags.zero = (*s == '0')) != 0)
-			s++;
-		esc.num = 0;
-		while (*s >= '0' && *s <= '9')
-			esc.num = esc.num * 10 + (*s++ - '0');
-		if ((esc.flags.lng = (*s == 'L')) != 0)
-			s++;
-
-	        if (!tick || tick > 3600)
-		        tick = 3600;
+		esc = op->esc;
+		if (op->tick && (!tick || tick > op->tick))
+			tick = op->tick;
 
 		switch (*s) {
 		case WINESC_TIME:
 			__WinMsgEscEsc_TIME(wmbc, tm, esc);
-			if (!tick || tick > 60)
-				tick = 60;
 			break;
 		case WINESC_time:
 			__WinMsgEscEsc_time(wmbc, tm, esc);
-			if (!tick || tick > 60)
-				tick = 60;
 			break;
 		case WINESC_HOUR:
 			__WinMsgEscEsc_HOUR(wmbc, tm);
@@ -758,6 +803,13 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 			break;
 		case WINESC_COND_ELSE:
 			WinMsgDoEscEx(CondElse, &qmnumrend);
+			/* the true branch was kept, so the closing %? throws away
+			 * whatever the else branch produces */
+			if (op->jump >= 0 && wmc_is_active(cond) && !wmc_is_set(cond)) {
+				if (op->jumptick && (!tick || tick > op->jumptick))
+					tick = op->jumptick;
+				i = op->jump - 1;
+			}
 			break;
 		case WINESC_HSTATUS:
 			WinMsgDoEscEx(Hstatus, win, &tick, rec);
@@ -786,7 +838,7 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 			WinMsgDoEscEx(WinGroup, win);
 			break;
 		case WINESC_REND_START:
-			WinMsgDoEsc(Rend);
+			WinMsgDoEscEx(Rend, op);
 			break;
 		case WINESC_HOST:
 			WinMsgDoEsc(HostName);
@@ -830,8 +882,13 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 		case WINESC_WIN_TTY:
 			WinMsgDoEscEx(WinTty, win);
 			break;
+		case WINESC_WIN_RATE:
+			WinMsgDoEscEx(WinRate, win);
+			break;
 		}
 	}
+	if (--prog->refs == 0 && !prog->cached)
+		wmp_free(prog);
 	if (wmc_is_active(cond) && !wmc_is_set(cond))
 		wmbc->p = wmbc->buf->buf + wmc_end(cond, wmbc_offset(wmbc), NULL) + 1;
 	wmbc_putchar(wmbc, '\0' );
@@ -846,16 +903,11 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 		ev->timeout = 0;
 	}
 	if (ev && tick) {
-		now.tv_usec = 100000;
-		if (tick == 1)
-			now.tv_sec++;
-		else
-			now.tv_sec += tick - (now.tv_sec % tick);
-		ev->timeout = (now.tv_sec * 1000 + now.tv_usec / 1000);
+		/* aligned to the wall clock, timed on the monotonic one */
+		time_t next = now.tv_sec + (tick == 1 ? 1 : tick - (now.tv_sec % tick));
+		SetTimeout(ev, (next - now.tv_sec) * 1000 + 100 - now.tv_usec / 1000);
 	}
 
-	free(cond);
-	wmbc_free(wmbc);
 	return winmsg->buf;
 }
 
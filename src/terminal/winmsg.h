@@ -42,64 +42,9 @@
 #include "window.h"
 #include "winmsgbuf.h"
 #include "winmsgcond.h"
+#include "winmsgprog.h"
 #include "backtick.h"
 
-#define RENDBUF_SIZE 128 /* max rendition byte count */
-
-/* escape characters (alphabetical order) */
-typedef enum {
-	WINESC_HOUR            = 'A',
-	WINESC_hour            = 'a',
-	WINESC_TIME            = 'C',
-	WINESC_time            = 'c',
-	WINESC_DAY             = 'D',
-	WINESC_day             = 'd',
-	WINESC_ESC_SEEN        = 'E',
-	WINESC_FOCUS           = 'F',
-	WINESC_WFLAGS          = 'f',
-	WINESC_WIN_GROUP       = 'g',
-	WINESC_HOST            = 'H',
-	WINESC_HSTATUS         = 'h',
-	WINESC_LAST_ACTIVITY   = 'I',  /* last I/O activity timestamp (ImmorTerm) */
-	WINESC_MONTH           = 'M',
-	WINESC_month           = 'm',
-	WINESC_WIN_LOGNAME     = 'N',
-	WINESC_WIN_NUM         = 'n',
-	WINESC_WIN_COUNT       = 'O',
-	WINESC_PID             = 'p',
-	WINESC_COPY_MODE       = 'P',  /* copy/_P_aste mode */
-	WINESC_SESS_NAME       = 'S',
-	WINESC_WIN_SIZE        = 's',
-	WINESC_WIN_TTY         = 'T',
-	WINESC_WIN_TITLE       = 't',
-	WINESC_WIN_NAMES_NOCUR = 'W',
-	WINESC_WIN_NAMES       = 'w',
-	WINESC_CMD             = 'X',
-	WINESC_CMD_ARGS        = 'x',
-	WINESC_YEAR            = 'Y',
-	WINESC_year            = 'y',
-	WINESC_REND_START      = '{',
-	WINESC_REND_END        = '}',
-	WINESC_REND_POP        = '-',
-	WINESC_COND            = '?',  /* start and end delimiter */
-	WINESC_COND_ELSE       = ':',
-	WINESC_BACKTICK        = '`',
-	WINESC_PAD             = '=',
-	WINESC_TRUNC           = '<',
-	WINESC_TRUNC_POS       = '>',
-} WinMsgEscapeChar;
-
-/* escape sequence */
-typedef struct {
-	int num;
-	struct {
-		bool zero  : 1;
-		bool lng   : 1;
-		bool minus : 1;
-		bool plus  : 1;
-	} flags;
-} WinMsgEsc;
-
 char *MakeWinMsg(char *, Window *, int);
 char *MakeWinMsgEv(WinMsgBuf *, char *, Window *, int, int, Event *, int);
 int   AddWinMsgRend(WinMsgBuf *, const char *, uint64_t);
@@ -120,6 +120,49 @@ void wmb_free(WinMsgBuf *w)
 }
 
 
+/* Scratch buffers handed out by wmb_acquire(); a message is evaluated and
+ * consumed before the next one starts, so a few buffers (one per nesting
+ * level of backticks and %h) serve every display */
+#define WMB_POOL_SIZE 16
+static WinMsgBuf *wmb_pool[WMB_POOL_SIZE];
+static int wmb_npool;
+
+/* Get an empty buffer, reusing a released one when possible. The buffer keeps
+ * the size it grew to, so in steady state this does not allocate. */
+WinMsgBuf *wmb_acquire(void)
+{
+	if (wmb_npool > 0) {
+		WinMsgBuf *w = wmb_pool[--wmb_npool];
+		wmb_reset(w);
+		return w;
+	}
+	return wmb_create();
+}
+
+/* Return a buffer obtained from wmb_acquire() for reuse */
+void wmb_release(WinMsgBuf *w)
+{
+	if (w == NULL)
+		return;
+	if (wmb_npool < WMB_POOL_SIZE) {
+		wmb_pool[wmb_npool++] = w;
+		return;
+	}
+	wmb_free(w);
+}
+
+
+/* Initialize a caller-provided buffer context for the given buffer, positioned
+ * at its start and with no truncation mark. */
+void wmbc_init(WinMsgBufContext *c, WinMsgBuf *w)
+{
+	c->buf = w;
+	c->p = w->buf;
+	c->trunc.pos = -1;
+	c->trunc.perc = 0;
+	c->trunc.ellip = false;
+}
+
 /* Allocate and initialize a buffer context for the given buffer. The return
  * value must be freed using wmbc_free. */
 WinMsgBufContext *wmbc_create(WinMsgBuf *w)
@@ -131,8 +174,7 @@ WinMsgBufContext *wmbc_create(WinMsgBuf *w)
 	if (c == NULL)
 		return NULL;
 
-	c->buf = w;
-	c->p = w->buf;
+	wmbc_init(c, w);
 	return c;
 }
 
@@ -68,7 +68,10 @@ size_t wmb_size(const WinMsgBuf *);
 const char *wmb_contents(const WinMsgBuf *);
 void wmb_reset(WinMsgBuf *);
 void wmb_free(WinMsgBuf *);
+WinMsgBuf *wmb_acquire(void);
+void wmb_release(WinMsgBuf *);
 
+void wmbc_init(WinMsgBufContext *, WinMsgBuf *);
 WinMsgBufContext *wmbc_create(WinMsgBuf *);
 void wmbc_rewind(WinMsgBufContext *);
 void wmbc_fastfw0(WinMsgBufContext *);
@@ -0,0 +1,266 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include "winmsgprog.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static WinMsgOp *wmp_newop(WinMsgProg *prog, int *size, WinMsgOpType type)
+{
+	WinMsgOp *op;
+
+	if (prog->nops == *size) {
+		int nsize = *size ? *size * 2 : 16;
+		WinMsgOp *nops = realloc(prog->ops, nsize * sizeof(WinMsgOp));
+		if (nops == NULL)
+			return NULL;
+		prog->ops = nops;
+		*size = nsize;
+	}
+	op = &prog->ops[prog->nops++];
+	memset(op, 0, sizeof(WinMsgOp));
+	op->type = type;
+	op->jump = -1;
+	return op;
+}
+
+/* Escapes that read the broken-down local time. */
+static bool wmp_clock(char chr)
+{
+	switch (chr) {
+	case WINESC_HOUR:
+	case WINESC_hour:
+	case WINESC_TIME:
+	case WINESC_time:
+	case WINESC_DAY:
+	case WINESC_day:
+	case WINESC_MONTH:
+	case WINESC_month:
+	case WINESC_YEAR:
+	case WINESC_year:
+		return true;
+	}
+	return false;
+}
+
+/* How often the output of an escape may change without anything telling
+ * WindowChanged() about it. Clocks and calendar fields run on their own;
+ * formatting directives never change, and the listed escapes are all
+ * refreshed by the code that changes them. Anything else keeps the hourly
+ * refresh screen always had. */
+static int wmp_tick(char chr)
+{
+	switch (chr) {
+	case WINESC_TIME:
+	case WINESC_time:
+		return 60;
+	case WINESC_WIN_RATE:
+		return 1;
+	case WINESC_REND_START:
+	case WINESC_COND:
+	case WINESC_COND_ELSE:
+	case WINESC_PAD:
+	case WINESC_TRUNC:
+	case WINESC_TRUNC_POS:
+	case WINESC_LAST_ACTIVITY:
+	case WINESC_WIN_TITLE:
+	case WINESC_WIN_NAMES:
+	case WINESC_WIN_NAMES_NOCUR:
+	case WINESC_WFLAGS:
+	case WINESC_HSTATUS:	/* its own escapes count */
+	case WINESC_BACKTICK:	/* runbacktick() knows its period */
+	case WINESC_SESS_NAME:
+	case WINESC_COPY_MODE:
+	case WINESC_ESC_SEEN:
+	case WINESC_FOCUS:
+		return 0;
+	}
+	return 3600;
+}
+
+/* Escapes that leave state behind for later ops; an else branch containing
+ * one of them has to be evaluated even when its output is thrown away. */
+static bool wmp_sideeffect(const WinMsgOp *op)
+{
+	if (op->type != WMOP_ESC)
+		return false;
+
+	switch (op->chr) {
+	case WINESC_PAD:
+	case WINESC_TRUNC:
+	case WINESC_TRUNC_POS:
+	case WINESC_BACKTICK:
+	case WINESC_HSTATUS:
+	case WINESC_COND_ELSE:
+		return true;
+	}
+	return false;
+}
+
+/* An else branch is discarded by the closing %? whenever the true branch was
+ * kept. If nothing in it has side effects, let it be jumped over, recording
+ * the refresh interval its escapes would have asked for. */
+static void wmp_linkelse(WinMsgProg *prog, int els, int end)
+{
+	int tick = 0;
+
+	for (int i = els + 1; i < end; i++) {
+		const WinMsgOp *op = &prog->ops[i];
+
+		if (wmp_sideeffect(op))
+			return;
+		if (op->tick && (!tick || op->tick < tick))
+			tick = op->tick;
+	}
+	prog->ops[els].jump = end;
+	prog->ops[els].jumptick = tick;
+}
+
+static void wmp_linkconds(WinMsgProg *prog)
+{
+	int open = -1;  /* opening %? */
+	int els = -1;   /* first %: after it; -2 if there are several */
+
+	for (int i = 0; i < prog->nops; i++) {
+		const WinMsgOp *op = &prog->ops[i];
+
+		if (op->type != WMOP_ESC)
+			continue;
+		if (op->chr == WINESC_COND) {
+			if (open < 0) {
+				open = i;
+				els = -1;
+				continue;
+			}
+			if (els >= 0)
+				wmp_linkelse(prog, els, i);
+			open = -1;
+		} else if (op->chr == WINESC_COND_ELSE && open >= 0)
+			els = (els == -1) ? i : -2;
+	}
+}
+
+/*
+ * Compile a window message format string. The scan mirrors the one
+ * MakeWinMsgEv() used to do on the raw string, including its treatment of
+ * malformed input, so evaluating the result is indistinguishable from it.
+ */
+WinMsgProg *wmp_compile(const char *str, int chesc)
+{
+	WinMsgProg *prog;
+	WinMsgOp *op;
+	int size = 0;
+	size_t len = strlen(str);
+	char *t;
+	bool merge = false;  /* may append to the last WMOP_TEXT */
+
+	if ((prog = calloc(1, sizeof(WinMsgProg))) == NULL)
+		return NULL;
+	prog->chesc = chesc;
+	prog->src = malloc(len + 1);
+	prog->text = malloc(len + 1);
+	if (prog->src == NULL || prog->text == NULL) {
+		wmp_free(prog);
+		return NULL;
+	}
+	memcpy(prog->src, str, len + 1);
+	t = prog->text;
+
+	for (const char *s = prog->src; *s; s++) {
+		if (*s != chesc) {
+			char c = *s;
+
+			if ((chesc == '%') && (*s == '^')) {
+				if (!*++s)
+					break;
+				if (*s == '^' || *s < 64)
+					continue;
+				c = *s & 0x1f;
+			}
+			if (!merge) {
+				if ((op = wmp_newop(prog, &size, WMOP_TEXT)) == NULL)
+					goto nomem;
+				op->str = t;
+			}
+			*t++ = c;
+			op->len++;
+			/* an embedded NUL is copied as a text op of its own */
+			merge = (c != '\0');
+			continue;
+		}
+		merge = false;
+
+		if (*++s == chesc)	/* double escape ? */
+			continue;
+
+		if ((op = wmp_newop(prog, &size, WMOP_ESC)) == NULL)
+			goto nomem;
+		if ((op->esc.flags.plus = (*s == '+')) != 0)
+			s++;
+		if ((op->esc.flags.minus = (*s == '-')) != 0)
+			s++;
+		if ((op->esc.flags.zero = (*s == '0')) != 0)
+			s++;
+		while (*s >= '0' && *s <= '9')
+			op->esc.num = op->esc.num * 10 + (*s++ - '0');
+		if ((op->esc.flags.lng = (*s == 'L')) != 0)
+			s++;
+		op->chr = *s;
+		op->tick = wmp_tick(*s);
+		prog->clock |= wmp_clock(*s);
+		if (!*s)
+			break;
+
+		if (*s == WINESC_REND_START) {
+			size_t i;
+
+			op->type = WMOP_REND;
+			op->str = ++s;
+			for (i = 0; i < RENDBUF_SIZE - 1; i++)
+				if (!s[i] || s[i] == WINESC_REND_END)
+					break;
+			op->len = i;
+			op->closed = (s[i] == WINESC_REND_END);
+			s += i;
+			if (!*s)
+				break;
+		}
+	}
+
+	wmp_linkconds(prog);
+	return prog;
+
+nomem:
+	wmp_free(prog);
+	return NULL;
+}
+
+void wmp_free(WinMsgProg *prog)
+{
+	if (prog == NULL)
+		return;
+	free(prog->ops);
+	free(prog->text);
+	free(prog->src);
+	free(prog);
+}
@@ -0,0 +1,128 @@
+/* Copyright (c) 2026
+ *      ImmorTerm contributors
+ *
+ * This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <https://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#ifndef SCREEN_WINMSGPROG_H
+#define SCREEN_WINMSGPROG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RENDBUF_SIZE 128 /* max rendition byte count */
+
+/* escape characters (alphabetical order) */
+typedef enum {
+	WINESC_HOUR            = 'A',
+	WINESC_hour            = 'a',
+	WINESC_TIME            = 'C',
+	WINESC_time            = 'c',
+	WINESC_DAY             = 'D',
+	WINESC_day             = 'd',
+	WINESC_ESC_SEEN        = 'E',
+	WINESC_FOCUS           = 'F',
+	WINESC_WFLAGS          = 'f',
+	WINESC_WIN_GROUP       = 'g',
+	WINESC_HOST            = 'H',
+	WINESC_HSTATUS         = 'h',
+	WINESC_LAST_ACTIVITY   = 'I',  /* last I/O activity timestamp (ImmorTerm) */
+	WINESC_MONTH           = 'M',
+	WINESC_month           = 'm',
+	WINESC_WIN_LOGNAME     = 'N',
+	WINESC_WIN_NUM         = 'n',
+	WINESC_WIN_COUNT       = 'O',
+	WINESC_PID             = 'p',
+	WINESC_COPY_MODE       = 'P',  /* copy/_P_aste mode */
+	WINESC_WIN_RATE        = 'R',  /* output bytes per second (ImmorTerm) */
+	WINESC_SESS_NAME       = 'S',
+	WINESC_WIN_SIZE        = 's',
+	WINESC_WIN_TTY         = 'T',
+	WINESC_WIN_TITLE       = 't',
+	WINESC_WIN_NAMES_NOCUR = 'W',
+	WINESC_WIN_NAMES       = 'w',
+	WINESC_CMD             = 'X',
+	WINESC_CMD_ARGS        = 'x',
+	WINESC_YEAR            = 'Y',
+	WINESC_year            = 'y',
+	WINESC_REND_START      = '{',
+	WINESC_REND_END        = '}',
+	WINESC_REND_POP        = '-',
+	WINESC_COND            = '?',  /* start and end delimiter */
+	WINESC_COND_ELSE       = ':',
+	WINESC_BACKTICK        = '`',
+	WINESC_PAD             = '=',
+	WINESC_TRUNC           = '<',
+	WINESC_TRUNC_POS       = '>',
+} WinMsgEscapeChar;
+
+/* escape sequence */
+typedef struct {
+	int num;
+	struct {
+		bool zero  : 1;
+		bool lng   : 1;
+		bool minus : 1;
+		bool plus  : 1;
+	} flags;
+} WinMsgEsc;
+
+/*
+ * A window message format string compiled into a list of operations, so
+ * that the string is scanned (and its renditions parsed) once rather than
+ * on every evaluation. Evaluating the ops in order produces exactly what
+ * scanning the source string would.
+ */
+typedef enum {
+	WMOP_TEXT,  /* literal text, with ^X control characters resolved */
+	WMOP_ESC,   /* escape sequence other than a rendition */
+	WMOP_REND,  /* rendition %{...} */
+} WinMsgOpType;
+
+typedef struct {
+	WinMsgOpType type;
+	char         chr;     /* WMOP_ESC: escape character */
+	WinMsgEsc    esc;     /* WMOP_ESC: flags and number */
+	const char  *str;     /* WMOP_TEXT: text; WMOP_REND: spec inside braces */
+	size_t       len;
+	bool         closed;  /* WMOP_REND: spec was terminated by '}' */
+	uint64_t     rend;    /* WMOP_REND: parsed rendition, set by the caller */
+	int          tick;    /* seconds until the output may change on its own;
+	                       * 0 if only an event (WindowChanged) changes it */
+	int          jump;    /* WINESC_COND_ELSE: index of the closing %? if
+	                       * the else branch may be skipped, otherwise -1 */
+	int          jumptick; /* shortest tick in the skipped branch */
+} WinMsgOp;
+
+typedef struct {
+	char     *src;    /* copy of the source string */
+	int       chesc;  /* escape character it was compiled for */
+	WinMsgOp *ops;
+	int       nops;
+	char     *text;   /* storage for WMOP_TEXT */
+	bool      clock;  /* uses a date or time escape */
+	int       refs;   /* evaluations in progress (caller managed) */
+	bool      cached; /* owned by a cache (caller managed) */
+} WinMsgProg;
+
+WinMsgProg *wmp_compile(const char *, int);
+void        wmp_free(WinMsgProg *);
+
+#endif /* SCREEN_WINMSGPROG_H */